@@ -113,6 +113,8 @@ extern const __declspec(selectany) GUID FspFsvrtDeviceClassGuid =
     CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0x800 + 'n', METHOD_NEITHER, FILE_ANY_ACCESS)
 #define FSP_FSCTL_UNLOAD                \
     CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0x800 + 'U', METHOD_NEITHER, FILE_ANY_ACCESS)
+#define FSP_FSCTL_DATA_RING             \
+    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0x800 + 'R', METHOD_BUFFERED, FILE_ANY_ACCESS)
 
 /* fsctl internal device codes (usable only in-kernel) */
 #define FSP_FSCTL_TRANSACT_INTERNAL     \
@@ -188,6 +190,11 @@ enum
     FspFsctlIrpCapacityMinimum = 100,
     FspFsctlIrpCapacityMaximum = 1000,
     FspFsctlIrpCapacityDefault = 1000,
+    FspFsctlReadSplitSizeMinimum = 64 * 1024,
+    FspFsctlNegativeLookupTimeoutMaximum = 60000,
+    FspFsctlDataRingSlotSizeMaximum = 1024 * 1024,
+    FspFsctlDataRingSlotCountMaximum = 256,
+    FspFsctlDataRingSizeMaximum = 64 * 1024 * 1024,
 };
 #define FSP_FSCTL_VOLUME_PARAMS_V0_FIELD_DEFN\
     UINT16 Version;                     /* set to 0 or sizeof(FSP_FSCTL_VOLUME_PARAMS) */\
@@ -250,8 +257,10 @@ enum
     UINT32 StreamInfoTimeout;           /* stream info timeout (millis); overrides FileInfoTimeout */\
     UINT32 EaTimeout;                   /* EA timeout (millis); overrides FileInfoTimeout */\
     UINT32 FsextControlCode;\
+    UINT32 ReadSplitSize;               /* split non-cached reads larger than this (bytes; 0: no split) */\
+    UINT32 NegativeLookupTimeout;       /* cache nonexistent names (millis; 0: no cache; max 1 min) */\
     UINT32 Reserved32[1];\
-    UINT64 Reserved64[2];
+    UINT64 Reserved64[1];
 typedef struct
 {
     FSP_FSCTL_VOLUME_PARAMS_V0_FIELD_DEFN
@@ -275,6 +284,13 @@ typedef struct
 FSP_FSCTL_STATIC_ASSERT(88 == sizeof(FSP_FSCTL_VOLUME_INFO),
     "sizeof(FSP_FSCTL_VOLUME_INFO) must be exactly 88.");
 typedef struct
+{
+    /* WinFsp specific statistics; each per-processor FSCTL_FILESYSTEM_GET_STATISTICS record
+     * contains these after its FILESYSTEM_STATISTICS and FAT_STATISTICS parts */
+    UINT32 NegativeLookupHits;          /* opens failed from the negative name cache */
+    UINT32 NegativeLookupMisses;        /* opens that consulted the negative name cache and missed */
+} FSP_FSCTL_STATISTICS;
+typedef struct
 {
     UINT32 FileAttributes;
     UINT32 ReparseTag;
@@ -328,6 +344,26 @@ typedef struct
 } FSP_FSCTL_NOTIFY_INFO;
 FSP_FSCTL_STATIC_ASSERT(12 == sizeof(FSP_FSCTL_NOTIFY_INFO),
     "sizeof(FSP_FSCTL_NOTIFY_INFO) must be exactly 12.");
+#define FSP_FSCTL_NOTIFY_ACTION_RANGE   0x80000000  /* record is FSP_FSCTL_NOTIFY_RANGE_INFO */
+#define FSP_FSCTL_NOTIFY_FILESIZE_UNCHANGED ((UINT64)-1)
+typedef struct
+{
+    UINT16 Size;
+    UINT32 Filter;
+    UINT32 Action;                      /* FILE_ACTION_* | FSP_FSCTL_NOTIFY_ACTION_RANGE */
+    UINT64 Offset;                      /* changed byte range */
+    UINT64 Length;
+    UINT64 FileSize;                    /* new file size or FSP_FSCTL_NOTIFY_FILESIZE_UNCHANGED */
+    WCHAR FileNameBuf[];
+} FSP_FSCTL_NOTIFY_RANGE_INFO;
+FSP_FSCTL_STATIC_ASSERT(40 == sizeof(FSP_FSCTL_NOTIFY_RANGE_INFO),
+    "sizeof(FSP_FSCTL_NOTIFY_RANGE_INFO) must be exactly 40.");
+/* data ring: replaces the process buffer for double buffered Read requests */
+typedef struct
+{
+    UINT32 SlotSize;                    /* bytes per slot (rounded up to a page multiple) */
+    UINT32 SlotCount;                   /* number of slots (must be a power of 2) */
+} FSP_FSCTL_DATA_RING_PARAMS;
 typedef struct
 {
     UINT64 UserContext;
@@ -402,6 +438,13 @@ typedef struct
             UINT64 Offset;
             UINT32 Length;
             UINT32 Key;
+            /* access pattern hints (advisory; computed per file handle by the FSD) */
+            UINT32 Sequential:1;        /* read continues the previous read on this handle */
+            UINT32 SequentialOnly:1;    /* handle opened with FILE_SEQUENTIAL_ONLY */
+            UINT32 RandomAccess:1;      /* handle opened with FILE_RANDOM_ACCESS */
+            UINT32 PagingIo:1;          /* read originates from the cache manager or a mapped view */
+            UINT32 SequentialCount;     /* number of consecutive sequential reads (saturating) */
+            UINT32 ReadAheadLength;     /* recommended prefetch beyond Offset + Length (0: none) */
         } Read;
         struct
         {
@@ -693,6 +736,8 @@ FSP_API NTSTATUS FspFsctlStop(HANDLE VolumeHandle);
 FSP_API NTSTATUS FspFsctlStop0(HANDLE VolumeHandle);
 FSP_API NTSTATUS FspFsctlNotify(HANDLE VolumeHandle,
     FSP_FSCTL_NOTIFY_INFO *NotifyInfo, SIZE_T Size);
+FSP_API NTSTATUS FspFsctlCreateDataRing(HANDLE VolumeHandle,
+    UINT32 SlotSize, UINT32 SlotCount);
 FSP_API NTSTATUS FspFsctlGetVolumeList(PWSTR DevicePath,
     PWCHAR VolumeListBuf, PSIZE_T PVolumeListSize);
 FSP_API NTSTATUS FspFsctlPreflight(PWSTR DevicePath);
@@ -69,6 +69,7 @@ enum
     FspLaunchCmdStop                    = 'T',  /* requires: SERVICE_STOP */
     FspLaunchCmdGetInfo                 = 'I',  /* requires: SERVICE_QUERY_STATUS */
     FspLaunchCmdGetNameList             = 'L',  /* requires: none*/
+    FspLaunchCmdReload                  = 'R',  /* requires: Administrators or SE_BACKUP_NAME */
     FspLaunchCmdDefineDosDevice         = 'D',  /* internal: do not use! */
     FspLaunchCmdQuit                    = 'Q',  /* DEBUG version only */
 };
@@ -422,6 +422,11 @@ typedef struct _FSP_FILE_SYSTEM_INTERFACE
     /**
      * Read a file.
      *
+     * The FSD also passes access pattern hints (sequential access detection and a recommended
+     * read-ahead length) in the Read request. File systems that can prefetch (e.g. because
+     * they are backed by remote storage) may retrieve them using
+     * FspFileSystemGetOperationContext()->Request->Req.Read.
+     *
      * @param FileSystem
      *     The file system on which this request is posted.
      * @param FileContext
@@ -683,7 +688,8 @@ typedef struct _FSP_FILE_SYSTEM_INTERFACE
      * @param Pattern
      *     The pattern to match against files in this directory. Can be NULL. The file system
      *     can choose to ignore this parameter as the FSD will always perform its own pattern
-     *     matching on the returned results.
+     *     matching on the returned results. File systems that filter by the pattern can use
+     *     FspFileNamePatternCompile and FspFileSystemReadDirectoryBufferEx.
      * @param Marker
      *     A file name that marks where in the directory to start reading. Files with names
      *     that are greater than (not equal to) this marker (in the directory order determined
@@ -1084,12 +1090,69 @@ typedef struct _FSP_FILE_SYSTEM_INTERFACE
      */
     VOID (*DispatcherStopped)(FSP_FILE_SYSTEM *FileSystem,
         BOOLEAN Normally);
+    /**
+     * Open a file or directory and get its security descriptor.
+     *
+     * This operation is optional. It combines the GetSecurityByName and Open operations for
+     * file systems that can retrieve the security descriptor of a file as part of opening it;
+     * such file systems otherwise resolve the file name twice for every open. When this
+     * operation is present (and GetSecurityByName is also present) the FSP_FILE_SYSTEM uses
+     * it to open existing files, unless a traverse check is required for the open, in which
+     * case GetSecurityByName and Open are used as usual.
+     *
+     * The access check is performed after this operation returns, using the returned file
+     * attributes and security descriptor. If the access check fails, the file is closed using
+     * the Close operation. For this reason the DesiredAccess parameter contains the access
+     * that is being requested rather than the access that has been granted and the file system
+     * must not rely on it for access control.
+     *
+     * @param FileSystem
+     *     The file system on which this request is posted.
+     * @param FileName
+     *     The name of the file or directory to be opened.
+     * @param CreateOptions
+     *     Create options for this request. See Open.
+     * @param DesiredAccess
+     *     Requested access to the opened file. The access check has not been performed yet.
+     * @param PFileContext [out]
+     *     Pointer that will receive the file context on successful return from this call.
+     * @param FileInfo [out]
+     *     Pointer to a structure that will receive the file information on successful return
+     *     from this call. This information includes file attributes, file times, etc.
+     * @param SecurityDescriptor
+     *     Pointer to a buffer that will receive the file security descriptor on successful return
+     *     from this call.
+     * @param PSecurityDescriptorSize [in,out]
+     *     Pointer to the security descriptor buffer size. On input it contains the size of the
+     *     security descriptor buffer. On output it will contain the actual size of the security
+     *     descriptor copied into the security descriptor buffer.
+     * @return
+     *     STATUS_SUCCESS, STATUS_REPARSE, STATUS_BUFFER_OVERFLOW or error code.
+     *
+     *     STATUS_BUFFER_OVERFLOW should be returned, without opening the file, when the security
+     *     descriptor does not fit in the security descriptor buffer; *PSecurityDescriptorSize
+     *     should then contain the required size and the operation will be retried.
+     *
+     *     STATUS_REPARSE should be returned, without opening the file, when the file system
+     *     encounters a FileName that contains reparse points anywhere but the final path
+     *     component, or when it cannot otherwise perform the combined open (for example, because
+     *     closing the file after a failed access check would have side effects); the open will
+     *     then proceed through GetSecurityByName and Open.
+     * @see
+     *     GetSecurityByName
+     *     Open
+     *     Close
+     */
+    NTSTATUS (*OpenWithSecurity)(FSP_FILE_SYSTEM *FileSystem,
+        PWSTR FileName, UINT32 CreateOptions, UINT32 DesiredAccess,
+        PVOID *PFileContext, FSP_FSCTL_FILE_INFO *FileInfo,
+        PSECURITY_DESCRIPTOR SecurityDescriptor, SIZE_T *PSecurityDescriptorSize);
 
     /*
      * This ensures that this interface will always contain 64 function pointers.
      * Please update when changing the interface as it is important for future compatibility.
      */
-    NTSTATUS (*Reserved[31])();
+    NTSTATUS (*Reserved[30])();
 } FSP_FILE_SYSTEM_INTERFACE;
 FSP_FSCTL_STATIC_ASSERT(sizeof(FSP_FILE_SYSTEM_INTERFACE) == 64 * sizeof(NTSTATUS (*)()),
     "FSP_FILE_SYSTEM_INTERFACE must have 64 entries.");
@@ -1143,7 +1206,11 @@ FSP_API NTSTATUS FspFileSystemPreflight(PWSTR DevicePath,
  *
  * @param DevicePath
  *     The name of the control device for this file system. This must be either
- *     FSP_FSCTL_DISK_DEVICE_NAME or FSP_FSCTL_NET_DEVICE_NAME.
+ *     FSP_FSCTL_DISK_DEVICE_NAME or FSP_FSCTL_NET_DEVICE_NAME. It may also be NULL, in which
+ *     case the file system object is not attached to the FSD: it cannot be mounted or
+ *     dispatched and may only be driven in-process (see FspFileSystemReplayTrace). Functions
+ *     that require the FSD (mounting, dispatching, notifications) return
+ *     STATUS_INVALID_DEVICE_REQUEST for such a file system object.
  * @param VolumeParams
  *     Volume parameters for the newly created file system.
  * @param Interface
@@ -1239,6 +1306,130 @@ FSP_API VOID FspFileSystemStopDispatcher(FSP_FILE_SYSTEM *FileSystem);
  */
 FSP_API VOID FspFileSystemSendResponse(FSP_FILE_SYSTEM *FileSystem,
     FSP_FSCTL_TRANSACT_RSP *Response);
+typedef struct _FSP_FILE_SYSTEM_REPLAY_STATISTICS
+{
+    UINT64 RequestCount;                /* requests replayed */
+    UINT64 SkippedCount;                /* requests skipped (e.g. unknown file context) */
+    UINT64 MismatchCount;               /* requests whose status differs from the recorded one */
+    UINT64 PendingCount;                /* requests that the file system completed asynchronously */
+    UINT64 DroppedCount;                /* records dropped while the trace was recorded */
+} FSP_FILE_SYSTEM_REPLAY_STATISTICS;
+enum
+{
+    FspFileSystemReplayTimed            = 0x00000001,
+};
+/**
+ * Replay a binary trace against a file system.
+ *
+ * The requests in a trace recorded with FspDebugLogStartTrace (preferably with
+ * FspDebugLogTraceNoDrop) are fed in timestamp order to the file system operations,
+ * exactly as the dispatcher would, but on the calling thread and without the FSD. File
+ * contexts from the recorded responses are mapped to the ones produced by the replay.
+ * Requests are performed in the security context of the calling process and the I/O buffers
+ * of Read, Write and QueryDirectory requests point to scratch memory.
+ *
+ * The file system object is usually created with a NULL DevicePath (see FspFileSystemCreate)
+ * and it must not be running a dispatcher.
+ *
+ * @param FileSystem
+ *     The file system object.
+ * @param Handle
+ *     Handle to the trace file.
+ * @param Flags
+ *     FspFileSystemReplayTimed to honor the time between recorded requests; otherwise requests
+ *     are replayed as fast as possible.
+ * @param Statistics [out]
+ *     Pointer to a structure that will receive replay statistics. May be NULL.
+ * @return
+ *     STATUS_SUCCESS or error code.
+ */
+FSP_API NTSTATUS FspFileSystemReplayTrace(FSP_FILE_SYSTEM *FileSystem,
+    HANDLE Handle, ULONG Flags, FSP_FILE_SYSTEM_REPLAY_STATISTICS *Statistics);
+#define FSP_FILE_SYSTEM_OPERATION_HISTOGRAM_COUNT 24
+typedef struct _FSP_FILE_SYSTEM_OPERATION_STATISTICS
+{
+    UINT64 Count;                       /* operations dispatched */
+    UINT64 ErrorCount;                  /* operations that completed with an error status */
+    UINT64 TotalTime;                   /* total time in 100ns units */
+    UINT64 MaxTime;                     /* longest time in 100ns units */
+    UINT64 Histogram[FSP_FILE_SYSTEM_OPERATION_HISTOGRAM_COUNT];
+        /* Histogram[0]: < 1us; Histogram[i]: [2^(i-1), 2^i) us; last bucket: everything longer */
+} FSP_FILE_SYSTEM_OPERATION_STATISTICS;
+/**
+ * Get per operation statistics.
+ *
+ * The dispatcher measures the time it takes to process every request, from the time that
+ * the operation guard is entered until the operation returns, and keeps a count, an error
+ * count, the total and maximum time and a latency histogram for every kind of request.
+ * Requests that are completed asynchronously (STATUS_PENDING) are measured until the
+ * operation returns.
+ *
+ * Statistics are kept per request kind and not per file system interface callback; for
+ * example, the Create statistics include the time spent in GetSecurityByName as well as in
+ * Open or Create. The time that a request spends queued in the FSD before it is retrieved
+ * by a dispatcher thread is not measured.
+ *
+ * Every dispatcher thread keeps its own statistics, so that collecting them requires no
+ * synchronization; they are merged when queried. Because they are updated without
+ * synchronization, the statistics of a running file system are approximate.
+ *
+ * Operation statistics are enabled by default; see FspFileSystemSetOperationStatistics.
+ *
+ * @param FileSystem
+ *     The file system object.
+ * @param Statistics [out]
+ *     Array that receives the statistics indexed by request kind (e.g.
+ *     FspFsctlTransactReadKind). It should have FspFsctlTransactKindCount elements.
+ * @param Count
+ *     Number of elements in the Statistics array.
+ * @return
+ *     STATUS_SUCCESS or error code.
+ * @see
+ *     FspFileSystemGetVolumeOperationStatistics
+ */
+FSP_API NTSTATUS FspFileSystemGetOperationStatistics(FSP_FILE_SYSTEM *FileSystem,
+    FSP_FILE_SYSTEM_OPERATION_STATISTICS *Statistics, ULONG Count);
+/**
+ * Get per operation statistics of a file system by its volume name.
+ *
+ * The operation statistics of a file system are kept in a named section that can be read by
+ * other processes (subject to its default security). This function can be used to query
+ * the statistics of a file system that is running in another process; for example,
+ * fsptool uses it to implement its opstat command.
+ *
+ * @param VolumeName
+ *     The volume name of the file system (e.g. \\Device\\Volume{GUID}).
+ * @param Statistics [out]
+ *     Array that receives the statistics indexed by request kind (e.g.
+ *     FspFsctlTransactReadKind). It should have FspFsctlTransactKindCount elements.
+ * @param Count
+ *     Number of elements in the Statistics array.
+ * @return
+ *     STATUS_SUCCESS or error code. STATUS_OBJECT_NAME_NOT_FOUND if there is no file system
+ *     with this volume name that collects operation statistics.
+ * @see
+ *     FspFileSystemGetOperationStatistics
+ */
+FSP_API NTSTATUS FspFileSystemGetVolumeOperationStatistics(PWSTR VolumeName,
+    FSP_FILE_SYSTEM_OPERATION_STATISTICS *Statistics, ULONG Count);
+/**
+ * Enable or disable operation statistics.
+ *
+ * Collecting operation statistics costs two QueryPerformanceCounter calls and a handful
+ * of unsynchronized counter updates per request, which is small compared to the cost of
+ * a request round trip through the FSD. They are enabled by default.
+ *
+ * This function must be called before the file system dispatcher is started.
+ *
+ * @param FileSystem
+ *     The file system object.
+ * @param Enable
+ *     TRUE to collect operation statistics, FALSE otherwise.
+ * @return
+ *     STATUS_SUCCESS or error code.
+ */
+FSP_API NTSTATUS FspFileSystemSetOperationStatistics(FSP_FILE_SYSTEM *FileSystem,
+    BOOLEAN Enable);
 /**
  * Begin notifying Windows that the file system has file changes.
  *
@@ -1297,7 +1488,8 @@ FSP_API NTSTATUS FspFileSystemNotifyEnd(FSP_FILE_SYSTEM *FileSystem);
  * @param FileSystem
  *     The file system object.
  * @param NotifyInfo
- *     Buffer containing information about file changes.
+ *     Buffer containing information about file changes. The buffer may also contain
+ *     byte range information (see FspFileSystemAddNotifyRangeInfo).
  * @param Size
  *     Size of buffer.
  * @return
@@ -1652,6 +1844,44 @@ FSP_API NTSTATUS FspFileSystemResolveReparsePoints(FSP_FILE_SYSTEM *FileSystem,
     PVOID Context,
     PWSTR FileName, UINT32 ReparsePointIndex, BOOLEAN ResolveLastPathComponent,
     PIO_STATUS_BLOCK PIoStatus, PVOID Buffer, PSIZE_T PSize);
+/**
+ * Enable or disable the reparse point cache.
+ *
+ * FspFileSystemFindReparsePoint and FspFileSystemResolveReparsePoints call GetReparsePointByName
+ * for every path component of the paths they examine. When the reparse point cache is enabled
+ * the results of these calls (whether a path is a reparse point and, for reparse points, the
+ * reparse data) are remembered for Timeout milliseconds. This is useful for file systems where
+ * GetReparsePointByName is expensive; for example, FUSE file systems must make a getattr call
+ * for every path component.
+ *
+ * Cached results are invalidated when a file is created, overwritten, renamed, deleted or has
+ * its reparse point set or deleted through the file system operations, as well as when a
+ * change is reported using FspFileSystemNotify. Invalidating a directory also invalidates all
+ * results below it. Changes that are made by other means and are not reported using
+ * FspFileSystemNotify become visible after Timeout milliseconds at most.
+ *
+ * The reparse point cache is keyed on the FileName and IsDirectory arguments only; the Context
+ * argument is not part of the key. File systems that enable the cache must therefore ensure that
+ * their GetReparsePointByName results do not depend on Context; otherwise a result computed
+ * for one caller may be returned to another.
+ *
+ * This function must be called before the file system dispatcher is started.
+ *
+ * @param FileSystem
+ *     The file system object.
+ * @param Timeout
+ *     Time in milliseconds that results are cached. A value of 0 disables the cache.
+ * @param MaxEntries
+ *     Maximum number of cached results. A value of 0 selects a default.
+ * @return
+ *     STATUS_SUCCESS or error code.
+ * @see
+ *     FspFileSystemFindReparsePoint
+ *     FspFileSystemResolveReparsePoints
+ *     FspFileSystemNotify
+ */
+FSP_API NTSTATUS FspFileSystemSetReparsePointCache(FSP_FILE_SYSTEM *FileSystem,
+    ULONG Timeout, ULONG MaxEntries);
 /**
  * Test whether reparse data can be replaced.
  *
@@ -1785,6 +2015,45 @@ UINT32 FspFileSystemGetEaPackedSize(PFILE_FULL_EA_INFORMATION SingleEa)
  */
 FSP_API BOOLEAN FspFileSystemAddNotifyInfo(FSP_FSCTL_NOTIFY_INFO *NotifyInfo,
     PVOID Buffer, ULONG Length, PULONG PBytesTransferred);
+/**
+ * Add byte range notify information to a buffer.
+ *
+ * This is a helper for filling a buffer to use with FspFileSystemNotify. Range notify
+ * information reports that the data of a file changed only in the byte range specified by
+ * the Offset and Length fields. If the file size also changed, the FileSize field should
+ * contain the new file size; otherwise it should be FSP_FSCTL_NOTIFY_FILESIZE_UNCHANGED.
+ *
+ * When the file is open, the FSD will flush and purge only the cached data in the specified
+ * byte range and will update the file size in place; other cached information about the file
+ * (security, extended attributes, streams) is retained. This allows a file system whose files
+ * are modified by a remote party to report small changes to large files without losing the
+ * rest of their cached data.
+ *
+ * Range notify information and regular notify information may be mixed in the same buffer.
+ * This function sets the FSP_FSCTL_NOTIFY_ACTION_RANGE flag in the Action field.
+ *
+ * Drivers prior to v2.1 do not support range notify information. With such a driver
+ * FspFileSystemNotify sends range notify information as regular notify information with
+ * the same Filter and Action, which invalidates all cached information about the file.
+ *
+ * @param NotifyInfo
+ *     The range notify information to add.
+ * @param Buffer
+ *     Pointer to a buffer that will receive the notify information.
+ * @param Length
+ *     Length of buffer.
+ * @param PBytesTransferred [out]
+ *     Pointer to a memory location that will receive the actual number of bytes stored. This should
+ *     be initialized to 0 prior to the first call to FspFileSystemAddNotifyInfo or
+ *     FspFileSystemAddNotifyRangeInfo for a particular buffer.
+ * @return
+ *     TRUE if the notify information was added, FALSE if there was not enough space to add it.
+ * @see
+ *     FspFileSystemNotify
+ *     FspFileSystemAddNotifyInfo
+ */
+FSP_API BOOLEAN FspFileSystemAddNotifyRangeInfo(FSP_FSCTL_NOTIFY_RANGE_INFO *NotifyInfo,
+    PVOID Buffer, ULONG Length, PULONG PBytesTransferred);
 /**
  * Stop a file system service, if any.
  *
@@ -1806,6 +2075,7 @@ FSP_API VOID FspFileSystemStopServiceIfNecessary(FSP_FILE_SYSTEM *FileSystem,
 /*
  * Directory buffering
  */
+typedef struct _FSP_FILE_NAME_PATTERN FSP_FILE_NAME_PATTERN;
 FSP_API BOOLEAN FspFileSystemAcquireDirectoryBufferEx(PVOID* PDirBuffer,
     BOOLEAN Reset, ULONG CapacityHint, PNTSTATUS PResult);
 FSP_API BOOLEAN FspFileSystemAcquireDirectoryBuffer(PVOID *PDirBuffer,
@@ -1816,6 +2086,9 @@ FSP_API VOID FspFileSystemReleaseDirectoryBuffer(PVOID *PDirBuffer);
 FSP_API VOID FspFileSystemReadDirectoryBuffer(PVOID *PDirBuffer,
     PWSTR Marker,
     PVOID Buffer, ULONG Length, PULONG PBytesTransferred);
+FSP_API VOID FspFileSystemReadDirectoryBufferEx(PVOID *PDirBuffer,
+    FSP_FILE_NAME_PATTERN *Pattern, PWSTR Marker,
+    PVOID Buffer, ULONG Length, PULONG PBytesTransferred);
 FSP_API VOID FspFileSystemDeleteDirectoryBuffer(PVOID *PDirBuffer);
 
 /*
@@ -1945,6 +2218,125 @@ FSP_API VOID FspPathPrefix(PWSTR Path, PWSTR *PPrefix, PWSTR *PRemain, PWSTR Roo
 FSP_API VOID FspPathSuffix(PWSTR Path, PWSTR *PRemain, PWSTR *PSuffix, PWSTR Root);
 FSP_API VOID FspPathCombine(PWSTR Prefix, PWSTR Suffix);
 
+/*
+ * File Name Patterns
+ */
+/**
+ * Compile a file name pattern.
+ *
+ * A file name pattern is a DOS wildcard expression with the same semantics as the
+ * Pattern passed to ReadDirectory (and FsRtlIsNameInExpression): it may contain the
+ * wildcards *, ?, and the DOS wildcards &lt; (DOS_STAR), &gt; (DOS_QM) and " (DOS_DOT).
+ * The compiled pattern can be used to match many file names quickly.
+ *
+ * @param Pattern
+ *     The pattern to compile.
+ * @param PatternLength
+ *     The length of the pattern in characters or -1 if the pattern is NULL-terminated.
+ * @param CaseInsensitive
+ *     Whether matching should be case-insensitive.
+ * @param PPattern [out]
+ *     Pointer that will receive the compiled pattern.
+ * @return
+ *     STATUS_SUCCESS or error code.
+ * @see
+ *     FspFileNamePatternDelete
+ *     FspFileNamePatternMatch
+ */
+FSP_API NTSTATUS FspFileNamePatternCompile(PWSTR Pattern, ULONG PatternLength,
+    BOOLEAN CaseInsensitive, FSP_FILE_NAME_PATTERN **PPattern);
+/**
+ * Delete a compiled file name pattern.
+ *
+ * @param Pattern
+ *     The compiled pattern.
+ */
+FSP_API VOID FspFileNamePatternDelete(FSP_FILE_NAME_PATTERN *Pattern);
+/**
+ * Match a file name against a compiled file name pattern.
+ *
+ * This function may be called concurrently from multiple threads on the same pattern.
+ *
+ * @param Pattern
+ *     The compiled pattern.
+ * @param FileName
+ *     The file name to match. This is a single path component, not a full path.
+ * @param FileNameLength
+ *     The length of the file name in characters or -1 if the file name is NULL-terminated.
+ * @return
+ *     TRUE if the file name matches the pattern.
+ */
+FSP_API BOOLEAN FspFileNamePatternMatch(FSP_FILE_NAME_PATTERN *Pattern,
+    PWSTR FileName, ULONG FileNameLength);
+
+/*
+ * Case-Insensitive Names
+ */
+/**
+ * Upcase characters.
+ *
+ * Characters are upcased as RtlUpcaseUnicodeChar does. This function and the other
+ * FspUpcase functions have a fast path for ASCII and may be used in performance
+ * sensitive code, e.g. when comparing or hashing file names.
+ *
+ * @param Destination
+ *     The destination buffer. This may be the same as Source.
+ * @param Source
+ *     The characters to upcase.
+ * @param Count
+ *     The number of characters to upcase.
+ */
+FSP_API VOID FspUpcaseChars(PWCH Destination, PWCH Source, ULONG Count);
+/**
+ * Compare characters for equality ignoring case.
+ *
+ * @param String1
+ *     The first string.
+ * @param String2
+ *     The second string.
+ * @param Count
+ *     The number of characters to compare.
+ * @return
+ *     TRUE if the upcased characters are equal.
+ */
+FSP_API BOOLEAN FspUpcaseEqual(PWCH String1, PWCH String2, ULONG Count);
+/**
+ * Compare strings ignoring case.
+ *
+ * Strings are compared by the numeric value of their upcased characters; a string that
+ * is a prefix of another string orders first.
+ *
+ * @param String1
+ *     The first string.
+ * @param Length1
+ *     The length of the first string in characters.
+ * @param String2
+ *     The second string.
+ * @param Length2
+ *     The length of the second string in characters.
+ * @return
+ *     Less than, equal to or greater than zero if String1 orders before, the same as or
+ *     after String2.
+ */
+FSP_API INT FspUpcaseCompare(PWCH String1, ULONG Length1, PWCH String2, ULONG Length2);
+/**
+ * Hash characters ignoring case.
+ *
+ * The hash is FNV-1a (32-bit) over the upcased characters. It can be computed
+ * incrementally by passing the result of a previous call as the Hash argument; the
+ * initial value is normally the FNV offset basis 2166136261.
+ *
+ * @param String
+ *     The characters to hash.
+ * @param Count
+ *     The number of characters to hash.
+ * @param Hash
+ *     The initial hash value.
+ * @return
+ *     The updated hash value.
+ */
+FSP_API ULONG FspUpcaseHash(PWCH String, ULONG Count, ULONG Hash);
+
 /**
  * @group Service Framework
  *
@@ -2169,6 +2561,79 @@ FSP_API VOID FspDebugLogSid(const char *format, PSID Sid);
 FSP_API VOID FspDebugLogFT(const char *Format, PFILETIME FileTime);
 FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request);
 FSP_API VOID FspDebugLogResponse(FSP_FSCTL_TRANSACT_RSP *Response);
+/**
+ * Start binary tracing of file system requests and responses.
+ *
+ * While tracing is active FspDebugLogRequest and FspDebugLogResponse do not format any text.
+ * Instead they record the raw request or response together with a timestamp into a per-thread
+ * ring buffer. A background thread writes the recorded data to the trace file in batches.
+ * When a ring buffer is full records are dropped (and counted) rather than delaying the
+ * file system dispatcher.
+ *
+ * Use FspDebugLogDecodeTrace to convert a trace file into the regular debug log format.
+ *
+ * @param Handle
+ *     Handle to the trace file. The handle must remain valid until FspDebugLogStopTrace
+ *     returns.
+ * @return
+ *     STATUS_SUCCESS or error code. STATUS_INVALID_DEVICE_STATE if tracing is already active.
+ */
+FSP_API NTSTATUS FspDebugLogStartTrace(HANDLE Handle);
+enum
+{
+    FspDebugLogTraceNoDrop              = 0x00000001,
+};
+/**
+ * Start binary tracing of file system requests and responses.
+ *
+ * @param Handle
+ *     Handle to the trace file. The handle must remain valid until FspDebugLogStopTrace
+ *     returns.
+ * @param Flags
+ *     FspDebugLogTraceNoDrop to make a thread whose ring buffer is full wait for the
+ *     background thread rather than drop the record. Use this when recording a trace for
+ *     FspFileSystemReplayTrace.
+ * @return
+ *     STATUS_SUCCESS or error code. STATUS_INVALID_DEVICE_STATE if tracing is already active.
+ */
+FSP_API NTSTATUS FspDebugLogStartTraceEx(HANDLE Handle, ULONG Flags);
+/**
+ * Stop binary tracing.
+ *
+ * All records that have been recorded so far are written to the trace file before this
+ * function returns.
+ */
+FSP_API VOID FspDebugLogStopTrace(VOID);
+/**
+ * Get binary tracing statistics.
+ *
+ * @param PRecordCount
+ *     Pointer to a location that will receive the number of records recorded since tracing
+ *     was last started. May be NULL.
+ * @param PDroppedCount
+ *     Pointer to a location that will receive the number of records dropped since tracing
+ *     was last started. May be NULL.
+ */
+FSP_API VOID FspDebugLogGetTraceStatistics(PUINT64 PRecordCount, PUINT64 PDroppedCount);
+enum
+{
+    FspDebugLogDecodeTimestamps         = 0x00000001,
+};
+/**
+ * Decode a binary trace file.
+ *
+ * The trace is written as text to the debug log (see FspDebugLogSetHandle) in the same
+ * format that FspDebugLogRequest and FspDebugLogResponse use.
+ *
+ * @param Handle
+ *     Handle to the trace file.
+ * @param Flags
+ *     FspDebugLogDecodeTimestamps to prefix each line with the time (in seconds) since
+ *     tracing was started.
+ * @return
+ *     STATUS_SUCCESS or error code.
+ */
+FSP_API NTSTATUS FspDebugLogDecodeTrace(HANDLE Handle, ULONG Flags);
 FSP_API NTSTATUS FspCallNamedPipeSecurely(PWSTR PipeName,
     PVOID InBuffer, ULONG InBufferSize, PVOID OutBuffer, ULONG OutBufferSize,
     PULONG PBytesTransferred, ULONG Timeout,
@@ -475,96 +475,614 @@ private:
     FileSystemBase &operator=(const FileSystemBase &);
 };
 
-class FileSystemHost
+/*
+ * FileSystemInterfaceT
+ *
+ * The FSP_FILE_SYSTEM_INTERFACE thunks that translate calls from the WinFsp DLL into calls to
+ * the operations of a file system class C. They are shared by FileSystemHost and
+ * FileSystemBaseT:
+ *
+ * - FileSystemInterfaceT<FileSystemBase, false> is the interface of a FileSystemHost for a
+ * FileSystemBase derived class. All slots are filled in and the thunks make virtual calls.
+ *
+ * - FileSystemInterfaceT<T, true> is the interface of a FileSystemHost for a FileSystemBaseT<T>
+ * derived class. See FileSystemBaseT.
+ */
+template <typename C, bool Static = true>
+class FileSystemInterfaceT
 {
 public:
-    /* ctor/dtor */
-    FileSystemHost(FileSystemBase &FileSystem) :
-        _VolumeParams(), _FileSystemPtr(0), _FileSystem(&FileSystem)
-    {
-        Initialize();
-        _VolumeParams.UmFileContextIsFullContext = 1;
-    }
-    virtual ~FileSystemHost()
+    static FSP_FILE_SYSTEM_INTERFACE *Interface()
     {
-        if (0 != _FileSystemPtr)
-            FspFileSystemDelete(_FileSystemPtr);
+#define FSP_CPP_IMPLEMENTED(Op)         (!Static || 2 == sizeof Overridden(&C::Op))
+        static FSP_FILE_SYSTEM_INTERFACE _Interface =
+        {
+            FSP_CPP_IMPLEMENTED(GetVolumeInfo) ?
+                GetVolumeInfo : 0,
+            FSP_CPP_IMPLEMENTED(SetVolumeLabel_) ?
+                SetVolumeLabel_ : 0,
+            FSP_CPP_IMPLEMENTED(GetSecurityByName) ?
+                GetSecurityByName : 0,
+            FSP_CPP_IMPLEMENTED(Create) ?
+                Create : 0,
+            FSP_CPP_IMPLEMENTED(Open) ?
+                Open : 0,
+            FSP_CPP_IMPLEMENTED(Overwrite) ?
+                Overwrite : 0,
+            FSP_CPP_IMPLEMENTED(Cleanup) ?
+                Cleanup : 0,
+            FSP_CPP_IMPLEMENTED(Close) ?
+                Close : 0,
+            FSP_CPP_IMPLEMENTED(Read) ?
+                Read : 0,
+            FSP_CPP_IMPLEMENTED(Write) ?
+                Write : 0,
+            FSP_CPP_IMPLEMENTED(Flush) ?
+                Flush : 0,
+            FSP_CPP_IMPLEMENTED(GetFileInfo) ?
+                GetFileInfo : 0,
+            FSP_CPP_IMPLEMENTED(SetBasicInfo) ?
+                SetBasicInfo : 0,
+            FSP_CPP_IMPLEMENTED(SetFileSize) ?
+                SetFileSize : 0,
+            FSP_CPP_IMPLEMENTED(CanDelete) ?
+                CanDelete : 0,
+            FSP_CPP_IMPLEMENTED(Rename) ?
+                Rename : 0,
+            FSP_CPP_IMPLEMENTED(GetSecurity) ?
+                GetSecurity : 0,
+            FSP_CPP_IMPLEMENTED(SetSecurity) ?
+                SetSecurity : 0,
+            FSP_CPP_IMPLEMENTED(ReadDirectory) || FSP_CPP_IMPLEMENTED(ReadDirectoryEntry) ?
+                ReadDirectory : 0,
+            FSP_CPP_IMPLEMENTED(ResolveReparsePoints) || FSP_CPP_IMPLEMENTED(GetReparsePointByName) ?
+                ResolveReparsePoints : 0,
+            FSP_CPP_IMPLEMENTED(GetReparsePoint) ?
+                GetReparsePoint : 0,
+            FSP_CPP_IMPLEMENTED(SetReparsePoint) ?
+                SetReparsePoint : 0,
+            FSP_CPP_IMPLEMENTED(DeleteReparsePoint) ?
+                DeleteReparsePoint : 0,
+            FSP_CPP_IMPLEMENTED(GetStreamInfo) ?
+                GetStreamInfo : 0,
+        };
+#undef FSP_CPP_IMPLEMENTED
+        return &_Interface;
     }
 
-    /* properties */
-    UINT16 SectorSize()
-    {
-        return _VolumeParams.SectorSize;
-    }
-    VOID SetSectorSize(UINT16 SectorSize)
+private:
+    /* &C::Op has type F FileSystemBase::* unless C (or a class between C and us) declares Op */
+    template <typename F>
+    static char (&Overridden(F FileSystemBase::*))[1];
+    template <typename F, typename D>
+    static char (&Overridden(F D::*))[2];
+
+    /* static: qualified (non-virtual) call to C::Op; otherwise virtual call */
+#define FSP_CPP_INVOKE(Op, Args)        (Static ? self->C::Op Args : self->Op Args)
+    static NTSTATUS GetVolumeInfo(FSP_FILE_SYSTEM *FileSystem0,
+        FSP_FSCTL_VOLUME_INFO *VolumeInfo)
     {
-        _VolumeParams.SectorSize = SectorSize;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(GetVolumeInfo, (
+                VolumeInfo));
+        )
     }
-    UINT16 SectorsPerAllocationUnit()
+    static NTSTATUS SetVolumeLabel_(FSP_FILE_SYSTEM *FileSystem0,
+        PWSTR VolumeLabel,
+        FSP_FSCTL_VOLUME_INFO *VolumeInfo)
     {
-        return _VolumeParams.SectorsPerAllocationUnit;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(SetVolumeLabel_, (
+                VolumeLabel,
+                VolumeInfo));
+        )
     }
-    VOID SetSectorsPerAllocationUnit(UINT16 SectorsPerAllocationUnit)
+    static NTSTATUS GetSecurityByName(FSP_FILE_SYSTEM *FileSystem0,
+        PWSTR FileName,
+        PUINT32 PFileAttributes/* or ReparsePointIndex */,
+        PSECURITY_DESCRIPTOR SecurityDescriptor,
+        SIZE_T *PSecurityDescriptorSize)
     {
-        _VolumeParams.SectorsPerAllocationUnit = SectorsPerAllocationUnit;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(GetSecurityByName, (
+                FileName,
+                PFileAttributes,
+                SecurityDescriptor,
+                PSecurityDescriptorSize));
+        )
     }
-    UINT16 MaxComponentLength()
+    static NTSTATUS Create(FSP_FILE_SYSTEM *FileSystem0,
+        PWSTR FileName,
+        UINT32 CreateOptions,
+        UINT32 GrantedAccess,
+        UINT32 FileAttributes,
+        PSECURITY_DESCRIPTOR SecurityDescriptor,
+        UINT64 AllocationSize,
+        PVOID *FullContext,
+        FSP_FSCTL_FILE_INFO *FileInfo)
     {
-        return _VolumeParams.MaxComponentLength;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        PVOID FileNode, FileDesc;
+        NTSTATUS Result;
+        FSP_CPP_EXCEPTION_GUARD(
+            Result = FSP_CPP_INVOKE(Create, (
+                FileName,
+                CreateOptions,
+                GrantedAccess,
+                FileAttributes,
+                SecurityDescriptor,
+                AllocationSize,
+                &FileNode,
+                &FileDesc,
+                FspFileSystemGetOpenFileInfo(FileInfo)));
+        )
+        ((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext = (UINT64)(UINT_PTR)FileNode;
+        ((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2 = (UINT64)(UINT_PTR)FileDesc;
+        return Result;
     }
-    VOID SetMaxComponentLength(UINT16 MaxComponentLength)
+    static NTSTATUS Open(FSP_FILE_SYSTEM *FileSystem0,
+        PWSTR FileName,
+        UINT32 CreateOptions,
+        UINT32 GrantedAccess,
+        PVOID *FullContext,
+        FSP_FSCTL_FILE_INFO *FileInfo)
     {
-        _VolumeParams.MaxComponentLength = MaxComponentLength;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        PVOID FileNode, FileDesc;
+        NTSTATUS Result;
+        FSP_CPP_EXCEPTION_GUARD(
+            Result = FSP_CPP_INVOKE(Open, (
+                FileName,
+                CreateOptions,
+                GrantedAccess,
+                &FileNode,
+                &FileDesc,
+                FspFileSystemGetOpenFileInfo(FileInfo)));
+        )
+        ((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext = (UINT64)(UINT_PTR)FileNode;
+        ((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2 = (UINT64)(UINT_PTR)FileDesc;
+        return Result;
     }
-    UINT64 VolumeCreationTime()
+    static NTSTATUS Overwrite(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        UINT32 FileAttributes,
+        BOOLEAN ReplaceFileAttributes,
+        UINT64 AllocationSize,
+        FSP_FSCTL_FILE_INFO *FileInfo)
     {
-        return _VolumeParams.VolumeCreationTime;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(Overwrite, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                FileAttributes,
+                ReplaceFileAttributes,
+                AllocationSize,
+                FileInfo));
+        )
     }
-    VOID SetVolumeCreationTime(UINT64 VolumeCreationTime)
+    static VOID Cleanup(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        PWSTR FileName,
+        ULONG Flags)
     {
-        _VolumeParams.VolumeCreationTime = VolumeCreationTime;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD_VOID(
+            return FSP_CPP_INVOKE(Cleanup, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                FileName,
+                Flags));
+        )
     }
-    UINT32 VolumeSerialNumber()
+    static VOID Close(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext)
     {
-        return _VolumeParams.VolumeSerialNumber;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD_VOID(
+            return FSP_CPP_INVOKE(Close, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2));
+        )
     }
-    VOID SetVolumeSerialNumber(UINT32 VolumeSerialNumber)
+    static NTSTATUS Read(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        PVOID Buffer,
+        UINT64 Offset,
+        ULONG Length,
+        PULONG PBytesTransferred)
     {
-        _VolumeParams.VolumeSerialNumber = VolumeSerialNumber;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(Read, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                Buffer,
+                Offset,
+                Length,
+                PBytesTransferred));
+        )
     }
-    UINT32 FileInfoTimeout()
+    static NTSTATUS Write(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        PVOID Buffer,
+        UINT64 Offset,
+        ULONG Length,
+        BOOLEAN WriteToEndOfFile,
+        BOOLEAN ConstrainedIo,
+        PULONG PBytesTransferred,
+        FSP_FSCTL_FILE_INFO *FileInfo)
     {
-        return _VolumeParams.FileInfoTimeout;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(Write, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                Buffer,
+                Offset,
+                Length,
+                WriteToEndOfFile,
+                ConstrainedIo,
+                PBytesTransferred,
+                FileInfo));
+        )
     }
-    VOID SetFileInfoTimeout(UINT32 FileInfoTimeout)
+    static NTSTATUS Flush(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        FSP_FSCTL_FILE_INFO *FileInfo)
     {
-        _VolumeParams.FileInfoTimeout = FileInfoTimeout;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(Flush, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                FileInfo));
+        )
     }
-    BOOLEAN CaseSensitiveSearch()
+    static NTSTATUS GetFileInfo(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        FSP_FSCTL_FILE_INFO *FileInfo)
     {
-        return _VolumeParams.CaseSensitiveSearch;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(GetFileInfo, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                FileInfo));
+        )
     }
-    VOID SetCaseSensitiveSearch(BOOLEAN CaseSensitiveSearch)
+    static NTSTATUS SetBasicInfo(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        UINT32 FileAttributes,
+        UINT64 CreationTime,
+        UINT64 LastAccessTime,
+        UINT64 LastWriteTime,
+        UINT64 ChangeTime,
+        FSP_FSCTL_FILE_INFO *FileInfo)
     {
-        _VolumeParams.CaseSensitiveSearch = !!CaseSensitiveSearch;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(SetBasicInfo, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                FileAttributes,
+                CreationTime,
+                LastAccessTime,
+                LastWriteTime,
+                ChangeTime,
+                FileInfo));
+        )
     }
-    BOOLEAN CasePreservedNames()
+    static NTSTATUS SetFileSize(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        UINT64 NewSize,
+        BOOLEAN SetAllocationSize,
+        FSP_FSCTL_FILE_INFO *FileInfo)
     {
-        return _VolumeParams.CasePreservedNames;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(SetFileSize, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                NewSize,
+                SetAllocationSize,
+                FileInfo));
+        )
     }
-    VOID SetCasePreservedNames(BOOLEAN CasePreservedNames)
+    static NTSTATUS CanDelete(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        PWSTR FileName)
     {
-        _VolumeParams.CasePreservedNames = !!CasePreservedNames;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(CanDelete, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                FileName));
+        )
     }
-    BOOLEAN UnicodeOnDisk()
+    static NTSTATUS Rename(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        PWSTR FileName,
+        PWSTR NewFileName,
+        BOOLEAN ReplaceIfExists)
     {
-        return _VolumeParams.UnicodeOnDisk;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(Rename, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                FileName,
+                NewFileName,
+                ReplaceIfExists));
+        )
     }
-    VOID SetUnicodeOnDisk(BOOLEAN UnicodeOnDisk)
+    static NTSTATUS GetSecurity(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        PSECURITY_DESCRIPTOR SecurityDescriptor,
+        SIZE_T *PSecurityDescriptorSize)
     {
-        _VolumeParams.UnicodeOnDisk = !!UnicodeOnDisk;
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(GetSecurity, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                SecurityDescriptor,
+                PSecurityDescriptorSize));
+        )
     }
-    BOOLEAN PersistentAcls()
+    static NTSTATUS SetSecurity(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        SECURITY_INFORMATION SecurityInformation,
+        PSECURITY_DESCRIPTOR ModificationDescriptor)
+    {
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(SetSecurity, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                SecurityInformation,
+                ModificationDescriptor));
+        )
+    }
+    static NTSTATUS ReadDirectory(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        PWSTR Pattern,
+        PWSTR Marker,
+        PVOID Buffer,
+        ULONG Length,
+        PULONG PBytesTransferred)
+    {
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(ReadDirectory, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                Pattern,
+                Marker,
+                Buffer,
+                Length,
+                PBytesTransferred));
+        )
+    }
+    static NTSTATUS ResolveReparsePoints(FSP_FILE_SYSTEM *FileSystem0,
+        PWSTR FileName,
+        UINT32 ReparsePointIndex,
+        BOOLEAN ResolveLastPathComponent,
+        PIO_STATUS_BLOCK PIoStatus,
+        PVOID Buffer,
+        PSIZE_T PSize)
+    {
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(ResolveReparsePoints, (
+                FileName,
+                ReparsePointIndex,
+                ResolveLastPathComponent,
+                PIoStatus,
+                Buffer,
+                PSize));
+        )
+    }
+    static NTSTATUS GetReparsePoint(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        PWSTR FileName,
+        PVOID Buffer,
+        PSIZE_T PSize)
+    {
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(GetReparsePoint, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                FileName,
+                Buffer,
+                PSize));
+        )
+    }
+    static NTSTATUS SetReparsePoint(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        PWSTR FileName,
+        PVOID Buffer,
+        SIZE_T Size)
+    {
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(SetReparsePoint, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                FileName,
+                Buffer,
+                Size));
+        )
+    }
+    static NTSTATUS DeleteReparsePoint(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        PWSTR FileName,
+        PVOID Buffer,
+        SIZE_T Size)
+    {
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(DeleteReparsePoint, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                FileName,
+                Buffer,
+                Size));
+        )
+    }
+    static NTSTATUS GetStreamInfo(FSP_FILE_SYSTEM *FileSystem0,
+        PVOID FullContext,
+        PVOID Buffer,
+        ULONG Length,
+        PULONG PBytesTransferred)
+    {
+        C *self = static_cast<C *>((FileSystemBase *)FileSystem0->UserContext);
+        FSP_CPP_EXCEPTION_GUARD(
+            return FSP_CPP_INVOKE(GetStreamInfo, (
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
+                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
+                Buffer,
+                Length,
+                PBytesTransferred));
+        )
+    }
+#undef FSP_CPP_INVOKE
+};
+
+/*
+ * FileSystemBaseT
+ *
+ * An alternative to FileSystemBase for file systems that want static dispatch. A file system
+ * class T derives from FileSystemBaseT<T> (instead of FileSystemBase) and overrides operations
+ * as usual. The FileSystemHost then uses an FSP_FILE_SYSTEM_INTERFACE that is specific to T
+ * (FileSystemInterfaceT<T>):
+ *
+ * - Only the interface slots of operations that T overrides are filled in. The remaining slots
+ * are left NULL, so that the DLL uses its default behavior for a missing operation (exactly as
+ * for a file system that uses the C API) rather than calling the FileSystemBase defaults. The
+ * ReadDirectory slot is also filled in when T overrides ReadDirectoryEntry and the
+ * ResolveReparsePoints slot when T overrides GetReparsePointByName.
+ *
+ * - The interface thunks call T's operations with qualified (non-virtual) calls that the
+ * compiler can inline. For this reason T should be the most derived class; a class that
+ * derives from T and overrides an operation will not have its override called by the host.
+ *
+ * If T declares its operations protected or private, it must befriend FileSystemInterfaceT<T>.
+ * An operation must not be overloaded in T.
+ */
+template <typename T>
+class FileSystemBaseT : public FileSystemBase
+{
+public:
+    static FSP_FILE_SYSTEM_INTERFACE *Interface()
+    {
+        return FileSystemInterfaceT<T>::Interface();
+    }
+};
+
+class FileSystemHost
+{
+public:
+    /* ctor/dtor */
+    FileSystemHost(FileSystemBase &FileSystem) :
+        _VolumeParams(), _FileSystemPtr(0), _FileSystem(&FileSystem), _Interface(Interface())
+    {
+        Initialize();
+        _VolumeParams.UmFileContextIsFullContext = 1;
+    }
+    template <typename T>
+    FileSystemHost(FileSystemBaseT<T> &FileSystem) :
+        _VolumeParams(), _FileSystemPtr(0), _FileSystem(&FileSystem),
+        _Interface(FileSystemBaseT<T>::Interface())
+    {
+        Initialize();
+        _VolumeParams.UmFileContextIsFullContext = 1;
+    }
+    virtual ~FileSystemHost()
+    {
+        if (0 != _FileSystemPtr)
+            FspFileSystemDelete(_FileSystemPtr);
+    }
+
+    /* properties */
+    UINT16 SectorSize()
+    {
+        return _VolumeParams.SectorSize;
+    }
+    VOID SetSectorSize(UINT16 SectorSize)
+    {
+        _VolumeParams.SectorSize = SectorSize;
+    }
+    UINT16 SectorsPerAllocationUnit()
+    {
+        return _VolumeParams.SectorsPerAllocationUnit;
+    }
+    VOID SetSectorsPerAllocationUnit(UINT16 SectorsPerAllocationUnit)
+    {
+        _VolumeParams.SectorsPerAllocationUnit = SectorsPerAllocationUnit;
+    }
+    UINT16 MaxComponentLength()
+    {
+        return _VolumeParams.MaxComponentLength;
+    }
+    VOID SetMaxComponentLength(UINT16 MaxComponentLength)
+    {
+        _VolumeParams.MaxComponentLength = MaxComponentLength;
+    }
+    UINT64 VolumeCreationTime()
+    {
+        return _VolumeParams.VolumeCreationTime;
+    }
+    VOID SetVolumeCreationTime(UINT64 VolumeCreationTime)
+    {
+        _VolumeParams.VolumeCreationTime = VolumeCreationTime;
+    }
+    UINT32 VolumeSerialNumber()
+    {
+        return _VolumeParams.VolumeSerialNumber;
+    }
+    VOID SetVolumeSerialNumber(UINT32 VolumeSerialNumber)
+    {
+        _VolumeParams.VolumeSerialNumber = VolumeSerialNumber;
+    }
+    UINT32 FileInfoTimeout()
+    {
+        return _VolumeParams.FileInfoTimeout;
+    }
+    VOID SetFileInfoTimeout(UINT32 FileInfoTimeout)
+    {
+        _VolumeParams.FileInfoTimeout = FileInfoTimeout;
+    }
+    BOOLEAN CaseSensitiveSearch()
+    {
+        return _VolumeParams.CaseSensitiveSearch;
+    }
+    VOID SetCaseSensitiveSearch(BOOLEAN CaseSensitiveSearch)
+    {
+        _VolumeParams.CaseSensitiveSearch = !!CaseSensitiveSearch;
+    }
+    BOOLEAN CasePreservedNames()
+    {
+        return _VolumeParams.CasePreservedNames;
+    }
+    VOID SetCasePreservedNames(BOOLEAN CasePreservedNames)
+    {
+        _VolumeParams.CasePreservedNames = !!CasePreservedNames;
+    }
+    BOOLEAN UnicodeOnDisk()
+    {
+        return _VolumeParams.UnicodeOnDisk;
+    }
+    VOID SetUnicodeOnDisk(BOOLEAN UnicodeOnDisk)
+    {
+        _VolumeParams.UnicodeOnDisk = !!UnicodeOnDisk;
+    }
+    BOOLEAN PersistentAcls()
     {
         return _VolumeParams.PersistentAcls;
     }
@@ -670,7 +1188,7 @@ public:
             return Result;
         Result = FspFileSystemCreate(
             _VolumeParams.Prefix[0] ? L"" FSP_FSCTL_NET_DEVICE_NAME : L"" FSP_FSCTL_DISK_DEVICE_NAME,
-            &_VolumeParams, Interface(), &_FileSystemPtr);
+            &_VolumeParams, _Interface, &_FileSystemPtr);
         if (!NT_SUCCESS(Result))
             return Result;
         _FileSystemPtr->UserContext = _FileSystem;
@@ -737,6 +1255,10 @@ public:
     {
         return *_FileSystem;
     }
+    FSP_FILE_SYSTEM_INTERFACE *FileSystemInterface()
+    {
+        return _Interface;
+    }
     static NTSTATUS SetDebugLogFile(PWSTR FileName)
     {
         HANDLE Handle;
@@ -758,429 +1280,9 @@ public:
     }
 
 private:
-    /* FSP_FILE_SYSTEM_INTERFACE */
-    static NTSTATUS GetVolumeInfo(FSP_FILE_SYSTEM *FileSystem0,
-        FSP_FSCTL_VOLUME_INFO *VolumeInfo)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->GetVolumeInfo(
-                VolumeInfo);
-        )
-    }
-    static NTSTATUS SetVolumeLabel_(FSP_FILE_SYSTEM *FileSystem0,
-        PWSTR VolumeLabel,
-        FSP_FSCTL_VOLUME_INFO *VolumeInfo)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->SetVolumeLabel_(
-                VolumeLabel,
-                VolumeInfo);
-        )
-    }
-    static NTSTATUS GetSecurityByName(FSP_FILE_SYSTEM *FileSystem0,
-        PWSTR FileName,
-        PUINT32 PFileAttributes/* or ReparsePointIndex */,
-        PSECURITY_DESCRIPTOR SecurityDescriptor,
-        SIZE_T *PSecurityDescriptorSize)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->GetSecurityByName(
-                FileName,
-                PFileAttributes,
-                SecurityDescriptor,
-                PSecurityDescriptorSize);
-        )
-    }
-    static NTSTATUS Create(FSP_FILE_SYSTEM *FileSystem0,
-        PWSTR FileName,
-        UINT32 CreateOptions,
-        UINT32 GrantedAccess,
-        UINT32 FileAttributes,
-        PSECURITY_DESCRIPTOR SecurityDescriptor,
-        UINT64 AllocationSize,
-        PVOID *FullContext,
-        FSP_FSCTL_FILE_INFO *FileInfo)
+    static FSP_FILE_SYSTEM_INTERFACE *Interface()
     {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        PVOID FileNode, FileDesc;
-        NTSTATUS Result;
-        FSP_CPP_EXCEPTION_GUARD(
-            Result = self->Create(
-                FileName,
-                CreateOptions,
-                GrantedAccess,
-                FileAttributes,
-                SecurityDescriptor,
-                AllocationSize,
-                &FileNode,
-                &FileDesc,
-                FspFileSystemGetOpenFileInfo(FileInfo));
-        )
-        ((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext = (UINT64)(UINT_PTR)FileNode;
-        ((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2 = (UINT64)(UINT_PTR)FileDesc;
-        return Result;
-    }
-    static NTSTATUS Open(FSP_FILE_SYSTEM *FileSystem0,
-        PWSTR FileName,
-        UINT32 CreateOptions,
-        UINT32 GrantedAccess,
-        PVOID *FullContext,
-        FSP_FSCTL_FILE_INFO *FileInfo)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        PVOID FileNode, FileDesc;
-        NTSTATUS Result;
-        FSP_CPP_EXCEPTION_GUARD(
-            Result = self->Open(
-                FileName,
-                CreateOptions,
-                GrantedAccess,
-                &FileNode,
-                &FileDesc,
-                FspFileSystemGetOpenFileInfo(FileInfo));
-        )
-        ((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext = (UINT64)(UINT_PTR)FileNode;
-        ((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2 = (UINT64)(UINT_PTR)FileDesc;
-        return Result;
-    }
-    static NTSTATUS Overwrite(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        UINT32 FileAttributes,
-        BOOLEAN ReplaceFileAttributes,
-        UINT64 AllocationSize,
-        FSP_FSCTL_FILE_INFO *FileInfo)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->Overwrite(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                FileAttributes,
-                ReplaceFileAttributes,
-                AllocationSize,
-                FileInfo);
-        )
-    }
-    static VOID Cleanup(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        PWSTR FileName,
-        ULONG Flags)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD_VOID(
-            return self->Cleanup(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                FileName,
-                Flags);
-        )
-    }
-    static VOID Close(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD_VOID(
-            return self->Close(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2);
-        )
-    }
-    static NTSTATUS Read(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        PVOID Buffer,
-        UINT64 Offset,
-        ULONG Length,
-        PULONG PBytesTransferred)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->Read(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                Buffer,
-                Offset,
-                Length,
-                PBytesTransferred);
-        )
-    }
-    static NTSTATUS Write(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        PVOID Buffer,
-        UINT64 Offset,
-        ULONG Length,
-        BOOLEAN WriteToEndOfFile,
-        BOOLEAN ConstrainedIo,
-        PULONG PBytesTransferred,
-        FSP_FSCTL_FILE_INFO *FileInfo)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->Write(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                Buffer,
-                Offset,
-                Length,
-                WriteToEndOfFile,
-                ConstrainedIo,
-                PBytesTransferred,
-                FileInfo);
-        )
-    }
-    static NTSTATUS Flush(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        FSP_FSCTL_FILE_INFO *FileInfo)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->Flush(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                FileInfo);
-        )
-    }
-    static NTSTATUS GetFileInfo(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        FSP_FSCTL_FILE_INFO *FileInfo)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->GetFileInfo(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                FileInfo);
-        )
-    }
-    static NTSTATUS SetBasicInfo(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        UINT32 FileAttributes,
-        UINT64 CreationTime,
-        UINT64 LastAccessTime,
-        UINT64 LastWriteTime,
-        UINT64 ChangeTime,
-        FSP_FSCTL_FILE_INFO *FileInfo)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->SetBasicInfo(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                FileAttributes,
-                CreationTime,
-                LastAccessTime,
-                LastWriteTime,
-                ChangeTime,
-                FileInfo);
-        )
-    }
-    static NTSTATUS SetFileSize(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        UINT64 NewSize,
-        BOOLEAN SetAllocationSize,
-        FSP_FSCTL_FILE_INFO *FileInfo)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->SetFileSize(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                NewSize,
-                SetAllocationSize,
-                FileInfo);
-        )
-    }
-    static NTSTATUS CanDelete(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        PWSTR FileName)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->CanDelete(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                FileName);
-        )
-    }
-    static NTSTATUS Rename(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        PWSTR FileName,
-        PWSTR NewFileName,
-        BOOLEAN ReplaceIfExists)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->Rename(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                FileName,
-                NewFileName,
-                ReplaceIfExists);
-        )
-    }
-    static NTSTATUS GetSecurity(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        PSECURITY_DESCRIPTOR SecurityDescriptor,
-        SIZE_T *PSecurityDescriptorSize)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->GetSecurity(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                SecurityDescriptor,
-                PSecurityDescriptorSize);
-        )
-    }
-    static NTSTATUS SetSecurity(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        SECURITY_INFORMATION SecurityInformation,
-        PSECURITY_DESCRIPTOR ModificationDescriptor)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->SetSecurity(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                SecurityInformation,
-                ModificationDescriptor);
-        )
-    }
-    static NTSTATUS ReadDirectory(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        PWSTR Pattern,
-        PWSTR Marker,
-        PVOID Buffer,
-        ULONG Length,
-        PULONG PBytesTransferred)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->ReadDirectory(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                Pattern,
-                Marker,
-                Buffer,
-                Length,
-                PBytesTransferred);
-        )
-    }
-    static NTSTATUS ResolveReparsePoints(FSP_FILE_SYSTEM *FileSystem0,
-        PWSTR FileName,
-        UINT32 ReparsePointIndex,
-        BOOLEAN ResolveLastPathComponent,
-        PIO_STATUS_BLOCK PIoStatus,
-        PVOID Buffer,
-        PSIZE_T PSize)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->ResolveReparsePoints(
-                FileName,
-                ReparsePointIndex,
-                ResolveLastPathComponent,
-                PIoStatus,
-                Buffer,
-                PSize);
-        )
-    }
-    static NTSTATUS GetReparsePoint(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        PWSTR FileName,
-        PVOID Buffer,
-        PSIZE_T PSize)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->GetReparsePoint(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                FileName,
-                Buffer,
-                PSize);
-        )
-    }
-    static NTSTATUS SetReparsePoint(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        PWSTR FileName,
-        PVOID Buffer,
-        SIZE_T Size)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->SetReparsePoint(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                FileName,
-                Buffer,
-                Size);
-        )
-    }
-    static NTSTATUS DeleteReparsePoint(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        PWSTR FileName,
-        PVOID Buffer,
-        SIZE_T Size)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->DeleteReparsePoint(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                FileName,
-                Buffer,
-                Size);
-        )
-    }
-    static NTSTATUS GetStreamInfo(FSP_FILE_SYSTEM *FileSystem0,
-        PVOID FullContext,
-        PVOID Buffer,
-        ULONG Length,
-        PULONG PBytesTransferred)
-    {
-        FileSystemBase *self = (FileSystemBase *)FileSystem0->UserContext;
-        FSP_CPP_EXCEPTION_GUARD(
-            return self->GetStreamInfo(
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext,
-                (PVOID)(UINT_PTR)((FSP_FSCTL_TRANSACT_FULL_CONTEXT *)FullContext)->UserContext2,
-                Buffer,
-                Length,
-                PBytesTransferred);
-        )
-    }
-    static FSP_FILE_SYSTEM_INTERFACE *Interface()
-    {
-        static FSP_FILE_SYSTEM_INTERFACE _Interface =
-        {
-            GetVolumeInfo,
-            SetVolumeLabel_,
-            GetSecurityByName,
-            Create,
-            Open,
-            Overwrite,
-            Cleanup,
-            Close,
-            Read,
-            Write,
-            Flush,
-            GetFileInfo,
-            SetBasicInfo,
-            SetFileSize,
-            CanDelete,
-            Rename,
-            GetSecurity,
-            SetSecurity,
-            ReadDirectory,
-            ResolveReparsePoints,
-            GetReparsePoint,
-            SetReparsePoint,
-            DeleteReparsePoint,
-            GetStreamInfo,
-        };
-        return &_Interface;
+        return FileSystemInterfaceT<FileSystemBase, false>::Interface();
     }
 
 private:
@@ -1192,6 +1294,7 @@ private:
     FSP_FSCTL_VOLUME_PARAMS _VolumeParams;
     FSP_FILE_SYSTEM *_FileSystemPtr;
     FileSystemBase *_FileSystem;
+    FSP_FILE_SYSTEM_INTERFACE *_Interface;
 };
 
 class Service
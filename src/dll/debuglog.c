@@ -288,13 +288,13 @@ static const char *FspDebugLogReparseDataString(PVOID ReparseData0, char *Buf)
 static VOID FspDebugLogRequestVoid(FSP_FSCTL_TRANSACT_REQ *Request, const char *Name)
 {
     FspDebugLog("%S[TID=%04lx]: %p: >>%s\n",
-        FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint, Name);
+        FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint, Name);
 }
 
 static VOID FspDebugLogResponseStatus(FSP_FSCTL_TRANSACT_RSP *Response, const char *Name)
 {
     FspDebugLog("%S[TID=%04lx]: %p: <<%s IoStatus=%lx[%ld]\n",
-        FspDiagIdent(), GetCurrentThreadId(), (PVOID)Response->Hint, Name,
+        FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Response->Hint, Name,
         Response->IoStatus.Status, Response->IoStatus.Information);
 }
 
@@ -305,6 +305,9 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
     char InfoBuf[256];
     char *Sddl = 0;
 
+    if (FspDebugLogTraceActive && FspDebugLogTraceRequest(Request))
+        return;
+
     switch (Request->Kind)
     {
     case FspFsctlTransactReservedKind:
@@ -323,7 +326,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
             "AllocationSize=%lx:%lx, "
             "AccessToken=%p[PID=%lx], DesiredAccess=%lx, GrantedAccess=%lx, "
             "ShareAccess=%lx\n",
-            FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+            FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
             Request->Req.Create.UserMode ? 'U' : 'K',
             Request->Req.Create.HasTraversePrivilege ? 'T' : '-',
             Request->Req.Create.HasBackupPrivilege ? 'B' : '-',
@@ -348,7 +351,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
     case FspFsctlTransactOverwriteKind:
         FspDebugLog("%S[TID=%04lx]: %p: >>Overwrite%s %s%S%s%s, "
             "FileAttributes=%lx\n",
-            FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+            FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
             Request->Req.Overwrite.Supersede ? " [Supersede]" : "",
             Request->FileName.Size ? "\"" : "",
             Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
@@ -360,7 +363,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         break;
     case FspFsctlTransactCleanupKind:
         FspDebugLog("%S[TID=%04lx]: %p: >>Cleanup%s %s%S%s%s\n",
-            FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+            FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
             Request->Req.Cleanup.Delete ? " [Delete]" : "",
             Request->FileName.Size ? "\"" : "",
             Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
@@ -371,7 +374,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         break;
     case FspFsctlTransactCloseKind:
         FspDebugLog("%S[TID=%04lx]: %p: >>Close %s%S%s%s\n",
-            FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+            FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
             Request->FileName.Size ? "\"" : "",
             Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
             Request->FileName.Size ? "\", " : "",
@@ -380,9 +383,11 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
                 UserContextBuf));
         break;
     case FspFsctlTransactReadKind:
-        FspDebugLog("%S[TID=%04lx]: %p: >>Read %s%S%s%s, "
-            "Address=%p, Offset=%lx:%lx, Length=%ld, Key=%lx\n",
-            FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+        FspDebugLog("%S[TID=%04lx]: %p: >>Read%s %s%S%s%s, "
+            "Address=%p, Offset=%lx:%lx, Length=%ld, Key=%lx, ReadAhead=%ld\n",
+            FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
+            Request->Req.Read.Sequential ? " [S]" :
+                Request->Req.Read.RandomAccess ? " [R]" : "",
             Request->FileName.Size ? "\"" : "",
             Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
             Request->FileName.Size ? "\", " : "",
@@ -392,12 +397,13 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
             (PVOID)Request->Req.Read.Address,
             MAKE_UINT32_PAIR(Request->Req.Read.Offset),
             Request->Req.Read.Length,
-            Request->Req.Read.Key);
+            Request->Req.Read.Key,
+            Request->Req.Read.ReadAheadLength);
         break;
     case FspFsctlTransactWriteKind:
         FspDebugLog("%S[TID=%04lx]: %p: >>Write%s %s%S%s%s, "
             "Address=%p, Offset=%lx:%lx, Length=%ld, Key=%lx\n",
-            FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+            FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
             Request->Req.Write.ConstrainedIo ? " [C]" : "",
             Request->FileName.Size ? "\"" : "",
             Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
@@ -412,7 +418,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         break;
     case FspFsctlTransactQueryInformationKind:
         FspDebugLog("%S[TID=%04lx]: %p: >>QueryInformation %s%S%s%s\n",
-            FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+            FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
             Request->FileName.Size ? "\"" : "",
             Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
             Request->FileName.Size ? "\", " : "",
@@ -426,7 +432,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         case 4/*FileBasicInformation*/:
             FspDebugLog("%S[TID=%04lx]: %p: >>SetInformation [Basic] %s%S%s%s, "
                 "FileAttributes=%lx, CreationTime=%s, LastAccessTime=%s, LastWriteTime=%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
                 Request->FileName.Size ? "\"" : "",
                 Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
                 Request->FileName.Size ? "\", " : "",
@@ -444,7 +450,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         case 19/*FileAllocationInformation*/:
             FspDebugLog("%S[TID=%04lx]: %p: >>SetInformation [Allocation] %s%S%s%s, "
                 "AllocationSize=%lx:%lx\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
                 Request->FileName.Size ? "\"" : "",
                 Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
                 Request->FileName.Size ? "\", " : "",
@@ -456,7 +462,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         case 20/*FileEndOfFileInformation*/:
             FspDebugLog("%S[TID=%04lx]: %p: >>SetInformation [EndOfFile] %s%S%s%s, "
                 "FileSize = %lx:%lx\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
                 Request->FileName.Size ? "\"" : "",
                 Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
                 Request->FileName.Size ? "\", " : "",
@@ -468,7 +474,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         case 13/*FileDispositionInformation*/:
             FspDebugLog("%S[TID=%04lx]: %p: >>SetInformation [Disposition] %s%S%s%s, "
                 "%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
                 Request->FileName.Size ? "\"" : "",
                 Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
                 Request->FileName.Size ? "\", " : "",
@@ -480,7 +486,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         case 64/*FileDispositionInformationEx*/:
             FspDebugLog("%S[TID=%04lx]: %p: >>SetInformation [DispositionEx] %s%S%s%s, "
                 "Flags=%lx\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
                 Request->FileName.Size ? "\"" : "",
                 Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
                 Request->FileName.Size ? "\", " : "",
@@ -492,7 +498,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         case 10/*FileRenameInformation*/:
             FspDebugLog("%S[TID=%04lx]: %p: >>SetInformation [Rename] %s%S%s%s, "
                 "NewFileName=\"%S\", AccessToken=%p[PID=%lx]\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
                 Request->FileName.Size ? "\"" : "",
                 Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
                 Request->FileName.Size ? "\", " : "",
@@ -506,7 +512,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         case 65/*FileRenameInformationEx*/:
             FspDebugLog("%S[TID=%04lx]: %p: >>SetInformation [RenameEx] %s%S%s%s, "
                 "NewFileName=\"%S\", AccessToken=%p[PID=%lx], Flags=%lx\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
                 Request->FileName.Size ? "\"" : "",
                 Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
                 Request->FileName.Size ? "\", " : "",
@@ -520,7 +526,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
             break;
         default:
             FspDebugLog("%S[TID=%04lx]: %p: >>SetInformation [INVALID] %s%S%s%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
                 Request->FileName.Size ? "\"" : "",
                 Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
                 Request->FileName.Size ? "\", " : "",
@@ -538,7 +544,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         break;
     case FspFsctlTransactFlushBuffersKind:
         FspDebugLog("%S[TID=%04lx]: %p: >>FlushBuffers %s%S%s%s\n",
-            FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+            FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
             Request->FileName.Size ? "\"" : "",
             Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
             Request->FileName.Size ? "\", " : "",
@@ -555,19 +561,19 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         case 2/*FileFsLabelInformation*/:
             FspDebugLog("%S[TID=%04lx]: %p: >>SetVolumeInformation [FsLabel] "
                 "Label=\"%S\"\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
                 (PWSTR)Request->Buffer);
             break;
         default:
             FspDebugLog("%S[TID=%04lx]: %p: >>SetVolumeInformation [INVALID]\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint);
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint);
             break;
         }
         break;
     case FspFsctlTransactQueryDirectoryKind:
         FspDebugLog("%S[TID=%04lx]: %p: >>QueryDirectory %s%S%s%s, "
             "Address=%p, Length=%ld, Pattern=%s%S%s, Marker=%s%S%s\n",
-            FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+            FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
             Request->FileName.Size ? "\"" : "",
             Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
             Request->FileName.Size ? "\", " : "",
@@ -590,7 +596,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         {
         case FSCTL_GET_REPARSE_POINT:
             FspDebugLog("%S[TID=%04lx]: %p: >>FileSystemControl [FSCTL_GET_REPARSE_POINT] %s%S%s%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
                 Request->FileName.Size ? "\"" : "",
                 Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
                 Request->FileName.Size ? "\", " : "",
@@ -602,7 +608,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         case FSCTL_DELETE_REPARSE_POINT:
             FspDebugLog("%S[TID=%04lx]: %p: >>FileSystemControl [%s] %s%S%s%s "
                 "ReparseData=%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
                 FSCTL_SET_REPARSE_POINT == Request->Req.FileSystemControl.FsControlCode ?
                     "FSCTL_SET_REPARSE_POINT" : "FSCTL_DELETE_REPARSE_POINT",
                 Request->FileName.Size ? "\"" : "",
@@ -616,7 +622,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
             break;
         default:
             FspDebugLog("%S[TID=%04lx]: %p: >>FileSystemControl [INVALID] %s%S%s%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
                 Request->FileName.Size ? "\"" : "",
                 Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
                 Request->FileName.Size ? "\", " : "",
@@ -637,7 +643,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         break;
     case FspFsctlTransactQuerySecurityKind:
         FspDebugLog("%S[TID=%04lx]: %p: >>QuerySecurity %s%S%s%s\n",
-            FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+            FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
             Request->FileName.Size ? "\"" : "",
             Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
             Request->FileName.Size ? "\", " : "",
@@ -655,7 +661,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
                 &Sddl, 0);
         FspDebugLog("%S[TID=%04lx]: %p: >>SetSecurity %s%S%s%s, "
             "SecurityInformation=%lx, Security=%s%s%s\n",
-            FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+            FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
             Request->FileName.Size ? "\"" : "",
             Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
             Request->FileName.Size ? "\", " : "",
@@ -670,7 +676,7 @@ FSP_API VOID FspDebugLogRequest(FSP_FSCTL_TRANSACT_REQ *Request)
         break;
     case FspFsctlTransactQueryStreamInformationKind:
         FspDebugLog("%S[TID=%04lx]: %p: >>QueryStreamInformation %s%S%s%s\n",
-            FspDiagIdent(), GetCurrentThreadId(), (PVOID)Request->Hint,
+            FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Request->Hint,
             Request->FileName.Size ? "\"" : "",
             Request->FileName.Size ? (PWSTR)Request->Buffer : L"",
             Request->FileName.Size ? "\", " : "",
@@ -693,6 +699,9 @@ FSP_API VOID FspDebugLogResponse(FSP_FSCTL_TRANSACT_RSP *Response)
     char InfoBuf[256];
     char *Sddl = 0;
 
+    if (FspDebugLogTraceActive && FspDebugLogTraceResponse(Response))
+        return;
+
     switch (Response->Kind)
     {
     case FspFsctlTransactReservedKind:
@@ -706,7 +715,7 @@ FSP_API VOID FspDebugLogResponse(FSP_FSCTL_TRANSACT_RSP *Response)
             if (0/*IO_REPARSE*/ == Response->IoStatus.Information)
                 FspDebugLog("%S[TID=%04lx]: %p: <<Create IoStatus=%lx[%ld] "
                     "Reparse.FileName=\"%s\"\n",
-                    FspDiagIdent(), GetCurrentThreadId(), (PVOID)Response->Hint,
+                    FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Response->Hint,
                     Response->IoStatus.Status, Response->IoStatus.Information,
                     FspDebugLogWideCharBufferString(
                         Response->Buffer + Response->Rsp.Create.Reparse.Buffer.Offset,
@@ -717,7 +726,7 @@ FSP_API VOID FspDebugLogResponse(FSP_FSCTL_TRANSACT_RSP *Response)
             else
                 FspDebugLog("%S[TID=%04lx]: %p: <<Create IoStatus=%lx[%ld] "
                     "Reparse.Data=\"%s\"\n",
-                    FspDiagIdent(), GetCurrentThreadId(), (PVOID)Response->Hint,
+                    FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Response->Hint,
                     Response->IoStatus.Status, Response->IoStatus.Information,
                     FspDebugLogReparseDataString(
                         Response->Buffer + Response->Rsp.Create.Reparse.Buffer.Offset,
@@ -726,7 +735,7 @@ FSP_API VOID FspDebugLogResponse(FSP_FSCTL_TRANSACT_RSP *Response)
         else
             FspDebugLog("%S[TID=%04lx]: %p: <<Create IoStatus=%lx[%ld] "
                 "UserContext=%s, GrantedAccess=%lx, FileInfo=%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Response->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Response->Hint,
                 Response->IoStatus.Status, Response->IoStatus.Information,
                 FspDebugLogUserContextString(
                     Response->Rsp.Create.Opened.UserContext, Response->Rsp.Create.Opened.UserContext2,
@@ -740,7 +749,7 @@ FSP_API VOID FspDebugLogResponse(FSP_FSCTL_TRANSACT_RSP *Response)
         else
             FspDebugLog("%S[TID=%04lx]: %p: <<Overwrite IoStatus=%lx[%ld] "
                 "FileInfo=%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Response->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Response->Hint,
                 Response->IoStatus.Status, Response->IoStatus.Information,
                 FspDebugLogFileInfoString(&Response->Rsp.Overwrite.FileInfo, InfoBuf));
         break;
@@ -759,7 +768,7 @@ FSP_API VOID FspDebugLogResponse(FSP_FSCTL_TRANSACT_RSP *Response)
         else
             FspDebugLog("%S[TID=%04lx]: %p: <<Write IoStatus=%lx[%ld] "
                 "FileInfo=%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Response->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Response->Hint,
                 Response->IoStatus.Status, Response->IoStatus.Information,
                 FspDebugLogFileInfoString(&Response->Rsp.Write.FileInfo, InfoBuf));
         break;
@@ -769,7 +778,7 @@ FSP_API VOID FspDebugLogResponse(FSP_FSCTL_TRANSACT_RSP *Response)
         else
             FspDebugLog("%S[TID=%04lx]: %p: <<QueryInformation IoStatus=%lx[%ld] "
                 "FileInfo=%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Response->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Response->Hint,
                 Response->IoStatus.Status, Response->IoStatus.Information,
                 FspDebugLogFileInfoString(&Response->Rsp.QueryInformation.FileInfo, InfoBuf));
         break;
@@ -779,7 +788,7 @@ FSP_API VOID FspDebugLogResponse(FSP_FSCTL_TRANSACT_RSP *Response)
         else
             FspDebugLog("%S[TID=%04lx]: %p: <<SetInformation IoStatus=%lx[%ld] "
                 "FileInfo=%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Response->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Response->Hint,
                 Response->IoStatus.Status, Response->IoStatus.Information,
                 FspDebugLogFileInfoString(&Response->Rsp.SetInformation.FileInfo, InfoBuf));
         break;
@@ -798,7 +807,7 @@ FSP_API VOID FspDebugLogResponse(FSP_FSCTL_TRANSACT_RSP *Response)
         else
             FspDebugLog("%S[TID=%04lx]: %p: <<QueryVolumeInformation IoStatus=%lx[%ld] "
                 "VolumeInfo=%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Response->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Response->Hint,
                 Response->IoStatus.Status, Response->IoStatus.Information,
                 FspDebugLogVolumeInfoString(&Response->Rsp.QueryVolumeInformation.VolumeInfo, InfoBuf));
         break;
@@ -808,7 +817,7 @@ FSP_API VOID FspDebugLogResponse(FSP_FSCTL_TRANSACT_RSP *Response)
         else
             FspDebugLog("%S[TID=%04lx]: %p: <<SetVolumeInformation IoStatus=%lx[%ld] "
                 "VolumeInfo=%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Response->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Response->Hint,
                 Response->IoStatus.Status, Response->IoStatus.Information,
                 FspDebugLogVolumeInfoString(&Response->Rsp.SetVolumeInformation.VolumeInfo, InfoBuf));
         break;
@@ -822,7 +831,7 @@ FSP_API VOID FspDebugLogResponse(FSP_FSCTL_TRANSACT_RSP *Response)
         else
             FspDebugLog("%S[TID=%04lx]: %p: <<FileSystemControl IoStatus=%lx[%ld] "
                 "ReparseData=%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Response->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Response->Hint,
                 Response->IoStatus.Status, Response->IoStatus.Information,
                 FspDebugLogReparseDataString(Response->Buffer + Response->Rsp.FileSystemControl.Buffer.Offset,
                     InfoBuf));
@@ -850,7 +859,7 @@ FSP_API VOID FspDebugLogResponse(FSP_FSCTL_TRANSACT_RSP *Response)
                     &Sddl, 0);
             FspDebugLog("%S[TID=%04lx]: %p: <<QuerySecurity IoStatus=%lx[%ld] "
                 "Security=%s%s%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Response->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Response->Hint,
                 Response->IoStatus.Status, Response->IoStatus.Information,
                 Sddl ? "\"" : "",
                 Sddl ? Sddl : "NULL",
@@ -872,7 +881,7 @@ FSP_API VOID FspDebugLogResponse(FSP_FSCTL_TRANSACT_RSP *Response)
                     &Sddl, 0);
             FspDebugLog("%S[TID=%04lx]: %p: <<SetSecurity IoStatus=%lx[%ld] "
                 "Security=%s%s%s\n",
-                FspDiagIdent(), GetCurrentThreadId(), (PVOID)Response->Hint,
+                FspDebugLogIdent(), FspDebugLogThreadId(), (PVOID)Response->Hint,
                 Response->IoStatus.Status, Response->IoStatus.Information,
                 Sddl ? "\"" : "",
                 Sddl ? Sddl : "NULL",
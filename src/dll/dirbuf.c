@@ -379,6 +379,13 @@ FSP_API VOID FspFileSystemReleaseDirectoryBuffer(PVOID *PDirBuffer)
 FSP_API VOID FspFileSystemReadDirectoryBuffer(PVOID *PDirBuffer,
     PWSTR Marker,
     PVOID Buffer, ULONG Length, PULONG PBytesTransferred)
+{
+    FspFileSystemReadDirectoryBufferEx(PDirBuffer, 0, Marker, Buffer, Length, PBytesTransferred);
+}
+
+FSP_API VOID FspFileSystemReadDirectoryBufferEx(PVOID *PDirBuffer,
+    FSP_FILE_NAME_PATTERN *Pattern, PWSTR Marker,
+    PVOID Buffer, ULONG Length, PULONG PBytesTransferred)
 {
     FSP_FILE_SYSTEM_DIRECTORY_BUFFER *DirBuffer = FspInterlockedLoadPointer(PDirBuffer);
 
@@ -404,6 +411,10 @@ FSP_API VOID FspFileSystemReadDirectoryBuffer(PVOID *PDirBuffer,
         for (; IndexNum < Count; IndexNum++)
         {
             DirInfo = (PVOID)(DirBuffer->Buffer + Index[IndexNum]);
+            if (0 != Pattern &&
+                !FspFileNamePatternMatch(Pattern, DirInfo->FileNameBuf,
+                    (DirInfo->Size - sizeof *DirInfo) / sizeof(WCHAR)))
+                continue;
             if (!FspFileSystemAddDirInfo(DirInfo, Buffer, Length, PBytesTransferred))
             {
                 ReleaseSRWLockShared(&DirBuffer->Lock);
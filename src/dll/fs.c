@@ -104,6 +104,7 @@ FSP_API NTSTATUS FspFileSystemCreate(PWSTR DevicePath,
     FSP_FILE_SYSTEM **PFileSystem)
 {
     NTSTATUS Result;
+    FSP_FILE_SYSTEM_PRIVATE *FileSystemPrivate;
     FSP_FILE_SYSTEM *FileSystem;
 
     *PFileSystem = 0;
@@ -119,17 +120,35 @@ FSP_API NTSTATUS FspFileSystemCreate(PWSTR DevicePath,
     if (TLS_OUT_OF_INDEXES == FspFileSystemTlsKey)
         return STATUS_INSUFFICIENT_RESOURCES;
 
-    FileSystem = MemAlloc(sizeof *FileSystem);
-    if (0 == FileSystem)
+    FileSystemPrivate = MemAlloc(sizeof *FileSystemPrivate);
+    if (0 == FileSystemPrivate)
         return STATUS_INSUFFICIENT_RESOURCES;
-    memset(FileSystem, 0, sizeof *FileSystem);
+    memset(FileSystemPrivate, 0, sizeof *FileSystemPrivate);
+    FileSystemPrivate->CaseInsensitive = !VolumeParams->CaseSensitiveSearch;
+    FileSystem = &FileSystemPrivate->FileSystem;
 
-    Result = FspFsctlCreateVolume(DevicePath, VolumeParams,
-        FileSystem->VolumeName, sizeof FileSystem->VolumeName,
-        &FileSystem->VolumeHandle);
+    if (0 != DevicePath)
+    {
+        Result = FspFsctlCreateVolume(DevicePath, VolumeParams,
+            FileSystem->VolumeName, sizeof FileSystem->VolumeName,
+            &FileSystem->VolumeHandle);
+        if (!NT_SUCCESS(Result))
+        {
+            MemFree(FileSystemPrivate);
+            return Result;
+        }
+    }
+    else
+        /* not attached to the FSD; can only be driven in-process (e.g. FspFileSystemReplayTrace) */
+        FileSystem->VolumeHandle = INVALID_HANDLE_VALUE;
+
+    Result = FspOperationStatisticsCreate(0 != DevicePath ? FileSystem->VolumeName : 0,
+        &FileSystemPrivate->OperationStatistics);
     if (!NT_SUCCESS(Result))
     {
-        MemFree(FileSystem);
+        if (INVALID_HANDLE_VALUE != FileSystem->VolumeHandle)
+            CloseHandle(FileSystem->VolumeHandle);
+        MemFree(FileSystemPrivate);
         return Result;
     }
 
@@ -170,9 +189,40 @@ FSP_API NTSTATUS FspFileSystemCreate(PWSTR DevicePath,
 
 FSP_API VOID FspFileSystemDelete(FSP_FILE_SYSTEM *FileSystem)
 {
+    FSP_FILE_SYSTEM_PRIVATE *FileSystemPrivate = FspFileSystemPrivate(FileSystem);
+
     FspFileSystemRemoveMountPoint(FileSystem);
-    CloseHandle(FileSystem->VolumeHandle);
-    MemFree(FileSystem);
+    if (INVALID_HANDLE_VALUE != FileSystem->VolumeHandle)
+        CloseHandle(FileSystem->VolumeHandle);
+    if (0 != FileSystemPrivate->ReparsePointCache)
+        FspReparsePointCacheDelete(FileSystemPrivate->ReparsePointCache);
+    FspOperationStatisticsDelete(FileSystemPrivate->OperationStatistics);
+    MemFree(FileSystemPrivate);
+}
+
+FSP_API NTSTATUS FspFileSystemSetReparsePointCache(FSP_FILE_SYSTEM *FileSystem,
+    ULONG Timeout, ULONG MaxEntries)
+{
+    FSP_FILE_SYSTEM_PRIVATE *FileSystemPrivate = FspFileSystemPrivate(FileSystem);
+    FSP_REPARSE_POINT_CACHE *Cache = 0;
+    NTSTATUS Result;
+
+    if (0 != FileSystem->DispatcherThread)
+        return STATUS_INVALID_DEVICE_REQUEST;
+
+    if (0 != Timeout)
+    {
+        Result = FspReparsePointCacheCreate(Timeout, MaxEntries,
+            FileSystemPrivate->CaseInsensitive, &Cache);
+        if (!NT_SUCCESS(Result))
+            return Result;
+    }
+
+    if (0 != FileSystemPrivate->ReparsePointCache)
+        FspReparsePointCacheDelete(FileSystemPrivate->ReparsePointCache);
+    FileSystemPrivate->ReparsePointCache = Cache;
+
+    return STATUS_SUCCESS;
 }
 
 FSP_API NTSTATUS FspFileSystemSetMountPoint(FSP_FILE_SYSTEM *FileSystem, PWSTR MountPoint)
@@ -185,6 +235,8 @@ FSP_API NTSTATUS FspFileSystemSetMountPointEx(FSP_FILE_SYSTEM *FileSystem, PWSTR
 {
     if (0 != FileSystem->MountPoint)
         return STATUS_INVALID_PARAMETER;
+    if (INVALID_HANDLE_VALUE == FileSystem->VolumeHandle)
+        return STATUS_INVALID_DEVICE_REQUEST;
 
     FSP_MOUNT_DESC Desc;
     int Size;
@@ -241,6 +293,72 @@ FSP_API VOID FspFileSystemRemoveMountPoint(FSP_FILE_SYSTEM *FileSystem)
     FileSystem->MountHandle = 0;
 }
 
+static inline VOID FspFileSystemDispatchOperation(FSP_FILE_SYSTEM *FileSystem,
+    FSP_FSCTL_TRANSACT_REQ *Request, FSP_FSCTL_TRANSACT_RSP *Response,
+    FSP_OPERATION_STATISTICS_SLOT *StatisticsSlot)
+{
+    LARGE_INTEGER StartCounter, EndCounter;
+
+    Response->Size = sizeof *Response;
+    Response->Kind = Request->Kind;
+    Response->Hint = Request->Hint;
+    if (FspFsctlTransactKindCount > Request->Kind && 0 != FileSystem->Operations[Request->Kind])
+    {
+        if (0 != StatisticsSlot)
+            QueryPerformanceCounter(&StartCounter);
+
+        Response->IoStatus.Status =
+            FspFileSystemEnterOperation(FileSystem, Request, Response);
+        if (NT_SUCCESS(Response->IoStatus.Status))
+        {
+            Response->IoStatus.Status =
+                FileSystem->Operations[Request->Kind](FileSystem, Request, Response);
+            FspFileSystemLeaveOperation(FileSystem, Request, Response);
+        }
+
+        if (0 != StatisticsSlot)
+        {
+            QueryPerformanceCounter(&EndCounter);
+            FspOperationStatisticsRecord(FspFileSystemPrivate(FileSystem)->OperationStatistics,
+                StatisticsSlot, Request->Kind, Response->IoStatus.Status,
+                EndCounter.QuadPart - StartCounter.QuadPart);
+        }
+    }
+    else
+        Response->IoStatus.Status = STATUS_INVALID_DEVICE_REQUEST;
+}
+
+static inline FSP_OPERATION_STATISTICS_SLOT *FspFileSystemStatisticsSlot(
+    FSP_FILE_SYSTEM *FileSystem, BOOLEAN Shared)
+{
+    FSP_FILE_SYSTEM_PRIVATE *FileSystemPrivate = FspFileSystemPrivate(FileSystem);
+
+    if (FileSystemPrivate->OperationStatisticsDisabled)
+        return 0;
+
+    return Shared ?
+        FspOperationStatisticsSharedSlot(FileSystemPrivate->OperationStatistics) :
+        FspOperationStatisticsAcquireSlot(FileSystemPrivate->OperationStatistics);
+}
+
+VOID FspFileSystemReplayOperation(FSP_FILE_SYSTEM *FileSystem,
+    FSP_FSCTL_TRANSACT_REQ *Request, FSP_FSCTL_TRANSACT_RSP *Response)
+{
+    FSP_FILE_SYSTEM_OPERATION_CONTEXT OperationContext;
+    PVOID PrevOperationContext;
+
+    OperationContext.Request = Request;
+    OperationContext.Response = Response;
+    PrevOperationContext = TlsGetValue(FspFileSystemTlsKey);
+    TlsSetValue(FspFileSystemTlsKey, &OperationContext);
+
+    memset(Response, 0, sizeof *Response);
+    FspFileSystemDispatchOperation(FileSystem, Request, Response,
+        FspFileSystemStatisticsSlot(FileSystem, TRUE));
+
+    TlsSetValue(FspFileSystemTlsKey, PrevOperationContext);
+}
+
 static DWORD WINAPI FspFileSystemDispatcherThread(PVOID FileSystem0)
 {
     FSP_FILE_SYSTEM *FileSystem = FileSystem0;
@@ -249,6 +367,7 @@ static DWORD WINAPI FspFileSystemDispatcherThread(PVOID FileSystem0)
     FSP_FSCTL_TRANSACT_REQ *Request = 0;
     FSP_FSCTL_TRANSACT_RSP *Response = 0;
     FSP_FILE_SYSTEM_OPERATION_CONTEXT OperationContext;
+    FSP_OPERATION_STATISTICS_SLOT *StatisticsSlot;
     HANDLE DispatcherThread = 0;
 
     Request = MemAlloc(FSP_FSCTL_TRANSACT_BUFFER_SIZEMIN);
@@ -274,6 +393,8 @@ static DWORD WINAPI FspFileSystemDispatcherThread(PVOID FileSystem0)
     OperationContext.Response = Response;
     TlsSetValue(FspFileSystemTlsKey, &OperationContext);
 
+    StatisticsSlot = FspFileSystemStatisticsSlot(FileSystem, FALSE);
+
 #if defined(FSP_CFG_REJECT_EARLY_IRP)
     Result = FspFsctlTransact(FileSystem->VolumeHandle, 0, 0, 0, 0, FALSE);
         /* send a Transact0 to inform the FSD that the dispatcher is ready */
@@ -301,22 +422,7 @@ static DWORD WINAPI FspFileSystemDispatcherThread(PVOID FileSystem0)
                 FspDebugLogRequest(Request);
         }
 
-        Response->Size = sizeof *Response;
-        Response->Kind = Request->Kind;
-        Response->Hint = Request->Hint;
-        if (FspFsctlTransactKindCount > Request->Kind && 0 != FileSystem->Operations[Request->Kind])
-        {
-            Response->IoStatus.Status =
-                FspFileSystemEnterOperation(FileSystem, Request, Response);
-            if (NT_SUCCESS(Response->IoStatus.Status))
-            {
-                Response->IoStatus.Status =
-                    FileSystem->Operations[Request->Kind](FileSystem, Request, Response);
-                FspFileSystemLeaveOperation(FileSystem, Request, Response);
-            }
-        }
-        else
-            Response->IoStatus.Status = STATUS_INVALID_DEVICE_REQUEST;
+        FspFileSystemDispatchOperation(FileSystem, Request, Response, StatisticsSlot);
 
         if (FileSystem->DebugLog)
         {
@@ -380,6 +486,8 @@ FSP_API NTSTATUS FspFileSystemStartDispatcher(FSP_FILE_SYSTEM *FileSystem, ULONG
 {
     if (0 != FileSystem->DispatcherThread)
         return STATUS_INVALID_PARAMETER;
+    if (INVALID_HANDLE_VALUE == FileSystem->VolumeHandle)
+        return STATUS_INVALID_DEVICE_REQUEST;
 
     if (0 == ThreadCount)
     {
@@ -400,6 +508,8 @@ FSP_API NTSTATUS FspFileSystemStartDispatcher(FSP_FILE_SYSTEM *FileSystem, ULONG
     if (ThreadCount < FspFileSystemDispatcherThreadCountMin)
         ThreadCount = FspFileSystemDispatcherThreadCountMin;
 
+    FspOperationStatisticsReset(FspFileSystemPrivate(FileSystem)->OperationStatistics);
+
     FileSystem->DispatcherThreadCount = ThreadCount;
     FileSystem->DispatcherThread = CreateThread(0, 0,
         FspFileSystemDispatcherThread, FileSystem, 0, 0);
@@ -452,6 +562,9 @@ FSP_API VOID FspFileSystemSendResponse(FSP_FILE_SYSTEM *FileSystem,
             FspDebugLogResponse(Response);
     }
 
+    if (INVALID_HANDLE_VALUE == FileSystem->VolumeHandle)
+        return;
+
     Result = FspFsctlTransact(FileSystem->VolumeHandle,
         Response, Response->Size, 0, 0, FALSE);
     if (!NT_SUCCESS(Result))
@@ -482,6 +595,9 @@ FSP_API NTSTATUS FspFileSystemNotifyBegin(FSP_FILE_SYSTEM *FileSystem, ULONG Tim
     ULONG Total = 0, Delay;
     NTSTATUS Result;
 
+    if (INVALID_HANDLE_VALUE == FileSystem->VolumeHandle)
+        return STATUS_INVALID_DEVICE_REQUEST;
+
     for (ULONG i = 0, n = sizeof(Delays) / sizeof(Delays[0]);; i++)
     {
         Result = FspFsctlNotify(FileSystem->VolumeHandle, 0, 0);
@@ -509,13 +625,105 @@ FSP_API NTSTATUS FspFileSystemNotifyEnd(FSP_FILE_SYSTEM *FileSystem)
 {
     FSP_FSCTL_NOTIFY_INFO NotifyInfo;
 
+    if (INVALID_HANDLE_VALUE == FileSystem->VolumeHandle)
+        return STATUS_INVALID_DEVICE_REQUEST;
+
     memset(&NotifyInfo, 0, sizeof NotifyInfo);
     return FspFsctlNotify(FileSystem->VolumeHandle, &NotifyInfo, sizeof NotifyInfo.Size);
 }
 
+static NTSTATUS FspFileSystemNotifyWithoutRanges(FSP_FILE_SYSTEM *FileSystem,
+    FSP_FSCTL_NOTIFY_INFO *NotifyInfo, SIZE_T Size)
+{
+    /*
+     * Drivers prior to v2.1 do not understand FSP_FSCTL_NOTIFY_RANGE_INFO records and would
+     * misparse them. Send such records as regular notify information instead; the driver
+     * then invalidates all cached information about the file, as it does for any change.
+     */
+    PUINT8 NotifyInfoEnd = (PUINT8)NotifyInfo + Size;
+    FSP_FSCTL_NOTIFY_INFO *Info, *PlainNotifyInfo, *PlainInfo;
+    ULONG InfoSize, FileNameSize;
+    SIZE_T PlainSize = 0;
+    NTSTATUS Result;
+
+    /* regular records are never larger than the range records they replace */
+    PlainNotifyInfo = MemAlloc(Size);
+    if (0 == PlainNotifyInfo)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    for (Info = NotifyInfo, PlainInfo = PlainNotifyInfo;
+        (PUINT8)Info + sizeof(FSP_FSCTL_NOTIFY_INFO) <= NotifyInfoEnd;
+        Info = (PVOID)((PUINT8)Info + FSP_FSCTL_DEFAULT_ALIGN_UP(InfoSize)))
+    {
+        InfoSize = Info->Size;
+        if (sizeof(FSP_FSCTL_NOTIFY_INFO) > InfoSize ||
+            (PUINT8)Info + InfoSize > NotifyInfoEnd)
+            break;
+
+        if (0 != (Info->Action & FSP_FSCTL_NOTIFY_ACTION_RANGE))
+        {
+            if (sizeof(FSP_FSCTL_NOTIFY_RANGE_INFO) > InfoSize)
+                break;
+
+            FileNameSize = InfoSize - sizeof(FSP_FSCTL_NOTIFY_RANGE_INFO);
+            PlainInfo->Size = (UINT16)(sizeof(FSP_FSCTL_NOTIFY_INFO) + FileNameSize);
+            PlainInfo->Filter = Info->Filter;
+            PlainInfo->Action = Info->Action & ~FSP_FSCTL_NOTIFY_ACTION_RANGE;
+            memcpy(PlainInfo->FileNameBuf,
+                ((FSP_FSCTL_NOTIFY_RANGE_INFO *)Info)->FileNameBuf, FileNameSize);
+        }
+        else
+            memcpy(PlainInfo, Info, InfoSize);
+
+        PlainSize = (PUINT8)PlainInfo + PlainInfo->Size - (PUINT8)PlainNotifyInfo;
+        PlainInfo = (PVOID)((PUINT8)PlainInfo + FSP_FSCTL_DEFAULT_ALIGN_UP(PlainInfo->Size));
+    }
+
+    Result = FspFsctlNotify(FileSystem->VolumeHandle, PlainNotifyInfo, PlainSize);
+
+    MemFree(PlainNotifyInfo);
+
+    return Result;
+}
+
 FSP_API NTSTATUS FspFileSystemNotify(FSP_FILE_SYSTEM *FileSystem,
     FSP_FSCTL_NOTIFY_INFO *NotifyInfo, SIZE_T Size)
 {
+    PUINT8 NotifyInfoEnd = (PUINT8)NotifyInfo + Size;
+    FSP_FSCTL_NOTIFY_INFO *Info;
+    ULONG InfoSize;
+    BOOLEAN HasRangeInfo = FALSE;
+    UINT32 Version;
+
+    if (INVALID_HANDLE_VALUE == FileSystem->VolumeHandle)
+        return STATUS_INVALID_DEVICE_REQUEST;
+
+    for (Info = NotifyInfo;
+        (PUINT8)Info + sizeof(FSP_FSCTL_NOTIFY_INFO) <= NotifyInfoEnd;
+        Info = (PVOID)((PUINT8)Info + FSP_FSCTL_DEFAULT_ALIGN_UP(InfoSize)))
+    {
+        InfoSize = Info->Size;
+        if (sizeof(FSP_FSCTL_NOTIFY_INFO) > InfoSize ||
+            (PUINT8)Info + InfoSize > NotifyInfoEnd)
+            break;
+
+        /* byte range records only report data changes */
+        if (0 != (Info->Action & FSP_FSCTL_NOTIFY_ACTION_RANGE))
+        {
+            HasRangeInfo = TRUE;
+            continue;
+        }
+
+        /* a changed file may have become (or stopped being) a reparse point */
+        if (0 != FspFileSystemPrivate(FileSystem)->ReparsePointCache)
+            FspFileSystemInvalidateReparsePointCache(FileSystem, Info->FileNameBuf,
+                (InfoSize - sizeof(FSP_FSCTL_NOTIFY_INFO)) / sizeof(WCHAR));
+    }
+
+    if (HasRangeInfo &&
+        (!NT_SUCCESS(FspFsctlServiceVersion(&Version)) || 0x00020001 /*v2.1*/ > Version))
+        return FspFileSystemNotifyWithoutRanges(FileSystem, NotifyInfo, Size);
+
     return FspFsctlNotify(FileSystem->VolumeHandle, NotifyInfo, Size);
 }
 
@@ -226,6 +226,24 @@ exit:
     return Result;
 }
 
+FSP_API NTSTATUS FspFsctlCreateDataRing(HANDLE VolumeHandle,
+    UINT32 SlotSize, UINT32 SlotCount)
+{
+    FSP_FSCTL_DATA_RING_PARAMS Params;
+    DWORD Bytes;
+
+    Params.SlotSize = SlotSize;
+    Params.SlotCount = SlotCount;
+
+    if (!DeviceIoControl(VolumeHandle,
+        FSP_FSCTL_DATA_RING,
+        &Params, sizeof Params, 0, 0,
+        &Bytes, 0))
+        return FspNtStatusFromWin32(GetLastError());
+
+    return STATUS_SUCCESS;
+}
+
 FSP_API NTSTATUS FspFsctlGetVolumeList(PWSTR DevicePath,
     PWCHAR VolumeListBuf, PSIZE_T PVolumeListSize)
 {
@@ -280,6 +280,94 @@ NTSTATUS FspFileSystemOpenCheck(FSP_FILE_SYSTEM *FileSystem,
     return Result;
 }
 
+static inline
+BOOLEAN FspFileSystemCanOpenWithSecurity(FSP_FILE_SYSTEM *FileSystem,
+    FSP_FSCTL_TRANSACT_REQ *Request)
+{
+    /*
+     * OpenWithSecurity replaces the GetSecurityByName and Open calls of an open. It is not
+     * used when a traverse check is required, because the traverse check must happen before
+     * the file is opened. It is also not used when FspAccessCheckEx would not look up the
+     * file anyway.
+     */
+    return 0 != FileSystem->Interface->OpenWithSecurity &&
+        0 != FileSystem->Interface->GetSecurityByName &&
+        (Request->Req.Create.UserMode ?
+            Request->Req.Create.HasTraversePrivilege :
+            Request->Req.Create.AcceptsSecurityDescriptor);
+}
+
+static NTSTATUS FspFileSystemOpenWithSecurityCheck(FSP_FILE_SYSTEM *FileSystem,
+    FSP_FSCTL_TRANSACT_REQ *Request, FSP_FSCTL_TRANSACT_RSP *Response,
+    PUINT32 PGrantedAccess, FSP_FSCTL_TRANSACT_FULL_CONTEXT *FullContext,
+    FSP_FSCTL_OPEN_FILE_INFO *OpenFileInfo, PSECURITY_DESCRIPTOR *PSecurityDescriptor)
+{
+    NTSTATUS Result;
+    UINT32 DesiredAccess, GrantedAccess;
+    PSECURITY_DESCRIPTOR SecurityDescriptor;
+    SIZE_T SecurityDescriptorSize;
+
+    /*
+     * Open the file and get its security in a single call and then perform the same
+     * checks as FspFileSystemOpenCheck on the result. If the checks fail the file is closed.
+     *
+     * STATUS_REPARSE is returned without the file open and without a reparse response,
+     * when the open must be retried through FspFileSystemOpenCheck and Open instead.
+     */
+
+    DesiredAccess = Request->Req.Create.DesiredAccess |
+        ((Request->Req.Create.CreateOptions & FILE_DELETE_ON_CLOSE) ? DELETE : 0);
+
+    SecurityDescriptorSize = 1024;
+    SecurityDescriptor = MemAlloc(SecurityDescriptorSize);
+    if (0 == SecurityDescriptor)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    for (;;)
+    {
+        FullContext->UserContext = 0;
+        FullContext->UserContext2 = 0;
+        memset(OpenFileInfo, 0, sizeof *OpenFileInfo);
+        OpenFileInfo->NormalizedName = (PVOID)Response->Buffer;
+        OpenFileInfo->NormalizedNameSize = FSP_FSCTL_TRANSACT_RSP_BUFFER_SIZEMAX;
+        Result = FileSystem->Interface->OpenWithSecurity(FileSystem,
+            (PWSTR)Request->Buffer, Request->Req.Create.CreateOptions, DesiredAccess,
+            AddrOfFileContext(*FullContext), &OpenFileInfo->FileInfo,
+            SecurityDescriptor, &SecurityDescriptorSize);
+        if (STATUS_BUFFER_OVERFLOW != Result)
+            break;
+
+        MemFree(SecurityDescriptor);
+        SecurityDescriptor = MemAlloc(SecurityDescriptorSize);
+        if (0 == SecurityDescriptor)
+            return STATUS_INSUFFICIENT_RESOURCES;
+    }
+    if (!NT_SUCCESS(Result) || STATUS_REPARSE == Result)
+    {
+        MemFree(SecurityDescriptor);
+        return Result;
+    }
+
+    /* FspAccessCheckOpened consumes SecurityDescriptor */
+    Result = FspAccessCheckOpened(FileSystem, Request,
+        OpenFileInfo->FileInfo.FileAttributes, SecurityDescriptor, SecurityDescriptorSize,
+        DesiredAccess, &GrantedAccess,
+        Request->Req.Create.AcceptsSecurityDescriptor ? PSecurityDescriptor : 0);
+    if (!NT_SUCCESS(Result) || STATUS_REPARSE == Result)
+    {
+        if (0 != FileSystem->Interface->Close)
+            FileSystem->Interface->Close(FileSystem, (PVOID)ValOfFileContext(*FullContext));
+        return Result;
+    }
+
+    *PGrantedAccess = GrantedAccess;
+    if (0 == (Request->Req.Create.DesiredAccess & MAXIMUM_ALLOWED))
+        *PGrantedAccess &= ~DELETE | (Request->Req.Create.DesiredAccess & DELETE);
+    *PGrantedAccess |= Request->Req.Create.GrantedAccess;
+
+    return STATUS_SUCCESS;
+}
+
 static inline
 NTSTATUS FspFileSystemOverwriteCheck(FSP_FILE_SYSTEM *FileSystem,
     FSP_FSCTL_TRANSACT_REQ *Request, FSP_FSCTL_TRANSACT_RSP *Response,
@@ -493,24 +581,33 @@ static NTSTATUS FspFileSystemOpCreate_FileOpen(FSP_FILE_SYSTEM *FileSystem,
     FSP_FSCTL_OPEN_FILE_INFO OpenFileInfo;
     PSECURITY_DESCRIPTOR OpenDescriptor = 0;
 
-    Result = FspFileSystemOpenCheck(FileSystem, Request, Response, TRUE, &GrantedAccess,
-        &OpenDescriptor);
-    if (!NT_SUCCESS(Result) || STATUS_REPARSE == Result)
-        return Result;
-
-    FullContext.UserContext = 0;
-    FullContext.UserContext2 = 0;
-    memset(&OpenFileInfo, 0, sizeof OpenFileInfo);
-    OpenFileInfo.NormalizedName = (PVOID)Response->Buffer;
-    OpenFileInfo.NormalizedNameSize = FSP_FSCTL_TRANSACT_RSP_BUFFER_SIZEMAX;
-    Result = FileSystem->Interface->Open(FileSystem,
-        (PWSTR)Request->Buffer, Request->Req.Create.CreateOptions, GrantedAccess,
-        AddrOfFileContext(FullContext), &OpenFileInfo.FileInfo);
-    if (!NT_SUCCESS(Result))
+    Result = STATUS_REPARSE;
+    if (FspFileSystemCanOpenWithSecurity(FileSystem, Request))
+        Result = FspFileSystemOpenWithSecurityCheck(FileSystem, Request, Response,
+            &GrantedAccess, &FullContext, &OpenFileInfo, &OpenDescriptor);
+    if (STATUS_REPARSE == Result)
     {
-        FspDeleteSecurityDescriptor(OpenDescriptor, FspAccessCheckEx);
-        return Result;
+        Result = FspFileSystemOpenCheck(FileSystem, Request, Response, TRUE, &GrantedAccess,
+            &OpenDescriptor);
+        if (!NT_SUCCESS(Result) || STATUS_REPARSE == Result)
+            return Result;
+
+        FullContext.UserContext = 0;
+        FullContext.UserContext2 = 0;
+        memset(&OpenFileInfo, 0, sizeof OpenFileInfo);
+        OpenFileInfo.NormalizedName = (PVOID)Response->Buffer;
+        OpenFileInfo.NormalizedNameSize = FSP_FSCTL_TRANSACT_RSP_BUFFER_SIZEMAX;
+        Result = FileSystem->Interface->Open(FileSystem,
+            (PWSTR)Request->Buffer, Request->Req.Create.CreateOptions, GrantedAccess,
+            AddrOfFileContext(FullContext), &OpenFileInfo.FileInfo);
+        if (!NT_SUCCESS(Result))
+        {
+            FspDeleteSecurityDescriptor(OpenDescriptor, FspAccessCheckEx);
+            return Result;
+        }
     }
+    else if (!NT_SUCCESS(Result))
+        return Result;
 
     if (FSP_FSCTL_TRANSACT_PATH_SIZEMAX >= OpenFileInfo.NormalizedNameSize)
     {
@@ -542,18 +639,36 @@ static NTSTATUS FspFileSystemOpCreate_FileOpenIf(FSP_FILE_SYSTEM *FileSystem,
     FSP_FSCTL_TRANSACT_FULL_CONTEXT FullContext;
     FSP_FSCTL_OPEN_FILE_INFO OpenFileInfo;
     PSECURITY_DESCRIPTOR OpenDescriptor = 0;
-    BOOLEAN Create = FALSE;
+    BOOLEAN Create = FALSE, Opened = FALSE;
 
-    Result = FspFileSystemOpenCheck(FileSystem, Request, Response, TRUE, &GrantedAccess,
-        &OpenDescriptor);
-    if (!NT_SUCCESS(Result) || STATUS_REPARSE == Result)
+    Result = STATUS_REPARSE;
+    if (FspFileSystemCanOpenWithSecurity(FileSystem, Request))
+        Result = FspFileSystemOpenWithSecurityCheck(FileSystem, Request, Response,
+            &GrantedAccess, &FullContext, &OpenFileInfo, &OpenDescriptor);
+    if (STATUS_REPARSE != Result)
     {
-        if (STATUS_OBJECT_NAME_NOT_FOUND != Result)
-            return Result;
-        Create = TRUE;
+        if (!NT_SUCCESS(Result))
+        {
+            if (STATUS_OBJECT_NAME_NOT_FOUND != Result)
+                return Result;
+            Create = TRUE;
+        }
+        else
+            Opened = TRUE;
+    }
+    else
+    {
+        Result = FspFileSystemOpenCheck(FileSystem, Request, Response, TRUE, &GrantedAccess,
+            &OpenDescriptor);
+        if (!NT_SUCCESS(Result) || STATUS_REPARSE == Result)
+        {
+            if (STATUS_OBJECT_NAME_NOT_FOUND != Result)
+                return Result;
+            Create = TRUE;
+        }
     }
 
-    if (!Create)
+    if (!Create && !Opened)
     {
         FullContext.UserContext = 0;
         FullContext.UserContext2 = 0;
@@ -939,6 +1054,10 @@ FSP_API NTSTATUS FspFileSystemOpCreate(FSP_FILE_SYSTEM *FileSystem,
         Result = FspFileSystemOpCreate_NotFoundCheck(FileSystem, Request, Response);
     else if (STATUS_OBJECT_NAME_COLLISION == Result)
         Result = FspFileSystemOpCreate_CollisionCheck(FileSystem, Request, Response);
+    else if (NT_SUCCESS(Result) && STATUS_REPARSE != Result &&
+        FILE_OPEN != ((Request->Req.Create.CreateOptions >> 24) & 0xff))
+        FspFileSystemInvalidateReparsePointCache(FileSystem,
+            (PWSTR)Request->Buffer, Request->FileName.Size / sizeof(WCHAR) - 1);
 
     return Result;
 }
@@ -996,6 +1115,11 @@ FSP_API NTSTATUS FspFileSystemOpCleanup(FSP_FILE_SYSTEM *FileSystem,
             (0 != Request->Req.Cleanup.SetLastWriteTime ? FspCleanupSetLastWriteTime : 0) |
             (0 != Request->Req.Cleanup.SetChangeTime ? FspCleanupSetChangeTime : 0));
 
+    /* invalidate after the delete so that a concurrent lookup cannot re-cache the old result */
+    if (0 != Request->Req.Cleanup.Delete && 0 != Request->FileName.Size)
+        FspFileSystemInvalidateReparsePointCache(FileSystem,
+            (PWSTR)Request->Buffer, Request->FileName.Size / sizeof(WCHAR) - 1);
+
     return STATUS_SUCCESS;
 }
 
@@ -1188,6 +1312,14 @@ FSP_API NTSTATUS FspFileSystemOpSetInformation(FSP_FILE_SYSTEM *FileSystem,
                 (PWSTR)Request->Buffer,
                 (PWSTR)(Request->Buffer + Request->Req.SetInformation.Info.Rename.NewFileName.Offset),
                 0 != Request->Req.SetInformation.Info.Rename.AccessToken);
+            if (NT_SUCCESS(Result))
+            {
+                FspFileSystemInvalidateReparsePointCache(FileSystem,
+                    (PWSTR)Request->Buffer, Request->FileName.Size / sizeof(WCHAR) - 1);
+                FspFileSystemInvalidateReparsePointCache(FileSystem,
+                    (PWSTR)(Request->Buffer + Request->Req.SetInformation.Info.Rename.NewFileName.Offset),
+                    Request->Req.SetInformation.Info.Rename.NewFileName.Size / sizeof(WCHAR) - 1);
+            }
         }
         break;
     }
@@ -1391,6 +1523,9 @@ FSP_API NTSTATUS FspFileSystemOpFileSystemControl(FSP_FILE_SYSTEM *FileSystem,
                 (PWSTR)Request->Buffer,
                 ReparseData,
                 Request->Req.FileSystemControl.Buffer.Size);
+            if (NT_SUCCESS(Result) && 0 != Request->FileName.Size)
+                FspFileSystemInvalidateReparsePointCache(FileSystem,
+                    (PWSTR)Request->Buffer, Request->FileName.Size / sizeof(WCHAR) - 1);
         }
         break;
     case FSCTL_DELETE_REPARSE_POINT:
@@ -1404,6 +1539,9 @@ FSP_API NTSTATUS FspFileSystemOpFileSystemControl(FSP_FILE_SYSTEM *FileSystem,
                 (PWSTR)Request->Buffer,
                 ReparseData,
                 Request->Req.FileSystemControl.Buffer.Size);
+            if (NT_SUCCESS(Result) && 0 != Request->FileName.Size)
+                FspFileSystemInvalidateReparsePointCache(FileSystem,
+                    (PWSTR)Request->Buffer, Request->FileName.Size / sizeof(WCHAR) - 1);
         }
         break;
     }
@@ -1534,6 +1672,32 @@ FSP_API BOOLEAN FspFileSystemAddDirInfo(FSP_FSCTL_DIR_INFO *DirInfo,
     return FspFileSystemAddXxxInfo(DirInfo, Buffer, Length, PBytesTransferred);
 }
 
+static NTSTATUS FspFileSystemGetReparsePointByNameCached(FSP_FILE_SYSTEM *FileSystem,
+    NTSTATUS (*GetReparsePointByName)(
+        FSP_FILE_SYSTEM *FileSystem, PVOID Context,
+        PWSTR FileName, BOOLEAN IsDirectory, PVOID Buffer, PSIZE_T PSize),
+    PVOID Context,
+    PWSTR FileName, BOOLEAN IsDirectory, PVOID Buffer, PSIZE_T PSize)
+{
+    FSP_REPARSE_POINT_CACHE *Cache = FspFileSystemPrivate(FileSystem)->ReparsePointCache;
+    NTSTATUS Result;
+    ULONG Generation = 0;
+
+    if (0 != Cache &&
+        FspReparsePointCacheLookup(Cache, FileName, IsDirectory, Buffer, PSize,
+            &Result, &Generation))
+        return Result;
+
+    Result = GetReparsePointByName(FileSystem, Context, FileName, IsDirectory, Buffer, PSize);
+
+    /* the insert is dropped if an invalidation ran during the upcall */
+    if (0 != Cache)
+        FspReparsePointCacheInsert(Cache, FileName, IsDirectory, Result,
+            Buffer, 0 != PSize ? *PSize : 0, Generation);
+
+    return Result;
+}
+
 FSP_API BOOLEAN FspFileSystemFindReparsePoint(FSP_FILE_SYSTEM *FileSystem,
     NTSTATUS (*GetReparsePointByName)(
         FSP_FILE_SYSTEM *FileSystem, PVOID Context,
@@ -1559,7 +1723,8 @@ FSP_API BOOLEAN FspFileSystemFindReparsePoint(FSP_FILE_SYSTEM *FileSystem,
         }
 
         *RemainderPath = L'\0';
-        Result = GetReparsePointByName(FileSystem, Context, FileName, TRUE, 0, 0);
+        Result = FspFileSystemGetReparsePointByNameCached(FileSystem,
+            GetReparsePointByName, Context, FileName, TRUE, 0, 0);
         *RemainderPath = L'\\';
 
         if (STATUS_NOT_A_REPARSE_POINT == Result)
@@ -1677,7 +1842,8 @@ static NTSTATUS FspFileSystemResolveReparsePointsInternal(FSP_FILE_SYSTEM *FileS
 
         RemainderChar = *RemainderPath; *RemainderPath = L'\0';
         ReparseDataSize = ReparseDataSize0;
-        Result = GetReparsePointByName(FileSystem, Context, TargetPath, L'\\' == RemainderChar,
+        Result = FspFileSystemGetReparsePointByNameCached(FileSystem,
+            GetReparsePointByName, Context, TargetPath, L'\\' == RemainderChar,
             ReparseData, &ReparseDataSize);
         *RemainderPath = RemainderChar;
 
@@ -1884,6 +2050,13 @@ FSP_API BOOLEAN FspFileSystemAddNotifyInfo(FSP_FSCTL_NOTIFY_INFO *NotifyInfo,
     return FspFileSystemAddXxxInfo(NotifyInfo, Buffer, Length, PBytesTransferred);
 }
 
+FSP_API BOOLEAN FspFileSystemAddNotifyRangeInfo(FSP_FSCTL_NOTIFY_RANGE_INFO *NotifyInfo,
+    PVOID Buffer, ULONG Length, PULONG PBytesTransferred)
+{
+    NotifyInfo->Action |= FSP_FSCTL_NOTIFY_ACTION_RANGE;
+    return FspFileSystemAddXxxInfo(NotifyInfo, Buffer, Length, PBytesTransferred);
+}
+
 FSP_API VOID FspFileSystemStopServiceIfNecessary(FSP_FILE_SYSTEM *FileSystem,
     BOOLEAN Normally)
 {
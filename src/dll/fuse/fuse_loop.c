@@ -235,6 +235,17 @@ static NTSTATUS fsp_fuse_loop_start(struct fuse *f)
     FspFileSystemSetOperationGuardStrategy(f->FileSystem, f->OpGuardStrategy);
     FspFileSystemSetDebugLog(f->FileSystem, f->DebugLog);
 
+    if (0 != f->ReparsePointTimeout)
+    {
+        Result = FspFileSystemSetReparsePointCache(f->FileSystem, f->ReparsePointTimeout, 0);
+        if (!NT_SUCCESS(Result))
+        {
+            FspServiceLog(EVENTLOG_ERROR_TYPE,
+                L"Cannot set " FSP_FUSE_LIBRARY_NAME " reparse point cache.");
+            goto fail;
+        }
+    }
+
     if (0 != f->MountPoint)
     {
         Result = FspFileSystemSetMountPoint(f->FileSystem,
@@ -58,6 +58,7 @@ struct fuse
     int rellinks;
     int dothidden;
     unsigned ThreadCount;
+    unsigned ReparsePointTimeout;
     struct fuse_operations ops;
     void *data;
     unsigned conn_want;
@@ -158,6 +159,7 @@ struct fsp_fuse_core_opt_data
         set_KeepFileCache,
         set_LegacyUnlinkRename;
     unsigned ThreadCount;
+    unsigned ReparsePointTimeout;
     FSP_FSCTL_VOLUME_PARAMS VolumeParams;
     UINT16 VolumeLabelLength;
     WCHAR VolumeLabel[sizeof ((FSP_FSCTL_VOLUME_INFO *)0)->VolumeLabel / sizeof(WCHAR)];
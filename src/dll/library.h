@@ -62,6 +62,7 @@ VOID FspFileSystemFinalize(BOOLEAN Dynamic);
 VOID FspServiceFinalize(BOOLEAN Dynamic);
 VOID fsp_fuse_finalize(BOOLEAN Dynamic);
 VOID fsp_fuse_finalize_thread(VOID);
+VOID FspDebugLogTraceFinalizeThread(VOID);
 
 NTSTATUS FspFsctlRegister(VOID);
 NTSTATUS FspFsctlUnregister(VOID);
@@ -93,6 +94,74 @@ ULONG FspLdapGetDefaultNamingContext(PVOID Ldap, PWSTR *PValue);
 ULONG FspLdapGetTrustPosixOffset(PVOID Ldap, PWSTR Context, PWSTR Domain, PWSTR *PValue);
 
 PWSTR FspDiagIdent(VOID);
+
+typedef struct _FSP_REPARSE_POINT_CACHE FSP_REPARSE_POINT_CACHE;
+NTSTATUS FspReparsePointCacheCreate(ULONG Timeout, ULONG MaxEntries, BOOLEAN CaseInsensitive,
+    FSP_REPARSE_POINT_CACHE **PCache);
+VOID FspReparsePointCacheDelete(FSP_REPARSE_POINT_CACHE *Cache);
+BOOLEAN FspReparsePointCacheLookup(FSP_REPARSE_POINT_CACHE *Cache,
+    PWSTR FileName, BOOLEAN IsDirectory, PVOID Buffer, PSIZE_T PSize,
+    PNTSTATUS PResult, PULONG PGeneration);
+VOID FspReparsePointCacheInsert(FSP_REPARSE_POINT_CACHE *Cache,
+    PWSTR FileName, BOOLEAN IsDirectory, NTSTATUS Result, PVOID Buffer, SIZE_T Size,
+    ULONG Generation);
+VOID FspReparsePointCacheInvalidate(FSP_REPARSE_POINT_CACHE *Cache,
+    PWCH FileName, ULONG FileNameLength);
+
+typedef struct _FSP_OPERATION_STATISTICS FSP_OPERATION_STATISTICS;
+typedef struct _FSP_OPERATION_STATISTICS_SLOT FSP_OPERATION_STATISTICS_SLOT;
+NTSTATUS FspOperationStatisticsCreate(PWSTR VolumeName,
+    FSP_OPERATION_STATISTICS **PStatistics);
+VOID FspOperationStatisticsDelete(FSP_OPERATION_STATISTICS *Statistics);
+VOID FspOperationStatisticsReset(FSP_OPERATION_STATISTICS *Statistics);
+FSP_OPERATION_STATISTICS_SLOT *FspOperationStatisticsAcquireSlot(
+    FSP_OPERATION_STATISTICS *Statistics);
+FSP_OPERATION_STATISTICS_SLOT *FspOperationStatisticsSharedSlot(
+    FSP_OPERATION_STATISTICS *Statistics);
+VOID FspOperationStatisticsRecord(FSP_OPERATION_STATISTICS *Statistics,
+    FSP_OPERATION_STATISTICS_SLOT *Slot, UINT32 Kind, NTSTATUS Result, UINT64 Ticks);
+
+/*
+ * FSP_FILE_SYSTEM has a fixed size that is part of the ABI. FspFileSystemCreate allocates
+ * this larger structure instead, so that the DLL can keep private per file system state.
+ */
+typedef struct
+{
+    FSP_FILE_SYSTEM FileSystem;
+    BOOLEAN CaseInsensitive;
+    FSP_REPARSE_POINT_CACHE *ReparsePointCache;
+    FSP_OPERATION_STATISTICS *OperationStatistics;
+    BOOLEAN OperationStatisticsDisabled;
+} FSP_FILE_SYSTEM_PRIVATE;
+static inline
+FSP_FILE_SYSTEM_PRIVATE *FspFileSystemPrivate(FSP_FILE_SYSTEM *FileSystem)
+{
+    return CONTAINING_RECORD(FileSystem, FSP_FILE_SYSTEM_PRIVATE, FileSystem);
+}
+static inline
+VOID FspFileSystemInvalidateReparsePointCache(FSP_FILE_SYSTEM *FileSystem,
+    PWCH FileName, ULONG FileNameLength)
+{
+    FSP_REPARSE_POINT_CACHE *Cache = FspFileSystemPrivate(FileSystem)->ReparsePointCache;
+    if (0 != Cache)
+        FspReparsePointCacheInvalidate(Cache, FileName, FileNameLength);
+}
+
+VOID FspFileSystemReplayOperation(FSP_FILE_SYSTEM *FileSystem,
+    FSP_FSCTL_TRANSACT_REQ *Request, FSP_FSCTL_TRANSACT_RSP *Response);
+
+NTSTATUS FspAccessCheckOpened(FSP_FILE_SYSTEM *FileSystem,
+    FSP_FSCTL_TRANSACT_REQ *Request,
+    UINT32 FileAttributes, PSECURITY_DESCRIPTOR SecurityDescriptor, SIZE_T SecurityDescriptorSize,
+    UINT32 DesiredAccess, PUINT32 PGrantedAccess,
+    PSECURITY_DESCRIPTOR *PSecurityDescriptor);
+
+extern volatile BOOLEAN FspDebugLogTraceActive;
+BOOLEAN FspDebugLogTraceRequest(FSP_FSCTL_TRANSACT_REQ *Request);
+BOOLEAN FspDebugLogTraceResponse(FSP_FSCTL_TRANSACT_RSP *Response);
+PWSTR FspDebugLogIdent(VOID);
+DWORD FspDebugLogThreadId(VOID);
+
 HANDLE FspCreateDirectoryFileW(
     PWSTR FileName,
     DWORD DesiredAccess,
@@ -0,0 +1,354 @@
+/**
+ * @file dll/opstat.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <dll/library.h>
+
+/*
+ * Operation Statistics
+ *
+ * The statistics live in a section that is named after the volume (so that other processes,
+ * such as fsptool, can read them) or in an anonymous section for file systems that are not
+ * attached to the FSD. The section starts with a header followed by an array of slots; each
+ * slot contains an FSP_FILE_SYSTEM_OPERATION_STATISTICS record for every request kind.
+ *
+ * Every dispatcher thread acquires a slot of its own when it starts and updates it without
+ * synchronization. Threads that do not find a free slot (and requests that are replayed
+ * outside the dispatcher) use the last slot, which is shared and updated with interlocked
+ * operations. Slots are merged when the statistics are queried.
+ *
+ * Times are recorded in performance counter ticks and converted to 100ns units when queried.
+ * The header records the KindCount and the performance counter Frequency of the writer, so
+ * that a reader does not depend on them.
+ */
+
+#define FSP_OPERATION_STATISTICS_SLOT_COUNT 33  /* 32 per thread slots + 1 shared slot */
+#define FSP_OPERATION_STATISTICS_VERSION    (sizeof(FSP_FILE_SYSTEM_OPERATION_STATISTICS) << 16 | 1)
+#define FSP_OPERATION_STATISTICS_NAMESIZE   128
+
+struct _FSP_OPERATION_STATISTICS_SLOT
+{
+    FSP_FILE_SYSTEM_OPERATION_STATISTICS Kind[FspFsctlTransactKindCount];
+};
+
+typedef struct
+{
+    UINT32 Version;
+    UINT32 KindCount;
+    UINT32 SlotCount;
+    volatile LONG NextSlot;
+    UINT64 Frequency;
+    FSP_OPERATION_STATISTICS_SLOT Slots[];
+} FSP_OPERATION_STATISTICS_VIEW;
+
+struct _FSP_OPERATION_STATISTICS
+{
+    HANDLE Mapping;
+    FSP_OPERATION_STATISTICS_VIEW *View;
+    UINT64 Frequency;
+};
+
+static BOOLEAN FspOperationStatisticsName(PWSTR VolumeName, BOOLEAN Global,
+    PWCHAR Buffer, ULONG BufferCount)
+{
+    PWSTR Prefix = Global ? L"Global\\WinFsp.OpStats." : L"Local\\WinFsp.OpStats.";
+    ULONG PrefixLength, SuffixLength;
+    PWSTR Suffix;
+
+    /* use the last component of the volume name: \Device\Volume{GUID} -> Volume{GUID} */
+    Suffix = VolumeName;
+    for (PWSTR P = VolumeName; L'\0' != *P; P++)
+        if (L'\\' == *P)
+            Suffix = P + 1;
+
+    PrefixLength = lstrlenW(Prefix);
+    SuffixLength = lstrlenW(Suffix);
+    if (0 == SuffixLength || PrefixLength + SuffixLength + 1 > BufferCount)
+        return FALSE;
+
+    memcpy(Buffer, Prefix, PrefixLength * sizeof(WCHAR));
+    memcpy(Buffer + PrefixLength, Suffix, (SuffixLength + 1) * sizeof(WCHAR));
+
+    return TRUE;
+}
+
+static inline UINT64 FspOperationStatisticsTime(UINT64 Ticks, UINT64 Frequency)
+{
+    /* convert to 100ns units without overflowing */
+    return Ticks / Frequency * 10000000 + Ticks % Frequency * 10000000 / Frequency;
+}
+
+static VOID FspOperationStatisticsMerge(FSP_OPERATION_STATISTICS_VIEW *View,
+    FSP_FILE_SYSTEM_OPERATION_STATISTICS *Statistics, ULONG Count)
+{
+    FSP_FILE_SYSTEM_OPERATION_STATISTICS *Records = (PVOID)View->Slots, *Record;
+    ULONG KindCount = View->KindCount < Count ? View->KindCount : Count;
+
+    memset(Statistics, 0, Count * sizeof *Statistics);
+
+    for (ULONG SlotIndex = 0; View->SlotCount > SlotIndex; SlotIndex++)
+        for (ULONG Kind = 0; KindCount > Kind; Kind++)
+        {
+            Record = Records + SlotIndex * View->KindCount + Kind;
+            Statistics[Kind].Count += Record->Count;
+            Statistics[Kind].ErrorCount += Record->ErrorCount;
+            Statistics[Kind].TotalTime += Record->TotalTime;
+            if (Statistics[Kind].MaxTime < Record->MaxTime)
+                Statistics[Kind].MaxTime = Record->MaxTime;
+            for (ULONG I = 0; FSP_FILE_SYSTEM_OPERATION_HISTOGRAM_COUNT > I; I++)
+                Statistics[Kind].Histogram[I] += Record->Histogram[I];
+        }
+
+    for (ULONG Kind = 0; KindCount > Kind; Kind++)
+    {
+        Statistics[Kind].TotalTime =
+            FspOperationStatisticsTime(Statistics[Kind].TotalTime, View->Frequency);
+        Statistics[Kind].MaxTime =
+            FspOperationStatisticsTime(Statistics[Kind].MaxTime, View->Frequency);
+    }
+}
+
+NTSTATUS FspOperationStatisticsCreate(PWSTR VolumeName,
+    FSP_OPERATION_STATISTICS **PStatistics)
+{
+    FSP_OPERATION_STATISTICS *Statistics = 0;
+    WCHAR Name[FSP_OPERATION_STATISTICS_NAMESIZE];
+    LARGE_INTEGER Frequency;
+    DWORD Size;
+    NTSTATUS Result;
+
+    *PStatistics = 0;
+
+    Statistics = MemAlloc(sizeof *Statistics);
+    if (0 == Statistics)
+    {
+        Result = STATUS_INSUFFICIENT_RESOURCES;
+        goto exit;
+    }
+    memset(Statistics, 0, sizeof *Statistics);
+
+    Size = sizeof(FSP_OPERATION_STATISTICS_VIEW) +
+        FSP_OPERATION_STATISTICS_SLOT_COUNT * sizeof(FSP_OPERATION_STATISTICS_SLOT);
+
+    /*
+     * Prefer the Global namespace, so that the statistics of a file system running as a
+     * service are visible from other sessions; creating a Global section requires the
+     * SeCreateGlobalPrivilege. Fall back to an anonymous section if neither name can be used.
+     */
+    if (0 != VolumeName)
+        for (int Global = 1; 0 <= Global && 0 == Statistics->Mapping; Global--)
+            if (FspOperationStatisticsName(VolumeName, (BOOLEAN)Global, Name, sizeof Name / sizeof Name[0]))
+            {
+                Statistics->Mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, 0,
+                    PAGE_READWRITE, 0, Size, Name);
+                if (0 != Statistics->Mapping && ERROR_ALREADY_EXISTS == GetLastError())
+                {
+                    CloseHandle(Statistics->Mapping);
+                    Statistics->Mapping = 0;
+                    break;
+                }
+            }
+    if (0 == Statistics->Mapping)
+        Statistics->Mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, 0,
+            PAGE_READWRITE, 0, Size, 0);
+    if (0 == Statistics->Mapping)
+    {
+        Result = FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+
+    Statistics->View = MapViewOfFile(Statistics->Mapping, FILE_MAP_WRITE, 0, 0, 0);
+    if (0 == Statistics->View)
+    {
+        Result = FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+    Statistics->Frequency = Frequency.QuadPart;
+
+    Statistics->View->Version = FSP_OPERATION_STATISTICS_VERSION;
+    Statistics->View->KindCount = FspFsctlTransactKindCount;
+    Statistics->View->SlotCount = FSP_OPERATION_STATISTICS_SLOT_COUNT;
+    Statistics->View->NextSlot = 0;
+    Statistics->View->Frequency = Frequency.QuadPart;
+
+    *PStatistics = Statistics;
+    Statistics = 0;
+
+    Result = STATUS_SUCCESS;
+
+exit:
+    if (0 != Statistics)
+        FspOperationStatisticsDelete(Statistics);
+
+    return Result;
+}
+
+VOID FspOperationStatisticsDelete(FSP_OPERATION_STATISTICS *Statistics)
+{
+    if (0 != Statistics->View)
+        UnmapViewOfFile(Statistics->View);
+    if (0 != Statistics->Mapping)
+        CloseHandle(Statistics->Mapping);
+    MemFree(Statistics);
+}
+
+VOID FspOperationStatisticsReset(FSP_OPERATION_STATISTICS *Statistics)
+{
+    /* called before the dispatcher threads are started; slots are reused (not cleared) */
+    Statistics->View->NextSlot = 0;
+}
+
+FSP_OPERATION_STATISTICS_SLOT *FspOperationStatisticsAcquireSlot(
+    FSP_OPERATION_STATISTICS *Statistics)
+{
+    ULONG Index = (ULONG)InterlockedIncrement(&Statistics->View->NextSlot) - 1;
+
+    if (FSP_OPERATION_STATISTICS_SLOT_COUNT - 1 <= Index)
+        Index = FSP_OPERATION_STATISTICS_SLOT_COUNT - 1;
+
+    return &Statistics->View->Slots[Index];
+}
+
+FSP_OPERATION_STATISTICS_SLOT *FspOperationStatisticsSharedSlot(
+    FSP_OPERATION_STATISTICS *Statistics)
+{
+    return &Statistics->View->Slots[FSP_OPERATION_STATISTICS_SLOT_COUNT - 1];
+}
+
+VOID FspOperationStatisticsRecord(FSP_OPERATION_STATISTICS *Statistics,
+    FSP_OPERATION_STATISTICS_SLOT *Slot, UINT32 Kind, NTSTATUS Result, UINT64 Ticks)
+{
+    FSP_FILE_SYSTEM_OPERATION_STATISTICS *Record = &Slot->Kind[Kind];
+    UINT64 Microseconds = Ticks * 1000000 / Statistics->Frequency;
+    ULONG Bucket, Index;
+
+    Bucket = 0;
+    if (0 != Microseconds)
+    {
+        _BitScanReverse(&Index, MAXULONG < Microseconds ? MAXULONG : (ULONG)Microseconds);
+        Bucket = FSP_FILE_SYSTEM_OPERATION_HISTOGRAM_COUNT - 1 > Index + 1 ?
+            Index + 1 : FSP_FILE_SYSTEM_OPERATION_HISTOGRAM_COUNT - 1;
+    }
+
+    if (FspOperationStatisticsSharedSlot(Statistics) != Slot)
+    {
+        Record->Count++;
+        if (!NT_SUCCESS(Result))
+            Record->ErrorCount++;
+        Record->TotalTime += Ticks;
+        if (Record->MaxTime < Ticks)
+            Record->MaxTime = Ticks;
+        Record->Histogram[Bucket]++;
+    }
+    else
+    {
+        LONG64 MaxTime;
+
+        InterlockedIncrement64((PLONG64)&Record->Count);
+        if (!NT_SUCCESS(Result))
+            InterlockedIncrement64((PLONG64)&Record->ErrorCount);
+        InterlockedAdd64((PLONG64)&Record->TotalTime, Ticks);
+        while ((UINT64)(MaxTime = Record->MaxTime) < Ticks &&
+            MaxTime != InterlockedCompareExchange64((PLONG64)&Record->MaxTime, Ticks, MaxTime))
+            ;
+        InterlockedIncrement64((PLONG64)&Record->Histogram[Bucket]);
+    }
+}
+
+FSP_API NTSTATUS FspFileSystemGetOperationStatistics(FSP_FILE_SYSTEM *FileSystem,
+    FSP_FILE_SYSTEM_OPERATION_STATISTICS *Statistics, ULONG Count)
+{
+    FSP_OPERATION_STATISTICS *OperationStatistics =
+        FspFileSystemPrivate(FileSystem)->OperationStatistics;
+
+    FspOperationStatisticsMerge(OperationStatistics->View, Statistics, Count);
+
+    return STATUS_SUCCESS;
+}
+
+FSP_API NTSTATUS FspFileSystemGetVolumeOperationStatistics(PWSTR VolumeName,
+    FSP_FILE_SYSTEM_OPERATION_STATISTICS *Statistics, ULONG Count)
+{
+    WCHAR Name[FSP_OPERATION_STATISTICS_NAMESIZE];
+    HANDLE Mapping = 0;
+    FSP_OPERATION_STATISTICS_VIEW *View = 0;
+    MEMORY_BASIC_INFORMATION MemoryInfo;
+    NTSTATUS Result;
+
+    for (int Global = 1; 0 <= Global && 0 == Mapping; Global--)
+    {
+        if (!FspOperationStatisticsName(VolumeName, (BOOLEAN)Global, Name, sizeof Name / sizeof Name[0]))
+        {
+            Result = STATUS_OBJECT_NAME_INVALID;
+            goto exit;
+        }
+
+        Mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, Name);
+    }
+    if (0 == Mapping)
+    {
+        Result = FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+
+    View = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+    if (0 == View)
+    {
+        Result = FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+
+    /* the section may have been created by a different version of the DLL */
+    if (0 == VirtualQuery(View, &MemoryInfo, sizeof MemoryInfo) ||
+        sizeof(FSP_OPERATION_STATISTICS_VIEW) > MemoryInfo.RegionSize ||
+        FSP_OPERATION_STATISTICS_VERSION != View->Version ||
+        0 == View->Frequency ||
+        (UINT64)View->SlotCount * View->KindCount * sizeof(FSP_FILE_SYSTEM_OPERATION_STATISTICS) >
+            MemoryInfo.RegionSize - sizeof(FSP_OPERATION_STATISTICS_VIEW))
+    {
+        Result = STATUS_REVISION_MISMATCH;
+        goto exit;
+    }
+
+    FspOperationStatisticsMerge(View, Statistics, Count);
+
+    Result = STATUS_SUCCESS;
+
+exit:
+    if (0 != View)
+        UnmapViewOfFile(View);
+    if (0 != Mapping)
+        CloseHandle(Mapping);
+
+    return Result;
+}
+
+FSP_API NTSTATUS FspFileSystemSetOperationStatistics(FSP_FILE_SYSTEM *FileSystem,
+    BOOLEAN Enable)
+{
+    if (0 != FileSystem->DispatcherThread)
+        return STATUS_INVALID_DEVICE_REQUEST;
+
+    FspFileSystemPrivate(FileSystem)->OperationStatisticsDisabled = !Enable;
+
+    return STATUS_SUCCESS;
+}
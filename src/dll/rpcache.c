@@ -0,0 +1,303 @@
+/**
+ * @file dll/rpcache.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <dll/library.h>
+
+/*
+ * Reparse Point Cache
+ *
+ * FspFileSystemFindReparsePoint and FspFileSystemResolveReparsePoints call GetReparsePointByName
+ * for every path component of the path they examine. For file systems where this is expensive
+ * (e.g. FUSE file systems, where every call is a getattr/readlink upcall) the reparse point
+ * cache remembers the results of these calls for a limited time:
+ *
+ * - Negative entries record that a path is not a reparse point (STATUS_NOT_A_REPARSE_POINT).
+ * - Positive entries record that a path is a reparse point and, if the reparse data was
+ *   requested and is small enough, the reparse data itself.
+ *
+ * Other results (e.g. STATUS_OBJECT_NAME_NOT_FOUND) are not cached.
+ *
+ * The cache is a hash table with a fixed number of buckets. Entries are also linked in
+ * insertion order; when the cache is full the oldest entry is evicted. Lookups acquire the
+ * cache lock shared; insertions and invalidations acquire it exclusive.
+ *
+ * An invalidation removes the entry for a path and the entries of all paths below it,
+ * since a rename or delete of a directory changes the reparse status of all its descendants.
+ * Invalidations walk all entries; they are rare compared to lookups and the cache is bounded.
+ *
+ * An invalidation may run while a GetReparsePointByName upcall for a cache miss is in
+ * progress; the result of that upcall may then be stale. To avoid caching it, every
+ * invalidation increments a generation number. Lookup returns the current generation and
+ * Insert drops the new entry if the generation has changed since.
+ */
+
+#define FSP_REPARSE_POINT_CACHE_BUCKET_COUNT 1024
+#define FSP_REPARSE_POINT_CACHE_DATA_SIZEMAX 1024
+
+typedef struct _FSP_REPARSE_POINT_CACHE_ENTRY
+{
+    struct _FSP_REPARSE_POINT_CACHE_ENTRY *HashNext;
+    LIST_ENTRY ListEntry;
+    UINT64 ExpirationTime;
+    ULONG Hash;
+    NTSTATUS Result;
+    BOOLEAN IsDirectory, HasData;
+    ULONG FileNameLength;               /* in WCHAR's */
+    ULONG DataSize;
+    PUINT8 Data;
+    WCHAR FileName[];
+} FSP_REPARSE_POINT_CACHE_ENTRY;
+
+struct _FSP_REPARSE_POINT_CACHE
+{
+    SRWLOCK Lock;
+    ULONG Timeout;
+    ULONG MaxEntries, EntryCount;
+    ULONG Generation;
+    BOOLEAN CaseInsensitive;
+    LIST_ENTRY ListHead;
+    FSP_REPARSE_POINT_CACHE_ENTRY *Buckets[FSP_REPARSE_POINT_CACHE_BUCKET_COUNT];
+};
+
+static inline ULONG FspReparsePointCacheHash(FSP_REPARSE_POINT_CACHE *Cache,
+    PWCH FileName, ULONG FileNameLength)
+{
+    ULONG Hash = 2166136261;
+
+    if (Cache->CaseInsensitive)
+        return FspUpcaseHash(FileName, FileNameLength, Hash);
+
+    for (ULONG I = 0; FileNameLength > I; I++)
+        Hash = (Hash ^ FileName[I]) * 16777619;
+    return Hash;
+}
+
+static inline BOOLEAN FspReparsePointCacheEqual(FSP_REPARSE_POINT_CACHE *Cache,
+    PWCH FileName1, PWCH FileName2, ULONG Count)
+{
+    if (Cache->CaseInsensitive)
+        return FspUpcaseEqual(FileName1, FileName2, Count);
+    return 0 == memcmp(FileName1, FileName2, Count * sizeof(WCHAR));
+}
+
+static FSP_REPARSE_POINT_CACHE_ENTRY **FspReparsePointCacheFind(FSP_REPARSE_POINT_CACHE *Cache,
+    PWCH FileName, ULONG FileNameLength, ULONG Hash, BOOLEAN IsDirectory)
+{
+    FSP_REPARSE_POINT_CACHE_ENTRY **PEntry;
+
+    for (PEntry = &Cache->Buckets[Hash % FSP_REPARSE_POINT_CACHE_BUCKET_COUNT];
+        0 != *PEntry; PEntry = &(*PEntry)->HashNext)
+    {
+        FSP_REPARSE_POINT_CACHE_ENTRY *Entry = *PEntry;
+        if (Hash == Entry->Hash &&
+            IsDirectory == Entry->IsDirectory &&
+            FileNameLength == Entry->FileNameLength &&
+            FspReparsePointCacheEqual(Cache, FileName, Entry->FileName, FileNameLength))
+            return PEntry;
+    }
+
+    return 0;
+}
+
+static VOID FspReparsePointCacheRemoveEntry(FSP_REPARSE_POINT_CACHE *Cache,
+    FSP_REPARSE_POINT_CACHE_ENTRY *Entry)
+{
+    FSP_REPARSE_POINT_CACHE_ENTRY **PEntry;
+
+    for (PEntry = &Cache->Buckets[Entry->Hash % FSP_REPARSE_POINT_CACHE_BUCKET_COUNT];
+        Entry != *PEntry; PEntry = &(*PEntry)->HashNext)
+        ;
+    *PEntry = Entry->HashNext;
+    RemoveEntryList(&Entry->ListEntry);
+    Cache->EntryCount--;
+
+    MemFree(Entry);
+}
+
+NTSTATUS FspReparsePointCacheCreate(ULONG Timeout, ULONG MaxEntries, BOOLEAN CaseInsensitive,
+    FSP_REPARSE_POINT_CACHE **PCache)
+{
+    FSP_REPARSE_POINT_CACHE *Cache;
+
+    *PCache = 0;
+
+    Cache = MemAlloc(sizeof *Cache);
+    if (0 == Cache)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    memset(Cache, 0, sizeof *Cache);
+    InitializeSRWLock(&Cache->Lock);
+    Cache->Timeout = Timeout;
+    Cache->MaxEntries = 0 != MaxEntries ? MaxEntries : 4096;
+    Cache->CaseInsensitive = CaseInsensitive;
+    Cache->ListHead.Flink = Cache->ListHead.Blink = &Cache->ListHead;
+
+    *PCache = Cache;
+
+    return STATUS_SUCCESS;
+}
+
+VOID FspReparsePointCacheDelete(FSP_REPARSE_POINT_CACHE *Cache)
+{
+    while (&Cache->ListHead != Cache->ListHead.Flink)
+        FspReparsePointCacheRemoveEntry(Cache,
+            CONTAINING_RECORD(Cache->ListHead.Flink, FSP_REPARSE_POINT_CACHE_ENTRY, ListEntry));
+
+    MemFree(Cache);
+}
+
+BOOLEAN FspReparsePointCacheLookup(FSP_REPARSE_POINT_CACHE *Cache,
+    PWSTR FileName, BOOLEAN IsDirectory, PVOID Buffer, PSIZE_T PSize,
+    PNTSTATUS PResult, PULONG PGeneration)
+{
+    FSP_REPARSE_POINT_CACHE_ENTRY **PEntry, *Entry;
+    ULONG FileNameLength, Hash;
+    BOOLEAN Found = FALSE;
+
+    FileNameLength = lstrlenW(FileName);
+    Hash = FspReparsePointCacheHash(Cache, FileName, FileNameLength);
+
+    AcquireSRWLockShared(&Cache->Lock);
+
+    *PGeneration = Cache->Generation;
+
+    PEntry = FspReparsePointCacheFind(Cache, FileName, FileNameLength, Hash, IsDirectory);
+    if (0 == PEntry)
+        goto exit;
+
+    Entry = *PEntry;
+    if (GetTickCount64() >= Entry->ExpirationTime)
+        goto exit;
+
+    if (STATUS_NOT_A_REPARSE_POINT == Entry->Result || 0 == Buffer)
+    {
+        *PResult = Entry->Result;
+        Found = TRUE;
+    }
+    else if (Entry->HasData)
+    {
+        /* same behavior as GetReparsePointByName when the buffer is too small */
+        if (Entry->DataSize > *PSize)
+            *PResult = STATUS_BUFFER_TOO_SMALL;
+        else
+        {
+            memcpy(Buffer, Entry->Data, Entry->DataSize);
+            *PSize = Entry->DataSize;
+            *PResult = STATUS_SUCCESS;
+        }
+        Found = TRUE;
+    }
+
+exit:
+    ReleaseSRWLockShared(&Cache->Lock);
+
+    return Found;
+}
+
+VOID FspReparsePointCacheInsert(FSP_REPARSE_POINT_CACHE *Cache,
+    PWSTR FileName, BOOLEAN IsDirectory, NTSTATUS Result, PVOID Buffer, SIZE_T Size,
+    ULONG Generation)
+{
+    FSP_REPARSE_POINT_CACHE_ENTRY **PEntry, *Entry;
+    ULONG FileNameLength, Hash, DataSize;
+    BOOLEAN HasData;
+
+    if (STATUS_NOT_A_REPARSE_POINT != Result && STATUS_SUCCESS != Result)
+        return;
+
+    HasData = STATUS_SUCCESS == Result &&
+        0 != Buffer && FSP_REPARSE_POINT_CACHE_DATA_SIZEMAX >= Size;
+    DataSize = HasData ? (ULONG)Size : 0;
+
+    FileNameLength = lstrlenW(FileName);
+    Hash = FspReparsePointCacheHash(Cache, FileName, FileNameLength);
+
+    Entry = MemAlloc(sizeof *Entry + FileNameLength * sizeof(WCHAR) + DataSize);
+    if (0 == Entry)
+        return;
+
+    memset(Entry, 0, sizeof *Entry);
+    Entry->ExpirationTime = GetTickCount64() + Cache->Timeout;
+    Entry->Hash = Hash;
+    Entry->Result = Result;
+    Entry->IsDirectory = IsDirectory;
+    Entry->HasData = HasData;
+    Entry->FileNameLength = FileNameLength;
+    Entry->DataSize = DataSize;
+    Entry->Data = (PUINT8)(Entry->FileName + FileNameLength);
+    memcpy(Entry->FileName, FileName, FileNameLength * sizeof(WCHAR));
+    if (HasData)
+        memcpy(Entry->Data, Buffer, DataSize);
+
+    AcquireSRWLockExclusive(&Cache->Lock);
+
+    if (Generation != Cache->Generation)
+    {
+        /* invalidated since the caller's lookup; the result may be stale */
+        ReleaseSRWLockExclusive(&Cache->Lock);
+        MemFree(Entry);
+        return;
+    }
+
+    PEntry = FspReparsePointCacheFind(Cache, FileName, FileNameLength, Hash, IsDirectory);
+    if (0 != PEntry)
+        FspReparsePointCacheRemoveEntry(Cache, *PEntry);
+    else if (Cache->MaxEntries <= Cache->EntryCount)
+        FspReparsePointCacheRemoveEntry(Cache,
+            CONTAINING_RECORD(Cache->ListHead.Flink, FSP_REPARSE_POINT_CACHE_ENTRY, ListEntry));
+
+    Entry->HashNext = Cache->Buckets[Hash % FSP_REPARSE_POINT_CACHE_BUCKET_COUNT];
+    Cache->Buckets[Hash % FSP_REPARSE_POINT_CACHE_BUCKET_COUNT] = Entry;
+    InsertTailList(&Cache->ListHead, &Entry->ListEntry);
+    Cache->EntryCount++;
+
+    ReleaseSRWLockExclusive(&Cache->Lock);
+}
+
+VOID FspReparsePointCacheInvalidate(FSP_REPARSE_POINT_CACHE *Cache,
+    PWCH FileName, ULONG FileNameLength)
+{
+    PLIST_ENTRY ListEntry, NextEntry;
+    FSP_REPARSE_POINT_CACHE_ENTRY *Entry;
+
+    /* ignore any trailing backslashes (the root "\" invalidates everything) */
+    while (0 < FileNameLength && L'\\' == FileName[FileNameLength - 1])
+        FileNameLength--;
+
+    AcquireSRWLockExclusive(&Cache->Lock);
+
+    Cache->Generation++;
+
+    for (ListEntry = Cache->ListHead.Flink; &Cache->ListHead != ListEntry; ListEntry = NextEntry)
+    {
+        NextEntry = ListEntry->Flink;
+        Entry = CONTAINING_RECORD(ListEntry, FSP_REPARSE_POINT_CACHE_ENTRY, ListEntry);
+
+        /* remove FileName and anything below it */
+        if (FileNameLength <= Entry->FileNameLength &&
+            (FileNameLength == Entry->FileNameLength ||
+                L'\\' == Entry->FileName[FileNameLength]) &&
+            FspReparsePointCacheEqual(Cache, FileName, Entry->FileName, FileNameLength))
+            FspReparsePointCacheRemoveEntry(Cache, Entry);
+    }
+
+    ReleaseSRWLockExclusive(&Cache->Lock);
+}
@@ -52,12 +52,28 @@ static NTSTATUS FspGetSecurityByName(FSP_FILE_SYSTEM *FileSystem,
     }
 }
 
-FSP_API NTSTATUS FspAccessCheckEx(FSP_FILE_SYSTEM *FileSystem,
+typedef struct
+{
+    UINT32 FileAttributes;
+    PSECURITY_DESCRIPTOR SecurityDescriptor;
+    SIZE_T SecurityDescriptorSize;
+} FSP_ACCESS_CHECK_OPENED;
+
+static NTSTATUS FspAccessCheckInternal(FSP_FILE_SYSTEM *FileSystem,
     FSP_FSCTL_TRANSACT_REQ *Request,
     BOOLEAN CheckParentOrMain, BOOLEAN AllowTraverseCheck,
     UINT32 DesiredAccess, PUINT32 PGrantedAccess,
-    PSECURITY_DESCRIPTOR *PSecurityDescriptor)
+    PSECURITY_DESCRIPTOR *PSecurityDescriptor,
+    FSP_ACCESS_CHECK_OPENED *Opened)
 {
+    /*
+     * When Opened is not NULL, the file has already been opened by OpenWithSecurity and
+     * Opened contains its attributes and security descriptor; these are used instead of
+     * calling GetSecurityByName for the file. In this case CheckParentOrMain and
+     * AllowTraverseCheck must be FALSE. The Opened->SecurityDescriptor buffer is consumed:
+     * it is either returned in *PSecurityDescriptor or freed.
+     */
+
     BOOLEAN CheckParentDirectory, CheckMainFile;
 
     CheckParentDirectory = CheckMainFile = FALSE;
@@ -111,12 +127,20 @@ FSP_API NTSTATUS FspAccessCheckEx(FSP_FILE_SYSTEM *FileSystem,
     else
         FileName = (PWSTR)Request->Buffer;
 
-    SecurityDescriptorSize = 1024;
-    SecurityDescriptor = MemAlloc(SecurityDescriptorSize);
-    if (0 == SecurityDescriptor)
+    if (0 == Opened)
     {
-        Result = STATUS_INSUFFICIENT_RESOURCES;
-        goto exit;
+        SecurityDescriptorSize = 1024;
+        SecurityDescriptor = MemAlloc(SecurityDescriptorSize);
+        if (0 == SecurityDescriptor)
+        {
+            Result = STATUS_INSUFFICIENT_RESOURCES;
+            goto exit;
+        }
+    }
+    else
+    {
+        SecurityDescriptorSize = Opened->SecurityDescriptorSize;
+        SecurityDescriptor = Opened->SecurityDescriptor;
     }
 
     if (Request->Req.Create.UserMode &&
@@ -193,11 +217,16 @@ FSP_API NTSTATUS FspAccessCheckEx(FSP_FILE_SYSTEM *FileSystem,
         ;
     }
 
-    FileAttributes = 0;
-    Result = FspGetSecurityByName(FileSystem, FileName, &FileAttributes,
-        &SecurityDescriptor, &SecurityDescriptorSize);
-    if (!NT_SUCCESS(Result) || STATUS_REPARSE == Result)
-        goto exit;
+    if (0 == Opened)
+    {
+        FileAttributes = 0;
+        Result = FspGetSecurityByName(FileSystem, FileName, &FileAttributes,
+            &SecurityDescriptor, &SecurityDescriptorSize);
+        if (!NT_SUCCESS(Result) || STATUS_REPARSE == Result)
+            goto exit;
+    }
+    else
+        FileAttributes = Opened->FileAttributes;
 
     if (!CheckParentOrMain && Request->Req.Create.HasTrailingBackslash &&
         !(FileAttributes & FILE_ATTRIBUTE_DIRECTORY))
@@ -401,6 +430,50 @@ exit:
     return Result;
 }
 
+FSP_API NTSTATUS FspAccessCheckEx(FSP_FILE_SYSTEM *FileSystem,
+    FSP_FSCTL_TRANSACT_REQ *Request,
+    BOOLEAN CheckParentOrMain, BOOLEAN AllowTraverseCheck,
+    UINT32 DesiredAccess, PUINT32 PGrantedAccess,
+    PSECURITY_DESCRIPTOR *PSecurityDescriptor)
+{
+    return FspAccessCheckInternal(FileSystem, Request,
+        CheckParentOrMain, AllowTraverseCheck,
+        DesiredAccess, PGrantedAccess,
+        PSecurityDescriptor,
+        0);
+}
+
+NTSTATUS FspAccessCheckOpened(FSP_FILE_SYSTEM *FileSystem,
+    FSP_FSCTL_TRANSACT_REQ *Request,
+    UINT32 FileAttributes, PSECURITY_DESCRIPTOR SecurityDescriptor, SIZE_T SecurityDescriptorSize,
+    UINT32 DesiredAccess, PUINT32 PGrantedAccess,
+    PSECURITY_DESCRIPTOR *PSecurityDescriptor)
+{
+    FSP_ACCESS_CHECK_OPENED Opened;
+
+    /* in these cases FspAccessCheckEx does not look up the file */
+    if (FspFsctlTransactCreateKind != Request->Kind ||
+        0 == FileSystem->Interface->GetSecurityByName ||
+        (!Request->Req.Create.UserMode && 0 == PSecurityDescriptor))
+    {
+        MemFree(SecurityDescriptor);
+        return FspAccessCheckEx(FileSystem, Request,
+            FALSE, FALSE,
+            DesiredAccess, PGrantedAccess,
+            PSecurityDescriptor);
+    }
+
+    Opened.FileAttributes = FileAttributes;
+    Opened.SecurityDescriptor = SecurityDescriptor;
+    Opened.SecurityDescriptorSize = SecurityDescriptorSize;
+
+    return FspAccessCheckInternal(FileSystem, Request,
+        FALSE, FALSE,
+        DesiredAccess, PGrantedAccess,
+        PSecurityDescriptor,
+        &Opened);
+}
+
 FSP_API NTSTATUS FspCreateSecurityDescriptor(FSP_FILE_SYSTEM *FileSystem,
     FSP_FSCTL_TRANSACT_REQ *Request,
     PSECURITY_DESCRIPTOR ParentDescriptor,
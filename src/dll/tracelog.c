@@ -0,0 +1,1172 @@
+/**
+ * @file dll/tracelog.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <dll/library.h>
+
+/*
+ * Binary Trace
+ *
+ * When tracing is active FspDebugLogRequest/FspDebugLogResponse do not format any text.
+ * Instead they copy the raw request/response into a per-thread ring buffer together with
+ * a timestamp. Each ring has a single producer (the thread that owns it) and a single
+ * consumer (the trace writer thread), so no locks are necessary. If a ring is full the
+ * record is dropped and counted; the producer never waits for the writer.
+ *
+ * The writer thread periodically drains all rings and writes the records to the trace
+ * file in large batches. FspDebugLogDecodeTrace converts a trace file back into the
+ * regular debug log text format.
+ *
+ * Rings are never freed. When a thread exits its ring is released and may be reused by
+ * a new thread. This avoids synchronizing the writer with thread exit.
+ *
+ * With FspDebugLogTraceNoDrop a producer whose ring is full waits for the writer instead.
+ * This is meant for traces that are to be replayed with FspFileSystemReplayTrace, which
+ * loses track of file contexts when Create or Close records are missing.
+ */
+
+#define FSP_DEBUGLOG_TRACE_MAGIC        "FSPTRACE"
+#define FSP_DEBUGLOG_TRACE_VERSION      1
+#define FSP_DEBUGLOG_TRACE_RINGSIZE     (256 * 1024)
+#define FSP_DEBUGLOG_TRACE_BUFSIZE      (64 * 1024)
+#define FSP_DEBUGLOG_TRACE_INTERVAL     100
+#define FSP_DEBUGLOG_TRACE_ALIGN(x)     (((x) + 7) & ~7)
+
+enum
+{
+    FspDebugLogTraceTypePadding = 0,
+    FspDebugLogTraceTypeRequest,
+    FspDebugLogTraceTypeResponse,
+    FspDebugLogTraceTypeDropped,
+};
+
+typedef struct
+{
+    UINT8 Magic[8];
+    UINT32 Version;
+    UINT32 HeaderSize;
+    UINT64 Frequency;
+    UINT64 StartCounter;
+    UINT64 StartTime;
+    UINT32 ProcessId;
+    UINT32 PointerSize;
+    WCHAR Ident[20];
+} FSP_DEBUGLOG_TRACE_HEADER;
+
+typedef struct
+{
+    UINT32 Size;                        /* record size including this header; 8-byte aligned */
+    UINT16 Type;
+    UINT16 Reserved;
+    UINT32 ThreadId;
+    UINT32 DataSize;
+    UINT64 Timestamp;
+    UINT8 Data[];
+} FSP_DEBUGLOG_TRACE_RECORD;
+
+typedef struct _FSP_DEBUGLOG_TRACE_RING
+{
+    struct _FSP_DEBUGLOG_TRACE_RING *Next;
+    volatile LONG OwnerThreadId;
+    volatile ULONG Head;                /* written by producer only */
+    volatile ULONG Tail;                /* written by consumer only */
+    volatile ULONG RecordCount;         /* written by producer only */
+    volatile ULONG DroppedCount;        /* written by producer only */
+    ULONG DroppedReported;              /* consumer only */
+    DWORD ThreadId;
+    __declspec(align(8)) UINT8 Buffer[FSP_DEBUGLOG_TRACE_RINGSIZE];
+} FSP_DEBUGLOG_TRACE_RING;
+
+FSP_FSCTL_STATIC_ASSERT(0 == (FSP_DEBUGLOG_TRACE_RINGSIZE & (FSP_DEBUGLOG_TRACE_RINGSIZE - 1)),
+    "FSP_DEBUGLOG_TRACE_RINGSIZE must be a power of 2");
+FSP_FSCTL_STATIC_ASSERT(sizeof(FSP_DEBUGLOG_TRACE_RECORD) +
+    FSP_FSCTL_TRANSACT_RSP_SIZEMAX <= FSP_DEBUGLOG_TRACE_RINGSIZE / 4,
+    "FSP_DEBUGLOG_TRACE_RINGSIZE is too small");
+
+static INIT_ONCE FspDebugLogTraceInitOnce = INIT_ONCE_STATIC_INIT;
+static DWORD FspDebugLogTraceTlsIndex = TLS_OUT_OF_INDEXES;
+static FSP_DEBUGLOG_TRACE_RING *volatile FspDebugLogTraceRingList;
+static SRWLOCK FspDebugLogTraceLock = SRWLOCK_INIT;
+static HANDLE FspDebugLogTraceHandle, FspDebugLogTraceThread;
+static HANDLE FspDebugLogTraceStopEvent, FspDebugLogTraceWakeEvent;
+static PUINT8 FspDebugLogTraceBuffer;
+static ULONG FspDebugLogTraceBufferLength;
+static UINT64 FspDebugLogTraceRecordBase, FspDebugLogTraceDroppedBase;
+static ULONG FspDebugLogTraceFlags;
+static volatile LONG FspDebugLogTraceProducerCount;
+static volatile DWORD FspDebugLogReplayThreadId;
+static DWORD FspDebugLogReplayRecordThreadId;
+static WCHAR FspDebugLogReplayIdent[20];
+volatile BOOLEAN FspDebugLogTraceActive;
+
+static BOOL WINAPI FspDebugLogTraceInitialize(
+    PINIT_ONCE InitOnce, PVOID Parameter, PVOID *Context)
+{
+    /* the events are never closed, because producers may signal them at any time */
+    FspDebugLogTraceStopEvent = CreateEventW(0, FALSE, FALSE, 0);
+    FspDebugLogTraceWakeEvent = CreateEventW(0, FALSE, FALSE, 0);
+    if (0 == FspDebugLogTraceStopEvent || 0 == FspDebugLogTraceWakeEvent)
+        return TRUE;
+
+    FspDebugLogTraceTlsIndex = TlsAlloc();
+    return TRUE;
+}
+
+static FSP_DEBUGLOG_TRACE_RING *FspDebugLogTraceRingAcquire(VOID)
+{
+    FSP_DEBUGLOG_TRACE_RING *Ring, *Next;
+    DWORD ThreadId = GetCurrentThreadId();
+
+    /* reuse a ring released by an exited thread */
+    for (Ring = FspDebugLogTraceRingList; 0 != Ring; Ring = Ring->Next)
+        if (0 == Ring->OwnerThreadId &&
+            0 == InterlockedCompareExchange(&Ring->OwnerThreadId, (LONG)ThreadId, 0))
+            goto exit;
+
+    Ring = MemAlloc(sizeof *Ring);
+    if (0 == Ring)
+        return 0;
+    memset(Ring, 0, FIELD_OFFSET(FSP_DEBUGLOG_TRACE_RING, Buffer));
+    Ring->OwnerThreadId = (LONG)ThreadId;
+
+    do
+    {
+        Next = FspDebugLogTraceRingList;
+        Ring->Next = Next;
+    } while (Next != InterlockedCompareExchangePointer(
+        (PVOID volatile *)&FspDebugLogTraceRingList, Ring, Next));
+
+exit:
+    Ring->ThreadId = ThreadId;
+    TlsSetValue(FspDebugLogTraceTlsIndex, Ring);
+    return Ring;
+}
+
+VOID FspDebugLogTraceFinalizeThread(VOID)
+{
+    FSP_DEBUGLOG_TRACE_RING *Ring;
+
+    if (TLS_OUT_OF_INDEXES == FspDebugLogTraceTlsIndex)
+        return;
+
+    Ring = TlsGetValue(FspDebugLogTraceTlsIndex);
+    if (0 != Ring)
+    {
+        TlsSetValue(FspDebugLogTraceTlsIndex, 0);
+        InterlockedExchange(&Ring->OwnerThreadId, 0);
+    }
+}
+
+static BOOLEAN FspDebugLogTraceRecordRing(FSP_DEBUGLOG_TRACE_RING *Ring,
+    UINT16 Type, PVOID Data, ULONG DataSize)
+{
+    FSP_DEBUGLOG_TRACE_RECORD *Record;
+    ULONG Size, Head, Used, Offset, Contig, Needed;
+    LARGE_INTEGER Counter;
+
+    Size = FSP_DEBUGLOG_TRACE_ALIGN(sizeof *Record + DataSize);
+    Head = Ring->Head;
+    Used = Head - (ULONG)ReadAcquire((LONG volatile *)&Ring->Tail);
+    Offset = Head & (FSP_DEBUGLOG_TRACE_RINGSIZE - 1);
+    Contig = FSP_DEBUGLOG_TRACE_RINGSIZE - Offset;
+    Needed = Size + (Contig < Size ? Contig : 0);
+
+    while (FSP_DEBUGLOG_TRACE_RINGSIZE - Used < Needed)
+    {
+        if (0 == (FspDebugLogTraceFlags & FspDebugLogTraceNoDrop) || !FspDebugLogTraceActive)
+        {
+            Ring->DroppedCount++;
+            return TRUE;
+        }
+
+        /* only the writer can make room; wake it and wait */
+        SetEvent(FspDebugLogTraceWakeEvent);
+        Sleep(1);
+        Used = Head - (ULONG)ReadAcquire((LONG volatile *)&Ring->Tail);
+    }
+
+    if (Contig < Size)
+    {
+        /* records never wrap; pad to the end of the buffer */
+        Record = (PVOID)(Ring->Buffer + Offset);
+        Record->Size = Contig;
+        Record->Type = FspDebugLogTraceTypePadding;
+        Head += Contig;
+        Offset = 0;
+    }
+
+    QueryPerformanceCounter(&Counter);
+    Record = (PVOID)(Ring->Buffer + Offset);
+    Record->Size = Size;
+    Record->Type = Type;
+    Record->Reserved = 0;
+    Record->ThreadId = Ring->ThreadId;
+    Record->DataSize = DataSize;
+    Record->Timestamp = Counter.QuadPart;
+    memcpy(Record->Data, Data, DataSize);
+
+    /* publish the record to the writer */
+    InterlockedExchange((LONG volatile *)&Ring->Head, (LONG)(Head + Size));
+    Ring->RecordCount++;
+
+    /* wake the writer when the ring crosses half-full; otherwise it wakes on its own */
+    if (Used <= FSP_DEBUGLOG_TRACE_RINGSIZE / 2 && Used + Needed > FSP_DEBUGLOG_TRACE_RINGSIZE / 2)
+        SetEvent(FspDebugLogTraceWakeEvent);
+
+    return TRUE;
+}
+
+static BOOLEAN FspDebugLogTraceRecord(UINT16 Type, PVOID Data, ULONG DataSize)
+{
+    FSP_DEBUGLOG_TRACE_RING *Ring;
+    BOOLEAN Result = FALSE;
+
+    if (GetCurrentThreadId() == FspDebugLogReplayThreadId)
+        return FALSE;
+
+    /*
+     * Producers hold a reference while they record, so that FspDebugLogStopTrace can wait
+     * for them after clearing FspDebugLogTraceActive (a rundown). A producer that enters
+     * after the trace has been stopped does not record.
+     */
+    InterlockedIncrement(&FspDebugLogTraceProducerCount);
+    if (!FspDebugLogTraceActive)
+        goto exit;
+
+    Ring = TlsGetValue(FspDebugLogTraceTlsIndex);
+    if (0 == Ring)
+    {
+        Ring = FspDebugLogTraceRingAcquire();
+        if (0 == Ring)
+            goto exit;
+    }
+
+    Result = FspDebugLogTraceRecordRing(Ring, Type, Data, DataSize);
+
+exit:
+    InterlockedDecrement(&FspDebugLogTraceProducerCount);
+
+    return Result;
+}
+
+BOOLEAN FspDebugLogTraceRequest(FSP_FSCTL_TRANSACT_REQ *Request)
+{
+    return FspDebugLogTraceRecord(FspDebugLogTraceTypeRequest, Request, Request->Size);
+}
+
+BOOLEAN FspDebugLogTraceResponse(FSP_FSCTL_TRANSACT_RSP *Response)
+{
+    return FspDebugLogTraceRecord(FspDebugLogTraceTypeResponse, Response, Response->Size);
+}
+
+static VOID FspDebugLogTraceFlush(VOID)
+{
+    DWORD BytesTransferred;
+
+    if (0 != FspDebugLogTraceBufferLength)
+    {
+        WriteFile(FspDebugLogTraceHandle,
+            FspDebugLogTraceBuffer, FspDebugLogTraceBufferLength, &BytesTransferred, 0);
+        FspDebugLogTraceBufferLength = 0;
+    }
+}
+
+static VOID FspDebugLogTraceWrite(PVOID Data, ULONG Size)
+{
+    DWORD BytesTransferred;
+
+    if (FSP_DEBUGLOG_TRACE_BUFSIZE - FspDebugLogTraceBufferLength < Size)
+        FspDebugLogTraceFlush();
+
+    if (FSP_DEBUGLOG_TRACE_BUFSIZE < Size)
+        WriteFile(FspDebugLogTraceHandle, Data, Size, &BytesTransferred, 0);
+    else
+    {
+        memcpy(FspDebugLogTraceBuffer + FspDebugLogTraceBufferLength, Data, Size);
+        FspDebugLogTraceBufferLength += Size;
+    }
+}
+
+static VOID FspDebugLogTraceDrain(VOID)
+{
+    FSP_DEBUGLOG_TRACE_RING *Ring;
+    FSP_DEBUGLOG_TRACE_RECORD *Record;
+    ULONG Head, Tail, Offset, RunOffset, RunSize, DroppedCount;
+    struct
+    {
+        FSP_DEBUGLOG_TRACE_RECORD Record;
+        UINT64 Count;
+    } Dropped;
+
+    for (Ring = FspDebugLogTraceRingList; 0 != Ring; Ring = Ring->Next)
+    {
+        Head = (ULONG)ReadAcquire((LONG volatile *)&Ring->Head);
+        Tail = Ring->Tail;
+
+        /* write contiguous runs of records, skipping padding */
+        RunOffset = Tail & (FSP_DEBUGLOG_TRACE_RINGSIZE - 1);
+        RunSize = 0;
+        while (Tail != Head)
+        {
+            Offset = Tail & (FSP_DEBUGLOG_TRACE_RINGSIZE - 1);
+            Record = (PVOID)(Ring->Buffer + Offset);
+            if (FspDebugLogTraceTypePadding == Record->Type)
+            {
+                FspDebugLogTraceWrite(Ring->Buffer + RunOffset, RunSize);
+                RunOffset = 0;
+                RunSize = 0;
+            }
+            else
+                RunSize += Record->Size;
+            Tail += Record->Size;
+        }
+        FspDebugLogTraceWrite(Ring->Buffer + RunOffset, RunSize);
+
+        /* release the space to the producer */
+        InterlockedExchange((LONG volatile *)&Ring->Tail, (LONG)Tail);
+
+        DroppedCount = Ring->DroppedCount;
+        if (DroppedCount != Ring->DroppedReported)
+        {
+            memset(&Dropped, 0, sizeof Dropped);
+            Dropped.Record.Size = sizeof Dropped;
+            Dropped.Record.Type = FspDebugLogTraceTypeDropped;
+            Dropped.Record.ThreadId = Ring->ThreadId;
+            Dropped.Record.DataSize = sizeof Dropped.Count;
+            Dropped.Count = DroppedCount - Ring->DroppedReported;
+            FspDebugLogTraceWrite(&Dropped, sizeof Dropped);
+            Ring->DroppedReported = DroppedCount;
+        }
+    }
+
+    FspDebugLogTraceFlush();
+}
+
+static DWORD WINAPI FspDebugLogTraceWriter(PVOID Context)
+{
+    HANDLE Handles[2] = { FspDebugLogTraceStopEvent, FspDebugLogTraceWakeEvent };
+
+    while (WAIT_OBJECT_0 != WaitForMultipleObjects(2, Handles, FALSE, FSP_DEBUGLOG_TRACE_INTERVAL))
+        FspDebugLogTraceDrain();
+
+    FspDebugLogTraceDrain();
+
+    return 0;
+}
+
+static VOID FspDebugLogTraceGetCounts(PUINT64 PRecordCount, PUINT64 PDroppedCount)
+{
+    FSP_DEBUGLOG_TRACE_RING *Ring;
+    UINT64 RecordCount = 0, DroppedCount = 0;
+
+    for (Ring = FspDebugLogTraceRingList; 0 != Ring; Ring = Ring->Next)
+    {
+        RecordCount += Ring->RecordCount;
+        DroppedCount += Ring->DroppedCount;
+    }
+
+    *PRecordCount = RecordCount;
+    *PDroppedCount = DroppedCount;
+}
+
+FSP_API NTSTATUS FspDebugLogStartTrace(HANDLE Handle)
+{
+    return FspDebugLogStartTraceEx(Handle, 0);
+}
+
+FSP_API NTSTATUS FspDebugLogStartTraceEx(HANDLE Handle, ULONG Flags)
+{
+    FSP_DEBUGLOG_TRACE_HEADER Header;
+    LARGE_INTEGER Frequency, Counter;
+    DWORD BytesTransferred;
+    NTSTATUS Result;
+
+    InitOnceExecuteOnce(&FspDebugLogTraceInitOnce, FspDebugLogTraceInitialize, 0, 0);
+    if (TLS_OUT_OF_INDEXES == FspDebugLogTraceTlsIndex)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    AcquireSRWLockExclusive(&FspDebugLogTraceLock);
+
+    if (0 != FspDebugLogTraceThread)
+    {
+        Result = STATUS_INVALID_DEVICE_STATE;
+        goto exit;
+    }
+
+    memset(&Header, 0, sizeof Header);
+    memcpy(Header.Magic, FSP_DEBUGLOG_TRACE_MAGIC, sizeof Header.Magic);
+    Header.Version = FSP_DEBUGLOG_TRACE_VERSION;
+    Header.HeaderSize = sizeof Header;
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Counter);
+    Header.Frequency = Frequency.QuadPart;
+    Header.StartCounter = Counter.QuadPart;
+    GetSystemTimeAsFileTime((PFILETIME)&Header.StartTime);
+    Header.ProcessId = GetCurrentProcessId();
+    Header.PointerSize = sizeof(PVOID);
+    memcpy(Header.Ident, FspDiagIdent(), sizeof Header.Ident);
+    Header.Ident[sizeof Header.Ident / sizeof(WCHAR) - 1] = L'\0';
+
+    if (!WriteFile(Handle, &Header, sizeof Header, &BytesTransferred, 0))
+    {
+        Result = FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+
+    FspDebugLogTraceBuffer = MemAlloc(FSP_DEBUGLOG_TRACE_BUFSIZE);
+    if (0 == FspDebugLogTraceBuffer)
+    {
+        Result = STATUS_INSUFFICIENT_RESOURCES;
+        goto exit;
+    }
+    FspDebugLogTraceBufferLength = 0;
+    FspDebugLogTraceHandle = Handle;
+    FspDebugLogTraceFlags = Flags;
+
+    FspDebugLogTraceGetCounts(&FspDebugLogTraceRecordBase, &FspDebugLogTraceDroppedBase);
+
+    FspDebugLogTraceThread = CreateThread(0, 0, FspDebugLogTraceWriter, 0, 0, 0);
+    if (0 == FspDebugLogTraceThread)
+    {
+        Result = FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+
+    FspDebugLogTraceActive = TRUE;
+
+    Result = STATUS_SUCCESS;
+
+exit:
+    if (!NT_SUCCESS(Result))
+    {
+        MemFree(FspDebugLogTraceBuffer);
+        FspDebugLogTraceBuffer = 0;
+        FspDebugLogTraceHandle = 0;
+    }
+
+    ReleaseSRWLockExclusive(&FspDebugLogTraceLock);
+
+    return Result;
+}
+
+FSP_API VOID FspDebugLogStopTrace(VOID)
+{
+    AcquireSRWLockExclusive(&FspDebugLogTraceLock);
+
+    if (0 != FspDebugLogTraceThread)
+    {
+        FspDebugLogTraceActive = FALSE;
+        MemoryBarrier();
+
+        /* wait for in-flight producers; the writer keeps draining so that they can finish */
+        while (0 != FspDebugLogTraceProducerCount)
+        {
+            SetEvent(FspDebugLogTraceWakeEvent);
+            Sleep(1);
+        }
+
+        SetEvent(FspDebugLogTraceStopEvent);
+        WaitForSingleObject(FspDebugLogTraceThread, INFINITE);
+        CloseHandle(FspDebugLogTraceThread);
+        MemFree(FspDebugLogTraceBuffer);
+
+        FspDebugLogTraceThread = 0;
+        FspDebugLogTraceBuffer = 0;
+        FspDebugLogTraceHandle = 0;
+    }
+
+    ReleaseSRWLockExclusive(&FspDebugLogTraceLock);
+}
+
+FSP_API VOID FspDebugLogGetTraceStatistics(PUINT64 PRecordCount, PUINT64 PDroppedCount)
+{
+    UINT64 RecordCount, DroppedCount;
+
+    AcquireSRWLockShared(&FspDebugLogTraceLock);
+
+    FspDebugLogTraceGetCounts(&RecordCount, &DroppedCount);
+    RecordCount -= FspDebugLogTraceRecordBase;
+    DroppedCount -= FspDebugLogTraceDroppedBase;
+
+    ReleaseSRWLockShared(&FspDebugLogTraceLock);
+
+    if (0 != PRecordCount)
+        *PRecordCount = RecordCount;
+    if (0 != PDroppedCount)
+        *PDroppedCount = DroppedCount;
+}
+
+PWSTR FspDebugLogIdent(VOID)
+{
+    if (GetCurrentThreadId() == FspDebugLogReplayThreadId)
+        return FspDebugLogReplayIdent;
+    return FspDiagIdent();
+}
+
+DWORD FspDebugLogThreadId(VOID)
+{
+    DWORD ThreadId = GetCurrentThreadId();
+    if (ThreadId == FspDebugLogReplayThreadId)
+        return FspDebugLogReplayRecordThreadId;
+    return ThreadId;
+}
+
+static BOOLEAN FspDebugLogDecodeRead(HANDLE Handle, PVOID Buffer, ULONG Size)
+{
+    DWORD BytesTransferred;
+
+    for (ULONG Offset = 0; Size > Offset; Offset += BytesTransferred)
+        if (!ReadFile(Handle, (PUINT8)Buffer + Offset, Size - Offset, &BytesTransferred, 0) ||
+            0 == BytesTransferred)
+            return FALSE;
+
+    return TRUE;
+}
+
+FSP_API NTSTATUS FspDebugLogDecodeTrace(HANDLE Handle, ULONG Flags)
+{
+    static SRWLOCK DecodeLock = SRWLOCK_INIT;
+    FSP_DEBUGLOG_TRACE_HEADER Header;
+    FSP_DEBUGLOG_TRACE_RECORD Record;
+    PUINT8 Buffer = 0;
+    ULONG BufferSize;
+    UINT64 Elapsed;
+    NTSTATUS Result;
+
+    /*
+     * The buffer is large enough that the request/response offsets (which are all UINT16)
+     * can never point outside it, even if the trace file is corrupt.
+     */
+    BufferSize = 2 * 64 * 1024;
+    Buffer = MemAlloc(BufferSize);
+    if (0 == Buffer)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    if (!FspDebugLogDecodeRead(Handle, &Header, sizeof Header) ||
+        0 != memcmp(Header.Magic, FSP_DEBUGLOG_TRACE_MAGIC, sizeof Header.Magic) ||
+        FSP_DEBUGLOG_TRACE_VERSION != Header.Version ||
+        sizeof Header != Header.HeaderSize ||
+        0 == Header.Frequency)
+    {
+        MemFree(Buffer);
+        return STATUS_INVALID_IMAGE_FORMAT;
+    }
+
+    AcquireSRWLockExclusive(&DecodeLock);
+
+    memcpy(FspDebugLogReplayIdent, Header.Ident, sizeof FspDebugLogReplayIdent);
+    FspDebugLogReplayIdent[sizeof FspDebugLogReplayIdent / sizeof(WCHAR) - 1] = L'\0';
+    FspDebugLogReplayThreadId = GetCurrentThreadId();
+
+    for (;;)
+    {
+        if (!FspDebugLogDecodeRead(Handle, &Record, sizeof Record))
+            break;
+
+        if (sizeof Record > Record.Size || BufferSize < Record.Size - sizeof Record ||
+            Record.Size - sizeof Record < Record.DataSize)
+        {
+            Result = STATUS_FILE_CORRUPT_ERROR;
+            goto exit;
+        }
+
+        memset(Buffer, 0, BufferSize);
+        if (!FspDebugLogDecodeRead(Handle, Buffer, Record.Size - sizeof Record))
+        {
+            Result = STATUS_FILE_CORRUPT_ERROR;
+            goto exit;
+        }
+
+        FspDebugLogReplayRecordThreadId = Record.ThreadId;
+
+        if (0 != (Flags & FspDebugLogDecodeTimestamps) && FspDebugLogTraceTypeDropped != Record.Type)
+        {
+            Elapsed = Header.StartCounter <= Record.Timestamp ?
+                (Record.Timestamp - Header.StartCounter) * 1000000 / Header.Frequency : 0;
+            FspDebugLog("%lu.%06lu ", (ULONG)(Elapsed / 1000000), (ULONG)(Elapsed % 1000000));
+        }
+
+        switch (Record.Type)
+        {
+        case FspDebugLogTraceTypeRequest:
+            if (sizeof(FSP_FSCTL_TRANSACT_REQ) <= Record.DataSize)
+                FspDebugLogRequest((FSP_FSCTL_TRANSACT_REQ *)Buffer);
+            break;
+        case FspDebugLogTraceTypeResponse:
+            if (sizeof(FSP_FSCTL_TRANSACT_RSP) <= Record.DataSize)
+                FspDebugLogResponse((FSP_FSCTL_TRANSACT_RSP *)Buffer);
+            break;
+        case FspDebugLogTraceTypeDropped:
+            if (sizeof(UINT64) <= Record.DataSize)
+                FspDebugLog("%S[TID=%04lx]: trace: %lu records dropped\n",
+                    FspDebugLogReplayIdent, Record.ThreadId, (ULONG)*(PUINT64)Buffer);
+            break;
+        default:
+            break;
+        }
+    }
+
+    Result = STATUS_SUCCESS;
+
+exit:
+    FspDebugLogReplayThreadId = 0;
+
+    ReleaseSRWLockExclusive(&DecodeLock);
+
+    MemFree(Buffer);
+
+    return Result;
+}
+
+/*
+ * Replay
+ *
+ * FspFileSystemReplayTrace loads a trace into memory, orders its records by timestamp (the
+ * writer interleaves per-thread rings, so file order is not time order) and feeds each
+ * recorded request to the file system operations on the calling thread. Recorded file
+ * contexts are translated to replayed ones: when the recorded and replayed responses to a
+ * Create both succeed, the recorded (UserContext, UserContext2) pair is mapped to the
+ * replayed pair; the mapping is dropped when the last Close for it is replayed.
+ */
+
+typedef struct
+{
+    BOOLEAN Used;
+    UINT64 Key[2];
+    UINT64 Value[2];
+    UINT32 Kind;
+    NTSTATUS Status;
+    ULONG RefCount;
+} FSP_DEBUGLOG_REPLAY_ENTRY;
+
+typedef struct
+{
+    FSP_DEBUGLOG_REPLAY_ENTRY *Entries;
+    ULONG Capacity;                     /* power of 2 */
+    ULONG Count;
+} FSP_DEBUGLOG_REPLAY_TABLE;
+
+static inline ULONG FspDebugLogReplayHash(UINT64 Key0, UINT64 Key1)
+{
+    return (ULONG)(((Key0 ^ (Key1 * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL) >> 32);
+}
+
+static BOOLEAN FspDebugLogReplayTableGrow(FSP_DEBUGLOG_REPLAY_TABLE *Table)
+{
+    FSP_DEBUGLOG_REPLAY_ENTRY *Entries, *Entry;
+    ULONG Capacity, Mask, Index;
+
+    Capacity = 0 != Table->Capacity ? Table->Capacity * 2 : 256;
+    Entries = MemAlloc(Capacity * sizeof *Entries);
+    if (0 == Entries)
+        return FALSE;
+    memset(Entries, 0, Capacity * sizeof *Entries);
+
+    Mask = Capacity - 1;
+    for (ULONG I = 0; Table->Capacity > I; I++)
+    {
+        Entry = &Table->Entries[I];
+        if (!Entry->Used)
+            continue;
+        for (Index = FspDebugLogReplayHash(Entry->Key[0], Entry->Key[1]) & Mask;
+            Entries[Index].Used;
+            Index = (Index + 1) & Mask)
+            ;
+        Entries[Index] = *Entry;
+    }
+
+    MemFree(Table->Entries);
+    Table->Entries = Entries;
+    Table->Capacity = Capacity;
+
+    return TRUE;
+}
+
+static FSP_DEBUGLOG_REPLAY_ENTRY *FspDebugLogReplayTableLookup(FSP_DEBUGLOG_REPLAY_TABLE *Table,
+    UINT64 Key0, UINT64 Key1, BOOLEAN Insert)
+{
+    FSP_DEBUGLOG_REPLAY_ENTRY *Entry;
+    ULONG Mask, Index;
+
+    if (Insert && (Table->Count + 1) * 2 > Table->Capacity)
+    {
+        if (!FspDebugLogReplayTableGrow(Table))
+            return 0;
+    }
+    else if (0 == Table->Capacity)
+        return 0;
+
+    Mask = Table->Capacity - 1;
+    for (Index = FspDebugLogReplayHash(Key0, Key1) & Mask;; Index = (Index + 1) & Mask)
+    {
+        Entry = &Table->Entries[Index];
+        if (!Entry->Used)
+            break;
+        if (Key0 == Entry->Key[0] && Key1 == Entry->Key[1])
+            return Entry;
+    }
+
+    if (!Insert)
+        return 0;
+
+    memset(Entry, 0, sizeof *Entry);
+    Entry->Used = TRUE;
+    Entry->Key[0] = Key0;
+    Entry->Key[1] = Key1;
+    Table->Count++;
+
+    return Entry;
+}
+
+static VOID FspDebugLogReplayTableRemove(FSP_DEBUGLOG_REPLAY_TABLE *Table,
+    FSP_DEBUGLOG_REPLAY_ENTRY *Entry)
+{
+    FSP_DEBUGLOG_REPLAY_ENTRY *Entries = Table->Entries;
+    ULONG Mask = Table->Capacity - 1, I, J, H;
+
+    /* linear probing: shift back entries that would otherwise become unreachable */
+    I = J = (ULONG)(Entry - Entries);
+    for (;;)
+    {
+        J = (J + 1) & Mask;
+        if (!Entries[J].Used)
+            break;
+        H = FspDebugLogReplayHash(Entries[J].Key[0], Entries[J].Key[1]) & Mask;
+        if (I <= J ? (I < H && H <= J) : (I < H || H <= J))
+            continue;
+        Entries[I] = Entries[J];
+        I = J;
+    }
+    memset(&Entries[I], 0, sizeof Entries[I]);
+    Table->Count--;
+}
+
+static int __cdecl FspDebugLogReplayCompare(const void *P0, const void *P1)
+{
+    const FSP_DEBUGLOG_TRACE_RECORD *Record0 = *(const FSP_DEBUGLOG_TRACE_RECORD **)P0;
+    const FSP_DEBUGLOG_TRACE_RECORD *Record1 = *(const FSP_DEBUGLOG_TRACE_RECORD **)P1;
+
+    if (Record0->Timestamp != Record1->Timestamp)
+        return Record0->Timestamp < Record1->Timestamp ? -1 : +1;
+
+    /* same timestamp: keep file order (which is per-thread order) */
+    return Record0 < Record1 ? -1 : Record0 > Record1 ? +1 : 0;
+}
+
+static inline BOOLEAN FspDebugLogReplayValidateBuf(FSP_FSCTL_TRANSACT_REQ *Request,
+    FSP_FSCTL_TRANSACT_BUF *Buf, BOOLEAN IsString)
+{
+    ULONG DataSize = Request->Size - sizeof *Request;
+    PWSTR String;
+
+    if ((ULONG)Buf->Offset + Buf->Size > DataSize)
+        return FALSE;
+
+    /* strings are passed to the file system as NUL-terminated PWSTR's */
+    if (IsString && 0 != Buf->Size)
+    {
+        if (0 != (Buf->Offset & 1) || 0 != (Buf->Size & 1))
+            return FALSE;
+        String = (PWSTR)(Request->Buffer + Buf->Offset);
+        if (L'\0' != String[Buf->Size / sizeof(WCHAR) - 1])
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static BOOLEAN FspDebugLogReplayValidateRequest(FSP_FSCTL_TRANSACT_REQ *Request)
+{
+    /*
+     * The file system operations trust the FSD to send well formed requests. A trace file
+     * may be truncated or corrupt, so check that every buffer lies within the request.
+     */
+    if (!FspDebugLogReplayValidateBuf(Request, &Request->FileName, TRUE))
+        return FALSE;
+
+    switch (Request->Kind)
+    {
+    case FspFsctlTransactCreateKind:
+        return 0 != Request->FileName.Size &&
+            Request->Req.Create.NamedStream < Request->FileName.Size &&
+            FspDebugLogReplayValidateBuf(Request, &Request->Req.Create.SecurityDescriptor, FALSE) &&
+            FspDebugLogReplayValidateBuf(Request, &Request->Req.Create.Ea, FALSE);
+    case FspFsctlTransactOverwriteKind:
+        return FspDebugLogReplayValidateBuf(Request, &Request->Req.Overwrite.Ea, FALSE);
+    case FspFsctlTransactSetInformationKind:
+        switch (Request->Req.SetInformation.FileInformationClass)
+        {
+        case 13/*FileDispositionInformation*/:
+        case 64/*FileDispositionInformationEx*/:
+            return 0 != Request->FileName.Size;
+        case 10/*FileRenameInformation*/:
+        case 65/*FileRenameInformationEx*/:
+            return 0 != Request->FileName.Size &&
+                0 != Request->Req.SetInformation.Info.Rename.NewFileName.Size &&
+                FspDebugLogReplayValidateBuf(Request,
+                    &Request->Req.SetInformation.Info.Rename.NewFileName, TRUE);
+        }
+        return TRUE;
+    case FspFsctlTransactSetEaKind:
+        return FspDebugLogReplayValidateBuf(Request, &Request->Req.SetEa.Ea, FALSE);
+    case FspFsctlTransactSetVolumeInformationKind:
+        switch (Request->Req.SetVolumeInformation.FsInformationClass)
+        {
+        case 2/*FileFsLabelInformation*/:
+            return 0 != Request->Req.SetVolumeInformation.Info.Label.VolumeLabel.Size &&
+                FspDebugLogReplayValidateBuf(Request,
+                    &Request->Req.SetVolumeInformation.Info.Label.VolumeLabel, TRUE);
+        }
+        return TRUE;
+    case FspFsctlTransactQueryDirectoryKind:
+        return FspDebugLogReplayValidateBuf(Request, &Request->Req.QueryDirectory.Pattern, TRUE) &&
+            FspDebugLogReplayValidateBuf(Request, &Request->Req.QueryDirectory.Marker, TRUE);
+    case FspFsctlTransactFileSystemControlKind:
+        return FspDebugLogReplayValidateBuf(Request, &Request->Req.FileSystemControl.Buffer, FALSE);
+    case FspFsctlTransactDeviceControlKind:
+        return FspDebugLogReplayValidateBuf(Request, &Request->Req.DeviceControl.Buffer, FALSE);
+    case FspFsctlTransactSetSecurityKind:
+        return FspDebugLogReplayValidateBuf(Request, &Request->Req.SetSecurity.SecurityDescriptor, FALSE);
+    default:
+        return TRUE;
+    }
+}
+
+FSP_API NTSTATUS FspFileSystemReplayTrace(FSP_FILE_SYSTEM *FileSystem,
+    HANDLE Handle, ULONG Flags, FSP_FILE_SYSTEM_REPLAY_STATISTICS *Statistics)
+{
+    FSP_DEBUGLOG_TRACE_HEADER Header;
+    FSP_DEBUGLOG_TRACE_RECORD *Record, **Records = 0;
+    FSP_FILE_SYSTEM_REPLAY_STATISTICS Stats;
+    FSP_DEBUGLOG_REPLAY_TABLE Contexts, Pending;
+    FSP_DEBUGLOG_REPLAY_ENTRY *Entry, *ContextEntry;
+    FSP_FSCTL_TRANSACT_REQ *Request = 0;
+    FSP_FSCTL_TRANSACT_RSP *Response = 0, *RecordedResponse;
+    PUINT8 Trace = 0, IoBuffer = 0;
+    ULONG TraceSize, RecordCount, IoBufferSize, Length;
+    PUINT64 PAddress;
+    LARGE_INTEGER FileSize, FilePointer, Frequency, StartCounter, Counter;
+    UINT64 FirstTimestamp, Due, Now;
+    HANDLE ProcessToken = 0, Token = 0;
+    UINT64 AccessToken;
+    NTSTATUS Result;
+
+    memset(&Stats, 0, sizeof Stats);
+    memset(&Contexts, 0, sizeof Contexts);
+    memset(&Pending, 0, sizeof Pending);
+
+    if (0 != FileSystem->DispatcherThread)
+    {
+        Result = STATUS_INVALID_DEVICE_STATE;
+        goto exit;
+    }
+
+    if (!FspDebugLogDecodeRead(Handle, &Header, sizeof Header) ||
+        0 != memcmp(Header.Magic, FSP_DEBUGLOG_TRACE_MAGIC, sizeof Header.Magic) ||
+        FSP_DEBUGLOG_TRACE_VERSION != Header.Version ||
+        sizeof Header != Header.HeaderSize ||
+        0 == Header.Frequency)
+    {
+        Result = STATUS_INVALID_IMAGE_FORMAT;
+        goto exit;
+    }
+
+    FilePointer.QuadPart = 0;
+    if (!GetFileSizeEx(Handle, &FileSize) ||
+        !SetFilePointerEx(Handle, FilePointer, &FilePointer, FILE_CURRENT))
+    {
+        Result = FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+    if (FileSize.QuadPart - FilePointer.QuadPart > MAXLONG)
+    {
+        Result = STATUS_FILE_TOO_LARGE;
+        goto exit;
+    }
+    TraceSize = (ULONG)(FileSize.QuadPart - FilePointer.QuadPart);
+
+    /* records are 8-byte aligned within the file; MemAlloc memory is suitably aligned */
+    Trace = MemAlloc(TraceSize + 1);
+    if (0 == Trace)
+    {
+        Result = STATUS_INSUFFICIENT_RESOURCES;
+        goto exit;
+    }
+    if (!FspDebugLogDecodeRead(Handle, Trace, TraceSize))
+    {
+        Result = STATUS_FILE_CORRUPT_ERROR;
+        goto exit;
+    }
+
+    /* index the request and response records */
+    RecordCount = 0;
+    for (ULONG Pass = 0; 2 > Pass; Pass++)
+    {
+        ULONG Count = 0;
+        for (ULONG Offset = 0; TraceSize > Offset; Offset += Record->Size)
+        {
+            Record = (PVOID)(Trace + Offset);
+            if (TraceSize - Offset < sizeof *Record ||
+                sizeof *Record > Record->Size || TraceSize - Offset < Record->Size ||
+                Record->Size - sizeof *Record < Record->DataSize)
+            {
+                Result = STATUS_FILE_CORRUPT_ERROR;
+                goto exit;
+            }
+
+            switch (Record->Type)
+            {
+            case FspDebugLogTraceTypeRequest:
+                if (sizeof(FSP_FSCTL_TRANSACT_REQ) > Record->DataSize ||
+                    FSP_FSCTL_TRANSACT_REQ_SIZEMAX < Record->DataSize)
+                {
+                    if (1 == Pass)
+                        Stats.SkippedCount++;
+                    break;
+                }
+                if (1 == Pass)
+                    Records[Count] = Record;
+                Count++;
+                break;
+            case FspDebugLogTraceTypeResponse:
+                if (sizeof(FSP_FSCTL_TRANSACT_RSP) > Record->DataSize)
+                    break;
+                if (1 == Pass)
+                    Records[Count] = Record;
+                Count++;
+                break;
+            case FspDebugLogTraceTypeDropped:
+                if (1 == Pass && sizeof(UINT64) <= Record->DataSize)
+                    Stats.DroppedCount += *(PUINT64)Record->Data;
+                break;
+            default:
+                break;
+            }
+        }
+
+        if (0 == Pass)
+        {
+            RecordCount = Count;
+            Records = MemAlloc((RecordCount + 1) * sizeof *Records);
+            if (0 == Records)
+            {
+                Result = STATUS_INSUFFICIENT_RESOURCES;
+                goto exit;
+            }
+        }
+    }
+    qsort(Records, RecordCount, sizeof *Records, FspDebugLogReplayCompare);
+
+    /* requests are performed in the security context of the current process */
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY | TOKEN_DUPLICATE, &ProcessToken) ||
+        !DuplicateToken(ProcessToken, SecurityImpersonation, &Token))
+    {
+        Result = FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+    AccessToken = ((UINT64)GetCurrentProcessId() << 32) | (UINT32)(UINT_PTR)Token;
+
+    Request = MemAlloc(FSP_FSCTL_TRANSACT_BUFFER_SIZEMIN);
+    Response = MemAlloc(FSP_FSCTL_TRANSACT_RSP_SIZEMAX);
+    if (0 == Request || 0 == Response)
+    {
+        Result = STATUS_INSUFFICIENT_RESOURCES;
+        goto exit;
+    }
+    IoBufferSize = 0;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&StartCounter);
+    FirstTimestamp = 0 != RecordCount ? Records[0]->Timestamp : 0;
+
+    for (ULONG I = 0; RecordCount > I; I++)
+    {
+        Record = Records[I];
+
+        if (0 != (Flags & FspFileSystemReplayTimed))
+        {
+            Due = (Record->Timestamp - FirstTimestamp) * 1000 / Header.Frequency;
+            QueryPerformanceCounter(&Counter);
+            Now = (UINT64)(Counter.QuadPart - StartCounter.QuadPart) * 1000 / Frequency.QuadPart;
+            if (Due > Now)
+                Sleep((DWORD)(Due - Now));
+        }
+
+        if (FspDebugLogTraceTypeResponse == Record->Type)
+        {
+            RecordedResponse = (PVOID)Record->Data;
+
+            /* responses to skipped or pending requests have no entry */
+            Entry = FspDebugLogReplayTableLookup(&Pending, RecordedResponse->Hint, 0, FALSE);
+            if (0 == Entry)
+                continue;
+
+            if ((NTSTATUS)RecordedResponse->IoStatus.Status != Entry->Status)
+                Stats.MismatchCount++;
+            else if (FspFsctlTransactCreateKind == Entry->Kind &&
+                STATUS_SUCCESS == Entry->Status)
+            {
+                ContextEntry = FspDebugLogReplayTableLookup(&Contexts,
+                    RecordedResponse->Rsp.Create.Opened.UserContext,
+                    RecordedResponse->Rsp.Create.Opened.UserContext2,
+                    TRUE);
+                if (0 == ContextEntry)
+                {
+                    Result = STATUS_INSUFFICIENT_RESOURCES;
+                    goto exit;
+                }
+                ContextEntry->Value[0] = Entry->Value[0];
+                ContextEntry->Value[1] = Entry->Value[1];
+                ContextEntry->RefCount++;
+            }
+
+            FspDebugLogReplayTableRemove(&Pending, Entry);
+            continue;
+        }
+
+        memcpy(Request, Record->Data, Record->DataSize);
+        Request->Size = (UINT16)Record->DataSize;
+        if (!FspDebugLogReplayValidateRequest(Request))
+        {
+            Stats.SkippedCount++;
+            continue;
+        }
+
+        ContextEntry = 0;
+        switch (Request->Kind)
+        {
+        case FspFsctlTransactReservedKind:
+        case FspFsctlTransactQueryVolumeInformationKind:
+        case FspFsctlTransactSetVolumeInformationKind:
+            break;
+        case FspFsctlTransactCreateKind:
+            Request->Req.Create.AccessToken = AccessToken;
+            break;
+        default:
+            /* all other requests start with the (UserContext, UserContext2) pair */
+            ContextEntry = FspDebugLogReplayTableLookup(&Contexts,
+                Request->Req.Close.UserContext, Request->Req.Close.UserContext2, FALSE);
+            if (0 == ContextEntry)
+                break;
+            Request->Req.Close.UserContext = ContextEntry->Value[0];
+            Request->Req.Close.UserContext2 = ContextEntry->Value[1];
+            break;
+        }
+        if (0 == ContextEntry &&
+            FspFsctlTransactKindCount > Request->Kind &&
+            FspFsctlTransactReservedKind != Request->Kind &&
+            FspFsctlTransactCreateKind != Request->Kind &&
+            FspFsctlTransactQueryVolumeInformationKind != Request->Kind &&
+            FspFsctlTransactSetVolumeInformationKind != Request->Kind)
+        {
+            Stats.SkippedCount++;
+            continue;
+        }
+
+        /* point I/O buffers to scratch memory */
+        PAddress = 0;
+        Length = 0;
+        switch (Request->Kind)
+        {
+        case FspFsctlTransactReadKind:
+            PAddress = &Request->Req.Read.Address;
+            Length = Request->Req.Read.Length;
+            break;
+        case FspFsctlTransactWriteKind:
+            PAddress = &Request->Req.Write.Address;
+            Length = Request->Req.Write.Length;
+            break;
+        case FspFsctlTransactQueryDirectoryKind:
+            PAddress = &Request->Req.QueryDirectory.Address;
+            Length = Request->Req.QueryDirectory.Length;
+            break;
+        case FspFsctlTransactSetInformationKind:
+            if ((10/*FileRenameInformation*/ == Request->Req.SetInformation.FileInformationClass ||
+                65/*FileRenameInformationEx*/ == Request->Req.SetInformation.FileInformationClass) &&
+                0 != Request->Req.SetInformation.Info.Rename.AccessToken)
+                Request->Req.SetInformation.Info.Rename.AccessToken = AccessToken;
+            break;
+        }
+        if (0 != PAddress)
+        {
+            if (IoBufferSize < Length)
+            {
+                MemFree(IoBuffer);
+                IoBufferSize = 0;
+                IoBuffer = MemAlloc(Length);
+                if (0 == IoBuffer)
+                {
+                    Result = STATUS_INSUFFICIENT_RESOURCES;
+                    goto exit;
+                }
+                memset(IoBuffer, 0, Length);
+                IoBufferSize = Length;
+            }
+            *PAddress = (UINT64)(UINT_PTR)IoBuffer;
+        }
+
+        FspFileSystemReplayOperation(FileSystem, Request, Response);
+        Stats.RequestCount++;
+
+        if (FspFsctlTransactCloseKind == Request->Kind && 0 == --ContextEntry->RefCount)
+            FspDebugLogReplayTableRemove(&Contexts, ContextEntry);
+
+        if (STATUS_PENDING == Response->IoStatus.Status)
+        {
+            /* the file system will respond later through FspFileSystemSendResponse */
+            Stats.PendingCount++;
+            continue;
+        }
+
+        Entry = FspDebugLogReplayTableLookup(&Pending, Request->Hint, 0, TRUE);
+        if (0 == Entry)
+        {
+            Result = STATUS_INSUFFICIENT_RESOURCES;
+            goto exit;
+        }
+        Entry->Kind = Request->Kind;
+        Entry->Status = Response->IoStatus.Status;
+        if (FspFsctlTransactCreateKind == Request->Kind)
+        {
+            Entry->Value[0] = Response->Rsp.Create.Opened.UserContext;
+            Entry->Value[1] = Response->Rsp.Create.Opened.UserContext2;
+        }
+    }
+
+    Result = STATUS_SUCCESS;
+
+exit:
+    if (0 != Statistics)
+        *Statistics = Stats;
+
+    MemFree(Pending.Entries);
+    MemFree(Contexts.Entries);
+    MemFree(IoBuffer);
+    MemFree(Response);
+    MemFree(Request);
+    if (0 != Token)
+        CloseHandle(Token);
+    if (0 != ProcessToken)
+        CloseHandle(ProcessToken);
+    MemFree(Records);
+    MemFree(Trace);
+
+    return Result;
+}
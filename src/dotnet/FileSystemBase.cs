@@ -159,6 +159,43 @@ namespace Fsp
             return STATUS_INVALID_DEVICE_REQUEST;
         }
         /// <summary>
+        /// Gets file or directory attributes and security descriptor given a file name
+        /// without allocating.
+        /// </summary>
+        /// <remarks>
+        /// This is the operation that the FileSystemHost calls. The base implementation
+        /// creates a String from FileName and calls the GetSecurityByName overload above.
+        /// File systems that want to avoid per-operation allocations may override this
+        /// overload instead.
+        /// </remarks>
+        /// <param name="FileName">
+        /// The name of the file or directory to get the attributes and security descriptor for.
+        /// </param>
+        /// <param name="FileAttributes">
+        /// Receives the file attributes on successful return.
+        /// </param>
+        /// <param name="SecurityDescriptor">
+        /// Receives the file security descriptor if SecurityDescriptor.IsRequested.
+        /// </param>
+        /// <returns>STATUS_SUCCESS, STATUS_REPARSE or error code.</returns>
+        public virtual Int32 GetSecurityByName(
+            NativeString FileName,
+            out UInt32 FileAttributes/* or ReparsePointIndex */,
+            SecurityDescriptorBuffer SecurityDescriptor)
+        {
+            Byte[] SecurityDescriptorBytes = null;
+            Int32 Result;
+            if (SecurityDescriptor.IsRequested)
+                SecurityDescriptorBytes = FileSystemHost.ByteBufferNotNull;
+            Result = GetSecurityByName(
+                FileName.ToString(),
+                out FileAttributes,
+                ref SecurityDescriptorBytes);
+            if (0 <= Result && STATUS_REPARSE != Result)
+                Result = SecurityDescriptor.Set(SecurityDescriptorBytes);
+            return Result;
+        }
+        /// <summary>
         /// Creates a new file or directory.
         /// </summary>
         /// <param name="FileName">
@@ -251,6 +288,32 @@ namespace Fsp
             return STATUS_INVALID_DEVICE_REQUEST;
         }
         /// <summary>
+        /// Opens a file or directory without allocating a String for its name.
+        /// </summary>
+        /// <remarks>
+        /// This is the operation that the FileSystemHost calls. The base implementation
+        /// creates a String from FileName and calls the Open overload above.
+        /// </remarks>
+        /// <returns>STATUS_SUCCESS or error code.</returns>
+        public virtual Int32 Open(
+            NativeString FileName,
+            UInt32 CreateOptions,
+            UInt32 GrantedAccess,
+            out Object FileNode,
+            out Object FileDesc,
+            out FileInfo FileInfo,
+            out String NormalizedName)
+        {
+            return Open(
+                FileName.ToString(),
+                CreateOptions,
+                GrantedAccess,
+                out FileNode,
+                out FileDesc,
+                out FileInfo,
+                out NormalizedName);
+        }
+        /// <summary>
         /// Overwrites a file.
         /// </summary>
         /// <param name="FileNode">
@@ -692,6 +755,38 @@ namespace Fsp
             return STATUS_INVALID_DEVICE_REQUEST;
         }
         /// <summary>
+        /// Gets file or directory security descriptor without allocating.
+        /// </summary>
+        /// <remarks>
+        /// This is the operation that the FileSystemHost calls. The base implementation
+        /// calls the GetSecurity overload above.
+        /// </remarks>
+        /// <param name="FileNode">
+        /// The file node of the file or directory to get the security descriptor for.
+        /// </param>
+        /// <param name="FileDesc">
+        /// The file descriptor of the file or directory to get the security descriptor for.
+        /// </param>
+        /// <param name="SecurityDescriptor">
+        /// Receives the file security descriptor.
+        /// </param>
+        /// <returns>STATUS_SUCCESS or error code.</returns>
+        public virtual Int32 GetSecurity(
+            Object FileNode,
+            Object FileDesc,
+            SecurityDescriptorBuffer SecurityDescriptor)
+        {
+            Byte[] SecurityDescriptorBytes = FileSystemHost.ByteBufferNotNull;
+            Int32 Result;
+            Result = GetSecurity(
+                FileNode,
+                FileDesc,
+                ref SecurityDescriptorBytes);
+            if (0 <= Result)
+                Result = SecurityDescriptor.Set(SecurityDescriptorBytes);
+            return Result;
+        }
+        /// <summary>
         /// Sets file or directory security descriptor.
         /// </summary>
         /// <param name="FileNode">
@@ -733,6 +828,41 @@ namespace Fsp
                 out BytesTransferred);
         }
         /// <summary>
+        /// Reads a directory without allocating.
+        /// </summary>
+        /// <remarks>
+        /// This is the operation that the FileSystemHost calls. The base implementation
+        /// creates Strings from Pattern and Marker and calls the ReadDirectory overload above.
+        /// File systems that override this overload add their directory entries directly
+        /// to Buffer and call Buffer.End when there are no more entries.
+        /// </remarks>
+        /// <param name="FileNode">
+        /// The file node of the directory to be read.
+        /// </param>
+        /// <param name="FileDesc">
+        /// The file descriptor of the directory to be read.
+        /// </param>
+        /// <param name="Pattern">
+        /// The pattern to match against files in this directory. Can be null.
+        /// </param>
+        /// <param name="Marker">
+        /// A file name that marks where in the directory to start reading. Can be null.
+        /// </param>
+        /// <param name="Buffer">
+        /// The buffer that receives the directory entries.
+        /// </param>
+        /// <returns>STATUS_SUCCESS or error code.</returns>
+        public virtual Int32 ReadDirectory(
+            Object FileNode,
+            Object FileDesc,
+            NativeString Pattern,
+            NativeString Marker,
+            ref DirInfoBuffer Buffer)
+        {
+            return ReadDirectory(FileNode, FileDesc, Pattern.ToString(), Marker.ToString(),
+                Buffer._Buffer, Buffer._Length, out Buffer._BytesTransferred);
+        }
+        /// <summary>
         /// Reads a directory entry.
         /// </summary>
         /// <param name="FileNode">
@@ -761,7 +891,7 @@ namespace Fsp
         /// Receives the file information for the directory entry.
         /// </param>
         /// <returns>True if there are additional directory entries to return. False otherwise.</returns>
-        /// <seealso cref="ReadDirectory"/>
+        /// <seealso cref="ReadDirectory(Object, Object, String, String, IntPtr, UInt32, out UInt32)"/>
         public virtual Boolean ReadDirectoryEntry(
             Object FileNode,
             Object FileDesc,
@@ -1336,17 +1466,19 @@ namespace Fsp
         {
             Object Context = null;
             String FileName;
-            DirInfo DirInfo = default(DirInfo);
-            BytesTransferred = default(UInt32);
+            FileInfo FileInfo;
+            DirInfoBuffer DirInfoBuffer = new DirInfoBuffer(Buffer, Length);
             while (ReadDirectoryEntry(FileNode, FileDesc, Pattern, Marker,
-                ref Context, out FileName, out DirInfo.FileInfo))
+                ref Context, out FileName, out FileInfo))
             {
-                DirInfo.SetFileNameBuf(FileName);
-                if (!Api.FspFileSystemAddDirInfo(ref DirInfo, Buffer, Length,
-                    out BytesTransferred))
+                if (!DirInfoBuffer.Add(FileName, ref FileInfo))
+                {
+                    BytesTransferred = DirInfoBuffer.BytesTransferred;
                     return STATUS_SUCCESS;
+                }
             }
-            Api.FspFileSystemEndDirInfo(Buffer, Length, out BytesTransferred);
+            DirInfoBuffer.End();
+            BytesTransferred = DirInfoBuffer.BytesTransferred;
             return STATUS_SUCCESS;
         }
         public Int32 BufferedReadDirectory(
@@ -1404,7 +1536,7 @@ namespace Fsp
         /// Receives the index of the first reparse point within FileName.
         /// </param>
         /// <returns>True if a reparse point was found, false otherwise.</returns>
-        /// <seealso cref="GetSecurityByName"/>
+        /// <seealso cref="GetSecurityByName(String, out UInt32, ref Byte[])"/>
         public Boolean FindReparsePoint(
             String FileName,
             out UInt32 ReparsePointIndex)
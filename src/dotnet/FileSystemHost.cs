@@ -207,6 +207,24 @@ namespace Fsp
             }
         }
         /// <summary>
+        /// Gets or sets the size above which non-cached reads are split into chunks
+        /// that may be serviced concurrently (0 disables splitting).
+        /// </summary>
+        public UInt32 ReadSplitSize
+        {
+            get { return _VolumeParams.ReadSplitSize; }
+            set { _VolumeParams.ReadSplitSize = value; }
+        }
+        /// <summary>
+        /// Gets or sets the time (in milliseconds) that the FSD remembers names that
+        /// were not found by the file system (0 disables negative lookup caching).
+        /// </summary>
+        public UInt32 NegativeLookupTimeout
+        {
+            get { return _VolumeParams.NegativeLookupTimeout; }
+            set { _VolumeParams.NegativeLookupTimeout = value; }
+        }
+        /// <summary>
         /// Gets or sets a value that determines whether the file system is case sensitive.
         /// </summary>
         public Boolean CaseSensitiveSearch
@@ -663,7 +681,7 @@ namespace Fsp
         }
 
         /* FSP_FILE_SYSTEM_INTERFACE */
-        private static Byte[] ByteBufferNotNull = new Byte[0];
+        internal static Byte[] ByteBufferNotNull = new Byte[0];
         private static Int32 ExceptionHandler(
             FileSystemBase FileSystem,
             Exception ex)
@@ -713,7 +731,7 @@ namespace Fsp
         }
         private static Int32 GetSecurityByName(
             IntPtr FileSystemPtr,
-            String FileName,
+            IntPtr FileName,
             IntPtr PFileAttributes/* or ReparsePointIndex */,
             IntPtr SecurityDescriptor,
             IntPtr PSecurityDescriptorSize)
@@ -722,20 +740,15 @@ namespace Fsp
             try
             {
                 UInt32 FileAttributes;
-                Byte[] SecurityDescriptorBytes = null;
                 Int32 Result;
-                if (IntPtr.Zero != PSecurityDescriptorSize)
-                    SecurityDescriptorBytes = ByteBufferNotNull;
                 Result = FileSystem.GetSecurityByName(
-                    FileName,
+                    new NativeString(FileName),
                     out FileAttributes,
-                    ref SecurityDescriptorBytes);
+                    new SecurityDescriptorBuffer(SecurityDescriptor, PSecurityDescriptorSize));
                 if (0 <= Result && 260/*STATUS_REPARSE*/ != Result)
                 {
                     if (IntPtr.Zero != PFileAttributes)
                         Marshal.WriteInt32(PFileAttributes, (Int32)FileAttributes);
-                    Result = Api.CopySecurityDescriptor(SecurityDescriptorBytes,
-                        SecurityDescriptor, PSecurityDescriptorSize);
                 }
                 return Result;
             }
@@ -793,7 +806,7 @@ namespace Fsp
         }
         private static Int32 Open(
             IntPtr FileSystemPtr,
-            String FileName,
+            IntPtr FileName,
             UInt32 CreateOptions,
             UInt32 GrantedAccess,
             ref FullContext FullContext,
@@ -806,7 +819,7 @@ namespace Fsp
                 String NormalizedName;
                 Int32 Result;
                 Result = FileSystem.Open(
-                    FileName,
+                    new NativeString(FileName),
                     CreateOptions,
                     GrantedAccess,
                     out FileNode,
@@ -1091,18 +1104,11 @@ namespace Fsp
             try
             {
                 Object FileNode, FileDesc;
-                Byte[] SecurityDescriptorBytes;
-                Int32 Result;
                 Api.GetFullContext(ref FullContext, out FileNode, out FileDesc);
-                SecurityDescriptorBytes = ByteBufferNotNull;
-                Result = FileSystem.GetSecurity(
+                return FileSystem.GetSecurity(
                     FileNode,
                     FileDesc,
-                    ref SecurityDescriptorBytes);
-                if (0 <= Result)
-                    Result = Api.CopySecurityDescriptor(SecurityDescriptorBytes,
-                        SecurityDescriptor, PSecurityDescriptorSize);
-                return Result;
+                    new SecurityDescriptorBuffer(SecurityDescriptor, PSecurityDescriptorSize));
             }
             catch (Exception ex)
             {
@@ -1144,8 +1150,8 @@ namespace Fsp
         private static Int32 ReadDirectory(
             IntPtr FileSystemPtr,
             ref FullContext FullContext,
-            String Pattern,
-            String Marker,
+            IntPtr Pattern,
+            IntPtr Marker,
             IntPtr Buffer,
             UInt32 Length,
             out UInt32 PBytesTransferred)
@@ -1154,15 +1160,17 @@ namespace Fsp
             try
             {
                 Object FileNode, FileDesc;
+                DirInfoBuffer DirInfoBuffer = new DirInfoBuffer(Buffer, Length);
+                Int32 Result;
                 Api.GetFullContext(ref FullContext, out FileNode, out FileDesc);
-                return FileSystem.ReadDirectory(
+                Result = FileSystem.ReadDirectory(
                     FileNode,
                     FileDesc,
-                    Pattern,
-                    Marker,
-                    Buffer,
-                    Length,
-                    out PBytesTransferred);
+                    new NativeString(Pattern),
+                    new NativeString(Marker),
+                    ref DirInfoBuffer);
+                PBytesTransferred = DirInfoBuffer.BytesTransferred;
+                return Result;
             }
             catch (Exception ex)
             {
@@ -86,8 +86,10 @@ namespace Fsp.Interop
         internal UInt32 StreamInfoTimeout;
         internal UInt32 EaTimeout;
         internal UInt32 FsextControlCode;
+        internal UInt32 ReadSplitSize;
+        internal UInt32 NegativeLookupTimeout;
         internal unsafe fixed UInt32 Reserved32[1];
-        internal unsafe fixed UInt64 Reserved64[2];
+        internal unsafe fixed UInt64 Reserved64[1];
 
         internal unsafe String GetPrefix()
         {
@@ -285,6 +287,271 @@ namespace Fsp.Interop
         }
     }
 
+    /// <summary>
+    /// Refers to a string that is owned by the native layer.
+    /// </summary>
+    /// <remarks>
+    /// A NativeString is valid only for the duration of the operation that receives it
+    /// and must not be stored. Use ToString to get a String that can be stored.
+    /// </remarks>
+    public unsafe struct NativeString
+    {
+        internal NativeString(IntPtr Value)
+        {
+            _Buffer = (Char *)Value;
+            _Length = 0;
+            if (null != _Buffer)
+                while (0 != _Buffer[_Length])
+                    _Length++;
+        }
+
+        /// <summary>
+        /// True if there is no string (as opposed to an empty string).
+        /// </summary>
+        public Boolean IsNull
+        {
+            get { return null == _Buffer; }
+        }
+        /// <summary>
+        /// The number of characters in the string.
+        /// </summary>
+        public Int32 Length
+        {
+            get { return _Length; }
+        }
+        /// <summary>
+        /// Gets the character at the specified index.
+        /// </summary>
+        public Char this[Int32 Index]
+        {
+            get
+            {
+                if ((UInt32)_Length <= (UInt32)Index)
+                    throw new IndexOutOfRangeException();
+                return _Buffer[Index];
+            }
+        }
+        /// <summary>
+        /// Compares the string with a String using ordinal comparison.
+        /// </summary>
+        /// <returns>
+        /// Less than zero, zero or greater than zero if the string is respectively less than,
+        /// equal to or greater than Value. A null string is less than any other string.
+        /// </returns>
+        public Int32 CompareTo(String Value, Boolean IgnoreCase)
+        {
+            if (null == _Buffer || null == Value)
+                return (null != _Buffer ? 1 : 0) - (null != Value ? 1 : 0);
+            int Length = Math.Min(_Length, Value.Length);
+            for (int I = 0; Length > I; I++)
+            {
+                Char C1 = _Buffer[I], C2 = Value[I];
+                if (IgnoreCase)
+                {
+                    C1 = Char.ToUpperInvariant(C1);
+                    C2 = Char.ToUpperInvariant(C2);
+                }
+                if (C1 != C2)
+                    return C1 - C2;
+            }
+            return _Length - Value.Length;
+        }
+        /// <summary>
+        /// Determines whether the string is equal to a String using ordinal comparison.
+        /// </summary>
+        public Boolean Equals(String Value, Boolean IgnoreCase)
+        {
+            if (null == _Buffer || null == Value)
+                return (null == _Buffer) == (null == Value);
+            return _Length == Value.Length && 0 == CompareTo(Value, IgnoreCase);
+        }
+        /// <summary>
+        /// Creates a String with the contents of the string or null if there is no string.
+        /// </summary>
+        public override String ToString()
+        {
+            return null != _Buffer ? new String(_Buffer, 0, _Length) : null;
+        }
+
+        private Char *_Buffer;
+        private Int32 _Length;
+    }
+
+    /// <summary>
+    /// Receives a security descriptor into the buffer supplied by the native layer.
+    /// </summary>
+    /// <remarks>
+    /// A SecurityDescriptorBuffer is valid only for the duration of the operation that
+    /// receives it and must not be stored.
+    /// </remarks>
+    public unsafe struct SecurityDescriptorBuffer
+    {
+        internal SecurityDescriptorBuffer(IntPtr SecurityDescriptor, IntPtr PSecurityDescriptorSize)
+        {
+            _SecurityDescriptor = SecurityDescriptor;
+            _PSecurityDescriptorSize = PSecurityDescriptorSize;
+        }
+
+        /// <summary>
+        /// True if the operation requests a security descriptor.
+        /// </summary>
+        public Boolean IsRequested
+        {
+            get { return IntPtr.Zero != _PSecurityDescriptorSize; }
+        }
+        /// <summary>
+        /// Sets the security descriptor.
+        /// </summary>
+        /// <param name="SecurityDescriptor">
+        /// The security descriptor in self-relative format. Can be null.
+        /// </param>
+        /// <returns>STATUS_SUCCESS or STATUS_BUFFER_OVERFLOW.</returns>
+        public Int32 Set(Byte[] SecurityDescriptor)
+        {
+            return Set(SecurityDescriptor, null != SecurityDescriptor ? SecurityDescriptor.Length : 0);
+        }
+        /// <summary>
+        /// Sets the security descriptor from the initial part of an array.
+        /// </summary>
+        /// <param name="SecurityDescriptor">
+        /// The security descriptor in self-relative format. Can be null.
+        /// </param>
+        /// <param name="Length">
+        /// The length of the security descriptor within the array.
+        /// </param>
+        /// <returns>STATUS_SUCCESS or STATUS_BUFFER_OVERFLOW.</returns>
+        public Int32 Set(Byte[] SecurityDescriptor, Int32 Length)
+        {
+            if (IntPtr.Zero != _PSecurityDescriptorSize)
+            {
+                if (null != SecurityDescriptor)
+                {
+                    if ((UInt32)SecurityDescriptor.Length < (UInt32)Length)
+                        throw new ArgumentOutOfRangeException("Length");
+                    if (Length > (int)*(IntPtr *)_PSecurityDescriptorSize)
+                    {
+                        *(IntPtr *)_PSecurityDescriptorSize = (IntPtr)Length;
+                        return unchecked((Int32)0x80000005)/*STATUS_BUFFER_OVERFLOW*/;
+                    }
+                    *(IntPtr *)_PSecurityDescriptorSize = (IntPtr)Length;
+                    if (IntPtr.Zero != _SecurityDescriptor)
+                        Marshal.Copy(SecurityDescriptor, 0, _SecurityDescriptor, Length);
+                }
+                else
+                    *(IntPtr *)_PSecurityDescriptorSize = IntPtr.Zero;
+            }
+            return 0/*STATUS_SUCCESS*/;
+        }
+        /// <summary>
+        /// Sets the security descriptor from a GenericSecurityDescriptor.
+        /// </summary>
+        /// <remarks>
+        /// The binary form of the security descriptor is produced in a per-thread buffer
+        /// that is reused across operations.
+        /// </remarks>
+        /// <returns>STATUS_SUCCESS or STATUS_BUFFER_OVERFLOW.</returns>
+        public Int32 Set(GenericSecurityDescriptor SecurityDescriptor)
+        {
+            if (null == SecurityDescriptor || IntPtr.Zero == _PSecurityDescriptorSize)
+                return Set(null, 0);
+            int Length = SecurityDescriptor.BinaryLength;
+            if (null == _PooledBuffer || _PooledBuffer.Length < Length)
+                _PooledBuffer = new Byte[Math.Max(Length, 1024)];
+            SecurityDescriptor.GetBinaryForm(_PooledBuffer, 0);
+            return Set(_PooledBuffer, Length);
+        }
+
+        [ThreadStatic]
+        private static Byte[] _PooledBuffer;
+        private IntPtr _SecurityDescriptor;
+        private IntPtr _PSecurityDescriptorSize;
+    }
+
+    /// <summary>
+    /// Fills the buffer of a ReadDirectory operation with directory entries.
+    /// </summary>
+    /// <remarks>
+    /// Entries are written directly into the buffer supplied by the native layer
+    /// in the same format that the native FspFileSystemAddDirInfo uses.
+    /// A DirInfoBuffer is valid only for the duration of the operation that receives it
+    /// and must not be stored.
+    /// </remarks>
+    public unsafe struct DirInfoBuffer
+    {
+        internal DirInfoBuffer(IntPtr Buffer, UInt32 Length)
+        {
+            _Buffer = Buffer;
+            _Length = Length;
+            _BytesTransferred = 0;
+        }
+
+        /// <summary>
+        /// The number of bytes filled so far.
+        /// </summary>
+        public UInt32 BytesTransferred
+        {
+            get { return _BytesTransferred; }
+        }
+        /// <summary>
+        /// Adds a directory entry.
+        /// </summary>
+        /// <returns>True if the entry was added. False if the buffer is full.</returns>
+        public Boolean Add(String FileName, ref FileInfo FileInfo)
+        {
+            fixed (Char *P = FileName)
+                return Add(P, null != FileName ? FileName.Length : 0, ref FileInfo);
+        }
+        /// <summary>
+        /// Adds a directory entry whose name is part of a character array.
+        /// </summary>
+        /// <returns>True if the entry was added. False if the buffer is full.</returns>
+        public Boolean Add(Char[] FileName, Int32 Index, Int32 Count, ref FileInfo FileInfo)
+        {
+            if (0 > Index || 0 > Count || FileName.Length - Index < Count)
+                throw new ArgumentOutOfRangeException();
+            fixed (Char *P = FileName)
+                return Add(P + Index, Count, ref FileInfo);
+        }
+        /// <summary>
+        /// Marks the end of the directory listing.
+        /// </summary>
+        /// <remarks>
+        /// This must be called when there are no more directory entries to add.
+        /// </remarks>
+        /// <returns>True if the end marker was added. False if the buffer is full.</returns>
+        public Boolean End()
+        {
+            if (_BytesTransferred + sizeof(UInt16) > _Length)
+                return false;
+            *(UInt16 *)((Byte *)_Buffer + _BytesTransferred) = 0;
+            _BytesTransferred += sizeof(UInt16);
+            return true;
+        }
+
+        private Boolean Add(Char *FileName, Int32 Count, ref FileInfo FileInfo)
+        {
+            if (Count > DirInfo.FileNameBufSize)
+                Count = DirInfo.FileNameBufSize;
+            UInt32 Size = (UInt32)(DirInfo.FileNameBufOffset + Count * 2);
+            UInt32 AlignedSize = (Size + 7) & ~7U; // align to next qword boundary
+            if (_BytesTransferred + AlignedSize > _Length)
+                return false;
+            DirInfo *P = (DirInfo *)((Byte *)_Buffer + _BytesTransferred);
+            P->Size = (UInt16)Size;
+            P->FileInfo = FileInfo;
+            for (int I = 0; 24 > I; I++)
+                P->Padding[I] = 0;
+            for (int I = 0; Count > I; I++)
+                P->FileNameBuf[I] = FileName[I];
+            _BytesTransferred += AlignedSize;
+            return true;
+        }
+
+        internal IntPtr _Buffer;
+        internal UInt32 _Length;
+        internal UInt32 _BytesTransferred;
+    }
+
     [StructLayout(LayoutKind.Sequential)]
     internal struct StreamInfo
     {
@@ -528,7 +795,7 @@ namespace Fsp.Interop
             [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
             internal delegate Int32 GetSecurityByName(
                 IntPtr FileSystem,
-                [MarshalAs(UnmanagedType.LPWStr)] String FileName,
+                IntPtr FileName,
                 IntPtr PFileAttributes/* or ReparsePointIndex */,
                 IntPtr SecurityDescriptor,
                 IntPtr PSecurityDescriptorSize);
@@ -546,7 +813,7 @@ namespace Fsp.Interop
             [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
             internal delegate Int32 Open(
                 IntPtr FileSystem,
-                [MarshalAs(UnmanagedType.LPWStr)] String FileName,
+                IntPtr FileName,
                 UInt32 CreateOptions,
                 UInt32 GrantedAccess,
                 ref FullContext FullContext,
@@ -643,8 +910,8 @@ namespace Fsp.Interop
             internal delegate Int32 ReadDirectory(
                 IntPtr FileSystem,
                 ref FullContext FullContext,
-                [MarshalAs(UnmanagedType.LPWStr)] String Pattern,
-                [MarshalAs(UnmanagedType.LPWStr)] String Marker,
+                IntPtr Pattern,
+                IntPtr Marker,
                 IntPtr Buffer,
                 UInt32 Length,
                 out UInt32 PBytesTransferred);
@@ -1293,29 +1560,13 @@ namespace Fsp.Interop
             }
         }
 
-        internal unsafe static Int32 CopySecurityDescriptor(
+        internal static Int32 CopySecurityDescriptor(
             Byte[] SecurityDescriptorBytes,
             IntPtr SecurityDescriptor,
             IntPtr PSecurityDescriptorSize)
         {
-            if (IntPtr.Zero != PSecurityDescriptorSize)
-            {
-                if (null != SecurityDescriptorBytes)
-                {
-                    if (SecurityDescriptorBytes.Length > (int)*(IntPtr *)PSecurityDescriptorSize)
-                    {
-                        *(IntPtr *)PSecurityDescriptorSize = (IntPtr)SecurityDescriptorBytes.Length;
-                        return unchecked((Int32)0x80000005)/*STATUS_BUFFER_OVERFLOW*/;
-                    }
-                    *(IntPtr *)PSecurityDescriptorSize = (IntPtr)SecurityDescriptorBytes.Length;
-                    if (IntPtr.Zero != SecurityDescriptor)
-                        Marshal.Copy(SecurityDescriptorBytes, 0,
-                            SecurityDescriptor, SecurityDescriptorBytes.Length);
-                }
-                else
-                    *(IntPtr *)PSecurityDescriptorSize = IntPtr.Zero;
-            }
-            return 0/*STATUS_SUCCESS*/;
+            return new SecurityDescriptorBuffer(SecurityDescriptor, PSecurityDescriptorSize).Set(
+                SecurityDescriptorBytes);
         }
         internal static Byte[] MakeSecurityDescriptor(
             IntPtr SecurityDescriptor)
@@ -65,6 +65,8 @@ static void usage(void)
         "    id [NAME|SID|UID]               print user id\n"
         "    perm [PATH|SDDL|UID:GID:MODE]   print permissions\n"
         "    lsdrv                           list drivers\n"
+        "    trace [-t] FILE                 decode binary trace file (-t: timestamps)\n"
+        "    opstat VOLUME|X:                print per-operation latency statistics\n"
         "    load                            load driver\n"
         "    unload                          unload driver (requires load driver priv)\n"
         "    ver                             print version\n",
@@ -612,6 +614,117 @@ static int unload(int argc, wchar_t **argv)
     return 0;
 }
 
+static int trace(int argc, wchar_t **argv)
+{
+    if (2 != argc && 3 != argc)
+        usage();
+
+    ULONG Flags = 0;
+    HANDLE Handle;
+    NTSTATUS Result;
+
+    if (3 == argc)
+    {
+        if (0 != invariant_wcscmp(L"-t", argv[1]))
+            usage();
+        Flags |= FspDebugLogDecodeTimestamps;
+    }
+
+    Handle = CreateFileW(argv[argc - 1],
+        FILE_READ_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_EXISTING, 0, 0);
+    if (INVALID_HANDLE_VALUE == Handle)
+        return GetLastError();
+
+    FspDebugLogSetHandle(GetStdHandle(STD_OUTPUT_HANDLE));
+    Result = FspDebugLogDecodeTrace(Handle, Flags);
+
+    CloseHandle(Handle);
+
+    return FspWin32FromNtStatus(Result);
+}
+
+static PSTR opstat_kind_names[] =
+{
+    "Reserved",
+    "Create",
+    "Overwrite",
+    "Cleanup",
+    "Close",
+    "Read",
+    "Write",
+    "QueryInformation",
+    "SetInformation",
+    "QueryEa",
+    "SetEa",
+    "FlushBuffers",
+    "QueryVolumeInformation",
+    "SetVolumeInformation",
+    "QueryDirectory",
+    "FileSystemControl",
+    "DeviceControl",
+    "Shutdown",
+    "LockControl",
+    "QuerySecurity",
+    "SetSecurity",
+    "QueryStreamInformation",
+};
+
+static ULONG opstat_percentile(FSP_FILE_SYSTEM_OPERATION_STATISTICS *Statistics, ULONG Percent)
+{
+    UINT64 Threshold, Count;
+    ULONG I;
+
+    /* return the upper bound (in us) of the histogram bucket that contains the percentile */
+    Threshold = (Statistics->Count * Percent + 99) / 100;
+    Count = 0;
+    for (I = 0; FSP_FILE_SYSTEM_OPERATION_HISTOGRAM_COUNT - 1 > I; I++)
+    {
+        Count += Statistics->Histogram[I];
+        if (Count >= Threshold)
+            break;
+    }
+
+    return 1 << I;
+}
+
+static int opstat(int argc, wchar_t **argv)
+{
+    if (2 != argc)
+        usage();
+
+    FSP_FILE_SYSTEM_OPERATION_STATISTICS Statistics[FspFsctlTransactKindCount];
+    WCHAR VolumeNameBuf[MAX_PATH];
+    PWSTR VolumeName = argv[1];
+    NTSTATUS Result;
+
+    if (L'\0' != VolumeName[0] && L':' == VolumeName[1] && L'\0' == VolumeName[2])
+    {
+        if (!QueryDosDeviceW(VolumeName, VolumeNameBuf, sizeof VolumeNameBuf / sizeof(WCHAR)))
+            return GetLastError();
+        VolumeName = VolumeNameBuf;
+    }
+
+    Result = FspFileSystemGetVolumeOperationStatistics(VolumeName,
+        Statistics, FspFsctlTransactKindCount);
+    if (!NT_SUCCESS(Result))
+        return FspWin32FromNtStatus(Result);
+
+    info("%-24s %10s %8s %10s %10s %10s %10s",
+        "OPERATION", "COUNT", "ERRORS", "AVG(us)", "MAX(us)", "P50(us)", "P99(us)");
+    for (ULONG Kind = 1; FspFsctlTransactKindCount > Kind; Kind++)
+        if (0 != Statistics[Kind].Count)
+            info("%-24s %10I64u %8I64u %10I64u %10I64u %10u %10u",
+                opstat_kind_names[Kind],
+                Statistics[Kind].Count,
+                Statistics[Kind].ErrorCount,
+                Statistics[Kind].TotalTime / Statistics[Kind].Count / 10,
+                Statistics[Kind].MaxTime / 10,
+                opstat_percentile(&Statistics[Kind], 50),
+                opstat_percentile(&Statistics[Kind], 99));
+
+    return 0;
+}
+
 int wmain(int argc, wchar_t **argv)
 {
     argc--;
@@ -640,6 +753,12 @@ int wmain(int argc, wchar_t **argv)
     else
     if (0 == invariant_wcscmp(L"unload", argv[0]))
         return unload(argc, argv);
+    else
+    if (0 == invariant_wcscmp(L"trace", argv[0]))
+        return trace(argc, argv);
+    else
+    if (0 == invariant_wcscmp(L"opstat", argv[0]))
+        return opstat(argc, argv);
     else
         usage();
 
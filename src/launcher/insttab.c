@@ -0,0 +1,143 @@
+/**
+ * @file launcher/insttab.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <launcher/insttab.h>
+#include <shared/um/minimal.h>
+
+#define SvcInstanceTableInitialBucketCount 64
+#define SvcInstanceTableMaximumBucketCount (1024 * 1024)
+
+static inline ULONG SvcInstanceTableHashString(ULONG Hash, PWSTR String)
+{
+    /* FNV-1a over the upper-cased UTF-16 code units */
+    for (PWSTR P = String; *P; P++)
+        Hash = (Hash ^ invariant_toupper(*P)) * 16777619;
+    return Hash;
+}
+
+static inline ULONG SvcInstanceTableHash(PWSTR ClassName, PWSTR InstanceName)
+{
+    ULONG Hash = 2166136261;
+    Hash = SvcInstanceTableHashString(Hash, ClassName);
+    Hash = (Hash ^ L'\\') * 16777619;
+    Hash = SvcInstanceTableHashString(Hash, InstanceName);
+    return Hash;
+}
+
+static VOID SvcInstanceTableGrow(SVC_INSTANCE_TABLE *Table)
+{
+    SVC_INSTANCE_TABLE_ENTRY **NewBuckets, *Entry, *HashNext;
+    ULONG NewBucketCount, Index;
+
+    if (SvcInstanceTableMaximumBucketCount <= Table->BucketCount)
+        return;
+
+    NewBucketCount = Table->BucketCount * 2;
+    NewBuckets = MemAlloc(NewBucketCount * sizeof NewBuckets[0]);
+    if (0 == NewBuckets)
+        return; /* not an error; the table simply has longer chains */
+    memset(NewBuckets, 0, NewBucketCount * sizeof NewBuckets[0]);
+
+    for (ULONG I = 0; Table->BucketCount > I; I++)
+        for (Entry = Table->Buckets[I]; 0 != Entry; Entry = HashNext)
+        {
+            HashNext = Entry->HashNext;
+            Index = Entry->Hash & (NewBucketCount - 1);
+            Entry->HashNext = NewBuckets[Index];
+            NewBuckets[Index] = Entry;
+        }
+
+    MemFree(Table->Buckets);
+    Table->Buckets = NewBuckets;
+    Table->BucketCount = NewBucketCount;
+}
+
+NTSTATUS SvcInstanceTableInitialize(SVC_INSTANCE_TABLE *Table)
+{
+    memset(Table, 0, sizeof *Table);
+
+    Table->Buckets = MemAlloc(SvcInstanceTableInitialBucketCount * sizeof Table->Buckets[0]);
+    if (0 == Table->Buckets)
+        return STATUS_INSUFFICIENT_RESOURCES;
+    memset(Table->Buckets, 0, SvcInstanceTableInitialBucketCount * sizeof Table->Buckets[0]);
+    Table->BucketCount = SvcInstanceTableInitialBucketCount;
+
+    return STATUS_SUCCESS;
+}
+
+VOID SvcInstanceTableFinalize(SVC_INSTANCE_TABLE *Table)
+{
+    MemFree(Table->Buckets);
+    memset(Table, 0, sizeof *Table);
+}
+
+SVC_INSTANCE_TABLE_ENTRY *SvcInstanceTableLookup(SVC_INSTANCE_TABLE *Table,
+    PWSTR ClassName, PWSTR InstanceName)
+{
+    ULONG Hash = SvcInstanceTableHash(ClassName, InstanceName);
+    SVC_INSTANCE_TABLE_ENTRY *Entry;
+
+    for (Entry = Table->Buckets[Hash & (Table->BucketCount - 1)]; 0 != Entry; Entry = Entry->HashNext)
+        if (Hash == Entry->Hash &&
+            0 == invariant_wcsicmp(ClassName, Entry->ClassName) &&
+            0 == invariant_wcsicmp(InstanceName, Entry->InstanceName))
+            return Entry;
+
+    return 0;
+}
+
+BOOLEAN SvcInstanceTableInsert(SVC_INSTANCE_TABLE *Table,
+    SVC_INSTANCE_TABLE_ENTRY *Entry, PWSTR ClassName, PWSTR InstanceName)
+{
+    ULONG Index;
+
+    if (0 != SvcInstanceTableLookup(Table, ClassName, InstanceName))
+        return FALSE;
+
+    if (Table->Count >= Table->BucketCount * 2)
+        SvcInstanceTableGrow(Table);
+
+    Entry->ClassName = ClassName;
+    Entry->InstanceName = InstanceName;
+    Entry->Hash = SvcInstanceTableHash(ClassName, InstanceName);
+
+    Index = Entry->Hash & (Table->BucketCount - 1);
+    Entry->HashNext = Table->Buckets[Index];
+    Table->Buckets[Index] = Entry;
+    Table->Count++;
+
+    return TRUE;
+}
+
+VOID SvcInstanceTableRemove(SVC_INSTANCE_TABLE *Table,
+    SVC_INSTANCE_TABLE_ENTRY *Entry)
+{
+    SVC_INSTANCE_TABLE_ENTRY **P;
+
+    for (P = &Table->Buckets[Entry->Hash & (Table->BucketCount - 1)]; 0 != *P; P = &(*P)->HashNext)
+        if (Entry == *P)
+        {
+            *P = Entry->HashNext;
+            Entry->HashNext = 0;
+            Table->Count--;
+            break;
+        }
+}
@@ -0,0 +1,64 @@
+/**
+ * @file launcher/insttab.h
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#ifndef WINFSP_LAUNCHER_INSTTAB_H_INCLUDED
+#define WINFSP_LAUNCHER_INSTTAB_H_INCLUDED
+
+#include <winfsp/launch.h>
+
+/*
+ * Instance Table
+ *
+ * A hash table of launcher instances keyed by class name and instance name. Names are
+ * compared case-insensitively (invariant culture), like the launcher always has.
+ *
+ * Entries are intrusive: an SVC_INSTANCE_TABLE_ENTRY is embedded in the instance and
+ * its ClassName and InstanceName must remain valid while the entry is in the table.
+ * The table grows (rehashes) as entries are inserted; it never shrinks.
+ *
+ * The table is not synchronized; callers must provide their own locking.
+ */
+
+typedef struct _SVC_INSTANCE_TABLE_ENTRY
+{
+    struct _SVC_INSTANCE_TABLE_ENTRY *HashNext;
+    PWSTR ClassName;
+    PWSTR InstanceName;
+    ULONG Hash;
+} SVC_INSTANCE_TABLE_ENTRY;
+
+typedef struct
+{
+    SVC_INSTANCE_TABLE_ENTRY **Buckets;
+    ULONG BucketCount;                  /* power of 2 */
+    ULONG Count;
+} SVC_INSTANCE_TABLE;
+
+NTSTATUS SvcInstanceTableInitialize(SVC_INSTANCE_TABLE *Table);
+VOID SvcInstanceTableFinalize(SVC_INSTANCE_TABLE *Table);
+SVC_INSTANCE_TABLE_ENTRY *SvcInstanceTableLookup(SVC_INSTANCE_TABLE *Table,
+    PWSTR ClassName, PWSTR InstanceName);
+BOOLEAN SvcInstanceTableInsert(SVC_INSTANCE_TABLE *Table,
+    SVC_INSTANCE_TABLE_ENTRY *Entry, PWSTR ClassName, PWSTR InstanceName);
+VOID SvcInstanceTableRemove(SVC_INSTANCE_TABLE *Table,
+    SVC_INSTANCE_TABLE_ENTRY *Entry);
+
+#endif
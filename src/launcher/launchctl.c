@@ -63,7 +63,8 @@ static void usage(void)
         "    startWithSecret     ClassName InstanceName Args... Secret\n"
         "    stop                ClassName InstanceName\n"
         "    info                ClassName InstanceName\n"
-        "    list\n",
+        "    list\n"
+        "    reload\n",
         PROGNAME);
 }
 
@@ -202,6 +203,19 @@ int list(PWSTR PipeBuf, ULONG PipeBufSize)
     return call_pipe_and_report(PipeBuf, (ULONG)((P - PipeBuf) * sizeof(WCHAR)), PipeBufSize);
 }
 
+int reload(PWSTR PipeBuf, ULONG PipeBufSize)
+{
+    PWSTR P;
+
+    if (PipeBufSize < 1 * sizeof(WCHAR))
+        return ERROR_INVALID_PARAMETER;
+
+    P = PipeBuf;
+    *P++ = FspLaunchCmdReload;
+
+    return call_pipe_and_report(PipeBuf, (ULONG)((P - PipeBuf) * sizeof(WCHAR)), PipeBufSize);
+}
+
 int quit(PWSTR PipeBuf, ULONG PipeBufSize)
 {
     /* works only against DEBUG version of launcher */
@@ -274,6 +288,14 @@ int wmain(int argc, wchar_t **argv)
         return list(PipeBuf, FSP_LAUNCH_PIPE_BUFFER_SIZE);
     }
     else
+    if (0 == invariant_wcscmp(L"reload", argv[0]))
+    {
+        if (1 != argc)
+            usage();
+
+        return reload(PipeBuf, FSP_LAUNCH_PIPE_BUFFER_SIZE);
+    }
+    else
     if (0 == invariant_wcscmp(L"quit", argv[0]))
     {
         if (1 != argc)
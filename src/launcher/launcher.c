@@ -21,6 +21,8 @@
 
 #include <winfsp/launch.h>
 #include <shared/um/minimal.h>
+#include <launcher/insttab.h>
+#include <launcher/regrec.h>
 #include <aclapi.h>
 #include <sddl.h>
 #include <userenv.h>
@@ -451,11 +453,13 @@ static VOID CALLBACK KillProcessWait(PVOID Context, BOOLEAN Timeout)
 #define LAUNCHER_START_WITH_SECRET_TIMEOUT 15000
 #define LAUNCHER_STOP_TIMEOUT           5500
 #define LAUNCHER_KILL_TIMEOUT           5000
+#define LAUNCHER_PIPE_WORKER_MAXIMUM    8
 
 typedef struct
 {
     LONG RefCount;
     LIST_ENTRY ListEntry;
+    SVC_INSTANCE_TABLE_ENTRY TableEntry;
     HANDLE ClientToken;
     PWSTR ClassName;
     PWSTR InstanceName;
@@ -469,7 +473,7 @@ typedef struct
     ULONG Argc;
     PWSTR *Argv;
     BOOLEAN HasSecret;
-    BOOLEAN Started, Stopped;
+    BOOLEAN Pending, Started, Stopped;
     WCHAR Buffer[];
 } SVC_INSTANCE;
 
@@ -477,6 +481,9 @@ static HANDLE SvcJob;
 static CRITICAL_SECTION SvcInstanceLock;
 static HANDLE SvcInstanceEvent;
 static LIST_ENTRY SvcInstanceList = { &SvcInstanceList, &SvcInstanceList };
+static SVC_INSTANCE_TABLE SvcInstanceTable;
+static BOOLEAN SvcInstanceStopping;
+static SVC_REG_CACHE SvcRegCache;
 
 static VOID CALLBACK SvcInstanceTerminated(PVOID Context, BOOLEAN Timeout);
 NTSTATUS SvcInstanceStart(HANDLE ClientToken,
@@ -485,147 +492,16 @@ NTSTATUS SvcInstanceStart(HANDLE ClientToken,
 
 static SVC_INSTANCE *SvcInstanceLookup(PWSTR ClassName, PWSTR InstanceName)
 {
+    SVC_INSTANCE_TABLE_ENTRY *TableEntry;
     SVC_INSTANCE *SvcInstance;
-    PLIST_ENTRY ListEntry;
-
-    for (ListEntry = SvcInstanceList.Flink;
-        &SvcInstanceList != ListEntry;
-        ListEntry = ListEntry->Flink)
-    {
-        SvcInstance = CONTAINING_RECORD(ListEntry, SVC_INSTANCE, ListEntry);
-
-        if (0 == invariant_wcsicmp(ClassName, SvcInstance->ClassName) &&
-            0 == invariant_wcsicmp(InstanceName, SvcInstance->InstanceName))
-            return SvcInstance;
-    }
-
-    return 0;
-}
-
-static inline ULONG SvcInstanceArgumentLength(PWSTR Arg, PWSTR Pattern, BOOLEAN Quote)
-{
-    PWSTR PathTransform(PWSTR Dest, PWSTR Arg, PWSTR Pattern);
-
-    return (Quote ? 2 : 0) + (ULONG)((UINT_PTR)PathTransform(0, Arg, Pattern) / sizeof(WCHAR));
-}
-
-static inline PWSTR SvcInstanceArgumentCopy(PWSTR Dest, PWSTR Arg, PWSTR Pattern, BOOLEAN Quote)
-{
-    PWSTR PathTransform(PWSTR Dest, PWSTR Arg, PWSTR Pattern);
-
-    if (Quote)
-        *Dest++ = L'"';
-    Dest = PathTransform(Dest, Arg, Pattern);
-    if (Quote)
-        *Dest++ = L'"';
-
-    return Dest;
-}
-
-static NTSTATUS SvcInstanceReplaceArguments(PWSTR String,
-    ULONG Argc, PWSTR *Argv, PWSTR *Varv, BOOLEAN Quote,
-    PWSTR *PNewString)
-{
-    PWSTR NewString = 0, P, Q;
-    PWSTR EmptyArg = L"";
-    ULONG Length;
-    PWSTR Pattern;
-
-    *PNewString = 0;
-
-    Length = 0;
-    for (P = String; *P; P++)
-    {
-        switch (*P)
-        {
-        case L'%':
-            Pattern = 0;
-            P++;
-            if (L'\\' == *P)
-            {
-                Pattern = ++P;
-                while (!(L'\0' == *P ||
-                    (L'0' <= *P && *P <= L'9') ||
-                    (L'A' <= *P && *P <= L'Z')))
-                    P++;
-            }
-            if (L'0' <= *P && *P <= L'9')
-            {
-                if (Argc > (ULONG)(*P - L'0'))
-                    Length += SvcInstanceArgumentLength(Argv[*P - L'0'], Pattern, Quote);
-                else
-                    Length += SvcInstanceArgumentLength(EmptyArg, 0, Quote);
-            }
-            else
-            if (L'A' <= *P && *P <= L'Z')
-            {
-                if (0 != Varv[*P - L'A'])
-                    Length += SvcInstanceArgumentLength(Varv[*P - L'A'], Pattern, Quote);
-                else
-                    Length += SvcInstanceArgumentLength(EmptyArg, 0, Quote);
-            }
-            else
-            if (*P)
-                Length++;
-            else
-                P--;
-            break;
-        default:
-            Length++;
-            break;
-        }
-    }
-
-    NewString = MemAlloc((Length + 1) * sizeof(WCHAR));
-    if (0 == NewString)
-        return STATUS_INSUFFICIENT_RESOURCES;
-
-    for (P = String, Q = NewString; *P; P++)
-    {
-        switch (*P)
-        {
-        case L'%':
-            Pattern = 0;
-            P++;
-            if (L'\\' == *P)
-            {
-                Pattern = ++P;
-                while (!(L'\0' == *P ||
-                    (L'0' <= *P && *P <= L'9') ||
-                    (L'A' <= *P && *P <= L'Z')))
-                    P++;
-            }
-            if (L'0' <= *P && *P <= L'9')
-            {
-                if (Argc > (ULONG)(*P - L'0'))
-                    Q = SvcInstanceArgumentCopy(Q, Argv[*P - L'0'], Pattern, Quote);
-                else
-                    Q = SvcInstanceArgumentCopy(Q, EmptyArg, 0, Quote);
-            }
-            else
-            if (L'A' <= *P && *P <= L'Z')
-            {
-                if (0 != Varv[*P - L'A'])
-                    Q = SvcInstanceArgumentCopy(Q, Varv[*P - L'A'], Pattern, Quote);
-                else
-                    Q = SvcInstanceArgumentCopy(Q, EmptyArg, 0, Quote);
-            }
-            else
-            if (*P)
-                *Q++ = *P;
-            else
-                P--;
-            break;
-        default:
-            *Q++ = *P;
-            break;
-        }
-    }
-    *Q = L'\0';
 
-    *PNewString = NewString;
+    TableEntry = SvcInstanceTableLookup(&SvcInstanceTable, ClassName, InstanceName);
+    if (0 == TableEntry)
+        return 0;
 
-    return STATUS_SUCCESS;
+    /* instances that are still being created are not visible */
+    SvcInstance = CONTAINING_RECORD(TableEntry, SVC_INSTANCE, TableEntry);
+    return !SvcInstance->Pending ? SvcInstance : 0;
 }
 
 static NTSTATUS SvcInstanceAddUserRights(HANDLE Token,
@@ -909,11 +785,13 @@ NTSTATUS SvcInstanceCreate(HANDLE ClientToken,
     PWSTR ClientUserName = 0, StderrFileName = 0;
     DWORD ClientTokenInformation = -1;
     SECURITY_ATTRIBUTES StderrSecurityAttributes = { sizeof(SECURITY_ATTRIBUTES), 0, TRUE };
-    FSP_LAUNCH_REG_RECORD *Record = 0;
-    WCHAR CurrentTime[32], UserProfileDir[MAX_PATH], CommandLine[512], Security[512];
+    SVC_REG_RECORD *RegRecord = 0;
+    FSP_LAUNCH_REG_RECORD *Record;
+    WCHAR CurrentTime[32], UserProfileDir[MAX_PATH];
     DWORD Length, ClassNameSize, InstanceNameSize;
-    PSECURITY_DESCRIPTOR SecurityDescriptor = 0, NewSecurityDescriptor;
+    PSECURITY_DESCRIPTOR SecurityDescriptor = 0;
     PROCESS_INFORMATION ProcessInfo;
+    BOOLEAN Inserted = FALSE;
     NTSTATUS Result;
 
     *PSvcInstance = 0;
@@ -928,13 +806,13 @@ NTSTATUS SvcInstanceCreate(HANDLE ClientToken,
 
     memset(&ProcessInfo, 0, sizeof ProcessInfo);
 
-    EnterCriticalSection(&SvcInstanceLock);
-
-    if (0 != SvcInstanceLookup(ClassName, InstanceName))
-    {
-        Result = STATUS_OBJECT_NAME_COLLISION;
-        goto exit;
-    }
+    /*
+     * The SvcInstanceLock is not held while the instance is being created; in particular
+     * it is not held while the registry is read or while the process is being spawned,
+     * so that other clients are not blocked behind a slow start. Instead the instance
+     * name is reserved by inserting a "pending" instance in the instance table. Pending
+     * instances are invisible to lookups, but they do cause name collisions.
+     */
 
     GetSystemTime(&SystemTime);
     wsprintfW(CurrentTime, L"%04hu%02hu%02huT%02hu%02hu%02hu.%03huZ",
@@ -954,9 +832,10 @@ NTSTATUS SvcInstanceCreate(HANDLE ClientToken,
         lstrcpyW(UserProfileDir, L":INVALID:");
     Varv[L'P' - L'A'] = UserProfileDir;
 
-    Result = FspLaunchRegGetRecord(ClassName, 0, &Record);
+    Result = SvcRegCacheGetRecord(&SvcRegCache, ClassName, &RegRecord);
     if (!NT_SUCCESS(Result))
         goto exit;
+    Record = RegRecord->Record;
 
     if ((!RedirectStdio && 0 != Record->Credentials) ||
         ( RedirectStdio && 0 == Record->Credentials))
@@ -967,48 +846,13 @@ NTSTATUS SvcInstanceCreate(HANDLE ClientToken,
 
     Argv[0] = Record->Executable;
 
-    lstrcpyW(CommandLine, L"%0 ");
-    if (0 != Record->CommandLine)
-    {
-        Length = lstrlenW(CommandLine);
-        lstrcpynW(CommandLine + Length, Record->CommandLine,
-            sizeof CommandLine / sizeof(WCHAR) - Length);
-        CommandLine[sizeof CommandLine / sizeof(WCHAR) - 1] = L'\0';
-    }
-
-    lstrcpyW(Security, L"O:SYG:SY");
-    if (0 != Record->Security)
-    {
-        if (L'D' == Record->Security[0] && L':' == Record->Security[1])
-            Length = lstrlenW(Security);
-        else
-            Length = 0;
-        lstrcpynW(Security + Length, Record->Security,
-            sizeof Security / sizeof(WCHAR) - Length);
-        Security[sizeof Security / sizeof(WCHAR) - 1] = L'\0';
-    }
-    else
-    {
-        Length = lstrlenW(Security);
-        lstrcpyW(Security + Length, L"" FSP_LAUNCH_SERVICE_DEFAULT_SDDL);
-    }
-
-    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(Security, SDDL_REVISION_1,
-        &SecurityDescriptor, 0))
-    {
-        Result = FspNtStatusFromWin32(GetLastError());
-        goto exit;
-    }
-
-    Result = SvcInstanceAccessCheck(ClientToken, SERVICE_START, SecurityDescriptor);
+    Result = SvcInstanceAccessCheck(ClientToken, SERVICE_START, RegRecord->SecurityDescriptor);
     if (!NT_SUCCESS(Result))
         goto exit;
 
-    Result = SvcInstanceAddUserRights(ClientToken, SecurityDescriptor, &NewSecurityDescriptor);
+    Result = SvcInstanceAddUserRights(ClientToken, RegRecord->SecurityDescriptor, &SecurityDescriptor);
     if (!NT_SUCCESS(Result))
         goto exit;
-    LocalFree(SecurityDescriptor);
-    SecurityDescriptor = NewSecurityDescriptor;
 
     ClassNameSize = (lstrlenW(ClassName) + 1) * sizeof(WCHAR);
     InstanceNameSize = (lstrlenW(InstanceName) + 1) * sizeof(WCHAR);
@@ -1043,15 +887,31 @@ NTSTATUS SvcInstanceCreate(HANDLE ClientToken,
     SvcInstance->StdioHandles[1] = INVALID_HANDLE_VALUE;
     SvcInstance->StdioHandles[2] = INVALID_HANDLE_VALUE;
     SvcInstance->Recovery = Record->Recovery;
+    SvcInstance->Pending = TRUE;
+
+    EnterCriticalSection(&SvcInstanceLock);
+    if (SvcInstanceStopping)
+        Result = STATUS_CANCELLED;
+    else if (!SvcInstanceTableInsert(&SvcInstanceTable, &SvcInstance->TableEntry,
+        SvcInstance->ClassName, SvcInstance->InstanceName))
+        Result = STATUS_OBJECT_NAME_COLLISION;
+    else
+    {
+        Inserted = TRUE;
+        Result = STATUS_SUCCESS;
+    }
+    LeaveCriticalSection(&SvcInstanceLock);
+    if (!NT_SUCCESS(Result))
+        goto exit;
 
-    Result = SvcInstanceReplaceArguments(CommandLine, Argc, Argv, Varv, TRUE,
+    Result = SvcArgTemplateExpand(RegRecord->CommandLine, Argc, Argv, Varv, TRUE,
         &SvcInstance->CommandLine);
     if (!NT_SUCCESS(Result))
         goto exit;
 
-    if (0 != Record->Stderr)
+    if (0 != RegRecord->Stderr)
     {
-        Result = SvcInstanceReplaceArguments(Record->Stderr, Argc, Argv, Varv, FALSE,
+        Result = SvcArgTemplateExpand(RegRecord->Stderr, Argc, Argv, Varv, FALSE,
             &StderrFileName);
         if (!NT_SUCCESS(Result))
             goto exit;
@@ -1098,6 +958,20 @@ NTSTATUS SvcInstanceCreate(HANDLE ClientToken,
                 L"Ignorning error: AssignProcessToJobObject = %ld", GetLastError());
     }
 
+    EnterCriticalSection(&SvcInstanceLock);
+    if (!SvcInstanceStopping)
+    {
+        SvcInstance->Pending = FALSE;
+        InsertTailList(&SvcInstanceList, &SvcInstance->ListEntry);
+        ResetEvent(SvcInstanceEvent);
+        Result = STATUS_SUCCESS;
+    }
+    else
+        Result = STATUS_CANCELLED;
+    LeaveCriticalSection(&SvcInstanceLock);
+    if (!NT_SUCCESS(Result))
+        goto exit;
+
     /*
      * ONCE THE PROCESS IS RESUMED NO MORE FAILURES ALLOWED!
      */
@@ -1106,9 +980,6 @@ NTSTATUS SvcInstanceCreate(HANDLE ClientToken,
     CloseHandle(ProcessInfo.hThread);
     ProcessInfo.hThread = 0;
 
-    InsertTailList(&SvcInstanceList, &SvcInstance->ListEntry);
-    ResetEvent(SvcInstanceEvent);
-
     *PSvcInstance = SvcInstance;
 
     Result = STATUS_SUCCESS;
@@ -1128,6 +999,13 @@ exit:
 
         if (0 != SvcInstance)
         {
+            if (Inserted)
+            {
+                EnterCriticalSection(&SvcInstanceLock);
+                SvcInstanceTableRemove(&SvcInstanceTable, &SvcInstance->TableEntry);
+                LeaveCriticalSection(&SvcInstanceLock);
+            }
+
             if (INVALID_HANDLE_VALUE != SvcInstance->StdioHandles[0])
                 CloseHandle(SvcInstance->StdioHandles[0]);
             if (INVALID_HANDLE_VALUE != SvcInstance->StdioHandles[1])
@@ -1149,14 +1027,12 @@ exit:
         }
     }
 
-    if (0 != Record)
-        FspLaunchRegFreeRecord(Record);
+    if (0 != RegRecord)
+        SvcRegRecordRelease(RegRecord);
 
     MemFree(StderrFileName);
     MemFree(ClientUserName);
 
-    LeaveCriticalSection(&SvcInstanceLock);
-
     FspServiceLog(EVENTLOG_INFORMATION_TYPE,
         L"create %s\\%s = %lx", ClassName, InstanceName, Result);
 
@@ -1169,6 +1045,7 @@ static VOID SvcInstanceRelease(SVC_INSTANCE *SvcInstance)
         return;
 
     EnterCriticalSection(&SvcInstanceLock);
+    SvcInstanceTableRemove(&SvcInstanceTable, &SvcInstance->TableEntry);
     if (RemoveEntryList(&SvcInstance->ListEntry))
         SetEvent(SvcInstanceEvent);
     LeaveCriticalSection(&SvcInstanceLock);
@@ -1488,6 +1365,9 @@ NTSTATUS SvcInstanceStopAndWaitAll(VOID)
 
     EnterCriticalSection(&SvcInstanceLock);
 
+    /* instances that are still pending will fail their creation */
+    SvcInstanceStopping = TRUE;
+
     for (ListEntry = SvcInstanceList.Flink;
         &SvcInstanceList != ListEntry;
         ListEntry = ListEntry->Flink)
@@ -1552,10 +1432,56 @@ NTSTATUS SvcDefineDosDevice(HANDLE ClientToken,
     return STATUS_SUCCESS;
 }
 
-static HANDLE SvcThread, SvcEvent;
-static DWORD SvcThreadId;
-static HANDLE SvcPipe = INVALID_HANDLE_VALUE;
-static OVERLAPPED SvcOverlapped;
+NTSTATUS SvcReload(HANDLE ClientToken)
+{
+    /* discarding the registry record cache affects all clients; require admin or backup */
+    UINT8 AdministratorsSidBuf[SECURITY_MAX_SID_SIZE];
+    DWORD Size = sizeof AdministratorsSidBuf;
+    BOOL IsAdministrator = FALSE, HasBackupPrivilege = FALSE;
+    PRIVILEGE_SET PrivilegeSet;
+
+    if (!CreateWellKnownSid(WinBuiltinAdministratorsSid, 0, AdministratorsSidBuf, &Size) ||
+        !CheckTokenMembership(ClientToken, AdministratorsSidBuf, &IsAdministrator))
+        return FspNtStatusFromWin32(GetLastError());
+
+    if (!IsAdministrator)
+    {
+        PrivilegeSet.PrivilegeCount = 1;
+        PrivilegeSet.Control = PRIVILEGE_SET_ALL_NECESSARY;
+        PrivilegeSet.Privilege[0].Attributes = 0;
+        if (!LookupPrivilegeValueW(0, SE_BACKUP_NAME, &PrivilegeSet.Privilege[0].Luid) ||
+            !PrivilegeCheck(ClientToken, &PrivilegeSet, &HasBackupPrivilege))
+            return FspNtStatusFromWin32(GetLastError());
+    }
+
+    if (!IsAdministrator && !HasBackupPrivilege)
+        return STATUS_ACCESS_DENIED;
+
+    SvcRegCacheInvalidate(&SvcRegCache);
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * The pipe server consists of a small pool of worker threads. Each worker owns an instance
+ * of the launcher pipe and services one client at a time; different clients are serviced
+ * concurrently by different workers. The first worker to exit its loop (because the service
+ * is being stopped or because of an unrecoverable error) stops the other workers and the
+ * service.
+ */
+typedef struct
+{
+    FSP_SERVICE *Service;
+    HANDLE Thread;
+    DWORD ThreadId;
+    HANDLE Pipe;
+    OVERLAPPED Overlapped;
+} SVC_PIPE_WORKER;
+
+static HANDLE SvcEvent;
+static SVC_PIPE_WORKER SvcPipeWorkers[LAUNCHER_PIPE_WORKER_MAXIMUM];
+static ULONG SvcPipeWorkerCount;
+static LONG SvcPipeServerExiting;
 
 static DWORD WINAPI SvcPipeServer(PVOID Context);
 static VOID SvcPipeTransact(HANDLE ClientToken, PWSTR PipeBuf, PULONG PSize);
@@ -1563,6 +1489,9 @@ static VOID SvcPipeTransact(HANDLE ClientToken, PWSTR PipeBuf, PULONG PSize);
 static NTSTATUS SvcStart(FSP_SERVICE *Service, ULONG argc, PWSTR *argv)
 {
     SECURITY_ATTRIBUTES SecurityAttributes = { 0 };
+    SYSTEM_INFO SystemInfo;
+    SVC_PIPE_WORKER *Worker;
+    NTSTATUS Result;
 
     /*
      * Allocate a console in case we are running as a service without one.
@@ -1573,6 +1502,16 @@ static NTSTATUS SvcStart(FSP_SERVICE *Service, ULONG argc, PWSTR *argv)
 
     InitializeCriticalSection(&SvcInstanceLock);
 
+    Result = SvcInstanceTableInitialize(&SvcInstanceTable);
+    if (!NT_SUCCESS(Result))
+        return Result;
+
+    SvcRegCacheInitialize(&SvcRegCache, &SvcRegStoreDefault, FALSE);
+    Result = SvcRegCacheStartNotify(&SvcRegCache);
+    if (!NT_SUCCESS(Result))
+        FspServiceLog(EVENTLOG_WARNING_TYPE,
+            L"Ignorning error: registry record cache disabled = %lx", Result);
+
     SecurityAttributes.nLength = sizeof SecurityAttributes;
     SecurityAttributes.bInheritHandle = FALSE;
     if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(L"" FSP_LAUNCH_PIPE_SDDL, SDDL_REVISION_1,
@@ -1604,22 +1543,51 @@ static NTSTATUS SvcStart(FSP_SERVICE *Service, ULONG argc, PWSTR *argv)
     if (0 == SvcEvent)
         goto fail;
 
-    SvcOverlapped.hEvent = CreateEventW(0, TRUE, FALSE, 0);
-    if (0 == SvcOverlapped.hEvent)
-        goto fail;
-
-    SvcPipe = CreateNamedPipeW(L"" FSP_LAUNCH_PIPE_NAME,
-        PIPE_ACCESS_DUPLEX |
-            FILE_FLAG_FIRST_PIPE_INSTANCE | FILE_FLAG_WRITE_THROUGH | FILE_FLAG_OVERLAPPED,
-        PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
-        1, FSP_LAUNCH_PIPE_BUFFER_SIZE, FSP_LAUNCH_PIPE_BUFFER_SIZE, LAUNCHER_PIPE_DEFAULT_TIMEOUT,
-        &SecurityAttributes);
-    if (INVALID_HANDLE_VALUE == SvcPipe)
-        goto fail;
-
-    SvcThread = CreateThread(0, 0, SvcPipeServer, Service, 0, &SvcThreadId);
-    if (0 == SvcThread)
-        goto fail;
+    GetSystemInfo(&SystemInfo);
+    SvcPipeWorkerCount = 2 * SystemInfo.dwNumberOfProcessors;
+    if (LAUNCHER_PIPE_WORKER_MAXIMUM < SvcPipeWorkerCount)
+        SvcPipeWorkerCount = LAUNCHER_PIPE_WORKER_MAXIMUM;
+    if (1 > SvcPipeWorkerCount)
+        SvcPipeWorkerCount = 1;
+
+    for (ULONG I = 0; SvcPipeWorkerCount > I; I++)
+    {
+        Worker = &SvcPipeWorkers[I];
+        Worker->Service = Service;
+        Worker->Pipe = INVALID_HANDLE_VALUE;
+
+        Worker->Overlapped.hEvent = CreateEventW(0, TRUE, FALSE, 0);
+        if (0 == Worker->Overlapped.hEvent)
+            goto fail;
+
+        /* only the first instance may create the pipe; this ensures that we own it */
+        Worker->Pipe = CreateNamedPipeW(L"" FSP_LAUNCH_PIPE_NAME,
+            PIPE_ACCESS_DUPLEX |
+                (0 == I ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0) |
+                FILE_FLAG_WRITE_THROUGH | FILE_FLAG_OVERLAPPED,
+            PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            SvcPipeWorkerCount, FSP_LAUNCH_PIPE_BUFFER_SIZE, FSP_LAUNCH_PIPE_BUFFER_SIZE,
+            LAUNCHER_PIPE_DEFAULT_TIMEOUT,
+            &SecurityAttributes);
+        if (INVALID_HANDLE_VALUE == Worker->Pipe)
+            goto fail;
+    }
+
+    for (ULONG I = 0; SvcPipeWorkerCount > I; I++)
+    {
+        Worker = &SvcPipeWorkers[I];
+        Worker->Thread = CreateThread(0, 0, SvcPipeServer, Worker, 0, &Worker->ThreadId);
+        if (0 == Worker->Thread)
+        {
+            if (0 < I)
+            {
+                /* the already running workers will stop themselves and the service */
+                SetEvent(SvcEvent);
+                break;
+            }
+            goto fail;
+        }
+    }
 
     LocalFree(SecurityAttributes.lpSecurityDescriptor);
 
@@ -1632,14 +1600,17 @@ fail:
      * The OS will cleanup for us. So there is no need to explicitly release these resources.
      */
 #if 0
-    if (0 != SvcThread)
-        CloseHandle(SvcThread);
+    for (ULONG I = 0; SvcPipeWorkerCount > I; I++)
+    {
+        if (0 != SvcPipeWorkers[I].Thread)
+            CloseHandle(SvcPipeWorkers[I].Thread);
 
-    if (INVALID_HANDLE_VALUE != SvcPipe)
-        CloseHandle(SvcPipe);
+        if (INVALID_HANDLE_VALUE != SvcPipeWorkers[I].Pipe)
+            CloseHandle(SvcPipeWorkers[I].Pipe);
 
-    if (0 != SvcOverlapped.hEvent)
-        CloseHandle(SvcOverlapped.hEvent);
+        if (0 != SvcPipeWorkers[I].Overlapped.hEvent)
+            CloseHandle(SvcPipeWorkers[I].Overlapped.hEvent);
+    }
 
     if (0 != SvcEvent)
         CloseHandle(SvcEvent);
@@ -1652,19 +1623,48 @@ fail:
 
     LocalFree(SecurityAttributes.lpSecurityDescriptor);
 
+    SvcRegCacheFinalize(&SvcRegCache);
+
+    SvcInstanceTableFinalize(&SvcInstanceTable);
+
     DeleteCriticalSection(&SvcInstanceLock);
 #endif
 
     return FspNtStatusFromWin32(LastError);
 }
 
+static BOOLEAN SvcPipeServerIsWorkerThread(VOID)
+{
+    DWORD ThreadId = GetCurrentThreadId();
+
+    for (ULONG I = 0; SvcPipeWorkerCount > I; I++)
+        if (ThreadId == SvcPipeWorkers[I].ThreadId)
+            return TRUE;
+
+    return FALSE;
+}
+
+static VOID SvcPipeServerWaitWorkers(DWORD Timeout)
+{
+    HANDLE Threads[LAUNCHER_PIPE_WORKER_MAXIMUM];
+    DWORD ThreadId = GetCurrentThreadId();
+    ULONG Count = 0;
+
+    for (ULONG I = 0; SvcPipeWorkerCount > I; I++)
+        if (0 != SvcPipeWorkers[I].Thread && ThreadId != SvcPipeWorkers[I].ThreadId)
+            Threads[Count++] = SvcPipeWorkers[I].Thread;
+
+    if (0 != Count)
+        WaitForMultipleObjects(Count, Threads, TRUE, Timeout);
+}
+
 static NTSTATUS SvcStop(FSP_SERVICE *Service)
 {
-    if (GetCurrentThreadId() != SvcThreadId)
+    if (!SvcPipeServerIsWorkerThread())
     {
         SetEvent(SvcEvent);
         FspServiceRequestTime(Service, LAUNCHER_STOP_TIMEOUT);
-        WaitForSingleObject(SvcThread, LAUNCHER_STOP_TIMEOUT);
+        SvcPipeServerWaitWorkers(LAUNCHER_STOP_TIMEOUT);
     }
 
     /*
@@ -1675,14 +1675,17 @@ static NTSTATUS SvcStop(FSP_SERVICE *Service)
      * with SvcInstanceTerminated.
      */
 #if 0
-    if (0 != SvcThread)
-        CloseHandle(SvcThread);
+    for (ULONG I = 0; SvcPipeWorkerCount > I; I++)
+    {
+        if (0 != SvcPipeWorkers[I].Thread)
+            CloseHandle(SvcPipeWorkers[I].Thread);
 
-    if (INVALID_HANDLE_VALUE != SvcPipe)
-        CloseHandle(SvcPipe);
+        if (INVALID_HANDLE_VALUE != SvcPipeWorkers[I].Pipe)
+            CloseHandle(SvcPipeWorkers[I].Pipe);
 
-    if (0 != SvcOverlapped.hEvent)
-        CloseHandle(SvcOverlapped.hEvent);
+        if (0 != SvcPipeWorkers[I].Overlapped.hEvent)
+            CloseHandle(SvcPipeWorkers[I].Overlapped.hEvent);
+    }
 
     if (0 != SvcEvent)
         CloseHandle(SvcEvent);
@@ -1693,6 +1696,10 @@ static NTSTATUS SvcStop(FSP_SERVICE *Service)
     if (0 != SvcInstanceEvent)
         CloseHandle(SvcInstanceEvent);
 
+    SvcRegCacheFinalize(&SvcRegCache);
+
+    SvcInstanceTableFinalize(&SvcInstanceTable);
+
     DeleteCriticalSection(&SvcInstanceLock);
 #endif
 
@@ -1729,7 +1736,10 @@ static DWORD WINAPI SvcPipeServer(PVOID Context)
         L"Error in service main loop (%s = %ld). Exiting...";
     static PWSTR LoopWarningMessage =
         L"Error in service main loop (%s = %ld). Continuing...";
-    FSP_SERVICE *Service = Context;
+    SVC_PIPE_WORKER *Worker = Context;
+    FSP_SERVICE *Service = Worker->Service;
+    HANDLE SvcPipe = Worker->Pipe;
+    OVERLAPPED *SvcOverlapped = &Worker->Overlapped;
     PWSTR PipeBuf = 0;
     HANDLE ClientToken;
     DWORD LastError, BytesTransferred;
@@ -1744,8 +1754,8 @@ static DWORD WINAPI SvcPipeServer(PVOID Context)
     for (;;)
     {
         LastError = SvcPipeWaitResult(
-            ConnectNamedPipe(SvcPipe, &SvcOverlapped),
-            SvcEvent, SvcPipe, &SvcOverlapped, &BytesTransferred);
+            ConnectNamedPipe(SvcPipe, SvcOverlapped),
+            SvcEvent, SvcPipe, SvcOverlapped, &BytesTransferred);
         if (-1 == LastError)
             break;
         else if (0 != LastError &&
@@ -1757,8 +1767,8 @@ static DWORD WINAPI SvcPipeServer(PVOID Context)
         }
 
         LastError = SvcPipeWaitResult(
-            ReadFile(SvcPipe, PipeBuf, FSP_LAUNCH_PIPE_BUFFER_SIZE, &BytesTransferred, &SvcOverlapped),
-            SvcEvent, SvcPipe, &SvcOverlapped, &BytesTransferred);
+            ReadFile(SvcPipe, PipeBuf, FSP_LAUNCH_PIPE_BUFFER_SIZE, &BytesTransferred, SvcOverlapped),
+            SvcEvent, SvcPipe, SvcOverlapped, &BytesTransferred);
         if (-1 == LastError)
             break;
         else if (0 != LastError || sizeof(WCHAR) > BytesTransferred)
@@ -1811,8 +1821,8 @@ static DWORD WINAPI SvcPipeServer(PVOID Context)
         CloseHandle(ClientToken);
 
         LastError = SvcPipeWaitResult(
-            WriteFile(SvcPipe, PipeBuf, BytesTransferred, &BytesTransferred, &SvcOverlapped),
-            SvcEvent, SvcPipe, &SvcOverlapped, &BytesTransferred);
+            WriteFile(SvcPipe, PipeBuf, BytesTransferred, &BytesTransferred, SvcOverlapped),
+            SvcEvent, SvcPipe, SvcOverlapped, &BytesTransferred);
         if (-1 == LastError)
             break;
         else if (0 != LastError)
@@ -1829,9 +1839,15 @@ static DWORD WINAPI SvcPipeServer(PVOID Context)
 exit:
     MemFree(PipeBuf);
 
-    SvcInstanceStopAndWaitAll();
+    if (0 == InterlockedExchange(&SvcPipeServerExiting, 1))
+    {
+        SetEvent(SvcEvent);
+        SvcPipeServerWaitWorkers(LAUNCHER_STOP_TIMEOUT);
+
+        SvcInstanceStopAndWaitAll();
 
-    FspServiceStop(Service);
+        FspServiceStop(Service);
+    }
 
     return 0;
 }
@@ -1933,6 +1949,12 @@ static VOID SvcPipeTransact(HANDLE ClientToken, PWSTR PipeBuf, PULONG PSize)
         SvcPipeTransactResult(Result, PipeBuf, PSize);
         break;
 
+    case FspLaunchCmdReload:
+        Result = SvcReload(ClientToken);
+
+        SvcPipeTransactResult(Result, PipeBuf, PSize);
+        break;
+
     case FspLaunchCmdDefineDosDevice:
         DeviceName = SvcPipeTransactGetPart(&P, PipeBufEnd);
         TargetPath = SvcPipeTransactGetPart(&P, PipeBufEnd);
@@ -0,0 +1,564 @@
+/**
+ * @file launcher/regrec.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <launcher/regrec.h>
+#include <shared/um/minimal.h>
+#include <sddl.h>
+
+#if !defined(REG_NOTIFY_THREAD_AGNOSTIC)
+#define REG_NOTIFY_THREAD_AGNOSTIC      0x10000000L
+#endif
+
+enum
+{
+    SvcArgTemplatePartLiteral           = 0,
+    SvcArgTemplatePartArgv              = 1,
+    SvcArgTemplatePartVarv              = 2,
+};
+
+typedef struct
+{
+    UINT8 Kind;
+    UINT8 Index;
+    ULONG Length;                       /* literal: length in WCHAR's */
+    PWSTR Text;                         /* literal: text; argv/varv: path pattern or NULL */
+} SVC_ARG_TEMPLATE_PART;
+
+struct _SVC_ARG_TEMPLATE
+{
+    ULONG PartCount;
+    SVC_ARG_TEMPLATE_PART *Parts;
+    WCHAR String[];
+};
+
+static inline VOID SvcArgTemplateAddLiteral(SVC_ARG_TEMPLATE *Template, PWSTR P)
+{
+    SVC_ARG_TEMPLATE_PART *Part;
+
+    if (0 < Template->PartCount)
+    {
+        Part = &Template->Parts[Template->PartCount - 1];
+        if (SvcArgTemplatePartLiteral == Part->Kind && Part->Text + Part->Length == P)
+        {
+            Part->Length++;
+            return;
+        }
+    }
+
+    Part = &Template->Parts[Template->PartCount++];
+    Part->Kind = SvcArgTemplatePartLiteral;
+    Part->Index = 0;
+    Part->Length = 1;
+    Part->Text = P;
+}
+
+static inline VOID SvcArgTemplateAddReference(SVC_ARG_TEMPLATE *Template,
+    UINT8 Kind, UINT8 Index, PWSTR Pattern)
+{
+    SVC_ARG_TEMPLATE_PART *Part;
+
+    Part = &Template->Parts[Template->PartCount++];
+    Part->Kind = Kind;
+    Part->Index = Index;
+    Part->Length = 0;
+    Part->Text = Pattern;
+}
+
+NTSTATUS SvcArgTemplateCreate(PWSTR String, SVC_ARG_TEMPLATE **PTemplate)
+{
+    SVC_ARG_TEMPLATE *Template;
+    ULONG StringLength;
+    PWSTR P, Pattern;
+
+    *PTemplate = 0;
+
+    /* every part consumes at least one character; so StringLength parts suffice */
+    StringLength = lstrlenW(String);
+    Template = MemAlloc(sizeof *Template +
+        (StringLength + 1) * sizeof(WCHAR) +
+        StringLength * sizeof(SVC_ARG_TEMPLATE_PART) + sizeof(PVOID));
+    if (0 == Template)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    memset(Template, 0, sizeof *Template);
+    memcpy(Template->String, String, (StringLength + 1) * sizeof(WCHAR));
+    Template->Parts = (PVOID)(((UINT_PTR)(Template->String + StringLength + 1) +
+        sizeof(PVOID) - 1) & ~(sizeof(PVOID) - 1));
+
+    /* the parsing rules must remain identical to those of the original SvcInstanceReplaceArguments */
+    for (P = Template->String; *P; P++)
+    {
+        switch (*P)
+        {
+        case L'%':
+            Pattern = 0;
+            P++;
+            if (L'\\' == *P)
+            {
+                Pattern = ++P;
+                while (!(L'\0' == *P ||
+                    (L'0' <= *P && *P <= L'9') ||
+                    (L'A' <= *P && *P <= L'Z')))
+                    P++;
+            }
+            if (L'0' <= *P && *P <= L'9')
+                SvcArgTemplateAddReference(Template,
+                    SvcArgTemplatePartArgv, (UINT8)(*P - L'0'), Pattern);
+            else
+            if (L'A' <= *P && *P <= L'Z')
+                SvcArgTemplateAddReference(Template,
+                    SvcArgTemplatePartVarv, (UINT8)(*P - L'A'), Pattern);
+            else
+            if (*P)
+                SvcArgTemplateAddLiteral(Template, P);
+            else
+                P--;
+            break;
+        default:
+            SvcArgTemplateAddLiteral(Template, P);
+            break;
+        }
+    }
+
+    *PTemplate = Template;
+
+    return STATUS_SUCCESS;
+}
+
+VOID SvcArgTemplateDelete(SVC_ARG_TEMPLATE *Template)
+{
+    MemFree(Template);
+}
+
+static inline ULONG SvcArgTemplateArgumentLength(PWSTR Arg, PWSTR Pattern, BOOLEAN Quote)
+{
+    return (Quote ? 2 : 0) + (ULONG)((UINT_PTR)PathTransform(0, Arg, Pattern) / sizeof(WCHAR));
+}
+
+static inline PWSTR SvcArgTemplateArgumentCopy(PWSTR Dest, PWSTR Arg, PWSTR Pattern, BOOLEAN Quote)
+{
+    if (Quote)
+        *Dest++ = L'"';
+    Dest = PathTransform(Dest, Arg, Pattern);
+    if (Quote)
+        *Dest++ = L'"';
+
+    return Dest;
+}
+
+static inline PWSTR SvcArgTemplateArgument(SVC_ARG_TEMPLATE_PART *Part,
+    ULONG Argc, PWSTR *Argv, PWSTR *Varv, PWSTR *PPattern)
+{
+    PWSTR Arg = 0;
+
+    if (SvcArgTemplatePartArgv == Part->Kind)
+        Arg = Argc > Part->Index ? Argv[Part->Index] : 0;
+    else
+        Arg = Varv[Part->Index];
+
+    /* missing arguments are replaced by an empty argument without path transformation */
+    *PPattern = 0 != Arg ? Part->Text : 0;
+    return 0 != Arg ? Arg : L"";
+}
+
+NTSTATUS SvcArgTemplateExpand(SVC_ARG_TEMPLATE *Template,
+    ULONG Argc, PWSTR *Argv, PWSTR *Varv, BOOLEAN Quote,
+    PWSTR *PNewString)
+{
+    SVC_ARG_TEMPLATE_PART *Part, *PartEnd = Template->Parts + Template->PartCount;
+    PWSTR NewString, Q, Arg, Pattern;
+    ULONG Length;
+
+    *PNewString = 0;
+
+    Length = 0;
+    for (Part = Template->Parts; PartEnd > Part; Part++)
+        if (SvcArgTemplatePartLiteral == Part->Kind)
+            Length += Part->Length;
+        else
+        {
+            Arg = SvcArgTemplateArgument(Part, Argc, Argv, Varv, &Pattern);
+            Length += SvcArgTemplateArgumentLength(Arg, Pattern, Quote);
+        }
+
+    NewString = MemAlloc((Length + 1) * sizeof(WCHAR));
+    if (0 == NewString)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    Q = NewString;
+    for (Part = Template->Parts; PartEnd > Part; Part++)
+        if (SvcArgTemplatePartLiteral == Part->Kind)
+        {
+            memcpy(Q, Part->Text, Part->Length * sizeof(WCHAR));
+            Q += Part->Length;
+        }
+        else
+        {
+            Arg = SvcArgTemplateArgument(Part, Argc, Argv, Varv, &Pattern);
+            Q = SvcArgTemplateArgumentCopy(Q, Arg, Pattern, Quote);
+        }
+    *Q = L'\0';
+
+    *PNewString = NewString;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS SvcRegRecordCreate(PWSTR ClassName,
+    FSP_LAUNCH_REG_RECORD *Record, VOID (*FreeRecord)(FSP_LAUNCH_REG_RECORD *Record),
+    SVC_REG_RECORD **PRegRecord)
+{
+    SVC_REG_RECORD *RegRecord = 0;
+    WCHAR CommandLine[512], Security[512];
+    ULONG ClassNameSize, Length;
+    NTSTATUS Result;
+
+    *PRegRecord = 0;
+
+    ClassNameSize = (lstrlenW(ClassName) + 1) * sizeof(WCHAR);
+
+    RegRecord = MemAlloc(sizeof *RegRecord + ClassNameSize);
+    if (0 == RegRecord)
+    {
+        Result = STATUS_INSUFFICIENT_RESOURCES;
+        goto exit;
+    }
+
+    memset(RegRecord, 0, sizeof *RegRecord);
+    RegRecord->RefCount = 1;
+    memcpy(RegRecord->Buffer, ClassName, ClassNameSize);
+    RegRecord->ClassName = RegRecord->Buffer;
+    RegRecord->Record = Record;
+    RegRecord->FreeRecord = FreeRecord;
+
+    lstrcpyW(CommandLine, L"%0 ");
+    if (0 != Record->CommandLine)
+    {
+        Length = lstrlenW(CommandLine);
+        lstrcpynW(CommandLine + Length, Record->CommandLine,
+            sizeof CommandLine / sizeof(WCHAR) - Length);
+        CommandLine[sizeof CommandLine / sizeof(WCHAR) - 1] = L'\0';
+    }
+
+    Result = SvcArgTemplateCreate(CommandLine, &RegRecord->CommandLine);
+    if (!NT_SUCCESS(Result))
+        goto exit;
+
+    if (0 != Record->Stderr)
+    {
+        Result = SvcArgTemplateCreate(Record->Stderr, &RegRecord->Stderr);
+        if (!NT_SUCCESS(Result))
+            goto exit;
+    }
+
+    lstrcpyW(Security, L"O:SYG:SY");
+    if (0 != Record->Security)
+    {
+        if (L'D' == Record->Security[0] && L':' == Record->Security[1])
+            Length = lstrlenW(Security);
+        else
+            Length = 0;
+        lstrcpynW(Security + Length, Record->Security,
+            sizeof Security / sizeof(WCHAR) - Length);
+        Security[sizeof Security / sizeof(WCHAR) - 1] = L'\0';
+    }
+    else
+    {
+        Length = lstrlenW(Security);
+        lstrcpyW(Security + Length, L"" FSP_LAUNCH_SERVICE_DEFAULT_SDDL);
+    }
+
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(Security, SDDL_REVISION_1,
+        &RegRecord->SecurityDescriptor, 0))
+    {
+        RegRecord->SecurityDescriptor = 0;
+        Result = FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+
+    *PRegRecord = RegRecord;
+
+    Result = STATUS_SUCCESS;
+
+exit:
+    if (!NT_SUCCESS(Result))
+    {
+        if (0 != RegRecord)
+            SvcRegRecordRelease(RegRecord);
+        else
+            FreeRecord(Record);
+    }
+
+    return Result;
+}
+
+VOID SvcRegRecordRelease(SVC_REG_RECORD *RegRecord)
+{
+    if (0 != InterlockedDecrement(&RegRecord->RefCount))
+        return;
+
+    LocalFree(RegRecord->SecurityDescriptor);
+    if (0 != RegRecord->Stderr)
+        SvcArgTemplateDelete(RegRecord->Stderr);
+    if (0 != RegRecord->CommandLine)
+        SvcArgTemplateDelete(RegRecord->CommandLine);
+    RegRecord->FreeRecord(RegRecord->Record);
+
+    MemFree(RegRecord);
+}
+
+static NTSTATUS SvcRegStoreGetRecord(PVOID Context, PWSTR ClassName,
+    FSP_LAUNCH_REG_RECORD **PRecord)
+{
+    return FspLaunchRegGetRecord(ClassName, 0, PRecord);
+}
+
+const SVC_REG_STORE SvcRegStoreDefault =
+{
+    SvcRegStoreGetRecord,
+    FspLaunchRegFreeRecord,
+    0,
+};
+
+VOID SvcRegCacheInitialize(SVC_REG_CACHE *Cache, const SVC_REG_STORE *Store, BOOLEAN Enabled)
+{
+    memset(Cache, 0, sizeof *Cache);
+    InitializeSRWLock(&Cache->Lock);
+    Cache->RecordList.Flink = Cache->RecordList.Blink = &Cache->RecordList;
+    Cache->Store = Store;
+    Cache->Enabled = Enabled;
+}
+
+VOID SvcRegCacheFinalize(SVC_REG_CACHE *Cache)
+{
+    if (0 != Cache->NotifyWait)
+        UnregisterWaitEx(Cache->NotifyWait, INVALID_HANDLE_VALUE);
+    if (0 != Cache->NotifyEvent)
+        CloseHandle(Cache->NotifyEvent);
+    if (0 != Cache->NotifyKey)
+        RegCloseKey(Cache->NotifyKey);
+
+    SvcRegCacheInvalidate(Cache);
+}
+
+static BOOLEAN SvcRegCacheArmNotify(SVC_REG_CACHE *Cache)
+{
+    return ERROR_SUCCESS == RegNotifyChangeKeyValue(Cache->NotifyKey, TRUE,
+        REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET | REG_NOTIFY_THREAD_AGNOSTIC,
+        Cache->NotifyEvent, TRUE);
+}
+
+static VOID CALLBACK SvcRegCacheNotified(PVOID Context, BOOLEAN Timeout)
+{
+    SVC_REG_CACHE *Cache = Context;
+
+    /* re-arm before invalidating, so that no change can be missed */
+    if (!SvcRegCacheArmNotify(Cache))
+    {
+        AcquireSRWLockExclusive(&Cache->Lock);
+        Cache->Enabled = FALSE;
+        ReleaseSRWLockExclusive(&Cache->Lock);
+    }
+
+    SvcRegCacheInvalidate(Cache);
+}
+
+NTSTATUS SvcRegCacheStartNotify(SVC_REG_CACHE *Cache)
+{
+    DWORD RegResult;
+    NTSTATUS Result;
+
+    RegResult = RegOpenKeyExW(HKEY_LOCAL_MACHINE, L"" FSP_LAUNCH_REGKEY,
+        0, FSP_LAUNCH_REGKEY_WOW64 | KEY_NOTIFY, &Cache->NotifyKey);
+    if (ERROR_SUCCESS != RegResult)
+    {
+        Cache->NotifyKey = 0;
+        Result = FspNtStatusFromWin32(RegResult);
+        goto exit;
+    }
+
+    Cache->NotifyEvent = CreateEventW(0, FALSE, FALSE, 0);
+    if (0 == Cache->NotifyEvent)
+    {
+        Result = FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+
+    if (!SvcRegCacheArmNotify(Cache))
+    {
+        Result = FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+
+    if (!RegisterWaitForSingleObject(&Cache->NotifyWait, Cache->NotifyEvent,
+        SvcRegCacheNotified, Cache, INFINITE, WT_EXECUTEDEFAULT))
+    {
+        Cache->NotifyWait = 0;
+        Result = FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+
+    AcquireSRWLockExclusive(&Cache->Lock);
+    Cache->Enabled = TRUE;
+    ReleaseSRWLockExclusive(&Cache->Lock);
+
+    Result = STATUS_SUCCESS;
+
+exit:
+    if (!NT_SUCCESS(Result))
+    {
+        if (0 != Cache->NotifyEvent)
+        {
+            CloseHandle(Cache->NotifyEvent);
+            Cache->NotifyEvent = 0;
+        }
+        if (0 != Cache->NotifyKey)
+        {
+            RegCloseKey(Cache->NotifyKey);
+            Cache->NotifyKey = 0;
+        }
+    }
+
+    return Result;
+}
+
+VOID SvcRegCacheInvalidate(SVC_REG_CACHE *Cache)
+{
+    LIST_ENTRY RecordList;
+    PLIST_ENTRY ListEntry;
+
+    /* move all records to a local list; release them outside the lock */
+    AcquireSRWLockExclusive(&Cache->Lock);
+    Cache->Generation++;
+    RecordList.Flink = RecordList.Blink = &RecordList;
+    if (&Cache->RecordList != Cache->RecordList.Flink)
+    {
+        RecordList = Cache->RecordList;
+        RecordList.Flink->Blink = &RecordList;
+        RecordList.Blink->Flink = &RecordList;
+        Cache->RecordList.Flink = Cache->RecordList.Blink = &Cache->RecordList;
+    }
+    ReleaseSRWLockExclusive(&Cache->Lock);
+
+    InterlockedIncrement(&Cache->InvalidateCount);
+
+    while (&RecordList != RecordList.Flink)
+    {
+        ListEntry = RecordList.Flink;
+        RemoveEntryList(ListEntry);
+        SvcRegRecordRelease(CONTAINING_RECORD(ListEntry, SVC_REG_RECORD, ListEntry));
+    }
+}
+
+static SVC_REG_RECORD *SvcRegCacheLookup(SVC_REG_CACHE *Cache, PWSTR ClassName)
+{
+    SVC_REG_RECORD *RegRecord;
+    PLIST_ENTRY ListEntry;
+
+    for (ListEntry = Cache->RecordList.Flink;
+        &Cache->RecordList != ListEntry;
+        ListEntry = ListEntry->Flink)
+    {
+        RegRecord = CONTAINING_RECORD(ListEntry, SVC_REG_RECORD, ListEntry);
+        if (0 == invariant_wcsicmp(ClassName, RegRecord->ClassName))
+            return RegRecord;
+    }
+
+    return 0;
+}
+
+NTSTATUS SvcRegCacheGetRecord(SVC_REG_CACHE *Cache, PWSTR ClassName,
+    SVC_REG_RECORD **PRegRecord)
+{
+    SVC_REG_RECORD *RegRecord, *CachedRegRecord;
+    FSP_LAUNCH_REG_RECORD *Record;
+    ULONG Generation;
+    BOOLEAN Enabled;
+    NTSTATUS Result;
+
+    *PRegRecord = 0;
+
+    AcquireSRWLockShared(&Cache->Lock);
+    Enabled = Cache->Enabled;
+    Generation = Cache->Generation;
+    RegRecord = Enabled ? SvcRegCacheLookup(Cache, ClassName) : 0;
+    if (0 != RegRecord)
+        InterlockedIncrement(&RegRecord->RefCount);
+    ReleaseSRWLockShared(&Cache->Lock);
+
+    if (0 != RegRecord)
+    {
+        InterlockedIncrement(&Cache->HitCount);
+        *PRegRecord = RegRecord;
+        return STATUS_SUCCESS;
+    }
+
+    InterlockedIncrement(&Cache->MissCount);
+
+    Result = Cache->Store->GetRecord(Cache->Store->Context, ClassName, &Record);
+    if (!NT_SUCCESS(Result))
+        return Result;
+
+    Result = SvcRegRecordCreate(ClassName, Record, Cache->Store->FreeRecord, &RegRecord);
+    if (!NT_SUCCESS(Result))
+        return Result;
+
+    if (Enabled)
+    {
+        AcquireSRWLockExclusive(&Cache->Lock);
+        /*
+         * If the cache was invalidated while we were reading the record, the record may
+         * be stale; return it to the caller, but do not cache it.
+         */
+        if (Cache->Enabled && Generation == Cache->Generation)
+        {
+            CachedRegRecord = SvcRegCacheLookup(Cache, ClassName);
+            if (0 == CachedRegRecord)
+            {
+                InterlockedIncrement(&RegRecord->RefCount);
+                InsertTailList(&Cache->RecordList, &RegRecord->ListEntry);
+            }
+            else
+            {
+                /* another thread was faster; use its record */
+                InterlockedIncrement(&CachedRegRecord->RefCount);
+                ReleaseSRWLockExclusive(&Cache->Lock);
+                SvcRegRecordRelease(RegRecord);
+                RegRecord = CachedRegRecord;
+                goto exit;
+            }
+        }
+        ReleaseSRWLockExclusive(&Cache->Lock);
+    }
+
+exit:
+    *PRegRecord = RegRecord;
+
+    return STATUS_SUCCESS;
+}
+
+VOID SvcRegCacheGetStatistics(SVC_REG_CACHE *Cache,
+    PULONG PHitCount, PULONG PMissCount, PULONG PInvalidateCount)
+{
+    *PHitCount = (ULONG)Cache->HitCount;
+    *PMissCount = (ULONG)Cache->MissCount;
+    *PInvalidateCount = (ULONG)Cache->InvalidateCount;
+}
@@ -0,0 +1,116 @@
+/**
+ * @file launcher/regrec.h
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#ifndef WINFSP_LAUNCHER_REGREC_H_INCLUDED
+#define WINFSP_LAUNCHER_REGREC_H_INCLUDED
+
+#include <winfsp/launch.h>
+
+PWSTR PathTransform(PWSTR Dest, PWSTR Arg, PWSTR Pattern);
+
+/*
+ * Argument Templates
+ *
+ * An argument template is a string such as a service CommandLine or Stderr that contains
+ * %0-%9 (command line argument) and %A-%Z (variable) references, optionally preceded by a
+ * path transformation (see ptrans.c). A template is parsed once into a list of literal
+ * and reference parts; it can then be expanded any number of times.
+ */
+
+typedef struct _SVC_ARG_TEMPLATE SVC_ARG_TEMPLATE;
+
+NTSTATUS SvcArgTemplateCreate(PWSTR String, SVC_ARG_TEMPLATE **PTemplate);
+VOID SvcArgTemplateDelete(SVC_ARG_TEMPLATE *Template);
+NTSTATUS SvcArgTemplateExpand(SVC_ARG_TEMPLATE *Template,
+    ULONG Argc, PWSTR *Argv, PWSTR *Varv, BOOLEAN Quote,
+    PWSTR *PNewString);
+
+/*
+ * Registry Records
+ *
+ * A registry record is a service registry record (FSP_LAUNCH_REG_RECORD) together with
+ * everything the launcher derives from it in order to start an instance: the parsed
+ * CommandLine and Stderr templates and the service security descriptor. Registry records
+ * are reference counted and immutable once created.
+ */
+
+typedef struct _SVC_REG_RECORD
+{
+    LONG RefCount;
+    LIST_ENTRY ListEntry;
+    PWSTR ClassName;
+    FSP_LAUNCH_REG_RECORD *Record;
+    SVC_ARG_TEMPLATE *CommandLine;
+    SVC_ARG_TEMPLATE *Stderr;
+    PSECURITY_DESCRIPTOR SecurityDescriptor;
+    VOID (*FreeRecord)(FSP_LAUNCH_REG_RECORD *Record);
+    WCHAR Buffer[];
+} SVC_REG_RECORD;
+
+NTSTATUS SvcRegRecordCreate(PWSTR ClassName,
+    FSP_LAUNCH_REG_RECORD *Record, VOID (*FreeRecord)(FSP_LAUNCH_REG_RECORD *Record),
+    SVC_REG_RECORD **PRegRecord);
+VOID SvcRegRecordRelease(SVC_REG_RECORD *RegRecord);
+
+/*
+ * Registry Record Cache
+ *
+ * The cache keeps registry records by class name so that starting an instance does not
+ * have to go to the registry. Records are obtained from a record store; the default store
+ * reads the registry through FspLaunchRegGetRecord. The cache is emptied whenever the
+ * launcher registry key changes (if change notification has been started) or when it is
+ * explicitly invalidated. If change notification cannot be set up the cache is disabled
+ * and every lookup goes to the store.
+ *
+ * The cache is synchronized and may be used concurrently.
+ */
+
+typedef struct
+{
+    NTSTATUS (*GetRecord)(PVOID Context, PWSTR ClassName, FSP_LAUNCH_REG_RECORD **PRecord);
+    VOID (*FreeRecord)(FSP_LAUNCH_REG_RECORD *Record);
+    PVOID Context;
+} SVC_REG_STORE;
+
+typedef struct
+{
+    SRWLOCK Lock;
+    LIST_ENTRY RecordList;
+    const SVC_REG_STORE *Store;
+    ULONG Generation;
+    BOOLEAN Enabled;
+    HKEY NotifyKey;
+    HANDLE NotifyEvent, NotifyWait;
+    volatile LONG HitCount, MissCount, InvalidateCount;
+} SVC_REG_CACHE;
+
+extern const SVC_REG_STORE SvcRegStoreDefault;
+
+VOID SvcRegCacheInitialize(SVC_REG_CACHE *Cache, const SVC_REG_STORE *Store, BOOLEAN Enabled);
+VOID SvcRegCacheFinalize(SVC_REG_CACHE *Cache);
+NTSTATUS SvcRegCacheStartNotify(SVC_REG_CACHE *Cache);
+VOID SvcRegCacheInvalidate(SVC_REG_CACHE *Cache);
+NTSTATUS SvcRegCacheGetRecord(SVC_REG_CACHE *Cache, PWSTR ClassName,
+    SVC_REG_RECORD **PRegRecord);
+VOID SvcRegCacheGetStatistics(SVC_REG_CACHE *Cache,
+    PULONG PHitCount, PULONG PMissCount, PULONG PInvalidateCount);
+
+#endif
@@ -0,0 +1,533 @@
+/**
+ * @file shared/ku/bufpool.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <shared/ku/library.h>
+#include <shared/ku/bufpool.h>
+
+/*
+ * Buffer Pool
+ *
+ * Size Classes
+ *
+ * A requested size is rounded up to a power of two that is at least FSP_BUFFER_POOL_SIZE_MIN.
+ * Each such size is a class; the pool has classes up to the ceiling specified when it is
+ * created. A buffer is only ever reused for requests of its own class, so that a stream of
+ * 1MB reads does not keep reallocating buffers that were sized for 64KB directory queries.
+ *
+ * Shards
+ *
+ * The pool is split into a power-of-two number of shards, usually one per processor. A
+ * buffer is acquired from the shard of the current processor and is returned to the shard
+ * that it was acquired from. Each shard has its own spin lock and its own table of
+ * per-process items; an item holds a free list per size class. Concurrent requests for the
+ * same file system process therefore only contend when they run on the same processor.
+ *
+ * Adaptive Counts
+ *
+ * For every (shard, process, class) the pool tracks the number of buffers in use. The number
+ * of buffers that are kept (cached plus in use; Target) grows to the highest number of
+ * buffers in use and is reset to the peak of the last FSP_BUFFER_POOL_WINDOW acquisitions,
+ * so that a burst of concurrency does not pin memory forever. Buffers above Target are
+ * freed when a buffer is released. Target never exceeds a per-class maximum that keeps
+ * each free list under FSP_BUFFER_POOL_CACHE_SIZE_MAX bytes.
+ *
+ * Process Lifetime
+ *
+ * Buffers belong to the address space of the process that acquired them. When a process
+ * goes away its items are removed from the pool (Collect); in the FSD its virtual memory
+ * goes away with it. A buffer that is released after its item was collected is freed rather
+ * than cached; each item has a unique id that the buffer cookie records, so that a buffer
+ * is never cached in an item of a new process that happens to reuse the process id.
+ *
+ * This code runs under spin locks in the FSD and must not be pageable.
+ */
+
+#define FSP_BUFFER_POOL_CLASS_COUNT_MAX 9   /* 64KB .. 16MB */
+#define FSP_BUFFER_POOL_SHARD_COUNT_MAX 64
+#define FSP_BUFFER_POOL_BUCKET_COUNT    16  /* per shard; few processes are file systems */
+#define FSP_BUFFER_POOL_CACHE_SIZE_MAX  (4 * 1024 * 1024)
+#define FSP_BUFFER_POOL_COUNT_MAX       16
+#define FSP_BUFFER_POOL_WINDOW          64
+#define FSP_BUFFER_POOL_CACHE_LINE      64
+
+#if defined(_KERNEL_MODE)
+typedef KSPIN_LOCK FSP_BUFFER_POOL_LOCK;
+typedef KIRQL FSP_BUFFER_POOL_LOCK_STATE;
+#define FspBufferPoolLockInitialize(L)  KeInitializeSpinLock(L)
+#define FspBufferPoolLock(L, S)         KeAcquireSpinLock(L, S)
+#define FspBufferPoolUnlock(L, S)       KeReleaseSpinLock(L, S)
+#define FspBufferPoolAllocNonPaged(S)   FspAllocNonPaged(S)
+#define FspBufferPoolFreeNonPaged(P)    FspFree(P)
+#define FspBufferPoolCurrentProcessor() KeGetCurrentProcessorNumber()
+#else
+typedef SRWLOCK FSP_BUFFER_POOL_LOCK;
+typedef UCHAR FSP_BUFFER_POOL_LOCK_STATE;
+#define FspBufferPoolLockInitialize(L)  InitializeSRWLock(L)
+#define FspBufferPoolLock(L, S)         (*(S) = 0, AcquireSRWLockExclusive(L))
+#define FspBufferPoolUnlock(L, S)       ((VOID)(S), ReleaseSRWLockExclusive(L))
+#define FspBufferPoolAllocNonPaged(S)   MemAlloc(S)
+#define FspBufferPoolFreeNonPaged(P)    MemFree(P)
+#define FspBufferPoolCurrentProcessor() GetCurrentProcessorNumber()
+#endif
+
+typedef struct _FSP_BUFFER_POOL_ENTRY
+{
+    struct _FSP_BUFFER_POOL_ENTRY *Next;
+    PVOID Buffer;
+    UINT64 ItemId;
+    UINT16 ShardIndex;
+    UINT16 ClassIndex;
+} FSP_BUFFER_POOL_ENTRY;
+
+typedef struct
+{
+    FSP_BUFFER_POOL_ENTRY *FreeList;
+    ULONG FreeCount;
+    ULONG InUseCount;
+    ULONG Target;
+    ULONG WindowPeak;
+    ULONG WindowCount;
+} FSP_BUFFER_POOL_CLASS;
+
+typedef struct _FSP_BUFFER_POOL_ITEM
+{
+    struct _FSP_BUFFER_POOL_ITEM *HashNext;
+    HANDLE ProcessId;
+    UINT64 ItemId;
+    FSP_BUFFER_POOL_CLASS Classes[FSP_BUFFER_POOL_CLASS_COUNT_MAX];
+} FSP_BUFFER_POOL_ITEM;
+
+typedef struct
+{
+    FSP_BUFFER_POOL_LOCK Lock;
+    FSP_BUFFER_POOL_ITEM *Buckets[FSP_BUFFER_POOL_BUCKET_COUNT];
+    UINT64 NextItemId;
+    FSP_BUFFER_POOL_STATISTICS Statistics;
+} FSP_BUFFER_POOL_SHARD;
+
+typedef union
+{
+    FSP_BUFFER_POOL_SHARD V;
+    UINT8 B[FSP_FSCTL_ALIGN_UP(sizeof(FSP_BUFFER_POOL_SHARD), FSP_BUFFER_POOL_CACHE_LINE)];
+} FSP_BUFFER_POOL_SHARD_PADDED;
+
+struct _FSP_BUFFER_POOL
+{
+    ULONG ClassCount;
+    ULONG ShardMask;
+    FSP_BUFFER_POOL_SHARD_PADDED *Shards;   /* cache line aligned */
+};
+
+static inline NTSTATUS FspBufferPoolAllocateMemory(SIZE_T Size, PVOID *PBuffer)
+{
+#if defined(_KERNEL_MODE)
+    *PBuffer = 0;
+    return ZwAllocateVirtualMemory(ZwCurrentProcess(),
+        PBuffer, 0, &Size, MEM_COMMIT, PAGE_READWRITE);
+#else
+    *PBuffer = VirtualAlloc(0, Size, MEM_COMMIT, PAGE_READWRITE);
+    return 0 != *PBuffer ? STATUS_SUCCESS : STATUS_INSUFFICIENT_RESOURCES;
+#endif
+}
+
+static inline VOID FspBufferPoolFreeMemory(PVOID Buffer)
+{
+#if defined(_KERNEL_MODE)
+    SIZE_T Size = 0;
+    ZwFreeVirtualMemory(ZwCurrentProcess(), &Buffer, &Size, MEM_RELEASE);
+#else
+    VirtualFree(Buffer, 0, MEM_RELEASE);
+#endif
+}
+
+static VOID FspBufferPoolFreeItem(FSP_BUFFER_POOL_ITEM *Item)
+{
+    FSP_BUFFER_POOL_ENTRY *Entry, *NextEntry;
+
+    for (ULONG I = 0; FSP_BUFFER_POOL_CLASS_COUNT_MAX > I; I++)
+        for (Entry = Item->Classes[I].FreeList; 0 != Entry; Entry = NextEntry)
+        {
+            NextEntry = Entry->Next;
+#if !defined(_KERNEL_MODE)
+            /* in the FSD the virtual memory goes away with the process */
+            FspBufferPoolFreeMemory(Entry->Buffer);
+#endif
+            FspBufferPoolFreeNonPaged(Entry);
+        }
+
+    FspBufferPoolFreeNonPaged(Item);
+}
+
+static inline ULONG FspBufferPoolHash(HANDLE ProcessId)
+{
+    UINT64 K = (UINT64)(UINT_PTR)ProcessId;
+    K ^= K >> 33;
+    K *= 0xff51afd7ed558ccdULL;
+    K ^= K >> 33;
+    return (ULONG)K;
+}
+
+static inline FSP_BUFFER_POOL_ITEM **FspBufferPoolBucket(FSP_BUFFER_POOL_SHARD *Shard,
+    HANDLE ProcessId)
+{
+    return &Shard->Buckets[FspBufferPoolHash(ProcessId) % FSP_BUFFER_POOL_BUCKET_COUNT];
+}
+
+static inline FSP_BUFFER_POOL_ITEM *FspBufferPoolLookupItem(FSP_BUFFER_POOL_SHARD *Shard,
+    HANDLE ProcessId)
+{
+    for (FSP_BUFFER_POOL_ITEM *Item = *FspBufferPoolBucket(Shard, ProcessId);
+        0 != Item; Item = Item->HashNext)
+        if (Item->ProcessId == ProcessId)
+            return Item;
+    return 0;
+}
+
+static inline ULONG FspBufferPoolClassIndex(SIZE_T BufferSize)
+{
+    ULONG ClassIndex = 0;
+    for (SIZE_T ClassSize = FSP_BUFFER_POOL_SIZE_MIN;
+        ClassSize < BufferSize && FSP_BUFFER_POOL_CLASS_COUNT_MAX > ClassIndex;
+        ClassSize <<= 1)
+        ClassIndex++;
+    return ClassIndex;
+}
+
+static inline ULONG FspBufferPoolCountMax(ULONG ClassIndex)
+{
+    ULONG CountMax = FSP_BUFFER_POOL_CACHE_SIZE_MAX / (FSP_BUFFER_POOL_SIZE_MIN << ClassIndex);
+    return 1 > CountMax ? 1 : (FSP_BUFFER_POOL_COUNT_MAX < CountMax ?
+        FSP_BUFFER_POOL_COUNT_MAX : CountMax);
+}
+
+/*
+ * Give back a buffer (or a failed acquisition, in which case Entry may be NULL or have no
+ * Buffer) to the item it was acquired from. The buffer is cached if the item still exists;
+ * the free list is then trimmed so that cached and in use buffers do not exceed Target.
+ */
+static VOID FspBufferPoolReturn(FSP_BUFFER_POOL *Pool, HANDLE ProcessId,
+    ULONG ShardIndex, ULONG ClassIndex, UINT64 ItemId, FSP_BUFFER_POOL_ENTRY *Entry)
+{
+    FSP_BUFFER_POOL_SHARD *Shard = &Pool->Shards[ShardIndex].V;
+    FSP_BUFFER_POOL_LOCK_STATE LockState;
+    FSP_BUFFER_POOL_ITEM *Item;
+    FSP_BUFFER_POOL_CLASS *Class;
+    FSP_BUFFER_POOL_ENTRY *FreeList = 0, *NextEntry;
+
+    if (0 != Entry)
+    {
+        if (0 != Entry->Buffer)
+            Entry->Next = 0;
+        else
+        {
+            FspBufferPoolFreeNonPaged(Entry);
+            Entry = 0;
+        }
+    }
+
+    FspBufferPoolLock(&Shard->Lock, &LockState);
+
+    Item = FspBufferPoolLookupItem(Shard, ProcessId);
+    if (0 != Item && ItemId == Item->ItemId)
+    {
+        Class = &Item->Classes[ClassIndex];
+        ASSERT(0 < Class->InUseCount);
+        Class->InUseCount--;
+
+        if (0 != Entry)
+        {
+            Entry->Next = Class->FreeList;
+            Class->FreeList = Entry;
+            Class->FreeCount++;
+        }
+
+        while (0 != Class->FreeCount && Class->FreeCount + Class->InUseCount > Class->Target)
+        {
+            Entry = Class->FreeList;
+            Class->FreeList = Entry->Next;
+            Class->FreeCount--;
+            Entry->Next = FreeList;
+            FreeList = Entry;
+        }
+    }
+    else
+        FreeList = Entry;
+
+    for (Entry = FreeList; 0 != Entry; Entry = Entry->Next)
+        Shard->Statistics.DeallocateCount++;
+
+    FspBufferPoolUnlock(&Shard->Lock, LockState);
+
+    for (Entry = FreeList; 0 != Entry; Entry = NextEntry)
+    {
+        NextEntry = Entry->Next;
+        FspBufferPoolFreeMemory(Entry->Buffer);
+        FspBufferPoolFreeNonPaged(Entry);
+    }
+}
+
+NTSTATUS FspBufferPoolCreate(ULONG SizeMax, ULONG ShardCount, FSP_BUFFER_POOL **PPool)
+{
+    FSP_BUFFER_POOL *Pool;
+    ULONG ClassCount, ShardCountPow2;
+
+    *PPool = 0;
+
+    ClassCount = 1;
+    while (FSP_BUFFER_POOL_CLASS_COUNT_MAX > ClassCount &&
+        (ULONG)FSP_BUFFER_POOL_SIZE_MIN << (ClassCount - 1) < SizeMax)
+        ClassCount++;
+
+    ShardCountPow2 = 1;
+    while (FSP_BUFFER_POOL_SHARD_COUNT_MAX > ShardCountPow2 && ShardCountPow2 < ShardCount)
+        ShardCountPow2 <<= 1;
+
+    /* the pool and its shards contain spin locks and must be non-paged in kernel mode */
+    Pool = FspBufferPoolAllocNonPaged(sizeof *Pool +
+        ShardCountPow2 * sizeof(FSP_BUFFER_POOL_SHARD_PADDED) + FSP_BUFFER_POOL_CACHE_LINE);
+    if (0 == Pool)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    RtlZeroMemory(Pool, sizeof *Pool +
+        ShardCountPow2 * sizeof(FSP_BUFFER_POOL_SHARD_PADDED) + FSP_BUFFER_POOL_CACHE_LINE);
+    Pool->ClassCount = ClassCount;
+    Pool->ShardMask = ShardCountPow2 - 1;
+    Pool->Shards = (PVOID)FSP_FSCTL_ALIGN_UP((UINT_PTR)(Pool + 1), FSP_BUFFER_POOL_CACHE_LINE);
+    for (ULONG I = 0; ShardCountPow2 > I; I++)
+        FspBufferPoolLockInitialize(&Pool->Shards[I].V.Lock);
+
+    *PPool = Pool;
+
+    return STATUS_SUCCESS;
+}
+
+VOID FspBufferPoolDelete(FSP_BUFFER_POOL *Pool)
+{
+    FSP_BUFFER_POOL_SHARD *Shard;
+    FSP_BUFFER_POOL_ITEM *Item, *NextItem;
+
+    /* buffers that are still acquired are freed when they are released */
+    for (ULONG I = 0; Pool->ShardMask >= I; I++)
+    {
+        Shard = &Pool->Shards[I].V;
+        for (ULONG J = 0; FSP_BUFFER_POOL_BUCKET_COUNT > J; J++)
+            for (Item = Shard->Buckets[J]; 0 != Item; Item = NextItem)
+            {
+                NextItem = Item->HashNext;
+                FspBufferPoolFreeItem(Item);
+            }
+    }
+
+    FspBufferPoolFreeNonPaged(Pool);
+}
+
+NTSTATUS FspBufferPoolAcquire(FSP_BUFFER_POOL *Pool, HANDLE ProcessId,
+    SIZE_T BufferSize, PVOID *PBufferCookie, PVOID *PBuffer)
+{
+    ULONG ClassIndex = FspBufferPoolClassIndex(BufferSize);
+    ULONG ShardIndex = FspBufferPoolCurrentProcessor() & Pool->ShardMask;
+    FSP_BUFFER_POOL_SHARD *Shard = &Pool->Shards[ShardIndex].V;
+    FSP_BUFFER_POOL_LOCK_STATE LockState;
+    FSP_BUFFER_POOL_ITEM *Item, *NewItem = 0;
+    FSP_BUFFER_POOL_CLASS *Class;
+    FSP_BUFFER_POOL_ENTRY *Entry;
+    UINT64 ItemId;
+    NTSTATUS Result;
+
+    *PBufferCookie = 0;
+    *PBuffer = 0;
+
+    if (Pool->ClassCount <= ClassIndex)
+    {
+        FspBufferPoolLock(&Shard->Lock, &LockState);
+        Shard->Statistics.AcquireCount++;
+        Shard->Statistics.UncachedCount++;
+        FspBufferPoolUnlock(&Shard->Lock, LockState);
+
+        return FspBufferPoolAllocateMemory(BufferSize, PBuffer);
+    }
+
+    for (;;)
+    {
+        FspBufferPoolLock(&Shard->Lock, &LockState);
+
+        Item = FspBufferPoolLookupItem(Shard, ProcessId);
+        if (0 != Item || 0 != NewItem)
+            break;
+
+        FspBufferPoolUnlock(&Shard->Lock, LockState);
+
+        NewItem = FspBufferPoolAllocNonPaged(sizeof *NewItem);
+        if (0 == NewItem)
+            return STATUS_INSUFFICIENT_RESOURCES;
+        RtlZeroMemory(NewItem, sizeof *NewItem);
+    }
+
+    if (0 == Item)
+    {
+        Item = NewItem;
+        NewItem = 0;
+        Item->ProcessId = ProcessId;
+        Item->ItemId = (++Shard->NextItemId << 6) | ShardIndex;
+        for (ULONG I = 0; FSP_BUFFER_POOL_CLASS_COUNT_MAX > I; I++)
+            Item->Classes[I].Target = 1;
+        Item->HashNext = *FspBufferPoolBucket(Shard, ProcessId);
+        *FspBufferPoolBucket(Shard, ProcessId) = Item;
+    }
+
+    Class = &Item->Classes[ClassIndex];
+
+    Entry = Class->FreeList;
+    if (0 != Entry)
+    {
+        Class->FreeList = Entry->Next;
+        Class->FreeCount--;
+        Shard->Statistics.HitCount++;
+    }
+    else
+        Shard->Statistics.AllocateCount++;
+    Shard->Statistics.AcquireCount++;
+
+    Class->InUseCount++;
+    if (Class->WindowPeak < Class->InUseCount)
+        Class->WindowPeak = Class->InUseCount;
+    if (Class->Target < Class->InUseCount)
+        Class->Target = Class->InUseCount;
+    if (FSP_BUFFER_POOL_WINDOW <= ++Class->WindowCount)
+    {
+        Class->Target = Class->WindowPeak;
+        Class->WindowPeak = Class->InUseCount;
+        Class->WindowCount = 0;
+    }
+    if (FspBufferPoolCountMax(ClassIndex) < Class->Target)
+        Class->Target = FspBufferPoolCountMax(ClassIndex);
+
+    ItemId = Item->ItemId;
+
+    FspBufferPoolUnlock(&Shard->Lock, LockState);
+
+    if (0 != NewItem)
+        FspBufferPoolFreeNonPaged(NewItem);
+
+    if (0 == Entry)
+    {
+        Entry = FspBufferPoolAllocNonPaged(sizeof *Entry);
+        if (0 == Entry)
+        {
+            Result = STATUS_INSUFFICIENT_RESOURCES;
+            goto fail;
+        }
+        RtlZeroMemory(Entry, sizeof *Entry);
+        Entry->ItemId = ItemId;
+        Entry->ShardIndex = (UINT16)ShardIndex;
+        Entry->ClassIndex = (UINT16)ClassIndex;
+
+        Result = FspBufferPoolAllocateMemory(
+            (SIZE_T)FSP_BUFFER_POOL_SIZE_MIN << ClassIndex, &Entry->Buffer);
+        if (!NT_SUCCESS(Result))
+        {
+            Entry->Buffer = 0;
+            goto fail;
+        }
+    }
+
+    *PBufferCookie = Entry;
+    *PBuffer = Entry->Buffer;
+
+    return STATUS_SUCCESS;
+
+fail:
+    FspBufferPoolReturn(Pool, ProcessId, ShardIndex, ClassIndex, ItemId, Entry);
+
+    return Result;
+}
+
+VOID FspBufferPoolRelease(FSP_BUFFER_POOL *Pool, HANDLE ProcessId,
+    PVOID BufferCookie, PVOID Buffer)
+{
+    FSP_BUFFER_POOL_ENTRY *Entry = BufferCookie;
+
+    if (0 == Entry)
+    {
+        FspBufferPoolFreeMemory(Buffer);
+        return;
+    }
+
+    ASSERT(Buffer == Entry->Buffer);
+
+    FspBufferPoolReturn(Pool, ProcessId, Entry->ShardIndex, Entry->ClassIndex, Entry->ItemId,
+        Entry);
+}
+
+VOID FspBufferPoolCollect(FSP_BUFFER_POOL *Pool, HANDLE ProcessId)
+{
+    FSP_BUFFER_POOL_SHARD *Shard;
+    FSP_BUFFER_POOL_LOCK_STATE LockState;
+    FSP_BUFFER_POOL_ITEM *Item;
+
+    for (ULONG I = 0; Pool->ShardMask >= I; I++)
+    {
+        Shard = &Pool->Shards[I].V;
+        Item = 0;
+
+        FspBufferPoolLock(&Shard->Lock, &LockState);
+
+        for (FSP_BUFFER_POOL_ITEM **P = FspBufferPoolBucket(Shard, ProcessId); *P; P = &(*P)->HashNext)
+            if ((*P)->ProcessId == ProcessId)
+            {
+                Item = *P;
+                *P = (*P)->HashNext;
+                break;
+            }
+
+        FspBufferPoolUnlock(&Shard->Lock, LockState);
+
+        if (0 != Item)
+            FspBufferPoolFreeItem(Item);
+    }
+}
+
+VOID FspBufferPoolGetStatistics(FSP_BUFFER_POOL *Pool, FSP_BUFFER_POOL_STATISTICS *Statistics)
+{
+    FSP_BUFFER_POOL_SHARD *Shard;
+    FSP_BUFFER_POOL_LOCK_STATE LockState;
+
+    RtlZeroMemory(Statistics, sizeof *Statistics);
+
+    for (ULONG I = 0; Pool->ShardMask >= I; I++)
+    {
+        Shard = &Pool->Shards[I].V;
+
+        FspBufferPoolLock(&Shard->Lock, &LockState);
+
+        Statistics->AcquireCount += Shard->Statistics.AcquireCount;
+        Statistics->HitCount += Shard->Statistics.HitCount;
+        Statistics->AllocateCount += Shard->Statistics.AllocateCount;
+        Statistics->DeallocateCount += Shard->Statistics.DeallocateCount;
+        Statistics->UncachedCount += Shard->Statistics.UncachedCount;
+        for (ULONG J = 0; FSP_BUFFER_POOL_BUCKET_COUNT > J; J++)
+            for (FSP_BUFFER_POOL_ITEM *Item = Shard->Buckets[J]; 0 != Item; Item = Item->HashNext)
+                for (ULONG K = 0; FSP_BUFFER_POOL_CLASS_COUNT_MAX > K; K++)
+                    Statistics->CachedCount += Item->Classes[K].FreeCount;
+
+        FspBufferPoolUnlock(&Shard->Lock, LockState);
+    }
+}
@@ -0,0 +1,61 @@
+/**
+ * @file shared/ku/bufpool.h
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#ifndef WINFSP_SHARED_KU_BUFPOOL_H_INCLUDED
+#define WINFSP_SHARED_KU_BUFPOOL_H_INCLUDED
+
+/*
+ * Buffer Pool
+ *
+ * A buffer pool caches virtual memory buffers that are allocated in the address space of
+ * the current process (in the FSD: the file system process that receives a request).
+ * Buffers are grouped in power-of-two size classes from FSP_BUFFER_POOL_SIZE_MIN up to a
+ * ceiling that is fixed when the pool is created; larger buffers are allocated and freed
+ * on every use. See bufpool.c for details.
+ *
+ * The process id that is passed to Acquire and Release must be that of the current
+ * process. Collect must be called when a process goes away.
+ */
+
+#define FSP_BUFFER_POOL_SIZE_MIN        (64 * 1024)
+#define FSP_BUFFER_POOL_SIZE_MAX        (16 * 1024 * 1024)
+
+typedef struct _FSP_BUFFER_POOL FSP_BUFFER_POOL;
+typedef struct
+{
+    UINT64 AcquireCount;                /* buffers acquired */
+    UINT64 HitCount;                    /* buffers acquired from the cache */
+    UINT64 AllocateCount;               /* virtual memory allocations */
+    UINT64 DeallocateCount;             /* virtual memory deallocations */
+    UINT64 UncachedCount;               /* buffers larger than the ceiling */
+    UINT64 CachedCount;                 /* buffers currently in the cache */
+} FSP_BUFFER_POOL_STATISTICS;
+
+NTSTATUS FspBufferPoolCreate(ULONG SizeMax, ULONG ShardCount, FSP_BUFFER_POOL **PPool);
+VOID FspBufferPoolDelete(FSP_BUFFER_POOL *Pool);
+NTSTATUS FspBufferPoolAcquire(FSP_BUFFER_POOL *Pool, HANDLE ProcessId,
+    SIZE_T BufferSize, PVOID *PBufferCookie, PVOID *PBuffer);
+VOID FspBufferPoolRelease(FSP_BUFFER_POOL *Pool, HANDLE ProcessId,
+    PVOID BufferCookie, PVOID Buffer);
+VOID FspBufferPoolCollect(FSP_BUFFER_POOL *Pool, HANDLE ProcessId);
+VOID FspBufferPoolGetStatistics(FSP_BUFFER_POOL *Pool, FSP_BUFFER_POOL_STATISTICS *Statistics);
+
+#endif
@@ -0,0 +1,180 @@
+/**
+ * @file shared/ku/dataring.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <shared/ku/library.h>
+
+/*
+ * Data Ring
+ *
+ * A data ring manages a contiguous data area that is divided into SlotCount slots of
+ * SlotSize bytes each. It is used by the FSD to hand out read buffers that live in the
+ * user mode file system process: the FSD acquires a slot when it prepares a Read request,
+ * the file system writes the read payload into the slot and the FSD copies the payload
+ * into the IRP's locked MDL and releases the slot when the request completes. The FSD
+ * uses the ring only in place of a process buffer (double buffered reads); it never
+ * replaces the zero-copy user mode mapping. The data area itself is opaque to this
+ * module; the ring only manages slot ownership.
+ *
+ * Protocol
+ *
+ * The ring has a single producer index (Head) and a state word per slot:
+ *
+ * - Head is a free running counter. Every acquisition attempt takes a ticket by
+ * incrementing Head; the ticket's low bits (Ticket & (SlotCount - 1)) select the slot
+ * and the ticket itself becomes the slot's sequence number if the attempt succeeds.
+ *
+ * - A slot's state word is (Sequence << 1) | Busy. A slot is acquired by a successful
+ * compare-exchange of a state word that has Busy clear to one that has Busy set and the
+ * new sequence number. If the slot is still busy (its previous owner has not released
+ * it yet) the attempt fails and a new ticket is taken; after SlotCount failed attempts
+ * the ring is considered full and the caller must use a different buffer.
+ *
+ * - A slot is released by a compare-exchange from (Sequence << 1) | 1 to (Sequence << 1).
+ * The release must present the sequence number obtained by the acquisition, so a stale
+ * or duplicate release (e.g. of a request that has already been completed) is detected
+ * and ignored rather than freeing a slot that now belongs to somebody else.
+ *
+ * Slots are released in any order; a slot that is held for a long time (e.g. by a pended
+ * read) does not block the rest of the ring, because acquirers skip over busy slots. The
+ * consumer index is therefore implicit: it is the set of slots whose Busy bit is clear.
+ *
+ * Sequence numbers are 31 bits wide (so that a slot state fits into a LONG on all
+ * platforms). A stale release can only be mistaken for a valid one if exactly a multiple
+ * of 2^31 acquisitions of the same slot happen in between, which is not a practical
+ * concern.
+ *
+ * All operations are lock-free and may be called at IRQL <= DISPATCH_LEVEL if the ring
+ * is allocated from non-paged memory. The ring does not synchronize access to the data
+ * area; that is the responsibility of the slot owner.
+ */
+
+#if !defined(_KERNEL_MODE)
+typedef struct _FSP_DATA_RING FSP_DATA_RING;
+#endif
+
+struct _FSP_DATA_RING
+{
+    PUINT8 Buffer;
+    ULONG SlotSize, SlotCount;
+    volatile LONG Head;
+    volatile LONG AcquireCount, ReleaseCount, FullCount;
+    volatile LONG State[];
+};
+
+#define FspDataRingTicketSequence(T)    ((ULONG)(T) & 0x7fffffff)
+
+NTSTATUS FspDataRingCreate(PVOID Buffer, ULONG SlotSize, ULONG SlotCount,
+    FSP_DATA_RING **PDataRing)
+{
+    FSP_KU_CODE;
+
+    FSP_DATA_RING *DataRing;
+
+    *PDataRing = 0;
+
+    if (0 == SlotSize || 0 == SlotCount || 0 != (SlotCount & (SlotCount - 1)) ||
+        FspFsctlDataRingSlotCountMaximum < SlotCount)
+        return STATUS_INVALID_PARAMETER;
+
+    DataRing = MemAlloc(sizeof *DataRing + SlotCount * sizeof DataRing->State[0]);
+    if (0 == DataRing)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    RtlZeroMemory(DataRing, sizeof *DataRing + SlotCount * sizeof DataRing->State[0]);
+    DataRing->Buffer = Buffer;
+    DataRing->SlotSize = SlotSize;
+    DataRing->SlotCount = SlotCount;
+
+    *PDataRing = DataRing;
+
+    return STATUS_SUCCESS;
+}
+
+VOID FspDataRingDelete(FSP_DATA_RING *DataRing)
+{
+    FSP_KU_CODE;
+
+    MemFree(DataRing);
+}
+
+BOOLEAN FspDataRingAcquire(FSP_DATA_RING *DataRing, PULONG PSequence, PVOID *PAddress)
+{
+    ULONG Ticket, Sequence, Index;
+    LONG State;
+
+    for (ULONG Attempt = 0; DataRing->SlotCount > Attempt; Attempt++)
+    {
+        Ticket = (ULONG)InterlockedIncrement(&DataRing->Head) - 1;
+        Sequence = FspDataRingTicketSequence(Ticket);
+        Index = Ticket & (DataRing->SlotCount - 1);
+
+        State = DataRing->State[Index];
+        if (0 == (State & 1) &&
+            State == InterlockedCompareExchange(&DataRing->State[Index], (LONG)(Sequence << 1) | 1, State))
+        {
+            InterlockedIncrement(&DataRing->AcquireCount);
+
+            *PSequence = Sequence;
+            *PAddress = DataRing->Buffer + (SIZE_T)Index * DataRing->SlotSize;
+            return TRUE;
+        }
+    }
+
+    InterlockedIncrement(&DataRing->FullCount);
+
+    *PSequence = 0;
+    *PAddress = 0;
+    return FALSE;
+}
+
+BOOLEAN FspDataRingRelease(FSP_DATA_RING *DataRing, ULONG Sequence, PVOID Address)
+{
+    ULONG Index;
+    LONG State;
+
+    if (DataRing->Buffer > (PUINT8)Address ||
+        (SIZE_T)((PUINT8)Address - DataRing->Buffer) >= (SIZE_T)DataRing->SlotCount * DataRing->SlotSize ||
+        0 != (SIZE_T)((PUINT8)Address - DataRing->Buffer) % DataRing->SlotSize)
+        return FALSE;
+
+    Index = (ULONG)((SIZE_T)((PUINT8)Address - DataRing->Buffer) / DataRing->SlotSize);
+    State = (LONG)(FspDataRingTicketSequence(Sequence) << 1);
+
+    if ((State | 1) != InterlockedCompareExchange(&DataRing->State[Index], State, State | 1))
+        return FALSE;
+
+    InterlockedIncrement(&DataRing->ReleaseCount);
+
+    return TRUE;
+}
+
+ULONG FspDataRingSlotSize(FSP_DATA_RING *DataRing)
+{
+    return DataRing->SlotSize;
+}
+
+VOID FspDataRingGetStatistics(FSP_DATA_RING *DataRing,
+    PULONG PAcquireCount, PULONG PReleaseCount, PULONG PFullCount)
+{
+    *PAcquireCount = (ULONG)DataRing->AcquireCount;
+    *PReleaseCount = (ULONG)DataRing->ReleaseCount;
+    *PFullCount = (ULONG)DataRing->FullCount;
+}
@@ -0,0 +1,450 @@
+/**
+ * @file shared/ku/nametab.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <shared/ku/library.h>
+#include <shared/ku/nametab.h>
+
+/*
+ * Name Table
+ *
+ * The table is split into FSP_NAME_TABLE_SHARD_COUNT shards. Each shard is an independent
+ * chained hash table with its own reader/writer lock and its own bucket array, which grows
+ * as the shard fills up. Lookups acquire a single shard shared; insertions and removals
+ * acquire a single shard exclusive.
+ *
+ * Hashing
+ *
+ * The hash of a name is computed over the case-folded name (if the table is case
+ * insensitive) and is cached in the entry, so that rehashing and most failed comparisons
+ * do not have to look at the name at all. The stream suffix of a name (":stream" in
+ * "\dir\file:stream") is not included in the hash: a file and all its named streams
+ * therefore hash to the same bucket. This allows the streams of a file to be enumerated
+ * by visiting a single bucket.
+ *
+ * Enumeration
+ *
+ * FspNameTableEnumerate returns the contexts of all names that have a given prefix (the
+ * prefix itself and its streams and, unless StreamsOnly is specified, its descendants). It
+ * is restartable through an FSP_NAME_TABLE_RESTART_KEY. Enumeration order is unspecified.
+ * Descendant enumeration visits the whole table; it is only used for rare operations such
+ * as directory rename. The caller must ensure that the table is not modified during an
+ * enumeration; in the FSD all modifications happen under the volume ContextTableMutex.
+ */
+
+#define FSP_NAME_TABLE_SHARD_BITS       4
+#define FSP_NAME_TABLE_SHARD_COUNT      (1 << FSP_NAME_TABLE_SHARD_BITS)
+#define FSP_NAME_TABLE_BUCKET_COUNT     16
+#define FSP_NAME_TABLE_BUCKET_COUNT_MAX (64 * 1024)
+
+#if defined(_KERNEL_MODE)
+typedef ERESOURCE FSP_NAME_TABLE_LOCK;
+#define FspNameTableLockInitialize(L)   ExInitializeResourceLite(L)
+#define FspNameTableLockFinalize(L)     ExDeleteResourceLite(L)
+#define FspNameTableLockShared(L)       ExEnterCriticalRegionAndAcquireResourceShared(L)
+#define FspNameTableUnlockShared(L)     ExReleaseResourceAndLeaveCriticalRegion(L)
+#define FspNameTableLockExclusive(L)    ExEnterCriticalRegionAndAcquireResourceExclusive(L)
+#define FspNameTableUnlockExclusive(L)  ExReleaseResourceAndLeaveCriticalRegion(L)
+#define FspNameTableAllocNonPaged(S)    FspAllocNonPaged(S)
+#else
+typedef SRWLOCK FSP_NAME_TABLE_LOCK;
+#define FspNameTableLockInitialize(L)   InitializeSRWLock(L)
+#define FspNameTableLockFinalize(L)     ((VOID)0)
+#define FspNameTableLockShared(L)       AcquireSRWLockShared(L)
+#define FspNameTableUnlockShared(L)     ReleaseSRWLockShared(L)
+#define FspNameTableLockExclusive(L)    AcquireSRWLockExclusive(L)
+#define FspNameTableUnlockExclusive(L)  ReleaseSRWLockExclusive(L)
+#define FspNameTableAllocNonPaged(S)    MemAlloc(S)
+#endif
+
+typedef struct
+{
+    FSP_NAME_TABLE_LOCK Lock;
+    FSP_NAME_TABLE_ENTRY **Buckets;
+    ULONG BucketCount;
+    ULONG Count;
+} FSP_NAME_TABLE_SHARD;
+
+struct _FSP_NAME_TABLE
+{
+    BOOLEAN CaseInsensitive;
+    FSP_NAME_TABLE_SHARD Shards[FSP_NAME_TABLE_SHARD_COUNT];
+};
+
+static inline BOOLEAN FspNameTableEqualChars(PWCH P1, PWCH P2, ULONG Count,
+    BOOLEAN CaseInsensitive)
+{
+    if (CaseInsensitive)
+        return FspUpcaseEqual(P1, P2, Count);
+    else
+        return 0 == memcmp(P1, P2, Count * sizeof(WCHAR));
+}
+
+static inline BOOLEAN FspNameTableEqual(PUNICODE_STRING FileName1, PUNICODE_STRING FileName2,
+    BOOLEAN CaseInsensitive)
+{
+    return FileName1->Length == FileName2->Length &&
+        FspNameTableEqualChars(FileName1->Buffer, FileName2->Buffer,
+            FileName1->Length / sizeof(WCHAR), CaseInsensitive);
+}
+
+static inline BOOLEAN FspNameTableIsPrefix(PUNICODE_STRING Prefix, PUNICODE_STRING FileName,
+    BOOLEAN StreamsOnly, BOOLEAN CaseInsensitive)
+{
+    WCHAR C;
+
+    if (Prefix->Length > FileName->Length ||
+        !FspNameTableEqualChars(Prefix->Buffer, FileName->Buffer,
+            Prefix->Length / sizeof(WCHAR), CaseInsensitive))
+        return FALSE;
+
+    if (Prefix->Length == FileName->Length)
+        return TRUE;
+
+    C = FileName->Buffer[Prefix->Length / sizeof(WCHAR)];
+    return L':' == C || (!StreamsOnly && L'\\' == C);
+}
+
+static ULONG FspNameTableHash(PUNICODE_STRING FileName, BOOLEAN CaseInsensitive)
+{
+    PWCH P = FileName->Buffer, EndP = P + FileName->Length / sizeof(WCHAR), StreamP = 0;
+    ULONG Hash = 2166136261;
+
+    /* exclude the stream suffix (if any) from the hash */
+    for (PWCH Q = P; EndP > Q; Q++)
+        if (L'\\' == *Q)
+            StreamP = 0;
+        else if (L':' == *Q && 0 == StreamP)
+            StreamP = Q;
+    if (0 != StreamP)
+        EndP = StreamP;
+
+    if (CaseInsensitive)
+        Hash = FspUpcaseHash(P, (ULONG)(EndP - P), Hash);
+    else
+        for (; EndP > P; P++)
+            Hash = (Hash ^ *P) * 16777619;
+
+    /* FNV-1a has weak high bits; mix them, because they select the shard */
+    Hash ^= Hash >> 16;
+    Hash *= 0x85ebca6b;
+    Hash ^= Hash >> 13;
+    Hash *= 0xc2b2ae35;
+    Hash ^= Hash >> 16;
+
+    return Hash;
+}
+
+static inline FSP_NAME_TABLE_SHARD *FspNameTableShard(FSP_NAME_TABLE *NameTable, ULONG Hash)
+{
+    return &NameTable->Shards[Hash >> (32 - FSP_NAME_TABLE_SHARD_BITS)];
+}
+
+static inline FSP_NAME_TABLE_ENTRY **FspNameTableBucket(FSP_NAME_TABLE_SHARD *Shard, ULONG Hash)
+{
+    return &Shard->Buckets[Hash & (Shard->BucketCount - 1)];
+}
+
+static VOID FspNameTableShardGrow(FSP_NAME_TABLE_SHARD *Shard)
+{
+    FSP_NAME_TABLE_ENTRY **NewBuckets, *Entry, *NextEntry, **Bucket;
+    ULONG NewBucketCount;
+
+    NewBucketCount = Shard->BucketCount * 2;
+    NewBuckets = MemAlloc(NewBucketCount * sizeof *NewBuckets);
+    if (0 == NewBuckets)
+        return; /* not fatal: the shard just gets slower */
+    RtlZeroMemory(NewBuckets, NewBucketCount * sizeof *NewBuckets);
+
+    for (ULONG I = 0; Shard->BucketCount > I; I++)
+        for (Entry = Shard->Buckets[I]; 0 != Entry; Entry = NextEntry)
+        {
+            NextEntry = Entry->HashNext;
+            Bucket = &NewBuckets[Entry->Hash & (NewBucketCount - 1)];
+            Entry->HashNext = *Bucket;
+            *Bucket = Entry;
+        }
+
+    MemFree(Shard->Buckets);
+    Shard->Buckets = NewBuckets;
+    Shard->BucketCount = NewBucketCount;
+}
+
+NTSTATUS FspNameTableCreate(BOOLEAN CaseInsensitive, FSP_NAME_TABLE **PNameTable)
+{
+    FSP_KU_CODE;
+
+    FSP_NAME_TABLE *NameTable;
+    FSP_NAME_TABLE_SHARD *Shard;
+
+    *PNameTable = 0;
+
+    /* the table contains the shard locks, which must be non-paged in kernel mode */
+    NameTable = FspNameTableAllocNonPaged(sizeof *NameTable);
+    if (0 == NameTable)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    RtlZeroMemory(NameTable, sizeof *NameTable);
+    NameTable->CaseInsensitive = CaseInsensitive;
+
+    for (ULONG I = 0; FSP_NAME_TABLE_SHARD_COUNT > I; I++)
+    {
+        Shard = &NameTable->Shards[I];
+        Shard->Buckets = MemAlloc(FSP_NAME_TABLE_BUCKET_COUNT * sizeof *Shard->Buckets);
+        if (0 == Shard->Buckets)
+        {
+            for (ULONG J = 0; I > J; J++)
+            {
+                FspNameTableLockFinalize(&NameTable->Shards[J].Lock);
+                MemFree(NameTable->Shards[J].Buckets);
+            }
+            MemFree(NameTable);
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+        RtlZeroMemory(Shard->Buckets, FSP_NAME_TABLE_BUCKET_COUNT * sizeof *Shard->Buckets);
+        Shard->BucketCount = FSP_NAME_TABLE_BUCKET_COUNT;
+        FspNameTableLockInitialize(&Shard->Lock);
+    }
+
+    *PNameTable = NameTable;
+
+    return STATUS_SUCCESS;
+}
+
+VOID FspNameTableDelete(FSP_NAME_TABLE *NameTable)
+{
+    FSP_KU_CODE;
+
+    /* entries are owned by the caller; there is nothing to free for them */
+    for (ULONG I = 0; FSP_NAME_TABLE_SHARD_COUNT > I; I++)
+    {
+        FspNameTableLockFinalize(&NameTable->Shards[I].Lock);
+        MemFree(NameTable->Shards[I].Buckets);
+    }
+
+    MemFree(NameTable);
+}
+
+PVOID FspNameTableLookup(FSP_NAME_TABLE *NameTable, PUNICODE_STRING FileName,
+    VOID (*Reference)(PVOID Context))
+{
+    FSP_KU_CODE;
+
+    ULONG Hash = FspNameTableHash(FileName, NameTable->CaseInsensitive);
+    FSP_NAME_TABLE_SHARD *Shard = FspNameTableShard(NameTable, Hash);
+    FSP_NAME_TABLE_ENTRY *Entry;
+    PVOID Context = 0;
+
+    FspNameTableLockShared(&Shard->Lock);
+
+    for (Entry = *FspNameTableBucket(Shard, Hash); 0 != Entry; Entry = Entry->HashNext)
+        if (Hash == Entry->Hash &&
+            FspNameTableEqual(FileName, Entry->FileName, NameTable->CaseInsensitive))
+        {
+            Context = Entry->Context;
+            if (0 != Reference)
+                Reference(Context);
+            break;
+        }
+
+    FspNameTableUnlockShared(&Shard->Lock);
+
+    return Context;
+}
+
+PVOID FspNameTableInsert(FSP_NAME_TABLE *NameTable, PUNICODE_STRING FileName, PVOID Context,
+    FSP_NAME_TABLE_ENTRY *Entry, PBOOLEAN PInserted)
+{
+    FSP_KU_CODE;
+
+    ULONG Hash = FspNameTableHash(FileName, NameTable->CaseInsensitive);
+    FSP_NAME_TABLE_SHARD *Shard = FspNameTableShard(NameTable, Hash);
+    FSP_NAME_TABLE_ENTRY **Bucket, *OtherEntry;
+    BOOLEAN Inserted = FALSE;
+
+    FspNameTableLockExclusive(&Shard->Lock);
+
+    Bucket = FspNameTableBucket(Shard, Hash);
+    for (OtherEntry = *Bucket; 0 != OtherEntry; OtherEntry = OtherEntry->HashNext)
+        if (Hash == OtherEntry->Hash &&
+            FspNameTableEqual(FileName, OtherEntry->FileName, NameTable->CaseInsensitive))
+        {
+            Context = OtherEntry->Context;
+            goto exit;
+        }
+
+    Entry->FileName = FileName;
+    Entry->Context = Context;
+    Entry->Hash = Hash;
+    Entry->HashNext = *Bucket;
+    *Bucket = Entry;
+    Inserted = TRUE;
+
+    Shard->Count++;
+    if (Shard->Count > 2 * Shard->BucketCount &&
+        FSP_NAME_TABLE_BUCKET_COUNT_MAX > Shard->BucketCount)
+        FspNameTableShardGrow(Shard);
+
+exit:
+    FspNameTableUnlockExclusive(&Shard->Lock);
+
+    if (0 != PInserted)
+        *PInserted = Inserted;
+
+    return Context;
+}
+
+BOOLEAN FspNameTableRemove(FSP_NAME_TABLE *NameTable, PUNICODE_STRING FileName)
+{
+    FSP_KU_CODE;
+
+    ULONG Hash = FspNameTableHash(FileName, NameTable->CaseInsensitive);
+    FSP_NAME_TABLE_SHARD *Shard = FspNameTableShard(NameTable, Hash);
+    FSP_NAME_TABLE_ENTRY **PEntry;
+    BOOLEAN Removed = FALSE;
+
+    FspNameTableLockExclusive(&Shard->Lock);
+
+    for (PEntry = FspNameTableBucket(Shard, Hash); 0 != *PEntry; PEntry = &(*PEntry)->HashNext)
+        if (Hash == (*PEntry)->Hash &&
+            FspNameTableEqual(FileName, (*PEntry)->FileName, NameTable->CaseInsensitive))
+        {
+            *PEntry = (*PEntry)->HashNext;
+            Shard->Count--;
+            Removed = TRUE;
+            break;
+        }
+
+    FspNameTableUnlockExclusive(&Shard->Lock);
+
+    return Removed;
+}
+
+PVOID FspNameTableEnumerate(FSP_NAME_TABLE *NameTable, PUNICODE_STRING Prefix, BOOLEAN StreamsOnly,
+    FSP_NAME_TABLE_RESTART_KEY *RestartKey)
+{
+    FSP_KU_CODE;
+
+    FSP_NAME_TABLE_SHARD *Shard;
+    FSP_NAME_TABLE_ENTRY *Entry;
+    ULONG ShardIndex, ShardEnd, BucketIndex, BucketEnd, Index, Hash;
+    PVOID Context = 0;
+
+    /*
+     * The RestartKey records the shard and bucket of the last returned entry and the number
+     * of entries of that bucket that have been visited. A zeroed RestartKey starts a new
+     * enumeration.
+     */
+    if (FSP_NAME_TABLE_SHARD_COUNT <= RestartKey->Shard)
+        return 0;
+
+    if (StreamsOnly && 0 != Prefix)
+    {
+        Hash = FspNameTableHash(Prefix, NameTable->CaseInsensitive);
+        ShardIndex = Hash >> (32 - FSP_NAME_TABLE_SHARD_BITS);
+        ShardEnd = ShardIndex + 1;
+    }
+    else
+    {
+        Hash = 0;
+        ShardIndex = RestartKey->Shard;
+        ShardEnd = FSP_NAME_TABLE_SHARD_COUNT;
+    }
+
+    for (; ShardEnd > ShardIndex; ShardIndex++)
+    {
+        Shard = &NameTable->Shards[ShardIndex];
+
+        FspNameTableLockShared(&Shard->Lock);
+
+        if (StreamsOnly && 0 != Prefix)
+        {
+            BucketIndex = Hash & (Shard->BucketCount - 1);
+            BucketEnd = BucketIndex + 1;
+        }
+        else
+        {
+            BucketIndex = ShardIndex == RestartKey->Shard ? RestartKey->Bucket : 0;
+            BucketEnd = Shard->BucketCount;
+        }
+
+        for (; BucketEnd > BucketIndex; BucketIndex++)
+        {
+            Index = ShardIndex == RestartKey->Shard && BucketIndex == RestartKey->Bucket ?
+                RestartKey->Index : 0;
+
+            Entry = Shard->Buckets[BucketIndex];
+            for (ULONG I = 0; 0 != Entry && Index > I; I++)
+                Entry = Entry->HashNext;
+
+            for (; 0 != Entry; Entry = Entry->HashNext)
+            {
+                Index++;
+                if (0 == Prefix ||
+                    ((!StreamsOnly || Hash == Entry->Hash) &&
+                    FspNameTableIsPrefix(Prefix, Entry->FileName, StreamsOnly,
+                        NameTable->CaseInsensitive)))
+                {
+                    Context = Entry->Context;
+                    break;
+                }
+            }
+
+            if (0 != Context)
+            {
+                RestartKey->Shard = ShardIndex;
+                RestartKey->Bucket = BucketIndex;
+                RestartKey->Index = Index;
+                break;
+            }
+        }
+
+        FspNameTableUnlockShared(&Shard->Lock);
+
+        if (0 != Context)
+            break;
+    }
+
+    if (0 == Context)
+    {
+        /* enumeration is done; make sure that further calls also return nothing */
+        RestartKey->Shard = FSP_NAME_TABLE_SHARD_COUNT;
+        RestartKey->Bucket = 0;
+        RestartKey->Index = 0;
+    }
+
+    return Context;
+}
+
+ULONG FspNameTableCount(FSP_NAME_TABLE *NameTable)
+{
+    FSP_KU_CODE;
+
+    ULONG Count = 0;
+
+    for (ULONG I = 0; FSP_NAME_TABLE_SHARD_COUNT > I; I++)
+    {
+        FspNameTableLockShared(&NameTable->Shards[I].Lock);
+        Count += NameTable->Shards[I].Count;
+        FspNameTableUnlockShared(&NameTable->Shards[I].Lock);
+    }
+
+    return Count;
+}
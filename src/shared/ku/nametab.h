@@ -0,0 +1,61 @@
+/**
+ * @file shared/ku/nametab.h
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#ifndef WINFSP_SHARED_KU_NAMETAB_H_INCLUDED
+#define WINFSP_SHARED_KU_NAMETAB_H_INCLUDED
+
+/*
+ * Name Table
+ *
+ * A name table maps file names to contexts. It is a hash table that is split into a fixed
+ * number of shards, each with its own reader/writer lock, so that operations on different
+ * names rarely contend. See nametab.c for details.
+ *
+ * Entries are allocated by the caller (usually embedded in the context) and must remain
+ * valid while they are in the table. The FileName that an entry points to must not change
+ * while the entry is in the table.
+ */
+
+typedef struct _FSP_NAME_TABLE FSP_NAME_TABLE;
+typedef struct _FSP_NAME_TABLE_ENTRY
+{
+    struct _FSP_NAME_TABLE_ENTRY *HashNext;
+    PUNICODE_STRING FileName;
+    PVOID Context;
+    ULONG Hash;
+} FSP_NAME_TABLE_ENTRY;
+typedef struct
+{
+    ULONG Shard, Bucket, Index;
+} FSP_NAME_TABLE_RESTART_KEY;
+
+NTSTATUS FspNameTableCreate(BOOLEAN CaseInsensitive, FSP_NAME_TABLE **PNameTable);
+VOID FspNameTableDelete(FSP_NAME_TABLE *NameTable);
+PVOID FspNameTableLookup(FSP_NAME_TABLE *NameTable, PUNICODE_STRING FileName,
+    VOID (*Reference)(PVOID Context));
+PVOID FspNameTableInsert(FSP_NAME_TABLE *NameTable, PUNICODE_STRING FileName, PVOID Context,
+    FSP_NAME_TABLE_ENTRY *Entry, PBOOLEAN PInserted);
+BOOLEAN FspNameTableRemove(FSP_NAME_TABLE *NameTable, PUNICODE_STRING FileName);
+PVOID FspNameTableEnumerate(FSP_NAME_TABLE *NameTable, PUNICODE_STRING Prefix, BOOLEAN StreamsOnly,
+    FSP_NAME_TABLE_RESTART_KEY *RestartKey);
+ULONG FspNameTableCount(FSP_NAME_TABLE *NameTable);
+
+#endif
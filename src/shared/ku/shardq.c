@@ -0,0 +1,276 @@
+/**
+ * @file shared/ku/shardq.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+
+#include <shared/ku/library.h>
+#include <shared/ku/shardq.h>
+
+/*
+ * Shard Queue
+ *
+ * Shards
+ *
+ * The queue is split into a power-of-two number of shards. An entry is inserted into the
+ * shard of the current processor under that shard's lock, so that producers that run on
+ * different processors do not contend on a lock. Each shard is a plain FIFO list.
+ *
+ * Ordering
+ *
+ * Every inserted entry receives a sequence number from a queue-wide counter; within a shard
+ * sequence numbers increase from head to tail. Each shard publishes the sequence number of
+ * its head and a consumer looks for the shard with the oldest head without taking any
+ * locks (FspShardQueueOldestShard); it then locks that shard only and removes its head if
+ * the head is still the one it found. If an insertion happens before another one, the first
+ * entry has the lower sequence number and is removed first, so entries are removed in the
+ * order in which they were inserted, as with a single list.
+ *
+ * A single pass over the shards is not enough for this: it may read shard A before an
+ * entry is inserted there and shard B after a later entry is inserted there. For this
+ * reason the scan is repeated until a pass that starts after the oldest head was observed
+ * does not find an older one. Such a pass sees every entry that was inserted before the
+ * oldest head, either as a head or behind an even older head.
+ *
+ * An entry may be removed from the middle of a shard at any time (e.g. cancelation); the
+ * shard republishes its head when needed.
+ *
+ * Waiters
+ *
+ * The queue keeps a count of all entries and a count of waiting consumers, each updated
+ * with interlocked operations. A consumer announces itself (FspShardQueueBeginWait) before
+ * checking the entry count and a producer reads the waiter count after incrementing the
+ * entry count. At least one of them sees the other; so a producer only needs to wake up a
+ * consumer when there is one waiting, and then only one, and a consumer never sleeps on a
+ * non-empty queue. Removal reports whether entries remain while consumers wait, so that
+ * wakeups are passed along one consumer at a time.
+ *
+ * This code runs under spin locks in the FSD and must not be pageable.
+ */
+
+#define FSP_SHARD_QUEUE_SHARD_COUNT_MAX 64
+#define FSP_SHARD_QUEUE_CACHE_LINE      64
+
+#if defined(_KERNEL_MODE)
+#define FspShardQueueLockInitialize(L)  KeInitializeSpinLock(L)
+#define FspShardQueueAllocNonPaged(S)   FspAllocNonPaged(S)
+#define FspShardQueueFreeNonPaged(P)    FspFree(P)
+#define FspShardQueueCurrentProcessor() KeGetCurrentProcessorNumber()
+#else
+#define FspShardQueueLockInitialize(L)  InitializeSRWLock(L)
+#define FspShardQueueAllocNonPaged(S)   MemAlloc(S)
+#define FspShardQueueFreeNonPaged(P)    MemFree(P)
+#define FspShardQueueCurrentProcessor() GetCurrentProcessorNumber()
+#endif
+
+#define FspShardQueueEntrySequence(Q, E)\
+    (*(UINT_PTR *)((PUINT8)(E) + (Q)->SequenceOffset))
+#define FspShardQueueSequenceBefore(A, B)\
+    (0 > (LONG)((ULONG)(A) - (ULONG)(B)))
+
+typedef struct
+{
+    volatile LONG Sequence;
+    volatile LONG Count;
+    volatile LONG WaiterCount;
+} FSP_SHARD_QUEUE_COUNTERS;
+
+typedef union
+{
+    FSP_SHARD_QUEUE_COUNTERS V;
+    UINT8 B[FSP_FSCTL_ALIGN_UP(sizeof(FSP_SHARD_QUEUE_COUNTERS), FSP_SHARD_QUEUE_CACHE_LINE)];
+} FSP_SHARD_QUEUE_COUNTERS_PADDED;
+
+struct _FSP_SHARD_QUEUE
+{
+    ULONG ShardMask;
+    ULONG ShardSize;
+    LONG SequenceOffset;
+    FSP_SHARD_QUEUE_COUNTERS *Counters;     /* cache line aligned */
+    PUINT8 Shards;                          /* cache line aligned */
+};
+
+NTSTATUS FspShardQueueCreate(ULONG ShardCount, ULONG ShardExtensionSize, LONG SequenceOffset,
+    FSP_SHARD_QUEUE **PQueue)
+{
+    FSP_SHARD_QUEUE *Queue;
+    ULONG ShardCountPow2, ShardSize, Size;
+
+    *PQueue = 0;
+
+    ShardCountPow2 = 1;
+    while (FSP_SHARD_QUEUE_SHARD_COUNT_MAX > ShardCountPow2 && ShardCountPow2 < ShardCount)
+        ShardCountPow2 <<= 1;
+
+    ShardSize = FSP_FSCTL_ALIGN_UP(sizeof(FSP_SHARD_QUEUE_SHARD) + ShardExtensionSize,
+        FSP_SHARD_QUEUE_CACHE_LINE);
+
+    /* the queue and its shards contain spin locks and must be non-paged in kernel mode */
+    Size = sizeof *Queue + FSP_SHARD_QUEUE_CACHE_LINE +
+        sizeof(FSP_SHARD_QUEUE_COUNTERS_PADDED) + ShardCountPow2 * ShardSize;
+    Queue = FspShardQueueAllocNonPaged(Size);
+    if (0 == Queue)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    RtlZeroMemory(Queue, Size);
+    Queue->ShardMask = ShardCountPow2 - 1;
+    Queue->ShardSize = ShardSize;
+    Queue->SequenceOffset = SequenceOffset;
+    Queue->Counters = (PVOID)FSP_FSCTL_ALIGN_UP((UINT_PTR)(Queue + 1), FSP_SHARD_QUEUE_CACHE_LINE);
+    Queue->Shards = (PUINT8)Queue->Counters + sizeof(FSP_SHARD_QUEUE_COUNTERS_PADDED);
+    for (ULONG I = 0; ShardCountPow2 > I; I++)
+    {
+        FSP_SHARD_QUEUE_SHARD *Shard = FspShardQueueShard(Queue, I);
+        FspShardQueueLockInitialize(&Shard->Lock);
+        InitializeListHead(&Shard->ListHead);
+    }
+
+    *PQueue = Queue;
+
+    return STATUS_SUCCESS;
+}
+
+VOID FspShardQueueDelete(FSP_SHARD_QUEUE *Queue)
+{
+    /* entries are owned by the caller, who must have removed them */
+    ASSERT(0 == Queue->Counters->Count);
+
+    FspShardQueueFreeNonPaged(Queue);
+}
+
+ULONG FspShardQueueShardCount(FSP_SHARD_QUEUE *Queue)
+{
+    return Queue->ShardMask + 1;
+}
+
+FSP_SHARD_QUEUE_SHARD *FspShardQueueShard(FSP_SHARD_QUEUE *Queue, ULONG Index)
+{
+    return (PVOID)(Queue->Shards + (Index & Queue->ShardMask) * Queue->ShardSize);
+}
+
+FSP_SHARD_QUEUE_SHARD *FspShardQueueCurrentShard(FSP_SHARD_QUEUE *Queue)
+{
+    return FspShardQueueShard(Queue, FspShardQueueCurrentProcessor());
+}
+
+static FSP_SHARD_QUEUE_SHARD *FspShardQueueScan(FSP_SHARD_QUEUE *Queue,
+    PLONG PHeadSequence)
+{
+    FSP_SHARD_QUEUE_SHARD *Shard, *OldestShard = 0;
+    LONG HeadSequence;
+
+    for (ULONG I = 0; Queue->ShardMask >= I; I++)
+    {
+        Shard = FspShardQueueShard(Queue, I);
+        if (0 == ReadAcquire(&Shard->Count))
+            continue;
+        HeadSequence = ReadAcquire(&Shard->HeadSequence);
+        if (0 == OldestShard || FspShardQueueSequenceBefore(HeadSequence, *PHeadSequence))
+        {
+            OldestShard = Shard;
+            *PHeadSequence = HeadSequence;
+        }
+    }
+
+    return OldestShard;
+}
+
+FSP_SHARD_QUEUE_SHARD *FspShardQueueOldestShard(FSP_SHARD_QUEUE *Queue,
+    PLONG PHeadSequence)
+{
+    FSP_SHARD_QUEUE_SHARD *OldestShard, *Shard;
+    LONG OldestSequence = 0, HeadSequence = 0;
+
+    /* lock-free; see Ordering above */
+    OldestShard = FspShardQueueScan(Queue, &OldestSequence);
+    if (0 == OldestShard)
+        return 0;
+    for (;;)
+    {
+        Shard = FspShardQueueScan(Queue, &HeadSequence);
+        if (0 == Shard || !FspShardQueueSequenceBefore(HeadSequence, OldestSequence))
+            break;
+        OldestShard = Shard;
+        OldestSequence = HeadSequence;
+    }
+
+    *PHeadSequence = OldestSequence;
+    return OldestShard;
+}
+
+BOOLEAN FspShardQueueInsertTail(FSP_SHARD_QUEUE *Queue, FSP_SHARD_QUEUE_SHARD *Shard,
+    PLIST_ENTRY Entry)
+{
+    FSP_SHARD_QUEUE_COUNTERS *Counters = Queue->Counters;
+    LONG Sequence;
+
+    Sequence = InterlockedIncrement(&Counters->Sequence);
+    FspShardQueueEntrySequence(Queue, Entry) = (ULONG)Sequence;
+    if (0 == Shard->Count)
+        WriteRelease(&Shard->HeadSequence, Sequence);
+    InsertTailList(&Shard->ListHead, Entry);
+    WriteRelease(&Shard->Count, Shard->Count + 1);
+
+    /* interlocked increment orders the waiter count read; see Waiters above */
+    InterlockedIncrement(&Counters->Count);
+    return 0 != Counters->WaiterCount;
+}
+
+BOOLEAN FspShardQueueRemove(FSP_SHARD_QUEUE *Queue, FSP_SHARD_QUEUE_SHARD *Shard,
+    PLIST_ENTRY Entry)
+{
+    FSP_SHARD_QUEUE_COUNTERS *Counters = Queue->Counters;
+    BOOLEAN WasHead = Shard->ListHead.Flink == Entry;
+
+    ASSERT(0 != Shard->Count);
+
+    RemoveEntryList(Entry);
+    FspShardQueueEntrySequence(Queue, Entry) = 0;
+    if (WasHead && 1 < Shard->Count)
+        WriteRelease(&Shard->HeadSequence,
+            (LONG)FspShardQueueEntrySequence(Queue, Shard->ListHead.Flink));
+    WriteRelease(&Shard->Count, Shard->Count - 1);
+
+    return 0 != InterlockedDecrement(&Counters->Count) && 0 != Counters->WaiterCount;
+}
+
+PLIST_ENTRY FspShardQueueNext(FSP_SHARD_QUEUE_SHARD *Shard, PLIST_ENTRY Entry)
+{
+    PLIST_ENTRY Next = 0 == Entry ? Shard->ListHead.Flink : Entry->Flink;
+    return &Shard->ListHead != Next ? Next : 0;
+}
+
+ULONG FspShardQueueCount(FSP_SHARD_QUEUE *Queue)
+{
+    return (ULONG)Queue->Counters->Count;
+}
+
+BOOLEAN FspShardQueueBeginWait(FSP_SHARD_QUEUE *Queue)
+{
+    FSP_SHARD_QUEUE_COUNTERS *Counters = Queue->Counters;
+
+    /* interlocked increment orders the entry count read; see Waiters above */
+    InterlockedIncrement(&Counters->WaiterCount);
+    return 0 == Counters->Count;
+}
+
+VOID FspShardQueueEndWait(FSP_SHARD_QUEUE *Queue)
+{
+    InterlockedDecrement(&Queue->Counters->WaiterCount);
+}
@@ -0,0 +1,82 @@
+/**
+ * @file shared/ku/shardq.h
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#ifndef WINFSP_SHARED_KU_SHARDQ_H_INCLUDED
+#define WINFSP_SHARED_KU_SHARDQ_H_INCLUDED
+
+/*
+ * Shard Queue
+ *
+ * A shard queue is a FIFO queue of LIST_ENTRY's that is split into shards, usually one per
+ * processor. Each shard has its own lock; entries are inserted into the shard of the current
+ * processor and are removed oldest first across all shards. See shardq.c for details.
+ *
+ * The queue does not lock shards itself. FspShardQueueInsertTail, FspShardQueueRemove and
+ * FspShardQueueNext must be called with the shard locked; the remaining functions may be
+ * called without any locks held. FspShardQueueOldestShard returns a hint: the caller locks
+ * the shard and removes its head only if the shard's HeadSequence is still the one that
+ * was returned; otherwise it looks again.
+ *
+ * Every entry has a UINT_PTR slot at a fixed offset from its LIST_ENTRY, which the queue
+ * uses to store a sequence number while the entry is queued. The slot is zeroed when the
+ * entry is removed.
+ */
+
+#if defined(_KERNEL_MODE)
+typedef KSPIN_LOCK FSP_SHARD_QUEUE_LOCK;
+typedef KIRQL FSP_SHARD_QUEUE_LOCK_STATE;
+#define FspShardQueueLock(S, P)         KeAcquireSpinLock(&(S)->Lock, P)
+#define FspShardQueueUnlock(S, T)       KeReleaseSpinLock(&(S)->Lock, T)
+#else
+typedef SRWLOCK FSP_SHARD_QUEUE_LOCK;
+typedef UCHAR FSP_SHARD_QUEUE_LOCK_STATE;
+#define FspShardQueueLock(S, P)         (*(P) = 0, AcquireSRWLockExclusive(&(S)->Lock))
+#define FspShardQueueUnlock(S, T)       ((VOID)(T), ReleaseSRWLockExclusive(&(S)->Lock))
+#endif
+
+typedef struct _FSP_SHARD_QUEUE FSP_SHARD_QUEUE;
+typedef struct
+{
+    FSP_SHARD_QUEUE_LOCK Lock;
+    LIST_ENTRY ListHead;
+    volatile LONG Count;
+    volatile LONG HeadSequence;         /* valid when Count != 0 */
+} FSP_SHARD_QUEUE_SHARD;
+#define FspShardQueueShardExtension(S)  ((PVOID)((S) + 1))
+
+NTSTATUS FspShardQueueCreate(ULONG ShardCount, ULONG ShardExtensionSize, LONG SequenceOffset,
+    FSP_SHARD_QUEUE **PQueue);
+VOID FspShardQueueDelete(FSP_SHARD_QUEUE *Queue);
+ULONG FspShardQueueShardCount(FSP_SHARD_QUEUE *Queue);
+FSP_SHARD_QUEUE_SHARD *FspShardQueueShard(FSP_SHARD_QUEUE *Queue, ULONG Index);
+FSP_SHARD_QUEUE_SHARD *FspShardQueueCurrentShard(FSP_SHARD_QUEUE *Queue);
+FSP_SHARD_QUEUE_SHARD *FspShardQueueOldestShard(FSP_SHARD_QUEUE *Queue,
+    PLONG PHeadSequence);
+BOOLEAN FspShardQueueInsertTail(FSP_SHARD_QUEUE *Queue, FSP_SHARD_QUEUE_SHARD *Shard,
+    PLIST_ENTRY Entry);
+BOOLEAN FspShardQueueRemove(FSP_SHARD_QUEUE *Queue, FSP_SHARD_QUEUE_SHARD *Shard,
+    PLIST_ENTRY Entry);
+PLIST_ENTRY FspShardQueueNext(FSP_SHARD_QUEUE_SHARD *Shard, PLIST_ENTRY Entry);
+ULONG FspShardQueueCount(FSP_SHARD_QUEUE *Queue);
+BOOLEAN FspShardQueueBeginWait(FSP_SHARD_QUEUE *Queue);
+VOID FspShardQueueEndWait(FSP_SHARD_QUEUE *Queue);
+
+#endif
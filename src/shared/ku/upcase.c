@@ -0,0 +1,298 @@
+/**
+ * @file shared/ku/upcase.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <shared/ku/library.h>
+
+FSP_API VOID FspUpcaseChars(PWCH Destination, PWCH Source, ULONG Count);
+FSP_API BOOLEAN FspUpcaseEqual(PWCH String1, PWCH String2, ULONG Count);
+FSP_API INT FspUpcaseCompare(PWCH String1, ULONG Length1, PWCH String2, ULONG Length2);
+FSP_API ULONG FspUpcaseHash(PWCH String, ULONG Count, ULONG Hash);
+
+/*
+ * Case-Insensitive Names
+ *
+ * Case-insensitive names are compared and hashed by upcasing every character, which is
+ * what NTFS and the FsRtl name functions do. Upcasing is done with RtlUpcaseUnicodeChar,
+ * which is expensive enough that upcasing one character at a time dominates name lookups
+ * and directory sorting in a case-insensitive file system.
+ *
+ * Most file names are ASCII. The functions in this file process names in blocks of
+ * FSP_UPCASE_BLOCK characters: if a block is pure ASCII (no character has any of the bits
+ * 0xff80 set) it is upcased with vector instructions (subtract 0x20 from every character
+ * in 'a'-'z'); otherwise the block falls back to upcasing one character at a time. The
+ * results are identical to the scalar definitions:
+ *
+ * - FspUpcaseEqual(S1, S2, N) == (Up(S1[I]) == Up(S2[I]) for all I < N)
+ * - FspUpcaseCompare returns Up(S1[I]) - Up(S2[I]) at the first differing I (if any),
+ *   otherwise Length1 - Length2.
+ * - FspUpcaseHash is FNV-1a over the upcased characters.
+ *
+ * Vector instructions are SSE2 on x64 (and x86 in user mode; the x86 kernel would have to
+ * save the floating point state first) and NEON on ARM64. Other targets use scalar code
+ * only. Wider vectors (AVX2) are not used: they would require runtime CPU detection and
+ * (in the kernel) saving extended processor state, while names are short.
+ */
+
+#if defined(_M_X64) || defined(__x86_64__) || \
+    (!defined(_KERNEL_MODE) && (defined(_M_IX86) || (defined(__i386__) && defined(__SSE2__))))
+#define FSP_UPCASE_SSE2
+#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define FSP_UPCASE_NEON
+#if defined(_MSC_VER)
+#include <arm64_neon.h>
+#else
+#include <arm_neon.h>
+#endif
+#endif
+
+#define FSP_UPCASE_BLOCK                8
+
+#if !defined(_KERNEL_MODE)
+NTSYSAPI WCHAR NTAPI RtlUpcaseUnicodeChar(WCHAR SourceCharacter);
+#endif
+
+static inline WCHAR FspUpcaseCharInline(WCHAR C)
+{
+    if (0x80 > C)
+        return L'a' <= C && C <= L'z' ? C - (L'a' - L'A') : C;
+    return RtlUpcaseUnicodeChar(C);
+}
+
+static inline ULONG FspUpcaseFirstBit(UINT64 Mask)
+{
+    /* Mask must be non-zero */
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    ULONG Index;
+    _BitScanForward64(&Index, Mask);
+    return Index;
+#elif defined(_MSC_VER)
+    ULONG Index;
+    if (!_BitScanForward(&Index, (ULONG)Mask))
+    {
+        _BitScanForward(&Index, (ULONG)(Mask >> 32));
+        Index += 32;
+    }
+    return Index;
+#else
+    return (ULONG)__builtin_ctzll(Mask);
+#endif
+}
+
+/*
+ * Block primitives; each one handles exactly FSP_UPCASE_BLOCK characters.
+ *
+ * - FspUpcaseBlockIsAscii: TRUE if no character in the block is outside ASCII.
+ * - FspUpcaseBlockAscii: upcase a block that is known to be ASCII.
+ * - FspUpcaseBlockFirstDiff: index of the first differing character in two blocks
+ *   or FSP_UPCASE_BLOCK if the blocks are equal.
+ */
+#if defined(FSP_UPCASE_SSE2)
+typedef __m128i FSP_UPCASE_VECTOR;
+
+static inline FSP_UPCASE_VECTOR FspUpcaseBlockLoad(PWCH P)
+{
+    return _mm_loadu_si128((const __m128i *)P);
+}
+
+static inline VOID FspUpcaseBlockStore(PWCH P, FSP_UPCASE_VECTOR V)
+{
+    _mm_storeu_si128((__m128i *)P, V);
+}
+
+static inline BOOLEAN FspUpcaseBlockIsAscii(FSP_UPCASE_VECTOR V)
+{
+    return 0xffff == _mm_movemask_epi8(
+        _mm_cmpeq_epi16(_mm_and_si128(V, _mm_set1_epi16((short)0xff80)), _mm_setzero_si128()));
+}
+
+static inline FSP_UPCASE_VECTOR FspUpcaseBlockAscii(FSP_UPCASE_VECTOR V)
+{
+    __m128i Lower = _mm_and_si128(
+        _mm_cmpgt_epi16(V, _mm_set1_epi16('a' - 1)),
+        _mm_cmplt_epi16(V, _mm_set1_epi16('z' + 1)));
+    return _mm_sub_epi16(V, _mm_and_si128(Lower, _mm_set1_epi16(0x20)));
+}
+
+static inline ULONG FspUpcaseBlockFirstDiff(FSP_UPCASE_VECTOR V1, FSP_UPCASE_VECTOR V2)
+{
+    /* movemask produces 2 bits per character */
+    ULONG Mask = ~(ULONG)_mm_movemask_epi8(_mm_cmpeq_epi16(V1, V2)) & 0xffff;
+    return 0 == Mask ? FSP_UPCASE_BLOCK : FspUpcaseFirstBit(Mask) >> 1;
+}
+#elif defined(FSP_UPCASE_NEON)
+typedef uint16x8_t FSP_UPCASE_VECTOR;
+
+static inline FSP_UPCASE_VECTOR FspUpcaseBlockLoad(PWCH P)
+{
+    return vld1q_u16((const uint16_t *)P);
+}
+
+static inline VOID FspUpcaseBlockStore(PWCH P, FSP_UPCASE_VECTOR V)
+{
+    vst1q_u16((uint16_t *)P, V);
+}
+
+static inline BOOLEAN FspUpcaseBlockIsAscii(FSP_UPCASE_VECTOR V)
+{
+    return 0 == vmaxvq_u16(vandq_u16(V, vdupq_n_u16(0xff80)));
+}
+
+static inline FSP_UPCASE_VECTOR FspUpcaseBlockAscii(FSP_UPCASE_VECTOR V)
+{
+    /* unsigned wrap-around: C - 'a' <= 'z' - 'a' iff 'a' <= C <= 'z' */
+    uint16x8_t Lower = vcleq_u16(vsubq_u16(V, vdupq_n_u16('a')), vdupq_n_u16('z' - 'a'));
+    return vsubq_u16(V, vandq_u16(Lower, vdupq_n_u16(0x20)));
+}
+
+static inline ULONG FspUpcaseBlockFirstDiff(FSP_UPCASE_VECTOR V1, FSP_UPCASE_VECTOR V2)
+{
+    /* narrow the compare result to 8 bits per character */
+    UINT64 Mask = ~vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(vceqq_u16(V1, V2))), 0);
+    return 0 == Mask ? FSP_UPCASE_BLOCK : FspUpcaseFirstBit(Mask) >> 3;
+}
+#endif
+
+FSP_API VOID FspUpcaseChars(PWCH Destination, PWCH Source, ULONG Count)
+{
+    ULONG I = 0;
+
+#if defined(FSP_UPCASE_SSE2) || defined(FSP_UPCASE_NEON)
+    for (; Count - I >= FSP_UPCASE_BLOCK; I += FSP_UPCASE_BLOCK)
+    {
+        FSP_UPCASE_VECTOR V = FspUpcaseBlockLoad(Source + I);
+        if (FspUpcaseBlockIsAscii(V))
+            FspUpcaseBlockStore(Destination + I, FspUpcaseBlockAscii(V));
+        else
+            for (ULONG J = I; I + FSP_UPCASE_BLOCK > J; J++)
+                Destination[J] = FspUpcaseCharInline(Source[J]);
+    }
+#endif
+
+    for (; Count > I; I++)
+        Destination[I] = FspUpcaseCharInline(Source[I]);
+}
+
+FSP_API BOOLEAN FspUpcaseEqual(PWCH String1, PWCH String2, ULONG Count)
+{
+    ULONG I = 0;
+
+#if defined(FSP_UPCASE_SSE2) || defined(FSP_UPCASE_NEON)
+    for (; Count - I >= FSP_UPCASE_BLOCK; I += FSP_UPCASE_BLOCK)
+    {
+        FSP_UPCASE_VECTOR V1 = FspUpcaseBlockLoad(String1 + I);
+        FSP_UPCASE_VECTOR V2 = FspUpcaseBlockLoad(String2 + I);
+        ULONG J = FspUpcaseBlockFirstDiff(V1, V2);
+        if (FSP_UPCASE_BLOCK == J)
+            continue;
+        if (FspUpcaseBlockIsAscii(V1) && FspUpcaseBlockIsAscii(V2))
+        {
+            if (FSP_UPCASE_BLOCK != FspUpcaseBlockFirstDiff(
+                FspUpcaseBlockAscii(V1), FspUpcaseBlockAscii(V2)))
+                return FALSE;
+        }
+        else
+        {
+            for (J += I; I + FSP_UPCASE_BLOCK > J; J++)
+                if (String1[J] != String2[J] &&
+                    FspUpcaseCharInline(String1[J]) != FspUpcaseCharInline(String2[J]))
+                    return FALSE;
+        }
+    }
+#endif
+
+    for (; Count > I; I++)
+        if (String1[I] != String2[I] &&
+            FspUpcaseCharInline(String1[I]) != FspUpcaseCharInline(String2[I]))
+            return FALSE;
+
+    return TRUE;
+}
+
+FSP_API INT FspUpcaseCompare(PWCH String1, ULONG Length1, PWCH String2, ULONG Length2)
+{
+    ULONG Count = Length1 < Length2 ? Length1 : Length2;
+    ULONG I = 0;
+    INT Result;
+
+#if defined(FSP_UPCASE_SSE2) || defined(FSP_UPCASE_NEON)
+    for (; Count - I >= FSP_UPCASE_BLOCK; I += FSP_UPCASE_BLOCK)
+    {
+        FSP_UPCASE_VECTOR V1 = FspUpcaseBlockLoad(String1 + I);
+        FSP_UPCASE_VECTOR V2 = FspUpcaseBlockLoad(String2 + I);
+        ULONG J = FspUpcaseBlockFirstDiff(V1, V2);
+        if (FSP_UPCASE_BLOCK == J)
+            continue;
+        if (FspUpcaseBlockIsAscii(V1) && FspUpcaseBlockIsAscii(V2))
+        {
+            J = FspUpcaseBlockFirstDiff(FspUpcaseBlockAscii(V1), FspUpcaseBlockAscii(V2));
+            if (FSP_UPCASE_BLOCK != J)
+                return (INT)FspUpcaseCharInline(String1[I + J]) -
+                    (INT)FspUpcaseCharInline(String2[I + J]);
+        }
+        else
+        {
+            /* characters before J are identical */
+            for (J += I; I + FSP_UPCASE_BLOCK > J; J++)
+            {
+                Result = (INT)FspUpcaseCharInline(String1[J]) -
+                    (INT)FspUpcaseCharInline(String2[J]);
+                if (0 != Result)
+                    return Result;
+            }
+        }
+    }
+#endif
+
+    for (; Count > I; I++)
+    {
+        Result = (INT)FspUpcaseCharInline(String1[I]) - (INT)FspUpcaseCharInline(String2[I]);
+        if (0 != Result)
+            return Result;
+    }
+
+    return (INT)Length1 - (INT)Length2;
+}
+
+FSP_API ULONG FspUpcaseHash(PWCH String, ULONG Count, ULONG Hash)
+{
+    ULONG I = 0;
+
+#if defined(FSP_UPCASE_SSE2) || defined(FSP_UPCASE_NEON)
+    WCHAR Block[FSP_UPCASE_BLOCK];
+    for (; Count - I >= FSP_UPCASE_BLOCK; I += FSP_UPCASE_BLOCK)
+    {
+        FSP_UPCASE_VECTOR V = FspUpcaseBlockLoad(String + I);
+        if (FspUpcaseBlockIsAscii(V))
+            FspUpcaseBlockStore(Block, FspUpcaseBlockAscii(V));
+        else
+            for (ULONG J = 0; FSP_UPCASE_BLOCK > J; J++)
+                Block[J] = FspUpcaseCharInline(String[I + J]);
+        for (ULONG J = 0; FSP_UPCASE_BLOCK > J; J++)
+            Hash = (Hash ^ Block[J]) * 16777619;
+    }
+#endif
+
+    for (; Count > I; I++)
+        Hash = (Hash ^ FspUpcaseCharInline(String[I])) * 16777619;
+
+    return Hash;
+}
@@ -0,0 +1,370 @@
+/**
+ * @file shared/ku/wildcard.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <shared/ku/library.h>
+
+static BOOLEAN FspFileNamePatternMatchGeneral(FSP_FILE_NAME_PATTERN *Pattern,
+    PWCH FileName, ULONG FileNameLength, PULONG64 States);
+FSP_API NTSTATUS FspFileNamePatternCompile(PWSTR Pattern, ULONG PatternLength,
+    BOOLEAN CaseInsensitive, FSP_FILE_NAME_PATTERN **PPattern);
+FSP_API VOID FspFileNamePatternDelete(FSP_FILE_NAME_PATTERN *Pattern);
+FSP_API BOOLEAN FspFileNamePatternMatch(FSP_FILE_NAME_PATTERN *Pattern,
+    PWSTR FileName, ULONG FileNameLength);
+
+#if defined(_KERNEL_MODE)
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text(PAGE, FspFileNamePatternMatchGeneral)
+#pragma alloc_text(PAGE, FspFileNamePatternCompile)
+#pragma alloc_text(PAGE, FspFileNamePatternDelete)
+#pragma alloc_text(PAGE, FspFileNamePatternMatch)
+#endif
+#endif
+
+/*
+ * File Name Patterns
+ *
+ * A file name pattern is a DOS wildcard expression as understood by FsRtlIsNameInExpression:
+ *
+ * - `*` matches zero or more characters.
+ * - `?` matches exactly one character.
+ * - `<` (DOS_STAR) matches zero or more characters, but does not consume the last `.`
+ *   in the name.
+ * - `>` (DOS_QM) matches exactly one character other than `.`; at a `.` or at the end
+ *   of the name it matches zero characters.
+ * - `"` (DOS_DOT) matches a `.`; at the end of the name it matches zero characters.
+ *
+ * FspFileNamePatternCompile analyzes the expression once, so that matching does not have
+ * to. Every expression has the form Prefix Middle Suffix, where Prefix and Suffix consist
+ * of literal characters only (possibly none) and Middle starts and ends with a wildcard.
+ * Since literals always consume exactly one name character, Prefix and Suffix must match
+ * the beginning and end of a name exactly; this is checked first and rejects most names
+ * cheaply. Common Middle forms are then matched without further work:
+ *
+ * - No Middle: the pattern is a plain name; compare the whole name.
+ * - Middle is `*` (e.g. `*`, `*.txt`, `abc*`, `abc*.txt`): any name that matches Prefix
+ *   and Suffix (and is long enough for both) matches.
+ *
+ * Any other Middle is matched by simulating a nondeterministic automaton with one state
+ * per Middle position, kept in a bit set. The simulation runs in O(NameLength * MiddleLength)
+ * time and allocates only when Middle is unusually long.
+ *
+ * When the pattern is case-insensitive, the pattern is upcased during compilation and
+ * name characters are upcased during matching (as FsRtlIsNameInExpression does).
+ */
+
+#if defined(_KERNEL_MODE)
+#define FspFileNamePatternAlloc(S)      FspAlloc(S)
+#define FspFileNamePatternFree(P)       FspFree(P)
+#else
+#define FspFileNamePatternAlloc(S)      MemAlloc(S)
+#define FspFileNamePatternFree(P)       MemFree(P)
+NTSYSAPI WCHAR NTAPI RtlUpcaseUnicodeChar(WCHAR SourceCharacter);
+#endif
+
+#define FSP_FILE_NAME_PATTERN_DOS_STAR  L'<'
+#define FSP_FILE_NAME_PATTERN_DOS_QM    L'>'
+#define FSP_FILE_NAME_PATTERN_DOS_DOT   L'"'
+#define FSP_FILE_NAME_PATTERN_STACK_WORDS 8  /* enough for 511 Middle characters */
+
+enum
+{
+    FspFileNamePatternExact = 0,
+    FspFileNamePatternStar,
+    FspFileNamePatternGeneral,
+};
+
+struct _FSP_FILE_NAME_PATTERN
+{
+    UINT8 Kind;
+    BOOLEAN CaseInsensitive;
+    ULONG PrefixLength, MiddleLength, SuffixLength;
+    PWCH Prefix, Middle, Suffix;
+    WCHAR Buffer[];
+};
+
+static inline WCHAR FspFileNamePatternUpcase(WCHAR C)
+{
+    if (0x80 > C)
+        return L'a' <= C && C <= L'z' ? C - (L'a' - L'A') : C;
+    return RtlUpcaseUnicodeChar(C);
+}
+
+static inline BOOLEAN FspFileNamePatternIsWild(WCHAR C)
+{
+    return L'*' == C || L'?' == C ||
+        FSP_FILE_NAME_PATTERN_DOS_STAR == C ||
+        FSP_FILE_NAME_PATTERN_DOS_QM == C ||
+        FSP_FILE_NAME_PATTERN_DOS_DOT == C;
+}
+
+static inline BOOLEAN FspFileNamePatternEqualChars(PWCH P, PWCH N, ULONG Count,
+    BOOLEAN CaseInsensitive)
+{
+    /* P is the (already upcased) pattern; upcasing it again is a no-op */
+    if (CaseInsensitive)
+        return FspUpcaseEqual(P, N, Count);
+    else
+        return 0 == memcmp(P, N, Count * sizeof(WCHAR));
+}
+
+static BOOLEAN FspFileNamePatternMatchGeneral(FSP_FILE_NAME_PATTERN *Pattern,
+    PWCH FileName, ULONG FileNameLength, PULONG64 States)
+{
+    /*
+     * Bit I in the state set means that Middle[0..I) has consumed FileName[PrefixLength..J).
+     * Epsilon transitions only go from I to I+1, so the epsilon closure of a state set
+     * is computed by a single ascending pass over it.
+     */
+    PWCH Middle = Pattern->Middle;
+    ULONG MiddleLength = Pattern->MiddleLength;
+    ULONG Begin = Pattern->PrefixLength;
+    ULONG End = FileNameLength - Pattern->SuffixLength;
+    ULONG WordCount = (MiddleLength + 1 + 63) / 64;
+    PULONG64 Curr = States, Next = States + WordCount, Temp;
+    ULONG LastDot = (ULONG)-1;
+    BOOLEAN Any;
+    WCHAR C, E;
+
+    /* DOS_STAR may consume a '.' only if it is not the last one in the name */
+    for (ULONG J = FileNameLength; 0 < J; J--)
+        if (L'.' == FileName[J - 1])
+        {
+            LastDot = J - 1;
+            break;
+        }
+
+#define STATE_TEST(S, I)                (0 != ((S)[(I) >> 6] & (1ULL << ((I) & 63))))
+#define STATE_SET(S, I)                 ((S)[(I) >> 6] |= (1ULL << ((I) & 63)))
+#define STATE_CLOSURE(S, J)             \
+    for (ULONG I = 0; MiddleLength > I; I++)\
+    {                                   \
+        if (!STATE_TEST(S, I))          \
+            continue;                   \
+        E = Middle[I];                  \
+        if (L'*' == E ||                \
+            FSP_FILE_NAME_PATTERN_DOS_STAR == E ||\
+            (FSP_FILE_NAME_PATTERN_DOS_QM == E &&\
+                (FileNameLength == (J) || L'.' == FileName[(J)])) ||\
+            (FSP_FILE_NAME_PATTERN_DOS_DOT == E && FileNameLength == (J)))\
+            STATE_SET(S, I + 1);        \
+    }
+
+    memset(Curr, 0, WordCount * sizeof(ULONG64));
+    STATE_SET(Curr, 0);
+    STATE_CLOSURE(Curr, Begin);
+
+    for (ULONG J = Begin; End > J; J++)
+    {
+        C = FileName[J];
+        if (Pattern->CaseInsensitive)
+            C = FspFileNamePatternUpcase(C);
+
+        memset(Next, 0, WordCount * sizeof(ULONG64));
+        Any = FALSE;
+
+        for (ULONG I = 0; MiddleLength > I; I++)
+        {
+            if (!STATE_TEST(Curr, I))
+                continue;
+
+            E = Middle[I];
+            switch (E)
+            {
+            case L'*':
+                STATE_SET(Next, I);
+                Any = TRUE;
+                break;
+            case FSP_FILE_NAME_PATTERN_DOS_STAR:
+                if (L'.' != C || LastDot != J)
+                {
+                    STATE_SET(Next, I);
+                    Any = TRUE;
+                }
+                break;
+            case L'?':
+                STATE_SET(Next, I + 1);
+                Any = TRUE;
+                break;
+            case FSP_FILE_NAME_PATTERN_DOS_QM:
+                if (L'.' != C)
+                {
+                    STATE_SET(Next, I + 1);
+                    Any = TRUE;
+                }
+                break;
+            case FSP_FILE_NAME_PATTERN_DOS_DOT:
+                if (L'.' == C)
+                {
+                    STATE_SET(Next, I + 1);
+                    Any = TRUE;
+                }
+                break;
+            default:
+                if (E == C)
+                {
+                    STATE_SET(Next, I + 1);
+                    Any = TRUE;
+                }
+                break;
+            }
+        }
+
+        if (!Any)
+            return FALSE;
+
+        STATE_CLOSURE(Next, J + 1);
+
+        Temp = Curr; Curr = Next; Next = Temp;
+    }
+
+    return STATE_TEST(Curr, MiddleLength);
+
+#undef STATE_CLOSURE
+#undef STATE_SET
+#undef STATE_TEST
+}
+
+FSP_API NTSTATUS FspFileNamePatternCompile(PWSTR Pattern, ULONG PatternLength,
+    BOOLEAN CaseInsensitive, FSP_FILE_NAME_PATTERN **PPattern)
+{
+    FSP_KU_CODE;
+
+    FSP_FILE_NAME_PATTERN *Result;
+    ULONG PrefixLength, SuffixLength, MiddleLength;
+
+    *PPattern = 0;
+
+    if ((ULONG)-1 == PatternLength)
+        PatternLength = (ULONG)wcslen(Pattern);
+
+    Result = FspFileNamePatternAlloc(
+        sizeof *Result + (PatternLength + 1) * sizeof(WCHAR));
+    if (0 == Result)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    memset(Result, 0, sizeof *Result);
+    Result->CaseInsensitive = CaseInsensitive;
+
+    for (PrefixLength = 0; PatternLength > PrefixLength; PrefixLength++)
+        if (FspFileNamePatternIsWild(Pattern[PrefixLength]))
+            break;
+    if (PatternLength == PrefixLength)
+        SuffixLength = 0;
+    else
+        for (SuffixLength = 0; PatternLength - PrefixLength > SuffixLength; SuffixLength++)
+            if (FspFileNamePatternIsWild(Pattern[PatternLength - SuffixLength - 1]))
+                break;
+
+    /* copy the pattern, upcasing literals and collapsing runs of '*' in Middle (** is *) */
+    MiddleLength = 0;
+    for (ULONG I = 0, J = 0; PatternLength > I; I++)
+    {
+        WCHAR C = Pattern[I];
+
+        if (PrefixLength <= I && PatternLength - SuffixLength > I)
+        {
+            if (L'*' == C && 0 < MiddleLength && L'*' == Result->Buffer[J - 1])
+                continue;
+            MiddleLength++;
+        }
+
+        Result->Buffer[J++] = CaseInsensitive && !FspFileNamePatternIsWild(C) ?
+            FspFileNamePatternUpcase(C) : C;
+    }
+    Result->Buffer[PrefixLength + MiddleLength + SuffixLength] = L'\0';
+
+    Result->PrefixLength = PrefixLength;
+    Result->MiddleLength = MiddleLength;
+    Result->SuffixLength = SuffixLength;
+    Result->Prefix = Result->Buffer;
+    Result->Middle = Result->Buffer + PrefixLength;
+    Result->Suffix = Result->Buffer + PrefixLength + MiddleLength;
+
+    if (0 == MiddleLength)
+        Result->Kind = FspFileNamePatternExact;
+    else if (1 == MiddleLength && L'*' == Result->Middle[0])
+        Result->Kind = FspFileNamePatternStar;
+    else
+        Result->Kind = FspFileNamePatternGeneral;
+
+    *PPattern = Result;
+
+    return STATUS_SUCCESS;
+}
+
+FSP_API VOID FspFileNamePatternDelete(FSP_FILE_NAME_PATTERN *Pattern)
+{
+    FSP_KU_CODE;
+
+    FspFileNamePatternFree(Pattern);
+}
+
+FSP_API BOOLEAN FspFileNamePatternMatch(FSP_FILE_NAME_PATTERN *Pattern,
+    PWSTR FileName, ULONG FileNameLength)
+{
+    FSP_KU_CODE;
+
+    ULONG64 StackStates[2 * FSP_FILE_NAME_PATTERN_STACK_WORDS];
+    PULONG64 States;
+    ULONG WordCount;
+    BOOLEAN Result;
+
+    if ((ULONG)-1 == FileNameLength)
+        FileNameLength = (ULONG)wcslen(FileName);
+
+    /* Prefix and Suffix are literals; they must match the ends of the name exactly */
+    if (Pattern->PrefixLength + Pattern->SuffixLength > FileNameLength)
+        return FALSE;
+    if (!FspFileNamePatternEqualChars(Pattern->Prefix,
+        FileName, Pattern->PrefixLength, Pattern->CaseInsensitive))
+        return FALSE;
+    if (!FspFileNamePatternEqualChars(Pattern->Suffix,
+        FileName + FileNameLength - Pattern->SuffixLength, Pattern->SuffixLength,
+        Pattern->CaseInsensitive))
+        return FALSE;
+
+    switch (Pattern->Kind)
+    {
+    case FspFileNamePatternExact:
+        return Pattern->PrefixLength == FileNameLength;
+    case FspFileNamePatternStar:
+        return TRUE;
+    default:
+        break;
+    }
+
+    WordCount = (Pattern->MiddleLength + 1 + 63) / 64;
+    if (FSP_FILE_NAME_PATTERN_STACK_WORDS >= WordCount)
+        States = StackStates;
+    else
+    {
+        States = FspFileNamePatternAlloc(2 * WordCount * sizeof(ULONG64));
+        if (0 == States)
+            return FALSE;
+    }
+
+    Result = FspFileNamePatternMatchGeneral(Pattern, FileName, FileNameLength, States);
+
+    if (StackStates != States)
+        FspFileNamePatternFree(States);
+
+    return Result;
+}
@@ -105,6 +105,21 @@ enum
     RequestProcessing                   = 1,
 };
 
+static inline BOOLEAN FspFsvolCreateIsNegCacheable(
+    FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension,
+    ULONG CreateDisposition, ULONG Flags, BOOLEAN CaseSensitive)
+{
+    /*
+     * Only opens that fail when the name does not exist can be answered by the NegCache.
+     * The NegCache compares names using the case sensitivity of the volume; opens that use
+     * a different case sensitivity bypass it (a case-sensitive miss on "Foo" says nothing
+     * about a case-insensitive open of "foo").
+     */
+    return (FILE_OPEN == CreateDisposition || FILE_OVERWRITE == CreateDisposition) &&
+        !FlagOn(Flags, SL_OPEN_TARGET_DIRECTORY) &&
+        !CaseSensitive == !FsvolDeviceExtension->VolumeParams.CaseSensitiveSearch;
+}
+
 static NTSTATUS FspFsctlCreate(
     PDEVICE_OBJECT DeviceObject, PIRP Irp, PIO_STACK_LOCATION IrpSp)
 {
@@ -560,6 +575,23 @@ static NTSTATUS FspFsvolCreateNoLock(
         return STATUS_CANNOT_DELETE;
     }
 
+    /* have we recently been told that this name does not exist? */
+    if (0 != FsvolDeviceExtension->NegCache &&
+        FspFsvolCreateIsNegCacheable(FsvolDeviceExtension,
+            CreateDisposition, Flags, CaseSensitive))
+    {
+        FSP_STATISTICS *Statistics = FspFsvolDeviceStatistics(FsvolDeviceObject);
+
+        if (FspNegCacheLookup(FsvolDeviceExtension->NegCache, &FileNode->FileName))
+        {
+            FspStatisticsInc(Statistics, WinFsp.NegativeLookupHits);
+            FspFileNodeDereference(FileNode);
+            return STATUS_OBJECT_NAME_NOT_FOUND;
+        }
+
+        FspStatisticsInc(Statistics, WinFsp.NegativeLookupMisses);
+    }
+
     Result = FspFileDescCreate(&FileDesc);
     if (!NT_SUCCESS(Result))
     {
@@ -658,6 +690,7 @@ static NTSTATUS FspFsvolCreateNoLock(
     FileDesc->FileNode = FileNode;
     FileDesc->CaseSensitive = CaseSensitive;
     FileDesc->HasTraversePrivilege = HasTraversePrivilege;
+    FileDesc->NegCacheSequence = FspNegCacheSequence(FsvolDeviceExtension->NegCache);
 
     if (!MainFileOpen)
     {
@@ -860,12 +893,25 @@ NTSTATUS FspFsvolCreateComplete(
         /* did the user-mode file system sent us a failure code? */
         if (!NT_SUCCESS(Response->IoStatus.Status))
         {
+            /* remember names that do not exist (if the name was not created meanwhile) */
+            if (STATUS_OBJECT_NAME_NOT_FOUND == Response->IoStatus.Status &&
+                FspFsvolCreateIsNegCacheable(FsvolDeviceExtension,
+                    (IrpSp->Parameters.Create.Options >> 24) & 0xff, IrpSp->Flags,
+                    FileDesc->CaseSensitive))
+                FspNegCacheAdd(FsvolDeviceExtension->NegCache,
+                    &FileNode->FileName, FileDesc->NegCacheSequence);
+
             Irp->IoStatus.Information = STATUS_SHARING_VIOLATION == Response->IoStatus.Status ?
                 Response->IoStatus.Information : 0;
             Result = Response->IoStatus.Status;
             FSP_RETURN();
         }
 
+        /* the name may have been created; forget that it did not exist */
+        if (FILE_OPEN != ((IrpSp->Parameters.Create.Options >> 24) & 0xff) &&
+            FILE_OVERWRITE != ((IrpSp->Parameters.Create.Options >> 24) & 0xff))
+            FspNegCacheInvalidate(FsvolDeviceExtension->NegCache, &FileNode->FileName, FALSE);
+
         /* special case STATUS_REPARSE */
         if (STATUS_REPARSE == Response->IoStatus.Status)
         {
@@ -47,15 +47,13 @@ NTSTATUS FspFsvolDeviceCopyContextByNameList(PDEVICE_OBJECT DeviceObject,
     PVOID **PContexts, PULONG PContextCount);
 VOID FspFsvolDeviceDeleteContextList(PVOID *Contexts, ULONG ContextCount);
 PVOID FspFsvolDeviceEnumerateContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STRING FileName,
-    BOOLEAN NextFlag, FSP_DEVICE_CONTEXT_BY_NAME_TABLE_RESTART_KEY *RestartKey);
-PVOID FspFsvolDeviceLookupContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STRING FileName);
+    BOOLEAN StreamsOnly, FSP_DEVICE_CONTEXT_BY_NAME_TABLE_RESTART_KEY *RestartKey);
+PVOID FspFsvolDeviceLookupContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STRING FileName,
+    VOID (*Reference)(PVOID Context));
 PVOID FspFsvolDeviceInsertContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STRING FileName, PVOID Context,
     FSP_DEVICE_CONTEXT_BY_NAME_TABLE_ELEMENT *ElementStorage, PBOOLEAN PInserted);
 VOID FspFsvolDeviceDeleteContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STRING FileName,
     PBOOLEAN PDeleted);
-static RTL_AVL_COMPARE_ROUTINE FspFsvolDeviceCompareContextByName;
-static RTL_AVL_ALLOCATE_ROUTINE FspFsvolDeviceAllocateContextByName;
-static RTL_AVL_FREE_ROUTINE FspFsvolDeviceFreeContextByName;
 VOID FspFsvolDeviceGetVolumeInfo(PDEVICE_OBJECT DeviceObject, FSP_FSCTL_VOLUME_INFO *VolumeInfo);
 BOOLEAN FspFsvolDeviceTryGetVolumeInfo(PDEVICE_OBJECT DeviceObject, FSP_FSCTL_VOLUME_INFO *VolumeInfo);
 VOID FspFsvolDeviceSetVolumeInfo(PDEVICE_OBJECT DeviceObject, const FSP_FSCTL_VOLUME_INFO *VolumeInfo);
@@ -84,9 +82,6 @@ VOID FspDeviceDeleteList(
 #pragma alloc_text(PAGE, FspFsvolDeviceLookupContextByName)
 #pragma alloc_text(PAGE, FspFsvolDeviceInsertContextByName)
 #pragma alloc_text(PAGE, FspFsvolDeviceDeleteContextByName)
-#pragma alloc_text(PAGE, FspFsvolDeviceCompareContextByName)
-#pragma alloc_text(PAGE, FspFsvolDeviceAllocateContextByName)
-#pragma alloc_text(PAGE, FspFsvolDeviceFreeContextByName)
 #pragma alloc_text(PAGE, FspFsvrtDeviceInit)
 #pragma alloc_text(PAGE, FspFsvrtDeviceFini)
 #pragma alloc_text(PAGE, FspFsmupDeviceInit)
@@ -315,7 +310,7 @@ static NTSTATUS FspFsvolDeviceInit(PDEVICE_OBJECT DeviceObject)
     NTSTATUS Result;
     FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension = FspFsvolDeviceExtension(DeviceObject);
     LARGE_INTEGER IrpTimeout;
-    LARGE_INTEGER SecurityTimeout, DirInfoTimeout, StreamInfoTimeout, EaTimeout;
+    LARGE_INTEGER SecurityTimeout, DirInfoTimeout, StreamInfoTimeout, EaTimeout, NegTimeout;
 
     /*
      * Volume device initialization is a mess, because of the different ways of
@@ -404,6 +399,17 @@ static NTSTATUS FspFsvolDeviceInit(PDEVICE_OBJECT DeviceObject)
         return Result;
     FsvolDeviceExtension->InitDoneEa = 1;
 
+    /* create our negative name cache */
+    NegTimeout.QuadPart = FspTimeoutFromMillis(FsvolDeviceExtension->VolumeParams.NegativeLookupTimeout);
+        /* convert millis to nanos */
+    Result = FspNegCacheCreate(
+        FspFsvolDeviceNegCacheCapacity, &NegTimeout,
+        !FsvolDeviceExtension->VolumeParams.CaseSensitiveSearch,
+        &FsvolDeviceExtension->NegCache);
+    if (!NT_SUCCESS(Result))
+        return Result;
+    FsvolDeviceExtension->InitDoneNeg = 1;
+
     /* initialize the Volume Notify and FSRTL Notify mechanisms */
     Result = FspNotifyInitializeSync(&FsvolDeviceExtension->NotifySync);
     if (!NT_SUCCESS(Result))
@@ -419,15 +425,15 @@ static NTSTATUS FspFsvolDeviceInit(PDEVICE_OBJECT DeviceObject)
     FsvolDeviceExtension->InitDoneStat = 1;
 
     /* initialize our context table */
+    Result = FspNameTableCreate(
+        !FsvolDeviceExtension->VolumeParams.CaseSensitiveSearch,
+        &FsvolDeviceExtension->ContextByNameTable);
+    if (!NT_SUCCESS(Result))
+        return Result;
     ExInitializeResourceLite(&FsvolDeviceExtension->VolumeDeleteResource);
     ExInitializeResourceLite(&FsvolDeviceExtension->FileRenameResource);
     ExInitializeFastMutex(&FsvolDeviceExtension->ContextTableMutex);
     InitializeListHead(&FsvolDeviceExtension->ContextList);
-    RtlInitializeGenericTableAvl(&FsvolDeviceExtension->ContextByNameTable,
-        FspFsvolDeviceCompareContextByName,
-        FspFsvolDeviceAllocateContextByName,
-        FspFsvolDeviceFreeContextByName,
-        0);
     FsvolDeviceExtension->InitDoneCtxTab = 1;
 
     /* initialize our timer routine and start our expiration timer */
@@ -468,6 +474,13 @@ static VOID FspFsvolDeviceFini(PDEVICE_OBJECT DeviceObject)
     if (FsvolDeviceExtension->InitDoneStat)
         FspStatisticsDelete(FsvolDeviceExtension->Statistics);
 
+    /* delete the data ring; its memory was freed by FspVolumeDelete */
+    if (0 != FsvolDeviceExtension->DataRing)
+    {
+        FspDataRingDelete(FsvolDeviceExtension->DataRing);
+        ObDereferenceObject(FsvolDeviceExtension->DataRingProcess);
+    }
+
     /* uninitialize the Volume Notify and FSRTL Notify mechanisms */
     if (FsvolDeviceExtension->InitDoneNotify)
     {
@@ -476,6 +489,10 @@ static VOID FspFsvolDeviceFini(PDEVICE_OBJECT DeviceObject)
         FspNotifyUninitializeSync(&FsvolDeviceExtension->NotifySync);
     }
 
+    /* delete the negative name cache */
+    if (FsvolDeviceExtension->InitDoneNeg)
+        FspNegCacheDelete(FsvolDeviceExtension->NegCache);
+
     /* delete the EA meta cache */
     if (FsvolDeviceExtension->InitDoneEa)
         FspMetaCacheDelete(FsvolDeviceExtension->EaCache);
@@ -499,10 +516,11 @@ static VOID FspFsvolDeviceFini(PDEVICE_OBJECT DeviceObject)
     if (FsvolDeviceExtension->InitDoneCtxTab)
     {
         /*
-         * FspDeviceFreeContext/FspDeviceFreeContextByName is a no-op, so it is not necessary
+         * The ContextByNameTable entries are embedded in the contexts, so it is not necessary
          * to enumerate and delete all entries in the ContextTable.
          */
 
+        FspNameTableDelete(FsvolDeviceExtension->ContextByNameTable);
         ExDeleteResourceLite(&FsvolDeviceExtension->FileRenameResource);
         ExDeleteResourceLite(&FsvolDeviceExtension->VolumeDeleteResource);
     }
@@ -570,6 +588,7 @@ static VOID FspFsvolDeviceExpirationRoutine(PVOID Context)
     FspMetaCacheInvalidateExpired(FsvolDeviceExtension->SecurityCache, InterruptTime);
     FspMetaCacheInvalidateExpired(FsvolDeviceExtension->DirInfoCache, InterruptTime);
     FspMetaCacheInvalidateExpired(FsvolDeviceExtension->StreamInfoCache, InterruptTime);
+    FspNegCacheInvalidateExpired(FsvolDeviceExtension->NegCache, InterruptTime);
     /* run any fsext provider expiration routine */
     if (0 != FsvolDeviceExtension->Provider)
         FsvolDeviceExtension->Provider->DeviceExpirationRoutine(DeviceObject, InterruptTime);
@@ -632,14 +651,14 @@ NTSTATUS FspFsvolDeviceCopyContextByNameList(PDEVICE_OBJECT DeviceObject,
     PAGED_CODE();
 
     FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension = FspFsvolDeviceExtension(DeviceObject);
-    FSP_DEVICE_CONTEXT_BY_NAME_TABLE_ELEMENT_DATA *Data;
-    PVOID *Contexts;
+    FSP_DEVICE_CONTEXT_BY_NAME_TABLE_RESTART_KEY RestartKey;
+    PVOID *Contexts, Context;
     ULONG ContextCount, Index;
 
     *PContexts = 0;
     *PContextCount = 0;
 
-    ContextCount = RtlNumberGenericTableElementsAvl(&FsvolDeviceExtension->ContextByNameTable);
+    ContextCount = FspNameTableCount(FsvolDeviceExtension->ContextByNameTable);
 
     /* if ContextCount == 0 allocate an empty Context list */
     Contexts = FspAlloc(sizeof(PVOID) * (0 != ContextCount ? ContextCount : 1));
@@ -647,11 +666,14 @@ NTSTATUS FspFsvolDeviceCopyContextByNameList(PDEVICE_OBJECT DeviceObject,
         return STATUS_INSUFFICIENT_RESOURCES;
 
     Index = 0;
-    Data = RtlEnumerateGenericTableAvl(&FsvolDeviceExtension->ContextByNameTable, TRUE);
-    while (Index < ContextCount && 0 != Data)
+    memset(&RestartKey, 0, sizeof RestartKey);
+    while (Index < ContextCount)
     {
-        Contexts[Index++] = Data->Context;
-        Data = RtlEnumerateGenericTableAvl(&FsvolDeviceExtension->ContextByNameTable, FALSE);
+        Context = FspNameTableEnumerate(FsvolDeviceExtension->ContextByNameTable,
+            0, FALSE, &RestartKey);
+        if (0 == Context)
+            break;
+        Contexts[Index++] = Context;
     }
 
     *PContexts = Contexts;
@@ -668,40 +690,39 @@ VOID FspFsvolDeviceDeleteContextList(PVOID *Contexts, ULONG ContextCount)
 }
 
 PVOID FspFsvolDeviceEnumerateContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STRING FileName,
-    BOOLEAN NextFlag, FSP_DEVICE_CONTEXT_BY_NAME_TABLE_RESTART_KEY *RestartKey)
+    BOOLEAN StreamsOnly, FSP_DEVICE_CONTEXT_BY_NAME_TABLE_RESTART_KEY *RestartKey)
 {
+    /*
+     * Enumerate FileName, its named streams and (unless StreamsOnly) its descendants.
+     * The enumeration order is unspecified.
+     */
+
     PAGED_CODE();
 
     FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension = FspFsvolDeviceExtension(DeviceObject);
-    BOOLEAN CaseInsensitive = 0 == FsvolDeviceExtension->VolumeParams.CaseSensitiveSearch;
-    FSP_DEVICE_CONTEXT_BY_NAME_TABLE_ELEMENT_DATA *Result;
-
-    if (0 != RestartKey->RestartKey)
-        NextFlag = TRUE;
 
-    Result = RtlEnumerateGenericTableLikeADirectory(&FsvolDeviceExtension->ContextByNameTable,
-        0, 0, NextFlag, &RestartKey->RestartKey, &RestartKey->DeleteCount, &FileName);
-
-    if (0 != Result &&
-        FspFileNameIsPrefix(FileName, Result->FileName, CaseInsensitive, 0) &&
-        (FileName->Length == Result->FileName->Length ||
-            (L'\\' == Result->FileName->Buffer[FileName->Length / sizeof(WCHAR)] ||
-            L':' == Result->FileName->Buffer[FileName->Length / sizeof(WCHAR)])))
-        return Result->Context;
-    else
-        return 0;
+    return FspNameTableEnumerate(FsvolDeviceExtension->ContextByNameTable,
+        FileName, StreamsOnly, RestartKey);
 }
 
-PVOID FspFsvolDeviceLookupContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STRING FileName)
+PVOID FspFsvolDeviceLookupContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STRING FileName,
+    VOID (*Reference)(PVOID Context))
 {
+    /*
+     * The ContextByNameTable has its own locking, so this function may be called without
+     * holding the ContextTableMutex. In this case the Reference function (if any) is called
+     * while the context is still in the table, which allows the caller to safely reference it.
+     *
+     * A lookup without the ContextTableMutex may miss a context that is being renamed, since
+     * FspFileNodeRename removes it from the table and reinserts it under the new name. Callers
+     * that must not miss it (e.g. cache invalidation) should hold the ContextTableMutex.
+     */
+
     PAGED_CODE();
 
     FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension = FspFsvolDeviceExtension(DeviceObject);
-    FSP_DEVICE_CONTEXT_BY_NAME_TABLE_ELEMENT_DATA *Result;
 
-    Result = RtlLookupElementGenericTableAvl(&FsvolDeviceExtension->ContextByNameTable, &FileName);
-
-    return 0 != Result ? Result->Context : 0;
+    return FspNameTableLookup(FsvolDeviceExtension->ContextByNameTable, FileName, Reference);
 }
 
 PVOID FspFsvolDeviceInsertContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STRING FileName, PVOID Context,
@@ -710,20 +731,11 @@ PVOID FspFsvolDeviceInsertContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_ST
     PAGED_CODE();
 
     FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension = FspFsvolDeviceExtension(DeviceObject);
-    FSP_DEVICE_CONTEXT_BY_NAME_TABLE_ELEMENT_DATA *Result, Element = { 0 };
 
     ASSERT(0 != ElementStorage);
-    Element.FileName = FileName;
-    Element.Context = Context;
-
-    FsvolDeviceExtension->ContextByNameTableElementStorage = ElementStorage;
-    Result = RtlInsertElementGenericTableAvl(&FsvolDeviceExtension->ContextByNameTable,
-        &Element, sizeof Element, PInserted);
-    FsvolDeviceExtension->ContextByNameTableElementStorage = 0;
 
-    ASSERT(0 != Result);
-
-    return Result->Context;
+    return FspNameTableInsert(FsvolDeviceExtension->ContextByNameTable,
+        FileName, Context, ElementStorage, PInserted);
 }
 
 VOID FspFsvolDeviceDeleteContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STRING FileName,
@@ -734,59 +746,12 @@ VOID FspFsvolDeviceDeleteContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STR
     FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension = FspFsvolDeviceExtension(DeviceObject);
     BOOLEAN Deleted;
 
-    Deleted = RtlDeleteElementGenericTableAvl(&FsvolDeviceExtension->ContextByNameTable, &FileName);
+    Deleted = FspNameTableRemove(FsvolDeviceExtension->ContextByNameTable, FileName);
 
     if (0 != PDeleted)
         *PDeleted = Deleted;
 }
 
-static RTL_GENERIC_COMPARE_RESULTS NTAPI FspFsvolDeviceCompareContextByName(
-    PRTL_AVL_TABLE Table, PVOID FirstElement, PVOID SecondElement)
-{
-    PAGED_CODE();
-
-    FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension =
-        CONTAINING_RECORD(Table, FSP_FSVOL_DEVICE_EXTENSION, ContextByNameTable);
-    BOOLEAN CaseInsensitive = 0 == FsvolDeviceExtension->VolumeParams.CaseSensitiveSearch;
-    PUNICODE_STRING FirstFileName = *(PUNICODE_STRING *)FirstElement;
-    PUNICODE_STRING SecondFileName = *(PUNICODE_STRING *)SecondElement;
-    LONG ComparisonResult;
-
-    /*
-     * Since FileNode FileName's are now always normalized, we could perhaps get away
-     * with using CaseInsensitive == FALSE at all times. For safety reasons we avoid
-     * doing so here.
-     */
-    ComparisonResult = FspFileNameCompare(FirstFileName, SecondFileName, CaseInsensitive, 0);
-
-    if (0 > ComparisonResult)
-        return GenericLessThan;
-    else
-    if (0 < ComparisonResult)
-        return GenericGreaterThan;
-    else
-        return GenericEqual;
-}
-
-static PVOID NTAPI FspFsvolDeviceAllocateContextByName(
-    PRTL_AVL_TABLE Table, CLONG ByteSize)
-{
-    PAGED_CODE();
-
-    FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension =
-        CONTAINING_RECORD(Table, FSP_FSVOL_DEVICE_EXTENSION, ContextByNameTable);
-
-    ASSERT(sizeof(FSP_DEVICE_CONTEXT_BY_NAME_TABLE_ELEMENT) == ByteSize);
-
-    return FsvolDeviceExtension->ContextByNameTableElementStorage;
-}
-
-static VOID NTAPI FspFsvolDeviceFreeContextByName(
-    PRTL_AVL_TABLE Table, PVOID Buffer)
-{
-    PAGED_CODE();
-}
-
 VOID FspFsvolDeviceGetVolumeInfo(PDEVICE_OBJECT DeviceObject, FSP_FSCTL_VOLUME_INFO *VolumeInfo)
 {
     // !PAGED_CODE();
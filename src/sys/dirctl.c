@@ -22,7 +22,7 @@
 #include <sys/driver.h>
 
 static NTSTATUS FspFsvolQueryDirectoryCopy(
-    PUNICODE_STRING DirectoryPattern, BOOLEAN CaseInsensitive,
+    FSP_FILE_NAME_PATTERN *DirectoryPattern, BOOLEAN CaseInsensitive,
     PUNICODE_STRING DirectoryMarker, PUNICODE_STRING DirectoryMarkerOut,
     PUINT64 DirectoryMarkerAsNextOffset,
     FILE_INFORMATION_CLASS FileInformationClass, BOOLEAN ReturnSingleEntry,
@@ -74,7 +74,7 @@ FSP_DRIVER_DISPATCH FspDirectoryControl;
 enum
 {
     /* QueryDirectory */
-    RequestFileNode                     = 0,
+    RequestFileDesc                     = 0,
     RequestCookie                       = 1,
     RequestAddress                      = 2,
     RequestProcess                      = 3,
@@ -87,7 +87,7 @@ enum
 };
 
 static NTSTATUS FspFsvolQueryDirectoryCopy(
-    PUNICODE_STRING DirectoryPattern, BOOLEAN CaseInsensitive,
+    FSP_FILE_NAME_PATTERN *DirectoryPattern, BOOLEAN CaseInsensitive,
     PUNICODE_STRING DirectoryMarker, PUNICODE_STRING DirectoryMarkerOut,
     PUINT64 DirectoryMarkerAsNextOffset,
     FILE_INFORMATION_CLASS FileInformationClass, BOOLEAN ReturnSingleEntry,
@@ -134,7 +134,7 @@ static NTSTATUS FspFsvolQueryDirectoryCopy(
     PAGED_CODE();
 
     NTSTATUS Result = STATUS_SUCCESS;
-    BOOLEAN MatchAll = FspFileDescDirectoryPatternMatchAll == DirectoryPattern->Buffer, Match;
+    BOOLEAN MatchAll = 0 == DirectoryPattern, Match;
     BOOLEAN Loop = TRUE, DirectoryMarkerFound = FALSE;
     FSP_FSCTL_DIR_INFO *DirInfo = *PDirInfo;
     PUINT8 DirInfoEnd = (PUINT8)DirInfo + DirInfoSize;
@@ -211,13 +211,8 @@ static NTSTATUS FspFsvolQueryDirectoryCopy(
             /* CopyLength is the same as FileName.Length except on STATUS_BUFFER_OVERFLOW */
             CopyLength = FileName.Length;
 
-            Match = MatchAll;
-            if (!Match)
-            {
-                Result = FspFileNameInExpression(DirectoryPattern, &FileName, CaseInsensitive, 0, &Match);
-                if (!NT_SUCCESS(Result))
-                    return Result;
-            }
+            Match = MatchAll || FspFileNamePatternMatch(DirectoryPattern,
+                FileName.Buffer, FileName.Length / sizeof(WCHAR));
 
             if (Match)
             {
@@ -342,7 +337,7 @@ static NTSTATUS FspFsvolQueryDirectoryCopyCache(
     FSP_FSCTL_DIR_INFO *DirInfo, ULONG DirInfoSize,
     PVOID DestBuf, PULONG PDestLen)
 {
-    /* FileNode/FileDesc assumed acquired exclusive (Main or Full) */
+    /* FileNode assumed acquired (shared or exclusive) and FileDesc directory cursor owned */
 
     PAGED_CODE();
 
@@ -357,7 +352,7 @@ static NTSTATUS FspFsvolQueryDirectoryCopyCache(
     FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension =
         FspFsvolDeviceExtension(FileNode->FsvolDeviceObject);
     BOOLEAN CaseInsensitive = !FileDesc->CaseSensitive;
-    PUNICODE_STRING DirectoryPattern = &FileDesc->DirectoryPattern;
+    FSP_FILE_NAME_PATTERN *DirectoryPattern = FileDesc->DirectoryPatternMatcher;
     UNICODE_STRING DirectoryMarker = FileDesc->DirectoryMarker;
     UINT64 DirectoryMarkerAsNextOffset = 0;
     PUINT8 DirInfoBgn = (PUINT8)DirInfo;
@@ -397,7 +392,7 @@ static NTSTATUS FspFsvolQueryDirectoryCopyInPlace(
     FSP_FSCTL_DIR_INFO *DirInfo, ULONG DirInfoSize,
     PVOID DestBuf, PULONG PDestLen)
 {
-    /* FileNode/FileDesc assumed acquired exclusive (Main or Full) */
+    /* FileNode assumed acquired (shared or exclusive) and FileDesc directory cursor owned */
 
     PAGED_CODE();
 
@@ -406,7 +401,7 @@ static NTSTATUS FspFsvolQueryDirectoryCopyInPlace(
     FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension =
         FspFsvolDeviceExtension(FileNode->FsvolDeviceObject);
     BOOLEAN CaseInsensitive = !FileDesc->CaseSensitive;
-    PUNICODE_STRING DirectoryPattern = &FileDesc->DirectoryPattern;
+    FSP_FILE_NAME_PATTERN *DirectoryPattern = FileDesc->DirectoryPatternMatcher;
     UNICODE_STRING DirectoryMarker = FileDesc->DirectoryMarker;
     UINT64 DirectoryMarkerAsNextOffset = 0;
 
@@ -500,11 +495,34 @@ static NTSTATUS FspFsvolQueryDirectoryRetry(
     if (BaseInfoLen >= Length)
         return STATUS_BUFFER_TOO_SMALL;
 
-    /* try to acquire the FileNode exclusive; Full because we may need to send a Request */
+    /*
+     * Try to acquire the FileNode shared and the FileDesc directory cursor; Full because we
+     * may need to send a Request. Enumerations through different handles (and cache hits in
+     * particular) can then proceed concurrently; only the Complete path that populates the
+     * DirInfo cache acquires the FileNode exclusive.
+     *
+     * If another thread or request is using the cursor of this FileDesc, acquire the FileNode
+     * exclusive instead, which waits for a request that is in user mode to complete. If the
+     * cursor is still busy (its request is being completed), repost and try again later.
+     */
     Success = DEBUGTEST(90) &&
-        FspFileNodeTryAcquireExclusiveF(FileNode, FspFileNodeAcquireFull, CanWait);
+        FspFileNodeTryAcquireSharedF(FileNode, FspFileNodeAcquireFull, CanWait);
     if (!Success)
         return FspWqRepostIrpWorkItem(Irp, FspFsvolQueryDirectoryRetry, 0);
+    if (!FspFileDescTryAcquireDirectory(FileDesc))
+    {
+        FspFileNodeRelease(FileNode, Full);
+        Success = DEBUGTEST(90) &&
+            FspFileNodeTryAcquireExclusiveF(FileNode, FspFileNodeAcquireFull, CanWait);
+        if (!Success)
+            return FspWqRepostIrpWorkItem(Irp, FspFsvolQueryDirectoryRetry, 0);
+        if (!FspFileDescTryAcquireDirectory(FileDesc))
+        {
+            FspFileNodeRelease(FileNode, Full);
+            return FspWqRepostIrpWorkItem(Irp, FspFsvolQueryDirectoryRetry, 0);
+        }
+        FspFileNodeConvertExclusiveToShared(FileNode, Full);
+    }
 
     /* if we have been retried reset our work item now! */
     if (0 != Request)
@@ -517,6 +535,7 @@ static NTSTATUS FspFsvolQueryDirectoryRetry(
     Result = FspFileDescResetDirectory(FileDesc, FileName, RestartScan, IndexSpecified);
     if (!NT_SUCCESS(Result))
     {
+        FspFileDescReleaseDirectory(FileDesc);
         FspFileNodeRelease(FileNode, Full);
         return Result;
     }
@@ -525,6 +544,7 @@ static NTSTATUS FspFsvolQueryDirectoryRetry(
     PatternIsWild = FsRtlDoesNameContainWildCards(&FileDesc->DirectoryPattern);
     if (!PatternIsWild && FileDesc->DirectoryHasSuchFile)
     {
+        FspFileDescReleaseDirectory(FileDesc);
         FspFileNodeRelease(FileNode, Full);
         return STATUS_NO_MORE_FILES;
     }
@@ -541,6 +561,7 @@ static NTSTATUS FspFsvolQueryDirectoryRetry(
 
         if (!NT_SUCCESS(Result) || 0 != Length)
         {
+            FspFileDescReleaseDirectory(FileDesc);
             FspFileNodeRelease(FileNode, Full);
             Irp->IoStatus.Information = Length;
             return Result;
@@ -550,8 +571,6 @@ static NTSTATUS FspFsvolQueryDirectoryRetry(
         Length = IrpSp->Parameters.QueryDirectory.Length;
     }
 
-    FspFileNodeConvertExclusiveToShared(FileNode, Full);
-
     /* special handling when pattern is filename */
     PatternIsFileName = FsvolDeviceExtension->VolumeParams.PassQueryDirectoryFileName &&
         !PatternIsWild;
@@ -563,6 +582,7 @@ static NTSTATUS FspFsvolQueryDirectoryRetry(
     Result = FspLockUserBuffer(Irp, Length, IoWriteAccess);
     if (!NT_SUCCESS(Result))
     {
+        FspFileDescReleaseDirectory(FileDesc);
         FspFileNodeRelease(FileNode, Full);
         return Result;
     }
@@ -574,6 +594,7 @@ static NTSTATUS FspFsvolQueryDirectoryRetry(
         FspFsvolQueryDirectoryRequestFini, &Request);
     if (!NT_SUCCESS(Result))
     {
+        FspFileDescReleaseDirectory(FileDesc);
         FspFileNodeRelease(FileNode, Full);
         return Result;
     }
@@ -686,8 +707,9 @@ static NTSTATUS FspFsvolQueryDirectoryRetry(
             FileDesc->DirectoryMarker.Length) = L'\0';
     }
 
+    /* the Request owns the FileNode (shared) and the directory cursor until it completes */
     FspFileNodeSetOwner(FileNode, Full, Request);
-    FspIopRequestContext(Request, RequestFileNode) = FileNode;
+    FspIopRequestContext(Request, RequestFileDesc) = (PVOID)((UINT_PTR)FileDesc | 1);
 
     return FSP_STATUS_IOQ_POST;
 }
@@ -922,11 +944,12 @@ NTSTATUS FspFsvolDirectoryControlComplete(
         FSP_RETURN();
     }
 
-    if (0 != FspIopRequestContext(Request, RequestFileNode))
+    if (FlagOn((UINT_PTR)FspIopRequestContext(Request, RequestFileDesc), 1))
     {
         FspIopRequestContext(Request, FspIopRequestExtraContext) = (PVOID)
             FspFileNodeDirInfoChangeNumber(FileNode);
-        FspIopRequestContext(Request, RequestFileNode) = 0;
+        /* release the FileNode, but keep the directory cursor until the Request is done */
+        FspIopRequestContext(Request, RequestFileDesc) = FileDesc;
 
         FspFileNodeReleaseOwner(FileNode, Full, Request);
     }
@@ -973,9 +996,14 @@ NTSTATUS FspFsvolDirectoryControlComplete(
         FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension =
             FspFsvolDeviceExtension(FsvolDeviceObject);
 
-        FspFileNodeConvertExclusiveToShared(FileNode, Full);
-
+        /*
+         * Resetting the Request releases its directory cursor. We hold the FileNode exclusive,
+         * so nobody else can acquire the cursor before we acquire it again for the new Request.
+         */
         FspIopResetRequest(Request, FspFsvolQueryDirectoryRequestFini);
+        Success = FspFileDescTryAcquireDirectory(FileDesc);
+        ASSERT(Success);
+        FspFileNodeConvertExclusiveToShared(FileNode, Full);
 
         Request->Req.QueryDirectory.Address = 0;
         Request->Req.QueryDirectory.Marker.Offset = 0;
@@ -998,7 +1026,7 @@ NTSTATUS FspFsvolDirectoryControlComplete(
         }
 
         FspFileNodeSetOwner(FileNode, Full, Request);
-        FspIopRequestContext(Request, RequestFileNode) = FileNode;
+        FspIopRequestContext(Request, RequestFileDesc) = (PVOID)((UINT_PTR)FileDesc | 1);
 
         FspIoqPostIrp(FsvolDeviceExtension->Ioq, Irp, &Result);
     }
@@ -1020,7 +1048,8 @@ static VOID FspFsvolQueryDirectoryRequestFini(FSP_FSCTL_TRANSACT_REQ *Request, P
 {
     PAGED_CODE();
 
-    FSP_FILE_NODE *FileNode = Context[RequestFileNode];
+    FSP_FILE_DESC *FileDesc = (PVOID)((UINT_PTR)Context[RequestFileDesc] & ~1);
+    BOOLEAN FileNodeOwned = FlagOn((UINT_PTR)Context[RequestFileDesc], 1);
     PVOID Cookie = (PVOID)((UINT_PTR)Context[RequestCookie] & ~1);
     PVOID Address = Context[RequestAddress];
     PEPROCESS Process = Context[RequestProcess];
@@ -1042,8 +1071,14 @@ static VOID FspFsvolQueryDirectoryRequestFini(FSP_FSCTL_TRANSACT_REQ *Request, P
         ObDereferenceObject(Process);
     }
 
-    if (0 != FileNode)
-        FspFileNodeReleaseOwner(FileNode, Full, Request);
+    if (0 != FileDesc)
+    {
+        /* release the cursor first; a thread that acquires the FileNode exclusive expects it free */
+        FSP_FILE_NODE *FileNode = FileDesc->FileNode;
+        FspFileDescReleaseDirectory(FileDesc);
+        if (FileNodeOwned)
+            FspFileNodeReleaseOwner(FileNode, Full, Request);
+    }
 }
 
 NTSTATUS FspDirectoryControl(
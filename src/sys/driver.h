@@ -34,6 +34,8 @@
 #include <winfsp/fsext.h>
 
 #include <shared/ku/config.h>
+#include <shared/ku/nametab.h>
+#include <shared/ku/shardq.h>
 
 /* disable warnings */
 #pragma warning(disable:4100)           /* unreferenced formal parameter */
@@ -580,9 +582,34 @@ NTSTATUS FspFileNameInExpression(
     PWCH UpcaseTable,
     PBOOLEAN PResult);
 
+/* file name patterns (ku) */
+typedef struct _FSP_FILE_NAME_PATTERN FSP_FILE_NAME_PATTERN;
+FSP_DDI NTSTATUS FspFileNamePatternCompile(PWSTR Pattern, ULONG PatternLength,
+    BOOLEAN CaseInsensitive, FSP_FILE_NAME_PATTERN **PPattern);
+FSP_DDI VOID FspFileNamePatternDelete(FSP_FILE_NAME_PATTERN *Pattern);
+FSP_DDI BOOLEAN FspFileNamePatternMatch(FSP_FILE_NAME_PATTERN *Pattern,
+    PWSTR FileName, ULONG FileNameLength);
+
+/* case-insensitive names (ku) */
+FSP_DDI VOID FspUpcaseChars(PWCH Destination, PWCH Source, ULONG Count);
+FSP_DDI BOOLEAN FspUpcaseEqual(PWCH String1, PWCH String2, ULONG Count);
+FSP_DDI INT FspUpcaseCompare(PWCH String1, ULONG Length1, PWCH String2, ULONG Length2);
+FSP_DDI ULONG FspUpcaseHash(PWCH String, ULONG Count, ULONG Hash);
+
 /* UUID5 creation (ku) */
 NTSTATUS FspUuid5Make(const UUID *Namespace, const VOID *Buffer, ULONG Size, UUID *Uuid);
 
+/* data ring (ku) */
+typedef struct _FSP_DATA_RING FSP_DATA_RING;
+NTSTATUS FspDataRingCreate(PVOID Buffer, ULONG SlotSize, ULONG SlotCount,
+    FSP_DATA_RING **PDataRing);
+VOID FspDataRingDelete(FSP_DATA_RING *DataRing);
+BOOLEAN FspDataRingAcquire(FSP_DATA_RING *DataRing, PULONG PSequence, PVOID *PAddress);
+BOOLEAN FspDataRingRelease(FSP_DATA_RING *DataRing, ULONG Sequence, PVOID Address);
+ULONG FspDataRingSlotSize(FSP_DATA_RING *DataRing);
+VOID FspDataRingGetStatistics(FSP_DATA_RING *DataRing,
+    PULONG PAcquireCount, PULONG PReleaseCount, PULONG PFullCount);
+
 /* utility */
 PVOID FspAllocatePoolMustSucceed(POOL_TYPE PoolType, SIZE_T Size, ULONG Tag);
 PVOID FspAllocateIrpMustSucceed(CCHAR StackSize);
@@ -773,7 +800,8 @@ VOID FspSiloFinalize(VOID);
 VOID FspSiloEnumerate(FSP_SILO_ENUM_CALLBACK EnumFn);
 
 /* process buffers */
-#define FspProcessBufferSizeMax         (64 * 1024)
+#define FspProcessBufferSizeMax         (64 * 1024)     /* double-buffering threshold */
+#define FspProcessBufferPoolSizeMax     (1024 * 1024)   /* default largest reused buffer */
 NTSTATUS FspProcessBufferInitialize(VOID);
 VOID FspProcessBufferFinalize(VOID);
 VOID FspProcessBufferCollect(HANDLE ProcessId);
@@ -981,10 +1009,11 @@ typedef struct
 #else
     KEVENT PendingIrpEvent;
 #endif
-    LIST_ENTRY PendingIrpList, ProcessIrpList, RetriedIrpList;
-    IO_CSQ PendingIoCsq, ProcessIoCsq, RetriedIoCsq;
+    FSP_SHARD_QUEUE *PendingQueue;
+    LIST_ENTRY ProcessIrpList, RetriedIrpList;
+    IO_CSQ ProcessIoCsq, RetriedIoCsq;
     ULONG IrpTimeout;
-    ULONG PendingIrpCapacity, PendingIrpCount, ProcessIrpCount, RetriedIrpCount;
+    ULONG PendingIrpCapacity, ProcessIrpCount, RetriedIrpCount;
     VOID (*CompleteCanceledIrp)(PIRP Irp);
     ULONG ProcessIrpBucketCount;
     PVOID ProcessIrpBuckets[];
@@ -1035,6 +1064,29 @@ VOID FspMetaCacheDereferenceItemBuffer(PCVOID Buffer);
 UINT64 FspMetaCacheAddItem(FSP_META_CACHE *MetaCache, PCVOID Buffer, ULONG Size);
 VOID FspMetaCacheInvalidateItem(FSP_META_CACHE *MetaCache, UINT64 ItemIndex);
 
+/* negative name cache */
+typedef struct
+{
+    KSPIN_LOCK SpinLock;
+    UINT64 NegTimeout;
+    ULONG NegCapacity, ItemCount;
+    BOOLEAN CaseInsensitive;
+    ULONG Sequence;
+    LIST_ENTRY ItemList;
+    ULONG ItemBucketCount;
+    PVOID ItemBuckets[];
+} FSP_NEG_CACHE;
+NTSTATUS FspNegCacheCreate(
+    ULONG NegCapacity, PLARGE_INTEGER NegTimeout, BOOLEAN CaseInsensitive,
+    FSP_NEG_CACHE **PNegCache);
+VOID FspNegCacheDelete(FSP_NEG_CACHE *NegCache);
+VOID FspNegCacheInvalidateExpired(FSP_NEG_CACHE *NegCache, UINT64 ExpirationTime);
+ULONG FspNegCacheSequence(FSP_NEG_CACHE *NegCache);
+BOOLEAN FspNegCacheLookup(FSP_NEG_CACHE *NegCache, PUNICODE_STRING FileName);
+VOID FspNegCacheAdd(FSP_NEG_CACHE *NegCache, PUNICODE_STRING FileName, ULONG Sequence);
+VOID FspNegCacheInvalidate(FSP_NEG_CACHE *NegCache, PUNICODE_STRING FileName,
+    BOOLEAN Descendants);
+
 /* I/O processing */
 #define FSP_FSCTL_WORK                  \
     CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0x800 + 'W', METHOD_NEITHER, FILE_ANY_ACCESS)
@@ -1141,6 +1193,7 @@ typedef struct
 {
     FILESYSTEM_STATISTICS Base;
     FAT_STATISTICS Specific;            /* pretend that we are FAT when it comes to stats */
+    FSP_FSCTL_STATISTICS WinFsp;        /* WinFsp specific stats; follow the FAT stats */
     /* align to 64 bytes */
     __declspec(align(64)) UINT8 EndOfStruct[];
 } FSP_STATISTICS;
@@ -1162,6 +1215,7 @@ enum
     FspFsvolDeviceStreamInfoCacheItemSizeMax = FSP_FSCTL_ALIGN_UP(16384, PAGE_SIZE),
     FspFsvolDeviceEaCacheCapacity = 100,
     FspFsvolDeviceEaCacheItemSizeMax = FSP_FSCTL_ALIGN_UP(16384, PAGE_SIZE),
+    FspFsvolDeviceNegCacheCapacity = 1024,
 };
 typedef struct
 {
@@ -1170,21 +1224,8 @@ typedef struct
     PDEVICE_OBJECT DeviceObject;
     PVOID Context;
 } FSP_DEVICE_TIMER;
-typedef struct
-{
-    PUNICODE_STRING FileName;
-    PVOID Context;
-} FSP_DEVICE_CONTEXT_BY_NAME_TABLE_ELEMENT_DATA;
-typedef struct
-{
-    RTL_BALANCED_LINKS Header;
-    FSP_DEVICE_CONTEXT_BY_NAME_TABLE_ELEMENT_DATA Data;
-} FSP_DEVICE_CONTEXT_BY_NAME_TABLE_ELEMENT;
-typedef struct
-{
-    PVOID RestartKey;
-    ULONG DeleteCount;
-} FSP_DEVICE_CONTEXT_BY_NAME_TABLE_RESTART_KEY;
+typedef FSP_NAME_TABLE_ENTRY FSP_DEVICE_CONTEXT_BY_NAME_TABLE_ELEMENT;
+typedef FSP_NAME_TABLE_RESTART_KEY FSP_DEVICE_CONTEXT_BY_NAME_TABLE_RESTART_KEY;
 enum
 {
     FspFsctlDeviceExtensionKind = '\0ltC',  /* file system control device (e.g. \Device\WinFsp.Disk) */
@@ -1204,7 +1245,7 @@ typedef struct
 {
     FSP_DEVICE_EXTENSION Base;
     UINT32 InitDoneFsvrt:1, InitDoneIoq:1, InitDoneSec:1, InitDoneDir:1, InitDoneStrm:1, InitDoneEa:1,
-        InitDoneCtxTab:1, InitDoneTimer:1, InitDoneInfo:1, InitDoneNotify:1, InitDoneStat:1,
+        InitDoneNeg:1, InitDoneCtxTab:1, InitDoneTimer:1, InitDoneInfo:1, InitDoneNotify:1, InitDoneStat:1,
         InitDoneFsext;
     PDEVICE_OBJECT FsctlDeviceObject;
     PDEVICE_OBJECT FsvrtDeviceObject;
@@ -1223,6 +1264,7 @@ typedef struct
     FSP_META_CACHE *DirInfoCache;
     FSP_META_CACHE *StreamInfoCache;
     FSP_META_CACHE *EaCache;
+    FSP_NEG_CACHE *NegCache;
     KSPIN_LOCK ExpirationLock;
     WORK_QUEUE_ITEM ExpirationWorkItem;
     BOOLEAN ExpirationInProgress;
@@ -1231,8 +1273,7 @@ typedef struct
     ERESOURCE FileRenameResource;
     FAST_MUTEX ContextTableMutex;
     LIST_ENTRY ContextList;
-    RTL_AVL_TABLE ContextByNameTable;
-    PVOID ContextByNameTableElementStorage;
+    FSP_NAME_TABLE *ContextByNameTable;  /* has its own (sharded) locking */
     UNICODE_STRING VolumeName;
     WCHAR VolumeNameBuf[FSP_FSCTL_VOLUME_NAME_SIZE / sizeof(WCHAR)];
     KSPIN_LOCK InfoSpinLock;
@@ -1243,6 +1284,10 @@ typedef struct
     PNOTIFY_SYNC NotifySync;
     LIST_ENTRY NotifyList;
     FSP_STATISTICS *Statistics;
+    FSP_DATA_RING *DataRing;            /* published last; other DataRing fields valid if set */
+    PVOID DataRingAddress;              /* user mode address in DataRingProcess */
+    SIZE_T DataRingSize;
+    PEPROCESS DataRingProcess;
     FSP_FSCTL_DECLSPEC_ALIGN UINT8 FsextData[];
 } FSP_FSVOL_DEVICE_EXTENSION;
 typedef struct
@@ -1409,8 +1454,9 @@ NTSTATUS FspFsvolDeviceCopyContextByNameList(PDEVICE_OBJECT DeviceObject,
     PVOID **PContexts, PULONG PContextCount);
 VOID FspFsvolDeviceDeleteContextList(PVOID *Contexts, ULONG ContextCount);
 PVOID FspFsvolDeviceEnumerateContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STRING FileName,
-    BOOLEAN NextFlag, FSP_DEVICE_CONTEXT_BY_NAME_TABLE_RESTART_KEY *RestartKey);
-PVOID FspFsvolDeviceLookupContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STRING FileName);
+    BOOLEAN StreamsOnly, FSP_DEVICE_CONTEXT_BY_NAME_TABLE_RESTART_KEY *RestartKey);
+PVOID FspFsvolDeviceLookupContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STRING FileName,
+    VOID (*Reference)(PVOID Context));
 PVOID FspFsvolDeviceInsertContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STRING FileName, PVOID Context,
     FSP_DEVICE_CONTEXT_BY_NAME_TABLE_ELEMENT *ElementStorage, PBOOLEAN PInserted);
 VOID FspFsvolDeviceDeleteContextByName(PDEVICE_OBJECT DeviceObject, PUNICODE_STRING FileName,
@@ -1608,6 +1654,8 @@ NTSTATUS FspVolumeStop(
     PDEVICE_OBJECT FsctlDeviceObject, PIRP Irp, PIO_STACK_LOCATION IrpSp);
 NTSTATUS FspVolumeNotify(
     PDEVICE_OBJECT FsctlDeviceObject, PIRP Irp, PIO_STACK_LOCATION IrpSp);
+NTSTATUS FspVolumeDataRing(
+    PDEVICE_OBJECT FsctlDeviceObject, PIRP Irp, PIO_STACK_LOCATION IrpSp);
 NTSTATUS FspVolumeWork(
     PDEVICE_OBJECT FsvolDeviceObject, PIRP Irp, PIO_STACK_LOCATION IrpSp);
 
@@ -1717,11 +1765,18 @@ typedef struct
         DirectoryHasSuchFile:1;
     NTSTATUS DispositionStatus;
     UNICODE_STRING DirectoryPattern;
+    FSP_FILE_NAME_PATTERN *DirectoryPatternMatcher; /* 0 when DirectoryPattern is MatchAll */
     UNICODE_STRING DirectoryMarker;
     UINT64 DirInfo;
     ULONG DirInfoCacheHint;
+    /* directory cursor owner (see FspFileDescTryAcquireDirectory) */
+    LONG DirectoryCursorBusy;
+    ULONG NegCacheSequence;
     ULONG EaIndex;
     ULONG EaChangeCount;
+    /* sequential read detection (advisory; not synchronized) */
+    UINT64 ReadNextOffset;
+    ULONG ReadSequentialCount;
     /* stream support */
     HANDLE MainFileHandle;
     PFILE_OBJECT MainFileObject;
@@ -1880,6 +1935,7 @@ VOID FspFileNodeNotifyChange(FSP_FILE_NODE *FileNode, ULONG Filter, ULONG Action
     BOOLEAN InvalidateCaches);
 VOID FspFileNodeInvalidateCachesAndNotifyChangeByName(PDEVICE_OBJECT FsvolDeviceObject,
     PUNICODE_STRING FileName, ULONG Filter, ULONG Action,
+    const FSP_FSCTL_NOTIFY_RANGE_INFO *RangeInfo,
     BOOLEAN InvalidateParentCaches);
 NTSTATUS FspFileNodeProcessLockIrp(FSP_FILE_NODE *FileNode, PIRP Irp);
 NTSTATUS FspFileDescCreate(FSP_FILE_DESC **PFileDesc);
@@ -1888,6 +1944,24 @@ NTSTATUS FspFileDescResetDirectory(FSP_FILE_DESC *FileDesc,
     PUNICODE_STRING FileName, BOOLEAN RestartScan, BOOLEAN IndexSpecified);
 NTSTATUS FspFileDescSetDirectoryMarker(FSP_FILE_DESC *FileDesc,
     PUNICODE_STRING FileName);
+/*
+ * The directory cursor of a FileDesc (DirectoryPattern, DirectoryMarker, DirInfo,
+ * DirInfoCacheHint, DirectoryHasSuchFile) may only be accessed by the cursor owner while it
+ * holds the FileNode (shared or exclusive). A QueryDirectory Request owns the cursor from the
+ * time it is created until it is finalized (including while it is in user mode), so that
+ * other QueryDirectory IRPs on the same FileDesc cannot move the cursor under it.
+ */
+static inline
+BOOLEAN FspFileDescTryAcquireDirectory(FSP_FILE_DESC *FileDesc)
+{
+    return 0 == InterlockedCompareExchange(&FileDesc->DirectoryCursorBusy, 1, 0);
+}
+static inline
+VOID FspFileDescReleaseDirectory(FSP_FILE_DESC *FileDesc)
+{
+    ASSERT(0 != FileDesc->DirectoryCursorBusy);
+    InterlockedExchange(&FileDesc->DirectoryCursorBusy, 0);
+}
 NTSTATUS FspMainFileOpen(
     PDEVICE_OBJECT FsvolDeviceObject,
     PDEVICE_OBJECT DeviceObjectHint,
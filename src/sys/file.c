@@ -83,6 +83,7 @@ VOID FspFileNodeSetDirInfo(FSP_FILE_NODE *FileNode, PCVOID Buffer, ULONG Size);
 BOOLEAN FspFileNodeTrySetDirInfo(FSP_FILE_NODE *FileNode, PCVOID Buffer, ULONG Size,
     ULONG DirInfoChangeNumber);
 static VOID FspFileNodeInvalidateDirInfo(FSP_FILE_NODE *FileNode);
+static VOID FspFileNodeReferenceContext(PVOID Context);
 static VOID FspFileNodeInvalidateDirInfoByName(PDEVICE_OBJECT FsvolDeviceObject,
     PUNICODE_STRING FileName);
 VOID FspFileNodeInvalidateParentDirInfo(FSP_FILE_NODE *FileNode);
@@ -100,7 +101,10 @@ VOID FspFileNodeNotifyChange(FSP_FILE_NODE *FileNode, ULONG Filter, ULONG Action
     BOOLEAN InvalidateCaches);
 VOID FspFileNodeInvalidateCachesAndNotifyChangeByName(PDEVICE_OBJECT FsvolDeviceObject,
     PUNICODE_STRING FileName, ULONG Filter, ULONG Action,
+    const FSP_FSCTL_NOTIFY_RANGE_INFO *RangeInfo,
     BOOLEAN InvalidateParentCaches);
+static BOOLEAN FspFileNodeInvalidateCacheRange(FSP_FILE_NODE *FileNode,
+    UINT64 Offset, UINT64 Length, UINT64 FileSize);
 NTSTATUS FspFileNodeProcessLockIrp(FSP_FILE_NODE *FileNode, PIRP Irp);
 static NTSTATUS FspFileNodeCompleteLockIrp(PVOID Context, PIRP Irp);
 NTSTATUS FspFileDescCreate(FSP_FILE_DESC **PFileDesc);
@@ -163,6 +167,7 @@ VOID FspFileNodeOplockComplete(PVOID Context, PIRP Irp);
 // !#pragma alloc_text(PAGE, FspFileNodeSetDirInfo)
 // !#pragma alloc_text(PAGE, FspFileNodeTrySetDirInfo)
 // !#pragma alloc_text(PAGE, FspFileNodeInvalidateDirInfo)
+#pragma alloc_text(PAGE, FspFileNodeReferenceContext)
 #pragma alloc_text(PAGE, FspFileNodeInvalidateDirInfoByName)
 #pragma alloc_text(PAGE, FspFileNodeInvalidateParentDirInfo)
 // !#pragma alloc_text(PAGE, FspFileNodeReferenceStreamInfo)
@@ -175,6 +180,7 @@ VOID FspFileNodeOplockComplete(PVOID Context, PIRP Irp);
 // !#pragma alloc_text(PAGE, FspFileNodeInvalidateEa)
 #pragma alloc_text(PAGE, FspFileNodeNotifyChange)
 #pragma alloc_text(PAGE, FspFileNodeInvalidateCachesAndNotifyChangeByName)
+#pragma alloc_text(PAGE, FspFileNodeInvalidateCacheRange)
 #pragma alloc_text(PAGE, FspFileNodeProcessLockIrp)
 #pragma alloc_text(PAGE, FspFileNodeCompleteLockIrp)
 #pragma alloc_text(PAGE, FspFileDescCreate)
@@ -204,7 +210,7 @@ VOID FspFileNodeOplockComplete(PVOID Context, PIRP Irp);
     if (IrpValid)                       \
         FspIrpSetFlags(Irp, FspIrpFlags(Irp) & (~Flags & 3))
 
-#define GATHER_DESCENDANTS(FILENAME, REFERENCE, ...)\
+#define GATHER_DESCENDANTS(FILENAME, STREAMSONLY, REFERENCE, ...)\
     FSP_FILE_NODE *DescendantFileNode;\
     FSP_FILE_NODE *DescendantFileNodeArray[16], **DescendantFileNodes;\
     ULONG DescendantFileNodeCount, DescendantFileNodeIndex;\
@@ -215,7 +221,7 @@ VOID FspFileNodeOplockComplete(PVOID Context, PIRP Irp);
     for (;;)                            \
     {                                   \
         DescendantFileNode = FspFsvolDeviceEnumerateContextByName(FsvolDeviceObject,\
-            FILENAME, FALSE, &RestartKey);\
+            FILENAME, STREAMSONLY, &RestartKey);\
         if (0 == DescendantFileNode)    \
             break;                      \
         ASSERT(0 == ((UINT_PTR)DescendantFileNode & 7));\
@@ -235,7 +241,7 @@ VOID FspFileNodeOplockComplete(PVOID Context, PIRP Irp);
         for (;;)                        \
         {                               \
             DescendantFileNode = FspFsvolDeviceEnumerateContextByName(FsvolDeviceObject,\
-                FILENAME, FALSE, &RestartKey);\
+                FILENAME, STREAMSONLY, &RestartKey);\
             if (0 == DescendantFileNode)\
                 break;                  \
             ASSERT(0 == ((UINT_PTR)DescendantFileNode & 7));\
@@ -942,12 +948,8 @@ VOID FspFileNodeCleanupComplete(FSP_FILE_NODE *FileNode, PFILE_OBJECT FileObject
             0 == FileNode->MainFileNode)
         {
             BOOLEAN StreamDeletedFromContextTable;
-            USHORT FileNameLength = FileNode->FileName.Length;
 
-            GATHER_DESCENDANTS(&FileNode->FileName, FALSE,
-                if (DescendantFileNode->FileName.Length > FileNameLength &&
-                    L'\\' == DescendantFileNode->FileName.Buffer[FileNameLength / sizeof(WCHAR)])
-                    break;
+            GATHER_DESCENDANTS(&FileNode->FileName, TRUE, FALSE,
                 ASSERT(FileNode != DescendantFileNode);
                 ASSERT(0 != DescendantFileNode->OpenCount);
                 );
@@ -1171,14 +1173,10 @@ VOID FspFileNodeOverwriteStreams(FSP_FILE_NODE *FileNode)
     ASSERT(0 == FileNode->MainFileNode);
 
     PDEVICE_OBJECT FsvolDeviceObject = FileNode->FsvolDeviceObject;
-    USHORT FileNameLength = FileNode->FileName.Length;
 
     FspFsvolDeviceLockContextTable(FsvolDeviceObject);
 
-    GATHER_DESCENDANTS(&FileNode->FileName, FALSE,
-        if (DescendantFileNode->FileName.Length > FileNameLength &&
-            L'\\' == DescendantFileNode->FileName.Buffer[FileNameLength / sizeof(WCHAR)])
-            break;
+    GATHER_DESCENDANTS(&FileNode->FileName, TRUE, FALSE,
         if (FileNode == DescendantFileNode || 0 >= DescendantFileNode->HandleCount)
             continue;
         );
@@ -1214,7 +1212,6 @@ NTSTATUS FspFileNodeCheckBatchOplocksOnAllStreams(
 
     ASSERT(0 == FileNode->MainFileNode);
 
-    USHORT FileNameLength = FileNode->FileName.Length;
     BOOLEAN CaseInsensitive = !FspFsvolDeviceExtension(FsvolDeviceObject)->
         VolumeParams.CaseSensitiveSearch;
     ULONG IsBatchOplock, IsHandleOplock;
@@ -1222,10 +1219,7 @@ NTSTATUS FspFileNodeCheckBatchOplocksOnAllStreams(
 
     FspFsvolDeviceLockContextTable(FsvolDeviceObject);
 
-    GATHER_DESCENDANTS(&FileNode->FileName, TRUE,
-        if (DescendantFileNode->FileName.Length > FileNameLength &&
-            L'\\' == DescendantFileNode->FileName.Buffer[FileNameLength / sizeof(WCHAR)])
-            break;
+    GATHER_DESCENDANTS(&FileNode->FileName, TRUE, TRUE,
         if (0 >= DescendantFileNode->HandleCount)
             continue;
         if (0 != StreamFileName)
@@ -1335,7 +1329,7 @@ NTSTATUS FspFileNodeRenameCheck(PDEVICE_OBJECT FsvolDeviceObject, PIRP OplockIrp
         return STATUS_SUCCESS;
     }
 
-    GATHER_DESCENDANTS(FileName, TRUE,
+    GATHER_DESCENDANTS(FileName, FALSE, TRUE,
         DescendantFileNode = (PVOID)((UINT_PTR)DescendantFileNode |
             (0 < DescendantFileNode->HandleCount)));
 
@@ -1599,9 +1593,13 @@ VOID FspFileNodeRename(FSP_FILE_NODE *FileNode, PUNICODE_STRING NewFileName)
     USHORT FileNameLength;
     PWSTR ExternalFileName;
 
+    /* the new name and everything below it exist now */
+    FspNegCacheInvalidate(FspFsvolDeviceExtension(FsvolDeviceObject)->NegCache,
+        NewFileName, TRUE);
+
     FspFsvolDeviceLockContextTable(FsvolDeviceObject);
 
-    GATHER_DESCENDANTS(&FileNode->FileName, FALSE, {});
+    GATHER_DESCENDANTS(&FileNode->FileName, FALSE, FALSE, {});
 
     FileNameLength = FileNode->FileName.Length;
     for (
@@ -1747,11 +1745,8 @@ BOOLEAN FspFileNodeTryGetFileInfoByName(PDEVICE_OBJECT FsvolDeviceObject, PIRP I
         /* kernel mode: anything goes! */
         DesiredAccess = 0;
 
-    FspFsvolDeviceLockContextTable(FsvolDeviceObject);
-    FileNode = FspFsvolDeviceLookupContextByName(FsvolDeviceObject, FileName);
-    if (0 != FileNode)
-        FspFileNodeReference(FileNode);
-    FspFsvolDeviceUnlockContextTable(FsvolDeviceObject);
+    FileNode = FspFsvolDeviceLookupContextByName(FsvolDeviceObject, FileName,
+        FspFileNodeReferenceContext);
 
     Result = FALSE;
     if (0 != FileNode)
@@ -2115,6 +2110,14 @@ static VOID FspFileNodeInvalidateDirInfo(FSP_FILE_NODE *FileNode)
     FspMetaCacheInvalidateItem(FsvolDeviceExtension->DirInfoCache, DirInfo);
 }
 
+static VOID FspFileNodeReferenceContext(PVOID Context)
+{
+    PAGED_CODE();
+
+    /* called under the context table shard lock; the table's reference keeps the node alive */
+    FspFileNodeReference(Context);
+}
+
 static VOID FspFileNodeInvalidateDirInfoByName(PDEVICE_OBJECT FsvolDeviceObject,
     PUNICODE_STRING FileName)
 {
@@ -2122,10 +2125,10 @@ static VOID FspFileNodeInvalidateDirInfoByName(PDEVICE_OBJECT FsvolDeviceObject,
 
     FSP_FILE_NODE *FileNode;
 
+    /* hold the context table lock so that we do not miss a node that is being renamed */
     FspFsvolDeviceLockContextTable(FsvolDeviceObject);
-    FileNode = FspFsvolDeviceLookupContextByName(FsvolDeviceObject, FileName);
-    if (0 != FileNode)
-        FspFileNodeReference(FileNode);
+    FileNode = FspFsvolDeviceLookupContextByName(FsvolDeviceObject, FileName,
+        FspFileNodeReferenceContext);
     FspFsvolDeviceUnlockContextTable(FsvolDeviceObject);
 
     if (0 != FileNode)
@@ -2371,35 +2374,50 @@ VOID FspFileNodeNotifyChange(FSP_FILE_NODE *FileNode, ULONG Filter, ULONG Action
 
 VOID FspFileNodeInvalidateCachesAndNotifyChangeByName(PDEVICE_OBJECT FsvolDeviceObject,
     PUNICODE_STRING FileName, ULONG Filter, ULONG Action,
+    const FSP_FSCTL_NOTIFY_RANGE_INFO *RangeInfo,
     BOOLEAN InvalidateParentCaches)
 {
     PAGED_CODE();
 
     FSP_FILE_NODE *FileNode;
 
+    /* the file system may have created the name (or names below it) behind our back */
+    FspNegCacheInvalidate(FspFsvolDeviceExtension(FsvolDeviceObject)->NegCache,
+        FileName, TRUE);
+
+    /* hold the context table lock so that we do not miss a node that is being renamed */
     FspFsvolDeviceLockContextTable(FsvolDeviceObject);
-    FileNode = FspFsvolDeviceLookupContextByName(FsvolDeviceObject, FileName);
-    if (0 != FileNode)
-        FspFileNodeReference(FileNode);
+    FileNode = FspFsvolDeviceLookupContextByName(FsvolDeviceObject, FileName,
+        FspFileNodeReferenceContext);
     FspFsvolDeviceUnlockContextTable(FsvolDeviceObject);
 
     if (0 != FileNode)
     {
         FspFileNodeAcquireExclusive(FileNode, Full);
 
-        if (0 != FileNode->NonPaged->SectionObjectPointers.DataSectionObject)
+        if (0 != RangeInfo && !FileNode->IsDirectory &&
+            FspFileNodeInvalidateCacheRange(FileNode,
+                RangeInfo->Offset, RangeInfo->Length, RangeInfo->FileSize))
         {
-            IO_STATUS_BLOCK IoStatus;
-            FspCcFlushCache(&FileNode->NonPaged->SectionObjectPointers, 0, 0, &IoStatus);
-            if (NT_SUCCESS(IoStatus.Status))
-                CcPurgeCacheSection(&FileNode->NonPaged->SectionObjectPointers, 0, 0, FALSE);
+            /* the file data changed; its security, EA's and streams did not */
+            FspFileNodeInvalidateFileInfo(FileNode);
         }
+        else
+        {
+            if (0 != FileNode->NonPaged->SectionObjectPointers.DataSectionObject)
+            {
+                IO_STATUS_BLOCK IoStatus;
+                FspCcFlushCache(&FileNode->NonPaged->SectionObjectPointers, 0, 0, &IoStatus);
+                if (NT_SUCCESS(IoStatus.Status))
+                    CcPurgeCacheSection(&FileNode->NonPaged->SectionObjectPointers, 0, 0, FALSE);
+            }
 
-        FspFileNodeInvalidateFileInfo(FileNode);
-        FspFileNodeInvalidateSecurity(FileNode);
-        FspFileNodeInvalidateDirInfo(FileNode);
-        FspFileNodeInvalidateStreamInfo(FileNode);
-        FspFileNodeInvalidateEa(FileNode);
+            FspFileNodeInvalidateFileInfo(FileNode);
+            FspFileNodeInvalidateSecurity(FileNode);
+            FspFileNodeInvalidateDirInfo(FileNode);
+            FspFileNodeInvalidateStreamInfo(FileNode);
+            FspFileNodeInvalidateEa(FileNode);
+        }
 
         FspFileNodeNotifyChange(FileNode, Filter, Action, InvalidateParentCaches);
 
@@ -2471,6 +2489,92 @@ VOID FspFileNodeInvalidateCachesAndNotifyChangeByName(PDEVICE_OBJECT FsvolDevice
     }
 }
 
+static BOOLEAN FspFileNodeInvalidateCacheRange(FSP_FILE_NODE *FileNode,
+    UINT64 Offset, UINT64 Length, UINT64 FileSize)
+{
+    /* FileNode must be acquired exclusive (Full) */
+
+    PAGED_CODE();
+
+    /*
+     * Invalidate the cached data of a FileNode in the byte range [Offset, Offset + Length)
+     * and update its file size in place if it changed. This allows a file system to report
+     * that a small part of a large file was modified (e.g. by a remote party) without
+     * throwing away the rest of the file's cached data.
+     *
+     * Returns FALSE if the file sizes cannot be updated in place, in which case the caller
+     * should invalidate all cached data of the FileNode instead.
+     */
+
+    PSECTION_OBJECT_POINTERS SectionObjectPointers = &FileNode->NonPaged->SectionObjectPointers;
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER RangeOffset;
+    UINT64 EndOffset;
+    ULONG RangeLength;
+
+    if (FSP_FSCTL_NOTIFY_FILESIZE_UNCHANGED != FileSize &&
+        (UINT64)FileNode->Header.FileSize.QuadPart != FileSize)
+    {
+        FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension =
+            FspFsvolDeviceExtension(FileNode->FsvolDeviceObject);
+        CC_FILE_SIZES FileSizes;
+        UINT64 AllocationUnit;
+
+        /* compute the new sizes aside; the FileNode is only updated if the cache accepts them */
+        AllocationUnit = FsvolDeviceExtension->VolumeParams.SectorSize *
+            FsvolDeviceExtension->VolumeParams.SectorsPerAllocationUnit;
+        FileSizes.AllocationSize = FileNode->Header.AllocationSize;
+        if ((UINT64)FileSizes.AllocationSize.QuadPart < FileSize)
+            FileSizes.AllocationSize.QuadPart =
+                (FileSize + AllocationUnit - 1) / AllocationUnit * AllocationUnit;
+        FileSizes.FileSize.QuadPart = FileSize;
+        FileSizes.ValidDataLength = FileNode->Header.ValidDataLength;
+
+        if (0 != SectionObjectPointers->DataSectionObject)
+        {
+            PFILE_OBJECT CcFileObject;
+            NTSTATUS Result;
+
+            /* CcSetFileSizes needs a FileObject; borrow the one that backs the section */
+            CcFileObject = CcGetFileObjectFromSectionPtrsRef(SectionObjectPointers);
+            if (0 == CcFileObject)
+                return FALSE;
+            Result = FspCcSetFileSizes(CcFileObject, &FileSizes);
+            ObDereferenceObject(CcFileObject);
+            if (!NT_SUCCESS(Result))
+                return FALSE;
+        }
+
+        FileNode->Header.AllocationSize = FileSizes.AllocationSize;
+        FileNode->Header.FileSize = FileSizes.FileSize;
+        FileNode->FileInfoChangeNumber++;
+    }
+
+    if (0 == SectionObjectPointers->DataSectionObject || 0 == Length)
+        return TRUE;
+
+    /* data past the file size is not cached (CcSetFileSizes purges it when the file shrinks) */
+    EndOffset = Length > MAXUINT64 - Offset ? MAXUINT64 : Offset + Length;
+    if (EndOffset > (UINT64)FileNode->Header.FileSize.QuadPart)
+        EndOffset = (UINT64)FileNode->Header.FileSize.QuadPart;
+
+    /* CcFlushCache and CcPurgeCacheSection take a ULONG length; go in page aligned chunks */
+    Offset &= ~(UINT64)(PAGE_SIZE - 1);
+    while (EndOffset > Offset)
+    {
+        RangeOffset.QuadPart = Offset;
+        RangeLength = EndOffset - Offset > 0x40000000 ? 0x40000000 : (ULONG)(EndOffset - Offset);
+
+        FspCcFlushCache(SectionObjectPointers, &RangeOffset, RangeLength, &IoStatus);
+        if (NT_SUCCESS(IoStatus.Status))
+            CcPurgeCacheSection(SectionObjectPointers, &RangeOffset, RangeLength, FALSE);
+
+        Offset += RangeLength;
+    }
+
+    return TRUE;
+}
+
 NTSTATUS FspFileNodeProcessLockIrp(FSP_FILE_NODE *FileNode, PIRP Irp)
 {
     PAGED_CODE();
@@ -2524,6 +2628,9 @@ VOID FspFileDescDelete(FSP_FILE_DESC *FileDesc)
 
     FspMainFileClose(FileDesc->MainFileHandle, FileDesc->MainFileObject);
 
+    if (0 != FileDesc->DirectoryPatternMatcher)
+        FspFileNamePatternDelete(FileDesc->DirectoryPatternMatcher);
+
     if (0 != FileDesc->DirectoryPattern.Buffer &&
         FspFileDescDirectoryPatternMatchAll != FileDesc->DirectoryPattern.Buffer)
     {
@@ -2548,6 +2655,7 @@ NTSTATUS FspFileDescResetDirectory(FSP_FILE_DESC *FileDesc,
         (RestartScan && 0 != FileName && 0 != FileName->Length))
     {
         UNICODE_STRING DirectoryPattern;
+        FSP_FILE_NAME_PATTERN *DirectoryPatternMatcher = 0;
 
         if (0 == FileName || (sizeof(WCHAR) == FileName->Length && L'*' == FileName->Buffer[0]))
         {
@@ -2556,6 +2664,8 @@ NTSTATUS FspFileDescResetDirectory(FSP_FILE_DESC *FileDesc,
         }
         else
         {
+            NTSTATUS Result;
+
             if (FileDesc->CaseSensitive)
             {
                 DirectoryPattern.Length = DirectoryPattern.MaximumLength = FileName->Length;
@@ -2566,10 +2676,23 @@ NTSTATUS FspFileDescResetDirectory(FSP_FILE_DESC *FileDesc,
             }
             else
             {
-                NTSTATUS Result = RtlUpcaseUnicodeString(&DirectoryPattern, FileName, TRUE);
+                Result = RtlUpcaseUnicodeString(&DirectoryPattern, FileName, TRUE);
                 if (!NT_SUCCESS(Result))
                     return Result;
             }
+
+            /* compile the pattern once rather than interpreting it for every directory entry */
+            Result = FspFileNamePatternCompile(DirectoryPattern.Buffer,
+                DirectoryPattern.Length / sizeof(WCHAR), !FileDesc->CaseSensitive,
+                &DirectoryPatternMatcher);
+            if (!NT_SUCCESS(Result))
+            {
+                if (FileDesc->CaseSensitive)
+                    FspFree(DirectoryPattern.Buffer);
+                else
+                    RtlFreeUnicodeString(&DirectoryPattern);
+                return Result;
+            }
         }
 
         if (0 != FileDesc->DirectoryPattern.Buffer &&
@@ -2581,7 +2704,11 @@ NTSTATUS FspFileDescResetDirectory(FSP_FILE_DESC *FileDesc,
                 RtlFreeUnicodeString(&FileDesc->DirectoryPattern);
         }
 
+        if (0 != FileDesc->DirectoryPatternMatcher)
+            FspFileNamePatternDelete(FileDesc->DirectoryPatternMatcher);
+
         FileDesc->DirectoryPattern = DirectoryPattern;
+        FileDesc->DirectoryPatternMatcher = DirectoryPatternMatcher;
         FileDesc->DirectoryHasSuchFile = FALSE;
 
         if (0 != FileDesc->DirectoryMarker.Buffer)
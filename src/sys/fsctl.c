@@ -128,6 +128,10 @@ static NTSTATUS FspFsctlFileSystemControl(
             if (0 != IrpSp->FileObject->FsContext2)
                 Result = FspVolumeNotify(FsctlDeviceObject, Irp, IrpSp);
             break;
+        case FSP_FSCTL_DATA_RING:
+            if (0 != IrpSp->FileObject->FsContext2)
+                Result = FspVolumeDataRing(FsctlDeviceObject, Irp, IrpSp);
+            break;
         case FSP_FSCTL_UNLOAD:
             Result = FspDriverUnload(FsctlDeviceObject, Irp, IrpSp);
             break;
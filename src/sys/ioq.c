@@ -133,6 +133,23 @@
  * UPDATE: We can now use a Queued Event which behaves like a SynchronizationEvent,
  * but has better performance. Unfortunately Queued Events cannot cleanly implement
  * an EventClear operation. However the EventClear operation is not strictly needed.
+ *
+ * UPDATE: The pending queue is now a shard queue (see shared/ku/shardq.c). There is a
+ * FIFO list per processor, each with its own spin lock and its own IO_CSQ, so that IRP's
+ * posted on different processors no longer contend on the FSP_IOQ spin lock. A thread that
+ * wants a pending IRP removes the head of the shard whose head is oldest; this keeps the
+ * order in which IRP's are delivered the same as with a single list. Cancelation goes
+ * through the IO_CSQ of the shard that holds the IRP. The Stopped flag is still set under
+ * the FSP_IOQ spin lock, but FspIoqStop also cycles through the shard locks so that every
+ * shard observes it.
+ *
+ * The shard queue also counts waiting threads. A thread checks the queue before waiting
+ * and announces itself before checking it again, so a posting thread only signals the
+ * PendingIrpEvent when a thread is waiting, and the Queued Event wakes only one of them.
+ * When a thread removes an IRP and more IRP's remain while threads wait, it passes the
+ * wakeup along to the next thread. The PendingIrpCapacity check is done against the shard
+ * queue's interlocked count without a queue-wide lock, so concurrent posts may exceed the
+ * capacity by a few IRP's.
  */
 
 /*
@@ -143,7 +160,7 @@
 #if defined(FSP_IOQ_USE_QEVENT)
 #define FspIoqEventInitialize(E)        FspQeventInitialize(E, 0)
 #define FspIoqEventFinalize(E)          FspQeventFinalize(E)
-#define FspIoqEventSet(E)               FspQeventSetNoLock(E)
+#define FspIoqEventSet(E)               (0 == KeReadStateQueue(&(E)->Queue) ? FspQeventSet(E) : (VOID)0)
 #define FspIoqEventCancellableWait(E,T,I)   FspQeventCancellableWait(E,T,I)
 #define FspIoqEventClear(E)             ((VOID)0)
 #else
@@ -217,15 +234,29 @@ typedef struct
 {
     PVOID IrpHint;
     ULONG ExpirationTime;
+    LONG HeadSequence;
+    BOOLEAN Stale;
 } FSP_IOQ_PEEK_CONTEXT;
 
+typedef struct
+{
+    IO_CSQ IoCsq;
+    FSP_IOQ *Ioq;
+    FSP_SHARD_QUEUE_SHARD *Shard;
+} FSP_IOQ_PENDING_SHARD;
+#define FspIoqPendingShard(S)           ((FSP_IOQ_PENDING_SHARD *)FspShardQueueShardExtension(S))
+#define FspIoqPendingSequenceOffset     \
+    ((LONG)FIELD_OFFSET(IRP, Tail.Overlay.DriverContext[1]) - \
+        (LONG)FIELD_OFFSET(IRP, Tail.Overlay.ListEntry))
+    /* the sequence number of a pending IRP shares the FspIrpDictNext slot */
+
 static inline VOID FspIoqPendingResetSynch(FSP_IOQ *Ioq)
 {
     /*
      * Examine the actual condition of the pending queue and
      * set the PendingIrpEvent accordingly.
      */
-    if (0 != Ioq->PendingIrpCount || Ioq->Stopped)
+    if (0 != FspShardQueueCount(Ioq->PendingQueue) || Ioq->Stopped)
         /* list is not empty or is stopped; wake up a waiter */
         FspIoqEventSet(&Ioq->PendingIrpEvent);
     else
@@ -236,35 +267,44 @@ static inline VOID FspIoqPendingResetSynch(FSP_IOQ *Ioq)
 
 static NTSTATUS FspIoqPendingInsertIrpEx(PIO_CSQ IoCsq, PIRP Irp, PVOID InsertContext)
 {
-    FSP_IOQ *Ioq = CONTAINING_RECORD(IoCsq, FSP_IOQ, PendingIoCsq);
+    FSP_IOQ_PENDING_SHARD *PendingShard = CONTAINING_RECORD(IoCsq, FSP_IOQ_PENDING_SHARD, IoCsq);
+    FSP_IOQ *Ioq = PendingShard->Ioq;
     if (Ioq->Stopped)
         return STATUS_CANCELLED;
-    if (!InsertContext && Ioq->PendingIrpCapacity <= Ioq->PendingIrpCount)
+    if (!InsertContext && Ioq->PendingIrpCapacity <= FspShardQueueCount(Ioq->PendingQueue))
         return STATUS_INSUFFICIENT_RESOURCES;
-    Ioq->PendingIrpCount++;
-    InsertTailList(&Ioq->PendingIrpList, &Irp->Tail.Overlay.ListEntry);
-    FspIoqEventSet(&Ioq->PendingIrpEvent);
-        /* equivalent to FspIoqPendingResetSynch(Ioq) */
+    if (FspShardQueueInsertTail(Ioq->PendingQueue, PendingShard->Shard,
+        &Irp->Tail.Overlay.ListEntry))
+        /* a thread is waiting; wake up one */
+        FspIoqEventSet(&Ioq->PendingIrpEvent);
     return STATUS_SUCCESS;
 }
 
 static VOID FspIoqPendingRemoveIrp(PIO_CSQ IoCsq, PIRP Irp)
 {
-    FSP_IOQ *Ioq = CONTAINING_RECORD(IoCsq, FSP_IOQ, PendingIoCsq);
-    Ioq->PendingIrpCount--;
-    RemoveEntryList(&Irp->Tail.Overlay.ListEntry);
-    FspIoqPendingResetSynch(Ioq);
+    FSP_IOQ_PENDING_SHARD *PendingShard = CONTAINING_RECORD(IoCsq, FSP_IOQ_PENDING_SHARD, IoCsq);
+    FSP_IOQ *Ioq = PendingShard->Ioq;
+    if (FspShardQueueRemove(Ioq->PendingQueue, PendingShard->Shard,
+        &Irp->Tail.Overlay.ListEntry))
+        /* IRP's remain and threads are waiting; pass the wakeup along */
+        FspIoqEventSet(&Ioq->PendingIrpEvent);
 }
 
 static PIRP FspIoqPendingPeekNextIrp(PIO_CSQ IoCsq, PIRP Irp, PVOID PeekContext)
 {
-    FSP_IOQ *Ioq = CONTAINING_RECORD(IoCsq, FSP_IOQ, PendingIoCsq);
+    FSP_IOQ_PENDING_SHARD *PendingShard = CONTAINING_RECORD(IoCsq, FSP_IOQ_PENDING_SHARD, IoCsq);
+    FSP_IOQ *Ioq = PendingShard->Ioq;
     if (PeekContext && Ioq->Stopped)
         return 0;
-    PLIST_ENTRY Head = &Ioq->PendingIrpList;
-    PLIST_ENTRY Entry = 0 == Irp ? Head->Flink : Irp->Tail.Overlay.ListEntry.Flink;
-    if (Head == Entry)
+    PLIST_ENTRY Entry = FspShardQueueNext(PendingShard->Shard,
+        0 == Irp ? 0 : &Irp->Tail.Overlay.ListEntry);
+    if (0 == Entry)
+    {
+        if (PeekContext && 0 != ((FSP_IOQ_PEEK_CONTEXT *)PeekContext)->IrpHint)
+            /* the shard was emptied after FspShardQueueOldestShard found it */
+            ((FSP_IOQ_PEEK_CONTEXT *)PeekContext)->Stale = TRUE;
         return 0;
+    }
     Irp = CONTAINING_RECORD(Entry, IRP, Tail.Overlay.ListEntry);
     if (!PeekContext)
         return Irp;
@@ -276,38 +316,77 @@ static PIRP FspIoqPendingPeekNextIrp(PIO_CSQ IoCsq, PIRP Irp, PVOID PeekContext)
         {
             if (FspIrpTimestampInfinity != FspIrpTimestamp(Irp))
                 return FspIrpTimestamp(Irp) <= ExpirationTime ? Irp : 0;
-            Entry = Entry->Flink;
-            if (Head == Entry)
+            Entry = FspShardQueueNext(PendingShard->Shard, Entry);
+            if (0 == Entry)
                 return 0;
             Irp = CONTAINING_RECORD(Entry, IRP, Tail.Overlay.ListEntry);
         }
     }
     else
     {
-        if (Irp == IrpHint)
+        /* only remove the head that FspShardQueueOldestShard found */
+        if (PendingShard->Shard->ListHead.Flink != Entry ||
+            PendingShard->Shard->HeadSequence != ((FSP_IOQ_PEEK_CONTEXT *)PeekContext)->HeadSequence)
+        {
+            ((FSP_IOQ_PEEK_CONTEXT *)PeekContext)->Stale = TRUE;
             return 0;
-        return Irp;
+        }
+        /* reaching the boundary IRP ends the scan (the peek is not stale) */
+        return Irp != IrpHint ? Irp : 0;
     }
 }
 
 _IRQL_raises_(DISPATCH_LEVEL)
 static VOID FspIoqPendingAcquireLock(PIO_CSQ IoCsq, _At_(*PIrql, _IRQL_saves_) PKIRQL PIrql)
 {
-    FSP_IOQ *Ioq = CONTAINING_RECORD(IoCsq, FSP_IOQ, PendingIoCsq);
-    KeAcquireSpinLock(&Ioq->SpinLock, PIrql);
+    FSP_IOQ_PENDING_SHARD *PendingShard = CONTAINING_RECORD(IoCsq, FSP_IOQ_PENDING_SHARD, IoCsq);
+    FspShardQueueLock(PendingShard->Shard, PIrql);
 }
 
 _IRQL_requires_(DISPATCH_LEVEL)
 static VOID FspIoqPendingReleaseLock(PIO_CSQ IoCsq, _IRQL_restores_ KIRQL Irql)
 {
-    FSP_IOQ *Ioq = CONTAINING_RECORD(IoCsq, FSP_IOQ, PendingIoCsq);
-    KeReleaseSpinLock(&Ioq->SpinLock, Irql);
+    FSP_IOQ_PENDING_SHARD *PendingShard = CONTAINING_RECORD(IoCsq, FSP_IOQ_PENDING_SHARD, IoCsq);
+    FspShardQueueUnlock(PendingShard->Shard, Irql);
 }
 
 static VOID FspIoqPendingCompleteCanceledIrp(PIO_CSQ IoCsq, PIRP Irp)
 {
-    FSP_IOQ *Ioq = CONTAINING_RECORD(IoCsq, FSP_IOQ, PendingIoCsq);
-    Ioq->CompleteCanceledIrp(Irp);
+    FSP_IOQ_PENDING_SHARD *PendingShard = CONTAINING_RECORD(IoCsq, FSP_IOQ_PENDING_SHARD, IoCsq);
+    PendingShard->Ioq->CompleteCanceledIrp(Irp);
+}
+
+static PIRP FspIoqPendingRemoveNextIrp(FSP_IOQ *Ioq, FSP_IOQ_PEEK_CONTEXT *PeekContext)
+{
+    /*
+     * Remove the oldest pending IRP across all shards. The shard with the oldest head
+     * is found without locks; if another thread removes that head before we lock the
+     * shard, look again.
+     */
+    FSP_SHARD_QUEUE_SHARD *Shard;
+    PIRP Irp;
+    for (;;)
+    {
+        Shard = FspShardQueueOldestShard(Ioq->PendingQueue, &PeekContext->HeadSequence);
+        if (0 == Shard)
+            return 0;
+        PeekContext->Stale = FALSE;
+        Irp = IoCsqRemoveNextIrp(&FspIoqPendingShard(Shard)->IoCsq, PeekContext);
+        if (0 != Irp || !PeekContext->Stale)
+            return Irp;
+    }
+}
+
+static VOID FspIoqPendingCancelIrps(FSP_IOQ *Ioq, FSP_IOQ_PEEK_CONTEXT *PeekContext)
+{
+    FSP_SHARD_QUEUE_SHARD *Shard;
+    PIRP Irp;
+    for (ULONG I = 0, N = FspShardQueueShardCount(Ioq->PendingQueue); N > I; I++)
+    {
+        Shard = FspShardQueueShard(Ioq->PendingQueue, I);
+        while (0 != (Irp = IoCsqRemoveNextIrp(&FspIoqPendingShard(Shard)->IoCsq, PeekContext)))
+            Ioq->CompleteCanceledIrp(Irp);
+    }
 }
 
 static NTSTATUS FspIoqProcessInsertIrpEx(PIO_CSQ IoCsq, PIRP Irp, PVOID InsertContext)
@@ -482,24 +561,40 @@ NTSTATUS FspIoqCreate(
     *PIoq = 0;
 
     FSP_IOQ *Ioq;
+    FSP_SHARD_QUEUE *PendingQueue;
+    NTSTATUS Result;
     ULONG BucketCount = (PAGE_SIZE - sizeof *Ioq) / sizeof Ioq->ProcessIrpBuckets[0];
+    Result = FspShardQueueCreate(FspProcessorCount, sizeof(FSP_IOQ_PENDING_SHARD),
+        FspIoqPendingSequenceOffset, &PendingQueue);
+    if (!NT_SUCCESS(Result))
+        return Result;
     Ioq = FspAllocNonPaged(PAGE_SIZE);
     if (0 == Ioq)
+    {
+        FspShardQueueDelete(PendingQueue);
         return STATUS_INSUFFICIENT_RESOURCES;
+    }
     RtlZeroMemory(Ioq, PAGE_SIZE);
 
     KeInitializeSpinLock(&Ioq->SpinLock);
     FspIoqEventInitialize(&Ioq->PendingIrpEvent);
-    InitializeListHead(&Ioq->PendingIrpList);
+    Ioq->PendingQueue = PendingQueue;
+    for (ULONG I = 0, N = FspShardQueueShardCount(PendingQueue); N > I; I++)
+    {
+        FSP_SHARD_QUEUE_SHARD *Shard = FspShardQueueShard(PendingQueue, I);
+        FSP_IOQ_PENDING_SHARD *PendingShard = FspIoqPendingShard(Shard);
+        IoCsqInitializeEx(&PendingShard->IoCsq,
+            FspIoqPendingInsertIrpEx,
+            FspIoqPendingRemoveIrp,
+            FspIoqPendingPeekNextIrp,
+            FspIoqPendingAcquireLock,
+            FspIoqPendingReleaseLock,
+            FspIoqPendingCompleteCanceledIrp);
+        PendingShard->Ioq = Ioq;
+        PendingShard->Shard = Shard;
+    }
     InitializeListHead(&Ioq->ProcessIrpList);
     InitializeListHead(&Ioq->RetriedIrpList);
-    IoCsqInitializeEx(&Ioq->PendingIoCsq,
-        FspIoqPendingInsertIrpEx,
-        FspIoqPendingRemoveIrp,
-        FspIoqPendingPeekNextIrp,
-        FspIoqPendingAcquireLock,
-        FspIoqPendingReleaseLock,
-        FspIoqPendingCompleteCanceledIrp);
     IoCsqInitializeEx(&Ioq->ProcessIoCsq,
         FspIoqProcessInsertIrpEx,
         FspIoqProcessRemoveIrp,
@@ -529,6 +624,7 @@ VOID FspIoqDelete(FSP_IOQ *Ioq)
 {
     FspIoqStop(Ioq, TRUE);
     FspIoqEventFinalize(&Ioq->PendingIrpEvent);
+    FspShardQueueDelete(Ioq->PendingQueue);
     FspFree(Ioq);
 }
 
@@ -537,15 +633,21 @@ VOID FspIoqStop(FSP_IOQ *Ioq, BOOLEAN CancelIrps)
     KIRQL Irql;
     KeAcquireSpinLock(&Ioq->SpinLock, &Irql);
     Ioq->Stopped = TRUE;
+    KeReleaseSpinLock(&Ioq->SpinLock, Irql);
+    /* cycle through the shard locks; posts that follow will see that we are stopped */
+    for (ULONG I = 0, N = FspShardQueueShardCount(Ioq->PendingQueue); N > I; I++)
+    {
+        FSP_SHARD_QUEUE_SHARD *Shard = FspShardQueueShard(Ioq->PendingQueue, I);
+        FspShardQueueLock(Shard, &Irql);
+        FspShardQueueUnlock(Shard, Irql);
+    }
     /* we are being stopped, permanently wake up waiters */
     FspIoqEventSet(&Ioq->PendingIrpEvent);
         /* equivalent to FspIoqPendingResetSynch(Ioq) */
-    KeReleaseSpinLock(&Ioq->SpinLock, Irql);
     if (CancelIrps)
     {
         PIRP Irp;
-        while (0 != (Irp = IoCsqRemoveNextIrp(&Ioq->PendingIoCsq, 0)))
-            Ioq->CompleteCanceledIrp(Irp);
+        FspIoqPendingCancelIrps(Ioq, 0);
         while (0 != (Irp = FspCsqRemoveNextIrp(&Ioq->ProcessIoCsq, 0)))
             Ioq->CompleteCanceledIrp(Irp);
         while (0 != (Irp = FspCsqRemoveNextIrp(&Ioq->RetriedIoCsq, 0)))
@@ -568,10 +670,9 @@ VOID FspIoqRemoveExpired(FSP_IOQ *Ioq, UINT64 InterruptTime)
     FSP_IOQ_PEEK_CONTEXT PeekContext;
     PeekContext.IrpHint = 0;
     PeekContext.ExpirationTime = ConvertInterruptTimeToSec(InterruptTime);
-    PIRP Irp;
-    while (0 != (Irp = IoCsqRemoveNextIrp(&Ioq->PendingIoCsq, &PeekContext)))
-        Ioq->CompleteCanceledIrp(Irp);
+    FspIoqPendingCancelIrps(Ioq, &PeekContext);
 #if !defined(FSP_IOQ_PROCESS_NO_CANCEL)
+    PIRP Irp;
     while (0 != (Irp = FspCsqRemoveNextIrp(&Ioq->ProcessIoCsq, &PeekContext)))
         Ioq->CompleteCanceledIrp(Irp);
     while (0 != (Irp = FspCsqRemoveNextIrp(&Ioq->RetryIoCsq, &PeekContext)))
@@ -584,7 +685,9 @@ BOOLEAN FspIoqPostIrpEx(FSP_IOQ *Ioq, PIRP Irp, BOOLEAN BestEffort, NTSTATUS *PR
     NTSTATUS Result;
     FspIrpTimestamp(Irp) = BestEffort ? FspIrpTimestampInfinity :
         QueryInterruptTimeInSec() + Ioq->IrpTimeout;
-    Result = IoCsqInsertIrpEx(&Ioq->PendingIoCsq, Irp, 0, (PVOID)BestEffort);
+    Result = IoCsqInsertIrpEx(
+        &FspIoqPendingShard(FspShardQueueCurrentShard(Ioq->PendingQueue))->IoCsq,
+        Irp, 0, (PVOID)BestEffort);
     if (NT_SUCCESS(Result))
     {
         if (0 != PResult)
@@ -607,54 +710,44 @@ PIRP FspIoqNextPendingIrp(FSP_IOQ *Ioq, PIRP BoundaryIrp, PLARGE_INTEGER Timeout
     PIRP PendingIrp;
     PeekContext.IrpHint = 0 != BoundaryIrp ? BoundaryIrp : (PVOID)1;
     PeekContext.ExpirationTime = 0;
-    if (0 != Timeout)
+    PendingIrp = FspIoqPendingRemoveNextIrp(Ioq, &PeekContext);
+    if (0 == PendingIrp && 0 != Timeout)
     {
-        NTSTATUS Result;
-        Result = FspIoqEventCancellableWait(&Ioq->PendingIrpEvent, Timeout,
-            CancellableIrp);
+        NTSTATUS Result = STATUS_SUCCESS;
+        /*
+         * Posting threads only signal the PendingIrpEvent when a thread is waiting.
+         * Announce ourselves and check the queue again before we go to sleep.
+         */
+        if (FspShardQueueBeginWait(Ioq->PendingQueue) && !FspIoqStopped(Ioq))
+            Result = FspIoqEventCancellableWait(&Ioq->PendingIrpEvent, Timeout,
+                CancellableIrp);
+        FspShardQueueEndWait(Ioq->PendingQueue);
         if (STATUS_TIMEOUT == Result)
             return FspIoqTimeout;
         if (STATUS_CANCELLED == Result || STATUS_THREAD_IS_TERMINATING == Result)
             return FspIoqCancelled;
         ASSERT(STATUS_SUCCESS == Result);
-        PendingIrp = IoCsqRemoveNextIrp(&Ioq->PendingIoCsq, &PeekContext);
+        PendingIrp = FspIoqPendingRemoveNextIrp(Ioq, &PeekContext);
         if (0 == PendingIrp)
-        {
             /*
              * The WaitForSingleObject call above has reset our PendingIrpEvent,
              * but we did not receive an IRP. For this reason we have to reset
              * our synchronization based on the actual condition of the pending
              * queue.
              */
-            KIRQL Irql;
-            KeAcquireSpinLock(&Ioq->SpinLock, &Irql);
             FspIoqPendingResetSynch(Ioq);
-            KeReleaseSpinLock(&Ioq->SpinLock, Irql);
-        }
     }
-    else
-        PendingIrp = IoCsqRemoveNextIrp(&Ioq->PendingIoCsq, &PeekContext);
     return PendingIrp;
 }
 
 ULONG FspIoqPendingIrpCount(FSP_IOQ *Ioq)
 {
-    ULONG Result;
-    KIRQL Irql;
-    KeAcquireSpinLock(&Ioq->SpinLock, &Irql);
-    Result = Ioq->PendingIrpCount;
-    KeReleaseSpinLock(&Ioq->SpinLock, Irql);
-    return Result;
+    return FspShardQueueCount(Ioq->PendingQueue);
 }
 
 BOOLEAN FspIoqPendingAboveWatermark(FSP_IOQ *Ioq, ULONG Watermark)
 {
-    BOOLEAN Result;
-    KIRQL Irql;
-    KeAcquireSpinLock(&Ioq->SpinLock, &Irql);
-    Result = Watermark < 100 * Ioq->PendingIrpCount / Ioq->PendingIrpCapacity;
-    KeReleaseSpinLock(&Ioq->SpinLock, Irql);
-    return Result;
+    return Watermark < 100 * FspShardQueueCount(Ioq->PendingQueue) / Ioq->PendingIrpCapacity;
 }
 
 BOOLEAN FspIoqStartProcessingIrp(FSP_IOQ *Ioq, PIRP Irp)
@@ -703,10 +796,7 @@ BOOLEAN FspIoqRetryCompleteIrp(FSP_IOQ *Ioq, PIRP Irp, NTSTATUS *PResult)
     if (NT_SUCCESS(Result))
     {
         /* wake up a waiter */
-        KIRQL Irql;
-        KeAcquireSpinLock(&Ioq->SpinLock, &Irql);
         FspIoqEventSet(&Ioq->PendingIrpEvent);
-        KeReleaseSpinLock(&Ioq->SpinLock, Irql);
 
         if (0 != PResult)
             *PResult = STATUS_PENDING;
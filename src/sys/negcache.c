@@ -0,0 +1,422 @@
+/**
+ * @file sys/negcache.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <sys/driver.h>
+
+NTSTATUS FspNegCacheCreate(
+    ULONG NegCapacity, PLARGE_INTEGER NegTimeout, BOOLEAN CaseInsensitive,
+    FSP_NEG_CACHE **PNegCache);
+VOID FspNegCacheDelete(FSP_NEG_CACHE *NegCache);
+VOID FspNegCacheInvalidateExpired(FSP_NEG_CACHE *NegCache, UINT64 ExpirationTime);
+ULONG FspNegCacheSequence(FSP_NEG_CACHE *NegCache);
+BOOLEAN FspNegCacheLookup(FSP_NEG_CACHE *NegCache, PUNICODE_STRING FileName);
+VOID FspNegCacheAdd(FSP_NEG_CACHE *NegCache, PUNICODE_STRING FileName, ULONG Sequence);
+VOID FspNegCacheInvalidate(FSP_NEG_CACHE *NegCache, PUNICODE_STRING FileName,
+    BOOLEAN Descendants);
+
+#ifdef ALLOC_PRAGMA
+#pragma alloc_text(PAGE, FspNegCacheCreate)
+#pragma alloc_text(PAGE, FspNegCacheDelete)
+// !#pragma alloc_text(PAGE, FspNegCacheInvalidateExpired)
+// !#pragma alloc_text(PAGE, FspNegCacheSequence)
+// !#pragma alloc_text(PAGE, FspNegCacheLookup)
+// !#pragma alloc_text(PAGE, FspNegCacheAdd)
+// !#pragma alloc_text(PAGE, FspNegCacheInvalidate)
+#endif
+
+/*
+ * Negative Name Cache
+ *
+ * The negative name cache remembers names that the user mode file system has recently
+ * reported as nonexistent (STATUS_OBJECT_NAME_NOT_FOUND), so that repeated opens of such
+ * names can be failed without a round trip to user mode.
+ *
+ * All items have the same timeout, so the item list is ordered by expiration time; the
+ * oldest item is evicted when the cache is full. Names are stored upcased when the cache
+ * is case-insensitive. The cache uses the case sensitivity of the volume; callers must not
+ * use it for opens with a different case sensitivity (see FspFsvolCreateIsNegCacheable).
+ *
+ * Every invalidation increments the cache Sequence. A name is only added if the Sequence
+ * has not changed since the corresponding Create request was issued; this prevents a
+ * Create that raced with the creation of a name from caching a stale negative entry.
+ */
+
+typedef struct _FSP_NEG_CACHE_ITEM
+{
+    LIST_ENTRY ListEntry;
+    struct _FSP_NEG_CACHE_ITEM *DictNext;
+    UINT64 ExpirationTime;
+    ULONG Hash;
+    UNICODE_STRING Name;
+    WCHAR NameBuf[];
+} FSP_NEG_CACHE_ITEM;
+
+typedef struct
+{
+    UNICODE_STRING Name;
+    ULONG Hash;
+    WCHAR NameBuf[128];
+} FSP_NEG_CACHE_KEY;
+
+static BOOLEAN FspNegCacheKeyInit(FSP_NEG_CACHE *NegCache, PUNICODE_STRING FileName,
+    FSP_NEG_CACHE_KEY *Key, PWCH Buffer)
+{
+    ULONG Hash = 2166136261;
+
+    if (0 == Buffer)
+    {
+        if (sizeof Key->NameBuf >= FileName->Length)
+            Buffer = Key->NameBuf;
+        else
+        {
+            Buffer = FspAlloc(FileName->Length);
+            if (0 == Buffer)
+                return FALSE;
+        }
+    }
+
+    Key->Name.Length = Key->Name.MaximumLength = FileName->Length;
+    Key->Name.Buffer = Buffer;
+
+    if (NegCache->CaseInsensitive)
+        for (ULONG I = 0, N = FileName->Length / sizeof(WCHAR); N > I; I++)
+            Buffer[I] = RtlUpcaseUnicodeChar(FileName->Buffer[I]);
+    else
+        RtlCopyMemory(Buffer, FileName->Buffer, FileName->Length);
+
+    for (ULONG I = 0, N = FileName->Length / sizeof(WCHAR); N > I; I++)
+        Hash = (Hash ^ Buffer[I]) * 16777619;
+    Key->Hash = Hash;
+
+    return TRUE;
+}
+
+static inline VOID FspNegCacheKeyFini(FSP_NEG_CACHE_KEY *Key)
+{
+    if (Key->NameBuf != Key->Name.Buffer)
+        FspFree(Key->Name.Buffer);
+}
+
+static inline BOOLEAN FspNegCacheKeyEqual(ULONG Hash, PUNICODE_STRING Name,
+    FSP_NEG_CACHE_ITEM *Item)
+{
+    return Hash == Item->Hash &&
+        Name->Length == Item->Name.Length &&
+        RtlEqualMemory(Name->Buffer, Item->Name.Buffer, Name->Length);
+}
+
+static inline BOOLEAN FspNegCacheKeyIsPrefix(PUNICODE_STRING Prefix, FSP_NEG_CACHE_ITEM *Item)
+{
+    WCHAR C;
+
+    /* the root directory is the prefix of all names */
+    if (sizeof(WCHAR) == Prefix->Length)
+        return TRUE;
+
+    if (Prefix->Length > Item->Name.Length ||
+        !RtlEqualMemory(Prefix->Buffer, Item->Name.Buffer, Prefix->Length))
+        return FALSE;
+
+    if (Prefix->Length == Item->Name.Length)
+        return TRUE;
+
+    C = Item->Name.Buffer[Prefix->Length / sizeof(WCHAR)];
+    return L'\\' == C || L':' == C;
+}
+
+static inline VOID FspNegCacheInsertItemAtDpcLevel(FSP_NEG_CACHE *NegCache,
+    FSP_NEG_CACHE_ITEM *Item)
+{
+    ULONG HashIndex = Item->Hash % NegCache->ItemBucketCount;
+
+    Item->DictNext = NegCache->ItemBuckets[HashIndex];
+    NegCache->ItemBuckets[HashIndex] = Item;
+
+    InsertTailList(&NegCache->ItemList, &Item->ListEntry);
+    NegCache->ItemCount++;
+}
+
+static inline FSP_NEG_CACHE_ITEM *FspNegCacheRemoveItemAtDpcLevel(FSP_NEG_CACHE *NegCache,
+    FSP_NEG_CACHE_ITEM *Item)
+{
+    ULONG HashIndex = Item->Hash % NegCache->ItemBucketCount;
+
+    for (FSP_NEG_CACHE_ITEM **P = (PVOID)&NegCache->ItemBuckets[HashIndex]; *P; P = &(*P)->DictNext)
+        if (*P == Item)
+        {
+            *P = (*P)->DictNext;
+            break;
+        }
+
+    RemoveEntryList(&Item->ListEntry);
+    NegCache->ItemCount--;
+
+    return Item;
+}
+
+static inline FSP_NEG_CACHE_ITEM *FspNegCacheLookupItemAtDpcLevel(FSP_NEG_CACHE *NegCache,
+    FSP_NEG_CACHE_KEY *Key)
+{
+    ULONG HashIndex = Key->Hash % NegCache->ItemBucketCount;
+
+    for (FSP_NEG_CACHE_ITEM *Item = NegCache->ItemBuckets[HashIndex]; Item; Item = Item->DictNext)
+        if (FspNegCacheKeyEqual(Key->Hash, &Key->Name, Item))
+            return Item;
+
+    return 0;
+}
+
+static inline FSP_NEG_CACHE_ITEM *FspNegCacheRemoveExpiredItemAtDpcLevel(FSP_NEG_CACHE *NegCache,
+    UINT64 ExpirationTime)
+{
+    PLIST_ENTRY Head = &NegCache->ItemList;
+    PLIST_ENTRY Entry = Head->Flink;
+    FSP_NEG_CACHE_ITEM *Item;
+
+    if (Head == Entry)
+        return 0;
+
+    Item = CONTAINING_RECORD(Entry, FSP_NEG_CACHE_ITEM, ListEntry);
+    if (FspExpirationTimeValid2(Item->ExpirationTime, ExpirationTime))
+        return 0;
+
+    return FspNegCacheRemoveItemAtDpcLevel(NegCache, Item);
+}
+
+NTSTATUS FspNegCacheCreate(
+    ULONG NegCapacity, PLARGE_INTEGER NegTimeout, BOOLEAN CaseInsensitive,
+    FSP_NEG_CACHE **PNegCache)
+{
+    PAGED_CODE();
+
+    FSP_NEG_CACHE *NegCache;
+    ULONG BucketCount;
+
+    *PNegCache = 0;
+
+    if (0 == NegCapacity || 0 == NegTimeout->QuadPart)
+        return STATUS_SUCCESS;
+
+    NegCache = FspAllocNonPaged(PAGE_SIZE);
+    if (0 == NegCache)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    BucketCount = (PAGE_SIZE - sizeof *NegCache) / sizeof NegCache->ItemBuckets[0];
+    RtlZeroMemory(NegCache, PAGE_SIZE);
+    KeInitializeSpinLock(&NegCache->SpinLock);
+    InitializeListHead(&NegCache->ItemList);
+    NegCache->NegCapacity = NegCapacity;
+    NegCache->NegTimeout = NegTimeout->QuadPart;
+    NegCache->CaseInsensitive = CaseInsensitive;
+    NegCache->ItemBucketCount = BucketCount;
+
+    *PNegCache = NegCache;
+
+    return STATUS_SUCCESS;
+}
+
+VOID FspNegCacheDelete(FSP_NEG_CACHE *NegCache)
+{
+    PAGED_CODE();
+
+    if (0 == NegCache)
+        return;
+
+    FspNegCacheInvalidateExpired(NegCache, (UINT64)-1LL);
+    FspFree(NegCache);
+}
+
+VOID FspNegCacheInvalidateExpired(FSP_NEG_CACHE *NegCache, UINT64 ExpirationTime)
+{
+    // !PAGED_CODE();
+
+    FSP_NEG_CACHE_ITEM *Item;
+    KIRQL Irql;
+
+    if (0 == NegCache)
+        return;
+
+    for (;;)
+    {
+        KeAcquireSpinLock(&NegCache->SpinLock, &Irql);
+        Item = FspNegCacheRemoveExpiredItemAtDpcLevel(NegCache, ExpirationTime);
+        KeReleaseSpinLock(&NegCache->SpinLock, Irql);
+
+        if (0 == Item)
+            break;
+
+        FspFree(Item);
+    }
+}
+
+ULONG FspNegCacheSequence(FSP_NEG_CACHE *NegCache)
+{
+    // !PAGED_CODE();
+
+    if (0 == NegCache)
+        return 0;
+
+    return (ULONG)InterlockedOr((PLONG)&NegCache->Sequence, 0);
+}
+
+BOOLEAN FspNegCacheLookup(FSP_NEG_CACHE *NegCache, PUNICODE_STRING FileName)
+{
+    // !PAGED_CODE();
+
+    FSP_NEG_CACHE_KEY Key;
+    FSP_NEG_CACHE_ITEM *Item;
+    UINT64 CurrentTime;
+    BOOLEAN Result = FALSE;
+    KIRQL Irql;
+
+    if (0 == NegCache)
+        return FALSE;
+
+    if (!FspNegCacheKeyInit(NegCache, FileName, &Key, 0))
+        return FALSE;
+
+    CurrentTime = KeQueryInterruptTime();
+
+    KeAcquireSpinLock(&NegCache->SpinLock, &Irql);
+    Item = FspNegCacheLookupItemAtDpcLevel(NegCache, &Key);
+    if (0 != Item)
+        Result = FspExpirationTimeValid2(Item->ExpirationTime, CurrentTime);
+    KeReleaseSpinLock(&NegCache->SpinLock, Irql);
+
+    FspNegCacheKeyFini(&Key);
+
+    return Result;
+}
+
+VOID FspNegCacheAdd(FSP_NEG_CACHE *NegCache, PUNICODE_STRING FileName, ULONG Sequence)
+{
+    // !PAGED_CODE();
+
+    FSP_NEG_CACHE_KEY Key;
+    FSP_NEG_CACHE_ITEM *Item, *OldItem = 0, *ExpiredItem = 0;
+    KIRQL Irql;
+
+    if (0 == NegCache)
+        return;
+
+    Item = FspAllocNonPaged(sizeof *Item + FileName->Length);
+    if (0 == Item)
+        return;
+
+    RtlZeroMemory(Item, sizeof *Item);
+    FspNegCacheKeyInit(NegCache, FileName, &Key, Item->NameBuf);
+    Item->Hash = Key.Hash;
+    Item->Name = Key.Name;
+    Item->ExpirationTime = FspExpirationTimeFromTimeout(NegCache->NegTimeout);
+
+    KeAcquireSpinLock(&NegCache->SpinLock, &Irql);
+
+    if (Sequence != NegCache->Sequence)
+    {
+        /* the name may have been created since the request was issued */
+        KeReleaseSpinLock(&NegCache->SpinLock, Irql);
+        FspFree(Item);
+        return;
+    }
+
+    OldItem = FspNegCacheLookupItemAtDpcLevel(NegCache, &Key);
+    if (0 != OldItem)
+        FspNegCacheRemoveItemAtDpcLevel(NegCache, OldItem);
+    else if (NegCache->ItemCount >= NegCache->NegCapacity)
+        ExpiredItem = FspNegCacheRemoveExpiredItemAtDpcLevel(NegCache, (UINT64)-1LL);
+
+    FspNegCacheInsertItemAtDpcLevel(NegCache, Item);
+
+    KeReleaseSpinLock(&NegCache->SpinLock, Irql);
+
+    if (0 != OldItem)
+        FspFree(OldItem);
+    if (0 != ExpiredItem)
+        FspFree(ExpiredItem);
+}
+
+VOID FspNegCacheInvalidate(FSP_NEG_CACHE *NegCache, PUNICODE_STRING FileName,
+    BOOLEAN Descendants)
+{
+    // !PAGED_CODE();
+
+    FSP_NEG_CACHE_KEY Key;
+    FSP_NEG_CACHE_ITEM *Item, *FreeList = 0;
+    PLIST_ENTRY ListEntry, NextEntry;
+    KIRQL Irql;
+    BOOLEAN KeyValid;
+
+    if (0 == NegCache)
+        return;
+
+    KeyValid = FspNegCacheKeyInit(NegCache, FileName, &Key, 0);
+
+    KeAcquireSpinLock(&NegCache->SpinLock, &Irql);
+
+    NegCache->Sequence++;
+
+    if (!KeyValid)
+    {
+        /* out of memory: be conservative and drop everything */
+        while (0 != (Item = FspNegCacheRemoveExpiredItemAtDpcLevel(NegCache, (UINT64)-1LL)))
+        {
+            Item->DictNext = FreeList;
+            FreeList = Item;
+        }
+    }
+    else if (Descendants)
+    {
+        for (ListEntry = NegCache->ItemList.Flink; &NegCache->ItemList != ListEntry;
+            ListEntry = NextEntry)
+        {
+            NextEntry = ListEntry->Flink;
+            Item = CONTAINING_RECORD(ListEntry, FSP_NEG_CACHE_ITEM, ListEntry);
+            if (FspNegCacheKeyIsPrefix(&Key.Name, Item))
+            {
+                FspNegCacheRemoveItemAtDpcLevel(NegCache, Item);
+                Item->DictNext = FreeList;
+                FreeList = Item;
+            }
+        }
+    }
+    else
+    {
+        Item = FspNegCacheLookupItemAtDpcLevel(NegCache, &Key);
+        if (0 != Item)
+        {
+            FspNegCacheRemoveItemAtDpcLevel(NegCache, Item);
+            Item->DictNext = FreeList;
+            FreeList = Item;
+        }
+    }
+
+    KeReleaseSpinLock(&NegCache->SpinLock, Irql);
+
+    if (KeyValid)
+        FspNegCacheKeyFini(&Key);
+
+    while (0 != FreeList)
+    {
+        Item = FreeList;
+        FreeList = Item->DictNext;
+        FspFree(Item);
+    }
+}
@@ -30,6 +30,13 @@ static NTSTATUS FspFsvolReadCached(
 static NTSTATUS FspFsvolReadNonCached(
     PDEVICE_OBJECT FsvolDeviceObject, PIRP Irp, PIO_STACK_LOCATION IrpSp,
     BOOLEAN CanWait);
+static NTSTATUS FspFsvolReadNonCachedSplit(
+    PDEVICE_OBJECT FsvolDeviceObject, PIRP Irp, PIO_STACK_LOCATION IrpSp,
+    ULONG ReadLength, ULONG SplitSize);
+static IO_COMPLETION_ROUTINE FspFsvolReadSplitCompletion;
+static DRIVER_CANCEL FspFsvolReadSplitCancel;
+static VOID FspFsvolReadHint(FSP_FILE_DESC *FileDesc, PFILE_OBJECT FileObject,
+    UINT64 ReadOffset, ULONG ReadLength, BOOLEAN PagingIo, FSP_FSCTL_TRANSACT_REQ *Request);
 FSP_IOPREP_DISPATCH FspFsvolReadPrepare;
 FSP_IOCMPL_DISPATCH FspFsvolReadComplete;
 static FSP_IOP_REQUEST_FINI FspFsvolReadNonCachedRequestFini;
@@ -40,6 +47,8 @@ FSP_DRIVER_DISPATCH FspRead;
 #pragma alloc_text(PAGE, FspFsvolRead)
 #pragma alloc_text(PAGE, FspFsvolReadCached)
 #pragma alloc_text(PAGE, FspFsvolReadNonCached)
+#pragma alloc_text(PAGE, FspFsvolReadNonCachedSplit)
+#pragma alloc_text(PAGE, FspFsvolReadHint)
 #pragma alloc_text(PAGE, FspFsvolReadPrepare)
 #pragma alloc_text(PAGE, FspFsvolReadComplete)
 #pragma alloc_text(PAGE, FspFsvolReadNonCachedRequestFini)
@@ -54,8 +63,69 @@ enum
     RequestSafeMdl                      = 1,
     RequestAddress                      = 2,
     RequestProcess                      = 3,
+    RequestSequence                     = 3,
+    RequestSplit                        = FspIopRequestExtraContext,
 };
 FSP_FSCTL_STATIC_ASSERT(RequestCookie == RequestSafeMdl, "");
+FSP_FSCTL_STATIC_ASSERT(RequestProcess == RequestSequence, "");
+#define RequestCookieDataRing           ((PVOID)2)
+
+/*
+ * Split Reads
+ *
+ * When VolumeParams.ReadSplitSize is non-zero, a non-cached (non-paging) read that
+ * is larger than ReadSplitSize is split into chunks whose boundaries are aligned to
+ * ReadSplitSize in the file. Each chunk is an IRP allocated by the FSD that maps a part
+ * of the original (master) IRP's MDL and is posted to the IOQ as a regular Read request.
+ * This allows multiple file system dispatcher threads to service a large read
+ * concurrently. Chunks are not associated IRPs: the split counts chunk completions itself
+ * and never uses the I/O manager's associated IRP bookkeeping of the master IRP.
+ *
+ * The master IRP acquires the FileNode shared Full as usual; ownership of the resource
+ * is transferred to the split and it is released when the last chunk request is
+ * finalized. Chunk completions are aggregated into the master IRP: the master transfers
+ * the bytes up to the first short chunk; any error other than STATUS_END_OF_FILE fails
+ * the master.
+ *
+ * The chunk completion routine keeps the chunk IRPs (STATUS_MORE_PROCESSING_REQUIRED) and
+ * the split completes the master IRP itself, once all chunks have completed and nobody can
+ * still reference them. This allows the master's cancel routine to cancel the outstanding
+ * chunks: the master is not completed before its chunks have been cancelled or drained.
+ * The split is reference counted: one reference for the chunks (dropped when the last chunk
+ * completes), one for the master's cancel routine (dropped by the cancel routine or by
+ * whoever removes it) and one for the code that posts the chunks.
+ */
+enum
+{
+    FspFsvolReadSplitCountMaximum       = 16,
+    FspFsvolReadAheadLengthMaximum      = 1024 * 1024,
+    FspFsvolReadSequentialCountMaximum  = 0xffff,
+};
+typedef struct
+{
+    struct FSP_FSVOL_READ_SPLIT *Split;
+    PIRP Irp;
+    ULONG Offset;                       /* chunk offset relative to the master read */
+    ULONG Length;
+} FSP_FSVOL_READ_SPLIT_CHUNK;
+typedef struct FSP_FSVOL_READ_SPLIT
+{
+    PDEVICE_OBJECT FsvolDeviceObject;
+    PIRP Irp;
+    FSP_FILE_NODE *FileNode;
+    LONG RefCount;
+    LONG FiniCount;
+    LONG CompleteCount;
+    LONG Status;
+    LONG64 Information;
+    ULONG ChunkCount;
+    FSP_FSVOL_READ_SPLIT_CHUNK Chunks[];
+} FSP_FSVOL_READ_SPLIT;
+/* the master IRP of a split read is not in the IOQ; use the IOQ dictionary slot */
+#define FspIrpReadSplit(Irp)            \
+    (*(FSP_FSVOL_READ_SPLIT **)&(Irp)->Tail.Overlay.DriverContext[1])
+static VOID FspFsvolReadSplitCancelChunks(FSP_FSVOL_READ_SPLIT *Split);
+static VOID FspFsvolReadSplitDereference(FSP_FSVOL_READ_SPLIT *Split);
 
 BOOLEAN FspFastIoRead(
     PFILE_OBJECT FileObject,
@@ -337,6 +407,7 @@ static NTSTATUS FspFsvolReadNonCached(
     ULONG ReadLength = IrpSp->Parameters.Read.Length;
     ULONG ReadKey = IrpSp->Parameters.Read.Key;
     BOOLEAN PagingIo = BooleanFlagOn(Irp->Flags, IRP_PAGING_IO);
+    ULONG SplitSize = FspFsvolDeviceExtension(FsvolDeviceObject)->VolumeParams.ReadSplitSize;
     FSP_FSCTL_FILE_INFO FileInfo;
     FSP_FSCTL_TRANSACT_REQ *Request;
     BOOLEAN Success;
@@ -413,6 +484,14 @@ static NTSTATUS FspFsvolReadNonCached(
             ReadLength = (ULONG)(FileInfo.FileSize - ReadOffset.QuadPart);
     }
 
+    /* split large reads so that they can be serviced concurrently; fall back to one request */
+    if (!PagingIo && 0 != SplitSize && ReadLength > SplitSize)
+    {
+        Result = FspFsvolReadNonCachedSplit(FsvolDeviceObject, Irp, IrpSp, ReadLength, SplitSize);
+        if (STATUS_PENDING == Result)
+            return Result;
+    }
+
     Request = FspIrpRequest(Irp);
     if (0 == Request)
     {
@@ -440,6 +519,7 @@ static NTSTATUS FspFsvolReadNonCached(
     Request->Req.Read.Offset = ReadOffset.QuadPart;
     Request->Req.Read.Length = ReadLength;
     Request->Req.Read.Key = ReadKey;
+    FspFsvolReadHint(FileDesc, FileObject, ReadOffset.QuadPart, ReadLength, PagingIo, Request);
 
     FspFileNodeSetOwner(FileNode, Full, Request);
     FspIopRequestContext(Request, RequestIrp) = Irp;
@@ -461,21 +541,383 @@ static NTSTATUS FspFsvolReadNonCached(
     return FSP_STATUS_IOQ_POST;
 }
 
+static NTSTATUS FspFsvolReadNonCachedSplit(
+    PDEVICE_OBJECT FsvolDeviceObject, PIRP Irp, PIO_STACK_LOCATION IrpSp,
+    ULONG ReadLength, ULONG SplitSize)
+{
+    PAGED_CODE();
+
+    NTSTATUS Result;
+    FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension = FspFsvolDeviceExtension(FsvolDeviceObject);
+    PFILE_OBJECT FileObject = IrpSp->FileObject;
+    FSP_FILE_NODE *FileNode = FileObject->FsContext;
+    FSP_FILE_DESC *FileDesc = FileObject->FsContext2;
+    UINT64 ReadOffset = IrpSp->Parameters.Read.ByteOffset.QuadPart;
+    PUINT8 ReadAddress = MmGetMdlVirtualAddress(Irp->MdlAddress);
+    UINT64 ChunkSize = SplitSize;
+    ULONG ChunkCount, ChunkOffset, ChunkLength, I;
+    FSP_FSVOL_READ_SPLIT *Split;
+    FSP_FSVOL_READ_SPLIT_CHUNK *Chunk;
+    PIO_STACK_LOCATION ChunkIrpSp;
+    PMDL ChunkMdl;
+    FSP_FSCTL_TRANSACT_REQ *Request, *Request0;
+
+    /* keep the number of chunks bounded; chunk boundaries remain aligned to SplitSize */
+    while (FspFsvolReadSplitCountMaximum <
+        (ReadOffset % ChunkSize + ReadLength + ChunkSize - 1) / ChunkSize)
+        ChunkSize *= 2;
+    ChunkCount = (ULONG)((ReadOffset % ChunkSize + ReadLength + ChunkSize - 1) / ChunkSize);
+    ASSERT(2 <= ChunkCount);
+
+    Split = FspAllocNonPaged(
+        sizeof *Split + ChunkCount * sizeof(FSP_FSVOL_READ_SPLIT_CHUNK));
+    if (0 == Split)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    RtlZeroMemory(Split, sizeof *Split + ChunkCount * sizeof(FSP_FSVOL_READ_SPLIT_CHUNK));
+    Split->FsvolDeviceObject = FsvolDeviceObject;
+    Split->Irp = Irp;
+    Split->FileNode = FileNode;
+    Split->RefCount = 3;
+    Split->FiniCount = ChunkCount;
+    Split->CompleteCount = ChunkCount;
+    Split->Status = STATUS_SUCCESS;
+    Split->Information = ReadLength;
+    Split->ChunkCount = ChunkCount;
+
+    /* build all chunks before posting any, so that failure can fall back to a single request */
+    for (I = 0, ChunkOffset = 0; ChunkCount > I; I++, ChunkOffset += ChunkLength)
+    {
+        Chunk = &Split->Chunks[I];
+        ChunkLength = (ULONG)(ChunkSize - (ReadOffset + ChunkOffset) % ChunkSize);
+        if (ChunkLength > ReadLength - ChunkOffset)
+            ChunkLength = ReadLength - ChunkOffset;
+
+        Chunk->Split = Split;
+        Chunk->Offset = ChunkOffset;
+        Chunk->Length = ChunkLength;
+
+        Chunk->Irp = IoAllocateIrp(FsvolDeviceObject->StackSize, FALSE);
+        if (0 == Chunk->Irp)
+        {
+            Result = STATUS_INSUFFICIENT_RESOURCES;
+            goto fail;
+        }
+        Chunk->Irp->Tail.Overlay.Thread = Irp->Tail.Overlay.Thread;
+
+        ChunkMdl = IoAllocateMdl(ReadAddress + ChunkOffset, ChunkLength, FALSE, FALSE, 0);
+        if (0 == ChunkMdl)
+        {
+            Result = STATUS_INSUFFICIENT_RESOURCES;
+            goto fail;
+        }
+        IoBuildPartialMdl(Irp->MdlAddress, ChunkMdl, ReadAddress + ChunkOffset, ChunkLength);
+        Chunk->Irp->MdlAddress = ChunkMdl;
+
+        Chunk->Irp->RequestorMode = Irp->RequestorMode;
+        Chunk->Irp->Flags |= Irp->Flags & IRP_NOCACHE;
+        IoSetCompletionRoutine(Chunk->Irp, FspFsvolReadSplitCompletion, Chunk, TRUE, TRUE, TRUE);
+        IoSetNextIrpStackLocation(Chunk->Irp);
+        ChunkIrpSp = IoGetCurrentIrpStackLocation(Chunk->Irp);
+        ChunkIrpSp->MajorFunction = IRP_MJ_READ;
+        ChunkIrpSp->MinorFunction = IrpSp->MinorFunction;
+        ChunkIrpSp->DeviceObject = FsvolDeviceObject;
+        ChunkIrpSp->FileObject = FileObject;
+        ChunkIrpSp->Parameters.Read.Length = ChunkLength;
+        ChunkIrpSp->Parameters.Read.Key = IrpSp->Parameters.Read.Key;
+        ChunkIrpSp->Parameters.Read.ByteOffset.QuadPart = ReadOffset + ChunkOffset;
+
+        Result = FspIopCreateRequestEx(Chunk->Irp, 0, 0, 0, &Request);
+        if (!NT_SUCCESS(Result))
+            goto fail;
+
+        Request->Kind = FspFsctlTransactReadKind;
+        Request->Req.Read.UserContext = FileNode->UserContext;
+        Request->Req.Read.UserContext2 = FileDesc->UserContext2;
+        Request->Req.Read.Offset = ReadOffset + ChunkOffset;
+        Request->Req.Read.Length = ChunkLength;
+        Request->Req.Read.Key = IrpSp->Parameters.Read.Key;
+    }
+
+    /* the whole read counts as one access; only the last chunk carries the read-ahead */
+    Request0 = FspIrpRequest(Split->Chunks[0].Irp);
+    FspFsvolReadHint(FileDesc, FileObject, ReadOffset, ReadLength, FALSE, Request0);
+    for (I = 1; ChunkCount > I; I++)
+    {
+        Request = FspIrpRequest(Split->Chunks[I].Irp);
+        Request->Req.Read.Sequential = Request0->Req.Read.Sequential;
+        Request->Req.Read.SequentialOnly = Request0->Req.Read.SequentialOnly;
+        Request->Req.Read.RandomAccess = Request0->Req.Read.RandomAccess;
+        Request->Req.Read.SequentialCount = Request0->Req.Read.SequentialCount;
+    }
+    Request->Req.Read.ReadAheadLength = Request0->Req.Read.ReadAheadLength;
+    Request0->Req.Read.ReadAheadLength = 0;
+
+    /* the master IRP no longer needs its own request (if it was reposted) */
+    FspIrpDeleteRequest(Irp);
+
+    /* the chunks now own the master IRP; cancelling it cancels the chunks */
+    IoMarkIrpPending(Irp);
+    FspFileNodeSetOwner(FileNode, Full, Split);
+    FspIrpReadSplit(Irp) = Split;
+    IoSetCancelRoutine(Irp, FspFsvolReadSplitCancel);
+
+    FSP_STATISTICS *Statistics = FspFsvolDeviceStatistics(FsvolDeviceObject);
+    FspStatisticsInc(Statistics, Specific.NonCachedReads);
+    FspStatisticsAdd(Statistics, Specific.NonCachedReadBytes, ReadLength);
+    FspStatisticsInc(Statistics, Specific.NonCachedDiskReads);
+
+    for (I = 0; ChunkCount > I; I++)
+    {
+        Chunk = &Split->Chunks[I];
+        Request = FspIrpRequest(Chunk->Irp);
+
+        FspIopResetRequest(Request, FspFsvolReadNonCachedRequestFini);
+        FspIopRequestContext(Request, RequestIrp) = Chunk->Irp;
+        FspIopRequestContext(Request, RequestSplit) = Split;
+
+        /* chunks carry the master's acquired resource flags; see FSP_FILE_NODE_GET_FLAGS */
+        FspIrpSetFlags(Chunk->Irp, FspIrpFlags(Irp));
+
+        /* cannot fail: the master IRP holds a reference to the device */
+        FspDeviceReference(FsvolDeviceObject);
+
+        if (!FspIoqPostIrp(FsvolDeviceExtension->Ioq, Chunk->Irp, &Result))
+        {
+            DEBUGLOG("FspIoqPostIrp = %s", NtStatusSym(Result));
+            FspIopCompleteIrp(Chunk->Irp, Result);
+        }
+    }
+
+    /* the master may have been cancelled before its cancel routine was set */
+    if (Irp->Cancel && 0 != IoSetCancelRoutine(Irp, 0))
+    {
+        FspFsvolReadSplitCancelChunks(Split);
+        FspFsvolReadSplitDereference(Split);
+    }
+
+    FspFsvolReadSplitDereference(Split);
+
+    return STATUS_PENDING;
+
+fail:
+    for (I = 0; ChunkCount > I; I++)
+    {
+        Chunk = &Split->Chunks[I];
+        if (0 == Chunk->Irp)
+            break;
+
+        FspIrpDeleteRequest(Chunk->Irp);
+        if (0 != Chunk->Irp->MdlAddress)
+            IoFreeMdl(Chunk->Irp->MdlAddress);
+        IoFreeIrp(Chunk->Irp);
+    }
+
+    FspFree(Split);
+
+    return Result;
+}
+
+static VOID FspFsvolReadSplitCancelChunks(FSP_FSVOL_READ_SPLIT *Split)
+{
+    // !PAGED_CODE();
+
+    /* chunk IRPs are not freed while the caller holds a split reference */
+    for (ULONG I = 0; Split->ChunkCount > I; I++)
+        IoCancelIrp(Split->Chunks[I].Irp);
+}
+
+static VOID FspFsvolReadSplitDereference(FSP_FSVOL_READ_SPLIT *Split)
+{
+    // !PAGED_CODE();
+
+    PIRP MasterIrp;
+    PIO_STACK_LOCATION MasterIrpSp;
+    PFILE_OBJECT FileObject;
+
+    if (0 != InterlockedDecrement(&Split->RefCount))
+        return;
+
+    MasterIrp = Split->Irp;
+    MasterIrpSp = IoGetCurrentIrpStackLocation(MasterIrp);
+    FileObject = MasterIrpSp->FileObject;
+
+    for (ULONG I = 0; Split->ChunkCount > I; I++)
+        IoFreeIrp(Split->Chunks[I].Irp);
+
+    if (!NT_SUCCESS(Split->Status))
+    {
+        MasterIrp->IoStatus.Status = Split->Status;
+        MasterIrp->IoStatus.Information = 0;
+    }
+    else if (0 == Split->Information)
+    {
+        MasterIrp->IoStatus.Status = STATUS_END_OF_FILE;
+        MasterIrp->IoStatus.Information = 0;
+    }
+    else
+    {
+        MasterIrp->IoStatus.Status = STATUS_SUCCESS;
+        MasterIrp->IoStatus.Information = (ULONG_PTR)Split->Information;
+
+        /* update the current file offset if synchronous I/O (split reads are never paging I/O) */
+        if (FlagOn(FileObject->Flags, FO_SYNCHRONOUS_IO))
+            FileObject->CurrentByteOffset.QuadPart =
+                MasterIrpSp->Parameters.Read.ByteOffset.QuadPart + Split->Information;
+    }
+
+    /* all chunk requests have been finalized prior to their completion */
+    FspFree(Split);
+
+    IoCompleteRequest(MasterIrp, FSP_IO_INCREMENT);
+}
+
+static VOID FspFsvolReadSplitCancel(PDEVICE_OBJECT DeviceObject, PIRP Irp)
+{
+    // !PAGED_CODE();
+
+    FSP_FSVOL_READ_SPLIT *Split = FspIrpReadSplit(Irp);
+
+    IoReleaseCancelSpinLock(Irp->CancelIrql);
+
+    FspFsvolReadSplitCancelChunks(Split);
+    FspFsvolReadSplitDereference(Split);
+}
+
+static NTSTATUS FspFsvolReadSplitCompletion(
+    PDEVICE_OBJECT DeviceObject, PIRP Irp, PVOID Context)
+{
+    // !PAGED_CODE();
+
+    FSP_FSVOL_READ_SPLIT_CHUNK *Chunk = Context;
+    FSP_FSVOL_READ_SPLIT *Split = Chunk->Split;
+    NTSTATUS Result = Irp->IoStatus.Status;
+
+    if (NT_SUCCESS(Result) || STATUS_END_OF_FILE == Result)
+    {
+        ULONG Information = NT_SUCCESS(Result) ? (ULONG)Irp->IoStatus.Information : 0;
+
+        /* a short chunk ends the master transfer */
+        if (Chunk->Length > Information)
+        {
+            LONG64 NewInformation = Chunk->Offset + Information, OldInformation;
+            do
+            {
+                OldInformation = Split->Information;
+                if (NewInformation >= OldInformation)
+                    break;
+            } while (OldInformation != InterlockedCompareExchange64(
+                &Split->Information, NewInformation, OldInformation));
+        }
+    }
+    else
+        InterlockedCompareExchange(&Split->Status, Result, STATUS_SUCCESS);
+
+    /* the partial MDL may have been mapped during Prepare or Complete */
+    MmPrepareMdlForReuse(Irp->MdlAddress);
+    IoFreeMdl(Irp->MdlAddress);
+    Irp->MdlAddress = 0;
+
+    if (0 == InterlockedDecrement(&Split->CompleteCount))
+    {
+        /* if we remove the master's cancel routine, we also drop its reference */
+        if (0 != IoSetCancelRoutine(Split->Irp, 0))
+            FspFsvolReadSplitDereference(Split);
+        FspFsvolReadSplitDereference(Split);
+    }
+
+    /* the chunk IRP is freed (and the master completed) when the split goes away */
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+static VOID FspFsvolReadHint(FSP_FILE_DESC *FileDesc, PFILE_OBJECT FileObject,
+    UINT64 ReadOffset, ULONG ReadLength, BOOLEAN PagingIo, FSP_FSCTL_TRANSACT_REQ *Request)
+{
+    PAGED_CODE();
+
+    /*
+     * Track sequential access per file handle (FileDesc) and pass the result to the
+     * user mode file system as hints in the Read request. Concurrent reads on the same
+     * handle may race on the tracking fields; this is acceptable as the hints are
+     * advisory only.
+     *
+     * A read is sequential if it starts where the previous read on the same handle
+     * ended. The recommended read-ahead doubles with each consecutive sequential read
+     * (starting at the read length) and is capped at FspFsvolReadAheadLengthMaximum.
+     * FILE_SEQUENTIAL_ONLY handles get read-ahead from their first read; FILE_RANDOM_ACCESS
+     * handles get no read-ahead.
+     */
+
+    BOOLEAN Sequential = 0 != ReadOffset && FileDesc->ReadNextOffset == ReadOffset;
+    BOOLEAN SequentialOnly = BooleanFlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY);
+    BOOLEAN RandomAccess = BooleanFlagOn(FileObject->Flags, FO_RANDOM_ACCESS);
+    ULONG SequentialCount = FileDesc->ReadSequentialCount;
+    UINT64 ReadAheadLength = 0;
+
+    if (Sequential)
+    {
+        if (FspFsvolReadSequentialCountMaximum > SequentialCount)
+            SequentialCount++;
+    }
+    else
+        SequentialCount = 0;
+
+    FileDesc->ReadNextOffset = ReadOffset + ReadLength;
+    FileDesc->ReadSequentialCount = SequentialCount;
+
+    if (!RandomAccess && (0 != SequentialCount || SequentialOnly))
+    {
+        ReadAheadLength = (UINT64)ReadLength << (4 > SequentialCount ? SequentialCount : 4);
+        if (FspFsvolReadAheadLengthMaximum < ReadAheadLength)
+            ReadAheadLength = FspFsvolReadAheadLengthMaximum;
+    }
+
+    Request->Req.Read.Sequential = Sequential;
+    Request->Req.Read.SequentialOnly = SequentialOnly;
+    Request->Req.Read.RandomAccess = RandomAccess;
+    Request->Req.Read.PagingIo = PagingIo;
+    Request->Req.Read.SequentialCount = SequentialCount;
+    Request->Req.Read.ReadAheadLength = (UINT32)ReadAheadLength;
+}
+
 NTSTATUS FspFsvolReadPrepare(
     PIRP Irp, FSP_FSCTL_TRANSACT_REQ *Request)
 {
     PAGED_CODE();
 
+    FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension =
+        FspFsvolDeviceExtension(IoGetCurrentIrpStackLocation(Irp)->DeviceObject);
+    FSP_DATA_RING *DataRing = FsvolDeviceExtension->DataRing;
+
     if (FspReadIrpShouldUseProcessBuffer(Irp, Request->Req.Read.Length))
     {
         NTSTATUS Result;
         PVOID Cookie;
         PVOID Address;
         PEPROCESS Process;
+        ULONG Sequence;
 
         if (0 == MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority))
             return STATUS_INSUFFICIENT_RESOURCES; /* something is seriously screwy! */
 
+        /*
+         * The read is double buffered anyway; prefer a data ring slot to a process buffer.
+         * Reads that are not double buffered keep the (zero copy) user mode mapping below.
+         */
+        if (0 != DataRing &&
+            FspDataRingSlotSize(DataRing) >= Request->Req.Read.Length &&
+            FsvolDeviceExtension->DataRingProcess == PsGetCurrentProcess() &&
+            FspDataRingAcquire(DataRing, &Sequence, &Address))
+        {
+            Request->Req.Read.Address = (UINT64)(UINT_PTR)Address;
+
+            FspIopRequestContext(Request, RequestCookie) = RequestCookieDataRing;
+            FspIopRequestContext(Request, RequestAddress) = Address;
+            FspIopRequestContext(Request, RequestSequence) = (PVOID)(UINT_PTR)Sequence;
+
+            return STATUS_SUCCESS;
+        }
+
         Result = FspProcessBufferAcquire(Request->Req.Read.Length, &Cookie, &Address);
         if (!NT_SUCCESS(Result))
             return Result;
@@ -549,7 +991,8 @@ NTSTATUS FspFsvolReadComplete(
     if (Response->IoStatus.Information > Request->Req.Read.Length)
         FSP_RETURN(Result = STATUS_INTERNAL_ERROR);
 
-    if ((UINT_PTR)FspIopRequestContext(Request, RequestCookie) & 1)
+    if ((UINT_PTR)FspIopRequestContext(Request, RequestCookie) & 1 ||
+        RequestCookieDataRing == FspIopRequestContext(Request, RequestCookie))
     {
         PVOID Address = FspIopRequestContext(Request, RequestAddress);
         PVOID SystemAddress = MmGetSystemAddressForMdlSafe(Irp->MdlAddress, NormalPagePriority);
@@ -579,8 +1022,11 @@ NTSTATUS FspFsvolReadComplete(
     BOOLEAN PagingIo = BooleanFlagOn(Irp->Flags, IRP_PAGING_IO);
     BOOLEAN SynchronousIo = BooleanFlagOn(FileObject->Flags, FO_SYNCHRONOUS_IO);
 
+    /* if we are a split read chunk, the master IRP is updated when all chunks complete */
+    if (0 != FspIopRequestContext(Request, RequestSplit))
+        FspIopResetRequest(Request, 0);
     /* if we are top-level */
-    if (0 == FspIrpTopFlags(Irp))
+    else if (0 == FspIrpTopFlags(Irp))
     {
         /* update the current file offset if synchronous I/O (and not paging I/O) */
         if (SynchronousIo && !PagingIo)
@@ -613,7 +1059,17 @@ static VOID FspFsvolReadNonCachedRequestFini(FSP_FSCTL_TRANSACT_REQ *Request, PV
 
     PIRP Irp = Context[RequestIrp];
 
-    if ((UINT_PTR)Context[RequestCookie] & 1)
+    if (RequestCookieDataRing == Context[RequestCookie])
+    {
+        PVOID Address = Context[RequestAddress];
+        ULONG Sequence = (ULONG)(UINT_PTR)Context[RequestSequence];
+
+        ASSERT(0 != Irp);
+        FspDataRingRelease(
+            FspFsvolDeviceExtension(IoGetCurrentIrpStackLocation(Irp)->DeviceObject)->DataRing,
+            Sequence, Address);
+    }
+    else if ((UINT_PTR)Context[RequestCookie] & 1)
     {
         PVOID Cookie = (PVOID)((UINT_PTR)Context[RequestCookie] & ~1);
         PVOID Address = Context[RequestAddress];
@@ -665,10 +1121,21 @@ static VOID FspFsvolReadNonCachedRequestFini(FSP_FSCTL_TRANSACT_REQ *Request, PV
 
     if (0 != Irp)
     {
-        PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation(Irp);
-        FSP_FILE_NODE *FileNode = IrpSp->FileObject->FsContext;
+        FSP_FSVOL_READ_SPLIT *Split = FspIopRequestContext(Request, RequestSplit);
 
-        FspFileNodeReleaseOwner(FileNode, Full, Request);
+        if (0 == Split)
+        {
+            PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation(Irp);
+            FSP_FILE_NODE *FileNode = IrpSp->FileObject->FsContext;
+
+            FspFileNodeReleaseOwner(FileNode, Full, Request);
+        }
+        else if (0 == InterlockedDecrement(&Split->FiniCount))
+        {
+            /* last chunk: release the master's resource and device reference */
+            FspFileNodeReleaseOwner(Split->FileNode, Full, Split);
+            FspDeviceDereference(Split->FsvolDeviceObject);
+        }
     }
 }
 
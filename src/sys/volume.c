@@ -66,6 +66,10 @@ NTSTATUS FspVolumeNotify(
 static NTSTATUS FspVolumeNotifyLock(
     PDEVICE_OBJECT FsvolDeviceObject);
 static WORKER_THREAD_ROUTINE FspVolumeNotifyWork;
+NTSTATUS FspVolumeDataRing(
+    PDEVICE_OBJECT FsctlDeviceObject, PIRP Irp, PIO_STACK_LOCATION IrpSp);
+static VOID FspVolumeDataRingFreeMemory(
+    PDEVICE_OBJECT FsvolDeviceObject);
 NTSTATUS FspVolumeWork(
     PDEVICE_OBJECT FsvolDeviceObject, PIRP Irp, PIO_STACK_LOCATION IrpSp);
 
@@ -89,6 +93,8 @@ NTSTATUS FspVolumeWork(
 #pragma alloc_text(PAGE, FspVolumeNotify)
 #pragma alloc_text(PAGE, FspVolumeNotifyLock)
 #pragma alloc_text(PAGE, FspVolumeNotifyWork)
+#pragma alloc_text(PAGE, FspVolumeDataRing)
+#pragma alloc_text(PAGE, FspVolumeDataRingFreeMemory)
 #pragma alloc_text(PAGE, FspVolumeWork)
 #endif
 
@@ -259,6 +265,14 @@ static NTSTATUS FspVolumeCreateNoLock(
         if (!VolumeParams.EaTimeoutValid)
             VolumeParams.EaTimeout = VolumeParams.FileInfoTimeout;
     }
+    if (0 != VolumeParams.ReadSplitSize)
+    {
+        if (FspFsctlReadSplitSizeMinimum > VolumeParams.ReadSplitSize)
+            VolumeParams.ReadSplitSize = FspFsctlReadSplitSizeMinimum;
+        VolumeParams.ReadSplitSize = (UINT32)ROUND_TO_PAGES(VolumeParams.ReadSplitSize);
+    }
+    if (FspFsctlNegativeLookupTimeoutMaximum < VolumeParams.NegativeLookupTimeout)
+        VolumeParams.NegativeLookupTimeout = FspFsctlNegativeLookupTimeoutMaximum;
     VolumeParams.VolumeInfoTimeoutValid = 1;
     VolumeParams.DirInfoTimeoutValid = 1;
     VolumeParams.SecurityTimeoutValid = 1;
@@ -457,6 +471,9 @@ VOID FspVolumeDelete(
 
     FspSiloDereferenceGlobals(Globals);
 
+    /* the I/O queue is stopped; release the data ring memory (if any) */
+    FspVolumeDataRingFreeMemory(FsvolDeviceObject);
+
     /*
      * Call MmForceSectionClosed on active files to ensure that Mm removes them from Standby List.
      */
@@ -1493,7 +1510,8 @@ static VOID FspVolumeNotifyWork(PVOID NotifyWorkItem0)
     FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension = FspFsvolDeviceExtension(FsvolDeviceObject);
     FSP_FSCTL_NOTIFY_INFO *NotifyInfo = (PVOID)NotifyWorkItem->InputBuffer;
     PUINT8 NotifyInfoEnd = (PUINT8)NotifyInfo + NotifyWorkItem->InputBufferLength;
-    ULONG NotifyInfoSize;
+    ULONG NotifyInfoSize, NotifyInfoHeaderSize;
+    FSP_FSCTL_NOTIFY_RANGE_INFO *RangeInfo;
     UNICODE_STRING FileName = { 0 }, StreamPart = { 0 }, AbsFileName = { 0 }, FullFileName = { 0 };
     ULONG StreamType = FspFileNameStreamTypeNone;
     BOOLEAN Unlock = FALSE;
@@ -1513,9 +1531,25 @@ static VOID FspVolumeNotifyWork(PVOID NotifyWorkItem0)
             break;
         }
 
+        /* range records carry the byte range of a data change (and possibly a new file size) */
+        if (FlagOn(NotifyInfo->Action, FSP_FSCTL_NOTIFY_ACTION_RANGE))
+        {
+            RangeInfo = (PVOID)NotifyInfo;
+            NotifyInfoHeaderSize = sizeof(FSP_FSCTL_NOTIFY_RANGE_INFO);
+            if (NotifyInfoHeaderSize > NotifyInfoSize ||
+                (PUINT8)NotifyInfo + NotifyInfoHeaderSize > NotifyInfoEnd)
+                break;
+            FileName.Buffer = RangeInfo->FileNameBuf;
+        }
+        else
+        {
+            RangeInfo = 0;
+            NotifyInfoHeaderSize = sizeof(FSP_FSCTL_NOTIFY_INFO);
+            FileName.Buffer = NotifyInfo->FileNameBuf;
+        }
+
         FileName.Length =
-        FileName.MaximumLength = (USHORT)(NotifyInfoSize - sizeof(FSP_FSCTL_NOTIFY_INFO));
-        FileName.Buffer = NotifyInfo->FileNameBuf;
+        FileName.MaximumLength = (USHORT)(NotifyInfoSize - NotifyInfoHeaderSize);
         if (sizeof(WCHAR) * 2/* not empty or root */ <= FileName.Length &&
             L'\\' == FileName.Buffer[FileName.Length / sizeof(WCHAR) - 1])
             FileName.Length -= sizeof(WCHAR);
@@ -1532,7 +1566,8 @@ static VOID FspVolumeNotifyWork(PVOID NotifyWorkItem0)
             AbsFileName = FileName;
 
             FspFileNodeInvalidateCachesAndNotifyChangeByName(FsvolDeviceObject,
-                &FileName, NotifyInfo->Filter, NotifyInfo->Action,
+                &FileName, NotifyInfo->Filter,
+                NotifyInfo->Action & ~FSP_FSCTL_NOTIFY_ACTION_RANGE, RangeInfo,
                 TRUE);
         }
         else if (0 != AbsFileName.Length)
@@ -1558,7 +1593,8 @@ static VOID FspVolumeNotifyWork(PVOID NotifyWorkItem0)
 
             if (NT_SUCCESS(Result))
                 FspFileNodeInvalidateCachesAndNotifyChangeByName(FsvolDeviceObject,
-                    &FullFileName, NotifyInfo->Filter, NotifyInfo->Action,
+                    &FullFileName, NotifyInfo->Filter,
+                    NotifyInfo->Action & ~FSP_FSCTL_NOTIFY_ACTION_RANGE, RangeInfo,
                     FALSE);
         }
     }
@@ -1591,6 +1627,136 @@ static VOID FspVolumeNotifyWork(PVOID NotifyWorkItem0)
     FsRtlExitFileSystem();
 }
 
+NTSTATUS FspVolumeDataRing(
+    PDEVICE_OBJECT FsctlDeviceObject, PIRP Irp, PIO_STACK_LOCATION IrpSp)
+{
+    PAGED_CODE();
+
+    /*
+     * Register a data ring for the volume. The ring memory is allocated in the address
+     * space of the calling (file system) process and is used for Read requests that
+     * would otherwise use a process buffer.
+     * See shared/ku/dataring.c for the slot ownership protocol.
+     *
+     * The ring control state is kept in kernel memory so that the file system cannot
+     * corrupt it; the file system only ever sees slot addresses in Read requests.
+     *
+ * Like the process buffer the ring is double buffered: the FSD copies the payload from
+     * the slot into the IRP's locked MDL. Reads that are not double buffered continue to
+     * use the zero-copy user mode mapping of the MDL.
+     */
+
+    ASSERT(IRP_MJ_FILE_SYSTEM_CONTROL == IrpSp->MajorFunction);
+    ASSERT(IRP_MN_USER_FS_REQUEST == IrpSp->MinorFunction);
+    ASSERT(FSP_FSCTL_DATA_RING == IrpSp->Parameters.FileSystemControl.FsControlCode);
+    ASSERT(METHOD_BUFFERED == (IrpSp->Parameters.FileSystemControl.FsControlCode & 3));
+    ASSERT(0 != IrpSp->FileObject->FsContext2);
+
+    PDEVICE_OBJECT FsvolDeviceObject = IrpSp->FileObject->FsContext2;
+    FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension = FspFsvolDeviceExtension(FsvolDeviceObject);
+    FSP_FSCTL_DATA_RING_PARAMS *Params = Irp->AssociatedIrp.SystemBuffer;
+    ULONG InputBufferLength = IrpSp->Parameters.FileSystemControl.InputBufferLength;
+    ULONG SlotSize, SlotCount;
+    SIZE_T Size;
+    PVOID Address = 0;
+    FSP_DATA_RING *DataRing = 0;
+    PEPROCESS Process;
+    NTSTATUS Result;
+
+    if (sizeof *Params > InputBufferLength || 0 == Params)
+        return STATUS_INVALID_PARAMETER;
+
+    if (0 == Params->SlotSize || FspFsctlDataRingSlotSizeMaximum < Params->SlotSize ||
+        0 == Params->SlotCount || FspFsctlDataRingSlotCountMaximum < Params->SlotCount ||
+        0 != (Params->SlotCount & (Params->SlotCount - 1)))
+        return STATUS_INVALID_PARAMETER;
+
+    SlotSize = (ULONG)ROUND_TO_PAGES(Params->SlotSize);
+    SlotCount = Params->SlotCount;
+    Size = (SIZE_T)SlotSize * SlotCount;
+    if (FspFsctlDataRingSizeMaximum < Size)
+        return STATUS_INVALID_PARAMETER;
+
+    FspFsvolDeviceVolumeDeleteAcquireExclusive(FsvolDeviceObject);
+
+    if (FsvolDeviceExtension->VolumeDeleted)
+    {
+        Result = STATUS_CANCELLED;
+        goto exit;
+    }
+
+    if (0 != FsvolDeviceExtension->DataRing)
+    {
+        Result = STATUS_INVALID_DEVICE_STATE;
+        goto exit;
+    }
+
+    Result = ZwAllocateVirtualMemory(ZwCurrentProcess(),
+        &Address, 0, &Size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!NT_SUCCESS(Result))
+    {
+        Address = 0;
+        goto exit;
+    }
+
+    Result = FspDataRingCreate(Address, SlotSize, SlotCount, &DataRing);
+    if (!NT_SUCCESS(Result))
+        goto exit;
+
+    /* get a pointer to the current process so that we can check and release the ring later */
+    Process = PsGetCurrentProcess();
+    ObReferenceObject(Process);
+
+    FsvolDeviceExtension->DataRingAddress = Address;
+    FsvolDeviceExtension->DataRingSize = Size;
+    FsvolDeviceExtension->DataRingProcess = Process;
+    InterlockedExchangePointer(&FsvolDeviceExtension->DataRing, DataRing);
+
+    Irp->IoStatus.Information = 0;
+    Result = STATUS_SUCCESS;
+
+exit:
+    if (!NT_SUCCESS(Result) && 0 != Address)
+    {
+        Size = 0;
+        ZwFreeVirtualMemory(ZwCurrentProcess(), &Address, &Size, MEM_RELEASE);
+    }
+
+    FspFsvolDeviceVolumeDeleteRelease(FsvolDeviceObject);
+
+    return Result;
+}
+
+static VOID FspVolumeDataRingFreeMemory(
+    PDEVICE_OBJECT FsvolDeviceObject)
+{
+    PAGED_CODE();
+
+    /*
+     * Free the ring memory in the file system process. The ring control state (which may
+     * still be referenced by requests that are being cancelled) is freed when the volume
+     * device is finalized.
+     */
+
+    FSP_FSVOL_DEVICE_EXTENSION *FsvolDeviceExtension = FspFsvolDeviceExtension(FsvolDeviceObject);
+    PVOID Address = FsvolDeviceExtension->DataRingAddress;
+    SIZE_T Size = 0;
+    KAPC_STATE ApcState;
+    BOOLEAN Attach;
+
+    if (0 == FsvolDeviceExtension->DataRing || 0 == Address)
+        return;
+
+    FsvolDeviceExtension->DataRingAddress = 0;
+
+    Attach = FsvolDeviceExtension->DataRingProcess != PsGetCurrentProcess();
+    if (Attach)
+        KeStackAttachProcess(FsvolDeviceExtension->DataRingProcess, &ApcState);
+    ZwFreeVirtualMemory(ZwCurrentProcess(), &Address, &Size, MEM_RELEASE);
+    if (Attach)
+        KeUnstackDetachProcess(&ApcState);
+}
+
 NTSTATUS FspVolumeWork(
     PDEVICE_OBJECT FsvolDeviceObject, PIRP Irp, PIO_STACK_LOCATION IrpSp)
 {
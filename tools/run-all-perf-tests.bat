@@ -18,8 +18,10 @@ popd
 set perftests="%ProjRoot%\tools\run-perf-tests.bat"
 set memfs="%ProjRoot%\build\VStudio\build\Release\memfs-x64.exe"
 set ntptfs="%ProjRoot%\tst\ntptfs\build\Release\ntptfs-x64.exe"
+set passthrough="%ProjRoot%\tst\passthrough\build\Release\passthrough-x64.exe"
 if not exist %memfs% echo cannot find memfs >&2 & goto fail
 if not exist %ntptfs% echo cannot find ntptfs >&2 & goto fail
+if not exist %passthrough% echo cannot find passthrough >&2 & goto fail
 
 fsutil 8dot3name query C:
 
@@ -59,9 +61,49 @@ for /l %%i in (1,1,%Count%) do (
 )
 popd
 taskkill /f /im ntptfs-x64.exe
+
+REM compare against ntptfs with synchronous (dispatcher thread) reads and writes
+start "" /b %ntptfs% -t -1 -o SynchronousIo -p C:\t -m X:
+waitfor 7BF47D72F6664550B03248ECFE77C7DD /t 3 2>nul
+pushd X:\
+for /l %%i in (1,1,%Count%) do (
+    echo ntptfs-sync-%%i
+    call %perftests% Release > %outdir%\ntptfs-sync-%%i.csv
+    if !ERRORLEVEL! neq 0 goto fail
+)
+popd
+taskkill /f /im ntptfs-x64.exe
 rmdir C:\t
 powershell -NoProfile -ExecutionPolicy Bypass -Command "Remove-MpPreference -ExclusionProcess '%ntptfs%'"
 
+REM compare the passthrough sample without and with its backing handle cache;
+REM the file_open_test, file_attr_test and file_list_* results show the open rate
+powershell -NoProfile -ExecutionPolicy Bypass -Command "Add-MpPreference -ExclusionProcess '%passthrough%'"
+mkdir C:\t
+start "" /b %passthrough% -p C:\t -m X:
+waitfor 7BF47D72F6664550B03248ECFE77C7DD /t 3 2>nul
+pushd X:\
+for /l %%i in (1,1,%Count%) do (
+    echo passthrough-%%i
+    call %perftests% Release > %outdir%\passthrough-%%i.csv
+    if !ERRORLEVEL! neq 0 goto fail
+)
+popd
+taskkill /f /im passthrough-x64.exe
+
+start "" /b %passthrough% -H 4096 -p C:\t -m X:
+waitfor 7BF47D72F6664550B03248ECFE77C7DD /t 3 2>nul
+pushd X:\
+for /l %%i in (1,1,%Count%) do (
+    echo passthrough-hcache-%%i
+    call %perftests% Release > %outdir%\passthrough-hcache-%%i.csv
+    if !ERRORLEVEL! neq 0 goto fail
+)
+popd
+taskkill /f /im passthrough-x64.exe
+rmdir C:\t
+powershell -NoProfile -ExecutionPolicy Bypass -Command "Remove-MpPreference -ExclusionProcess '%passthrough%'"
+
 exit /b 0
 
 :fail
@@ -59,6 +59,14 @@ for %%a in (%OptMmap%) do (
     call :csv "" %%a "%fsbench% --empty-cache=C --mmap=%%a mmap_*"
 )
 
+rem Multi-threaded load: wall time goes to the CSV stream, per-op latency
+rem percentiles go to fsbench-load-THREADS.csv next to the fsbench directory.
+set OptLoadThreads=1 2 4 8 16
+if X%2==Xbaseline set OptLoadThreads=8
+for %%a in (%OptLoadThreads%) do (
+    call :csv "" %%a "%fsbench% --empty-cache=C --threads=%%a --report=csv --report-file=..\fsbench-load-%%a.csv +load_test"
+)
+
 popd
 rmdir fsbench
 
@@ -86,7 +86,7 @@ void DeleteNode(AIRFS_ Airfs, NODE_ Node)
 
     StorageFree(Airfs, Node->Name);
     StorageFree(Airfs, Node->ReparseData);
-    StorageFree(Airfs, Node->SecurityDescriptor);
+    StorageReleaseSecurity(Airfs, Node->SecurityDescriptor);
     StorageFree(Airfs, Node);
 }
 
@@ -455,14 +455,14 @@ NTSTATUS ApiCreate(FSP_FILE_SYSTEM *FileSystem, PWSTR Name, UINT32 CreateOptions
 
     if (SecurityDescriptor)
     {
-        Node->SecurityDescriptorSize = GetSecurityDescriptorLength(SecurityDescriptor);
-        Node->SecurityDescriptor = StorageAllocate(Airfs, (int)Node->SecurityDescriptorSize);
+        uint64_t SecurityDescriptorSize = GetSecurityDescriptorLength(SecurityDescriptor);
+        Node->SecurityDescriptor = StorageInternSecurity(Airfs, SecurityDescriptor, SecurityDescriptorSize);
         if (!Node->SecurityDescriptor)
         {
             DeleteNode(Airfs, Node);
             return STATUS_INSUFFICIENT_RESOURCES;
         }
-        memcpy(Node->SecurityDescriptor.Address(), SecurityDescriptor, Node->SecurityDescriptorSize);
+        Node->SecurityDescriptorSize = SecurityDescriptorSize;
     }
 
     if (AllocationSize)
@@ -837,7 +837,7 @@ NTSTATUS ApiSetSecurity(FSP_FILE_SYSTEM *FileSystem, PVOID Node0,
 {
     AIRFS_ Airfs = (AIRFS_) FileSystem->UserContext;
     NODE_ Node = (NODE_) Node0;
-    PSECURITY_DESCRIPTOR NewSecurityDescriptor, MallocSecurityDescriptor;
+    PSECURITY_DESCRIPTOR NewSecurityDescriptor;
 
     if (Node->IsAStream) Node = Node->Parent;
 
@@ -850,31 +850,15 @@ NTSTATUS ApiSetSecurity(FSP_FILE_SYSTEM *FileSystem, PVOID Node0,
         return Result;
 
     uint64_t SecurityDescriptorSize = GetSecurityDescriptorLength(NewSecurityDescriptor);
-    MallocSecurityDescriptor = (PSECURITY_DESCRIPTOR) malloc(SecurityDescriptorSize);
-    if (!MallocSecurityDescriptor)
-    {
-        FspDeleteSecurityDescriptor(NewSecurityDescriptor, (NTSTATUS (*)())FspSetSecurityDescriptor);
-        return STATUS_INSUFFICIENT_RESOURCES;
-    }
-    memcpy(MallocSecurityDescriptor, NewSecurityDescriptor, SecurityDescriptorSize);
+    void* SharedSecurityDescriptor = StorageInternSecurity(Airfs, NewSecurityDescriptor, SecurityDescriptorSize);
     FspDeleteSecurityDescriptor(NewSecurityDescriptor, (NTSTATUS (*)())FspSetSecurityDescriptor);
-
-    NODE_ NewHunk = (NODE_) StorageReallocate(Airfs, Node->SecurityDescriptor, SecurityDescriptorSize);
-    if (!NewHunk && SecurityDescriptorSize)
-    {
-        free(MallocSecurityDescriptor);
+    if (!SharedSecurityDescriptor && SecurityDescriptorSize)
         return STATUS_INSUFFICIENT_RESOURCES;
-    }
 
+    StorageReleaseSecurity(Airfs, Node->SecurityDescriptor);
     Node->SecurityDescriptorSize = SecurityDescriptorSize;
-    if (!SecurityDescriptorSize) Node->SecurityDescriptor = 0;
-    else
-    {
-        Node->SecurityDescriptor = NewHunk;
-        memcpy(Node->SecurityDescriptor.Address(), MallocSecurityDescriptor, SecurityDescriptorSize);
-    }
+    Node->SecurityDescriptor = SharedSecurityDescriptor;
 
-    free(MallocSecurityDescriptor);
     return STATUS_SUCCESS;
 }
 
@@ -1138,6 +1122,37 @@ void AirfsDelete(AIRFS_ Airfs)
 
 //////////////////////////////////////////////////////////////////////
 
+NTSTATUS ShareSecurityDescriptors(AIRFS_ Airfs, NODE_ Node)
+{
+    //  Move private security descriptors into the security store. Nodes that
+    //  already share a store entry are skipped, so this can safely be rerun
+    //  after a partial upgrade.
+    if (Node->SecurityDescriptor &&
+        !StorageIsSharedSecurity(Airfs, Node->SecurityDescriptor, Node->SecurityDescriptorSize))
+    {
+        void* Shared = StorageInternSecurity(Airfs, Node->SecurityDescriptor, Node->SecurityDescriptorSize);
+        if (!Shared) return STATUS_INSUFFICIENT_RESOURCES;
+        StorageFree(Airfs, Node->SecurityDescriptor);
+        Node->SecurityDescriptor = Shared;
+    }
+
+    NTSTATUS Result;
+    for (NODE_ Stream = First(Node->Streams); Stream; Stream = Next(Stream))
+    {
+        Result = ShareSecurityDescriptors(Airfs, Stream);
+        if (!NT_SUCCESS(Result)) return Result;
+    }
+    for (NODE_ Child = First(Node->Children); Child; Child = Next(Child))
+    {
+        Result = ShareSecurityDescriptors(Airfs, Child);
+        if (!NT_SUCCESS(Result)) return Result;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+//////////////////////////////////////////////////////////////////////
+
 NTSTATUS AirfsCreate(
     PWSTR StorageFileName,
     PWSTR MapName,
@@ -1169,7 +1184,8 @@ NTSTATUS AirfsCreate(
 
     if (ShouldFormat)
     {
-        memcpy(Airfs->Signature,"Airfs\0\0\0"  "\1\0\0\0"  "\0\0\0\0", 16);
+        memcpy(Airfs->Signature,"Airfs\0\0\0"  "\2\0\0\0"  "\0\0\0\0", 16);
+        Airfs->Securities = 0;
 
         if (!RootSddl)
             RootSddl = L"O:BAG:BAD:P(A;;FA;;;SY)(A;;FA;;;BA)(A;;FA;;;WD)";
@@ -1236,7 +1252,7 @@ NTSTATUS AirfsCreate(
         }
         RootNode->P = RootNode->L = RootNode->R = RootNode->E = RootNode->Parent = 0;
         RootNode->FileInfo.FileAttributes = FILE_ATTRIBUTE_DIRECTORY;
-        RootNode->SecurityDescriptor = StorageAllocate(Airfs, RootSecuritySize);
+        RootNode->SecurityDescriptor = StorageInternSecurity(Airfs, RootSecurity, RootSecuritySize);
         if (!RootNode->SecurityDescriptor)
         {
             DeleteNode(Airfs, RootNode);
@@ -1245,11 +1261,20 @@ NTSTATUS AirfsCreate(
             return STATUS_INSUFFICIENT_RESOURCES;
         }
         RootNode->SecurityDescriptorSize = RootSecuritySize;
-        memcpy(RootNode->SecurityDescriptor.Address(), RootSecurity, RootSecuritySize);
         Airfs->Root = RootNode;
         ReferenceNode(RootNode);
         LocalFree(RootSecurity);
     }
+    else if (Airfs->MapFormatVersion[0] < 2)
+    {
+        //  Version 1 volumes keep a private security descriptor per node.
+        //  They start with an empty security store (StorageStartup relocated the header).
+        Airfs->Securities = 0;
+        Result = ShareSecurityDescriptors(Airfs, Airfs->Root);
+        if (!NT_SUCCESS(Result))
+            return Result;
+        Airfs->MapFormatVersion[0] = 2;
+    }
 
     Result = FspFileSystemCreate(DevicePath, &Airfs->VolumeParams, &AirfsInterface, &Airfs->FileSystem);
     if (!NT_SUCCESS(Result))
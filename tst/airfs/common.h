@@ -44,6 +44,7 @@
 #define FAIL(format, ...) FspServiceLog(EVENTLOG_ERROR_TYPE       , format, __VA_ARGS__)
 #define AIRFS_MAX_PATH 512
 #define FILEBLOCK_OVERHEAD 40  //  size of ( P + E + L + R + FileOffset ) = 8 * 5 = 40
+#define SECURITY_OVERHEAD 48   //  size of ( P + E + L + R + Hash + RefCount + Size ) = 8 * 5 + 4 * 2 = 48
 #define ARG_TO_S(v) if (arge > ++argp) v = *argp; else goto usage
 #define ARG_TO_4(v) if (arge > ++argp) v = (int32_t) wcstoll_default(*argp, v); else goto usage
 #define ARG_TO_8(v) if (arge > ++argp) v =           wcstoll_default(*argp, v); else goto usage
@@ -123,6 +124,7 @@ typedef struct
     char         filler[4];
     Where<NODE_> Root;
     Where<NODE_> Available;
+    Where<NODE_> Securities;          //  Security store (MapFormatVersion 2 and later)
     UINT64       VolumeSize;
     UINT64       FreeSize;
     WCHAR        VolumeLabel[32];
@@ -162,6 +164,22 @@ struct NODE
     BOOLEAN       IsAStream;
 };
 
+//////////////////////////////////////////////////////////////////////
+//
+//  A security descriptor in the security store. Identical security
+//  descriptors are kept once per volume and shared by reference count.
+//  The first four fields overlay NODE so that entries can be kept in a
+//  Rubbertree; the descriptor itself follows the entry header.
+//
+struct SECURITY
+{
+    Where<NODE_>  P,L,R,E;
+    uint64_t      Hash;
+    int32_t       RefCount;
+    int32_t       Size;
+};
+typedef SECURITY* SECURITY_;
+
 //////////////////////////////////////////////////////////////////////
 
 class SpinLock
@@ -201,10 +219,14 @@ void*    StorageAllocate        (AIRFS_, int64_t RequestedSize);
 void*    StorageReallocate      (AIRFS_, void* Reallocate, int64_t RequestedSize);
 void     StorageFree            (AIRFS_, void* Release);
 NTSTATUS StorageSetFileCapacity (AIRFS_, NODE_, int64_t MinimumRequiredCapacity);
+void*    StorageInternSecurity  (AIRFS_, void* SecurityDescriptor, int64_t Size);
+void     StorageReleaseSecurity (AIRFS_, void* SecurityDescriptor);
+bool     StorageIsSharedSecurity(AIRFS_, void* SecurityDescriptor, int64_t Size);
 void     StorageAccessFile      (StorageFileAccessType, NODE_, int64_t Offset, int64_t NumBytes, char* Address);
 
 static_assert(AIRFS_MAX_PATH > MAX_PATH, "AIRFS_MAX_PATH must be greater than MAX_PATH.");
 static_assert(sizeof NODE + sizeof int32_t == MINIMUM_ALLOCSIZE, "MINIMUM_ALLOCSIZE should be 196.");
+static_assert(sizeof SECURITY == SECURITY_OVERHEAD, "SECURITY_OVERHEAD should be 48.");
 
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
@@ -36,7 +36,7 @@
 
 #include "common.h"
 
-SpinLock StorageLock, AirprintLock, SetLock;
+SpinLock StorageLock, AirprintLock, SetLock, SecurityLock;
 
 int SizeCmp ( void* key,  NODE_ x)
 {
@@ -430,6 +430,103 @@ void StorageFree(AIRFS_ Airfs, void* r)
     StorageLock.Release();
 }
 
+//--------------------------------------------------------------------
+//
+//  The security store keeps one copy of each distinct security descriptor,
+//  in a Rubbertree ordered by content hash, size and bytes. Nodes point at
+//  the descriptor bytes that follow the SECURITY entry header.
+
+struct SECURITY_KEY
+{
+    uint64_t Hash;
+    int32_t  Size;
+    void*    Data;
+};
+
+static uint64_t SecurityHash(void* Data, int64_t Size)
+{
+    //  FNV-1a
+    uint64_t Hash = 0xcbf29ce484222325ULL;
+    for (unsigned char *p = (unsigned char*)Data, *e = p + Size; p < e; p++)
+        Hash = (Hash ^ *p) * 0x100000001b3ULL;
+    return Hash;
+}
+
+int SecurityCmp ( void* key,  NODE_ x)
+{
+    SECURITY_KEY* k = (SECURITY_KEY*) key;
+    SECURITY_ s = (SECURITY_) x;
+    if (k->Hash != s->Hash) return k->Hash < s->Hash ? -1 : 1;
+    if (k->Size != s->Size) return k->Size < s->Size ? -1 : 1;
+    return memcmp(k->Data, (char*)s + SECURITY_OVERHEAD, k->Size);
+}
+
+//--------------------------------------------------------------------
+
+void* StorageInternSecurity(AIRFS_ Airfs, void* SecurityDescriptor, int64_t Size)
+{
+    if (!SecurityDescriptor || !Size) return 0;
+
+    SECURITY_KEY Key = { SecurityHash(SecurityDescriptor, Size), (int32_t) Size, SecurityDescriptor };
+
+    SecurityLock.Acquire();
+    SECURITY_ Entry = (SECURITY_) Find(Airfs->Securities, &Key, SecurityCmp);
+    if (Entry)
+        Entry->RefCount++;
+    else
+    {
+        Entry = (SECURITY_) StorageAllocate(Airfs, SECURITY_OVERHEAD + Size);
+        if (!Entry)
+        {
+            SecurityLock.Release();
+            return 0;
+        }
+        Entry->Hash = Key.Hash;
+        Entry->RefCount = 1;
+        Entry->Size = Key.Size;
+        memcpy((char*)Entry + SECURITY_OVERHEAD, SecurityDescriptor, Size);
+        Attach(Airfs->Securities, (NODE_) Entry, SecurityCmp, &Key);
+    }
+    SecurityLock.Release();
+
+    return (char*)Entry + SECURITY_OVERHEAD;
+}
+
+//--------------------------------------------------------------------
+
+void StorageReleaseSecurity(AIRFS_ Airfs, void* SecurityDescriptor)
+{
+    if (!SecurityDescriptor) return;
+
+    SECURITY_ Entry = (SECURITY_) ((char*)SecurityDescriptor - SECURITY_OVERHEAD);
+
+    SecurityLock.Acquire();
+    if (--Entry->RefCount == 0)
+    {
+        Detach(Airfs->Securities, (NODE_) Entry);
+        StorageFree(Airfs, Entry);
+    }
+    SecurityLock.Release();
+}
+
+//--------------------------------------------------------------------
+
+bool StorageIsSharedSecurity(AIRFS_ Airfs, void* SecurityDescriptor, int64_t Size)
+{
+    //  True if this exact allocation is owned by the security store
+    //  (as opposed to being a private per-node copy from a version 1 volume).
+    if (!SecurityDescriptor || !Size) return false;
+
+    SECURITY_KEY Key = { SecurityHash(SecurityDescriptor, Size), (int32_t) Size, SecurityDescriptor };
+
+    SecurityLock.Acquire();
+    SECURITY_ Entry = (SECURITY_) Find(Airfs->Securities, &Key, SecurityCmp);
+    bool Shared = Entry && (char*)Entry + SECURITY_OVERHEAD == (char*)SecurityDescriptor;
+    SecurityLock.Release();
+
+    return Shared;
+}
+
 //--------------------------------------------------------------------
 
 void StorageAccessFile(StorageFileAccessType Type, NODE_ Node, int64_t AccessOffset, int64_t NumBytes, char* MemoryAddress)
@@ -552,8 +649,15 @@ NTSTATUS StorageStartup(AIRFS_ &Airfs, WCHAR* MapName, WCHAR* StorageFileName, i
     char* MappedAddress = (char*) MapViewOfFile(MapHandle, FILE_MAP_ALL_ACCESS, 0, 0, VolumeLength);
     if (!MappedAddress) return GetLastErrorAsStatus();
 
-    //  Keep.
+    //  Relocate.  Version 1 headers have no Securities field; make room for it after Available.
     Airfs = (AIRFS_) MappedAddress;
+    if (!memcmp(Airfs->Signature, "Airfs\0\0\0", 8) && Airfs->MapFormatVersion[0] < 2)
+    {
+        memmove(&Airfs->VolumeSize, &Airfs->Securities, (char*)(Airfs + 1) - (char*)&Airfs->VolumeSize);
+        Airfs->Securities = 0;
+    }
+
+    //  Keep.
     Airfs->MapFileHandle = MapFileHandle;
     Airfs->MapHandle = MapHandle;
     Airfs->VolumeLength = VolumeLength;
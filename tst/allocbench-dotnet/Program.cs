@@ -0,0 +1,332 @@
+/**
+ * @file Program.cs
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+/*
+ * Measures the managed allocations per operation of the FileSystemHost marshaling paths.
+ *
+ * The program is compiled together with the winfsp.net sources, so that it can construct
+ * NativeString, SecurityDescriptorBuffer and DirInfoBuffer over native memory the same way
+ * the FileSystemHost does. It does not need the WinFsp DLL or driver.
+ *
+ * Each operation is measured three ways:
+ * - old:      the host marshals Strings/Byte[]'s and calls the String/Byte[] overloads
+ *             (the FileSystemHost code prior to the low-allocation overloads)
+ * - forward:  the host calls the low-allocation overloads, which the file system does
+ *             not override (base implementations forward to the String/Byte[] overloads)
+ * - override: the host calls the low-allocation overloads, which the file system overrides
+ *
+ * The program exits with a non-zero status if an overridden operation allocates.
+ */
+
+using System;
+using System.Runtime.InteropServices;
+
+using Fsp;
+using Fsp.Interop;
+using FileInfo = Fsp.Interop.FileInfo;
+
+namespace allocbench
+{
+    class TestFs : FileSystemBase
+    {
+        public const int EntryCount = 32;
+
+        public TestFs(Boolean Override)
+        {
+            this.Override = Override;
+            SecurityDescriptor = new Byte[96];
+            for (int I = 0; SecurityDescriptor.Length > I; I++)
+                SecurityDescriptor[I] = (Byte)I;
+            EntryNames = new String[EntryCount];
+            for (int I = 0; EntryCount > I; I++)
+                EntryNames[I] = String.Format("file{0:D4}.txt", I);
+            Node = new Object();
+        }
+
+        public override Int32 GetSecurityByName(
+            String FileName,
+            out UInt32 FileAttributes/* or ReparsePointIndex */,
+            ref Byte[] SecurityDescriptor)
+        {
+            FileAttributes = 0;
+            if (!String.Equals(FileName, Name, StringComparison.OrdinalIgnoreCase))
+                return STATUS_OBJECT_NAME_NOT_FOUND;
+            FileAttributes = (UInt32)System.IO.FileAttributes.Normal;
+            if (null != SecurityDescriptor)
+                SecurityDescriptor = this.SecurityDescriptor;
+            return STATUS_SUCCESS;
+        }
+        public override Int32 GetSecurityByName(
+            NativeString FileName,
+            out UInt32 FileAttributes/* or ReparsePointIndex */,
+            SecurityDescriptorBuffer SecurityDescriptor)
+        {
+            if (!Override)
+                return base.GetSecurityByName(FileName, out FileAttributes, SecurityDescriptor);
+            FileAttributes = 0;
+            if (!FileName.Equals(Name, true))
+                return STATUS_OBJECT_NAME_NOT_FOUND;
+            FileAttributes = (UInt32)System.IO.FileAttributes.Normal;
+            return SecurityDescriptor.Set(this.SecurityDescriptor);
+        }
+        public override Int32 Open(
+            String FileName,
+            UInt32 CreateOptions,
+            UInt32 GrantedAccess,
+            out Object FileNode,
+            out Object FileDesc,
+            out FileInfo FileInfo,
+            out String NormalizedName)
+        {
+            FileNode = default(Object);
+            FileDesc = default(Object);
+            FileInfo = default(FileInfo);
+            NormalizedName = default(String);
+            if (!String.Equals(FileName, Name, StringComparison.OrdinalIgnoreCase))
+                return STATUS_OBJECT_NAME_NOT_FOUND;
+            FileNode = Node;
+            FileDesc = Node;
+            return STATUS_SUCCESS;
+        }
+        public override Int32 Open(
+            NativeString FileName,
+            UInt32 CreateOptions,
+            UInt32 GrantedAccess,
+            out Object FileNode,
+            out Object FileDesc,
+            out FileInfo FileInfo,
+            out String NormalizedName)
+        {
+            if (!Override)
+                return base.Open(FileName, CreateOptions, GrantedAccess,
+                    out FileNode, out FileDesc, out FileInfo, out NormalizedName);
+            FileNode = default(Object);
+            FileDesc = default(Object);
+            FileInfo = default(FileInfo);
+            NormalizedName = default(String);
+            if (!FileName.Equals(Name, true))
+                return STATUS_OBJECT_NAME_NOT_FOUND;
+            FileNode = Node;
+            FileDesc = Node;
+            return STATUS_SUCCESS;
+        }
+        public override Int32 GetSecurity(
+            Object FileNode,
+            Object FileDesc,
+            ref Byte[] SecurityDescriptor)
+        {
+            SecurityDescriptor = this.SecurityDescriptor;
+            return STATUS_SUCCESS;
+        }
+        public override Int32 GetSecurity(
+            Object FileNode,
+            Object FileDesc,
+            SecurityDescriptorBuffer SecurityDescriptor)
+        {
+            if (!Override)
+                return base.GetSecurity(FileNode, FileDesc, SecurityDescriptor);
+            return SecurityDescriptor.Set(this.SecurityDescriptor);
+        }
+        public override Int32 ReadDirectory(
+            Object FileNode,
+            Object FileDesc,
+            String Pattern,
+            String Marker,
+            IntPtr Buffer,
+            UInt32 Length,
+            out UInt32 BytesTransferred)
+        {
+            return SeekableReadDirectory(FileNode, FileDesc, Pattern, Marker, Buffer, Length,
+                out BytesTransferred);
+        }
+        public override Int32 ReadDirectory(
+            Object FileNode,
+            Object FileDesc,
+            NativeString Pattern,
+            NativeString Marker,
+            ref DirInfoBuffer Buffer)
+        {
+            if (!Override)
+                return base.ReadDirectory(FileNode, FileDesc, Pattern, Marker, ref Buffer);
+            FileInfo FileInfo = default(FileInfo);
+            for (int I = 0; EntryCount > I; I++)
+                if (!Buffer.Add(EntryNames[I], ref FileInfo))
+                    return STATUS_SUCCESS;
+            Buffer.End();
+            return STATUS_SUCCESS;
+        }
+        public override Boolean ReadDirectoryEntry(
+            Object FileNode,
+            Object FileDesc,
+            String Pattern,
+            String Marker,
+            ref Object Context,
+            out String FileName,
+            out FileInfo FileInfo)
+        {
+            /* typical enumeration: the context is an index (boxed) into the directory */
+            int Index = null == Context ? 0 : (int)Context;
+            FileInfo = default(FileInfo);
+            if (EntryCount <= Index)
+            {
+                FileName = default(String);
+                return false;
+            }
+            FileName = EntryNames[Index];
+            Context = Index + 1;
+            return true;
+        }
+
+        public const String Name = "\\dir\\file0007.txt";
+        private Boolean Override;
+        private Byte[] SecurityDescriptor;
+        private String[] EntryNames;
+        private Object Node;
+    }
+
+    class Program
+    {
+        const int Iterations = 100000;
+
+        delegate Int32 Operation();
+
+        static Double Measure(Operation Operation)
+        {
+            for (int I = 0; 1000 > I; I++)
+                if (0 > Operation())
+                    throw new InvalidOperationException();
+            Int64 Allocated = GC.GetAllocatedBytesForCurrentThread();
+            for (int I = 0; Iterations > I; I++)
+                Operation();
+            return (Double)(GC.GetAllocatedBytesForCurrentThread() - Allocated) / Iterations;
+        }
+
+        static unsafe int Main(String[] args)
+        {
+            TestFs OldFs = new TestFs(false), OverrideFs = new TestFs(true);
+            IntPtr FileName = Marshal.StringToHGlobalUni(TestFs.Name);
+            IntPtr SecurityDescriptor = Marshal.AllocHGlobal(1024);
+            IntPtr PSecurityDescriptorSize = Marshal.AllocHGlobal(IntPtr.Size);
+            IntPtr DirBuffer = Marshal.AllocHGlobal(16384);
+            Operation[,] Operations = new Operation[4, 3];
+            String[] Names = new String[] { "GetSecurityByName", "Open", "GetSecurity", "ReadDirectory" };
+            Boolean Failed = false;
+
+            foreach (TestFs Fs in new TestFs[] { OldFs, OverrideFs })
+            {
+                TestFs F = Fs;
+                int Column = F == OldFs ? 1 : 2;
+                Operations[0, Column] = delegate ()
+                {
+                    UInt32 FileAttributes;
+                    *(IntPtr *)PSecurityDescriptorSize = (IntPtr)1024;
+                    return F.GetSecurityByName(new NativeString(FileName), out FileAttributes,
+                        new SecurityDescriptorBuffer(SecurityDescriptor, PSecurityDescriptorSize));
+                };
+                Operations[1, Column] = delegate ()
+                {
+                    Object FileNode, FileDesc;
+                    FileInfo FileInfo;
+                    String NormalizedName;
+                    return F.Open(new NativeString(FileName), 0, 0,
+                        out FileNode, out FileDesc, out FileInfo, out NormalizedName);
+                };
+                Operations[2, Column] = delegate ()
+                {
+                    *(IntPtr *)PSecurityDescriptorSize = (IntPtr)1024;
+                    return F.GetSecurity(null, null,
+                        new SecurityDescriptorBuffer(SecurityDescriptor, PSecurityDescriptorSize));
+                };
+                Operations[3, Column] = delegate ()
+                {
+                    DirInfoBuffer Buffer = new DirInfoBuffer(DirBuffer, 16384);
+                    return F.ReadDirectory(null, null,
+                        new NativeString(IntPtr.Zero), new NativeString(IntPtr.Zero), ref Buffer);
+                };
+            }
+
+            /*
+             * The FileSystemHost marshaling prior to the low-allocation overloads.
+             * Api.CopySecurityDescriptor is replaced by its (equivalent) body, because
+             * the Api class loads the WinFsp DLL.
+             */
+            Operations[0, 0] = delegate ()
+            {
+                UInt32 FileAttributes;
+                Byte[] SecurityDescriptorBytes = FileSystemHost.ByteBufferNotNull;
+                Int32 Result;
+                *(IntPtr *)PSecurityDescriptorSize = (IntPtr)1024;
+                Result = OldFs.GetSecurityByName(Marshal.PtrToStringUni(FileName),
+                    out FileAttributes, ref SecurityDescriptorBytes);
+                if (0 <= Result)
+                    Result = new SecurityDescriptorBuffer(SecurityDescriptor,
+                        PSecurityDescriptorSize).Set(SecurityDescriptorBytes);
+                return Result;
+            };
+            Operations[1, 0] = delegate ()
+            {
+                Object FileNode, FileDesc;
+                FileInfo FileInfo;
+                String NormalizedName;
+                return OldFs.Open(Marshal.PtrToStringUni(FileName), 0, 0,
+                    out FileNode, out FileDesc, out FileInfo, out NormalizedName);
+            };
+            Operations[2, 0] = delegate ()
+            {
+                Byte[] SecurityDescriptorBytes = FileSystemHost.ByteBufferNotNull;
+                Int32 Result;
+                *(IntPtr *)PSecurityDescriptorSize = (IntPtr)1024;
+                Result = OldFs.GetSecurity(null, null, ref SecurityDescriptorBytes);
+                if (0 <= Result)
+                    Result = new SecurityDescriptorBuffer(SecurityDescriptor,
+                        PSecurityDescriptorSize).Set(SecurityDescriptorBytes);
+                return Result;
+            };
+            Operations[3, 0] = delegate ()
+            {
+                UInt32 BytesTransferred;
+                return OldFs.ReadDirectory(null, null,
+                    Marshal.PtrToStringUni(IntPtr.Zero), Marshal.PtrToStringUni(IntPtr.Zero),
+                    DirBuffer, 16384, out BytesTransferred);
+            };
+
+            Console.WriteLine("{0,-20}{1,12}{2,12}{3,12}", "bytes/op", "old", "forward", "override");
+            for (int I = 0; Names.Length > I; I++)
+            {
+                Double Old = Measure(Operations[I, 0]);
+                Double Forward = Measure(Operations[I, 1]);
+                Double Override = Measure(Operations[I, 2]);
+                Console.WriteLine("{0,-20}{1,12:F1}{2,12:F1}{3,12:F1}", Names[I], Old, Forward, Override);
+                if (0 != Override)
+                    Failed = true;
+            }
+
+            Marshal.FreeHGlobal(DirBuffer);
+            Marshal.FreeHGlobal(PSecurityDescriptorSize);
+            Marshal.FreeHGlobal(SecurityDescriptor);
+            Marshal.FreeHGlobal(FileName);
+
+            if (Failed)
+                Console.WriteLine("FAIL: an overridden low-allocation operation allocates");
+            return Failed ? 1 : 0;
+        }
+    }
+}
@@ -0,0 +1,241 @@
+/**
+ * @file fsbench-posix.c
+ *
+ * POSIX driver for the fsbench load generator. This allows the fsbench load
+ * profiles to be run against a local directory on Linux or other POSIX systems
+ * to obtain a baseline. Build with:
+ *
+ *     cc -O2 -pthread -o fsbench-posix fsbench-posix.c loadgen.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include "loadgen.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t PosixNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+typedef struct
+{
+    void (*Worker)(void *Context, unsigned Index);
+    void *Context;
+    unsigned Index;
+} POSIX_THREAD_ARGS;
+
+static void *PosixThread(void *Args0)
+{
+    POSIX_THREAD_ARGS *Args = Args0;
+    Args->Worker(Args->Context, Args->Index);
+    return 0;
+}
+
+static int PosixParallel(unsigned Threads, void (*Worker)(void *Context, unsigned Index), void *Context)
+{
+    pthread_t *Thread;
+    POSIX_THREAD_ARGS *Args;
+    unsigned Started = 0;
+    int Result = 0;
+
+    Thread = calloc(Threads, sizeof *Thread);
+    Args = calloc(Threads, sizeof *Args);
+    if (0 == Thread || 0 == Args)
+    {
+        free(Thread);
+        free(Args);
+        return -1;
+    }
+
+    for (; Threads > Started; Started++)
+    {
+        Args[Started].Worker = Worker;
+        Args[Started].Context = Context;
+        Args[Started].Index = Started;
+        if (0 != pthread_create(&Thread[Started], 0, PosixThread, &Args[Started]))
+        {
+            Result = -1;
+            break;
+        }
+    }
+    for (unsigned I = 0; Started > I; I++)
+        pthread_join(Thread[I], 0);
+
+    free(Thread);
+    free(Args);
+
+    return Result;
+}
+
+static int PosixMkdir(const char *Path)
+{
+    return mkdir(Path, 0755);
+}
+
+static int PosixRmdir(const char *Path)
+{
+    return rmdir(Path);
+}
+
+static int PosixUnlink(const char *Path)
+{
+    return unlink(Path);
+}
+
+static int PosixCreate(const char *Path, uint64_t Size, void *Buffer, unsigned IoSize)
+{
+    int Fd = open(Path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (-1 == Fd)
+        return -1;
+    for (uint64_t Offset = 0; Size > Offset;)
+    {
+        size_t Length = Size - Offset < IoSize ? (size_t)(Size - Offset) : IoSize;
+        ssize_t Bytes = write(Fd, Buffer, Length);
+        if (0 >= Bytes)
+        {
+            close(Fd);
+            return -1;
+        }
+        Offset += (uint64_t)Bytes;
+    }
+    return close(Fd);
+}
+
+static int PosixRead(const char *Path, void *Buffer, unsigned IoSize, uint64_t *PBytes)
+{
+    ssize_t Bytes;
+    int Fd = open(Path, O_RDONLY);
+    if (-1 == Fd)
+        return -1;
+    *PBytes = 0;
+    while (0 < (Bytes = read(Fd, Buffer, IoSize)))
+        *PBytes += (uint64_t)Bytes;
+    close(Fd);
+    return 0 == Bytes ? 0 : -1;
+}
+
+static int PosixWrite(const char *Path, uint64_t Offset, void *Buffer, unsigned Length)
+{
+    ssize_t Bytes;
+    int Fd = open(Path, O_WRONLY);
+    if (-1 == Fd)
+        return -1;
+    Bytes = pwrite(Fd, Buffer, Length, (off_t)Offset);
+    close(Fd);
+    return (ssize_t)Length == Bytes ? 0 : -1;
+}
+
+static int PosixOpen(const char *Path)
+{
+    int Fd = open(Path, O_RDWR);
+    if (-1 == Fd)
+        return -1;
+    return close(Fd);
+}
+
+static int PosixStat(const char *Path)
+{
+    struct stat Stbuf;
+    return stat(Path, &Stbuf);
+}
+
+static int PosixList(const char *Path, uint64_t *PCount)
+{
+    DIR *Dir = opendir(Path);
+    if (0 == Dir)
+        return -1;
+    *PCount = 0;
+    while (0 != readdir(Dir))
+        ++*PCount;
+    return closedir(Dir);
+}
+
+static LOADGEN_PLATFORM PosixPlatform =
+{
+    PosixNow,
+    PosixParallel,
+    PosixMkdir,
+    PosixRmdir,
+    PosixUnlink,
+    PosixCreate,
+    PosixRead,
+    PosixWrite,
+    PosixOpen,
+    PosixStat,
+    PosixList,
+};
+
+int main(int argc, char *argv[])
+{
+    LOADGEN_PROFILE Profile;
+    LOADGEN_STATS *Stats;
+    FILE *File = stdout;
+
+    LoadgenProfileInit(&Profile);
+    for (int argi = 1; argc > argi; argi++)
+    {
+        if (0 == strcmp("-C", argv[argi]) && argc > argi + 1)
+        {
+            if (0 != chdir(argv[++argi]))
+            {
+                fprintf(stderr, "cannot change directory to %s\n", argv[argi]);
+                return 2;
+            }
+        }
+        else if (!LoadgenProfileOption(&Profile, argv[argi]))
+        {
+            fprintf(stderr, "usage: %s [-C DIR] [OPTIONS]\n%s", argv[0], LoadgenProfileUsage());
+            return 2;
+        }
+    }
+
+    Stats = malloc(sizeof *Stats);
+    if (0 == Stats)
+        return 1;
+
+    if (0 != LoadgenRun(&Profile, &PosixPlatform, Stats))
+    {
+        fprintf(stderr, "load generator failed\n");
+        free(Stats);
+        return 1;
+    }
+
+    if (0 != Profile.ReportPath && 0 == (File = fopen(Profile.ReportPath, "w")))
+    {
+        fprintf(stderr, "cannot open %s\n", Profile.ReportPath);
+        free(Stats);
+        return 1;
+    }
+    LoadgenReport(&Profile, Stats, File);
+    if (stdout != File)
+        fclose(File);
+
+    free(Stats);
+
+    return 0;
+}
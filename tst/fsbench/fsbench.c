@@ -22,6 +22,7 @@
 #include <windows.h>
 #include <strsafe.h>
 #include <tlib/testsuite.h>
+#include "loadgen.h"
 
 static BOOLEAN OptEmptyCache = FALSE;
 static CHAR OptEmptyCacheDrive = 0;
@@ -33,6 +34,7 @@ static ULONG OptRdwrCcCount = 100;
 static ULONG OptRdwrNcCount = 100;
 static ULONG OptMmapFileSize = 4096 * 1024;
 static ULONG OptMmapCount = 100;
+static LOADGEN_PROFILE OptLoadProfile;
 
 static void file_create_dotest(ULONG CreateDisposition, ULONG OpenCount)
 {
@@ -402,6 +404,210 @@ static void mmap_tests(void)
     TEST(mmap_read_test);
 }
 
+static uint64_t load_now(void)
+{
+    static LARGE_INTEGER Frequency;
+    LARGE_INTEGER Counter;
+    if (0 == Frequency.QuadPart)
+        QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Counter);
+    return (uint64_t)(Counter.QuadPart / Frequency.QuadPart * 1000000000 +
+        Counter.QuadPart % Frequency.QuadPart * 1000000000 / Frequency.QuadPart);
+}
+typedef struct
+{
+    void (*Worker)(void *Context, unsigned Index);
+    void *Context;
+    unsigned Index;
+} LOAD_THREAD_ARGS;
+static DWORD WINAPI load_thread(PVOID Args0)
+{
+    LOAD_THREAD_ARGS *Args = Args0;
+    Args->Worker(Args->Context, Args->Index);
+    return 0;
+}
+static int load_parallel(unsigned Threads, void (*Worker)(void *Context, unsigned Index), void *Context)
+{
+    HANDLE *Thread;
+    LOAD_THREAD_ARGS *Args;
+    unsigned Started = 0;
+    int Result = 0;
+
+    Thread = calloc(Threads, sizeof *Thread);
+    Args = calloc(Threads, sizeof *Args);
+    if (0 == Thread || 0 == Args)
+    {
+        free(Thread);
+        free(Args);
+        return -1;
+    }
+
+    for (; Threads > Started; Started++)
+    {
+        Args[Started].Worker = Worker;
+        Args[Started].Context = Context;
+        Args[Started].Index = Started;
+        Thread[Started] = CreateThread(0, 0, load_thread, &Args[Started], 0, 0);
+        if (0 == Thread[Started])
+        {
+            Result = -1;
+            break;
+        }
+    }
+    for (unsigned I = 0; Started > I; I++)
+    {
+        WaitForSingleObject(Thread[I], INFINITE);
+        CloseHandle(Thread[I]);
+    }
+
+    free(Thread);
+    free(Args);
+
+    return Result;
+}
+static int load_mkdir(const char *Path)
+{
+    return CreateDirectoryA(Path, 0) ? 0 : -1;
+}
+static int load_rmdir(const char *Path)
+{
+    return RemoveDirectoryA(Path) ? 0 : -1;
+}
+static int load_unlink(const char *Path)
+{
+    return DeleteFileA(Path) ? 0 : -1;
+}
+static int load_create(const char *Path, uint64_t Size, void *Buffer, unsigned IoSize)
+{
+    HANDLE Handle;
+    DWORD BytesTransferred;
+    BOOL Success = TRUE;
+
+    Handle = CreateFileA(Path,
+        GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    if (INVALID_HANDLE_VALUE == Handle)
+        return -1;
+    for (uint64_t Offset = 0; Success && Size > Offset; Offset += BytesTransferred)
+    {
+        DWORD Length = Size - Offset < IoSize ? (DWORD)(Size - Offset) : IoSize;
+        Success = WriteFile(Handle, Buffer, Length, &BytesTransferred, 0) && 0 != BytesTransferred;
+    }
+    CloseHandle(Handle);
+    return Success ? 0 : -1;
+}
+static int load_read(const char *Path, void *Buffer, unsigned IoSize, uint64_t *PBytes)
+{
+    HANDLE Handle;
+    DWORD BytesTransferred;
+    BOOL Success;
+
+    Handle = CreateFileA(Path,
+        GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (INVALID_HANDLE_VALUE == Handle)
+        return -1;
+    *PBytes = 0;
+    while ((Success = ReadFile(Handle, Buffer, IoSize, &BytesTransferred, 0)) && 0 != BytesTransferred)
+        *PBytes += BytesTransferred;
+    CloseHandle(Handle);
+    return Success ? 0 : -1;
+}
+static int load_write(const char *Path, uint64_t Offset, void *Buffer, unsigned Length)
+{
+    HANDLE Handle;
+    OVERLAPPED Overlapped = { 0 };
+    DWORD BytesTransferred;
+    BOOL Success;
+
+    Handle = CreateFileA(Path,
+        GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (INVALID_HANDLE_VALUE == Handle)
+        return -1;
+    Overlapped.Offset = (DWORD)Offset;
+    Overlapped.OffsetHigh = (DWORD)(Offset >> 32);
+    Success = WriteFile(Handle, Buffer, Length, &BytesTransferred, &Overlapped) &&
+        Length == BytesTransferred;
+    CloseHandle(Handle);
+    return Success ? 0 : -1;
+}
+static int load_open(const char *Path)
+{
+    HANDLE Handle;
+
+    Handle = CreateFileA(Path,
+        GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (INVALID_HANDLE_VALUE == Handle)
+        return -1;
+    CloseHandle(Handle);
+    return 0;
+}
+static int load_stat(const char *Path)
+{
+    return INVALID_FILE_ATTRIBUTES != GetFileAttributesA(Path) ? 0 : -1;
+}
+static int load_list(const char *Path, uint64_t *PCount)
+{
+    CHAR Pattern[MAX_PATH];
+    WIN32_FIND_DATAA FindData;
+    HANDLE Handle;
+
+    StringCbPrintfA(Pattern, sizeof Pattern, "%s/*", Path);
+    Handle = FindFirstFileA(Pattern, &FindData);
+    if (INVALID_HANDLE_VALUE == Handle)
+        return -1;
+    *PCount = 0;
+    do
+    {
+        ++*PCount;
+    } while (FindNextFileA(Handle, &FindData));
+    FindClose(Handle);
+    return 0;
+}
+static LOADGEN_PLATFORM load_platform =
+{
+    load_now,
+    load_parallel,
+    load_mkdir,
+    load_rmdir,
+    load_unlink,
+    load_create,
+    load_read,
+    load_write,
+    load_open,
+    load_stat,
+    load_list,
+};
+static void load_test(void)
+{
+    LOADGEN_STATS *Stats;
+    FILE *File = 0;
+    int Result;
+
+    Stats = malloc(sizeof *Stats);
+    ASSERT(0 != Stats);
+
+    Result = LoadgenRun(&OptLoadProfile, &load_platform, Stats);
+    ASSERT(0 == Result);
+
+    if (0 != OptLoadProfile.ReportPath)
+    {
+        ASSERT(0 == fopen_s(&File, OptLoadProfile.ReportPath, "w"));
+        LoadgenReport(&OptLoadProfile, Stats, File);
+        fclose(File);
+    }
+    else
+        LoadgenReport(&OptLoadProfile, Stats, stdout);
+
+    free(Stats);
+}
+static void load_tests(void)
+{
+    TEST_OPT(load_test);
+}
+
 static void EmptyCache(const char *name, void (*fn)(void), int v)
 {
     NTSYSCALLAPI NTSTATUS NTAPI
@@ -481,12 +687,23 @@ int main(int argc, char *argv[])
     TESTSUITE(file_tests);
     TESTSUITE(rdwr_tests);
     TESTSUITE(mmap_tests);
+    TESTSUITE(load_tests);
+
+    LoadgenProfileInit(&OptLoadProfile);
 
     for (int argi = 1; argc > argi; argi++)
     {
         const char *a = argv[argi];
         if ('-' == a[0])
         {
+            /* load generator options; --files is shared with the file tests */
+            if (LoadgenProfileOption(&OptLoadProfile, a) &&
+                0 != strncmp("--files=", a, sizeof "--files=" - 1))
+            {
+                rmarg(argv, argc, argi);
+                continue;
+            }
+
             if (0 == strcmp("--empty-cache", a))
             {
                 OptEmptyCache = TRUE;
@@ -0,0 +1,737 @@
+/**
+ * @file loadgen.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include "loadgen.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LOADGEN_PATH_MAX                256
+
+static const char *LoadgenOpNames[LoadgenOpCount] =
+{
+    "read", "write", "create", "open", "stat", "list",
+};
+
+/*
+ * Histogram
+ */
+
+static inline unsigned LoadgenHistIndex(uint64_t Ns)
+{
+    unsigned Exp;
+
+    if (Ns < (1ULL << LOADGEN_HIST_SUBBITS))
+        return (unsigned)Ns;
+
+    for (Exp = LOADGEN_HIST_SUBBITS; Exp < 63 && (Ns >> (Exp + 1)); Exp++)
+        ;
+
+    return ((Exp - LOADGEN_HIST_SUBBITS + 1) << LOADGEN_HIST_SUBBITS) +
+        (unsigned)((Ns >> (Exp - LOADGEN_HIST_SUBBITS)) & ((1ULL << LOADGEN_HIST_SUBBITS) - 1));
+}
+
+static inline uint64_t LoadgenHistValue(unsigned Index)
+{
+    /* midpoint of the bucket */
+    unsigned Exp, Sub;
+
+    if (Index < (1U << LOADGEN_HIST_SUBBITS))
+        return Index;
+
+    Exp = (Index >> LOADGEN_HIST_SUBBITS) + LOADGEN_HIST_SUBBITS - 1;
+    Sub = Index & ((1U << LOADGEN_HIST_SUBBITS) - 1);
+
+    return (1ULL << Exp) + ((uint64_t)Sub << (Exp - LOADGEN_HIST_SUBBITS)) +
+        ((1ULL << (Exp - LOADGEN_HIST_SUBBITS)) >> 1);
+}
+
+void LoadgenHistRecord(LOADGEN_HIST *Hist, uint64_t Ns, int Success, uint64_t Bytes)
+{
+    if (!Success)
+    {
+        Hist->Errors++;
+        return;
+    }
+
+    if (0 == Hist->Count || Hist->Min > Ns)
+        Hist->Min = Ns;
+    if (Hist->Max < Ns)
+        Hist->Max = Ns;
+    Hist->Count++;
+    Hist->Sum += Ns;
+    Hist->Bytes += Bytes;
+    Hist->Buckets[LoadgenHistIndex(Ns)]++;
+}
+
+void LoadgenHistMerge(LOADGEN_HIST *Dst, const LOADGEN_HIST *Src)
+{
+    if (0 != Src->Count)
+    {
+        if (0 == Dst->Count || Dst->Min > Src->Min)
+            Dst->Min = Src->Min;
+        if (Dst->Max < Src->Max)
+            Dst->Max = Src->Max;
+    }
+    Dst->Count += Src->Count;
+    Dst->Errors += Src->Errors;
+    Dst->Bytes += Src->Bytes;
+    Dst->Sum += Src->Sum;
+    for (unsigned I = 0; LOADGEN_HIST_BUCKETS > I; I++)
+        Dst->Buckets[I] += Src->Buckets[I];
+}
+
+uint64_t LoadgenHistPercentile(const LOADGEN_HIST *Hist, double Percentile)
+{
+    uint64_t Rank, Seen = 0;
+    uint64_t Value;
+
+    if (0 == Hist->Count)
+        return 0;
+
+    Rank = (uint64_t)(Percentile / 100.0 * (double)Hist->Count + 0.5);
+    if (Rank < 1)
+        Rank = 1;
+    if (Rank > Hist->Count)
+        Rank = Hist->Count;
+
+    for (unsigned I = 0; LOADGEN_HIST_BUCKETS > I; I++)
+    {
+        Seen += Hist->Buckets[I];
+        if (Seen >= Rank)
+        {
+            Value = LoadgenHistValue(I);
+            if (Value < Hist->Min)
+                Value = Hist->Min;
+            if (Value > Hist->Max)
+                Value = Hist->Max;
+            return Value;
+        }
+    }
+
+    return Hist->Max;
+}
+
+/*
+ * Profile
+ */
+
+void LoadgenProfileInit(LOADGEN_PROFILE *Profile)
+{
+    memset(Profile, 0, sizeof *Profile);
+    Profile->Threads = 1;
+    Profile->OpsPerThread = 10000;
+    Profile->Mix[LoadgenOpRead] = 60;
+    Profile->Mix[LoadgenOpWrite] = 20;
+    Profile->Mix[LoadgenOpCreate] = 5;
+    Profile->Mix[LoadgenOpOpen] = 5;
+    Profile->Mix[LoadgenOpStat] = 5;
+    Profile->Mix[LoadgenOpList] = 5;
+    Profile->FileCount = 1000;
+    Profile->DirFanout = 10;
+    Profile->DirDepth = 1;
+    Profile->SizeDistribution = LoadgenSizeFixed;
+    Profile->SizeMin = Profile->SizeMax = 64 * 1024;
+    Profile->IoSize = 64 * 1024;
+    Profile->Seed = 1;
+    Profile->ReportFormat = LoadgenReportText;
+    Profile->ReportPath = 0;
+    Profile->Root = "fsbench-load";
+}
+
+static int LoadgenParseSize(const char *P, const char **PEnd, uint64_t *PValue)
+{
+    char *EndP;
+    uint64_t Value = strtoull(P, &EndP, 10);
+
+    if (EndP == P)
+        return 0;
+    switch (*EndP)
+    {
+    case 'k': case 'K':
+        Value <<= 10; EndP++; break;
+    case 'm': case 'M':
+        Value <<= 20; EndP++; break;
+    case 'g': case 'G':
+        Value <<= 30; EndP++; break;
+    }
+
+    *PEnd = EndP;
+    *PValue = Value;
+    return 1;
+}
+
+static int LoadgenParseMix(LOADGEN_PROFILE *Profile, const char *P)
+{
+    unsigned Mix[LoadgenOpCount] = { 0 };
+    unsigned Total = 0;
+
+    /* read:60,write:20,... */
+    while (*P)
+    {
+        unsigned Op;
+        size_t Len;
+        char *EndP;
+
+        for (Op = 0; LoadgenOpCount > Op; Op++)
+        {
+            Len = strlen(LoadgenOpNames[Op]);
+            if (0 == strncmp(P, LoadgenOpNames[Op], Len) && ':' == P[Len])
+                break;
+        }
+        if (LoadgenOpCount == Op)
+            return 0;
+
+        P += Len + 1;
+        Mix[Op] = (unsigned)strtoul(P, &EndP, 10);
+        if (EndP == P)
+            return 0;
+        Total += Mix[Op];
+
+        P = EndP;
+        if (',' == *P)
+            P++;
+        else if ('\0' != *P)
+            return 0;
+    }
+
+    if (0 == Total)
+        return 0;
+
+    memcpy(Profile->Mix, Mix, sizeof Mix);
+    return 1;
+}
+
+static int LoadgenParseSizeDistribution(LOADGEN_PROFILE *Profile, const char *P)
+{
+    unsigned Distribution = LoadgenSizeFixed;
+    uint64_t Min, Max;
+
+    /* N | uniform:MIN-MAX | loguniform:MIN-MAX */
+    if (0 == strncmp(P, "uniform:", sizeof "uniform:" - 1))
+        Distribution = LoadgenSizeUniform, P += sizeof "uniform:" - 1;
+    else if (0 == strncmp(P, "loguniform:", sizeof "loguniform:" - 1))
+        Distribution = LoadgenSizeLogUniform, P += sizeof "loguniform:" - 1;
+
+    if (!LoadgenParseSize(P, &P, &Min))
+        return 0;
+    Max = Min;
+    if (LoadgenSizeFixed != Distribution)
+    {
+        if ('-' != *P || !LoadgenParseSize(P + 1, &P, &Max) || Max < Min)
+            return 0;
+    }
+    if ('\0' != *P)
+        return 0;
+    if (LoadgenSizeLogUniform == Distribution && 0 == Min)
+        return 0;
+
+    Profile->SizeDistribution = Distribution;
+    Profile->SizeMin = Min;
+    Profile->SizeMax = Max;
+    return 1;
+}
+
+int LoadgenProfileOption(LOADGEN_PROFILE *Profile, const char *Arg)
+{
+#define OPTION(N)                       (0 == strncmp(Arg, "--" N "=", sizeof "--" N "=" - 1) &&\
+                                            (V = Arg + sizeof "--" N "=" - 1))
+    const char *V;
+    uint64_t Value;
+
+    if (OPTION("threads"))
+        return 0 != (Profile->Threads = (unsigned)strtoul(V, 0, 10));
+    else if (OPTION("ops"))
+        return 0 != (Profile->OpsPerThread = (unsigned)strtoul(V, 0, 10));
+    else if (OPTION("mix"))
+        return LoadgenParseMix(Profile, V);
+    else if (OPTION("files"))
+        return 0 != (Profile->FileCount = (unsigned)strtoul(V, 0, 10));
+    else if (OPTION("fanout"))
+        return 0 != (Profile->DirFanout = (unsigned)strtoul(V, 0, 10));
+    else if (OPTION("depth"))
+        return Profile->DirDepth = (unsigned)strtoul(V, 0, 10), 1;
+    else if (OPTION("size"))
+        return LoadgenParseSizeDistribution(Profile, V);
+    else if (OPTION("iosize"))
+        return LoadgenParseSize(V, &V, &Value) && 0 != Value && Value <= 0x10000000 &&
+            (Profile->IoSize = (unsigned)Value);
+    else if (OPTION("seed"))
+        return Profile->Seed = strtoull(V, 0, 10), 1;
+    else if (OPTION("report"))
+    {
+        if (0 == strcmp(V, "text"))
+            Profile->ReportFormat = LoadgenReportText;
+        else if (0 == strcmp(V, "csv"))
+            Profile->ReportFormat = LoadgenReportCsv;
+        else if (0 == strcmp(V, "json"))
+            Profile->ReportFormat = LoadgenReportJson;
+        else
+            return 0;
+        return 1;
+    }
+    else if (OPTION("report-file"))
+        return Profile->ReportPath = V, 1;
+    else if (OPTION("root"))
+        return Profile->Root = V, 1;
+
+    return 0;
+#undef OPTION
+}
+
+const char *LoadgenProfileUsage(void)
+{
+    return
+        "    --threads=N                     worker threads [1]\n"
+        "    --ops=N                         measured operations per thread [10000]\n"
+        "    --mix=OP:W,...                  operation weights; OP is one of\n"
+        "                                    read,write,create,open,stat,list\n"
+        "                                    [read:60,write:20,create:5,open:5,stat:5,list:5]\n"
+        "    --files=N                       files created before measurement [1000]\n"
+        "    --fanout=N                      subdirectories per level [10]\n"
+        "    --depth=N                       directory levels [1]\n"
+        "    --size=N|uniform:MIN-MAX|loguniform:MIN-MAX\n"
+        "                                    file size distribution (k/m/g suffixes) [64k]\n"
+        "    --iosize=N                      read/write transfer size [64k]\n"
+        "    --seed=N                        random seed [1]\n"
+        "    --report=text|csv|json          report format [text]\n"
+        "    --report-file=PATH              report destination [stdout]\n"
+        "    --root=NAME                     workload directory [fsbench-load]\n";
+}
+
+/*
+ * Workload generator
+ */
+
+typedef struct
+{
+    const LOADGEN_PROFILE *Profile;
+    const LOADGEN_PLATFORM *Platform;
+    unsigned LeafCount;
+    unsigned MixTotal;
+    uint64_t *FileSizes;
+    LOADGEN_STATS *WorkerStats;
+    volatile int Failed;
+} LOADGEN_CONTEXT;
+
+static inline uint64_t LoadgenRandom(uint64_t *State)
+{
+    /* xorshift64* */
+    uint64_t X = *State;
+    X ^= X >> 12;
+    X ^= X << 25;
+    X ^= X >> 27;
+    *State = X;
+    return X * 0x2545f4914f6cdd1dULL;
+}
+
+static inline uint64_t LoadgenRandomRange(uint64_t *State, uint64_t Min, uint64_t Max)
+{
+    return Min + (Max > Min ? LoadgenRandom(State) % (Max - Min + 1) : 0);
+}
+
+static uint64_t LoadgenFileSize(const LOADGEN_PROFILE *Profile, uint64_t *State)
+{
+    switch (Profile->SizeDistribution)
+    {
+    case LoadgenSizeUniform:
+        return LoadgenRandomRange(State, Profile->SizeMin, Profile->SizeMax);
+    case LoadgenSizeLogUniform:
+        {
+            unsigned MinExp = 0, MaxExp = 0;
+            uint64_t Low, High;
+            while ((Profile->SizeMin >> MinExp) > 1)
+                MinExp++;
+            while ((Profile->SizeMax >> MaxExp) > 1)
+                MaxExp++;
+            MinExp = (unsigned)LoadgenRandomRange(State, MinExp, MaxExp);
+            Low = 1ULL << MinExp;
+            High = MinExp < 63 ? (1ULL << (MinExp + 1)) - 1 : ~0ULL;
+            if (Low < Profile->SizeMin)
+                Low = Profile->SizeMin;
+            if (High > Profile->SizeMax)
+                High = Profile->SizeMax;
+            return LoadgenRandomRange(State, Low, High);
+        }
+    default:
+        return Profile->SizeMin;
+    }
+}
+
+static void LoadgenDirPath(LOADGEN_CONTEXT *Context, unsigned Leaf, unsigned Depth,
+    char *Buffer, size_t Size)
+{
+    const LOADGEN_PROFILE *Profile = Context->Profile;
+    unsigned Digits[32];
+    size_t Length;
+
+    for (unsigned I = Profile->DirDepth; 0 < I; I--)
+    {
+        Digits[I - 1] = Leaf % Profile->DirFanout;
+        Leaf /= Profile->DirFanout;
+    }
+
+    Length = (size_t)snprintf(Buffer, Size, "%s", Profile->Root);
+    for (unsigned I = 0; Depth > I && Size > Length; I++)
+        Length += (size_t)snprintf(Buffer + Length, Size - Length, "/d%u", Digits[I]);
+}
+
+static void LoadgenFilePath(LOADGEN_CONTEXT *Context, unsigned FileIndex,
+    char *Buffer, size_t Size)
+{
+    size_t Length;
+
+    LoadgenDirPath(Context, FileIndex % Context->LeafCount, Context->Profile->DirDepth,
+        Buffer, Size);
+    Length = strlen(Buffer);
+    snprintf(Buffer + Length, Size - Length, "/f%u", FileIndex);
+}
+
+static void LoadgenCreatePath(LOADGEN_CONTEXT *Context, unsigned Worker, unsigned CreateIndex,
+    char *Buffer, size_t Size)
+{
+    size_t Length;
+
+    /* spread each worker's new files over the leaf directories */
+    LoadgenDirPath(Context, (Worker + CreateIndex) % Context->LeafCount, Context->Profile->DirDepth,
+        Buffer, Size);
+    Length = strlen(Buffer);
+    snprintf(Buffer + Length, Size - Length, "/c%u-%u", Worker, CreateIndex);
+}
+
+static void LoadgenPrepareWorker(void *Context0, unsigned Index)
+{
+    LOADGEN_CONTEXT *Context = Context0;
+    const LOADGEN_PROFILE *Profile = Context->Profile;
+    const LOADGEN_PLATFORM *Platform = Context->Platform;
+    char Path[LOADGEN_PATH_MAX];
+    void *Buffer;
+
+    Buffer = calloc(1, Profile->IoSize);
+    if (0 == Buffer)
+    {
+        Context->Failed = 1;
+        return;
+    }
+
+    for (unsigned I = Index; Profile->FileCount > I; I += Profile->Threads)
+    {
+        LoadgenFilePath(Context, I, Path, sizeof Path);
+        if (0 != Platform->Create(Path, Context->FileSizes[I], Buffer, Profile->IoSize))
+        {
+            Context->Failed = 1;
+            break;
+        }
+    }
+
+    free(Buffer);
+}
+
+static void LoadgenMeasureWorker(void *Context0, unsigned Index)
+{
+    LOADGEN_CONTEXT *Context = Context0;
+    const LOADGEN_PROFILE *Profile = Context->Profile;
+    const LOADGEN_PLATFORM *Platform = Context->Platform;
+    LOADGEN_STATS *Stats = &Context->WorkerStats[Index];
+    uint64_t State = (Profile->Seed + 1) * 0x9e3779b97f4a7c15ULL + Index + 1;
+    char Path[LOADGEN_PATH_MAX];
+    unsigned CreateCount = 0;
+    void *Buffer;
+
+    Buffer = calloc(1, Profile->IoSize);
+    if (0 == Buffer)
+    {
+        Context->Failed = 1;
+        return;
+    }
+
+    for (unsigned I = 0; Profile->OpsPerThread > I; I++)
+    {
+        unsigned Op, Pick = (unsigned)(LoadgenRandom(&State) % Context->MixTotal);
+        unsigned FileIndex = (unsigned)(LoadgenRandom(&State) % Profile->FileCount);
+        uint64_t Bytes = 0, Size, Offset, Start, Stop;
+        int Result;
+
+        for (Op = 0; LoadgenOpCount - 1 > Op && Pick >= Profile->Mix[Op]; Op++)
+            Pick -= Profile->Mix[Op];
+
+        switch (Op)
+        {
+        case LoadgenOpRead:
+            LoadgenFilePath(Context, FileIndex, Path, sizeof Path);
+            Start = Platform->Now();
+            Result = Platform->Read(Path, Buffer, Profile->IoSize, &Bytes);
+            Stop = Platform->Now();
+            break;
+        case LoadgenOpWrite:
+            LoadgenFilePath(Context, FileIndex, Path, sizeof Path);
+            Size = Context->FileSizes[FileIndex];
+            Bytes = Size < Profile->IoSize ? Size : Profile->IoSize;
+            Offset = Size > Bytes ?
+                LoadgenRandomRange(&State, 0, (Size - Bytes) / Profile->IoSize) * Profile->IoSize : 0;
+            Start = Platform->Now();
+            Result = Platform->Write(Path, Offset, Buffer, (unsigned)Bytes);
+            Stop = Platform->Now();
+            break;
+        case LoadgenOpCreate:
+            LoadgenCreatePath(Context, Index, CreateCount++, Path, sizeof Path);
+            Bytes = LoadgenFileSize(Profile, &State);
+            Start = Platform->Now();
+            Result = Platform->Create(Path, Bytes, Buffer, Profile->IoSize);
+            Stop = Platform->Now();
+            break;
+        case LoadgenOpOpen:
+            LoadgenFilePath(Context, FileIndex, Path, sizeof Path);
+            Start = Platform->Now();
+            Result = Platform->Open(Path);
+            Stop = Platform->Now();
+            break;
+        case LoadgenOpStat:
+            LoadgenFilePath(Context, FileIndex, Path, sizeof Path);
+            Start = Platform->Now();
+            Result = Platform->Stat(Path);
+            Stop = Platform->Now();
+            break;
+        case LoadgenOpList:
+        default:
+            LoadgenDirPath(Context, FileIndex % Context->LeafCount, Profile->DirDepth,
+                Path, sizeof Path);
+            Start = Platform->Now();
+            Result = Platform->List(Path, &Bytes);
+            Stop = Platform->Now();
+            Bytes = 0;
+            break;
+        }
+
+        LoadgenHistRecord(&Stats->Op[Op], Stop - Start, 0 == Result, Bytes);
+    }
+
+    /* remove files created during measurement */
+    for (unsigned I = 0; CreateCount > I; I++)
+    {
+        LoadgenCreatePath(Context, Index, I, Path, sizeof Path);
+        Platform->Unlink(Path);
+    }
+
+    free(Buffer);
+}
+
+static void LoadgenCleanupWorker(void *Context0, unsigned Index)
+{
+    LOADGEN_CONTEXT *Context = Context0;
+    const LOADGEN_PROFILE *Profile = Context->Profile;
+    char Path[LOADGEN_PATH_MAX];
+
+    for (unsigned I = Index; Profile->FileCount > I; I += Profile->Threads)
+    {
+        LoadgenFilePath(Context, I, Path, sizeof Path);
+        Context->Platform->Unlink(Path);
+    }
+}
+
+static void LoadgenTree(LOADGEN_CONTEXT *Context, int Create)
+{
+    const LOADGEN_PROFILE *Profile = Context->Profile;
+    char Path[LOADGEN_PATH_MAX];
+    unsigned Count = 1;
+
+    if (Create)
+        Context->Platform->Mkdir(Profile->Root);
+
+    /* level by level on create, deepest level first on remove */
+    for (unsigned Level = 1; Profile->DirDepth >= Level; Level++)
+    {
+        unsigned Depth = Create ? Level : Profile->DirDepth - Level + 1;
+        unsigned Stride = 1;
+
+        for (unsigned I = Depth; Profile->DirDepth > I; I++)
+            Stride *= Profile->DirFanout;
+        Count = Context->LeafCount / Stride;
+
+        for (unsigned I = 0; Count > I; I++)
+        {
+            LoadgenDirPath(Context, I * Stride, Depth, Path, sizeof Path);
+            if (Create)
+                Context->Platform->Mkdir(Path);
+            else
+                Context->Platform->Rmdir(Path);
+        }
+    }
+
+    if (!Create)
+        Context->Platform->Rmdir(Profile->Root);
+}
+
+int LoadgenRun(const LOADGEN_PROFILE *Profile, const LOADGEN_PLATFORM *Platform,
+    LOADGEN_STATS *Stats)
+{
+    LOADGEN_CONTEXT Context;
+    uint64_t State, Start, Stop;
+    int Result = -1;
+
+    memset(Stats, 0, sizeof *Stats);
+
+    if (0 == Profile->Threads || 0 == Profile->FileCount || 0 == Profile->DirFanout ||
+        32 < Profile->DirDepth || 0 == Profile->IoSize)
+        return -1;
+
+    memset(&Context, 0, sizeof Context);
+    Context.Profile = Profile;
+    Context.Platform = Platform;
+    Context.LeafCount = 1;
+    for (unsigned I = 0; Profile->DirDepth > I; I++)
+    {
+        if (Context.LeafCount > 0x10000 / Profile->DirFanout)
+            return -1;
+        Context.LeafCount *= Profile->DirFanout;
+    }
+    for (unsigned I = 0; LoadgenOpCount > I; I++)
+        Context.MixTotal += Profile->Mix[I];
+    if (0 == Context.MixTotal)
+        return -1;
+
+    Context.FileSizes = malloc(Profile->FileCount * sizeof(uint64_t));
+    Context.WorkerStats = calloc(Profile->Threads, sizeof(LOADGEN_STATS));
+    if (0 == Context.FileSizes || 0 == Context.WorkerStats)
+        goto exit;
+
+    State = Profile->Seed * 0x9e3779b97f4a7c15ULL + 1;
+    for (unsigned I = 0; Profile->FileCount > I; I++)
+        Context.FileSizes[I] = LoadgenFileSize(Profile, &State);
+
+    LoadgenTree(&Context, 1);
+    if (0 != Platform->Parallel(Profile->Threads, LoadgenPrepareWorker, &Context) ||
+        Context.Failed)
+        goto cleanup;
+
+    Start = Platform->Now();
+    if (0 != Platform->Parallel(Profile->Threads, LoadgenMeasureWorker, &Context) ||
+        Context.Failed)
+        goto cleanup;
+    Stop = Platform->Now();
+
+    Stats->ElapsedNs = Stop - Start;
+    Stats->Threads = Profile->Threads;
+    for (unsigned I = 0; Profile->Threads > I; I++)
+        for (unsigned Op = 0; LoadgenOpCount > Op; Op++)
+            LoadgenHistMerge(&Stats->Op[Op], &Context.WorkerStats[I].Op[Op]);
+
+    Result = 0;
+
+cleanup:
+    Platform->Parallel(Profile->Threads, LoadgenCleanupWorker, &Context);
+    LoadgenTree(&Context, 0);
+
+exit:
+    free(Context.WorkerStats);
+    free(Context.FileSizes);
+
+    return Result;
+}
+
+/*
+ * Report
+ */
+
+void LoadgenReport(const LOADGEN_PROFILE *Profile, const LOADGEN_STATS *Stats, FILE *File)
+{
+    double Seconds = (double)Stats->ElapsedNs / 1e9;
+    uint64_t Total = 0;
+    int First = 1;
+
+    for (unsigned Op = 0; LoadgenOpCount > Op; Op++)
+        Total += Stats->Op[Op].Count;
+
+    switch (Profile->ReportFormat)
+    {
+    case LoadgenReportCsv:
+        fprintf(File, "op,threads,count,errors,bytes,ops_per_sec,mean_ns,min_ns,p50_ns,p99_ns,p999_ns,max_ns\n");
+        break;
+    case LoadgenReportJson:
+        fprintf(File,
+            "{\"threads\":%u,\"elapsed_ns\":%llu,\"ops_per_sec\":%.1f,\"ops\":[",
+            Stats->Threads, (unsigned long long)Stats->ElapsedNs,
+            0 < Seconds ? (double)Total / Seconds : 0.0);
+        break;
+    default:
+        fprintf(File, "%-8s %10s %8s %12s %10s %10s %10s %10s %10s\n",
+            "op", "count", "errors", "ops/s", "mean(us)", "p50(us)", "p99(us)", "p999(us)", "max(us)");
+        break;
+    }
+
+    for (unsigned Op = 0; LoadgenOpCount > Op; Op++)
+    {
+        const LOADGEN_HIST *Hist = &Stats->Op[Op];
+        double OpsPerSec = 0 < Seconds ? (double)Hist->Count / Seconds : 0.0;
+        uint64_t Mean = 0 != Hist->Count ? Hist->Sum / Hist->Count : 0;
+        uint64_t P50 = LoadgenHistPercentile(Hist, 50.0);
+        uint64_t P99 = LoadgenHistPercentile(Hist, 99.0);
+        uint64_t P999 = LoadgenHistPercentile(Hist, 99.9);
+
+        if (0 == Hist->Count && 0 == Hist->Errors)
+            continue;
+
+        switch (Profile->ReportFormat)
+        {
+        case LoadgenReportCsv:
+            fprintf(File, "%s,%u,%llu,%llu,%llu,%.1f,%llu,%llu,%llu,%llu,%llu,%llu\n",
+                LoadgenOpNames[Op], Stats->Threads,
+                (unsigned long long)Hist->Count, (unsigned long long)Hist->Errors,
+                (unsigned long long)Hist->Bytes, OpsPerSec,
+                (unsigned long long)Mean, (unsigned long long)Hist->Min,
+                (unsigned long long)P50, (unsigned long long)P99, (unsigned long long)P999,
+                (unsigned long long)Hist->Max);
+            break;
+        case LoadgenReportJson:
+            fprintf(File,
+                "%s{\"op\":\"%s\",\"count\":%llu,\"errors\":%llu,\"bytes\":%llu,"
+                "\"ops_per_sec\":%.1f,\"mean_ns\":%llu,\"min_ns\":%llu,"
+                "\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}",
+                First ? "" : ",", LoadgenOpNames[Op],
+                (unsigned long long)Hist->Count, (unsigned long long)Hist->Errors,
+                (unsigned long long)Hist->Bytes, OpsPerSec,
+                (unsigned long long)Mean, (unsigned long long)Hist->Min,
+                (unsigned long long)P50, (unsigned long long)P99, (unsigned long long)P999,
+                (unsigned long long)Hist->Max);
+            break;
+        default:
+            fprintf(File, "%-8s %10llu %8llu %12.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                LoadgenOpNames[Op],
+                (unsigned long long)Hist->Count, (unsigned long long)Hist->Errors, OpsPerSec,
+                (double)Mean / 1e3, (double)P50 / 1e3, (double)P99 / 1e3, (double)P999 / 1e3,
+                (double)Hist->Max / 1e3);
+            break;
+        }
+        First = 0;
+    }
+
+    switch (Profile->ReportFormat)
+    {
+    case LoadgenReportCsv:
+        break;
+    case LoadgenReportJson:
+        fprintf(File, "]}\n");
+        break;
+    default:
+        fprintf(File, "threads=%u elapsed=%.3fs total=%.1f ops/s\n",
+            Stats->Threads, Seconds, 0 < Seconds ? (double)Total / Seconds : 0.0);
+        break;
+    }
+}
@@ -0,0 +1,155 @@
+/**
+ * @file loadgen.h
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+/*
+ * Portable multi-threaded load generator and latency statistics.
+ *
+ * This module contains no platform specific code. The workload generator
+ * decides which operation each worker performs next and on which file; the
+ * platform driver (fsbench.c on Windows, fsbench-posix.c on POSIX systems)
+ * supplies threads, a clock and the file operations themselves. This allows
+ * the same profile to be run against a WinFsp file system and against a
+ * local directory for baselining.
+ */
+
+#ifndef LOADGEN_H_INCLUDED
+#define LOADGEN_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum
+{
+    LoadgenOpRead = 0,
+    LoadgenOpWrite,
+    LoadgenOpCreate,
+    LoadgenOpOpen,
+    LoadgenOpStat,
+    LoadgenOpList,
+    LoadgenOpCount,
+};
+
+enum
+{
+    LoadgenSizeFixed = 0,               /* always SizeMin */
+    LoadgenSizeUniform,                 /* uniform in [SizeMin, SizeMax] */
+    LoadgenSizeLogUniform,              /* uniform exponent; many small, few large files */
+};
+
+enum
+{
+    LoadgenReportText = 0,
+    LoadgenReportCsv,
+    LoadgenReportJson,
+};
+
+typedef struct
+{
+    unsigned Threads;                   /* number of worker threads */
+    unsigned OpsPerThread;              /* measured operations per worker */
+    unsigned Mix[LoadgenOpCount];       /* relative operation weights */
+    unsigned FileCount;                 /* files created before measurement */
+    unsigned DirFanout;                 /* subdirectories per directory level */
+    unsigned DirDepth;                  /* directory levels below the root */
+    unsigned SizeDistribution;
+    uint64_t SizeMin, SizeMax;
+    unsigned IoSize;                    /* read/write transfer size */
+    uint64_t Seed;
+    unsigned ReportFormat;
+    const char *ReportPath;             /* 0 for stdout */
+    const char *Root;                   /* workload root directory name */
+} LOADGEN_PROFILE;
+
+/*
+ * Latency histogram
+ *
+ * Log-linear buckets over nanoseconds: values below 2^LOADGEN_HIST_SUBBITS are
+ * recorded exactly, larger values are kept with a relative error of at most
+ * 2^-LOADGEN_HIST_SUBBITS (about 3%).
+ */
+#define LOADGEN_HIST_SUBBITS            5
+#define LOADGEN_HIST_BUCKETS            ((64 - LOADGEN_HIST_SUBBITS + 1) << LOADGEN_HIST_SUBBITS)
+
+typedef struct
+{
+    uint64_t Count, Errors, Bytes;
+    uint64_t Sum, Min, Max;
+    uint64_t Buckets[LOADGEN_HIST_BUCKETS];
+} LOADGEN_HIST;
+
+typedef struct
+{
+    LOADGEN_HIST Op[LoadgenOpCount];
+    uint64_t ElapsedNs;
+    unsigned Threads;
+} LOADGEN_STATS;
+
+void LoadgenHistRecord(LOADGEN_HIST *Hist, uint64_t Ns, int Success, uint64_t Bytes);
+void LoadgenHistMerge(LOADGEN_HIST *Dst, const LOADGEN_HIST *Src);
+uint64_t LoadgenHistPercentile(const LOADGEN_HIST *Hist, double Percentile);
+
+/*
+ * Platform driver
+ *
+ * All file operations return 0 on success and nonzero on failure. Paths are
+ * relative to the current directory and use '/' as the separator; drivers that
+ * require a different separator must translate. Buffer is a per-worker buffer
+ * of IoSize bytes.
+ */
+typedef struct
+{
+    uint64_t (*Now)(void);              /* monotonic nanoseconds */
+    int (*Parallel)(unsigned Threads, void (*Worker)(void *Context, unsigned Index), void *Context);
+    int (*Mkdir)(const char *Path);
+    int (*Rmdir)(const char *Path);
+    int (*Unlink)(const char *Path);
+    int (*Create)(const char *Path, uint64_t Size, void *Buffer, unsigned IoSize);
+    int (*Read)(const char *Path, void *Buffer, unsigned IoSize, uint64_t *PBytes);
+    int (*Write)(const char *Path, uint64_t Offset, void *Buffer, unsigned Length);
+    int (*Open)(const char *Path);
+    int (*Stat)(const char *Path);
+    int (*List)(const char *Path, uint64_t *PCount);
+} LOADGEN_PLATFORM;
+
+void LoadgenProfileInit(LOADGEN_PROFILE *Profile);
+int LoadgenProfileOption(LOADGEN_PROFILE *Profile, const char *Arg);
+const char *LoadgenProfileUsage(void);
+
+/*
+ * Run a profile: build the directory tree and initial files, run the measured
+ * phase on Profile->Threads workers, then remove everything. Returns 0 on
+ * success; Stats is valid even if some individual operations failed (they are
+ * counted as errors).
+ */
+int LoadgenRun(const LOADGEN_PROFILE *Profile, const LOADGEN_PLATFORM *Platform,
+    LOADGEN_STATS *Stats);
+void LoadgenReport(const LOADGEN_PROFILE *Profile, const LOADGEN_STATS *Stats, FILE *File);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -43,10 +43,13 @@ NTSTATUS SvcStart(FSP_SERVICE *Service, ULONG argc, PWSTR *argv)
     wchar_t **argp, **arge;
     ULONG DebugFlags = 0;
     PWSTR DebugLogFile = 0;
+    PWSTR TraceFile = 0;
+    ULONG TraceFlags = 0;
     ULONG Flags = MemfsDisk;
     ULONG OtherFlags = 0;
     ULONG FileInfoTimeout = INFINITE;
     ULONG MaxFileNodes = 1024;
+    ULONG MaxNodeMemory = 0;        /* -N: node memory limit in MB; replaces -n */
     ULONG MaxFileSize = 16 * 1024 * 1024;
     ULONG SlowioMaxDelay = 0;       /* -M: maximum slow IO delay in millis */
     ULONG SlowioPercentDelay = 0;   /* -P: percent of slow IO to make pending */
@@ -56,6 +59,7 @@ NTSTATUS SvcStart(FSP_SERVICE *Service, ULONG argc, PWSTR *argv)
     PWSTR VolumePrefix = 0;
     PWSTR RootSddl = 0;
     HANDLE DebugLogHandle = INVALID_HANDLE_VALUE;
+    HANDLE TraceHandle = INVALID_HANDLE_VALUE;
     MEMFS *Memfs = 0;
     NTSTATUS Result;
 
@@ -82,6 +86,9 @@ NTSTATUS SvcStart(FSP_SERVICE *Service, ULONG argc, PWSTR *argv)
         case L'i':
             OtherFlags = MemfsCaseInsensitive;
             break;
+        case L'L':
+            TraceFlags = FspDebugLogTraceNoDrop;
+            break;
         case L'm':
             argtos(MountPoint);
             break;
@@ -91,6 +98,9 @@ NTSTATUS SvcStart(FSP_SERVICE *Service, ULONG argc, PWSTR *argv)
         case L'n':
             argtol(MaxFileNodes);
             break;
+        case L'N':
+            argtol(MaxNodeMemory);
+            break;
         case L'P':
             argtol(SlowioPercentDelay);
             break;
@@ -106,6 +116,9 @@ NTSTATUS SvcStart(FSP_SERVICE *Service, ULONG argc, PWSTR *argv)
         case L't':
             argtol(FileInfoTimeout);
             break;
+        case L'T':
+            argtos(TraceFile);
+            break;
         case L'u':
             argtos(VolumePrefix);
             if (0 != VolumePrefix && L'\0' != VolumePrefix[0])
@@ -144,6 +157,31 @@ NTSTATUS SvcStart(FSP_SERVICE *Service, ULONG argc, PWSTR *argv)
         FspDebugLogSetHandle(DebugLogHandle);
     }
 
+    if (0 != TraceFile)
+    {
+        TraceHandle = CreateFileW(
+            TraceFile,
+            FILE_WRITE_DATA,
+            FILE_SHARE_READ,
+            0,
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL,
+            0);
+        if (INVALID_HANDLE_VALUE == TraceHandle)
+        {
+            fail(L"cannot open trace file");
+            goto usage;
+        }
+
+        Result = FspDebugLogStartTraceEx(TraceHandle, TraceFlags);
+        if (!NT_SUCCESS(Result))
+        {
+            CloseHandle(TraceHandle);
+            fail(L"cannot start trace");
+            goto exit;
+        }
+    }
+
     Result = MemfsCreateFunnel(
         Flags | OtherFlags,
         FileInfoTimeout,
@@ -162,6 +200,9 @@ NTSTATUS SvcStart(FSP_SERVICE *Service, ULONG argc, PWSTR *argv)
         goto exit;
     }
 
+    if (0 != MaxNodeMemory)
+        MemfsSetMaxNodeMemory(Memfs, MaxNodeMemory * 1024ULL * 1024ULL);
+
     FspFileSystemSetDebugLog(MemfsFileSystem(Memfs), DebugFlags);
 
     if (0 != MountPoint && L'\0' != MountPoint[0])
@@ -207,10 +248,13 @@ usage:
         "options:\n"
         "    -d DebugFlags       [-1: enable all debug logs]\n"
         "    -D DebugLogFile     [file path; use - for stderr]\n"
+        "    -T TraceFile        [binary trace of requests; decode with fsptool]\n"
+        "    -L                  [lossless trace: never drop records; use for replay]\n"
         "    -i                  [case insensitive file system]\n"
         "    -f                  [flush and purge cache on cleanup]\n"
         "    -t FileInfoTimeout  [millis]\n"
         "    -n MaxFileNodes\n"
+        "    -N MaxNodeMemory    [MB; limit file nodes by memory instead of count]\n"
         "    -s MaxFileSize      [bytes]\n"
         "    -M MaxDelay         [maximum slow IO delay in millis]\n"
         "    -P PercentDelay     [percent of slow IO to make pending]\n"
@@ -218,9 +262,13 @@ usage:
         "    -F FileSystemName\n"
         "    -S RootSddl         [file rights: FA, etc; NO generic rights: GA, etc.]\n"
         "    -u \\Server\\Share    [UNC prefix (single backslash)]\n"
-        "    -m MountPoint       [X:|* (required if no UNC prefix)]\n";
+        "    -m MountPoint       [X:|* (required if no UNC prefix)]\n"
+        "\n"
+        "usage: %s -r TraceFile [-i] [-n MaxFileNodes] [-s MaxFileSize] [-w]\n"
+        "    replay a trace against a detached MEMFS (no driver involved);\n"
+        "    -w honors the time between recorded requests\n";
 
-    fail(usage, L"" PROGNAME);
+    fail(usage, L"" PROGNAME, L"" PROGNAME);
 
     return STATUS_UNSUCCESSFUL;
 }
@@ -232,10 +280,111 @@ NTSTATUS SvcStop(FSP_SERVICE *Service)
     MemfsStop(Memfs);
     MemfsDelete(Memfs);
 
+    FspDebugLogStopTrace();
+
     return STATUS_SUCCESS;
 }
 
+static int Replay(int argc, wchar_t **argv)
+{
+    wchar_t **argp, **arge;
+    PWSTR TraceFile = 0;
+    ULONG Flags = MemfsDisk | MemfsDetached;
+    ULONG ReplayFlags = 0;
+    ULONG MaxFileNodes = 1024;
+    ULONG MaxFileSize = 16 * 1024 * 1024;
+    HANDLE TraceHandle = INVALID_HANDLE_VALUE;
+    MEMFS *Memfs = 0;
+    FSP_FILE_SYSTEM_REPLAY_STATISTICS Statistics;
+    NTSTATUS Result;
+
+    for (argp = argv + 1, arge = argv + argc; arge > argp; argp++)
+    {
+        if (L'-' != argp[0][0])
+            break;
+        switch (argp[0][1])
+        {
+        case L'i':
+            Flags |= MemfsCaseInsensitive;
+            break;
+        case L'n':
+            argtol(MaxFileNodes);
+            break;
+        case L'r':
+            argtos(TraceFile);
+            break;
+        case L's':
+            argtol(MaxFileSize);
+            break;
+        case L'w':
+            ReplayFlags |= FspFileSystemReplayTimed;
+            break;
+        default:
+            goto usage;
+        }
+    }
+
+    if (arge > argp || 0 == TraceFile)
+        goto usage;
+
+    TraceHandle = CreateFileW(
+        TraceFile,
+        FILE_READ_DATA,
+        FILE_SHARE_READ,
+        0,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        0);
+    if (INVALID_HANDLE_VALUE == TraceHandle)
+    {
+        fail(L"cannot open trace file");
+        return 2;
+    }
+
+    Result = MemfsCreate(
+        Flags,
+        INFINITE,
+        MaxFileNodes,
+        MaxFileSize,
+        0,
+        0,
+        &Memfs);
+    if (!NT_SUCCESS(Result))
+    {
+        fail(L"cannot create MEMFS");
+        goto exit;
+    }
+
+    Result = FspFileSystemReplayTrace(MemfsFileSystem(Memfs), TraceHandle, ReplayFlags,
+        &Statistics);
+    if (!NT_SUCCESS(Result))
+    {
+        fail(L"cannot replay trace (Status=%lx)", Result);
+        goto exit;
+    }
+
+    info(L"requests=%llu skipped=%llu mismatched=%llu pending=%llu dropped=%llu",
+        Statistics.RequestCount, Statistics.SkippedCount, Statistics.MismatchCount,
+        Statistics.PendingCount, Statistics.DroppedCount);
+
+exit:
+    if (0 != Memfs)
+        MemfsDelete(Memfs);
+    CloseHandle(TraceHandle);
+
+    return NT_SUCCESS(Result) ? 0 : 1;
+
+usage:
+    fail(L"usage: %s -r TraceFile [-i] [-n MaxFileNodes] [-s MaxFileSize] [-w]",
+        L"" PROGNAME);
+
+    return 2;
+}
+
 int wmain(int argc, wchar_t **argv)
 {
+    if (1 < argc && 0 == wcscmp(L"-r", argv[1]))
+        return Replay(argc, argv);
+
     return FspServiceRun(L"" PROGNAME, SvcStart, SvcStop, 0);
 }
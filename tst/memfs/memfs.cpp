@@ -45,6 +45,11 @@ FSP_FSCTL_STATIC_ASSERT(MEMFS_MAX_PATH > MAX_PATH,
  */
 #define MEMFS_DISPATCHER_STOPPED
 
+/*
+ * Define the MEMFS_OPEN_WITH_SECURITY macro to include OpenWithSecurity support.
+ */
+#define MEMFS_OPEN_WITH_SECURITY
+
 /*
  * Define the MEMFS_NAME_NORMALIZATION macro to include name normalization support.
  */
@@ -187,51 +192,6 @@ UINT64 MemfsGetSystemTime(VOID)
     return ((PLARGE_INTEGER)&FileTime)->QuadPart;
 }
 
-static inline
-unsigned MemfsUpperChar(unsigned c)
-{
-    /*
-     * Bit-twiddling upper case char:
-     *
-     * - Let signbit(x) = x & 0x100 (treat bit 0x100 as "signbit").
-     * - 'A' <= c && c <= 'Z' <=> s = signbit(c - 'A') ^ signbit(c - ('Z' + 1)) == 1
-     *     - c >= 'A' <=> c - 'A' >= 0      <=> signbit(c - 'A') = 0
-     *     - c <= 'Z' <=> c - ('Z' + 1) < 0 <=> signbit(c - ('Z' + 1)) = 1
-     * - Bit 0x20 = 0x100 >> 3 toggles uppercase to lowercase and vice-versa.
-     *
-     * This is actually faster than `(c - 'a' <= 'z' - 'a') ? (c & ~0x20) : c`, even
-     * when compiled using cmov conditional moves at least on this system (i7-1065G7).
-     *
-     * See https://godbolt.org/z/ebv131Wrh
-     */
-    unsigned s = ((c - 'a') ^ (c - ('z' + 1))) & 0x100;
-    return c & ~(s >> 3);
-}
-
-static inline
-int MemfsWcsnicmp(const wchar_t *s0, const wchar_t *t0, int n)
-{
-    /* Use fast loop for ASCII and fall back to CompareStringW for general case. */
-    const wchar_t *s = s0;
-    const wchar_t *t = t0;
-    int v = 0;
-    for (const void *e = t + n; e > (const void *)t; ++s, ++t)
-    {
-        unsigned sc = *s, tc = *t;
-        if (0xffffff80 & (sc | tc))
-        {
-            v = CompareStringW(LOCALE_INVARIANT, NORM_IGNORECASE, s0, n, t0, n);
-            if (0 != v)
-                return v - 2;
-            else
-                return _wcsnicmp(s, t, n);
-        }
-        if (0 != (v = MemfsUpperChar(sc) - MemfsUpperChar(tc)) || !tc)
-            break;
-    }
-    return v;/*(0 < v) - (0 > v);*/
-}
-
 static inline
 int MemfsFileNameCompare(PWSTR a, int alen, PWSTR b, int blen, BOOLEAN CaseInsensitive)
 {
@@ -276,7 +236,7 @@ int MemfsFileNameCompare(PWSTR a, int alen, PWSTR b, int blen, BOOLEAN CaseInsen
         len = plen < qlen ? plen : qlen;
 
         if (CaseInsensitive)
-            res = MemfsWcsnicmp(partp, partq, len);
+            res = FspUpcaseCompare(partp, len, partq, len);
         else
             res = wcsncmp(partp, partq, len);
 
@@ -335,12 +295,309 @@ struct MEMFS_FILE_NODE_EA_LESS
 typedef std::map<PSTR, FILE_FULL_EA_INFORMATION *, MEMFS_FILE_NODE_EA_LESS> MEMFS_FILE_NODE_EA_MAP;
 #endif
 
+/*
+ * Security descriptor store
+ *
+ * Nearly all files in a file system have one of a handful of (inherited) security
+ * descriptors. Rather than keep a private copy per file node, security descriptors
+ * are interned in a process-wide store keyed by content and shared by reference count.
+ */
+
+typedef struct _MEMFS_SECURITY
+{
+    UINT64 Hash;
+    LONG RefCount;
+    ULONG Size;
+    FSP_FSCTL_DECLSPEC_ALIGN UINT8 Data[];
+} MEMFS_SECURITY;
+typedef std::unordered_multimap<UINT64, MEMFS_SECURITY *> MEMFS_SECURITY_MAP;
+
+static SRWLOCK MemfsSecurityLock = SRWLOCK_INIT;
+static MEMFS_SECURITY_MAP *MemfsSecurityMap;
+
+static inline
+UINT64 MemfsSecurityHash(PVOID Data, ULONG Size)
+{
+    /* FNV-1a */
+    UINT64 Hash = 0xcbf29ce484222325ULL;
+    for (PUINT8 P = (PUINT8)Data, EndP = P + Size; EndP > P; P++)
+        Hash = (Hash ^ *P) * 0x100000001b3ULL;
+    return Hash;
+}
+
+static inline
+NTSTATUS MemfsSecurityIntern(PSECURITY_DESCRIPTOR SecurityDescriptor, MEMFS_SECURITY **PSecurity)
+{
+    ULONG Size = GetSecurityDescriptorLength(SecurityDescriptor);
+    UINT64 Hash = MemfsSecurityHash(SecurityDescriptor, Size);
+    MEMFS_SECURITY *Security = 0;
+
+    *PSecurity = 0;
+
+    AcquireSRWLockExclusive(&MemfsSecurityLock);
+
+    try
+    {
+        if (0 == MemfsSecurityMap)
+            MemfsSecurityMap = new MEMFS_SECURITY_MAP;
+
+        std::pair<MEMFS_SECURITY_MAP::iterator, MEMFS_SECURITY_MAP::iterator> Range =
+            MemfsSecurityMap->equal_range(Hash);
+        for (MEMFS_SECURITY_MAP::iterator p = Range.first; Range.second != p; ++p)
+            if (p->second->Size == Size && 0 == memcmp(p->second->Data, SecurityDescriptor, Size))
+            {
+                Security = p->second;
+                Security->RefCount++;
+                break;
+            }
+
+        if (0 == Security)
+        {
+            Security = (MEMFS_SECURITY *)malloc(sizeof *Security + Size);
+            if (0 == Security)
+            {
+                ReleaseSRWLockExclusive(&MemfsSecurityLock);
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            Security->Hash = Hash;
+            Security->RefCount = 1;
+            Security->Size = Size;
+            memcpy(Security->Data, SecurityDescriptor, Size);
+
+            MemfsSecurityMap->insert(MEMFS_SECURITY_MAP::value_type(Hash, Security));
+        }
+    }
+    catch (...)
+    {
+        ReleaseSRWLockExclusive(&MemfsSecurityLock);
+        free(Security);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    ReleaseSRWLockExclusive(&MemfsSecurityLock);
+
+    *PSecurity = Security;
+
+    return STATUS_SUCCESS;
+}
+
+static inline
+VOID MemfsSecurityRelease(MEMFS_SECURITY *Security)
+{
+    if (0 == Security)
+        return;
+
+    AcquireSRWLockExclusive(&MemfsSecurityLock);
+
+    if (0 == --Security->RefCount)
+    {
+        std::pair<MEMFS_SECURITY_MAP::iterator, MEMFS_SECURITY_MAP::iterator> Range =
+            MemfsSecurityMap->equal_range(Security->Hash);
+        for (MEMFS_SECURITY_MAP::iterator p = Range.first; Range.second != p; ++p)
+            if (p->second == Security)
+            {
+                MemfsSecurityMap->erase(p);
+                break;
+            }
+        free(Security);
+    }
+
+    ReleaseSRWLockExclusive(&MemfsSecurityLock);
+}
+
+static inline
+NTSTATUS MemfsSecurityCopy(MEMFS_SECURITY *Security,
+    PSECURITY_DESCRIPTOR SecurityDescriptor, SIZE_T *PSecurityDescriptorSize)
+{
+    ULONG Size = 0 != Security ? Security->Size : 0;
+
+    if (Size > *PSecurityDescriptorSize)
+    {
+        *PSecurityDescriptorSize = Size;
+        return STATUS_BUFFER_OVERFLOW;
+    }
+
+    *PSecurityDescriptorSize = Size;
+    if (0 != SecurityDescriptor && 0 != Size)
+        memcpy(SecurityDescriptor, Security->Data, Size);
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Node Arena
+ *
+ * File nodes and their names are carved out of aligned slabs owned by the file
+ * system instead of being individual heap allocations. Slabs are allocated with
+ * VirtualAlloc, whose allocations are aligned to the 64KB allocation granularity;
+ * a slab is exactly one such allocation, so no memory is lost to alignment. All nodes have the
+ * same size; names are rounded up to a multiple of MEMFS_ARENA_NAME_QUANTUM
+ * characters and recycled through per-size free lists. Every slab begins with
+ * a pointer to its arena, which lets a node be freed without a file system
+ * reference (see MemfsFileNodeDereference).
+ */
+
+#define MEMFS_ARENA_SLAB_SIZE           (64 * 1024)
+#define MEMFS_ARENA_ALIGNMENT           16
+#define MEMFS_ARENA_NAME_QUANTUM        8
+#define MEMFS_ARENA_NAME_CLASSES        (MEMFS_MAX_PATH / MEMFS_ARENA_NAME_QUANTUM)
+#define MEMFS_ARENA_ALIGN(x)            (((x) + MEMFS_ARENA_ALIGNMENT - 1) & ~(MEMFS_ARENA_ALIGNMENT - 1))
+FSP_FSCTL_STATIC_ASSERT(0 == MEMFS_MAX_PATH % MEMFS_ARENA_NAME_QUANTUM,
+    "MEMFS_MAX_PATH must be a multiple of MEMFS_ARENA_NAME_QUANTUM.");
+FSP_FSCTL_STATIC_ASSERT(0 == MEMFS_ARENA_NAME_QUANTUM * sizeof(WCHAR) % MEMFS_ARENA_ALIGNMENT,
+    "MEMFS_ARENA_NAME_QUANTUM must preserve MEMFS_ARENA_ALIGNMENT.");
+
+typedef struct _MEMFS_ARENA_FREE_ENTRY
+{
+    struct _MEMFS_ARENA_FREE_ENTRY *Next;
+} MEMFS_ARENA_FREE_ENTRY;
+
+typedef struct _MEMFS_ARENA_SLAB
+{
+    struct _MEMFS_ARENA *Arena;
+    struct _MEMFS_ARENA_SLAB *Next;
+} MEMFS_ARENA_SLAB;
+
+typedef struct _MEMFS_ARENA
+{
+    SRWLOCK Lock;
+    MEMFS_ARENA_SLAB *SlabList;
+    PUINT8 SlabNext, SlabEnd;
+    MEMFS_ARENA_FREE_ENTRY *NodeFreeList;
+    MEMFS_ARENA_FREE_ENTRY *NameFreeList[MEMFS_ARENA_NAME_CLASSES];
+    UINT64 SlabBytes;                   /* memory committed for slabs */
+    UINT64 UsedBytes;                   /* memory in live nodes and names */
+    UINT64 MaxBytes;                    /* 0 means no limit */
+} MEMFS_ARENA;
+
+static inline
+VOID MemfsArenaInitialize(MEMFS_ARENA *Arena)
+{
+    memset(Arena, 0, sizeof *Arena);
+    InitializeSRWLock(&Arena->Lock);
+}
+
+static inline
+VOID MemfsArenaFinalize(MEMFS_ARENA *Arena)
+{
+    for (MEMFS_ARENA_SLAB *Slab = Arena->SlabList, *NextSlab; 0 != Slab; Slab = NextSlab)
+    {
+        NextSlab = Slab->Next;
+        VirtualFree(Slab, 0, MEM_RELEASE);
+    }
+
+    memset(Arena, 0, sizeof *Arena);
+}
+
+static inline
+MEMFS_ARENA *MemfsArenaFromPointer(PVOID Pointer)
+{
+    return ((MEMFS_ARENA_SLAB *)((UINT_PTR)Pointer & ~(UINT_PTR)(MEMFS_ARENA_SLAB_SIZE - 1)))->Arena;
+}
+
+static NTSTATUS MemfsArenaAllocate(MEMFS_ARENA *Arena,
+    MEMFS_ARENA_FREE_ENTRY **PFreeList, SIZE_T Size, PVOID *PPointer)
+{
+    MEMFS_ARENA_SLAB *Slab;
+    PVOID Pointer;
+    NTSTATUS Result;
+
+    *PPointer = 0;
+
+    AcquireSRWLockExclusive(&Arena->Lock);
+
+    if (0 != Arena->MaxBytes && Arena->UsedBytes + Size > Arena->MaxBytes)
+    {
+        Result = STATUS_CANNOT_MAKE;
+        goto exit;
+    }
+
+    if (0 != *PFreeList)
+    {
+        Pointer = *PFreeList;
+        *PFreeList = (*PFreeList)->Next;
+    }
+    else
+    {
+        if ((SIZE_T)(Arena->SlabEnd - Arena->SlabNext) < Size)
+        {
+            /* the unused tail of the current slab (if any) is abandoned */
+            Slab = (MEMFS_ARENA_SLAB *)VirtualAlloc(0, MEMFS_ARENA_SLAB_SIZE,
+                MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            if (0 == Slab)
+            {
+                Result = STATUS_INSUFFICIENT_RESOURCES;
+                goto exit;
+            }
+            assert(0 == ((UINT_PTR)Slab & (MEMFS_ARENA_SLAB_SIZE - 1)));
+
+            Slab->Arena = Arena;
+            Slab->Next = Arena->SlabList;
+            Arena->SlabList = Slab;
+            Arena->SlabNext = (PUINT8)Slab + MEMFS_ARENA_ALIGN(sizeof *Slab);
+            Arena->SlabEnd = (PUINT8)Slab + MEMFS_ARENA_SLAB_SIZE;
+            Arena->SlabBytes += MEMFS_ARENA_SLAB_SIZE;
+        }
+
+        Pointer = Arena->SlabNext;
+        Arena->SlabNext += Size;
+    }
+
+    Arena->UsedBytes += Size;
+    *PPointer = Pointer;
+
+    Result = STATUS_SUCCESS;
+
+exit:
+    ReleaseSRWLockExclusive(&Arena->Lock);
+
+    return Result;
+}
+
+static VOID MemfsArenaFree(MEMFS_ARENA *Arena,
+    MEMFS_ARENA_FREE_ENTRY **PFreeList, SIZE_T Size, PVOID Pointer)
+{
+    MEMFS_ARENA_FREE_ENTRY *Entry = (MEMFS_ARENA_FREE_ENTRY *)Pointer;
+
+    AcquireSRWLockExclusive(&Arena->Lock);
+
+    Entry->Next = *PFreeList;
+    *PFreeList = Entry;
+    Arena->UsedBytes -= Size;
+
+    ReleaseSRWLockExclusive(&Arena->Lock);
+}
+
+static inline
+ULONG MemfsArenaNameClass(SIZE_T Length)
+{
+    /* Length includes the terminating NUL */
+    assert(0 < Length && MEMFS_MAX_PATH >= Length);
+    return (ULONG)((Length + MEMFS_ARENA_NAME_QUANTUM - 1) / MEMFS_ARENA_NAME_QUANTUM - 1);
+}
+
+static inline
+NTSTATUS MemfsArenaNameAllocate(MEMFS_ARENA *Arena, SIZE_T Length, PWSTR *PName)
+{
+    ULONG Class = MemfsArenaNameClass(Length);
+    return MemfsArenaAllocate(Arena, &Arena->NameFreeList[Class],
+        (Class + 1) * MEMFS_ARENA_NAME_QUANTUM * sizeof(WCHAR), (PVOID *)PName);
+}
+
+static inline
+VOID MemfsArenaNameFree(MEMFS_ARENA *Arena, PWSTR Name)
+{
+    ULONG Class = MemfsArenaNameClass(wcslen(Name) + 1);
+    MemfsArenaFree(Arena, &Arena->NameFreeList[Class],
+        (Class + 1) * MEMFS_ARENA_NAME_QUANTUM * sizeof(WCHAR), Name);
+}
+
 typedef struct _MEMFS_FILE_NODE
 {
-    WCHAR FileName[MEMFS_MAX_PATH];
     FSP_FSCTL_FILE_INFO FileInfo;
-    SIZE_T FileSecuritySize;
-    PVOID FileSecurity;
+    PWSTR FileName;                     /* allocated from the node arena */
+    MEMFS_SECURITY *FileSecurity;
     PVOID FileData;
 #if defined(MEMFS_REPARSE_POINTS)
     SIZE_T ReparseDataSize;
@@ -372,6 +629,7 @@ typedef struct _MEMFS
 {
     FSP_FILE_SYSTEM *FileSystem;
     MEMFS_FILE_NODE_MAP *FileNodeMap;
+    MEMFS_ARENA Arena;
     ULONG MaxFileNodes;
     ULONG MaxFileSize;
 #ifdef MEMFS_SLOWIO
@@ -385,19 +643,31 @@ typedef struct _MEMFS
 } MEMFS;
 
 static inline
-NTSTATUS MemfsFileNodeCreate(PWSTR FileName, MEMFS_FILE_NODE **PFileNode)
+NTSTATUS MemfsFileNodeCreate(MEMFS_ARENA *Arena, PWSTR FileName, MEMFS_FILE_NODE **PFileNode)
 {
     static UINT64 IndexNumber = 1;
+    SIZE_T FileNameLength = wcslen(FileName) + 1;
     MEMFS_FILE_NODE *FileNode;
+    PWSTR Name;
+    NTSTATUS Result;
 
     *PFileNode = 0;
 
-    FileNode = (MEMFS_FILE_NODE *)malloc(sizeof *FileNode);
-    if (0 == FileNode)
-        return STATUS_INSUFFICIENT_RESOURCES;
+    Result = MemfsArenaAllocate(Arena, &Arena->NodeFreeList,
+        MEMFS_ARENA_ALIGN(sizeof *FileNode), (PVOID *)&FileNode);
+    if (!NT_SUCCESS(Result))
+        return Result;
+
+    Result = MemfsArenaNameAllocate(Arena, FileNameLength, &Name);
+    if (!NT_SUCCESS(Result))
+    {
+        MemfsArenaFree(Arena, &Arena->NodeFreeList, MEMFS_ARENA_ALIGN(sizeof *FileNode), FileNode);
+        return Result;
+    }
 
     memset(FileNode, 0, sizeof *FileNode);
-    wcscpy_s(FileNode->FileName, sizeof FileNode->FileName / sizeof(WCHAR), FileName);
+    memcpy(Name, FileName, FileNameLength * sizeof(WCHAR));
+    FileNode->FileName = Name;
     FileNode->FileInfo.CreationTime =
     FileNode->FileInfo.LastAccessTime =
     FileNode->FileInfo.LastWriteTime =
@@ -428,6 +698,8 @@ VOID MemfsFileNodeDeleteEaMap(MEMFS_FILE_NODE *FileNode)
 static inline
 VOID MemfsFileNodeDelete(MEMFS_FILE_NODE *FileNode)
 {
+    MEMFS_ARENA *Arena = MemfsArenaFromPointer(FileNode);
+
 #if defined(MEMFS_EA)
     MemfsFileNodeDeleteEaMap(FileNode);
 #endif
@@ -435,8 +707,9 @@ VOID MemfsFileNodeDelete(MEMFS_FILE_NODE *FileNode)
     free(FileNode->ReparseData);
 #endif
     LargeHeapFree(FileNode->FileData);
-    free(FileNode->FileSecurity);
-    free(FileNode);
+    MemfsSecurityRelease(FileNode->FileSecurity);
+    MemfsArenaNameFree(Arena, FileNode->FileName);
+    MemfsArenaFree(Arena, &Arena->NodeFreeList, MEMFS_ARENA_ALIGN(sizeof *FileNode), FileNode);
 }
 
 static inline
@@ -1092,17 +1365,7 @@ static NTSTATUS GetSecurityByName(FSP_FILE_SYSTEM *FileSystem,
 #endif
 
     if (0 != PSecurityDescriptorSize)
-    {
-        if (FileNode->FileSecuritySize > *PSecurityDescriptorSize)
-        {
-            *PSecurityDescriptorSize = FileNode->FileSecuritySize;
-            return STATUS_BUFFER_OVERFLOW;
-        }
-
-        *PSecurityDescriptorSize = FileNode->FileSecuritySize;
-        if (0 != SecurityDescriptor)
-            memcpy(SecurityDescriptor, FileNode->FileSecurity, FileNode->FileSecuritySize);
-    }
+        return MemfsSecurityCopy(FileNode->FileSecurity, SecurityDescriptor, PSecurityDescriptorSize);
 
     return STATUS_SUCCESS;
 }
@@ -1138,7 +1401,8 @@ static NTSTATUS Create(FSP_FILE_SYSTEM *FileSystem,
     if (0 == ParentNode)
         return Result;
 
-    if (MemfsFileNodeMapCount(Memfs->FileNodeMap) >= Memfs->MaxFileNodes)
+    if (0 == Memfs->Arena.MaxBytes &&
+        MemfsFileNodeMapCount(Memfs->FileNodeMap) >= Memfs->MaxFileNodes)
         return STATUS_CANNOT_MAKE;
 
     if (AllocationSize > Memfs->MaxFileSize)
@@ -1169,7 +1433,7 @@ static NTSTATUS Create(FSP_FILE_SYSTEM *FileSystem,
     }
 #endif
 
-    Result = MemfsFileNodeCreate(FileName, &FileNode);
+    Result = MemfsFileNodeCreate(&Memfs->Arena, FileName, &FileNode);
     if (!NT_SUCCESS(Result))
         return Result;
 
@@ -1182,14 +1446,12 @@ static NTSTATUS Create(FSP_FILE_SYSTEM *FileSystem,
 
     if (0 != SecurityDescriptor)
     {
-        FileNode->FileSecuritySize = GetSecurityDescriptorLength(SecurityDescriptor);
-        FileNode->FileSecurity = (PSECURITY_DESCRIPTOR)malloc(FileNode->FileSecuritySize);
-        if (0 == FileNode->FileSecurity)
+        Result = MemfsSecurityIntern(SecurityDescriptor, &FileNode->FileSecurity);
+        if (!NT_SUCCESS(Result))
         {
             MemfsFileNodeDelete(FileNode);
-            return STATUS_INSUFFICIENT_RESOURCES;
+            return Result;
         }
-        memcpy(FileNode->FileSecurity, SecurityDescriptor, FileNode->FileSecuritySize);
     }
 
 #if defined(MEMFS_EA) || defined(MEMFS_WSL)
@@ -1270,25 +1532,11 @@ static NTSTATUS Create(FSP_FILE_SYSTEM *FileSystem,
     return STATUS_SUCCESS;
 }
 
-static NTSTATUS Open(FSP_FILE_SYSTEM *FileSystem,
-    PWSTR FileName, UINT32 CreateOptions, UINT32 GrantedAccess,
+static NTSTATUS OpenFileNode(MEMFS *Memfs, MEMFS_FILE_NODE *FileNode, UINT32 CreateOptions,
     PVOID *PFileNode, FSP_FSCTL_FILE_INFO *FileInfo)
 {
-    MEMFS *Memfs = (MEMFS *)FileSystem->UserContext;
-    MEMFS_FILE_NODE *FileNode;
     NTSTATUS Result;
 
-    if (MEMFS_MAX_PATH <= wcslen(FileName))
-        return STATUS_OBJECT_NAME_INVALID;
-
-    FileNode = MemfsFileNodeMapGet(Memfs->FileNodeMap, FileName);
-    if (0 == FileNode)
-    {
-        Result = STATUS_OBJECT_NAME_NOT_FOUND;
-        MemfsFileNodeMapGetParent(Memfs->FileNodeMap, FileName, &Result);
-        return Result;
-    }
-
 #if defined(MEMFS_EA)
     /* if the OP specified no EA's check the need EA count, but only if accessing main stream */
     if (0 != (CreateOptions & FILE_NO_EA_KNOWLEDGE)
@@ -1323,6 +1571,73 @@ static NTSTATUS Open(FSP_FILE_SYSTEM *FileSystem,
     return STATUS_SUCCESS;
 }
 
+static NTSTATUS Open(FSP_FILE_SYSTEM *FileSystem,
+    PWSTR FileName, UINT32 CreateOptions, UINT32 GrantedAccess,
+    PVOID *PFileNode, FSP_FSCTL_FILE_INFO *FileInfo)
+{
+    MEMFS *Memfs = (MEMFS *)FileSystem->UserContext;
+    MEMFS_FILE_NODE *FileNode;
+    NTSTATUS Result;
+
+    if (MEMFS_MAX_PATH <= wcslen(FileName))
+        return STATUS_OBJECT_NAME_INVALID;
+
+    FileNode = MemfsFileNodeMapGet(Memfs->FileNodeMap, FileName);
+    if (0 == FileNode)
+    {
+        Result = STATUS_OBJECT_NAME_NOT_FOUND;
+        MemfsFileNodeMapGetParent(Memfs->FileNodeMap, FileName, &Result);
+        return Result;
+    }
+
+    return OpenFileNode(Memfs, FileNode, CreateOptions, PFileNode, FileInfo);
+}
+
+#if defined(MEMFS_OPEN_WITH_SECURITY)
+static NTSTATUS OpenWithSecurity(FSP_FILE_SYSTEM *FileSystem,
+    PWSTR FileName, UINT32 CreateOptions, UINT32 DesiredAccess,
+    PVOID *PFileNode, FSP_FSCTL_FILE_INFO *FileInfo,
+    PSECURITY_DESCRIPTOR SecurityDescriptor, SIZE_T *PSecurityDescriptorSize)
+{
+    MEMFS *Memfs = (MEMFS *)FileSystem->UserContext;
+    MEMFS_FILE_NODE *FileNode, *MainFileNode;
+    NTSTATUS Result;
+
+    if (MEMFS_MAX_PATH <= wcslen(FileName))
+        return STATUS_OBJECT_NAME_INVALID;
+
+    FileNode = MemfsFileNodeMapGet(Memfs->FileNodeMap, FileName);
+    if (0 == FileNode)
+    {
+        Result = STATUS_OBJECT_NAME_NOT_FOUND;
+
+#if defined(MEMFS_REPARSE_POINTS)
+        if (FspFileSystemFindReparsePoint(FileSystem, GetReparsePointByName, 0,
+            FileName, 0))
+            Result = STATUS_REPARSE;
+        else
+#endif
+            MemfsFileNodeMapGetParent(Memfs->FileNodeMap, FileName, &Result);
+
+        return Result;
+    }
+
+    MainFileNode = FileNode;
+#if defined(MEMFS_NAMED_STREAMS)
+    if (0 != FileNode->MainFileNode)
+        MainFileNode = FileNode->MainFileNode;
+#endif
+
+    /* copy the security first; on STATUS_BUFFER_OVERFLOW the file must not be opened */
+    Result = MemfsSecurityCopy(MainFileNode->FileSecurity,
+        SecurityDescriptor, PSecurityDescriptorSize);
+    if (!NT_SUCCESS(Result))
+        return Result;
+
+    return OpenFileNode(Memfs, FileNode, CreateOptions, PFileNode, FileInfo);
+}
+#endif
+
 static NTSTATUS Overwrite(FSP_FILE_SYSTEM *FileSystem,
     PVOID FileNode0, UINT32 FileAttributes, BOOLEAN ReplaceFileAttributes, UINT64 AllocationSize,
 #if defined(MEMFS_EA)
@@ -1714,7 +2029,8 @@ static NTSTATUS Rename(FSP_FILE_SYSTEM *FileSystem,
     MEMFS_FILE_NODE *FileNode = (MEMFS_FILE_NODE *)FileNode0;
     MEMFS_FILE_NODE *NewFileNode, *DescendantFileNode;
     MEMFS_FILE_NODE_MAP_ENUM_CONTEXT Context = { TRUE };
-    ULONG Index, FileNameLen, NewFileNameLen;
+    ULONG Index, FileNameLen, NewFileNameLen, DescendantFileNameLen;
+    PWSTR *NewFileNames = 0, OldFileName;
     BOOLEAN Inserted;
     NTSTATUS Result;
 
@@ -1749,6 +2065,26 @@ static NTSTATUS Rename(FSP_FILE_SYSTEM *FileSystem,
         }
     }
 
+    /* allocate all new names up front, so that the rename cannot fail halfway */
+    NewFileNames = (PWSTR *)calloc(Context.Count, sizeof(PWSTR));
+    if (0 == NewFileNames && 0 != Context.Count)
+    {
+        Result = STATUS_INSUFFICIENT_RESOURCES;
+        goto exit;
+    }
+    for (Index = 0; Context.Count > Index; Index++)
+    {
+        DescendantFileNode = Context.FileNodes[Index];
+        DescendantFileNameLen = (ULONG)wcslen(DescendantFileNode->FileName);
+        Result = MemfsArenaNameAllocate(&Memfs->Arena,
+            DescendantFileNameLen - FileNameLen + NewFileNameLen + 1, &NewFileNames[Index]);
+        if (!NT_SUCCESS(Result))
+            goto exit;
+        memcpy(NewFileNames[Index], NewFileName, NewFileNameLen * sizeof(WCHAR));
+        memcpy(NewFileNames[Index] + NewFileNameLen, DescendantFileNode->FileName + FileNameLen,
+            (DescendantFileNameLen + 1 - FileNameLen) * sizeof(WCHAR));
+    }
+
     if (0 != NewFileNode)
     {
         MemfsFileNodeReference(NewFileNode);
@@ -1760,10 +2096,9 @@ static NTSTATUS Rename(FSP_FILE_SYSTEM *FileSystem,
     {
         DescendantFileNode = Context.FileNodes[Index];
         MemfsFileNodeMapRemove(Memfs->FileNodeMap, DescendantFileNode);
-        memmove(DescendantFileNode->FileName + NewFileNameLen,
-            DescendantFileNode->FileName + FileNameLen,
-            (wcslen(DescendantFileNode->FileName) + 1 - FileNameLen) * sizeof(WCHAR));
-        memcpy(DescendantFileNode->FileName, NewFileName, NewFileNameLen * sizeof(WCHAR));
+        OldFileName = DescendantFileNode->FileName;
+        DescendantFileNode->FileName = NewFileNames[Index];
+        NewFileNames[Index] = OldFileName;
         Result = MemfsFileNodeMapInsert(Memfs->FileNodeMap, DescendantFileNode, &Inserted);
         if (!NT_SUCCESS(Result))
         {
@@ -1776,6 +2111,15 @@ static NTSTATUS Rename(FSP_FILE_SYSTEM *FileSystem,
     Result = STATUS_SUCCESS;
 
 exit:
+    /* on success these are the old names; on failure the unused new ones */
+    if (0 != NewFileNames)
+    {
+        for (Index = 0; Context.Count > Index; Index++)
+            if (0 != NewFileNames[Index])
+                MemfsArenaNameFree(&Memfs->Arena, NewFileNames[Index]);
+        free(NewFileNames);
+    }
+
     MemfsFileNodeMapEnumerateFree(&Context);
 
     return Result;
@@ -1792,17 +2136,7 @@ static NTSTATUS GetSecurity(FSP_FILE_SYSTEM *FileSystem,
         FileNode = FileNode->MainFileNode;
 #endif
 
-    if (FileNode->FileSecuritySize > *PSecurityDescriptorSize)
-    {
-        *PSecurityDescriptorSize = FileNode->FileSecuritySize;
-        return STATUS_BUFFER_OVERFLOW;
-    }
-
-    *PSecurityDescriptorSize = FileNode->FileSecuritySize;
-    if (0 != SecurityDescriptor)
-        memcpy(SecurityDescriptor, FileNode->FileSecurity, FileNode->FileSecuritySize);
-
-    return STATUS_SUCCESS;
+    return MemfsSecurityCopy(FileNode->FileSecurity, SecurityDescriptor, PSecurityDescriptorSize);
 }
 
 static NTSTATUS SetSecurity(FSP_FILE_SYSTEM *FileSystem,
@@ -1810,8 +2144,8 @@ static NTSTATUS SetSecurity(FSP_FILE_SYSTEM *FileSystem,
     SECURITY_INFORMATION SecurityInformation, PSECURITY_DESCRIPTOR ModificationDescriptor)
 {
     MEMFS_FILE_NODE *FileNode = (MEMFS_FILE_NODE *)FileNode0;
-    PSECURITY_DESCRIPTOR NewSecurityDescriptor, FileSecurity;
-    SIZE_T FileSecuritySize;
+    PSECURITY_DESCRIPTOR NewSecurityDescriptor;
+    MEMFS_SECURITY *FileSecurity;
     NTSTATUS Result;
 
 #if defined(MEMFS_NAMED_STREAMS)
@@ -1820,25 +2154,19 @@ static NTSTATUS SetSecurity(FSP_FILE_SYSTEM *FileSystem,
 #endif
 
     Result = FspSetSecurityDescriptor(
-        FileNode->FileSecurity,
+        0 != FileNode->FileSecurity ? FileNode->FileSecurity->Data : 0,
         SecurityInformation,
         ModificationDescriptor,
         &NewSecurityDescriptor);
     if (!NT_SUCCESS(Result))
         return Result;
 
-    FileSecuritySize = GetSecurityDescriptorLength(NewSecurityDescriptor);
-    FileSecurity = (PSECURITY_DESCRIPTOR)malloc(FileSecuritySize);
-    if (0 == FileSecurity)
-    {
-        FspDeleteSecurityDescriptor(NewSecurityDescriptor, (NTSTATUS (*)())FspSetSecurityDescriptor);
-        return STATUS_INSUFFICIENT_RESOURCES;
-    }
-    memcpy(FileSecurity, NewSecurityDescriptor, FileSecuritySize);
+    Result = MemfsSecurityIntern(NewSecurityDescriptor, &FileSecurity);
     FspDeleteSecurityDescriptor(NewSecurityDescriptor, (NTSTATUS (*)())FspSetSecurityDescriptor);
+    if (!NT_SUCCESS(Result))
+        return Result;
 
-    free(FileNode->FileSecurity);
-    FileNode->FileSecuritySize = FileSecuritySize;
+    MemfsSecurityRelease(FileNode->FileSecurity);
     FileNode->FileSecurity = FileSecurity;
 
     return STATUS_SUCCESS;
@@ -1854,7 +2182,7 @@ typedef struct _MEMFS_READ_DIRECTORY_CONTEXT
 static BOOLEAN AddDirInfo(MEMFS_FILE_NODE *FileNode, PWSTR FileName,
     PVOID Buffer, ULONG Length, PULONG PBytesTransferred)
 {
-    UINT8 DirInfoBuf[sizeof(FSP_FSCTL_DIR_INFO) + sizeof FileNode->FileName];
+    UINT8 DirInfoBuf[sizeof(FSP_FSCTL_DIR_INFO) + MEMFS_MAX_PATH * sizeof(WCHAR)];
     FSP_FSCTL_DIR_INFO *DirInfo = (FSP_FSCTL_DIR_INFO *)DirInfoBuf;
     WCHAR Root[2] = L"\\";
     PWSTR Remain, Suffix;
@@ -2137,7 +2465,7 @@ typedef struct _MEMFS_GET_STREAM_INFO_CONTEXT
 static BOOLEAN AddStreamInfo(MEMFS_FILE_NODE *FileNode,
     PVOID Buffer, ULONG Length, PULONG PBytesTransferred)
 {
-    UINT8 StreamInfoBuf[sizeof(FSP_FSCTL_STREAM_INFO) + sizeof FileNode->FileName];
+    UINT8 StreamInfoBuf[sizeof(FSP_FSCTL_STREAM_INFO) + MEMFS_MAX_PATH * sizeof(WCHAR)];
     FSP_FSCTL_STREAM_INFO *StreamInfo = (FSP_FSCTL_STREAM_INFO *)StreamInfoBuf;
     PWSTR StreamName;
 
@@ -2356,6 +2684,11 @@ static FSP_FILE_SYSTEM_INTERFACE MemfsInterface =
 #else
     0,
 #endif
+#if defined(MEMFS_OPEN_WITH_SECURITY)
+    OpenWithSecurity,
+#else
+    0,
+#endif
 };
 
 /*
@@ -2380,8 +2713,12 @@ NTSTATUS MemfsCreateFunnel(
     BOOLEAN CaseInsensitive = !!(Flags & MemfsCaseInsensitive);
     BOOLEAN FlushAndPurgeOnCleanup = !!(Flags & MemfsFlushAndPurgeOnCleanup);
     BOOLEAN SupportsPosixUnlinkRename = !(Flags & MemfsLegacyUnlinkRename);
-    PWSTR DevicePath = MemfsNet == (Flags & MemfsDeviceMask) ?
-        L"" FSP_FSCTL_NET_DEVICE_NAME : L"" FSP_FSCTL_DISK_DEVICE_NAME;
+    BOOLEAN ReadSplit = !!(Flags & MemfsReadSplit);
+    BOOLEAN DataRing = !!(Flags & MemfsDataRing);
+    BOOLEAN NegativeLookup = !!(Flags & MemfsNegativeLookup);
+    PWSTR DevicePath = 0 != (Flags & MemfsDetached) ? 0 :
+        MemfsNet == (Flags & MemfsDeviceMask) ?
+            L"" FSP_FSCTL_NET_DEVICE_NAME : L"" FSP_FSCTL_DISK_DEVICE_NAME;
     UINT64 AllocationUnit;
     MEMFS *Memfs;
     MEMFS_FILE_NODE *RootNode;
@@ -2409,6 +2746,7 @@ NTSTATUS MemfsCreateFunnel(
     }
 
     memset(Memfs, 0, sizeof *Memfs);
+    MemfsArenaInitialize(&Memfs->Arena);
     Memfs->MaxFileNodes = MaxFileNodes;
     AllocationUnit = MEMFS_SECTOR_SIZE * MEMFS_SECTORS_PER_ALLOCATION_UNIT;
     Memfs->MaxFileSize = (ULONG)((MaxFileSize + AllocationUnit - 1) / AllocationUnit * AllocationUnit);
@@ -2463,6 +2801,8 @@ NTSTATUS MemfsCreateFunnel(
     VolumeParams.RejectIrpPriorToTransact0 = 1;
 #endif
     VolumeParams.SupportsPosixUnlinkRename = SupportsPosixUnlinkRename;
+    VolumeParams.ReadSplitSize = ReadSplit ? FspFsctlReadSplitSizeMinimum : 0;
+    VolumeParams.NegativeLookupTimeout = NegativeLookup ? 1000 : 0;
     if (0 != VolumePrefix)
         wcscpy_s(VolumeParams.Prefix, sizeof VolumeParams.Prefix / sizeof(WCHAR), VolumePrefix);
     wcscpy_s(VolumeParams.FileSystemName, sizeof VolumeParams.FileSystemName / sizeof(WCHAR),
@@ -2479,6 +2819,19 @@ NTSTATUS MemfsCreateFunnel(
 
     Memfs->FileSystem->UserContext = Memfs;
     Memfs->VolumeLabelLength = sizeof L"MEMFS" - sizeof(WCHAR);
+
+    if (DataRing && 0 != DevicePath)
+    {
+        Result = FspFsctlCreateDataRing(Memfs->FileSystem->VolumeHandle, 256 * 1024, 8);
+        if (!NT_SUCCESS(Result))
+        {
+            FspFileSystemDelete(Memfs->FileSystem);
+            MemfsFileNodeMapDelete(Memfs->FileNodeMap);
+            free(Memfs);
+            LocalFree(RootSecurity);
+            return Result;
+        }
+    }
     memcpy(Memfs->VolumeLabel, L"MEMFS", Memfs->VolumeLabelLength);
 
 #if 0
@@ -2490,7 +2843,7 @@ NTSTATUS MemfsCreateFunnel(
      * Create root directory.
      */
 
-    Result = MemfsFileNodeCreate(L"\\", &RootNode);
+    Result = MemfsFileNodeCreate(&Memfs->Arena, L"\\", &RootNode);
     if (!NT_SUCCESS(Result))
     {
         MemfsDelete(Memfs);
@@ -2500,16 +2853,14 @@ NTSTATUS MemfsCreateFunnel(
 
     RootNode->FileInfo.FileAttributes = FILE_ATTRIBUTE_DIRECTORY;
 
-    RootNode->FileSecurity = malloc(RootSecuritySize);
-    if (0 == RootNode->FileSecurity)
+    Result = MemfsSecurityIntern(RootSecurity, &RootNode->FileSecurity);
+    if (!NT_SUCCESS(Result))
     {
         MemfsFileNodeDelete(RootNode);
         MemfsDelete(Memfs);
         LocalFree(RootSecurity);
-        return STATUS_INSUFFICIENT_RESOURCES;
+        return Result;
     }
-    RootNode->FileSecuritySize = RootSecuritySize;
-    memcpy(RootNode->FileSecurity, RootSecurity, RootSecuritySize);
 
     Result = MemfsFileNodeMapInsert(Memfs->FileNodeMap, RootNode, &Inserted);
     if (!NT_SUCCESS(Result))
@@ -2533,6 +2884,8 @@ VOID MemfsDelete(MEMFS *Memfs)
 
     MemfsFileNodeMapDelete(Memfs->FileNodeMap);
 
+    MemfsArenaFinalize(&Memfs->Arena);
+
     free(Memfs);
 }
 
@@ -2560,6 +2913,23 @@ FSP_FILE_SYSTEM *MemfsFileSystem(MEMFS *Memfs)
     return Memfs->FileSystem;
 }
 
+VOID MemfsSetMaxNodeMemory(MEMFS *Memfs, UINT64 MaxNodeMemory)
+{
+    AcquireSRWLockExclusive(&Memfs->Arena.Lock);
+    Memfs->Arena.MaxBytes = MaxNodeMemory;
+    ReleaseSRWLockExclusive(&Memfs->Arena.Lock);
+}
+
+VOID MemfsGetNodeMemory(MEMFS *Memfs, UINT64 *PUsedBytes, UINT64 *PReservedBytes)
+{
+    AcquireSRWLockShared(&Memfs->Arena.Lock);
+    if (0 != PUsedBytes)
+        *PUsedBytes = Memfs->Arena.UsedBytes;
+    if (0 != PReservedBytes)
+        *PReservedBytes = Memfs->Arena.SlabBytes;
+    ReleaseSRWLockShared(&Memfs->Arena.Lock);
+}
+
 NTSTATUS MemfsHeapConfigure(SIZE_T InitialSize, SIZE_T MaximumSize, SIZE_T Alignment)
 {
     return LargeHeapInitialize(0, InitialSize, MaximumSize, LargeHeapAlignment) ?
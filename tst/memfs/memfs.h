@@ -39,6 +39,10 @@ enum
     MemfsFlushAndPurgeOnCleanup         = 0x40000000,
     MemfsLegacyUnlinkRename             = 0x20000000,
     MemfsNoSlowio                       = 0x10000000,
+    MemfsReadSplit                      = 0x08000000,
+    MemfsDataRing                       = 0x04000000,
+    MemfsNegativeLookup                 = 0x02000000,
+    MemfsDetached                       = 0x01000000,
 };
 
 #define MemfsCreate(Flags, FileInfoTimeout, MaxFileNodes, MaxFileSize, VolumePrefix, RootSddl, PMemfs)\
@@ -70,6 +74,8 @@ VOID MemfsDelete(MEMFS *Memfs);
 NTSTATUS MemfsStart(MEMFS *Memfs);
 VOID MemfsStop(MEMFS *Memfs);
 FSP_FILE_SYSTEM *MemfsFileSystem(MEMFS *Memfs);
+VOID MemfsSetMaxNodeMemory(MEMFS *Memfs, UINT64 MaxNodeMemory);
+VOID MemfsGetNodeMemory(MEMFS *Memfs, UINT64 *PUsedBytes, UINT64 *PReservedBytes);
 
 NTSTATUS MemfsHeapConfigure(SIZE_T InitialSize, SIZE_T MaximumSize, SIZE_T Alignment);
 
@@ -247,6 +247,51 @@ NTSTATUS LfsWriteFile(
     return Result;
 }
 
+NTSTATUS LfsReadFileAsync(
+    HANDLE Handle,
+    PVOID Buffer,
+    UINT64 Offset,
+    ULONG Length,
+    PVOID ApcContext,
+    PIO_STATUS_BLOCK Iosb)
+{
+    /*
+     * The Handle must be associated with a completion port. Unless the I/O completes
+     * immediately, the completion packet is posted with ApcContext as its overlapped
+     * pointer.
+     */
+    return NtReadFile(
+        Handle,
+        0,
+        0,
+        ApcContext,
+        Iosb,
+        Buffer,
+        Length,
+        (PLARGE_INTEGER)&Offset,
+        0);
+}
+
+NTSTATUS LfsWriteFileAsync(
+    HANDLE Handle,
+    PVOID Buffer,
+    UINT64 Offset,
+    ULONG Length,
+    PVOID ApcContext,
+    PIO_STATUS_BLOCK Iosb)
+{
+    return NtWriteFile(
+        Handle,
+        0,
+        0,
+        ApcContext,
+        Iosb,
+        Buffer,
+        Length,
+        (PLARGE_INTEGER)&Offset,
+        0);
+}
+
 NTSTATUS LfsQueryDirectoryFile(
     HANDLE Handle,
     PVOID Buffer,
@@ -134,6 +134,8 @@ static NTSTATUS SvcStart(FSP_SERVICE *Service, ULONG argc, PWSTR *argv)
                 FsAttributeMask |= PtfsFlushAndPurgeOnCleanup;
             else if (0 == _wcsicmp(L"SetAllocationSizeOnCleanup", OptionString))
                 FsAttributeMask |= PtfsSetAllocationSizeOnCleanup;
+            else if (0 == _wcsicmp(L"SynchronousIo", OptionString))
+                FsAttributeMask |= PtfsSynchronousIo;
             else
                 goto usage;
             break;
@@ -255,6 +257,7 @@ usage:
         "        -o NamedStreams\n"
         "        -o ExtendedAttributes\n"
         "        -o WslFeatures\n"
+        "    -o SynchronousIo    [read/write on dispatcher threads]\n"
         "    -u \\Server\\Share    [UNC prefix (single backslash)]\n"
         "    -p Directory        [directory to expose as pass through file system]\n"
         "    -m MountPoint       [X:|*|directory]\n";
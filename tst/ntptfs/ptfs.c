@@ -26,6 +26,9 @@
 #define FileContextIsDirectory          (((FILE_CONTEXT *)(FileContext))->IsDirectory)
 #define FileContextDirFileSize          (((FILE_CONTEXT *)(FileContext))->DirFileSize)
 #define FileContextDirBuffer            (&((FILE_CONTEXT *)(FileContext))->DirBuffer)
+#define FileContextIo                   (((FILE_CONTEXT *)(FileContext))->Io)
+
+#define QUERY_BUFFER_SIZE               (64 * 1024)
 
 typedef struct
 {
@@ -33,13 +36,53 @@ typedef struct
     BOOLEAN IsDirectory;
     ULONG DirFileSize;
     PVOID DirBuffer;
+    PTP_IO Io;
 } FILE_CONTEXT;
 
+typedef struct
+{
+    IO_STATUS_BLOCK Iosb;
+    HANDLE Handle;
+    UINT64 Hint;
+    UINT32 Kind;
+} IO_CONTEXT;
+
 static NTSTATUS GetReparsePointByName(
     FSP_FILE_SYSTEM *FileSystem, PVOID Context,
     PWSTR FileName, BOOLEAN IsDirectory, PVOID Buffer, PSIZE_T PSize);
 static NTSTATUS SetDisposition(
     HANDLE Handle, BOOLEAN DeleteFile);
+static VOID CALLBACK IoCompletion(
+    PTP_CALLBACK_INSTANCE Instance, PVOID Context, PVOID Overlapped,
+    ULONG IoResult, ULONG_PTR NumberOfBytesTransferred, PTP_IO Io);
+
+static VOID BindIoCompletion(FSP_FILE_SYSTEM *FileSystem, FILE_CONTEXT *FileContext)
+{
+    PTFS *Ptfs = FileSystemContext;
+
+    /*
+     * Files are opened for asynchronous I/O. Associate their handles with the thread pool,
+     * so that Read and Write can return STATUS_PENDING and complete from the pool. Skip
+     * the completion port on success, so that I/O that completes immediately (e.g. hits
+     * in the lower file system cache) is completed inline without a thread switch.
+     *
+     * Directories are opened for synchronous I/O (see Open) and are never bound.
+     */
+    if (FileContext->IsDirectory || (Ptfs->FsAttributeMask & PtfsSynchronousIo))
+        return;
+
+    FileContext->Io = CreateThreadpoolIo(FileContext->Handle, IoCompletion, FileSystem, 0);
+    if (0 == FileContext->Io)
+        return;
+
+    if (!SetFileCompletionNotificationModes(FileContext->Handle,
+        FILE_SKIP_COMPLETION_PORT_ON_SUCCESS))
+    {
+        /* I/O issued without an ApcContext does not post to the port; use synchronous I/O */
+        CloseThreadpoolIo(FileContext->Io);
+        FileContext->Io = 0;
+    }
+}
 
 static NTSTATUS GetVolumeInfo(FSP_FILE_SYSTEM *FileSystem,
     FSP_FSCTL_VOLUME_INFO *VolumeInfo)
@@ -244,6 +287,7 @@ static NTSTATUS CreateEx(FSP_FILE_SYSTEM *FileSystem,
     FileContext->Handle = Handle;
     FileContext->IsDirectory = IsDirectory;
     FileContext->DirFileSize = (ULONG)FileInfo->FileSize;
+    BindIoCompletion(FileSystem, FileContext);
     *PFileContext = FileContext;
 
     Result = STATUS_SUCCESS;
@@ -335,6 +379,7 @@ static NTSTATUS Open(FSP_FILE_SYSTEM *FileSystem,
     FileContext->Handle = Handle;
     FileContext->IsDirectory = IsDirectory;
     FileContext->DirFileSize = (ULONG)FileInfo->FileSize;
+    BindIoCompletion(FileSystem, FileContext);
     *PFileContext = FileContext;
 
     Result = STATUS_SUCCESS;
@@ -430,21 +475,115 @@ static VOID Close(FSP_FILE_SYSTEM *FileSystem,
     PVOID FileContext)
 {
     HANDLE Handle = FileContextHandle;
+    PTP_IO Io = FileContextIo;
 
     if (0 != Handle)
         NtClose(Handle);
 
+    if (0 != Io)
+    {
+        /* the I/O has been responded to, but its callback may not have returned yet */
+        WaitForThreadpoolIoCallbacks(Io, FALSE);
+        CloseThreadpoolIo(Io);
+    }
+
     FspFileSystemDeleteDirectoryBuffer(FileContextDirBuffer);
 
     free(FileContext);
 }
 
+static inline VOID PendingIoRelease(PTFS *Ptfs)
+{
+    /* PendingIoCount holds an extra reference that PtfsDelete drops */
+    if (0 == InterlockedDecrement(&Ptfs->PendingIoCount))
+        SetEvent(Ptfs->PendingIoEvent);
+}
+
+static VOID CALLBACK IoCompletion(
+    PTP_CALLBACK_INSTANCE Instance, PVOID Context, PVOID Overlapped,
+    ULONG IoResult, ULONG_PTR NumberOfBytesTransferred, PTP_IO Io)
+{
+    FSP_FILE_SYSTEM *FileSystem = Context;
+    PTFS *Ptfs = FileSystemContext;
+    IO_CONTEXT *IoContext = Overlapped;
+    FSP_FSCTL_TRANSACT_RSP Response;
+    NTSTATUS Result;
+
+    memset(&Response, 0, sizeof Response);
+    Response.Size = sizeof Response;
+    Response.Kind = IoContext->Kind;
+    Response.Hint = IoContext->Hint;
+    Response.IoStatus.Status = IoContext->Iosb.Status;
+    Response.IoStatus.Information = (UINT32)IoContext->Iosb.Information;
+    if (FspFsctlTransactWriteKind == IoContext->Kind && NT_SUCCESS(Response.IoStatus.Status))
+    {
+        Result = LfsGetFileInfo(IoContext->Handle, -1, &Response.Rsp.Write.FileInfo);
+        if (!NT_SUCCESS(Result))
+        {
+            Response.IoStatus.Status = Result;
+            Response.IoStatus.Information = 0;
+        }
+    }
+    FspFileSystemSendResponse(FileSystem, &Response);
+
+    free(IoContext);
+    PendingIoRelease(Ptfs);
+}
+
+static NTSTATUS StartAsyncIo(FSP_FILE_SYSTEM *FileSystem,
+    PVOID FileContext, UINT32 Kind, PVOID Buffer, UINT64 Offset, ULONG Length,
+    PULONG PBytesTransferred)
+{
+    PTFS *Ptfs = FileSystemContext;
+    HANDLE Handle = FileContextHandle;
+    PTP_IO Io = FileContextIo;
+    IO_CONTEXT *IoContext;
+    NTSTATUS Result;
+
+    IoContext = malloc(sizeof *IoContext);
+    if (0 == IoContext)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    IoContext->Handle = Handle;
+    IoContext->Hint = FspFileSystemGetOperationContext()->Request->Hint;
+    IoContext->Kind = Kind;
+
+    /*
+     * The Buffer is the I/O buffer of the originating request and remains valid until
+     * we respond to it, so it can be handed to the lower file system as is.
+     */
+    InterlockedIncrement(&Ptfs->PendingIoCount);
+    StartThreadpoolIo(Io);
+    Result = FspFsctlTransactReadKind == Kind ?
+        LfsReadFileAsync(Handle, Buffer, Offset, Length, IoContext, &IoContext->Iosb) :
+        LfsWriteFileAsync(Handle, Buffer, Offset, Length, IoContext, &IoContext->Iosb);
+
+    /*
+     * A completion is posted to the port unless the I/O failed immediately (NT_ERROR) or
+     * succeeded immediately (NT_SUCCESS and not pending; FILE_SKIP_COMPLETION_PORT_ON_SUCCESS).
+     * Pending I/O and warning statuses (e.g. STATUS_BUFFER_OVERFLOW) complete from the port.
+     */
+    if (!NT_ERROR(Result) && (STATUS_PENDING == Result || !NT_SUCCESS(Result)))
+        return STATUS_PENDING;
+
+    CancelThreadpoolIo(Io);
+    *PBytesTransferred = NT_SUCCESS(Result) ? (ULONG)IoContext->Iosb.Information : 0;
+    free(IoContext);
+    PendingIoRelease(Ptfs);
+
+    return Result;
+}
+
 static NTSTATUS Read(FSP_FILE_SYSTEM *FileSystem,
     PVOID FileContext, PVOID Buffer, UINT64 Offset, ULONG Length,
     PULONG PBytesTransferred)
 {
     HANDLE Handle = FileContextHandle;
 
+    if (0 != FileContextIo)
+        return StartAsyncIo(FileSystem, FileContext, FspFsctlTransactReadKind,
+            Buffer, Offset, Length, PBytesTransferred);
+
     return LfsReadFile(
         Handle,
         Buffer,
@@ -480,13 +619,17 @@ static NTSTATUS Write(FSP_FILE_SYSTEM *FileSystem,
             Length = (ULONG)((UINT64)FileStdInfo.EndOfFile.QuadPart - Offset);
     }
 
-    Result = LfsWriteFile(
-        Handle,
-        Buffer,
-        Offset,
-        Length,
-        PBytesTransferred);
-    if (!NT_SUCCESS(Result))
+    if (0 != FileContextIo)
+        Result = StartAsyncIo(FileSystem, FileContext, FspFsctlTransactWriteKind,
+            Buffer, Offset, Length, PBytesTransferred);
+    else
+        Result = LfsWriteFile(
+            Handle,
+            Buffer,
+            Offset,
+            Length,
+            PBytesTransferred);
+    if (STATUS_PENDING == Result || !NT_SUCCESS(Result))
         goto exit;
 
     Result = LfsGetFileInfo(Handle, -1, FileInfo);
@@ -806,7 +949,7 @@ static NTSTATUS BufferedReadDirectory(FSP_FILE_SYSTEM *FileSystem,
     PVOID PDirBuffer = FileContextDirBuffer;
     BOOLEAN RestartScan;
     ULONG BytesTransferred;
-    UINT8 QueryBuffer[16 * 1024];
+    PUINT8 QueryBuffer = 0;
     FILE_ID_BOTH_DIR_INFORMATION *QueryInfo;
     ULONG QueryNext;
     union
@@ -819,12 +962,24 @@ static NTSTATUS BufferedReadDirectory(FSP_FILE_SYSTEM *FileSystem,
     DirBufferResult = STATUS_SUCCESS;
     if (FspFileSystemAcquireDirectoryBufferEx(PDirBuffer, 0 == Marker, CapacityHint, &DirBufferResult))
     {
+        /*
+         * Fill the directory buffer in large batches: a bigger query buffer means fewer
+         * NtQueryDirectoryFile round trips per enumeration. The query buffer is only
+         * needed while the directory buffer is being filled (once per enumeration).
+         */
+        QueryBuffer = malloc(QUERY_BUFFER_SIZE);
+        if (0 == QueryBuffer)
+        {
+            DirBufferResult = STATUS_INSUFFICIENT_RESOURCES;
+            goto done;
+        }
+
         for (RestartScan = TRUE;; RestartScan = FALSE)
         {
             Result = LfsQueryDirectoryFile(
                 Handle,
                 QueryBuffer,
-                sizeof QueryBuffer,
+                QUERY_BUFFER_SIZE,
                 37/*FileIdBothDirectoryInformation*/,
                 FALSE,
                 Pattern,
@@ -855,6 +1010,7 @@ static NTSTATUS BufferedReadDirectory(FSP_FILE_SYSTEM *FileSystem,
         }
 
     done:
+        free(QueryBuffer);
         FspFileSystemReleaseDirectoryBuffer(PDirBuffer);
     }
 
@@ -1317,6 +1473,14 @@ NTSTATUS PtfsCreate(
     }
     memset(Ptfs, 0, sizeof *Ptfs);
 
+    Ptfs->PendingIoEvent = CreateEventW(0, TRUE, FALSE, 0);
+    if (0 == Ptfs->PendingIoEvent)
+    {
+        Result = FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+    Ptfs->PendingIoCount = 1;
+
     Ptfs->FileSystem = FileSystem;
     Ptfs->HasSecurityPrivilege = HasSecurityPrivilege;
     Ptfs->RootHandle = RootHandle;
@@ -1337,6 +1501,9 @@ NTSTATUS PtfsCreate(
 exit:
     if (!NT_SUCCESS(Result))
     {
+        if (0 != Ptfs && 0 != Ptfs->PendingIoEvent)
+            CloseHandle(Ptfs->PendingIoEvent);
+
         free(Ptfs);
 
         if (0 != FileSystem)
@@ -1351,6 +1518,11 @@ exit:
 
 VOID PtfsDelete(PTFS *Ptfs)
 {
+    /* wait for outstanding asynchronous I/O to be responded to */
+    PendingIoRelease(Ptfs);
+    WaitForSingleObject(Ptfs->PendingIoEvent, INFINITE);
+    CloseHandle(Ptfs->PendingIoEvent);
+
     FspFileSystemDelete(Ptfs->FileSystem);
     CloseHandle(Ptfs->RootHandle);
 
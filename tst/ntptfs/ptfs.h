@@ -44,13 +44,15 @@ enum
     PtfsWslFeatures = 0x04000000,
     PtfsFlushAndPurgeOnCleanup = 0x00004000,
     PtfsSetAllocationSizeOnCleanup = 0x00010000,                // reuse UmFileContextIsUserContext2
+    PtfsSynchronousIo = 0x00020000,
     PtfsAttributesMask =
         PtfsReparsePoints |
         PtfsNamedStreams |
         PtfsExtendedAttributes |
         PtfsWslFeatures |
         PtfsFlushAndPurgeOnCleanup |
-        PtfsSetAllocationSizeOnCleanup,
+        PtfsSetAllocationSizeOnCleanup |
+        PtfsSynchronousIo,
 };
 typedef struct
 {
@@ -61,6 +63,8 @@ typedef struct
     ULONG FsAttributeMask;
     ULONG FsAttributes;
     UINT64 AllocationUnit;
+    volatile LONG PendingIoCount;
+    HANDLE PendingIoEvent;
 } PTFS;
 NTSTATUS PtfsCreate(
     PWSTR RootPath,
@@ -111,6 +115,20 @@ NTSTATUS LfsWriteFile(
     UINT64 Offset,
     ULONG Length,
     PULONG PBytesTransferred);
+NTSTATUS LfsReadFileAsync(
+    HANDLE Handle,
+    PVOID Buffer,
+    UINT64 Offset,
+    ULONG Length,
+    PVOID ApcContext,
+    PIO_STATUS_BLOCK Iosb);
+NTSTATUS LfsWriteFileAsync(
+    HANDLE Handle,
+    PVOID Buffer,
+    UINT64 Offset,
+    ULONG Length,
+    PVOID ApcContext,
+    PIO_STATUS_BLOCK Iosb);
 NTSTATUS LfsQueryDirectoryFile(
     HANDLE Handle,
     PVOID Buffer,
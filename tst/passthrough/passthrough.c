@@ -33,18 +33,295 @@
 #define ConcatPath(Ptfs, FN, FP)        (0 == StringCbPrintfW(FP, sizeof FP, L"%s%s", Ptfs->Path, FN))
 #define HandleFromContext(FC)           (((PTFS_FILE_CONTEXT *)(FC))->Handle)
 
+/*
+ * Handle cache
+ *
+ * Every open on the file system costs at least two opens on the backing volume: one in
+ * GetSecurityByName and one in Open (or Create). Workloads that reopen the same files over
+ * and over (compilers, antivirus scanners) spend most of their time in these opens. When
+ * enabled, the handle cache keeps backing handles open after they are no longer used and
+ * hands them out again to the next open of the same path with the same access rights.
+ *
+ * A handle is "checked out" of the cache for as long as it is in use (by GetSecurityByName
+ * or by a file context) and "checked in" when it is no longer used. Only idle (checked in)
+ * handles are in the cache; the least recently used idle handle is closed when there are
+ * more than HandleCacheMax idle handles.
+ *
+ * Backing handles are always opened with full sharing and are never opened delete-on-close,
+ * so an idle cached handle never causes a sharing violation. However an idle handle keeps
+ * a deleted file in the delete pending state and prevents the rename of its directories.
+ * For this reason SetDelete, delete on Cleanup and Rename close the idle handles for a path
+ * and all paths below it. They also increment the HandleCacheGeneration, so that handles
+ * that are in use at the time (and may now refer to a different or deleted file) are closed
+ * rather than checked in.
+ *
+ * The cache assumes that the backing directory is not modified behind the back of the
+ * file system.
+ */
+#define PTFS_HANDLE_CACHE_BUCKET_COUNT  1024
+
+typedef struct _PTFS_HANDLE_ENTRY
+{
+    struct _PTFS_HANDLE_ENTRY *HashNext;
+    LIST_ENTRY ListEntry;
+    HANDLE Handle;
+    UINT32 Access;
+    ULONG Hash;
+    LONG64 Generation;
+    ULONG FileNameLength;               /* in WCHAR's */
+    WCHAR FileName[];
+} PTFS_HANDLE_ENTRY;
+
 typedef struct
 {
     FSP_FILE_SYSTEM *FileSystem;
     PWSTR Path;
+    ULONG PrefetchMax;
+    volatile LONG64 ModifyGeneration;
+    ULONG HandleCacheMax, HandleCacheCount;
+    SRWLOCK HandleCacheLock;
+    LONG64 HandleCacheGeneration;
+    LIST_ENTRY HandleCacheList;         /* least recently used first */
+    PTFS_HANDLE_ENTRY *HandleCacheBuckets[PTFS_HANDLE_CACHE_BUCKET_COUNT];
 } PTFS;
 
+/*
+ * Prefetch cache
+ *
+ * A reference implementation of read-ahead driven by the access pattern hints that the
+ * FSD passes in the Read request. When the FSD recommends a read-ahead, the file system
+ * reads Length + ReadAheadLength bytes (up to PrefetchMax) into a per-handle buffer and
+ * serves subsequent reads from it. This matters little for a local pass through file
+ * system, but demonstrates the technique for file systems with high-latency backends.
+ *
+ * Any modification on the volume (Write, Overwrite, SetFileSize, etc.) increments the
+ * volume-wide ModifyGeneration; a prefetch buffer is only used if its generation is
+ * current. This is coarse, but keeps the cache coherent across file handles.
+ */
+typedef struct
+{
+    SRWLOCK Lock;
+    PUINT8 Buffer;
+    ULONG Size;                         /* allocated buffer size */
+    UINT64 Offset;                      /* file offset of the buffered data */
+    ULONG Length;                       /* valid buffered bytes */
+    BOOLEAN EndOfFile;                  /* buffered data extends to the end of file */
+    LONG64 Generation;
+} PTFS_PREFETCH;
+
 typedef struct
 {
     HANDLE Handle;
     PVOID DirBuffer;
+    PTFS_PREFETCH Prefetch;
+    PTFS_HANDLE_ENTRY *CacheEntry;
 } PTFS_FILE_CONTEXT;
 
+#define PtfsModified(Ptfs)              InterlockedIncrement64(&(Ptfs)->ModifyGeneration)
+
+static inline ULONG HandleCacheHash(PWSTR FileName, ULONG FileNameLength)
+{
+    ULONG Hash = 2166136261;
+
+    /*
+     * File names are case-insensitive. Only ASCII is folded here; names that differ in the
+     * case of other characters hash differently and simply miss the cache.
+     */
+    for (ULONG I = 0; FileNameLength > I; I++)
+    {
+        WCHAR C = FileName[I];
+        if (L'a' <= C && C <= L'z')
+            C -= L'a' - L'A';
+        Hash = (Hash ^ C) * 16777619;
+    }
+    return Hash;
+}
+
+static inline BOOLEAN HandleCacheEqual(PWSTR FileName1, PWSTR FileName2, ULONG Count)
+{
+    return CSTR_EQUAL == CompareStringOrdinal(FileName1, Count, FileName2, Count, TRUE);
+}
+
+static VOID HandleCacheRemove(PTFS *Ptfs, PTFS_HANDLE_ENTRY *Entry)
+{
+    PTFS_HANDLE_ENTRY **PEntry;
+
+    /* must be called with the HandleCacheLock held exclusive */
+
+    for (PEntry = &Ptfs->HandleCacheBuckets[Entry->Hash % PTFS_HANDLE_CACHE_BUCKET_COUNT];
+        Entry != *PEntry; PEntry = &(*PEntry)->HashNext)
+        ;
+    *PEntry = Entry->HashNext;
+    Entry->ListEntry.Blink->Flink = Entry->ListEntry.Flink;
+    Entry->ListEntry.Flink->Blink = Entry->ListEntry.Blink;
+    Ptfs->HandleCacheCount--;
+}
+
+static PTFS_HANDLE_ENTRY *HandleCacheEntryCreate(PTFS *Ptfs, PWSTR FileName, UINT32 Access)
+{
+    PTFS_HANDLE_ENTRY *Entry;
+    ULONG FileNameLength;
+
+    if (0 == Ptfs->HandleCacheMax)
+        return 0;
+
+    FileNameLength = (ULONG)wcslen(FileName);
+    Entry = malloc(sizeof *Entry + FileNameLength * sizeof(WCHAR));
+    if (0 == Entry)
+        return 0;
+
+    memset(Entry, 0, sizeof *Entry);
+    Entry->Handle = INVALID_HANDLE_VALUE;
+    Entry->Access = Access;
+    Entry->Hash = HandleCacheHash(FileName, FileNameLength);
+    Entry->FileNameLength = FileNameLength;
+    memcpy(Entry->FileName, FileName, FileNameLength * sizeof(WCHAR));
+
+    AcquireSRWLockShared(&Ptfs->HandleCacheLock);
+    Entry->Generation = Ptfs->HandleCacheGeneration;
+    ReleaseSRWLockShared(&Ptfs->HandleCacheLock);
+
+    return Entry;
+}
+
+static HANDLE HandleCacheCheckout(PTFS *Ptfs, PWSTR FileName, UINT32 Access,
+    PTFS_HANDLE_ENTRY **PEntry)
+{
+    PTFS_HANDLE_ENTRY *Entry;
+    ULONG FileNameLength, Hash;
+
+    *PEntry = 0;
+
+    if (0 == Ptfs->HandleCacheMax)
+        return INVALID_HANDLE_VALUE;
+
+    FileNameLength = (ULONG)wcslen(FileName);
+    Hash = HandleCacheHash(FileName, FileNameLength);
+
+    AcquireSRWLockExclusive(&Ptfs->HandleCacheLock);
+
+    for (Entry = Ptfs->HandleCacheBuckets[Hash % PTFS_HANDLE_CACHE_BUCKET_COUNT];
+        0 != Entry; Entry = Entry->HashNext)
+        if (Hash == Entry->Hash &&
+            Access == Entry->Access &&
+            FileNameLength == Entry->FileNameLength &&
+            HandleCacheEqual(FileName, Entry->FileName, FileNameLength))
+        {
+            HandleCacheRemove(Ptfs, Entry);
+            Entry->Generation = Ptfs->HandleCacheGeneration;
+            break;
+        }
+
+    ReleaseSRWLockExclusive(&Ptfs->HandleCacheLock);
+
+    if (0 != Entry)
+    {
+        *PEntry = Entry;
+        return Entry->Handle;
+    }
+
+    /* cache miss: the caller opens the handle and checks it in when done */
+    *PEntry = HandleCacheEntryCreate(Ptfs, FileName, Access);
+    return INVALID_HANDLE_VALUE;
+}
+
+static VOID HandleCacheCheckin(PTFS *Ptfs, PTFS_HANDLE_ENTRY *Entry, HANDLE Handle)
+{
+    PTFS_HANDLE_ENTRY *Evict = 0;
+
+    if (0 == Entry)
+    {
+        if (INVALID_HANDLE_VALUE != Handle)
+            CloseHandle(Handle);
+        return;
+    }
+
+    if (INVALID_HANDLE_VALUE == Handle)
+    {
+        free(Entry);
+        return;
+    }
+
+    Entry->Handle = Handle;
+
+    AcquireSRWLockExclusive(&Ptfs->HandleCacheLock);
+
+    if (Ptfs->HandleCacheGeneration != Entry->Generation)
+        Evict = Entry;
+    else
+    {
+        Entry->HashNext = Ptfs->HandleCacheBuckets[Entry->Hash % PTFS_HANDLE_CACHE_BUCKET_COUNT];
+        Ptfs->HandleCacheBuckets[Entry->Hash % PTFS_HANDLE_CACHE_BUCKET_COUNT] = Entry;
+        Entry->ListEntry.Flink = &Ptfs->HandleCacheList;
+        Entry->ListEntry.Blink = Ptfs->HandleCacheList.Blink;
+        Ptfs->HandleCacheList.Blink->Flink = &Entry->ListEntry;
+        Ptfs->HandleCacheList.Blink = &Entry->ListEntry;
+        Ptfs->HandleCacheCount++;
+
+        if (Ptfs->HandleCacheMax < Ptfs->HandleCacheCount)
+        {
+            Evict = CONTAINING_RECORD(Ptfs->HandleCacheList.Flink, PTFS_HANDLE_ENTRY, ListEntry);
+            HandleCacheRemove(Ptfs, Evict);
+        }
+    }
+
+    ReleaseSRWLockExclusive(&Ptfs->HandleCacheLock);
+
+    /* close outside the lock; closing a handle may flush the file */
+    if (0 != Evict)
+    {
+        CloseHandle(Evict->Handle);
+        free(Evict);
+    }
+}
+
+static VOID HandleCacheInvalidate(PTFS *Ptfs, PWSTR FileName)
+{
+    PLIST_ENTRY ListEntry, NextEntry;
+    PTFS_HANDLE_ENTRY *Entry, *EvictList = 0;
+    ULONG FileNameLength;
+
+    if (0 == Ptfs->HandleCacheMax)
+        return;
+
+    /* ignore any trailing backslashes (the root "\" invalidates everything) */
+    FileNameLength = (ULONG)wcslen(FileName);
+    while (0 < FileNameLength && L'\\' == FileName[FileNameLength - 1])
+        FileNameLength--;
+
+    AcquireSRWLockExclusive(&Ptfs->HandleCacheLock);
+
+    Ptfs->HandleCacheGeneration++;
+
+    for (ListEntry = Ptfs->HandleCacheList.Flink; &Ptfs->HandleCacheList != ListEntry;
+        ListEntry = NextEntry)
+    {
+        NextEntry = ListEntry->Flink;
+        Entry = CONTAINING_RECORD(ListEntry, PTFS_HANDLE_ENTRY, ListEntry);
+
+        /* remove FileName and anything below it */
+        if (FileNameLength <= Entry->FileNameLength &&
+            (FileNameLength == Entry->FileNameLength ||
+                L'\\' == Entry->FileName[FileNameLength]) &&
+            HandleCacheEqual(FileName, Entry->FileName, FileNameLength))
+        {
+            HandleCacheRemove(Ptfs, Entry);
+            Entry->HashNext = EvictList;
+            EvictList = Entry;
+        }
+    }
+
+    ReleaseSRWLockExclusive(&Ptfs->HandleCacheLock);
+
+    while (0 != EvictList)
+    {
+        Entry = EvictList;
+        EvictList = Entry->HashNext;
+        CloseHandle(Entry->Handle);
+        free(Entry);
+    }
+}
+
 static NTSTATUS GetFileInfoInternal(HANDLE Handle, FSP_FSCTL_FILE_INFO *FileInfo)
 {
     BY_HANDLE_FILE_INFORMATION ByHandleFileInfo;
@@ -103,6 +380,7 @@ static NTSTATUS GetSecurityByName(FSP_FILE_SYSTEM *FileSystem,
     PTFS *Ptfs = (PTFS *)FileSystem->UserContext;
     WCHAR FullPath[FULLPATH_SIZE];
     HANDLE Handle;
+    PTFS_HANDLE_ENTRY *CacheEntry;
     FILE_ATTRIBUTE_TAG_INFO AttributeTagInfo;
     DWORD SecurityDescriptorSizeNeeded;
     NTSTATUS Result;
@@ -110,9 +388,11 @@ static NTSTATUS GetSecurityByName(FSP_FILE_SYSTEM *FileSystem,
     if (!ConcatPath(Ptfs, FileName, FullPath))
         return STATUS_OBJECT_NAME_INVALID;
 
-    Handle = CreateFileW(FullPath,
-        FILE_READ_ATTRIBUTES | READ_CONTROL, 0, 0,
-        OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, 0);
+    Handle = HandleCacheCheckout(Ptfs, FileName, FILE_READ_ATTRIBUTES | READ_CONTROL, &CacheEntry);
+    if (INVALID_HANDLE_VALUE == Handle)
+        Handle = CreateFileW(FullPath,
+            FILE_READ_ATTRIBUTES | READ_CONTROL, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0,
+            OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, 0);
     if (INVALID_HANDLE_VALUE == Handle)
     {
         Result = FspNtStatusFromWin32(GetLastError());
@@ -148,8 +428,7 @@ static NTSTATUS GetSecurityByName(FSP_FILE_SYSTEM *FileSystem,
     Result = STATUS_SUCCESS;
 
 exit:
-    if (INVALID_HANDLE_VALUE != Handle)
-        CloseHandle(Handle);
+    HandleCacheCheckin(Ptfs, CacheEntry, Handle);
 
     return Result;
 }
@@ -198,13 +477,18 @@ static NTSTATUS Create(FSP_FILE_SYSTEM *FileSystem,
     if (0 == FileAttributes)
         FileAttributes = FILE_ATTRIBUTE_NORMAL;
 
+    if (!(CreateFlags & FILE_FLAG_DELETE_ON_CLOSE))
+        FileContext->CacheEntry = HandleCacheEntryCreate(Ptfs, FileName, GrantedAccess);
+
     FileContext->Handle = CreateFileW(FullPath,
         GrantedAccess, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, &SecurityAttributes,
         CREATE_NEW, CreateFlags | FileAttributes, 0);
     if (INVALID_HANDLE_VALUE == FileContext->Handle)
     {
+        NTSTATUS Result = FspNtStatusFromWin32(GetLastError());
+        HandleCacheCheckin(Ptfs, FileContext->CacheEntry, INVALID_HANDLE_VALUE);
         free(FileContext);
-        return FspNtStatusFromWin32(GetLastError());
+        return Result;
     }
 
     *PFileContext = FileContext;
@@ -233,13 +517,20 @@ static NTSTATUS Open(FSP_FILE_SYSTEM *FileSystem,
     if (CreateOptions & FILE_DELETE_ON_CLOSE)
         CreateFlags |= FILE_FLAG_DELETE_ON_CLOSE;
 
-    FileContext->Handle = CreateFileW(FullPath,
-        GrantedAccess, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0,
-        OPEN_EXISTING, CreateFlags, 0);
+    FileContext->Handle = INVALID_HANDLE_VALUE;
+    if (!(CreateFlags & FILE_FLAG_DELETE_ON_CLOSE))
+        FileContext->Handle = HandleCacheCheckout(Ptfs, FileName, GrantedAccess,
+            &FileContext->CacheEntry);
+    if (INVALID_HANDLE_VALUE == FileContext->Handle)
+        FileContext->Handle = CreateFileW(FullPath,
+            GrantedAccess, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0,
+            OPEN_EXISTING, CreateFlags, 0);
     if (INVALID_HANDLE_VALUE == FileContext->Handle)
     {
+        NTSTATUS Result = FspNtStatusFromWin32(GetLastError());
+        HandleCacheCheckin(Ptfs, FileContext->CacheEntry, INVALID_HANDLE_VALUE);
         free(FileContext);
-        return FspNtStatusFromWin32(GetLastError());
+        return Result;
     }
 
     *PFileContext = FileContext;
@@ -247,6 +538,77 @@ static NTSTATUS Open(FSP_FILE_SYSTEM *FileSystem,
     return GetFileInfoInternal(FileContext->Handle, FileInfo);
 }
 
+static NTSTATUS OpenWithSecurity(FSP_FILE_SYSTEM *FileSystem,
+    PWSTR FileName, UINT32 CreateOptions, UINT32 DesiredAccess,
+    PVOID *PFileContext, FSP_FSCTL_FILE_INFO *FileInfo,
+    PSECURITY_DESCRIPTOR SecurityDescriptor, SIZE_T *PSecurityDescriptorSize)
+{
+    PTFS *Ptfs = (PTFS *)FileSystem->UserContext;
+    WCHAR FullPath[FULLPATH_SIZE];
+    DWORD SecurityDescriptorSizeNeeded;
+    PTFS_FILE_CONTEXT *FileContext;
+    NTSTATUS Result;
+
+    /*
+     * The access check happens after the file is opened and the file is closed if it fails.
+     * A delete-on-close handle would delete the file when closed, so let the regular
+     * GetSecurityByName and Open path handle this case.
+     */
+    if (CreateOptions & FILE_DELETE_ON_CLOSE)
+        return STATUS_REPARSE;
+
+    if (!ConcatPath(Ptfs, FileName, FullPath))
+        return STATUS_OBJECT_NAME_INVALID;
+
+    FileContext = malloc(sizeof *FileContext);
+    if (0 == FileContext)
+        return STATUS_INSUFFICIENT_RESOURCES;
+    memset(FileContext, 0, sizeof *FileContext);
+
+    FileContext->Handle = HandleCacheCheckout(Ptfs, FileName, DesiredAccess | READ_CONTROL,
+        &FileContext->CacheEntry);
+    if (INVALID_HANDLE_VALUE == FileContext->Handle)
+        FileContext->Handle = CreateFileW(FullPath,
+            DesiredAccess | READ_CONTROL, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0,
+            OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, 0);
+    if (INVALID_HANDLE_VALUE == FileContext->Handle)
+    {
+        Result = FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+
+    if (!GetKernelObjectSecurity(FileContext->Handle,
+        OWNER_SECURITY_INFORMATION | GROUP_SECURITY_INFORMATION | DACL_SECURITY_INFORMATION,
+        SecurityDescriptor, (DWORD)*PSecurityDescriptorSize, &SecurityDescriptorSizeNeeded))
+    {
+        *PSecurityDescriptorSize = SecurityDescriptorSizeNeeded;
+        Result = ERROR_INSUFFICIENT_BUFFER == GetLastError() ?
+            STATUS_BUFFER_OVERFLOW : FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+
+    *PSecurityDescriptorSize = SecurityDescriptorSizeNeeded;
+
+    Result = GetFileInfoInternal(FileContext->Handle, FileInfo);
+    if (!NT_SUCCESS(Result))
+        goto exit;
+
+    *PFileContext = FileContext;
+    FileContext = 0;
+
+    Result = STATUS_SUCCESS;
+
+exit:
+    if (0 != FileContext)
+    {
+        /* a handle checked in here is reused when the FSD retries with a larger buffer */
+        HandleCacheCheckin(Ptfs, FileContext->CacheEntry, FileContext->Handle);
+        free(FileContext);
+    }
+
+    return Result;
+}
+
 static NTSTATUS Overwrite(FSP_FILE_SYSTEM *FileSystem,
     PVOID FileContext, UINT32 FileAttributes, BOOLEAN ReplaceFileAttributes, UINT64 AllocationSize,
     FSP_FSCTL_FILE_INFO *FileInfo)
@@ -256,6 +618,8 @@ static NTSTATUS Overwrite(FSP_FILE_SYSTEM *FileSystem,
     FILE_ALLOCATION_INFO AllocationInfo = { 0 };
     FILE_ATTRIBUTE_TAG_INFO AttributeTagInfo;
 
+    PtfsModified((PTFS *)FileSystem->UserContext);
+
     if (ReplaceFileAttributes)
     {
         if (0 == FileAttributes)
@@ -295,6 +659,9 @@ static VOID Cleanup(FSP_FILE_SYSTEM *FileSystem,
 
     if (Flags & FspCleanupDelete)
     {
+        /* close any idle handles first; the file is deleted when its last handle is closed */
+        HandleCacheInvalidate((PTFS *)FileSystem->UserContext, FileName);
+
         CloseHandle(Handle);
 
         /* this will make all future uses of Handle to fail with STATUS_INVALID_HANDLE */
@@ -308,19 +675,120 @@ static VOID Close(FSP_FILE_SYSTEM *FileSystem,
     PTFS_FILE_CONTEXT *FileContext = FileContext0;
     HANDLE Handle = HandleFromContext(FileContext);
 
-    CloseHandle(Handle);
+    HandleCacheCheckin((PTFS *)FileSystem->UserContext, FileContext->CacheEntry, Handle);
 
     FspFileSystemDeleteDirectoryBuffer(&FileContext->DirBuffer);
+    free(FileContext->Prefetch.Buffer);
     free(FileContext);
 }
 
+static BOOLEAN PrefetchRead(PTFS *Ptfs, PTFS_PREFETCH *Prefetch,
+    PVOID Buffer, UINT64 Offset, ULONG Length,
+    PULONG PBytesTransferred, PNTSTATUS PResult)
+{
+    BOOLEAN Hit = FALSE;
+
+    AcquireSRWLockShared(&Prefetch->Lock);
+
+    if (0 != Prefetch->Buffer &&
+        Ptfs->ModifyGeneration == Prefetch->Generation &&
+        Prefetch->Offset <= Offset &&
+        Prefetch->Offset + Prefetch->Length >= Offset &&
+        (Prefetch->Offset + Prefetch->Length >= Offset + Length || Prefetch->EndOfFile))
+    {
+        ULONG Skip = (ULONG)(Offset - Prefetch->Offset);
+        ULONG Bytes = Prefetch->Length - Skip;
+        if (Bytes > Length)
+            Bytes = Length;
+
+        memcpy(Buffer, Prefetch->Buffer + Skip, Bytes);
+        *PBytesTransferred = Bytes;
+        *PResult = 0 != Bytes || 0 == Length ? STATUS_SUCCESS : STATUS_END_OF_FILE;
+        Hit = TRUE;
+    }
+
+    ReleaseSRWLockShared(&Prefetch->Lock);
+
+    return Hit;
+}
+
+static NTSTATUS PrefetchFill(PTFS *Ptfs, HANDLE Handle, PTFS_PREFETCH *Prefetch,
+    PVOID Buffer, UINT64 Offset, ULONG Length, ULONG ReadAheadLength,
+    PULONG PBytesTransferred)
+{
+    LONG64 Generation = Ptfs->ModifyGeneration;
+    OVERLAPPED Overlapped = { 0 };
+    ULONG FillLength, BytesTransferred;
+    NTSTATUS Result;
+
+    FillLength = Ptfs->PrefetchMax - Length < ReadAheadLength ?
+        Ptfs->PrefetchMax : Length + ReadAheadLength;
+
+    AcquireSRWLockExclusive(&Prefetch->Lock);
+
+    if (Prefetch->Size < FillLength)
+    {
+        PUINT8 NewBuffer = realloc(Prefetch->Buffer, FillLength);
+        if (0 == NewBuffer)
+        {
+            Result = STATUS_INSUFFICIENT_RESOURCES;
+            goto exit;
+        }
+        Prefetch->Buffer = NewBuffer;
+        Prefetch->Size = FillLength;
+    }
+
+    /* invalidate while filling; a failed fill leaves the buffer unused */
+    Prefetch->Length = 0;
+    Prefetch->Generation = Generation - 1;
+
+    Overlapped.Offset = (DWORD)Offset;
+    Overlapped.OffsetHigh = (DWORD)(Offset >> 32);
+
+    if (!ReadFile(Handle, Prefetch->Buffer, FillLength, &BytesTransferred, &Overlapped))
+    {
+        Result = FspNtStatusFromWin32(GetLastError());
+        goto exit;
+    }
+
+    Prefetch->Offset = Offset;
+    Prefetch->Length = BytesTransferred;
+    Prefetch->EndOfFile = FillLength > BytesTransferred;
+    Prefetch->Generation = Generation;
+
+    *PBytesTransferred = Length < BytesTransferred ? Length : BytesTransferred;
+    memcpy(Buffer, Prefetch->Buffer, *PBytesTransferred);
+    Result = STATUS_SUCCESS;
+
+exit:
+    ReleaseSRWLockExclusive(&Prefetch->Lock);
+
+    return Result;
+}
+
 static NTSTATUS Read(FSP_FILE_SYSTEM *FileSystem,
     PVOID FileContext, PVOID Buffer, UINT64 Offset, ULONG Length,
     PULONG PBytesTransferred)
 {
+    PTFS *Ptfs = (PTFS *)FileSystem->UserContext;
     HANDLE Handle = HandleFromContext(FileContext);
     OVERLAPPED Overlapped = { 0 };
 
+    if (0 != Ptfs->PrefetchMax)
+    {
+        PTFS_PREFETCH *Prefetch = &((PTFS_FILE_CONTEXT *)FileContext)->Prefetch;
+        FSP_FSCTL_TRANSACT_REQ *Request = FspFileSystemGetOperationContext()->Request;
+        NTSTATUS Result;
+
+        if (PrefetchRead(Ptfs, Prefetch, Buffer, Offset, Length, PBytesTransferred, &Result))
+            return Result;
+
+        if (0 != Request->Req.Read.ReadAheadLength && Ptfs->PrefetchMax > Length)
+            return PrefetchFill(Ptfs, Handle, Prefetch,
+                Buffer, Offset, Length, Request->Req.Read.ReadAheadLength,
+                PBytesTransferred);
+    }
+
     Overlapped.Offset = (DWORD)Offset;
     Overlapped.OffsetHigh = (DWORD)(Offset >> 32);
 
@@ -339,6 +807,8 @@ static NTSTATUS Write(FSP_FILE_SYSTEM *FileSystem,
     LARGE_INTEGER FileSize;
     OVERLAPPED Overlapped = { 0 };
 
+    PtfsModified((PTFS *)FileSystem->UserContext);
+
     if (ConstrainedIo)
     {
         if (!GetFileSizeEx(Handle, &FileSize))
@@ -418,6 +888,8 @@ static NTSTATUS SetFileSize(FSP_FILE_SYSTEM *FileSystem,
     FILE_ALLOCATION_INFO AllocationInfo;
     FILE_END_OF_FILE_INFO EndOfFileInfo;
 
+    PtfsModified((PTFS *)FileSystem->UserContext);
+
     if (SetAllocationSize)
     {
         /*
@@ -462,6 +934,10 @@ static NTSTATUS Rename(FSP_FILE_SYSTEM *FileSystem,
     if (!ConcatPath(Ptfs, NewFileName, NewFullPath))
         return STATUS_OBJECT_NAME_INVALID;
 
+    /* idle handles below FileName prevent the rename; an idle handle on NewFileName the replace */
+    HandleCacheInvalidate(Ptfs, FileName);
+    HandleCacheInvalidate(Ptfs, NewFileName);
+
     if (!MoveFileExW(FullPath, NewFullPath, ReplaceIfExists ? MOVEFILE_REPLACE_EXISTING : 0))
         return FspNtStatusFromWin32(GetLastError());
 
@@ -542,7 +1018,9 @@ static NTSTATUS ReadDirectory(FSP_FILE_SYSTEM *FileSystem,
         memcpy(FullPath + Length, Pattern, PatternLength * sizeof(WCHAR));
         FullPath[Length + PatternLength] = L'\0';
 
-        FindHandle = FindFirstFileW(FullPath, &FindData);
+        /* the snapshot is taken once per enumeration (Marker == 0) and served from DirBuffer */
+        FindHandle = FindFirstFileExW(FullPath, FindExInfoBasic, &FindData,
+            FindExSearchNameMatch, 0, FIND_FIRST_EX_LARGE_FETCH);
         if (INVALID_HANDLE_VALUE != FindHandle)
         {
             do
@@ -591,6 +1069,9 @@ static NTSTATUS SetDelete(FSP_FILE_SYSTEM *FileSystem,
 
     DispositionInfo.DeleteFile = DeleteFile;
 
+    if (DeleteFile)
+        HandleCacheInvalidate((PTFS *)FileSystem->UserContext, FileName);
+
     if (!SetFileInformationByHandle(Handle,
         FileDispositionInfo, &DispositionInfo, sizeof DispositionInfo))
         return FspNtStatusFromWin32(GetLastError());
@@ -619,12 +1100,13 @@ static FSP_FILE_SYSTEM_INTERFACE PtfsInterface =
     .SetSecurity = SetSecurity,
     .ReadDirectory = ReadDirectory,
     .SetDelete = SetDelete,
+    .OpenWithSecurity = OpenWithSecurity,
 };
 
 static VOID PtfsDelete(PTFS *Ptfs);
 
 static NTSTATUS PtfsCreate(PWSTR Path, PWSTR VolumePrefix, PWSTR MountPoint, UINT32 DebugFlags,
-    PTFS **PPtfs)
+    ULONG PrefetchMax, ULONG HandleCacheMax, PTFS **PPtfs)
 {
     WCHAR FullPath[MAX_PATH];
     ULONG Length;
@@ -671,6 +1153,8 @@ static NTSTATUS PtfsCreate(PWSTR Path, PWSTR VolumePrefix, PWSTR MountPoint, UIN
         goto exit;
     }
     memset(Ptfs, 0, sizeof *Ptfs);
+    InitializeSRWLock(&Ptfs->HandleCacheLock);
+    Ptfs->HandleCacheList.Flink = Ptfs->HandleCacheList.Blink = &Ptfs->HandleCacheList;
 
     Length = (Length + 1) * sizeof(WCHAR);
     Ptfs->Path = malloc(Length);
@@ -680,6 +1164,8 @@ static NTSTATUS PtfsCreate(PWSTR Path, PWSTR VolumePrefix, PWSTR MountPoint, UIN
         goto exit;
     }
     memcpy(Ptfs->Path, FullPath, Length);
+    Ptfs->PrefetchMax = PrefetchMax;
+    Ptfs->HandleCacheMax = HandleCacheMax;
 
     memset(&VolumeParams, 0, sizeof VolumeParams);
     VolumeParams.SectorSize = ALLOCATION_UNIT;
@@ -731,6 +1217,9 @@ static VOID PtfsDelete(PTFS *Ptfs)
     if (0 != Ptfs->FileSystem)
         FspFileSystemDelete(Ptfs->FileSystem);
 
+    /* close all idle handles */
+    HandleCacheInvalidate(Ptfs, L"\\");
+
     if (0 != Ptfs->Path)
         free(Ptfs->Path);
 
@@ -784,6 +1273,8 @@ static NTSTATUS SvcStart(FSP_SERVICE *Service, ULONG argc, PWSTR *argv)
     wchar_t **argp, **arge;
     PWSTR DebugLogFile = 0;
     ULONG DebugFlags = 0;
+    ULONG PrefetchMax = 0;
+    ULONG HandleCacheMax = 0;
     PWSTR VolumePrefix = 0;
     PWSTR PassThrough = 0;
     PWSTR MountPoint = 0;
@@ -806,12 +1297,18 @@ static NTSTATUS SvcStart(FSP_SERVICE *Service, ULONG argc, PWSTR *argv)
         case L'D':
             argtos(DebugLogFile);
             break;
+        case L'H':
+            argtol(HandleCacheMax);
+            break;
         case L'm':
             argtos(MountPoint);
             break;
         case L'p':
             argtos(PassThrough);
             break;
+        case L'P':
+            argtol(PrefetchMax);
+            break;
         case L'u':
             argtos(VolumePrefix);
             break;
@@ -871,7 +1368,7 @@ static NTSTATUS SvcStart(FSP_SERVICE *Service, ULONG argc, PWSTR *argv)
         FspDebugLogSetHandle(DebugLogHandle);
     }
 
-    Result = PtfsCreate(PassThrough, VolumePrefix, MountPoint, DebugFlags, &Ptfs);
+    Result = PtfsCreate(PassThrough, VolumePrefix, MountPoint, DebugFlags, PrefetchMax, HandleCacheMax, &Ptfs);
     if (!NT_SUCCESS(Result))
     {
         fail(L"cannot create file system");
@@ -912,6 +1409,8 @@ usage:
         "    -D DebugLogFile     [file path; use - for stderr]\n"
         "    -u \\Server\\Share    [UNC prefix (single backslash)]\n"
         "    -p Directory        [directory to expose as pass through file system]\n"
+        "    -P PrefetchMax      [max bytes prefetched per file handle; 0: no prefetch]\n"
+        "    -H HandleCacheMax   [max idle backing handles kept open; 0: no handle cache]\n"
         "    -m MountPoint       [X:|*|directory]\n";
 
     fail(usage, L"" PROGNAME);
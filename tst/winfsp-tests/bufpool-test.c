@@ -0,0 +1,361 @@
+/**
+ * @file bufpool-test.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <winfsp/winfsp.h>
+#include <tlib/testsuite.h>
+#include <process.h>
+
+#include "winfsp-tests.h"
+
+#include <shared/ku/bufpool.c>
+
+/*
+ * In user mode the pool allocates buffers with VirtualAlloc in the current process; the
+ * process ids passed to it only partition the pool, which lets these tests simulate
+ * several file system processes.
+ */
+#define BUFPOOL_PID(N)                  ((HANDLE)(UINT_PTR)(0x1000 + 4 * (N)))
+
+static void bufpool_classes_test(void)
+{
+    FSP_BUFFER_POOL *Pool;
+    FSP_BUFFER_POOL_STATISTICS Statistics;
+    PVOID Cookie[4], Buffer[4], Cookie0, Buffer0;
+    NTSTATUS Result;
+
+    Result = FspBufferPoolCreate(1024 * 1024, 1, &Pool);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    /* small requests get a whole 64KB buffer, which is reused */
+    Result = FspBufferPoolAcquire(Pool, BUFPOOL_PID(0), 1, &Cookie[0], &Buffer[0]);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(0 != Cookie[0] && 0 != Buffer[0]);
+    memset(Buffer[0], 0xaa, 64 * 1024);
+    FspBufferPoolRelease(Pool, BUFPOOL_PID(0), Cookie[0], Buffer[0]);
+
+    Result = FspBufferPoolAcquire(Pool, BUFPOOL_PID(0), 60000, &Cookie0, &Buffer0);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(Buffer[0] == Buffer0);
+    Buffer[0] = Buffer0;
+    Cookie[0] = Cookie0;
+
+    /* other classes */
+    Result = FspBufferPoolAcquire(Pool, BUFPOOL_PID(0), 64 * 1024 + 1, &Cookie[1], &Buffer[1]);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(0 != Cookie[1] && Buffer[0] != Buffer[1]);
+    memset(Buffer[1], 0xbb, 128 * 1024);
+
+    Result = FspBufferPoolAcquire(Pool, BUFPOOL_PID(0), 1024 * 1024, &Cookie[2], &Buffer[2]);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(0 != Cookie[2]);
+    memset(Buffer[2], 0xcc, 1024 * 1024);
+
+    /* above the ceiling: not pooled */
+    Result = FspBufferPoolAcquire(Pool, BUFPOOL_PID(0), 1024 * 1024 + 1, &Cookie[3], &Buffer[3]);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(0 == Cookie[3] && 0 != Buffer[3]);
+    memset(Buffer[3], 0xdd, 1024 * 1024 + 1);
+
+    for (ULONG I = 0; 4 > I; I++)
+        FspBufferPoolRelease(Pool, BUFPOOL_PID(0), Cookie[I], Buffer[I]);
+
+    FspBufferPoolGetStatistics(Pool, &Statistics);
+    ASSERT(5 == Statistics.AcquireCount);
+    ASSERT(1 == Statistics.HitCount);
+    ASSERT(3 == Statistics.AllocateCount);
+    ASSERT(0 == Statistics.DeallocateCount);
+    ASSERT(1 == Statistics.UncachedCount);
+    ASSERT(3 == Statistics.CachedCount);
+
+    /* processes do not share buffers */
+    Result = FspBufferPoolAcquire(Pool, BUFPOOL_PID(1), 1, &Cookie0, &Buffer0);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(Buffer[0] != Buffer0);
+    FspBufferPoolRelease(Pool, BUFPOOL_PID(1), Cookie0, Buffer0);
+
+    FspBufferPoolDelete(Pool);
+}
+
+static void bufpool_adaptive_test(void)
+{
+    FSP_BUFFER_POOL *Pool;
+    FSP_BUFFER_POOL_STATISTICS Statistics;
+    PVOID Cookie[32], Buffer[32];
+    NTSTATUS Result;
+
+    Result = FspBufferPoolCreate(1024 * 1024, 1, &Pool);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    /* the number of cached buffers follows the observed concurrency */
+    for (ULONG I = 0; 8 > I; I++)
+    {
+        Result = FspBufferPoolAcquire(Pool, BUFPOOL_PID(0), 4096, &Cookie[I], &Buffer[I]);
+        ASSERT(STATUS_SUCCESS == Result);
+    }
+    for (ULONG I = 0; 8 > I; I++)
+        FspBufferPoolRelease(Pool, BUFPOOL_PID(0), Cookie[I], Buffer[I]);
+
+    FspBufferPoolGetStatistics(Pool, &Statistics);
+    ASSERT(8 == Statistics.CachedCount);
+    ASSERT(0 == Statistics.DeallocateCount);
+
+    /* ... and shrinks back when concurrency drops */
+    for (ULONG I = 0; 2 * FSP_BUFFER_POOL_WINDOW > I; I++)
+    {
+        Result = FspBufferPoolAcquire(Pool, BUFPOOL_PID(0), 4096, &Cookie[0], &Buffer[0]);
+        ASSERT(STATUS_SUCCESS == Result);
+        FspBufferPoolRelease(Pool, BUFPOOL_PID(0), Cookie[0], Buffer[0]);
+    }
+
+    FspBufferPoolGetStatistics(Pool, &Statistics);
+    ASSERT(1 == Statistics.CachedCount);
+    ASSERT(7 == Statistics.DeallocateCount);
+
+    /* large classes cache fewer buffers */
+    for (ULONG I = 0; 32 > I; I++)
+    {
+        Result = FspBufferPoolAcquire(Pool, BUFPOOL_PID(0), 1024 * 1024, &Cookie[I], &Buffer[I]);
+        ASSERT(STATUS_SUCCESS == Result);
+    }
+    for (ULONG I = 0; 32 > I; I++)
+        FspBufferPoolRelease(Pool, BUFPOOL_PID(0), Cookie[I], Buffer[I]);
+
+    FspBufferPoolGetStatistics(Pool, &Statistics);
+    ASSERT(1 + FSP_BUFFER_POOL_CACHE_SIZE_MAX / (1024 * 1024) == Statistics.CachedCount);
+
+    FspBufferPoolDelete(Pool);
+}
+
+static void bufpool_collect_test(void)
+{
+    FSP_BUFFER_POOL *Pool;
+    FSP_BUFFER_POOL_STATISTICS Statistics;
+    PVOID Cookie[2], Buffer[2];
+    NTSTATUS Result;
+
+    Result = FspBufferPoolCreate(1024 * 1024, 4, &Pool);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    for (ULONG I = 0; 2 > I; I++)
+    {
+        Result = FspBufferPoolAcquire(Pool, BUFPOOL_PID(0), 4096, &Cookie[I], &Buffer[I]);
+        ASSERT(STATUS_SUCCESS == Result);
+    }
+    FspBufferPoolRelease(Pool, BUFPOOL_PID(0), Cookie[0], Buffer[0]);
+
+    /* the process goes away while a buffer is still acquired */
+    FspBufferPoolCollect(Pool, BUFPOOL_PID(0));
+
+    FspBufferPoolGetStatistics(Pool, &Statistics);
+    ASSERT(0 == Statistics.CachedCount);
+
+    /* the same process id is reused by a new process before the buffer is released */
+    Result = FspBufferPoolAcquire(Pool, BUFPOOL_PID(0), 4096, &Cookie[0], &Buffer[0]);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    /* the old buffer must not end up in the new process */
+    FspBufferPoolRelease(Pool, BUFPOOL_PID(0), Cookie[1], Buffer[1]);
+    FspBufferPoolGetStatistics(Pool, &Statistics);
+    ASSERT(0 == Statistics.CachedCount);
+    ASSERT(1 == Statistics.DeallocateCount);
+
+    FspBufferPoolRelease(Pool, BUFPOOL_PID(0), Cookie[0], Buffer[0]);
+    FspBufferPoolGetStatistics(Pool, &Statistics);
+    ASSERT(1 == Statistics.CachedCount);
+
+    FspBufferPoolDelete(Pool);
+}
+
+#define BUFPOOL_STRESS_THREADS          8
+#define BUFPOOL_STRESS_COUNT            5000
+
+static FSP_BUFFER_POOL *bufpool_stress_pool;
+
+static unsigned __stdcall bufpool_stress_thread(void *Data)
+{
+    ULONG Index = (ULONG)(UINT_PTR)Data;
+    HANDLE ProcessId = BUFPOOL_PID(Index % 2);
+    PVOID Cookie[4], Buffer[4];
+    SIZE_T Size[4];
+    NTSTATUS Result;
+
+    srand(Index);
+
+    for (ULONG I = 0; BUFPOOL_STRESS_COUNT > I; I++)
+    {
+        ULONG Count = 1 + rand() % 4;
+
+        for (ULONG J = 0; Count > J; J++)
+        {
+            Size[J] = 1 + (SIZE_T)rand() * rand() % (2 * 1024 * 1024);
+            Result = FspBufferPoolAcquire(bufpool_stress_pool, ProcessId,
+                Size[J], &Cookie[J], &Buffer[J]);
+            ASSERT(STATUS_SUCCESS == Result);
+
+            /* a buffer is never handed out twice */
+            ((PULONG)Buffer[J])[0] = Index;
+            ((PUINT8)Buffer[J])[Size[J] - 1] = (UINT8)Index;
+        }
+
+        for (ULONG J = 0; Count > J; J++)
+        {
+            ASSERT(Index == ((PULONG)Buffer[J])[0]);
+            ASSERT((UINT8)Index == ((PUINT8)Buffer[J])[Size[J] - 1]);
+            FspBufferPoolRelease(bufpool_stress_pool, ProcessId, Cookie[J], Buffer[J]);
+        }
+    }
+
+    return 0;
+}
+
+static void bufpool_stress_test(void)
+{
+    HANDLE Threads[BUFPOOL_STRESS_THREADS];
+    FSP_BUFFER_POOL_STATISTICS Statistics;
+    SYSTEM_INFO SystemInfo;
+    NTSTATUS Result;
+
+    GetSystemInfo(&SystemInfo);
+
+    Result = FspBufferPoolCreate(1024 * 1024, SystemInfo.dwNumberOfProcessors,
+        &bufpool_stress_pool);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    for (ULONG I = 0; BUFPOOL_STRESS_THREADS > I; I++)
+    {
+        Threads[I] = (HANDLE)_beginthreadex(0, 0, bufpool_stress_thread, (PVOID)(UINT_PTR)I, 0, 0);
+        ASSERT(0 != Threads[I]);
+    }
+    WaitForMultipleObjects(BUFPOOL_STRESS_THREADS, Threads, TRUE, INFINITE);
+    for (ULONG I = 0; BUFPOOL_STRESS_THREADS > I; I++)
+        CloseHandle(Threads[I]);
+
+    FspBufferPoolGetStatistics(bufpool_stress_pool, &Statistics);
+    ASSERT(Statistics.AcquireCount ==
+        Statistics.HitCount + Statistics.AllocateCount + Statistics.UncachedCount);
+    ASSERT(Statistics.AllocateCount == Statistics.DeallocateCount + Statistics.CachedCount);
+
+    FspBufferPoolCollect(bufpool_stress_pool, BUFPOOL_PID(0));
+    FspBufferPoolCollect(bufpool_stress_pool, BUFPOOL_PID(1));
+    FspBufferPoolGetStatistics(bufpool_stress_pool, &Statistics);
+    ASSERT(0 == Statistics.CachedCount);
+
+    FspBufferPoolDelete(bufpool_stress_pool);
+    bufpool_stress_pool = 0;
+}
+
+#define BUFPOOL_BENCH_THREADS           4
+#define BUFPOOL_BENCH_COUNT             20000
+#define BUFPOOL_BENCH_SIZE              (1024 * 1024)
+
+static FSP_BUFFER_POOL *bufpool_bench_pool;
+
+static unsigned __stdcall bufpool_bench_thread(void *Data)
+{
+    PVOID Cookie, Buffer;
+    NTSTATUS Result;
+
+    for (ULONG I = 0; BUFPOOL_BENCH_COUNT > I; I++)
+    {
+        if (0 != bufpool_bench_pool)
+        {
+            Result = FspBufferPoolAcquire(bufpool_bench_pool, BUFPOOL_PID(0),
+                BUFPOOL_BENCH_SIZE, &Cookie, &Buffer);
+            ASSERT(STATUS_SUCCESS == Result);
+        }
+        else
+        {
+            /* what the FSD used to do for buffers larger than 64KB */
+            Buffer = VirtualAlloc(0, BUFPOOL_BENCH_SIZE, MEM_COMMIT, PAGE_READWRITE);
+            ASSERT(0 != Buffer);
+        }
+
+        /* touch every page like a file system filling a read buffer */
+        for (ULONG J = 0; BUFPOOL_BENCH_SIZE > J; J += 4096)
+            ((PUINT8)Buffer)[J] = (UINT8)J;
+
+        if (0 != bufpool_bench_pool)
+            FspBufferPoolRelease(bufpool_bench_pool, BUFPOOL_PID(0), Cookie, Buffer);
+        else
+            VirtualFree(Buffer, 0, MEM_RELEASE);
+    }
+
+    return 0;
+}
+
+static double bufpool_bench_run(void)
+{
+    HANDLE Threads[BUFPOOL_BENCH_THREADS];
+    LARGE_INTEGER Frequency, StartCounter, EndCounter;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&StartCounter);
+
+    for (ULONG I = 0; BUFPOOL_BENCH_THREADS > I; I++)
+    {
+        Threads[I] = (HANDLE)_beginthreadex(0, 0, bufpool_bench_thread, 0, 0, 0);
+        ASSERT(0 != Threads[I]);
+    }
+    WaitForMultipleObjects(BUFPOOL_BENCH_THREADS, Threads, TRUE, INFINITE);
+    for (ULONG I = 0; BUFPOOL_BENCH_THREADS > I; I++)
+        CloseHandle(Threads[I]);
+
+    QueryPerformanceCounter(&EndCounter);
+
+    return (double)(EndCounter.QuadPart - StartCounter.QuadPart) / Frequency.QuadPart;
+}
+
+static void bufpool_bench_test(void)
+{
+    FSP_BUFFER_POOL_STATISTICS Statistics;
+    SYSTEM_INFO SystemInfo;
+    double PoolSeconds, VirtualAllocSeconds;
+    NTSTATUS Result;
+
+    GetSystemInfo(&SystemInfo);
+
+    Result = FspBufferPoolCreate(1024 * 1024, SystemInfo.dwNumberOfProcessors,
+        &bufpool_bench_pool);
+    ASSERT(STATUS_SUCCESS == Result);
+    PoolSeconds = bufpool_bench_run();
+    FspBufferPoolGetStatistics(bufpool_bench_pool, &Statistics);
+    FspBufferPoolDelete(bufpool_bench_pool);
+    bufpool_bench_pool = 0;
+
+    VirtualAllocSeconds = bufpool_bench_run();
+
+    tlib_printf("1MB x %u x %u threads: pool=%.3fs (hits=%u%%) VirtualAlloc=%.3fs",
+        BUFPOOL_BENCH_COUNT, BUFPOOL_BENCH_THREADS,
+        PoolSeconds, (ULONG)(100 * Statistics.HitCount / Statistics.AcquireCount),
+        VirtualAllocSeconds);
+}
+
+void bufpool_tests(void)
+{
+    if (OptExternal)
+        return;
+
+    TEST(bufpool_classes_test);
+    TEST(bufpool_adaptive_test);
+    TEST(bufpool_collect_test);
+    TEST(bufpool_stress_test);
+    TEST_OPT(bufpool_bench_test);
+}
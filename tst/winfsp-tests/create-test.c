@@ -1396,6 +1396,336 @@ void create_pid_test(void)
         create_pid_dotest(MemfsNet, L"\\\\memfs\\share");
 }
 
+FSP_FILE_SYSTEM_OPERATION *create_negcache_CreateOp;
+volatile UINT32 create_negcache_Count;
+
+NTSTATUS create_negcache_Create(FSP_FILE_SYSTEM *FileSystem,
+    FSP_FSCTL_TRANSACT_REQ *Request, FSP_FSCTL_TRANSACT_RSP *Response)
+{
+    InterlockedIncrement(&create_negcache_Count);
+    return create_negcache_CreateOp(FileSystem, Request, Response);
+}
+
+static void create_negcache_stats(HANDLE Handle, PUINT32 PHits, PUINT32 PMisses)
+{
+    UINT8 Buffer[64 * 1024];
+    FILESYSTEM_STATISTICS *Base;
+    FSP_FSCTL_STATISTICS *WinFsp;
+    DWORD BytesTransferred;
+    BOOL Success;
+
+    *PHits = *PMisses = 0;
+
+    Success = DeviceIoControl(Handle, FSCTL_FILESYSTEM_GET_STATISTICS,
+        0, 0, Buffer, sizeof Buffer, &BytesTransferred, 0);
+    ASSERT(Success);
+
+    /* one record per processor; WinFsp stats follow the FAT stats */
+    for (ULONG Offset = 0; BytesTransferred > Offset; Offset += Base->SizeOfCompleteStructure)
+    {
+        Base = (FILESYSTEM_STATISTICS *)(Buffer + Offset);
+        ASSERT(sizeof(FILESYSTEM_STATISTICS) + sizeof(FAT_STATISTICS) + sizeof(FSP_FSCTL_STATISTICS) <=
+            Base->SizeOfCompleteStructure);
+        WinFsp = (FSP_FSCTL_STATISTICS *)((PUINT8)Base +
+            sizeof(FILESYSTEM_STATISTICS) + sizeof(FAT_STATISTICS));
+        *PHits += WinFsp->NegativeLookupHits;
+        *PMisses += WinFsp->NegativeLookupMisses;
+    }
+}
+
+void create_negcache_dotest(ULONG Flags, PWSTR Prefix)
+{
+    void *memfs = memfs_start(Flags | MemfsNegativeLookup);
+
+    FSP_FILE_SYSTEM *FileSystem = MemfsFileSystem(memfs);
+    create_negcache_CreateOp = FileSystem->Operations[FspFsctlTransactCreateKind];
+    FileSystem->Operations[FspFsctlTransactCreateKind] = create_negcache_Create;
+
+    HANDLE RootHandle, Handle;
+    BOOL Success;
+    UINT32 Count, Hits0, Misses0, Hits, Misses;
+    WCHAR RootPath[MAX_PATH], FilePath[MAX_PATH], File2Path[MAX_PATH];
+
+    StringCbPrintfW(RootPath, sizeof RootPath, L"%s%s\\",
+        Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs));
+    StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\\file0",
+        Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs));
+    StringCbPrintfW(File2Path, sizeof File2Path, L"%s%s\\file2",
+        Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs));
+
+    RootHandle = CreateFileW(RootPath,
+        FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0,
+        OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, 0);
+    ASSERT(INVALID_HANDLE_VALUE != RootHandle);
+
+    create_negcache_stats(RootHandle, &Hits0, &Misses0);
+
+    /* first failed open goes to the file system; second one is answered from the cache */
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE == Handle);
+    ASSERT(ERROR_FILE_NOT_FOUND == GetLastError());
+
+    Count = create_negcache_Count;
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE == Handle);
+    ASSERT(ERROR_FILE_NOT_FOUND == GetLastError());
+    ASSERT(Count == create_negcache_Count);
+
+    create_negcache_stats(RootHandle, &Hits, &Misses);
+    ASSERT(Hits0 + 1 <= Hits);
+    ASSERT(Misses0 + 1 <= Misses);
+
+    /* creating the file invalidates the cached name */
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE != Handle);
+    CloseHandle(Handle);
+
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE != Handle);
+    CloseHandle(Handle);
+
+    /* renaming onto a cached name invalidates it */
+    Handle = CreateFileW(File2Path,
+        GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE == Handle);
+    ASSERT(ERROR_FILE_NOT_FOUND == GetLastError());
+
+    Success = MoveFileExW(FilePath, File2Path, 0);
+    ASSERT(Success);
+
+    Handle = CreateFileW(File2Path,
+        GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE != Handle);
+    CloseHandle(Handle);
+
+    /* the original name is now cached; renaming back onto it must invalidate it again */
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE == Handle);
+    ASSERT(ERROR_FILE_NOT_FOUND == GetLastError());
+
+    Success = MoveFileExW(File2Path, FilePath, 0);
+    ASSERT(Success);
+
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE, 0);
+    ASSERT(INVALID_HANDLE_VALUE != Handle);
+    CloseHandle(Handle);
+
+    CloseHandle(RootHandle);
+
+    memfs_stop(memfs);
+}
+
+void create_negcache_test(void)
+{
+    if (NtfsTests)
+        return;
+
+    if (WinFspDiskTests)
+        create_negcache_dotest(MemfsDisk, 0);
+    if (WinFspNetTests)
+        create_negcache_dotest(MemfsNet, L"\\\\memfs\\share");
+}
+
+static FSP_FILE_SYSTEM_INTERFACE create_openwithsec_Interface;
+static const FSP_FILE_SYSTEM_INTERFACE *create_openwithsec_OrigInterface;
+static volatile UINT32 create_openwithsec_GetSecurityByNameCount;
+static volatile UINT32 create_openwithsec_OpenWithSecurityCount;
+
+static NTSTATUS create_openwithsec_GetSecurityByName(FSP_FILE_SYSTEM *FileSystem,
+    PWSTR FileName, PUINT32 PFileAttributes,
+    PSECURITY_DESCRIPTOR SecurityDescriptor, SIZE_T *PSecurityDescriptorSize)
+{
+    InterlockedIncrement(&create_openwithsec_GetSecurityByNameCount);
+    return create_openwithsec_OrigInterface->GetSecurityByName(FileSystem,
+        FileName, PFileAttributes, SecurityDescriptor, PSecurityDescriptorSize);
+}
+
+static NTSTATUS create_openwithsec_OpenWithSecurity(FSP_FILE_SYSTEM *FileSystem,
+    PWSTR FileName, UINT32 CreateOptions, UINT32 DesiredAccess,
+    PVOID *PFileContext, FSP_FSCTL_FILE_INFO *FileInfo,
+    PSECURITY_DESCRIPTOR SecurityDescriptor, SIZE_T *PSecurityDescriptorSize)
+{
+    InterlockedIncrement(&create_openwithsec_OpenWithSecurityCount);
+    return create_openwithsec_OrigInterface->OpenWithSecurity(FileSystem,
+        FileName, CreateOptions, DesiredAccess, PFileContext, FileInfo,
+        SecurityDescriptor, PSecurityDescriptorSize);
+}
+
+static void create_openwithsec_hook(FSP_FILE_SYSTEM *FileSystem, BOOLEAN OpenWithSecurity)
+{
+    create_openwithsec_OrigInterface = FileSystem->Interface;
+    create_openwithsec_Interface = *FileSystem->Interface;
+    create_openwithsec_Interface.GetSecurityByName = create_openwithsec_GetSecurityByName;
+    create_openwithsec_Interface.OpenWithSecurity = OpenWithSecurity ?
+        create_openwithsec_OpenWithSecurity : 0;
+    create_openwithsec_GetSecurityByNameCount = 0;
+    create_openwithsec_OpenWithSecurityCount = 0;
+    FileSystem->Interface = &create_openwithsec_Interface;
+}
+
+static void create_openwithsec_unhook(FSP_FILE_SYSTEM *FileSystem)
+{
+    FileSystem->Interface = create_openwithsec_OrigInterface;
+}
+
+void create_openwithsec_dotest(ULONG Flags, PWSTR Prefix)
+{
+    void *memfs = memfs_start(Flags);
+
+    FSP_FILE_SYSTEM *FileSystem = MemfsFileSystem(memfs);
+    HANDLE Handle;
+    BOOL Success;
+    WCHAR FilePath[MAX_PATH], File2Path[MAX_PATH];
+    PSECURITY_DESCRIPTOR SecurityDescriptor;
+    SECURITY_ATTRIBUTES SecurityAttributes = { 0 };
+    UINT32 Count;
+
+    if (0 == FileSystem->Interface->OpenWithSecurity)
+    {
+        memfs_stop(memfs);
+        return;
+    }
+
+    StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\file0",
+        Prefix ? L"" : L"\\?\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs));
+    StringCbPrintfW(File2Path, sizeof File2Path, L"%s%s\file2",
+        Prefix ? L"" : L"\\?\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs));
+
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE != Handle);
+    CloseHandle(Handle);
+
+    /* only the owner's implicit READ_CONTROL/WRITE_DAC and SYSTEM's full access */
+    Success = ConvertStringSecurityDescriptorToSecurityDescriptorW(
+        L"O:BAG:BAD:P(A;;FA;;;SY)", SDDL_REVISION_1, &SecurityDescriptor, 0);
+    ASSERT(Success);
+    SecurityAttributes.nLength = sizeof SecurityAttributes;
+    SecurityAttributes.lpSecurityDescriptor = SecurityDescriptor;
+    Handle = CreateFileW(File2Path,
+        GENERIC_READ | GENERIC_WRITE, 0, &SecurityAttributes, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE != Handle);
+    CloseHandle(Handle);
+    LocalFree(SecurityDescriptor);
+
+    create_openwithsec_hook(FileSystem, TRUE);
+
+    /* opening an existing file does not go through GetSecurityByName */
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE != Handle);
+    CloseHandle(Handle);
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ, 0, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE != Handle);
+    ASSERT(ERROR_ALREADY_EXISTS == GetLastError());
+    CloseHandle(Handle);
+    ASSERT(2 <= create_openwithsec_OpenWithSecurityCount);
+    ASSERT(0 == create_openwithsec_GetSecurityByNameCount);
+
+    /* the access check still applies; the file is closed again when it fails */
+    Handle = CreateFileW(File2Path,
+        GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE == Handle);
+    ASSERT(ERROR_ACCESS_DENIED == GetLastError());
+    Handle = CreateFileW(File2Path,
+        READ_CONTROL, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE != Handle);
+    CloseHandle(Handle);
+
+    /* a missing file is reported as such and can then be created */
+    Count = create_openwithsec_OpenWithSecurityCount;
+    Success = DeleteFileW(FilePath);
+    ASSERT(Success);
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE == Handle);
+    ASSERT(ERROR_FILE_NOT_FOUND == GetLastError());
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ, 0, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE != Handle);
+    ASSERT(ERROR_ALREADY_EXISTS != GetLastError());
+    CloseHandle(Handle);
+    ASSERT(Count < create_openwithsec_OpenWithSecurityCount);
+
+    create_openwithsec_unhook(FileSystem);
+
+    memfs_stop(memfs);
+}
+
+void create_openwithsec_test(void)
+{
+    if (NtfsTests)
+        return;
+
+    if (WinFspDiskTests)
+        create_openwithsec_dotest(MemfsDisk, 0);
+    if (WinFspNetTests)
+        create_openwithsec_dotest(MemfsNet, L"\\memfs\share");
+}
+
+void create_openwithsec_bench_dotest(ULONG Flags, PWSTR Prefix)
+{
+    void *memfs = memfs_start(Flags);
+
+    FSP_FILE_SYSTEM *FileSystem = MemfsFileSystem(memfs);
+    HANDLE Handle;
+    WCHAR FilePath[MAX_PATH];
+    LARGE_INTEGER Frequency, StartCounter, EndCounter;
+    double Seconds[2];
+    ULONG Iterations = 10000;
+
+    StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\file0",
+        Prefix ? L"" : L"\\?\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs));
+
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ | GENERIC_WRITE, 0, 0, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE != Handle);
+    CloseHandle(Handle);
+
+    QueryPerformanceFrequency(&Frequency);
+
+    for (int Combined = 0; 2 > Combined; Combined++)
+    {
+        create_openwithsec_hook(FileSystem, !!Combined);
+
+        QueryPerformanceCounter(&StartCounter);
+        for (ULONG I = 0; Iterations > I; I++)
+        {
+            Handle = CreateFileW(FilePath,
+                GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+            ASSERT(INVALID_HANDLE_VALUE != Handle);
+            CloseHandle(Handle);
+        }
+        QueryPerformanceCounter(&EndCounter);
+        Seconds[Combined] = (double)(EndCounter.QuadPart - StartCounter.QuadPart) / Frequency.QuadPart;
+
+        create_openwithsec_unhook(FileSystem);
+    }
+
+    tlib_printf("open/close: GetSecurityByName+Open=%.0f/s OpenWithSecurity=%.0f/s",
+        Iterations / Seconds[0], Iterations / Seconds[1]);
+
+    memfs_stop(memfs);
+}
+
+void create_openwithsec_bench_test(void)
+{
+    if (NtfsTests)
+        return;
+
+    if (WinFspDiskTests)
+        create_openwithsec_bench_dotest(MemfsDisk, 0);
+    if (WinFspNetTests)
+        create_openwithsec_bench_dotest(MemfsNet, L"\\memfs\share");
+}
+
 void create_tests(void)
 {
     TEST(create_test);
@@ -1415,4 +1745,11 @@ void create_tests(void)
         TEST(create_namelen_test);
     if (!NtfsTests)
         TEST(create_pid_test);
+    if (!NtfsTests && !OptExternal)
+        TEST(create_negcache_test);
+    if (!NtfsTests && !OptExternal)
+    {
+        TEST(create_openwithsec_test);
+        TEST_OPT(create_openwithsec_bench_test);
+    }
 }
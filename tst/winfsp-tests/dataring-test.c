@@ -0,0 +1,265 @@
+/**
+ * @file dataring-test.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <winfsp/winfsp.h>
+#include <tlib/testsuite.h>
+#include <process.h>
+
+#include "winfsp-tests.h"
+
+#include <shared/ku/dataring.c>
+
+static void dataring_create_test(void)
+{
+    static UINT8 Buffer[4 * 16];
+    FSP_DATA_RING *DataRing;
+    NTSTATUS Result;
+
+    Result = FspDataRingCreate(Buffer, 16, 0, &DataRing);
+    ASSERT(STATUS_INVALID_PARAMETER == Result);
+    ASSERT(0 == DataRing);
+
+    Result = FspDataRingCreate(Buffer, 16, 3, &DataRing);
+    ASSERT(STATUS_INVALID_PARAMETER == Result);
+    ASSERT(0 == DataRing);
+
+    Result = FspDataRingCreate(Buffer, 0, 4, &DataRing);
+    ASSERT(STATUS_INVALID_PARAMETER == Result);
+    ASSERT(0 == DataRing);
+
+    Result = FspDataRingCreate(Buffer, 16, FspFsctlDataRingSlotCountMaximum * 2, &DataRing);
+    ASSERT(STATUS_INVALID_PARAMETER == Result);
+    ASSERT(0 == DataRing);
+
+    Result = FspDataRingCreate(Buffer, 16, 4, &DataRing);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(0 != DataRing);
+    ASSERT(16 == FspDataRingSlotSize(DataRing));
+
+    FspDataRingDelete(DataRing);
+}
+
+static void dataring_acquire_release_test(void)
+{
+    static UINT8 Buffer[4 * 16];
+    FSP_DATA_RING *DataRing;
+    ULONG Sequence[5];
+    PVOID Address[5];
+    ULONG AcquireCount, ReleaseCount, FullCount;
+    BOOLEAN Success;
+    NTSTATUS Result;
+
+    Result = FspDataRingCreate(Buffer, 16, 4, &DataRing);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    /* acquire all slots; each slot is handed out exactly once */
+    for (ULONG I = 0; 4 > I; I++)
+    {
+        Success = FspDataRingAcquire(DataRing, &Sequence[I], &Address[I]);
+        ASSERT(Success);
+        ASSERT(Buffer <= (PUINT8)Address[I] && Buffer + sizeof Buffer > (PUINT8)Address[I]);
+        ASSERT(0 == ((PUINT8)Address[I] - Buffer) % 16);
+        for (ULONG J = 0; I > J; J++)
+        {
+            ASSERT(Address[J] != Address[I]);
+            ASSERT(Sequence[J] != Sequence[I]);
+        }
+    }
+
+    /* ring is full */
+    Success = FspDataRingAcquire(DataRing, &Sequence[4], &Address[4]);
+    ASSERT(!Success);
+    ASSERT(0 == Address[4]);
+
+    /* release out of order */
+    Success = FspDataRingRelease(DataRing, Sequence[2], Address[2]);
+    ASSERT(Success);
+
+    /* duplicate release is rejected */
+    Success = FspDataRingRelease(DataRing, Sequence[2], Address[2]);
+    ASSERT(!Success);
+
+    /* release with wrong sequence is rejected */
+    Success = FspDataRingRelease(DataRing, Sequence[1] + 1, Address[1]);
+    ASSERT(!Success);
+
+    /* release of address outside the ring or not at a slot boundary is rejected */
+    Success = FspDataRingRelease(DataRing, Sequence[1], Buffer + sizeof Buffer);
+    ASSERT(!Success);
+    Success = FspDataRingRelease(DataRing, Sequence[1], (PUINT8)Address[1] + 1);
+    ASSERT(!Success);
+
+    /* the released slot is reacquired even though the head points at busy slots */
+    Success = FspDataRingAcquire(DataRing, &Sequence[4], &Address[4]);
+    ASSERT(Success);
+    ASSERT(Address[2] == Address[4]);
+    ASSERT(Sequence[2] != Sequence[4]);
+
+    /* a stale release of the previous owner does not free the new owner's slot */
+    Success = FspDataRingRelease(DataRing, Sequence[2], Address[2]);
+    ASSERT(!Success);
+
+    Success = FspDataRingRelease(DataRing, Sequence[0], Address[0]);
+    ASSERT(Success);
+    Success = FspDataRingRelease(DataRing, Sequence[1], Address[1]);
+    ASSERT(Success);
+    Success = FspDataRingRelease(DataRing, Sequence[3], Address[3]);
+    ASSERT(Success);
+    Success = FspDataRingRelease(DataRing, Sequence[4], Address[4]);
+    ASSERT(Success);
+
+    FspDataRingGetStatistics(DataRing, &AcquireCount, &ReleaseCount, &FullCount);
+    ASSERT(5 == AcquireCount);
+    ASSERT(5 == ReleaseCount);
+    ASSERT(1 == FullCount);
+
+    FspDataRingDelete(DataRing);
+}
+
+static void dataring_wrap_test(void)
+{
+    static UINT8 Buffer[2 * 16];
+    FSP_DATA_RING *DataRing;
+    ULONG Sequence;
+    PVOID Address;
+    BOOLEAN Success;
+    NTSTATUS Result;
+
+    Result = FspDataRingCreate(Buffer, 16, 2, &DataRing);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    /* force the head and the sequence numbers to wrap around */
+    DataRing->Head = (LONG)0xfffffff0;
+    for (ULONG I = 0; 64 > I; I++)
+    {
+        Success = FspDataRingAcquire(DataRing, &Sequence, &Address);
+        ASSERT(Success);
+        ASSERT(0x7fffffff >= Sequence);
+        Success = FspDataRingRelease(DataRing, Sequence, Address);
+        ASSERT(Success);
+    }
+
+    FspDataRingDelete(DataRing);
+}
+
+#define DATARING_STRESS_THREADS         8
+#define DATARING_STRESS_ITERATIONS      20000
+
+typedef struct
+{
+    FSP_DATA_RING *DataRing;
+    ULONG SlotSize;
+    ULONG ThreadIndex;
+    ULONG AcquireCount, FullCount, ErrorCount;
+} DATARING_STRESS_ARGS;
+
+static unsigned __stdcall dataring_stress_thread(void *Args0)
+{
+    DATARING_STRESS_ARGS *Args = Args0;
+    ULONG Sequence;
+    PVOID Address;
+
+    for (ULONG I = 0; DATARING_STRESS_ITERATIONS > I; I++)
+    {
+        if (!FspDataRingAcquire(Args->DataRing, &Sequence, &Address))
+        {
+            Args->FullCount++;
+            SwitchToThread();
+            continue;
+        }
+        Args->AcquireCount++;
+
+        /* we own the slot exclusively: nobody else may modify it until we release it */
+        memset(Address, (int)Args->ThreadIndex, Args->SlotSize);
+        if (0 == I % 7)
+            SwitchToThread();
+        for (ULONG J = 0; Args->SlotSize > J; J++)
+            if (Args->ThreadIndex != ((PUINT8)Address)[J])
+            {
+                Args->ErrorCount++;
+                break;
+            }
+
+        if (!FspDataRingRelease(Args->DataRing, Sequence, Address))
+            Args->ErrorCount++;
+    }
+
+    return 0;
+}
+
+static void dataring_stress_test(void)
+{
+    enum { SlotSize = 64, SlotCount = 4 };
+    static UINT8 Buffer[SlotSize * SlotCount];
+    FSP_DATA_RING *DataRing;
+    DATARING_STRESS_ARGS Args[DATARING_STRESS_THREADS];
+    HANDLE Threads[DATARING_STRESS_THREADS];
+    ULONG AcquireCount, ReleaseCount, FullCount, TotalAcquireCount, TotalFullCount;
+    NTSTATUS Result;
+
+    Result = FspDataRingCreate(Buffer, SlotSize, SlotCount, &DataRing);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    /* more threads than slots, so that the ring is frequently full */
+    for (ULONG I = 0; DATARING_STRESS_THREADS > I; I++)
+    {
+        memset(&Args[I], 0, sizeof Args[I]);
+        Args[I].DataRing = DataRing;
+        Args[I].SlotSize = SlotSize;
+        Args[I].ThreadIndex = I + 1;
+        Threads[I] = (HANDLE)_beginthreadex(0, 0, dataring_stress_thread, &Args[I], 0, 0);
+        ASSERT(0 != Threads[I]);
+    }
+
+    WaitForMultipleObjects(DATARING_STRESS_THREADS, Threads, TRUE, INFINITE);
+
+    TotalAcquireCount = TotalFullCount = 0;
+    for (ULONG I = 0; DATARING_STRESS_THREADS > I; I++)
+    {
+        CloseHandle(Threads[I]);
+        ASSERT(0 == Args[I].ErrorCount);
+        TotalAcquireCount += Args[I].AcquireCount;
+        TotalFullCount += Args[I].FullCount;
+    }
+
+    FspDataRingGetStatistics(DataRing, &AcquireCount, &ReleaseCount, &FullCount);
+    ASSERT(TotalAcquireCount == AcquireCount);
+    ASSERT(TotalAcquireCount == ReleaseCount);
+    ASSERT(TotalFullCount == FullCount);
+    ASSERT(DATARING_STRESS_THREADS * DATARING_STRESS_ITERATIONS == AcquireCount + FullCount);
+
+    /* all slots are free again */
+    for (ULONG I = 0; SlotCount > I; I++)
+        ASSERT(0 == (DataRing->State[I] & 1));
+
+    FspDataRingDelete(DataRing);
+}
+
+void dataring_tests(void)
+{
+    if (OptExternal)
+        return;
+
+    TEST(dataring_create_test);
+    TEST(dataring_acquire_release_test);
+    TEST(dataring_wrap_test);
+    TEST(dataring_stress_test);
+}
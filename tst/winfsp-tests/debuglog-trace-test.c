@@ -0,0 +1,353 @@
+/**
+ * @file debuglog-trace-test.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <winfsp/winfsp.h>
+#include <tlib/testsuite.h>
+#include <process.h>
+#include "memfs.h"
+
+#include "winfsp-tests.h"
+
+static char *debuglog_trace_readfile(HANDLE Handle, PULONG PSize)
+{
+    LARGE_INTEGER FileSize;
+    DWORD BytesTransferred;
+    char *Buffer;
+
+    ASSERT(GetFileSizeEx(Handle, &FileSize));
+    ASSERT(0 == FileSize.HighPart);
+    Buffer = malloc(FileSize.LowPart + 1);
+    ASSERT(0 != Buffer);
+
+    ASSERT(INVALID_SET_FILE_POINTER != SetFilePointer(Handle, 0, 0, FILE_BEGIN));
+    ASSERT(ReadFile(Handle, Buffer, FileSize.LowPart, &BytesTransferred, 0));
+    ASSERT(FileSize.LowPart == BytesTransferred);
+    Buffer[BytesTransferred] = '\0';
+
+    *PSize = BytesTransferred;
+    return Buffer;
+}
+
+static ULONG debuglog_trace_count(const char *Text, const char *Pattern)
+{
+    ULONG Count = 0;
+
+    for (const char *P = Text; 0 != (P = strstr(P, Pattern)); P++)
+        Count++;
+
+    return Count;
+}
+
+static void debuglog_trace_log(ULONG Index)
+{
+    union
+    {
+        FSP_FSCTL_TRANSACT_REQ V;
+        UINT8 B[sizeof(FSP_FSCTL_TRANSACT_REQ) + 64];
+    } RequestBuf;
+    FSP_FSCTL_TRANSACT_REQ *Request = &RequestBuf.V;
+    FSP_FSCTL_TRANSACT_RSP Response;
+
+    memset(&RequestBuf, 0, sizeof RequestBuf);
+    Request->Version = sizeof(FSP_FSCTL_TRANSACT_REQ);
+    Request->Size = sizeof(FSP_FSCTL_TRANSACT_REQ) + sizeof L"\\file.txt";
+    Request->Kind = FspFsctlTransactReadKind;
+    Request->Hint = 0x1000 + Index;
+    Request->Req.Read.UserContext = 0x42;
+    Request->Req.Read.Offset = 4096 * Index;
+    Request->Req.Read.Length = 4096;
+    Request->FileName.Offset = 0;
+    Request->FileName.Size = sizeof L"\\file.txt";
+    memcpy(Request->Buffer, L"\\file.txt", sizeof L"\\file.txt");
+    FspDebugLogRequest(Request);
+
+    memset(&Response, 0, sizeof Response);
+    Response.Size = sizeof Response;
+    Response.Kind = FspFsctlTransactReadKind;
+    Response.Hint = Request->Hint;
+    Response.IoStatus.Status = 0 == Index % 3 ? STATUS_END_OF_FILE : STATUS_SUCCESS;
+    Response.IoStatus.Information = 0 == Index % 3 ? 0 : 4096;
+    FspDebugLogResponse(&Response);
+
+    /* pending responses are not logged */
+    Response.IoStatus.Status = STATUS_PENDING;
+    FspDebugLogResponse(&Response);
+}
+
+static void debuglog_trace_roundtrip_test(void)
+{
+    HANDLE TextHandle, TraceHandle, DecodeHandle;
+    char *Text, *Decode;
+    ULONG TextSize, DecodeSize;
+    UINT64 RecordCount, DroppedCount;
+    NTSTATUS Result;
+
+    /* log directly as text */
+    TextHandle = trace_tempfile();
+    FspDebugLogSetHandle(TextHandle);
+    for (ULONG I = 0; 100 > I; I++)
+        debuglog_trace_log(I);
+
+    /* log the same requests into a binary trace */
+    TraceHandle = trace_tempfile();
+    Result = FspDebugLogStartTrace(TraceHandle);
+    ASSERT(STATUS_SUCCESS == Result);
+    Result = FspDebugLogStartTrace(TraceHandle);
+    ASSERT(STATUS_INVALID_DEVICE_STATE == Result);
+    for (ULONG I = 0; 100 > I; I++)
+        debuglog_trace_log(I);
+    FspDebugLogStopTrace();
+
+    FspDebugLogGetTraceStatistics(&RecordCount, &DroppedCount);
+    ASSERT(200 == RecordCount);
+    ASSERT(0 == DroppedCount);
+
+    /* decode the trace; the result must be identical to the text log */
+    DecodeHandle = trace_tempfile();
+    FspDebugLogSetHandle(DecodeHandle);
+    ASSERT(INVALID_SET_FILE_POINTER != SetFilePointer(TraceHandle, 0, 0, FILE_BEGIN));
+    Result = FspDebugLogDecodeTrace(TraceHandle, 0);
+    ASSERT(STATUS_SUCCESS == Result);
+    FspDebugLogSetHandle(INVALID_HANDLE_VALUE);
+
+    Text = debuglog_trace_readfile(TextHandle, &TextSize);
+    Decode = debuglog_trace_readfile(DecodeHandle, &DecodeSize);
+    ASSERT(0 != TextSize);
+    ASSERT(TextSize == DecodeSize);
+    ASSERT(0 == memcmp(Text, Decode, TextSize));
+    ASSERT(100 == debuglog_trace_count(Text, ">>Read"));
+    ASSERT(100 == debuglog_trace_count(Text, "<<Read"));
+    free(Decode);
+    free(Text);
+
+    /* not a trace file */
+    ASSERT(INVALID_SET_FILE_POINTER != SetFilePointer(TextHandle, 0, 0, FILE_BEGIN));
+    Result = FspDebugLogDecodeTrace(TextHandle, 0);
+    ASSERT(STATUS_INVALID_IMAGE_FORMAT == Result);
+
+    CloseHandle(DecodeHandle);
+    CloseHandle(TraceHandle);
+    CloseHandle(TextHandle);
+}
+
+#define DEBUGLOG_TRACE_OVERFLOW_THREADS 4
+#define DEBUGLOG_TRACE_OVERFLOW_COUNT   20000
+
+static unsigned __stdcall debuglog_trace_overflow_thread(void *Args)
+{
+    for (ULONG I = 0; DEBUGLOG_TRACE_OVERFLOW_COUNT > I; I++)
+        debuglog_trace_log(I);
+
+    return 0;
+}
+
+static void debuglog_trace_overflow_test(void)
+{
+    HANDLE TraceHandle, DecodeHandle;
+    HANDLE Threads[DEBUGLOG_TRACE_OVERFLOW_THREADS];
+    char *Decode;
+    ULONG DecodeSize;
+    UINT64 RecordCount, DroppedCount;
+    NTSTATUS Result;
+
+    TraceHandle = trace_tempfile();
+    Result = FspDebugLogStartTrace(TraceHandle);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    /* producers run much faster than the writer; records are dropped but never lost */
+    for (ULONG I = 0; DEBUGLOG_TRACE_OVERFLOW_THREADS > I; I++)
+    {
+        Threads[I] = (HANDLE)_beginthreadex(0, 0, debuglog_trace_overflow_thread, 0, 0, 0);
+        ASSERT(0 != Threads[I]);
+    }
+    WaitForMultipleObjects(DEBUGLOG_TRACE_OVERFLOW_THREADS, Threads, TRUE, INFINITE);
+    for (ULONG I = 0; DEBUGLOG_TRACE_OVERFLOW_THREADS > I; I++)
+        CloseHandle(Threads[I]);
+
+    FspDebugLogStopTrace();
+
+    FspDebugLogGetTraceStatistics(&RecordCount, &DroppedCount);
+    ASSERT(DEBUGLOG_TRACE_OVERFLOW_THREADS * DEBUGLOG_TRACE_OVERFLOW_COUNT * 2 ==
+        RecordCount + DroppedCount);
+
+    /* every recorded record is in the trace file */
+    DecodeHandle = trace_tempfile();
+    FspDebugLogSetHandle(DecodeHandle);
+    ASSERT(INVALID_SET_FILE_POINTER != SetFilePointer(TraceHandle, 0, 0, FILE_BEGIN));
+    Result = FspDebugLogDecodeTrace(TraceHandle, FspDebugLogDecodeTimestamps);
+    ASSERT(STATUS_SUCCESS == Result);
+    FspDebugLogSetHandle(INVALID_HANDLE_VALUE);
+
+    Decode = debuglog_trace_readfile(DecodeHandle, &DecodeSize);
+    ASSERT(RecordCount ==
+        debuglog_trace_count(Decode, ">>Read") + debuglog_trace_count(Decode, "<<Read"));
+    ASSERT((0 == DroppedCount) == (0 == debuglog_trace_count(Decode, "records dropped")));
+    free(Decode);
+
+    CloseHandle(DecodeHandle);
+    CloseHandle(TraceHandle);
+}
+
+static void debuglog_trace_nodrop_test(void)
+{
+    HANDLE TraceHandle;
+    HANDLE Threads[DEBUGLOG_TRACE_OVERFLOW_THREADS];
+    UINT64 RecordCount, DroppedCount;
+    NTSTATUS Result;
+
+    TraceHandle = trace_tempfile();
+    Result = FspDebugLogStartTraceEx(TraceHandle, FspDebugLogTraceNoDrop);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    /* same load as the overflow test; producers now wait for the writer instead */
+    for (ULONG I = 0; DEBUGLOG_TRACE_OVERFLOW_THREADS > I; I++)
+    {
+        Threads[I] = (HANDLE)_beginthreadex(0, 0, debuglog_trace_overflow_thread, 0, 0, 0);
+        ASSERT(0 != Threads[I]);
+    }
+    WaitForMultipleObjects(DEBUGLOG_TRACE_OVERFLOW_THREADS, Threads, TRUE, INFINITE);
+    for (ULONG I = 0; DEBUGLOG_TRACE_OVERFLOW_THREADS > I; I++)
+        CloseHandle(Threads[I]);
+
+    FspDebugLogStopTrace();
+
+    FspDebugLogGetTraceStatistics(&RecordCount, &DroppedCount);
+    ASSERT(DEBUGLOG_TRACE_OVERFLOW_THREADS * DEBUGLOG_TRACE_OVERFLOW_COUNT * 2 == RecordCount);
+    ASSERT(0 == DroppedCount);
+
+    CloseHandle(TraceHandle);
+}
+
+static void debuglog_trace_replay_test(void)
+{
+    HANDLE TraceHandle;
+    MEMFS *Memfs;
+    FSP_FILE_SYSTEM_REPLAY_STATISTICS Statistics;
+    NTSTATUS Result;
+
+    /* record a session: the recorded file context 0x1000 is not the one MEMFS will use */
+    TraceHandle = trace_tempfile();
+    Result = FspDebugLogStartTraceEx(TraceHandle, FspDebugLogTraceNoDrop);
+    ASSERT(STATUS_SUCCESS == Result);
+    trace_record(FspFsctlTransactCreateKind, 1, 0, STATUS_SUCCESS, 0x1000);
+    trace_record(FspFsctlTransactWriteKind, 2, 0x1000, STATUS_SUCCESS, 0);
+    trace_record(FspFsctlTransactReadKind, 3, 0x1000, STATUS_SUCCESS, 0);
+    trace_record(FspFsctlTransactReadKind, 4, 0x2000, STATUS_SUCCESS, 0);
+    trace_record(FspFsctlTransactCleanupKind, 5, 0x1000, STATUS_SUCCESS, 0);
+    trace_record(FspFsctlTransactCloseKind, 6, 0x1000, STATUS_SUCCESS, 0);
+    trace_record(FspFsctlTransactReadKind, 7, 0x1000, STATUS_SUCCESS, 0);
+    FspDebugLogStopTrace();
+
+    /* replay it against a MEMFS that is not attached to the FSD */
+    Memfs = memfs_create_detached();
+
+    ASSERT(INVALID_SET_FILE_POINTER != SetFilePointer(TraceHandle, 0, 0, FILE_BEGIN));
+    Result = FspFileSystemReplayTrace(MemfsFileSystem(Memfs), TraceHandle, 0, &Statistics);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(5 == Statistics.RequestCount);
+    ASSERT(2 == Statistics.SkippedCount);   /* unknown context; context after Close */
+    ASSERT(0 == Statistics.MismatchCount);
+    ASSERT(0 == Statistics.PendingCount);
+    ASSERT(0 == Statistics.DroppedCount);
+
+    /* a detached file system cannot be mounted, dispatched or notified */
+    Result = FspFileSystemSetMountPoint(MemfsFileSystem(Memfs), 0);
+    ASSERT(STATUS_INVALID_DEVICE_REQUEST == Result);
+    Result = FspFileSystemStartDispatcher(MemfsFileSystem(Memfs), 0);
+    ASSERT(STATUS_INVALID_DEVICE_REQUEST == Result);
+    Result = FspFileSystemNotifyBegin(MemfsFileSystem(Memfs), 0);
+    ASSERT(STATUS_INVALID_DEVICE_REQUEST == Result);
+    Result = FspFileSystemNotifyEnd(MemfsFileSystem(Memfs));
+    ASSERT(STATUS_INVALID_DEVICE_REQUEST == Result);
+
+    MemfsDelete(Memfs);
+
+    CloseHandle(TraceHandle);
+}
+
+static void debuglog_trace_replay_corrupt_test(void)
+{
+    union
+    {
+        FSP_FSCTL_TRANSACT_REQ V;
+        UINT8 B[sizeof(FSP_FSCTL_TRANSACT_REQ) + 64];
+    } RequestBuf;
+    FSP_FSCTL_TRANSACT_REQ *Request = &RequestBuf.V;
+    HANDLE TraceHandle;
+    MEMFS *Memfs;
+    FSP_FILE_SYSTEM_REPLAY_STATISTICS Statistics;
+    NTSTATUS Result;
+
+    TraceHandle = trace_tempfile();
+    Result = FspDebugLogStartTraceEx(TraceHandle, FspDebugLogTraceNoDrop);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    /* file name extends past the end of the request */
+    memset(&RequestBuf, 0, sizeof RequestBuf);
+    Request->Version = sizeof(FSP_FSCTL_TRANSACT_REQ);
+    Request->Size = sizeof(FSP_FSCTL_TRANSACT_REQ) + sizeof L"\\file.txt";
+    Request->Kind = FspFsctlTransactCreateKind;
+    Request->Hint = 1;
+    Request->FileName.Offset = 0;
+    Request->FileName.Size = 0x1000;
+    memcpy(Request->Buffer, L"\\file.txt", sizeof L"\\file.txt");
+    Request->Req.Create.CreateOptions = FILE_OPEN_IF << 24;
+    FspDebugLogRequest(Request);
+
+    /* file name is not NUL-terminated */
+    Request->Hint = 2;
+    Request->FileName.Size = sizeof L"\\file.txt" - sizeof(WCHAR);
+    FspDebugLogRequest(Request);
+
+    /* query directory pattern out of bounds */
+    Request->Hint = 3;
+    Request->Kind = FspFsctlTransactQueryDirectoryKind;
+    Request->FileName.Size = 0;
+    Request->Req.QueryDirectory.Pattern.Offset = 0xfff0;
+    Request->Req.QueryDirectory.Pattern.Size = 0x20;
+    FspDebugLogRequest(Request);
+
+    FspDebugLogStopTrace();
+
+    Memfs = memfs_create_detached();
+
+    ASSERT(INVALID_SET_FILE_POINTER != SetFilePointer(TraceHandle, 0, 0, FILE_BEGIN));
+    Result = FspFileSystemReplayTrace(MemfsFileSystem(Memfs), TraceHandle, 0, &Statistics);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(0 == Statistics.RequestCount);
+    ASSERT(3 == Statistics.SkippedCount);
+
+    MemfsDelete(Memfs);
+
+    CloseHandle(TraceHandle);
+}
+
+void debuglog_trace_tests(void)
+{
+    if (OptExternal)
+        return;
+
+    TEST(debuglog_trace_roundtrip_test);
+    TEST_OPT(debuglog_trace_overflow_test);
+    TEST_OPT(debuglog_trace_nodrop_test);
+    TEST(debuglog_trace_replay_test);
+    TEST(debuglog_trace_replay_corrupt_test);
+}
@@ -501,6 +501,85 @@ static void dirbuf_boundary_test(void)
     dirbuf_boundary_dotest(L"G", 0, 0, L"B", L"D", L"F", 0);
 }
 
+static void dirbuf_pattern_dotest(PWSTR Pattern, BOOLEAN CaseInsensitive, PWSTR Marker,
+    ULONG ExpectN, ...)
+{
+    static PWSTR Names[] = { L"a.txt", L"b.doc", L"c.txt", L"d.txt.bak", L"e.tx", 0 };
+    PVOID DirBuffer = 0;
+    FSP_FILE_NAME_PATTERN *CompiledPattern;
+    NTSTATUS Result;
+    BOOLEAN Success;
+    union
+    {
+        UINT8 B[sizeof(FSP_FSCTL_DIR_INFO) + MAX_PATH * sizeof(WCHAR)];
+        FSP_FSCTL_DIR_INFO D;
+    } DirInfoBuf;
+    FSP_FSCTL_DIR_INFO *DirInfo = &DirInfoBuf.D, *DirInfoEnd;
+    UINT8 Buffer[1024];
+    ULONG Length, BytesTransferred;
+    WCHAR CurrFileName[MAX_PATH];
+    ULONG N;
+    va_list Expect;
+
+    Length = sizeof Buffer;
+
+    Result = FspFileNamePatternCompile(Pattern, (ULONG)-1, CaseInsensitive, &CompiledPattern);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    Result = STATUS_UNSUCCESSFUL;
+    Success = FspFileSystemAcquireDirectoryBuffer(&DirBuffer, FALSE, &Result);
+    ASSERT(Success);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    for (PWSTR *Name = Names; 0 != *Name; Name++)
+    {
+        memset(&DirInfoBuf, 0, sizeof DirInfoBuf);
+        DirInfo->Size = (UINT16)(sizeof(FSP_FSCTL_DIR_INFO) + wcslen(*Name) * sizeof(WCHAR));
+        wcscpy_s(DirInfo->FileNameBuf, MAX_PATH, *Name);
+        Success = FspFileSystemFillDirectoryBuffer(&DirBuffer, DirInfo, &Result);
+        ASSERT(Success);
+        ASSERT(STATUS_SUCCESS == Result);
+    }
+
+    FspFileSystemReleaseDirectoryBuffer(&DirBuffer);
+
+    BytesTransferred = 0;
+    FspFileSystemReadDirectoryBufferEx(&DirBuffer, CompiledPattern, Marker,
+        Buffer, Length, &BytesTransferred);
+
+    va_start(Expect, ExpectN);
+    for (N = 0,
+        DirInfo = (PVOID)Buffer, DirInfoEnd = (PVOID)(Buffer + BytesTransferred);
+        DirInfoEnd > DirInfo && 0 != DirInfo->Size;
+        DirInfo = (PVOID)((PUINT8)DirInfo + FSP_FSCTL_DEFAULT_ALIGN_UP(DirInfo->Size)), N++)
+    {
+        memcpy(CurrFileName, DirInfo->FileNameBuf, DirInfo->Size - sizeof *DirInfo);
+        CurrFileName[(DirInfo->Size - sizeof *DirInfo) / sizeof(WCHAR)] = L'\0';
+
+        ASSERT(ExpectN > N);
+        ASSERT(0 == wcscmp(CurrFileName, va_arg(Expect, PWSTR)));
+    }
+    ASSERT(ExpectN == N);
+    va_end(Expect);
+
+    FspFileSystemDeleteDirectoryBuffer(&DirBuffer);
+    FspFileNamePatternDelete(CompiledPattern);
+}
+
+static void dirbuf_pattern_test(void)
+{
+    dirbuf_pattern_dotest(L"*", FALSE, 0, 5,
+        L"a.txt", L"b.doc", L"c.txt", L"d.txt.bak", L"e.tx");
+    dirbuf_pattern_dotest(L"*.txt", FALSE, 0, 2, L"a.txt", L"c.txt");
+    dirbuf_pattern_dotest(L"*.TXT", FALSE, 0, 0);
+    dirbuf_pattern_dotest(L"*.TXT", TRUE, 0, 2, L"a.txt", L"c.txt");
+    dirbuf_pattern_dotest(L"*.txt", FALSE, L"a.txt", 1, L"c.txt");
+    dirbuf_pattern_dotest(L"*.txt", FALSE, L"c.txt", 0);
+    dirbuf_pattern_dotest(L"?.tx?", FALSE, 0, 2, L"a.txt", L"c.txt");
+    dirbuf_pattern_dotest(L"*.tx*", FALSE, 0, 4, L"a.txt", L"c.txt", L"d.txt.bak", L"e.tx");
+    dirbuf_pattern_dotest(L"b.doc", FALSE, 0, 1, L"b.doc");
+}
+
 void dirbuf_tests(void)
 {
     if (OptExternal)
@@ -511,4 +590,5 @@ void dirbuf_tests(void)
     TEST(dirbuf_fill_test);
     TEST(dirbuf_presort_fill_test);
     TEST(dirbuf_boundary_test);
+    TEST(dirbuf_pattern_test);
 }
@@ -521,6 +521,331 @@ static void querydir_nodup_test(void)
 #endif
 }
 
+static volatile LONG querydir_parallel_errors;
+static unsigned __stdcall querydir_parallel_dotest_thread(void *FilePath)
+{
+    void *Buffer;
+    HANDLE Handle;
+    IO_STATUS_BLOCK IoStatus;
+    NTSTATUS Result;
+    ULONG Count, ExpectedCount = 0;
+
+    Buffer = malloc(4096);
+    if (0 == Buffer)
+    {
+        InterlockedIncrement(&querydir_parallel_errors);
+        return 1;
+    }
+
+    for (size_t i = 0; 1000 > i; i++)
+    {
+        Handle = CreateFileW(
+            FilePath,
+            FILE_LIST_DIRECTORY,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            0,
+            OPEN_EXISTING,
+            FILE_FLAG_BACKUP_SEMANTICS,
+            0);
+        if (INVALID_HANDLE_VALUE == Handle)
+        {
+            InterlockedIncrement(&querydir_parallel_errors);
+            break;
+        }
+
+        Count = 0;
+        for (;;)
+        {
+            Result = NtQueryDirectoryFile(
+                Handle,
+                0, 0, 0,
+                &IoStatus,
+                Buffer,
+                4096,
+                1/*FileDirectoryInformation*/,
+                FALSE,
+                0,
+                FALSE);
+            if (STATUS_NO_MORE_FILES == Result)
+                break;
+            if (!NT_SUCCESS(Result))
+            {
+                InterlockedIncrement(&querydir_parallel_errors);
+                break;
+            }
+
+            for (FILE_DIRECTORY_INFORMATION *DirInfo = Buffer;;
+                DirInfo = (PVOID)((PUINT8)DirInfo + DirInfo->NextEntryOffset))
+            {
+                Count++;
+                if (0 == DirInfo->NextEntryOffset)
+                    break;
+            }
+        }
+
+        CloseHandle(Handle);
+
+        /* every enumeration must see the same entries */
+        if (0 == ExpectedCount)
+            ExpectedCount = Count;
+        else if (ExpectedCount != Count)
+            InterlockedIncrement(&querydir_parallel_errors);
+    }
+
+    free(Buffer);
+
+    return 0;
+}
+
+static void querydir_parallel_dotest(ULONG Flags, PWSTR Prefix, ULONG FileInfoTimeout)
+{
+    void *memfs = memfs_start_ex(Flags, FileInfoTimeout);
+
+    HANDLE Handle;
+    BOOL Success;
+    WCHAR FilePath[MAX_PATH];
+    HANDLE Threads[8];
+    ULONG ThreadCount;
+    LARGE_INTEGER Frequency, StartCounter, EndCounter;
+
+    StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\\dir0",
+        Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs));
+    Success = CreateDirectoryW(FilePath, 0);
+    ASSERT(Success);
+
+    for (size_t i = 0; 256 > i; i++)
+    {
+        StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\\dir0\\file%u",
+            Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs),
+            (unsigned)i);
+        Handle = CreateFileW(FilePath, GENERIC_ALL, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+        ASSERT(INVALID_HANDLE_VALUE != Handle);
+        Success = CloseHandle(Handle);
+        ASSERT(Success);
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+
+    StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\\dir0",
+        Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs));
+    for (ThreadCount = 1; sizeof Threads / sizeof Threads[0] >= ThreadCount; ThreadCount *= 2)
+    {
+        querydir_parallel_errors = 0;
+
+        QueryPerformanceCounter(&StartCounter);
+        for (ULONG i = 0; ThreadCount > i; i++)
+        {
+            Threads[i] = (HANDLE)_beginthreadex(0, 0, querydir_parallel_dotest_thread, FilePath, 0, 0);
+            ASSERT(0 != Threads[i]);
+        }
+        for (ULONG i = 0; ThreadCount > i; i++)
+        {
+            WaitForSingleObject(Threads[i], INFINITE);
+            CloseHandle(Threads[i]);
+        }
+        QueryPerformanceCounter(&EndCounter);
+
+        ASSERT(0 == querydir_parallel_errors);
+
+        tlib_printf("%u threads: %.0f enumerations/s, ", ThreadCount,
+            1000.0 * ThreadCount * Frequency.QuadPart / (EndCounter.QuadPart - StartCounter.QuadPart));
+    }
+
+    for (size_t i = 0; 256 > i; i++)
+    {
+        StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\\dir0\\file%u",
+            Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs),
+            (unsigned)i);
+        Success = DeleteFileW(FilePath);
+        ASSERT(Success);
+    }
+
+    StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\\dir0",
+        Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs));
+    Success = RemoveDirectoryW(FilePath);
+    ASSERT(Success);
+
+    memfs_stop(memfs);
+}
+
+static void querydir_parallel_test(void)
+{
+    /*
+     * Enumerate the same directory from an increasing number of threads, each using its
+     * own handle. With the DirInfo cache primed these enumerations are answered under a
+     * shared directory lock and should scale with the number of threads.
+     */
+
+    if (NtfsTests)
+    {
+        WCHAR DirBuf[MAX_PATH];
+        GetTestDirectory(DirBuf);
+        querydir_parallel_dotest(-1, DirBuf, 0);
+    }
+    if (WinFspDiskTests)
+    {
+        querydir_parallel_dotest(MemfsDisk | MemfsNoSlowio, 0, 0);
+        querydir_parallel_dotest(MemfsDisk | MemfsNoSlowio, 0, 1000);
+    }
+    if (WinFspNetTests)
+    {
+        querydir_parallel_dotest(MemfsNet | MemfsNoSlowio, L"\\\\memfs\\share", 0);
+        querydir_parallel_dotest(MemfsNet | MemfsNoSlowio, L"\\\\memfs\\share", 1000);
+    }
+}
+
+#define QUERYDIR_SAMEHANDLE_COUNT       256
+static volatile LONG querydir_samehandle_counts[QUERYDIR_SAMEHANDLE_COUNT + 1];
+static volatile LONG querydir_samehandle_errors;
+static unsigned __stdcall querydir_samehandle_dotest_thread(void *Handle)
+{
+    union
+    {
+        FILE_DIRECTORY_INFORMATION V;
+        UINT8 B[sizeof(FILE_DIRECTORY_INFORMATION) + MAX_PATH * sizeof(WCHAR)];
+    } Buffer;
+    IO_STATUS_BLOCK IoStatus;
+    NTSTATUS Result;
+    WCHAR FileName[MAX_PATH + 2];
+    wchar_t *endp;
+    ULONG Index;
+
+    for (;;)
+    {
+        /* one entry at a time, so that the two threads interleave on the same cursor */
+        Result = NtQueryDirectoryFile(
+            Handle,
+            0, 0, 0,
+            &IoStatus,
+            &Buffer,
+            sizeof Buffer,
+            1/*FileDirectoryInformation*/,
+            TRUE,
+            0,
+            FALSE);
+        if (STATUS_NO_MORE_FILES == Result)
+            break;
+        if (!NT_SUCCESS(Result))
+        {
+            InterlockedIncrement(&querydir_samehandle_errors);
+            break;
+        }
+
+        memcpy(FileName, Buffer.V.FileName, Buffer.V.FileNameLength);
+        FileName[Buffer.V.FileNameLength / sizeof(WCHAR)] = L'\0';
+        if (0 == wcscmp(FileName, L".") || 0 == wcscmp(FileName, L".."))
+            InterlockedIncrement(&querydir_samehandle_counts[QUERYDIR_SAMEHANDLE_COUNT]);
+        else if (0 == wcsncmp(FileName, L"file", 4) &&
+            QUERYDIR_SAMEHANDLE_COUNT > (Index = wcstoul(FileName + 4, &endp, 10)) &&
+            L'\0' == *endp)
+            InterlockedIncrement(&querydir_samehandle_counts[Index]);
+        else
+            InterlockedIncrement(&querydir_samehandle_errors);
+    }
+
+    return 0;
+}
+
+static void querydir_samehandle_dotest(ULONG Flags, PWSTR Prefix, ULONG FileInfoTimeout)
+{
+    void *memfs = memfs_start_ex(Flags, FileInfoTimeout);
+
+    HANDLE Handle;
+    BOOL Success;
+    WCHAR FilePath[MAX_PATH];
+    HANDLE Threads[2];
+
+    StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\\dir0",
+        Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs));
+    Success = CreateDirectoryW(FilePath, 0);
+    ASSERT(Success);
+
+    for (size_t i = 0; QUERYDIR_SAMEHANDLE_COUNT > i; i++)
+    {
+        StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\\dir0\\file%u",
+            Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs),
+            (unsigned)i);
+        Handle = CreateFileW(FilePath, GENERIC_ALL, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+        ASSERT(INVALID_HANDLE_VALUE != Handle);
+        Success = CloseHandle(Handle);
+        ASSERT(Success);
+    }
+
+    StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\\dir0",
+        Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs));
+    for (ULONG Pass = 0; 2 > Pass; Pass++)
+    {
+        /* second pass: the DirInfo cache (if enabled) is primed */
+        Handle = CreateFileW(FilePath,
+            FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0,
+            OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, 0);
+        ASSERT(INVALID_HANDLE_VALUE != Handle);
+
+        memset((PVOID)querydir_samehandle_counts, 0, sizeof querydir_samehandle_counts);
+        querydir_samehandle_errors = 0;
+
+        for (ULONG i = 0; sizeof Threads / sizeof Threads[0] > i; i++)
+        {
+            Threads[i] = (HANDLE)_beginthreadex(0, 0, querydir_samehandle_dotest_thread, Handle, 0, 0);
+            ASSERT(0 != Threads[i]);
+        }
+        for (ULONG i = 0; sizeof Threads / sizeof Threads[0] > i; i++)
+        {
+            WaitForSingleObject(Threads[i], INFINITE);
+            CloseHandle(Threads[i]);
+        }
+
+        CloseHandle(Handle);
+
+        /* the threads share one cursor: every entry is returned exactly once */
+        ASSERT(0 == querydir_samehandle_errors);
+        for (ULONG i = 0; QUERYDIR_SAMEHANDLE_COUNT > i; i++)
+            ASSERT(1 == querydir_samehandle_counts[i]);
+        ASSERT(2 == querydir_samehandle_counts[QUERYDIR_SAMEHANDLE_COUNT]);
+    }
+
+    for (size_t i = 0; QUERYDIR_SAMEHANDLE_COUNT > i; i++)
+    {
+        StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\\dir0\\file%u",
+            Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs),
+            (unsigned)i);
+        Success = DeleteFileW(FilePath);
+        ASSERT(Success);
+    }
+
+    StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\\dir0",
+        Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs));
+    Success = RemoveDirectoryW(FilePath);
+    ASSERT(Success);
+
+    memfs_stop(memfs);
+}
+
+static void querydir_samehandle_test(void)
+{
+    /*
+     * Enumerate a directory from two threads that share a single handle. The directory
+     * cursor is per handle, so the two threads must split the entries between them.
+     */
+
+    if (NtfsTests)
+    {
+        WCHAR DirBuf[MAX_PATH];
+        GetTestDirectory(DirBuf);
+        querydir_samehandle_dotest(-1, DirBuf, 0);
+    }
+    if (WinFspDiskTests)
+    {
+        querydir_samehandle_dotest(MemfsDisk, 0, 0);
+        querydir_samehandle_dotest(MemfsDisk, 0, 1000);
+    }
+    if (WinFspNetTests)
+    {
+        querydir_samehandle_dotest(MemfsNet, L"\\\\memfs\\share", 0);
+        querydir_samehandle_dotest(MemfsNet, L"\\\\memfs\\share", 1000);
+    }
+}
+
 static void querydir_single_dotest(ULONG Flags, PWSTR Prefix, ULONG FileInfoTimeout, ULONG SleepTimeout)
 {
     void *memfs = memfs_start_ex(Flags, FileInfoTimeout);
@@ -989,6 +1314,8 @@ void dirctl_tests(void)
 {
     TEST(querydir_test);
     TEST_OPT(querydir_nodup_test);
+    TEST_OPT(querydir_parallel_test);
+    TEST(querydir_samehandle_test);
     if (!OptShareName)
         TEST_OPT(querydir_single_test);
     TEST(querydir_expire_cache_test);
@@ -0,0 +1,286 @@
+/**
+ * @file hpp-test.cpp
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <winfsp/winfsp.hpp>
+
+extern "C" {
+#include <tlib/testsuite.h>
+
+#include "winfsp-tests.h"
+}
+
+using namespace Fsp;
+
+/*
+ * The file systems below are never mounted. Their interfaces are called directly with a
+ * FSP_FILE_SYSTEM whose UserContext points to the file system object, the same way that
+ * FileSystemHost sets it up.
+ *
+ * The interface slot matrix is checked at run time (hpp_interface_test) and the dispatch
+ * benchmark is a TEST_OPT; both run as part of winfsp-tests on Windows only, because
+ * winfsp.hpp requires the Windows SDK headers.
+ */
+
+class hpp_VirtualFs : public FileSystemBase
+{
+public:
+    hpp_VirtualFs() : Reads(0)
+    {
+    }
+    ULONG Reads;
+
+protected:
+    NTSTATUS Read(
+        PVOID FileNode,
+        PVOID FileDesc,
+        PVOID Buffer,
+        UINT64 Offset,
+        ULONG Length,
+        PULONG PBytesTransferred)
+    {
+        Reads++;
+        *PBytesTransferred = Length;
+        return STATUS_SUCCESS;
+    }
+};
+
+class hpp_StaticFs : public FileSystemBaseT<hpp_StaticFs>
+{
+    friend class FileSystemInterfaceT<hpp_StaticFs>;
+
+public:
+    hpp_StaticFs() : Reads(0)
+    {
+    }
+    ULONG Reads;
+
+protected:
+    NTSTATUS Read(
+        PVOID FileNode,
+        PVOID FileDesc,
+        PVOID Buffer,
+        UINT64 Offset,
+        ULONG Length,
+        PULONG PBytesTransferred)
+    {
+        Reads++;
+        *PBytesTransferred = Length;
+        return STATUS_SUCCESS;
+    }
+    NTSTATUS GetFileInfo(
+        PVOID FileNode,
+        PVOID FileDesc,
+        FileInfo *FileInfo)
+    {
+        throw 42;
+    }
+};
+
+class hpp_EmptyFs : public FileSystemBaseT<hpp_EmptyFs>
+{
+};
+
+class hpp_DirEntryFs : public FileSystemBaseT<hpp_DirEntryFs>
+{
+    friend class FileSystemInterfaceT<hpp_DirEntryFs>;
+
+protected:
+    NTSTATUS ReadDirectoryEntry(
+        PVOID FileNode,
+        PVOID FileDesc,
+        PWSTR Pattern,
+        PWSTR Marker,
+        PVOID *PContext,
+        DirInfo *DirInfo)
+    {
+        UINT_PTR Index = (UINT_PTR)*PContext;
+        if (2 <= Index)
+            return STATUS_NO_MORE_FILES;
+        memset(DirInfo, 0, sizeof *DirInfo);
+        DirInfo->Size = (UINT16)(FIELD_OFFSET(FileSystemBase::DirInfo, FileNameBuf) + sizeof(WCHAR));
+        DirInfo->FileNameBuf[0] = (WCHAR)(L'a' + Index);
+        *PContext = (PVOID)(Index + 1);
+        return STATUS_SUCCESS;
+    }
+};
+
+class hpp_ReparseFs : public FileSystemBaseT<hpp_ReparseFs>
+{
+public:
+    NTSTATUS GetReparsePointByName(
+        PWSTR FileName,
+        BOOLEAN IsDirectory,
+        PVOID Buffer,
+        PSIZE_T PSize)
+    {
+        return STATUS_NOT_A_REPARSE_POINT;
+    }
+};
+
+static void hpp_interface_test(void)
+{
+    FSP_FILE_SYSTEM_INTERFACE *Interface;
+    PVOID *Slot;
+
+    Interface = FileSystemBaseT<hpp_EmptyFs>::Interface();
+    for (Slot = (PVOID *)Interface; (PVOID *)(Interface + 1) > Slot; Slot++)
+        ASSERT(0 == *Slot);
+
+    Interface = FileSystemBaseT<hpp_StaticFs>::Interface();
+    ASSERT(0 != Interface->Read);
+    ASSERT(0 != Interface->GetFileInfo);
+    ASSERT(0 == Interface->GetSecurityByName);
+    ASSERT(0 == Interface->Open);
+    ASSERT(0 == Interface->Cleanup);
+    ASSERT(0 == Interface->Close);
+    ASSERT(0 == Interface->Write);
+    ASSERT(0 == Interface->ReadDirectory);
+    ASSERT(0 == Interface->ResolveReparsePoints);
+
+    Interface = FileSystemBaseT<hpp_DirEntryFs>::Interface();
+    ASSERT(0 != Interface->ReadDirectory);
+    ASSERT(0 == Interface->ResolveReparsePoints);
+    ASSERT(0 == Interface->Read);
+
+    Interface = FileSystemBaseT<hpp_ReparseFs>::Interface();
+    ASSERT(0 == Interface->ReadDirectory);
+    ASSERT(0 != Interface->ResolveReparsePoints);
+    ASSERT(0 == Interface->GetReparsePoint);
+
+    /* existing FileSystemBase derived classes keep the fully populated interface */
+    {
+        hpp_VirtualFs VirtualFs;
+        FileSystemHost Host(VirtualFs);
+        Interface = Host.FileSystemInterface();
+        ASSERT(0 != Interface->Read);
+        ASSERT(0 != Interface->Write);
+        ASSERT(0 != Interface->Cleanup);
+        ASSERT(0 != Interface->ReadDirectory);
+        ASSERT(&VirtualFs == &Host.FileSystem());
+    }
+
+    {
+        hpp_StaticFs StaticFs;
+        FileSystemHost Host(StaticFs);
+        ASSERT(FileSystemBaseT<hpp_StaticFs>::Interface() == Host.FileSystemInterface());
+        ASSERT(&StaticFs == &Host.FileSystem());
+    }
+}
+
+static void hpp_dispatch_test(void)
+{
+    FSP_FILE_SYSTEM FileSystem;
+    FSP_FSCTL_TRANSACT_FULL_CONTEXT FullContext;
+    FSP_FSCTL_FILE_INFO FileInfo;
+    FSP_FILE_SYSTEM_INTERFACE *Interface;
+    UINT8 Buffer[1024];
+    ULONG BytesTransferred;
+    NTSTATUS Result;
+
+    memset(&FileSystem, 0, sizeof FileSystem);
+    memset(&FullContext, 0, sizeof FullContext);
+
+    {
+        hpp_StaticFs StaticFs;
+        FileSystem.UserContext = static_cast<FileSystemBase *>(&StaticFs);
+        Interface = FileSystemBaseT<hpp_StaticFs>::Interface();
+
+        BytesTransferred = 0;
+        Result = Interface->Read(&FileSystem, &FullContext, Buffer, 0, 42, &BytesTransferred);
+        ASSERT(STATUS_SUCCESS == Result);
+        ASSERT(42 == BytesTransferred);
+        ASSERT(1 == StaticFs.Reads);
+
+        Result = Interface->GetFileInfo(&FileSystem, &FullContext, &FileInfo);
+        ASSERT(STATUS_UNEXPECTED_IO_ERROR == Result);
+    }
+
+    {
+        hpp_DirEntryFs DirEntryFs;
+        FileSystem.UserContext = static_cast<FileSystemBase *>(&DirEntryFs);
+        Interface = FileSystemBaseT<hpp_DirEntryFs>::Interface();
+
+        BytesTransferred = 0;
+        Result = Interface->ReadDirectory(&FileSystem, &FullContext, 0, 0,
+            Buffer, sizeof Buffer, &BytesTransferred);
+        ASSERT(STATUS_SUCCESS == Result);
+        ASSERT(2 * FSP_FSCTL_DEFAULT_ALIGN_UP(
+            FIELD_OFFSET(FSP_FSCTL_DIR_INFO, FileNameBuf) + sizeof(WCHAR)) == BytesTransferred);
+        ASSERT(L'a' == ((FSP_FSCTL_DIR_INFO *)Buffer)->FileNameBuf[0]);
+    }
+}
+
+static void hpp_dispatch_bench_test(void)
+{
+    enum { Iterations = 10000000 };
+    FSP_FILE_SYSTEM FileSystem;
+    FSP_FSCTL_TRANSACT_FULL_CONTEXT FullContext;
+    FSP_FILE_SYSTEM_INTERFACE *Interface;
+    hpp_VirtualFs VirtualFs;
+    hpp_StaticFs StaticFs;
+    FileSystemHost VirtualHost(VirtualFs), StaticHost(StaticFs);
+    LARGE_INTEGER Frequency, StartCounter, EndCounter;
+    double Seconds[2];
+    UINT8 Buffer[16];
+    ULONG BytesTransferred;
+
+    memset(&FileSystem, 0, sizeof FileSystem);
+    memset(&FullContext, 0, sizeof FullContext);
+
+    QueryPerformanceFrequency(&Frequency);
+
+    for (int Static = 0; 2 > Static; Static++)
+    {
+        if (Static)
+        {
+            FileSystem.UserContext = static_cast<FileSystemBase *>(&StaticFs);
+            Interface = StaticHost.FileSystemInterface();
+        }
+        else
+        {
+            FileSystem.UserContext = static_cast<FileSystemBase *>(&VirtualFs);
+            Interface = VirtualHost.FileSystemInterface();
+        }
+
+        QueryPerformanceCounter(&StartCounter);
+        for (ULONG I = 0; Iterations > I; I++)
+            Interface->Read(&FileSystem, &FullContext, Buffer, 0, sizeof Buffer, &BytesTransferred);
+        QueryPerformanceCounter(&EndCounter);
+
+        Seconds[Static] = (double)(EndCounter.QuadPart - StartCounter.QuadPart) / Frequency.QuadPart;
+    }
+
+    ASSERT(Iterations == VirtualFs.Reads);
+    ASSERT(Iterations == StaticFs.Reads);
+
+    tlib_printf("calls=%u: virtual=%.2fns/call static=%.2fns/call",
+        Iterations, Seconds[0] * 1e9 / Iterations, Seconds[1] * 1e9 / Iterations);
+}
+
+extern "C" void hpp_tests(void)
+{
+    if (OptExternal)
+        return;
+
+    TEST(hpp_interface_test);
+    TEST(hpp_dispatch_test);
+    TEST_OPT(hpp_dispatch_bench_test);
+}
@@ -0,0 +1,281 @@
+/**
+ * @file launcher-insttab-test.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <winfsp/launch.h>
+#include <tlib/testsuite.h>
+#include <process.h>
+
+#include "winfsp-tests.h"
+
+#include <launcher/insttab.c>
+
+typedef struct
+{
+    SVC_INSTANCE_TABLE_ENTRY TableEntry;
+    WCHAR ClassName[32];
+    WCHAR InstanceName[32];
+} INSTTAB_TEST_INSTANCE;
+
+static void launcher_insttab_test(void)
+{
+    static INSTTAB_TEST_INSTANCE Instances[1000];
+    SVC_INSTANCE_TABLE Table;
+    SVC_INSTANCE_TABLE_ENTRY *Entry;
+    BOOLEAN Success;
+    NTSTATUS Result;
+
+    Result = SvcInstanceTableInitialize(&Table);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(0 == Table.Count);
+
+    Entry = SvcInstanceTableLookup(&Table, L"memfs", L"X:");
+    ASSERT(0 == Entry);
+
+    /* insert enough entries to force the table to grow a few times */
+    for (ULONG I = 0; sizeof Instances / sizeof Instances[0] > I; I++)
+    {
+        wsprintfW(Instances[I].ClassName, L"class%u", I % 7);
+        wsprintfW(Instances[I].InstanceName, L"instance%u", I);
+        Success = SvcInstanceTableInsert(&Table, &Instances[I].TableEntry,
+            Instances[I].ClassName, Instances[I].InstanceName);
+        ASSERT(Success);
+    }
+    ASSERT(sizeof Instances / sizeof Instances[0] == Table.Count);
+    ASSERT(SvcInstanceTableInitialBucketCount < Table.BucketCount);
+
+    for (ULONG I = 0; sizeof Instances / sizeof Instances[0] > I; I++)
+    {
+        Entry = SvcInstanceTableLookup(&Table, Instances[I].ClassName, Instances[I].InstanceName);
+        ASSERT(&Instances[I].TableEntry == Entry);
+    }
+
+    /* names are case-insensitive */
+    Entry = SvcInstanceTableLookup(&Table, L"CLASS3", L"INSTANCE3");
+    ASSERT(&Instances[3].TableEntry == Entry);
+    Entry = SvcInstanceTableLookup(&Table, L"Class3", L"iNsTaNcE3");
+    ASSERT(&Instances[3].TableEntry == Entry);
+
+    /* the same instance name under a different class is a different instance */
+    Entry = SvcInstanceTableLookup(&Table, L"class4", L"instance3");
+    ASSERT(0 == Entry);
+
+    /* the class/instance boundary matters */
+    Entry = SvcInstanceTableLookup(&Table, L"class3instance", L"3");
+    ASSERT(0 == Entry);
+
+    /* collisions are rejected regardless of case */
+    {
+        INSTTAB_TEST_INSTANCE Duplicate;
+        lstrcpyW(Duplicate.ClassName, L"CLASS5");
+        lstrcpyW(Duplicate.InstanceName, L"Instance5");
+        Success = SvcInstanceTableInsert(&Table, &Duplicate.TableEntry,
+            Duplicate.ClassName, Duplicate.InstanceName);
+        ASSERT(!Success);
+        ASSERT(sizeof Instances / sizeof Instances[0] == Table.Count);
+    }
+
+    /* remove every other entry */
+    for (ULONG I = 0; sizeof Instances / sizeof Instances[0] > I; I += 2)
+        SvcInstanceTableRemove(&Table, &Instances[I].TableEntry);
+    ASSERT(sizeof Instances / sizeof Instances[0] / 2 == Table.Count);
+
+    for (ULONG I = 0; sizeof Instances / sizeof Instances[0] > I; I++)
+    {
+        Entry = SvcInstanceTableLookup(&Table, Instances[I].ClassName, Instances[I].InstanceName);
+        ASSERT((0 == I % 2 ? 0 : &Instances[I].TableEntry) == Entry);
+    }
+
+    /* removing an entry that is not in the table is harmless */
+    SvcInstanceTableRemove(&Table, &Instances[0].TableEntry);
+    ASSERT(sizeof Instances / sizeof Instances[0] / 2 == Table.Count);
+
+    /* a removed name can be reused */
+    Success = SvcInstanceTableInsert(&Table, &Instances[0].TableEntry,
+        Instances[0].ClassName, Instances[0].InstanceName);
+    ASSERT(Success);
+    Entry = SvcInstanceTableLookup(&Table, Instances[0].ClassName, Instances[0].InstanceName);
+    ASSERT(&Instances[0].TableEntry == Entry);
+
+    SvcInstanceTableFinalize(&Table);
+}
+
+/*
+ * Stress test: a number of client threads start, query, list and stop instances
+ * concurrently. This models the launcher's concurrent pipe server: every client
+ * operation is a short critical section over the instance table (the launcher's
+ * SvcInstanceLock), while the expensive parts of an operation (reading the registry,
+ * spawning the process, pipe I/O) happen outside the lock and are modeled by a small
+ * amount of work that does not hold the lock.
+ */
+
+#define INSTTAB_STRESS_THREADS          8
+#define INSTTAB_STRESS_INSTANCES        4096
+#define INSTTAB_STRESS_ROUNDS           8
+
+typedef struct
+{
+    SVC_INSTANCE_TABLE *Table;
+    CRITICAL_SECTION *Lock;
+    ULONG ThreadIndex;
+    ULONG OperationCount, ErrorCount;
+} INSTTAB_STRESS_ARGS;
+
+static unsigned __stdcall launcher_insttab_stress_thread(void *Args0)
+{
+    INSTTAB_STRESS_ARGS *Args = Args0;
+    ULONG InstanceCount = INSTTAB_STRESS_INSTANCES / INSTTAB_STRESS_THREADS;
+    INSTTAB_TEST_INSTANCE *Instances;
+    SVC_INSTANCE_TABLE_ENTRY *Entry;
+    ULONG ListCount;
+    volatile ULONG Work;
+
+    Instances = malloc(InstanceCount * sizeof *Instances);
+    if (0 == Instances)
+    {
+        Args->ErrorCount++;
+        return 0;
+    }
+
+    for (ULONG I = 0; InstanceCount > I; I++)
+    {
+        /* all threads use the same class names so that their instances share buckets */
+        wsprintfW(Instances[I].ClassName, L"class%u", I % 3);
+        wsprintfW(Instances[I].InstanceName, L"%u:%u", Args->ThreadIndex, I);
+    }
+
+    for (ULONG Round = 0; INSTTAB_STRESS_ROUNDS > Round; Round++)
+    {
+        /* start */
+        for (ULONG I = 0; InstanceCount > I; I++)
+        {
+            for (Work = 0; 64 > Work; Work++)
+                ;
+            EnterCriticalSection(Args->Lock);
+            if (!SvcInstanceTableInsert(Args->Table, &Instances[I].TableEntry,
+                Instances[I].ClassName, Instances[I].InstanceName))
+                Args->ErrorCount++;
+            LeaveCriticalSection(Args->Lock);
+            Args->OperationCount++;
+        }
+
+        /* query; names are looked up with a different case than they were inserted */
+        for (ULONG I = 0; InstanceCount > I; I++)
+        {
+            WCHAR ClassName[32];
+            lstrcpyW(ClassName, Instances[I].ClassName);
+            ClassName[0] = L'C';
+            EnterCriticalSection(Args->Lock);
+            Entry = SvcInstanceTableLookup(Args->Table, ClassName, Instances[I].InstanceName);
+            if (&Instances[I].TableEntry != Entry)
+                Args->ErrorCount++;
+            LeaveCriticalSection(Args->Lock);
+            Args->OperationCount++;
+        }
+
+        /* list */
+        ListCount = 0;
+        EnterCriticalSection(Args->Lock);
+        for (ULONG I = 0; Args->Table->BucketCount > I; I++)
+            for (Entry = Args->Table->Buckets[I]; 0 != Entry; Entry = Entry->HashNext)
+                ListCount++;
+        if (ListCount != Args->Table->Count || ListCount < InstanceCount)
+            Args->ErrorCount++;
+        LeaveCriticalSection(Args->Lock);
+        Args->OperationCount++;
+
+        /* stop */
+        for (ULONG I = 0; InstanceCount > I; I++)
+        {
+            EnterCriticalSection(Args->Lock);
+            SvcInstanceTableRemove(Args->Table, &Instances[I].TableEntry);
+            Entry = SvcInstanceTableLookup(Args->Table,
+                Instances[I].ClassName, Instances[I].InstanceName);
+            if (0 != Entry)
+                Args->ErrorCount++;
+            LeaveCriticalSection(Args->Lock);
+            Args->OperationCount++;
+        }
+    }
+
+    free(Instances);
+
+    return 0;
+}
+
+static void launcher_insttab_stress_test(void)
+{
+    SVC_INSTANCE_TABLE Table;
+    CRITICAL_SECTION Lock;
+    INSTTAB_STRESS_ARGS Args[INSTTAB_STRESS_THREADS];
+    HANDLE Threads[INSTTAB_STRESS_THREADS];
+    ULONG OperationCount;
+    LARGE_INTEGER Frequency, StartCounter, EndCounter;
+    double Seconds;
+    NTSTATUS Result;
+
+    Result = SvcInstanceTableInitialize(&Table);
+    ASSERT(STATUS_SUCCESS == Result);
+    InitializeCriticalSection(&Lock);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&StartCounter);
+
+    for (ULONG I = 0; INSTTAB_STRESS_THREADS > I; I++)
+    {
+        memset(&Args[I], 0, sizeof Args[I]);
+        Args[I].Table = &Table;
+        Args[I].Lock = &Lock;
+        Args[I].ThreadIndex = I;
+        Threads[I] = (HANDLE)_beginthreadex(0, 0, launcher_insttab_stress_thread, &Args[I], 0, 0);
+        ASSERT(0 != Threads[I]);
+    }
+
+    WaitForMultipleObjects(INSTTAB_STRESS_THREADS, Threads, TRUE, INFINITE);
+
+    QueryPerformanceCounter(&EndCounter);
+
+    OperationCount = 0;
+    for (ULONG I = 0; INSTTAB_STRESS_THREADS > I; I++)
+    {
+        CloseHandle(Threads[I]);
+        ASSERT(0 == Args[I].ErrorCount);
+        OperationCount += Args[I].OperationCount;
+    }
+
+    ASSERT(0 == Table.Count);
+
+    Seconds = (double)(EndCounter.QuadPart - StartCounter.QuadPart) / Frequency.QuadPart;
+    tlib_printf("threads=%u instances=%u ops=%u time=%.3fs ops/s=%.0f",
+        INSTTAB_STRESS_THREADS, INSTTAB_STRESS_INSTANCES, OperationCount,
+        Seconds, 0 < Seconds ? OperationCount / Seconds : 0.0);
+
+    DeleteCriticalSection(&Lock);
+    SvcInstanceTableFinalize(&Table);
+}
+
+void launcher_insttab_tests(void)
+{
+    if (OptExternal)
+        return;
+
+    TEST(launcher_insttab_test);
+    TEST_OPT(launcher_insttab_stress_test);
+}
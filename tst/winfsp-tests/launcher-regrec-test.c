@@ -0,0 +1,326 @@
+/**
+ * @file launcher-regrec-test.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <winfsp/launch.h>
+#include <tlib/testsuite.h>
+
+#include "winfsp-tests.h"
+
+/* PathTransform is provided by launcher-ptrans-test.c */
+#include <launcher/regrec.c>
+
+static void launcher_regrec_template_test(void)
+{
+    PWSTR Argv[] = { L"C:\\memfs.exe", L"\\foo\\bar", L"X:" };
+    PWSTR Varv[26] = { 0 };
+    struct
+    {
+        PWSTR Template;
+        BOOLEAN Quote;
+        PWSTR Expected;
+    } Tests[] =
+    {
+        { L"", FALSE, L"" },
+        { L"plain text", FALSE, L"plain text" },
+        { L"%0 %1 %2", FALSE, L"C:\\memfs.exe \\foo\\bar X:" },
+        { L"%0 %1 %2", TRUE, L"\"C:\\memfs.exe\" \"\\foo\\bar\" \"X:\"" },
+        { L"-m %2 -u %1", FALSE, L"-m X: -u \\foo\\bar" },
+        { L"-u %\\/_1", FALSE, L"-u /foo/bar" },
+        { L"-u %\\/a:b1", FALSE, L"-u foo:bar" },
+        { L"%3%9", FALSE, L"" },
+        { L"[%3]", TRUE, L"[\"\"]" },
+        { L"user=%U time=%T", FALSE, L"user=alice time=" },
+        { L"100%%", FALSE, L"100%" },
+        { L"%%1", FALSE, L"%1" },
+        { L"%x%", FALSE, L"x" },
+        { L"trailing %", FALSE, L"trailing " },
+        { L"trailing %\\/_", FALSE, L"trailing " },
+    };
+    SVC_ARG_TEMPLATE *Template;
+    PWSTR NewString;
+    NTSTATUS Result;
+
+    Varv[L'U' - L'A'] = L"alice";
+
+    for (ULONG I = 0; sizeof Tests / sizeof Tests[0] > I; I++)
+    {
+        Result = SvcArgTemplateCreate(Tests[I].Template, &Template);
+        ASSERT(STATUS_SUCCESS == Result);
+
+        Result = SvcArgTemplateExpand(Template, 3, Argv, Varv, Tests[I].Quote, &NewString);
+        ASSERT(STATUS_SUCCESS == Result);
+        ASSERT(0 == wcscmp(Tests[I].Expected, NewString));
+        MemFree(NewString);
+
+        /* a template can be expanded any number of times */
+        Result = SvcArgTemplateExpand(Template, 3, Argv, Varv, Tests[I].Quote, &NewString);
+        ASSERT(STATUS_SUCCESS == Result);
+        ASSERT(0 == wcscmp(Tests[I].Expected, NewString));
+        MemFree(NewString);
+
+        SvcArgTemplateDelete(Template);
+    }
+}
+
+/*
+ * In-memory record store.
+ */
+
+typedef struct
+{
+    PWSTR ClassName;
+    FSP_LAUNCH_REG_RECORD Record;
+} REGREC_TEST_ENTRY;
+
+typedef struct
+{
+    REGREC_TEST_ENTRY *Entries;
+    ULONG EntryCount;
+    volatile LONG GetCount, FreeCount;
+} REGREC_TEST_STORE;
+
+static REGREC_TEST_STORE *regrec_test_store;
+
+static NTSTATUS regrec_test_store_get(PVOID Context, PWSTR ClassName,
+    FSP_LAUNCH_REG_RECORD **PRecord)
+{
+    REGREC_TEST_STORE *Store = Context;
+
+    InterlockedIncrement(&Store->GetCount);
+
+    for (ULONG I = 0; Store->EntryCount > I; I++)
+        if (0 == invariant_wcsicmp(ClassName, Store->Entries[I].ClassName))
+        {
+            *PRecord = &Store->Entries[I].Record;
+            return STATUS_SUCCESS;
+        }
+
+    *PRecord = 0;
+    return STATUS_OBJECT_NAME_NOT_FOUND;
+}
+
+static VOID regrec_test_store_free(FSP_LAUNCH_REG_RECORD *Record)
+{
+    InterlockedIncrement(&regrec_test_store->FreeCount);
+}
+
+static void launcher_regrec_record_test(void)
+{
+    FSP_LAUNCH_REG_RECORD Record;
+    SVC_REG_RECORD *RegRecord;
+    PWSTR Argv[] = { L"C:\\memfs.exe", L"\\share", L"X:" };
+    PWSTR Varv[26] = { 0 };
+    PWSTR NewString;
+    REGREC_TEST_STORE Store = { 0 };
+    NTSTATUS Result;
+
+    regrec_test_store = &Store;
+
+    memset(&Record, 0, sizeof Record);
+    Record.Executable = L"C:\\memfs.exe";
+    Record.CommandLine = L"-i -F NTFS -u %1 -m %2";
+    Record.Security = L"D:P(A;;RPWPLC;;;WD)";
+    Record.Stderr = L"C:\\logs\\%2.log";
+
+    Result = SvcRegRecordCreate(L"memfs", &Record, regrec_test_store_free, &RegRecord);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(0 == wcscmp(L"memfs", RegRecord->ClassName));
+    ASSERT(&Record == RegRecord->Record);
+    ASSERT(0 != RegRecord->SecurityDescriptor);
+    ASSERT(IsValidSecurityDescriptor(RegRecord->SecurityDescriptor));
+    ASSERT(0 != RegRecord->Stderr);
+
+    /* the command line is prefixed with the executable */
+    Result = SvcArgTemplateExpand(RegRecord->CommandLine, 3, Argv, Varv, TRUE, &NewString);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(0 == wcscmp(L"\"C:\\memfs.exe\" -i -F NTFS -u \"\\share\" -m \"X:\"", NewString));
+    MemFree(NewString);
+
+    Result = SvcArgTemplateExpand(RegRecord->Stderr, 3, Argv, Varv, FALSE, &NewString);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(0 == wcscmp(L"C:\\logs\\X:.log", NewString));
+    MemFree(NewString);
+
+    SvcRegRecordRelease(RegRecord);
+    ASSERT(1 == Store.FreeCount);
+
+    /* bad SDDL fails record creation; the record is freed */
+    Record.Security = L"D:P(this is not SDDL)";
+    Result = SvcRegRecordCreate(L"memfs", &Record, regrec_test_store_free, &RegRecord);
+    ASSERT(!NT_SUCCESS(Result));
+    ASSERT(0 == RegRecord);
+    ASSERT(2 == Store.FreeCount);
+
+    regrec_test_store = 0;
+}
+
+static void launcher_regrec_cache_test(void)
+{
+    REGREC_TEST_ENTRY Entries[2];
+    REGREC_TEST_STORE Store = { 0 };
+    SVC_REG_STORE RegStore = { regrec_test_store_get, regrec_test_store_free, &Store };
+    SVC_REG_CACHE Cache;
+    SVC_REG_RECORD *RegRecord0, *RegRecord1;
+    ULONG HitCount, MissCount, InvalidateCount;
+    NTSTATUS Result;
+
+    memset(Entries, 0, sizeof Entries);
+    Entries[0].ClassName = L"memfs";
+    Entries[0].Record.Executable = L"C:\\memfs.exe";
+    Entries[1].ClassName = L"ptfs";
+    Entries[1].Record.Executable = L"C:\\ptfs.exe";
+    Entries[1].Record.CommandLine = L"-p %1";
+    Store.Entries = Entries;
+    Store.EntryCount = 2;
+    regrec_test_store = &Store;
+
+    SvcRegCacheInitialize(&Cache, &RegStore, TRUE);
+
+    Result = SvcRegCacheGetRecord(&Cache, L"nosuchclass", &RegRecord0);
+    ASSERT(STATUS_OBJECT_NAME_NOT_FOUND == Result);
+    ASSERT(0 == RegRecord0);
+
+    /* first lookup goes to the store; subsequent lookups (in any case) are cached */
+    Result = SvcRegCacheGetRecord(&Cache, L"memfs", &RegRecord0);
+    ASSERT(STATUS_SUCCESS == Result);
+    Result = SvcRegCacheGetRecord(&Cache, L"MEMFS", &RegRecord1);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(RegRecord0 == RegRecord1);
+    ASSERT(2 == Store.GetCount);
+    SvcRegRecordRelease(RegRecord1);
+
+    /* invalidation drops the cache reference; outstanding references remain valid */
+    SvcRegCacheInvalidate(&Cache);
+    ASSERT(0 == Store.FreeCount);
+    ASSERT(0 == wcscmp(L"C:\\memfs.exe", RegRecord0->Record->Executable));
+    SvcRegRecordRelease(RegRecord0);
+    ASSERT(1 == Store.FreeCount);
+
+    Result = SvcRegCacheGetRecord(&Cache, L"memfs", &RegRecord1);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(3 == Store.GetCount);
+    SvcRegRecordRelease(RegRecord1);
+
+    Result = SvcRegCacheGetRecord(&Cache, L"ptfs", &RegRecord1);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(4 == Store.GetCount);
+    ASSERT(0 == wcscmp(L"ptfs", RegRecord1->ClassName));
+    SvcRegRecordRelease(RegRecord1);
+
+    SvcRegCacheGetStatistics(&Cache, &HitCount, &MissCount, &InvalidateCount);
+    ASSERT(1 == HitCount);
+    ASSERT(4 == MissCount);
+    ASSERT(1 == InvalidateCount);
+
+    SvcRegCacheFinalize(&Cache);
+    ASSERT(Store.GetCount - 1/*nosuchclass*/ == Store.FreeCount);
+
+    /* a disabled cache always goes to the store */
+    Store.GetCount = Store.FreeCount = 0;
+    SvcRegCacheInitialize(&Cache, &RegStore, FALSE);
+    for (ULONG I = 0; 3 > I; I++)
+    {
+        Result = SvcRegCacheGetRecord(&Cache, L"memfs", &RegRecord0);
+        ASSERT(STATUS_SUCCESS == Result);
+        SvcRegRecordRelease(RegRecord0);
+    }
+    ASSERT(3 == Store.GetCount);
+    ASSERT(3 == Store.FreeCount);
+    SvcRegCacheFinalize(&Cache);
+
+    regrec_test_store = 0;
+}
+
+static void launcher_regrec_benchmark_test(void)
+{
+    REGREC_TEST_ENTRY Entries[1];
+    REGREC_TEST_STORE Store = { 0 };
+    SVC_REG_STORE RegStore = { regrec_test_store_get, regrec_test_store_free, &Store };
+    SVC_REG_CACHE Cache;
+    SVC_REG_RECORD *RegRecord;
+    PWSTR Argv[] = { L"C:\\memfs.exe", L"\\server\\share\\dir", L"X:" };
+    PWSTR Varv[26] = { 0 };
+    PWSTR NewString;
+    LARGE_INTEGER Frequency, StartCounter, EndCounter;
+    ULONG Iterations = 100000;
+    double UncachedSeconds, CachedSeconds;
+    NTSTATUS Result;
+
+    memset(Entries, 0, sizeof Entries);
+    Entries[0].ClassName = L"memfs";
+    Entries[0].Record.Executable = L"C:\\memfs.exe";
+    Entries[0].Record.CommandLine = L"-i -F NTFS -n 65536 -s 67108864 -u %\\/_1 -m %2 -S D:P(A;;GA;;;WD)";
+    Entries[0].Record.Security = L"D:P(A;;RPWPLC;;;WD)";
+    Entries[0].Record.Stderr = L"C:\\logs\\%\\/a1.log";
+    Store.Entries = Entries;
+    Store.EntryCount = 1;
+    regrec_test_store = &Store;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    /* disabled cache: every start parses the record and builds the security descriptor */
+    SvcRegCacheInitialize(&Cache, &RegStore, FALSE);
+    QueryPerformanceCounter(&StartCounter);
+    for (ULONG I = 0; Iterations > I; I++)
+    {
+        Result = SvcRegCacheGetRecord(&Cache, L"memfs", &RegRecord);
+        ASSERT(STATUS_SUCCESS == Result);
+        Result = SvcArgTemplateExpand(RegRecord->CommandLine, 3, Argv, Varv, TRUE, &NewString);
+        ASSERT(STATUS_SUCCESS == Result);
+        MemFree(NewString);
+        SvcRegRecordRelease(RegRecord);
+    }
+    QueryPerformanceCounter(&EndCounter);
+    SvcRegCacheFinalize(&Cache);
+    UncachedSeconds = (double)(EndCounter.QuadPart - StartCounter.QuadPart) / Frequency.QuadPart;
+
+    /* enabled cache: every start only expands the command line template */
+    SvcRegCacheInitialize(&Cache, &RegStore, TRUE);
+    QueryPerformanceCounter(&StartCounter);
+    for (ULONG I = 0; Iterations > I; I++)
+    {
+        Result = SvcRegCacheGetRecord(&Cache, L"memfs", &RegRecord);
+        ASSERT(STATUS_SUCCESS == Result);
+        Result = SvcArgTemplateExpand(RegRecord->CommandLine, 3, Argv, Varv, TRUE, &NewString);
+        ASSERT(STATUS_SUCCESS == Result);
+        MemFree(NewString);
+        SvcRegRecordRelease(RegRecord);
+    }
+    QueryPerformanceCounter(&EndCounter);
+    SvcRegCacheFinalize(&Cache);
+    CachedSeconds = (double)(EndCounter.QuadPart - StartCounter.QuadPart) / Frequency.QuadPart;
+
+    tlib_printf("iterations=%u uncached=%.3fs cached=%.3fs",
+        Iterations, UncachedSeconds, CachedSeconds);
+
+    regrec_test_store = 0;
+}
+
+void launcher_regrec_tests(void)
+{
+    if (OptExternal)
+        return;
+
+    TEST(launcher_regrec_template_test);
+    TEST(launcher_regrec_record_test);
+    TEST(launcher_regrec_cache_test);
+    TEST_OPT(launcher_regrec_benchmark_test);
+}
@@ -22,6 +22,7 @@
 #include <winfsp/winfsp.h>
 #include <tlib/testsuite.h>
 #include <process.h>
+#include <psapi.h>
 #include "memfs.h"
 
 #include "winfsp-tests.h"
@@ -52,7 +53,7 @@ void *memfs_start_ex(ULONG Flags, ULONG FileInfoTimeout)
         (Flags & MemfsNoSlowio) ? 0 : 10, /*SlowioPercentDelay*/
         (Flags & MemfsNoSlowio) ? 0 : 5,  /*SlowioRarefyDelay*/
         0,
-        MemfsNet == Flags ? L"\\memfs\\share" : 0,
+        MemfsNet == (Flags & MemfsDeviceMask) ? L"\\memfs\\share" : 0,
         0,
         &Memfs);
     ASSERT(NT_SUCCESS(Result));
@@ -117,10 +118,153 @@ void memfs_test(void)
         memfs_dotest(MemfsNet);
 }
 
+typedef BOOL WINAPI K32_GET_PROCESS_MEMORY_INFO(
+    HANDLE Process, PPROCESS_MEMORY_COUNTERS Counters, DWORD Size);
+
+static SIZE_T memfs_private_usage(void)
+{
+    static K32_GET_PROCESS_MEMORY_INFO *GetProcessMemoryInfoFn;
+    PROCESS_MEMORY_COUNTERS_EX Counters;
+
+    if (0 == GetProcessMemoryInfoFn)
+        GetProcessMemoryInfoFn = (K32_GET_PROCESS_MEMORY_INFO *)GetProcAddress(
+            GetModuleHandleW(L"kernel32.dll"), "K32GetProcessMemoryInfo");
+    if (0 == GetProcessMemoryInfoFn ||
+        !GetProcessMemoryInfoFn(GetCurrentProcess(),
+            (PPROCESS_MEMORY_COUNTERS)&Counters, sizeof Counters))
+        return 0;
+
+    return Counters.PrivateUsage;
+}
+
+static void memfs_nodes_dobench(ULONG Count)
+{
+    MEMFS *Memfs;
+    FSP_FILE_SYSTEM *FileSystem;
+    FSP_FSCTL_FILE_INFO FileInfo;
+    WCHAR FileName[64];
+    PVOID FileNode;
+    LARGE_INTEGER Frequency, StartCounter, EndCounter;
+    double CreateSeconds, OpenSeconds;
+    SIZE_T PrivateUsage0, PrivateUsage1;
+    UINT64 UsedBytes, ReservedBytes;
+    NTSTATUS Result;
+
+    PrivateUsage0 = memfs_private_usage();
+
+    /* case sensitive: Create/Open need no OPEN_FILE_INFO for name normalization */
+    Result = MemfsCreateFunnel(MemfsDisk, 1000, Count + 1, 0,
+        0, 0, 0, 0, 0, 0, &Memfs);
+    ASSERT(NT_SUCCESS(Result));
+    FileSystem = MemfsFileSystem(Memfs);
+
+    QueryPerformanceFrequency(&Frequency);
+
+    QueryPerformanceCounter(&StartCounter);
+    for (ULONG I = 0; Count > I; I++)
+    {
+        wsprintfW(FileName, L"\\file%u", I);
+        if (0 != FileSystem->Interface->CreateEx)
+            Result = FileSystem->Interface->CreateEx(FileSystem, FileName,
+                0, FILE_ALL_ACCESS, FILE_ATTRIBUTE_NORMAL, 0, 0, 0, 0, FALSE,
+                &FileNode, &FileInfo);
+        else
+            Result = FileSystem->Interface->Create(FileSystem, FileName,
+                0, FILE_ALL_ACCESS, FILE_ATTRIBUTE_NORMAL, 0, 0,
+                &FileNode, &FileInfo);
+        ASSERT(NT_SUCCESS(Result));
+        FileSystem->Interface->Close(FileSystem, FileNode);
+    }
+    QueryPerformanceCounter(&EndCounter);
+    CreateSeconds = (double)(EndCounter.QuadPart - StartCounter.QuadPart) / Frequency.QuadPart;
+
+    PrivateUsage1 = memfs_private_usage();
+    MemfsGetNodeMemory(Memfs, &UsedBytes, &ReservedBytes);
+
+    QueryPerformanceCounter(&StartCounter);
+    for (ULONG I = 0; Count > I; I++)
+    {
+        wsprintfW(FileName, L"\\file%u", I);
+        Result = FileSystem->Interface->Open(FileSystem, FileName,
+            0, FILE_READ_ATTRIBUTES, &FileNode, &FileInfo);
+        ASSERT(NT_SUCCESS(Result));
+        FileSystem->Interface->Close(FileSystem, FileNode);
+    }
+    QueryPerformanceCounter(&EndCounter);
+    OpenSeconds = (double)(EndCounter.QuadPart - StartCounter.QuadPart) / Frequency.QuadPart;
+
+    MemfsDelete(Memfs);
+
+    tlib_printf("nodes=%u node+name=%.1fB/file arena=%.1fB/file process=%.1fB/file "
+        "create=%.0f/s open=%.0f/s",
+        Count,
+        (double)UsedBytes / Count,
+        (double)ReservedBytes / Count,
+        (double)(PrivateUsage1 - PrivateUsage0) / Count,
+        Count / CreateSeconds, Count / OpenSeconds);
+}
+
+static void memfs_nodes_bench_test(void)
+{
+    if (!WinFspDiskTests)
+        return;
+
+    memfs_nodes_dobench(1000000);
+    memfs_nodes_dobench(10000000);
+}
+
+static void memfs_node_memory_limit_test(void)
+{
+    MEMFS *Memfs;
+    FSP_FILE_SYSTEM *FileSystem;
+    FSP_FSCTL_FILE_INFO FileInfo;
+    WCHAR FileName[64];
+    PVOID FileNode;
+    UINT64 UsedBytes;
+    ULONG Count;
+    NTSTATUS Result;
+
+    if (!WinFspDiskTests)
+        return;
+
+    Result = MemfsCreateFunnel(MemfsDisk, 1000, 16, 0,
+        0, 0, 0, 0, 0, 0, &Memfs);
+    ASSERT(NT_SUCCESS(Result));
+    FileSystem = MemfsFileSystem(Memfs);
+
+    /* the memory limit replaces the MaxFileNodes limit of 16 */
+    MemfsSetMaxNodeMemory(Memfs, 64 * 1024);
+
+    for (Count = 0;; Count++)
+    {
+        wsprintfW(FileName, L"\\file%u", Count);
+        if (0 != FileSystem->Interface->CreateEx)
+            Result = FileSystem->Interface->CreateEx(FileSystem, FileName,
+                0, FILE_ALL_ACCESS, FILE_ATTRIBUTE_NORMAL, 0, 0, 0, 0, FALSE,
+                &FileNode, &FileInfo);
+        else
+            Result = FileSystem->Interface->Create(FileSystem, FileName,
+                0, FILE_ALL_ACCESS, FILE_ATTRIBUTE_NORMAL, 0, 0,
+                &FileNode, &FileInfo);
+        if (!NT_SUCCESS(Result))
+            break;
+        FileSystem->Interface->Close(FileSystem, FileNode);
+    }
+    ASSERT(STATUS_CANNOT_MAKE == Result);
+    ASSERT(16 < Count);
+
+    MemfsGetNodeMemory(Memfs, &UsedBytes, 0);
+    ASSERT(64 * 1024 >= UsedBytes);
+
+    MemfsDelete(Memfs);
+}
+
 void memfs_tests(void)
 {
     if (OptExternal)
         return;
 
     TEST(memfs_test);
+    TEST(memfs_node_memory_limit_test);
+    TEST_OPT(memfs_nodes_bench_test);
 }
@@ -0,0 +1,354 @@
+/**
+ * @file nametab-test.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <winfsp/winfsp.h>
+#include <tlib/testsuite.h>
+#include <process.h>
+
+#include "winfsp-tests.h"
+
+#include <shared/ku/nametab.c>
+
+typedef struct
+{
+    FSP_NAME_TABLE_ENTRY Entry;
+    UNICODE_STRING FileName;
+    WCHAR Buffer[64];
+    LONG RefCount;
+} NAMETAB_TEST_NODE;
+
+static void nametab_node_init(NAMETAB_TEST_NODE *Node, PWSTR FileName)
+{
+    memset(Node, 0, sizeof *Node);
+    wcscpy_s(Node->Buffer, sizeof Node->Buffer / sizeof(WCHAR), FileName);
+    Node->FileName.Length = Node->FileName.MaximumLength =
+        (USHORT)(wcslen(FileName) * sizeof(WCHAR));
+    Node->FileName.Buffer = Node->Buffer;
+}
+
+static void nametab_node_reference(PVOID Context)
+{
+    InterlockedIncrement(&((NAMETAB_TEST_NODE *)Context)->RefCount);
+}
+
+static PUNICODE_STRING nametab_string(PUNICODE_STRING String, PWSTR Buffer)
+{
+    String->Length = String->MaximumLength = (USHORT)(wcslen(Buffer) * sizeof(WCHAR));
+    String->Buffer = Buffer;
+    return String;
+}
+
+static ULONG nametab_enumerate(FSP_NAME_TABLE *NameTable, PWSTR Prefix, BOOLEAN StreamsOnly,
+    NAMETAB_TEST_NODE *Nodes, ULONG NodeCount)
+{
+    FSP_NAME_TABLE_RESTART_KEY RestartKey;
+    UNICODE_STRING String;
+    NAMETAB_TEST_NODE *Node;
+    ULONG Mask = 0;
+
+    ASSERT(32 >= NodeCount);
+
+    memset(&RestartKey, 0, sizeof RestartKey);
+    while (0 != (Node = FspNameTableEnumerate(NameTable,
+        0 != Prefix ? nametab_string(&String, Prefix) : 0, StreamsOnly, &RestartKey)))
+    {
+        ASSERT(Nodes <= Node && Node < Nodes + NodeCount);
+        ASSERT(0 == (Mask & (1 << (Node - Nodes))));
+        Mask |= 1 << (Node - Nodes);
+    }
+
+    /* a finished enumeration stays finished */
+    ASSERT(0 == FspNameTableEnumerate(NameTable,
+        0 != Prefix ? nametab_string(&String, Prefix) : 0, StreamsOnly, &RestartKey));
+
+    return Mask;
+}
+
+static void nametab_insert_lookup_remove_test(void)
+{
+    FSP_NAME_TABLE *NameTable;
+    NAMETAB_TEST_NODE Nodes[3], Other;
+    UNICODE_STRING String;
+    BOOLEAN Inserted;
+    PVOID Context;
+    NTSTATUS Result;
+
+    Result = FspNameTableCreate(TRUE, &NameTable);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(0 != NameTable);
+    ASSERT(0 == FspNameTableCount(NameTable));
+
+    nametab_node_init(&Nodes[0], L"\\");
+    nametab_node_init(&Nodes[1], L"\\dir\\file");
+    nametab_node_init(&Nodes[2], L"\\dir\\file:stream");
+    for (ULONG I = 0; 3 > I; I++)
+    {
+        Context = FspNameTableInsert(NameTable, &Nodes[I].FileName, &Nodes[I],
+            &Nodes[I].Entry, &Inserted);
+        ASSERT(Inserted);
+        ASSERT(&Nodes[I] == Context);
+    }
+    ASSERT(3 == FspNameTableCount(NameTable));
+
+    /* names are compared case-insensitively */
+    nametab_node_init(&Other, L"\\DIR\\File");
+    Context = FspNameTableInsert(NameTable, &Other.FileName, &Other, &Other.Entry, &Inserted);
+    ASSERT(!Inserted);
+    ASSERT(&Nodes[1] == Context);
+    ASSERT(3 == FspNameTableCount(NameTable));
+
+    Context = FspNameTableLookup(NameTable, nametab_string(&String, L"\\Dir\\FILE:Stream"),
+        nametab_node_reference);
+    ASSERT(&Nodes[2] == Context);
+    ASSERT(1 == Nodes[2].RefCount);
+    Context = FspNameTableLookup(NameTable, nametab_string(&String, L"\\dir\\file:stream2"),
+        nametab_node_reference);
+    ASSERT(0 == Context);
+    Context = FspNameTableLookup(NameTable, nametab_string(&String, L"\\dir"), 0);
+    ASSERT(0 == Context);
+
+    ASSERT(FspNameTableRemove(NameTable, nametab_string(&String, L"\\DIR\\FILE")));
+    ASSERT(!FspNameTableRemove(NameTable, nametab_string(&String, L"\\dir\\file")));
+    ASSERT(2 == FspNameTableCount(NameTable));
+    ASSERT(0 == FspNameTableLookup(NameTable, &Nodes[1].FileName, 0));
+    ASSERT(&Nodes[2] == FspNameTableLookup(NameTable, &Nodes[2].FileName, 0));
+
+    Context = FspNameTableInsert(NameTable, &Other.FileName, &Other, &Other.Entry, &Inserted);
+    ASSERT(Inserted);
+    ASSERT(&Other == Context);
+    ASSERT(&Other == FspNameTableLookup(NameTable, &Nodes[1].FileName, 0));
+
+    FspNameTableDelete(NameTable);
+
+    /* names are compared case-sensitively */
+    Result = FspNameTableCreate(FALSE, &NameTable);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    Context = FspNameTableInsert(NameTable, &Nodes[1].FileName, &Nodes[1],
+        &Nodes[1].Entry, &Inserted);
+    ASSERT(Inserted);
+    Context = FspNameTableInsert(NameTable, &Other.FileName, &Other, &Other.Entry, &Inserted);
+    ASSERT(Inserted);
+    ASSERT(&Other == Context);
+    ASSERT(2 == FspNameTableCount(NameTable));
+    ASSERT(&Nodes[1] == FspNameTableLookup(NameTable, &Nodes[1].FileName, 0));
+    ASSERT(&Other == FspNameTableLookup(NameTable, &Other.FileName, 0));
+    ASSERT(0 == FspNameTableLookup(NameTable, nametab_string(&String, L"\\dir\\FILE"), 0));
+
+    FspNameTableDelete(NameTable);
+}
+
+static void nametab_enumerate_test(void)
+{
+    static PWSTR FileNames[] =
+    {
+        L"\\",
+        L"\\dir",
+        L"\\dir:stream",
+        L"\\dir\\file",
+        L"\\dir\\file:s1",
+        L"\\dir\\file:s2",
+        L"\\dir\\sub",
+        L"\\dir\\sub\\file",
+        L"\\dir2",
+        L"\\dir2:stream",
+        L"\\dirx\\file",
+        L"\\file",
+        L"\\file:s1",
+    };
+    FSP_NAME_TABLE *NameTable;
+    NAMETAB_TEST_NODE Nodes[ARRAYSIZE(FileNames)];
+    BOOLEAN Inserted;
+    NTSTATUS Result;
+
+    Result = FspNameTableCreate(TRUE, &NameTable);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    ASSERT(0 == nametab_enumerate(NameTable, 0, FALSE, Nodes, ARRAYSIZE(Nodes)));
+    ASSERT(0 == nametab_enumerate(NameTable, L"\\dir", TRUE, Nodes, ARRAYSIZE(Nodes)));
+
+    for (ULONG I = 0; ARRAYSIZE(FileNames) > I; I++)
+    {
+        nametab_node_init(&Nodes[I], FileNames[I]);
+        FspNameTableInsert(NameTable, &Nodes[I].FileName, &Nodes[I], &Nodes[I].Entry, &Inserted);
+        ASSERT(Inserted);
+    }
+
+    /* everything */
+    ASSERT(0x1fff == nametab_enumerate(NameTable, 0, FALSE, Nodes, ARRAYSIZE(Nodes)));
+
+    /* a name and its streams */
+    ASSERT(0x0006 == nametab_enumerate(NameTable, L"\\dir", TRUE, Nodes, ARRAYSIZE(Nodes)));
+    ASSERT(0x0006 == nametab_enumerate(NameTable, L"\\DIR", TRUE, Nodes, ARRAYSIZE(Nodes)));
+    ASSERT(0x0038 == nametab_enumerate(NameTable, L"\\dir\\file", TRUE, Nodes, ARRAYSIZE(Nodes)));
+    ASSERT(0x1800 == nametab_enumerate(NameTable, L"\\file", TRUE, Nodes, ARRAYSIZE(Nodes)));
+    ASSERT(0x0000 == nametab_enumerate(NameTable, L"\\nonexistent", TRUE, Nodes, ARRAYSIZE(Nodes)));
+
+    /* a name, its streams and its descendants */
+    ASSERT(0x00fe == nametab_enumerate(NameTable, L"\\dir", FALSE, Nodes, ARRAYSIZE(Nodes)));
+    ASSERT(0x00c0 == nametab_enumerate(NameTable, L"\\dir\\sub", FALSE, Nodes, ARRAYSIZE(Nodes)));
+    ASSERT(0x0300 == nametab_enumerate(NameTable, L"\\dir2", FALSE, Nodes, ARRAYSIZE(Nodes)));
+    ASSERT(0x0000 == nametab_enumerate(NameTable, L"\\di", FALSE, Nodes, ARRAYSIZE(Nodes)));
+
+    FspNameTableDelete(NameTable);
+}
+
+static void nametab_grow_test(void)
+{
+    FSP_NAME_TABLE *NameTable;
+    NAMETAB_TEST_NODE *Nodes;
+    FSP_NAME_TABLE_RESTART_KEY RestartKey;
+    WCHAR Buffer[64];
+    BOOLEAN Inserted;
+    PVOID Context;
+    ULONG Count;
+    NTSTATUS Result;
+
+    Nodes = malloc(10000 * sizeof *Nodes);
+    ASSERT(0 != Nodes);
+
+    Result = FspNameTableCreate(TRUE, &NameTable);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    for (ULONG I = 0; 10000 > I; I++)
+    {
+        wsprintfW(Buffer, L"\\dir%u\\file%u", I % 100, I);
+        nametab_node_init(&Nodes[I], Buffer);
+        FspNameTableInsert(NameTable, &Nodes[I].FileName, &Nodes[I], &Nodes[I].Entry, &Inserted);
+        ASSERT(Inserted);
+    }
+    ASSERT(10000 == FspNameTableCount(NameTable));
+
+    /* the shards have grown; every name must still be found */
+    for (ULONG I = 0; FSP_NAME_TABLE_SHARD_COUNT > I; I++)
+        ASSERT(FSP_NAME_TABLE_BUCKET_COUNT < NameTable->Shards[I].BucketCount);
+    for (ULONG I = 0; 10000 > I; I++)
+        ASSERT(&Nodes[I] == FspNameTableLookup(NameTable, &Nodes[I].FileName, 0));
+
+    Count = 0;
+    memset(&RestartKey, 0, sizeof RestartKey);
+    while (0 != (Context = FspNameTableEnumerate(NameTable, 0, FALSE, &RestartKey)))
+        Count++;
+    ASSERT(10000 == Count);
+
+    for (ULONG I = 0; 10000 > I; I += 2)
+        ASSERT(FspNameTableRemove(NameTable, &Nodes[I].FileName));
+    ASSERT(5000 == FspNameTableCount(NameTable));
+    for (ULONG I = 0; 10000 > I; I++)
+        ASSERT((0 == I % 2 ? 0 : &Nodes[I]) ==
+            FspNameTableLookup(NameTable, &Nodes[I].FileName, 0));
+
+    FspNameTableDelete(NameTable);
+
+    free(Nodes);
+}
+
+#define NAMETAB_STRESS_THREADS          8
+#define NAMETAB_STRESS_NODES            1000
+#define NAMETAB_STRESS_ITERATIONS       200
+
+static FSP_NAME_TABLE *nametab_stress_table;
+static NAMETAB_TEST_NODE nametab_stress_shared;
+
+static unsigned __stdcall nametab_stress_thread(void *Args)
+{
+    ULONG ThreadIndex = (ULONG)(UINT_PTR)Args;
+    NAMETAB_TEST_NODE *Nodes;
+    WCHAR Buffer[64];
+    BOOLEAN Inserted;
+
+    Nodes = malloc(NAMETAB_STRESS_NODES * sizeof *Nodes);
+    ASSERT(0 != Nodes);
+
+    for (ULONG I = 0; NAMETAB_STRESS_NODES > I; I++)
+    {
+        wsprintfW(Buffer, L"\\thread%u\\file%u", ThreadIndex, I);
+        nametab_node_init(&Nodes[I], Buffer);
+    }
+
+    for (ULONG J = 0; NAMETAB_STRESS_ITERATIONS > J; J++)
+    {
+        for (ULONG I = 0; NAMETAB_STRESS_NODES > I; I++)
+        {
+            FspNameTableInsert(nametab_stress_table,
+                &Nodes[I].FileName, &Nodes[I], &Nodes[I].Entry, &Inserted);
+            ASSERT(Inserted);
+        }
+        for (ULONG I = 0; NAMETAB_STRESS_NODES > I; I++)
+        {
+            ASSERT(&Nodes[I] == FspNameTableLookup(nametab_stress_table,
+                &Nodes[I].FileName, nametab_node_reference));
+            ASSERT(&nametab_stress_shared == FspNameTableLookup(nametab_stress_table,
+                &nametab_stress_shared.FileName, nametab_node_reference));
+        }
+        for (ULONG I = 0; NAMETAB_STRESS_NODES > I; I++)
+            ASSERT(FspNameTableRemove(nametab_stress_table, &Nodes[I].FileName));
+    }
+
+    for (ULONG I = 0; NAMETAB_STRESS_NODES > I; I++)
+        ASSERT(NAMETAB_STRESS_ITERATIONS == Nodes[I].RefCount);
+
+    free(Nodes);
+
+    return 0;
+}
+
+static void nametab_stress_test(void)
+{
+    HANDLE Threads[NAMETAB_STRESS_THREADS];
+    BOOLEAN Inserted;
+    NTSTATUS Result;
+
+    Result = FspNameTableCreate(TRUE, &nametab_stress_table);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    nametab_node_init(&nametab_stress_shared, L"\\shared");
+    FspNameTableInsert(nametab_stress_table,
+        &nametab_stress_shared.FileName, &nametab_stress_shared, &nametab_stress_shared.Entry,
+        &Inserted);
+    ASSERT(Inserted);
+
+    for (ULONG I = 0; NAMETAB_STRESS_THREADS > I; I++)
+    {
+        Threads[I] = (HANDLE)_beginthreadex(0, 0, nametab_stress_thread, (PVOID)(UINT_PTR)I, 0, 0);
+        ASSERT(0 != Threads[I]);
+    }
+    WaitForMultipleObjects(NAMETAB_STRESS_THREADS, Threads, TRUE, INFINITE);
+    for (ULONG I = 0; NAMETAB_STRESS_THREADS > I; I++)
+        CloseHandle(Threads[I]);
+
+    ASSERT(1 == FspNameTableCount(nametab_stress_table));
+    ASSERT(NAMETAB_STRESS_THREADS * NAMETAB_STRESS_NODES * NAMETAB_STRESS_ITERATIONS ==
+        nametab_stress_shared.RefCount);
+
+    FspNameTableDelete(nametab_stress_table);
+}
+
+void nametab_tests(void)
+{
+    if (OptExternal)
+        return;
+
+    TEST(nametab_insert_lookup_remove_test);
+    TEST(nametab_enumerate_test);
+    TEST(nametab_grow_test);
+    TEST_OPT(nametab_stress_test);
+}
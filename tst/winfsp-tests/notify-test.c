@@ -368,6 +368,132 @@ void notify_open_change_test(void)
     }
 }
 
+static
+void notify_range_change_dotest(ULONG Flags, PWSTR Prefix, ULONG FileInfoTimeout)
+{
+    void *memfs = memfs_start_ex(Flags, FileInfoTimeout);
+    FSP_FILE_SYSTEM *FileSystem = MemfsFileSystem(memfs);
+
+    HANDLE FileHandle;
+    WCHAR FilePath[MAX_PATH];
+    union
+    {
+        FSP_FSCTL_NOTIFY_INFO V;
+        UINT8 B[1024];
+    } Buffer;
+    ULONG Length = 0;
+    union
+    {
+        FSP_FSCTL_NOTIFY_RANGE_INFO V;
+        UINT8 B[sizeof(FSP_FSCTL_NOTIFY_RANGE_INFO) + MAX_PATH * sizeof(WCHAR)];
+    } RangeInfo;
+    union
+    {
+        FSP_FSCTL_NOTIFY_INFO V;
+        UINT8 B[sizeof(FSP_FSCTL_NOTIFY_INFO) + MAX_PATH * sizeof(WCHAR)];
+    } NotifyInfo;
+    PWSTR FileName;
+    UINT8 Data[3 * 4096], ReadData[3 * 4096];
+    LARGE_INTEGER FileSize;
+    DWORD BytesTransferred;
+    BOOL Success;
+    NTSTATUS Result;
+
+    StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\\file0",
+        Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs));
+
+    FileHandle = CreateFileW(FilePath,
+        GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, CREATE_NEW,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE, 0);
+    ASSERT(INVALID_HANDLE_VALUE != FileHandle);
+
+    for (ULONG I = 0; sizeof Data > I; I++)
+        Data[I] = (UINT8)('a' + I / 4096);
+    Success = WriteFile(FileHandle, Data, sizeof Data, &BytesTransferred, 0);
+    ASSERT(Success);
+    ASSERT(sizeof Data == BytesTransferred);
+
+    Result = FspFileSystemNotifyBegin(FileSystem, 1000);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    /* the middle page changed */
+    FileName = L"\\file0";
+    RangeInfo.V.Size = (UINT16)(sizeof(FSP_FSCTL_NOTIFY_RANGE_INFO) + wcslen(FileName) * sizeof(WCHAR));
+    RangeInfo.V.Filter = FILE_NOTIFY_CHANGE_LAST_WRITE;
+    RangeInfo.V.Action = FILE_ACTION_MODIFIED;
+    RangeInfo.V.Offset = 4096;
+    RangeInfo.V.Length = 4096;
+    RangeInfo.V.FileSize = FSP_FSCTL_NOTIFY_FILESIZE_UNCHANGED;
+    memcpy(RangeInfo.V.FileNameBuf, FileName, RangeInfo.V.Size - sizeof(FSP_FSCTL_NOTIFY_RANGE_INFO));
+    Success = FspFileSystemAddNotifyRangeInfo(&RangeInfo.V, &Buffer, sizeof Buffer, &Length);
+    ASSERT(Success);
+
+    /* a range past the end of file together with a file size that did not change */
+    RangeInfo.V.Offset = 5 * 4096;
+    RangeInfo.V.Length = (UINT64)-1;
+    RangeInfo.V.FileSize = sizeof Data;
+    Success = FspFileSystemAddNotifyRangeInfo(&RangeInfo.V, &Buffer, sizeof Buffer, &Length);
+    ASSERT(Success);
+
+    /* range and regular notify information can be mixed */
+    FileName = L"\\";
+    NotifyInfo.V.Size = (UINT16)(sizeof(FSP_FSCTL_NOTIFY_INFO) + wcslen(FileName) * sizeof(WCHAR));
+    NotifyInfo.V.Filter = FILE_NOTIFY_CHANGE_LAST_WRITE;
+    NotifyInfo.V.Action = FILE_ACTION_MODIFIED;
+    memcpy(NotifyInfo.V.FileNameBuf, FileName, NotifyInfo.V.Size - sizeof(FSP_FSCTL_NOTIFY_INFO));
+    Success = FspFileSystemAddNotifyInfo(&NotifyInfo.V, &Buffer, sizeof Buffer, &Length);
+    ASSERT(Success);
+
+    /* relative name: relative to the last absolute name */
+    FileName = L"file0";
+    RangeInfo.V.Size = (UINT16)(sizeof(FSP_FSCTL_NOTIFY_RANGE_INFO) + wcslen(FileName) * sizeof(WCHAR));
+    RangeInfo.V.Offset = 0;
+    RangeInfo.V.Length = 1;
+    RangeInfo.V.FileSize = FSP_FSCTL_NOTIFY_FILESIZE_UNCHANGED;
+    memcpy(RangeInfo.V.FileNameBuf, FileName, RangeInfo.V.Size - sizeof(FSP_FSCTL_NOTIFY_RANGE_INFO));
+    Success = FspFileSystemAddNotifyRangeInfo(&RangeInfo.V, &Buffer, sizeof Buffer, &Length);
+    ASSERT(Success);
+
+    Result = FspFileSystemNotify(FileSystem, &Buffer.V, Length);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    Result = FspFileSystemNotifyEnd(FileSystem);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    Success = GetFileSizeEx(FileHandle, &FileSize);
+    ASSERT(Success);
+    ASSERT(sizeof Data == FileSize.QuadPart);
+
+    FileSize.QuadPart = 0;
+    Success = SetFilePointerEx(FileHandle, FileSize, 0, FILE_BEGIN);
+    ASSERT(Success);
+    Success = ReadFile(FileHandle, ReadData, sizeof ReadData, &BytesTransferred, 0);
+    ASSERT(Success);
+    ASSERT(sizeof ReadData == BytesTransferred);
+    ASSERT(0 == memcmp(Data, ReadData, sizeof Data));
+
+    CloseHandle(FileHandle);
+
+    memfs_stop(memfs);
+}
+
+static
+void notify_range_change_test(void)
+{
+    if (WinFspDiskTests)
+    {
+        notify_range_change_dotest(MemfsDisk, 0, 0);
+        notify_range_change_dotest(MemfsDisk, 0, 1000);
+        notify_range_change_dotest(MemfsDisk, 0, INFINITE);
+    }
+    if (WinFspNetTests)
+    {
+        notify_range_change_dotest(MemfsNet, L"\\\\memfs\\share", 0);
+        notify_range_change_dotest(MemfsNet, L"\\\\memfs\\share", 1000);
+        notify_range_change_dotest(MemfsNet, L"\\\\memfs\\share", INFINITE);
+    }
+}
+
 static
 unsigned __stdcall notify_dirnotify_dotest_thread(void *FileSystem0)
 {
@@ -488,5 +614,6 @@ void notify_tests(void)
     TEST(notify_multiple_end_test);
     TEST(notify_change_test);
     TEST(notify_open_change_test);
+    TEST(notify_range_change_test);
     TEST(notify_dirnotify_test);
 }
@@ -0,0 +1,241 @@
+/**
+ * @file opstat-test.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <winfsp/winfsp.h>
+#include <tlib/testsuite.h>
+#include <strsafe.h>
+#include "memfs.h"
+
+#include "winfsp-tests.h"
+
+static UINT64 opstat_histogram_count(FSP_FILE_SYSTEM_OPERATION_STATISTICS *Statistics)
+{
+    UINT64 Count = 0;
+
+    for (ULONG I = 0; FSP_FILE_SYSTEM_OPERATION_HISTOGRAM_COUNT > I; I++)
+        Count += Statistics->Histogram[I];
+
+    return Count;
+}
+
+static void opstat_replay_test(void)
+{
+    HANDLE TraceHandle;
+    MEMFS *Memfs;
+    FSP_FILE_SYSTEM_REPLAY_STATISTICS ReplayStatistics;
+    FSP_FILE_SYSTEM_OPERATION_STATISTICS Statistics[FspFsctlTransactKindCount];
+    NTSTATUS Result;
+
+    TraceHandle = trace_tempfile();
+    Result = FspDebugLogStartTraceEx(TraceHandle, FspDebugLogTraceNoDrop);
+    ASSERT(STATUS_SUCCESS == Result);
+    trace_record(FspFsctlTransactCreateKind, 1, 0, STATUS_SUCCESS, 0x1000);
+    for (ULONG I = 0; 10 > I; I++)
+        trace_record(FspFsctlTransactReadKind, 2 + I, 0x1000, STATUS_END_OF_FILE, 0);
+    trace_record(FspFsctlTransactCleanupKind, 12, 0x1000, STATUS_SUCCESS, 0);
+    trace_record(FspFsctlTransactCloseKind, 13, 0x1000, STATUS_SUCCESS, 0);
+    FspDebugLogStopTrace();
+
+    Memfs = memfs_create_detached();
+
+    /* nothing dispatched yet */
+    Result = FspFileSystemGetOperationStatistics(MemfsFileSystem(Memfs),
+        Statistics, FspFsctlTransactKindCount);
+    ASSERT(STATUS_SUCCESS == Result);
+    for (ULONG Kind = 0; FspFsctlTransactKindCount > Kind; Kind++)
+        ASSERT(0 == Statistics[Kind].Count);
+
+    ASSERT(INVALID_SET_FILE_POINTER != SetFilePointer(TraceHandle, 0, 0, FILE_BEGIN));
+    Result = FspFileSystemReplayTrace(MemfsFileSystem(Memfs), TraceHandle, 0, &ReplayStatistics);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(13 == ReplayStatistics.RequestCount);
+
+    Result = FspFileSystemGetOperationStatistics(MemfsFileSystem(Memfs),
+        Statistics, FspFsctlTransactKindCount);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(1 == Statistics[FspFsctlTransactCreateKind].Count);
+    ASSERT(0 == Statistics[FspFsctlTransactCreateKind].ErrorCount);
+    ASSERT(10 == Statistics[FspFsctlTransactReadKind].Count);
+    ASSERT(10 == Statistics[FspFsctlTransactReadKind].ErrorCount);   /* empty file: EOF */
+    ASSERT(1 == Statistics[FspFsctlTransactCleanupKind].Count);
+    ASSERT(1 == Statistics[FspFsctlTransactCloseKind].Count);
+    ASSERT(0 == Statistics[FspFsctlTransactWriteKind].Count);
+    for (ULONG Kind = 0; FspFsctlTransactKindCount > Kind; Kind++)
+    {
+        ASSERT(Statistics[Kind].Count == opstat_histogram_count(&Statistics[Kind]));
+        ASSERT(Statistics[Kind].MaxTime <= Statistics[Kind].TotalTime);
+    }
+
+    /* a shorter array receives a prefix of the statistics */
+    Result = FspFileSystemGetOperationStatistics(MemfsFileSystem(Memfs),
+        Statistics, FspFsctlTransactCreateKind + 1);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(1 == Statistics[FspFsctlTransactCreateKind].Count);
+
+    MemfsDelete(Memfs);
+
+    /* disabled statistics are not recorded */
+    Memfs = memfs_create_detached();
+
+    Result = FspFileSystemSetOperationStatistics(MemfsFileSystem(Memfs), FALSE);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    ASSERT(INVALID_SET_FILE_POINTER != SetFilePointer(TraceHandle, 0, 0, FILE_BEGIN));
+    Result = FspFileSystemReplayTrace(MemfsFileSystem(Memfs), TraceHandle, 0, &ReplayStatistics);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    Result = FspFileSystemGetOperationStatistics(MemfsFileSystem(Memfs),
+        Statistics, FspFsctlTransactKindCount);
+    ASSERT(STATUS_SUCCESS == Result);
+    for (ULONG Kind = 0; FspFsctlTransactKindCount > Kind; Kind++)
+        ASSERT(0 == Statistics[Kind].Count);
+
+    MemfsDelete(Memfs);
+
+    CloseHandle(TraceHandle);
+}
+
+static void opstat_dotest(ULONG Flags)
+{
+    void *memfs = memfs_start(Flags);
+
+    FSP_FILE_SYSTEM_OPERATION_STATISTICS Statistics[FspFsctlTransactKindCount];
+    FSP_FILE_SYSTEM_OPERATION_STATISTICS VolumeStatistics[FspFsctlTransactKindCount];
+    HANDLE Handle;
+    WCHAR FilePath[MAX_PATH];
+    NTSTATUS Result;
+
+    StringCbPrintfW(FilePath, sizeof FilePath, L"\\\\?\\GLOBALROOT%s\\file0",
+        memfs_volumename(memfs));
+
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE != Handle);
+    CloseHandle(Handle);
+
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE == Handle);
+    ASSERT(ERROR_FILE_EXISTS == GetLastError());
+
+    Result = FspFileSystemGetOperationStatistics(MemfsFileSystem(memfs),
+        Statistics, FspFsctlTransactKindCount);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(2 <= Statistics[FspFsctlTransactCreateKind].Count);
+    ASSERT(1 <= Statistics[FspFsctlTransactCreateKind].ErrorCount);
+
+    /* the same statistics are visible through the volume name */
+    Result = FspFileSystemGetVolumeOperationStatistics(memfs_volumename(memfs),
+        VolumeStatistics, FspFsctlTransactKindCount);
+    ASSERT(STATUS_SUCCESS == Result);
+    ASSERT(Statistics[FspFsctlTransactCreateKind].Count <=
+        VolumeStatistics[FspFsctlTransactCreateKind].Count);
+    ASSERT(Statistics[FspFsctlTransactCreateKind].ErrorCount <=
+        VolumeStatistics[FspFsctlTransactCreateKind].ErrorCount);
+
+    /* the dispatcher is running */
+    Result = FspFileSystemSetOperationStatistics(MemfsFileSystem(memfs), FALSE);
+    ASSERT(STATUS_INVALID_DEVICE_REQUEST == Result);
+
+    memfs_stop(memfs);
+
+    Result = FspFileSystemGetVolumeOperationStatistics(L"\\Device\\Volume{00000000-0000-0000-0000-000000000000}",
+        VolumeStatistics, FspFsctlTransactKindCount);
+    ASSERT(STATUS_OBJECT_NAME_NOT_FOUND == Result);
+}
+
+static void opstat_test(void)
+{
+    if (WinFspDiskTests)
+        opstat_dotest(MemfsDisk);
+    if (WinFspNetTests)
+        opstat_dotest(MemfsNet);
+}
+
+#define OPSTAT_OVERHEAD_COUNT           100000
+
+static void opstat_overhead_dotest(ULONG Flags, BOOLEAN Enable, double *PSeconds)
+{
+    MEMFS *Memfs;
+    HANDLE Handle;
+    WCHAR FilePath[MAX_PATH];
+    LARGE_INTEGER Frequency, StartCounter, EndCounter;
+    NTSTATUS Result;
+
+    Result = MemfsCreateFunnel(Flags, 1000, 1024, 1024 * 1024, 0, 0, 0, 0,
+        MemfsNet == (Flags & MemfsDeviceMask) ? L"\\memfs\\share" : 0, 0, &Memfs);
+    ASSERT(NT_SUCCESS(Result));
+
+    Result = FspFileSystemSetOperationStatistics(MemfsFileSystem(Memfs), Enable);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    Result = MemfsStart(Memfs);
+    ASSERT(NT_SUCCESS(Result));
+
+    StringCbPrintfW(FilePath, sizeof FilePath, L"\\\\?\\GLOBALROOT%s\\file0",
+        MemfsFileSystem(Memfs)->VolumeName);
+
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, 0);
+    ASSERT(INVALID_HANDLE_VALUE != Handle);
+    CloseHandle(Handle);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&StartCounter);
+    for (ULONG I = 0; OPSTAT_OVERHEAD_COUNT > I; I++)
+    {
+        Handle = CreateFileW(FilePath,
+            FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_EXISTING, 0, 0);
+        ASSERT(INVALID_HANDLE_VALUE != Handle);
+        CloseHandle(Handle);
+    }
+    QueryPerformanceCounter(&EndCounter);
+
+    *PSeconds = (double)(EndCounter.QuadPart - StartCounter.QuadPart) / Frequency.QuadPart;
+
+    MemfsStop(Memfs);
+    MemfsDelete(Memfs);
+}
+
+static void opstat_overhead_test(void)
+{
+    double Seconds[2];
+
+    if (!WinFspDiskTests)
+        return;
+
+    opstat_overhead_dotest(MemfsDisk, FALSE, &Seconds[0]);
+    opstat_overhead_dotest(MemfsDisk, TRUE, &Seconds[1]);
+
+    tlib_printf("opens=%u: disabled=%.2fus/open enabled=%.2fus/open",
+        OPSTAT_OVERHEAD_COUNT,
+        Seconds[0] * 1e6 / OPSTAT_OVERHEAD_COUNT, Seconds[1] * 1e6 / OPSTAT_OVERHEAD_COUNT);
+}
+
+void opstat_tests(void)
+{
+    if (OptExternal)
+        return;
+
+    TEST(opstat_replay_test);
+    TEST(opstat_test);
+    TEST_OPT(opstat_overhead_test);
+}
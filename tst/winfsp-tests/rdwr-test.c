@@ -886,6 +886,113 @@ void rdwr_noncached_overlapped_test(void)
     }
 }
 
+static void rdwr_noncached_large_dotest(ULONG Flags, PWSTR Prefix, ULONG FileInfoTimeout)
+{
+    void *memfs = memfs_start_ex(Flags, FileInfoTimeout);
+
+    HANDLE Handle;
+    BOOL Success;
+    WCHAR FilePath[MAX_PATH];
+    SYSTEM_INFO SystemInfo;
+    PVOID Buffer[2];
+    ULONG BufferSize, FileSize;
+    DWORD BytesTransferred;
+    DWORD FilePointer;
+
+    GetSystemInfo(&SystemInfo);
+
+    /* large enough to be split into many chunks; file size not chunk aligned */
+    BufferSize = 768 * 1024;
+    FileSize = 512 * 1024 + 3 * SystemInfo.dwPageSize;
+
+    Buffer[0] = _aligned_malloc(BufferSize, SystemInfo.dwPageSize);
+    Buffer[1] = _aligned_malloc(BufferSize, SystemInfo.dwPageSize);
+    ASSERT(0 != Buffer[0] && 0 != Buffer[1]);
+
+    srand((unsigned)time(0));
+    for (PUINT8 Bgn = Buffer[0], End = Bgn + BufferSize; End > Bgn; Bgn++)
+        *Bgn = rand();
+
+    StringCbPrintfW(FilePath, sizeof FilePath, L"%s%s\\file0",
+        Prefix ? L"" : L"\\\\?\\GLOBALROOT", Prefix ? Prefix : memfs_volumename(memfs));
+
+    Handle = CreateFileW(FilePath,
+        GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, 0,
+        CREATE_NEW, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, 0);
+    ASSERT(INVALID_HANDLE_VALUE != Handle);
+
+    Success = WriteFile(Handle, Buffer[0], FileSize, &BytesTransferred, 0);
+    ASSERT(Success);
+    ASSERT(FileSize == BytesTransferred);
+
+    /* read the whole file: chunks after EOF are short or empty */
+    FilePointer = SetFilePointer(Handle, 0, 0, FILE_BEGIN);
+    ASSERT(0 == FilePointer);
+    memset(Buffer[1], 0, BufferSize);
+    Success = ReadFile(Handle, Buffer[1], BufferSize, &BytesTransferred, 0);
+    ASSERT(Success);
+    ASSERT(FileSize == BytesTransferred);
+    ASSERT(FileSize == SetFilePointer(Handle, 0, 0, FILE_CURRENT));
+    ASSERT(0 == memcmp(Buffer[0], Buffer[1], BytesTransferred));
+
+    /* read from an offset that is not aligned to the split size */
+    FilePointer = SetFilePointer(Handle, SystemInfo.dwPageSize, 0, FILE_BEGIN);
+    ASSERT(SystemInfo.dwPageSize == FilePointer);
+    memset(Buffer[1], 0, BufferSize);
+    Success = ReadFile(Handle, Buffer[1], 256 * 1024, &BytesTransferred, 0);
+    ASSERT(Success);
+    ASSERT(256 * 1024 == BytesTransferred);
+    ASSERT(FilePointer + BytesTransferred == SetFilePointer(Handle, 0, 0, FILE_CURRENT));
+    ASSERT(0 == memcmp((PUINT8)Buffer[0] + FilePointer, Buffer[1], BytesTransferred));
+
+    /* read at EOF */
+    FilePointer = SetFilePointer(Handle, FileSize, 0, FILE_BEGIN);
+    ASSERT(FileSize == FilePointer);
+    Success = ReadFile(Handle, Buffer[1], BufferSize, &BytesTransferred, 0);
+    ASSERT(Success);
+    ASSERT(0 == BytesTransferred);
+
+    Success = CloseHandle(Handle);
+    ASSERT(Success);
+
+    Success = DeleteFileW(FilePath);
+    ASSERT(Success);
+
+    _aligned_free(Buffer[0]);
+    _aligned_free(Buffer[1]);
+
+    memfs_stop(memfs);
+}
+
+void rdwr_noncached_split_test(void)
+{
+    if (WinFspDiskTests)
+    {
+        rdwr_noncached_large_dotest(MemfsDisk | MemfsReadSplit, 0, 1000);
+        rdwr_noncached_large_dotest(MemfsDisk | MemfsReadSplit, 0, INFINITE);
+    }
+    if (WinFspNetTests)
+    {
+        rdwr_noncached_large_dotest(MemfsNet | MemfsReadSplit, L"\\\\memfs\\share", 1000);
+        rdwr_noncached_large_dotest(MemfsNet | MemfsReadSplit, L"\\\\memfs\\share", INFINITE);
+    }
+}
+
+void rdwr_noncached_dataring_test(void)
+{
+    /* memfs uses 256K ring slots: smaller reads use the ring, larger ones fall back */
+    if (WinFspDiskTests)
+    {
+        rdwr_noncached_large_dotest(MemfsDisk | MemfsDataRing, 0, 1000);
+        rdwr_noncached_large_dotest(MemfsDisk | MemfsDataRing | MemfsReadSplit, 0, INFINITE);
+    }
+    if (WinFspNetTests)
+    {
+        rdwr_noncached_large_dotest(MemfsNet | MemfsDataRing, L"\\\\memfs\\share", 1000);
+        rdwr_noncached_large_dotest(MemfsNet | MemfsDataRing | MemfsReadSplit, L"\\\\memfs\\share", INFINITE);
+    }
+}
+
 void rdwr_cached_test(void)
 {
     if (NtfsTests)
@@ -1122,6 +1229,8 @@ void rdwr_tests(void)
     TEST(rdwr_noncached_append_test);
 #endif
     TEST(rdwr_noncached_overlapped_test);
+    TEST(rdwr_noncached_split_test);
+    TEST(rdwr_noncached_dataring_test);
     TEST(rdwr_cached_test);
     TEST(rdwr_cached_append_test);
     TEST(rdwr_cached_overlapped_test);
@@ -0,0 +1,398 @@
+/**
+ * @file rpcache-test.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <winfsp/winfsp.h>
+#include <tlib/testsuite.h>
+
+#include "winfsp-tests.h"
+
+/*
+ * A stand-in for a FUSE backend: every GetReparsePointByName call is an "upcall" that is
+ * counted and (optionally) delayed. The backend knows a handful of symlinks; everything
+ * else is a directory or file that is not a reparse point.
+ */
+
+#define RPCACHE_LINK_COUNT              4
+
+static struct
+{
+    PWSTR FileName;
+    PWSTR Target;
+} rpcache_Links[RPCACHE_LINK_COUNT];
+static BOOLEAN rpcache_CaseInsensitive;
+static ULONG rpcache_DelayCount;
+static volatile LONG rpcache_Upcalls;
+
+static NTSTATUS rpcache_GetReparsePointByName(
+    FSP_FILE_SYSTEM *FileSystem, PVOID Context,
+    PWSTR FileName, BOOLEAN IsDirectory, PVOID Buffer, PSIZE_T PSize)
+{
+    PREPARSE_DATA_BUFFER ReparseData = Buffer;
+    SIZE_T TargetSize, Size;
+
+    InterlockedIncrement(&rpcache_Upcalls);
+    for (volatile ULONG I = 0; rpcache_DelayCount > I; I++)
+        ;
+
+    for (ULONG I = 0; RPCACHE_LINK_COUNT > I; I++)
+    {
+        if (0 == rpcache_Links[I].FileName)
+            continue;
+        if (0 != (rpcache_CaseInsensitive ?
+            _wcsicmp(FileName, rpcache_Links[I].FileName) :
+            wcscmp(FileName, rpcache_Links[I].FileName)))
+            continue;
+
+        if (0 == Buffer)
+            return STATUS_SUCCESS;
+
+        TargetSize = wcslen(rpcache_Links[I].Target) * sizeof(WCHAR);
+        Size = FIELD_OFFSET(REPARSE_DATA_BUFFER, SymbolicLinkReparseBuffer.PathBuffer) + TargetSize;
+        if (Size > *PSize)
+            return STATUS_BUFFER_TOO_SMALL;
+
+        memset(ReparseData, 0, Size);
+        ReparseData->ReparseTag = IO_REPARSE_TAG_SYMLINK;
+        ReparseData->ReparseDataLength = (USHORT)(Size - REPARSE_DATA_BUFFER_HEADER_SIZE);
+        ReparseData->SymbolicLinkReparseBuffer.SubstituteNameLength = (USHORT)TargetSize;
+        ReparseData->SymbolicLinkReparseBuffer.PrintNameLength = (USHORT)TargetSize;
+        ReparseData->SymbolicLinkReparseBuffer.Flags = SYMLINK_FLAG_RELATIVE;
+        memcpy(ReparseData->SymbolicLinkReparseBuffer.PathBuffer,
+            rpcache_Links[I].Target, TargetSize);
+        *PSize = Size;
+
+        return STATUS_SUCCESS;
+    }
+
+    return STATUS_NOT_A_REPARSE_POINT;
+}
+
+static FSP_FILE_SYSTEM *rpcache_create(BOOLEAN CaseInsensitive)
+{
+    FSP_FSCTL_VOLUME_PARAMS VolumeParams;
+    FSP_FILE_SYSTEM *FileSystem;
+    NTSTATUS Result;
+
+    memset(&VolumeParams, 0, sizeof VolumeParams);
+    VolumeParams.Version = sizeof FSP_FSCTL_VOLUME_PARAMS;
+    VolumeParams.CaseSensitiveSearch = !CaseInsensitive;
+    VolumeParams.CasePreservedNames = 1;
+    VolumeParams.ReparsePoints = 1;
+
+    /* detached file system object: no FSD required */
+    Result = FspFileSystemCreate(0, &VolumeParams, 0, &FileSystem);
+    ASSERT(NT_SUCCESS(Result));
+
+    memset(rpcache_Links, 0, sizeof rpcache_Links);
+    rpcache_CaseInsensitive = CaseInsensitive;
+    rpcache_DelayCount = 0;
+    rpcache_Upcalls = 0;
+
+    return FileSystem;
+}
+
+static BOOLEAN rpcache_find(FSP_FILE_SYSTEM *FileSystem, PWSTR FileName0, PUINT32 PIndex)
+{
+    WCHAR FileName[260];
+
+    /* FspFileSystemFindReparsePoint temporarily modifies FileName */
+    wcscpy_s(FileName, 260, FileName0);
+    return FspFileSystemFindReparsePoint(FileSystem, rpcache_GetReparsePointByName, 0,
+        FileName, PIndex);
+}
+
+static void rpcache_notify(FSP_FILE_SYSTEM *FileSystem, PWSTR FileName)
+{
+    union
+    {
+        FSP_FSCTL_NOTIFY_INFO V;
+        UINT8 B[sizeof(FSP_FSCTL_NOTIFY_INFO) + 260 * sizeof(WCHAR)];
+    } NotifyInfo;
+    ULONG Length = (ULONG)wcslen(FileName);
+
+    NotifyInfo.V.Size = (UINT16)(sizeof(FSP_FSCTL_NOTIFY_INFO) + Length * sizeof(WCHAR));
+    NotifyInfo.V.Filter = FILE_NOTIFY_CHANGE_ATTRIBUTES;
+    NotifyInfo.V.Action = FILE_ACTION_MODIFIED;
+    memcpy(NotifyInfo.V.FileNameBuf, FileName, Length * sizeof(WCHAR));
+
+    /* the file system is detached, so the FSD part of the notification fails */
+    FspFileSystemNotify(FileSystem, &NotifyInfo.V, NotifyInfo.V.Size);
+}
+
+static void rpcache_find_test(void)
+{
+    FSP_FILE_SYSTEM *FileSystem;
+    UINT32 Index;
+    BOOLEAN Found;
+    NTSTATUS Result;
+
+    FileSystem = rpcache_create(FALSE);
+    rpcache_Links[0].FileName = L"\\a\\b\\link";
+    rpcache_Links[0].Target = L"c";
+
+    /* no cache: one upcall per directory component */
+    Found = rpcache_find(FileSystem, L"\\a\\b\\c\\d\\file", &Index);
+    ASSERT(!Found);
+    ASSERT(4 == rpcache_Upcalls);
+    Found = rpcache_find(FileSystem, L"\\a\\b\\c\\d\\file", &Index);
+    ASSERT(!Found);
+    ASSERT(8 == rpcache_Upcalls);
+
+    Result = FspFileSystemSetReparsePointCache(FileSystem, 60000, 0);
+    ASSERT(NT_SUCCESS(Result));
+    rpcache_Upcalls = 0;
+
+    /* cache: second lookup is free */
+    Found = rpcache_find(FileSystem, L"\\a\\b\\c\\d\\file", &Index);
+    ASSERT(!Found);
+    ASSERT(4 == rpcache_Upcalls);
+    Found = rpcache_find(FileSystem, L"\\a\\b\\c\\d\\file", &Index);
+    ASSERT(!Found);
+    ASSERT(4 == rpcache_Upcalls);
+
+    /* positive results are cached too */
+    Index = 0;
+    Found = rpcache_find(FileSystem, L"\\a\\b\\link\\x\\file", &Index);
+    ASSERT(Found);
+    ASSERT(wcslen(L"\\a\\b\\") == Index);
+    ASSERT(5 == rpcache_Upcalls);
+    Index = 0;
+    Found = rpcache_find(FileSystem, L"\\a\\b\\link\\x\\file", &Index);
+    ASSERT(Found);
+    ASSERT(wcslen(L"\\a\\b\\") == Index);
+    ASSERT(5 == rpcache_Upcalls);
+
+    /* the backend changes; the cache is stale until notified */
+    rpcache_Links[1].FileName = L"\\a\\b\\c";
+    rpcache_Links[1].Target = L"link";
+    Found = rpcache_find(FileSystem, L"\\a\\b\\c\\d\\file", &Index);
+    ASSERT(!Found);
+    ASSERT(5 == rpcache_Upcalls);
+
+    /* notifying a directory invalidates it and everything below it */
+    rpcache_notify(FileSystem, L"\\a\\b");
+    Index = 0;
+    Found = rpcache_find(FileSystem, L"\\a\\b\\c\\d\\file", &Index);
+    ASSERT(Found);
+    ASSERT(wcslen(L"\\a\\b\\") == Index);
+    ASSERT(7 == rpcache_Upcalls);
+
+    /* entries outside the notified directory are unaffected */
+    Found = rpcache_find(FileSystem, L"\\a\\file", &Index);
+    ASSERT(!Found);
+    ASSERT(7 == rpcache_Upcalls);
+
+    /* disabling the cache goes back to upcalls */
+    Result = FspFileSystemSetReparsePointCache(FileSystem, 0, 0);
+    ASSERT(NT_SUCCESS(Result));
+    Found = rpcache_find(FileSystem, L"\\a\\file", &Index);
+    ASSERT(!Found);
+    ASSERT(8 == rpcache_Upcalls);
+
+    FspFileSystemDelete(FileSystem);
+}
+
+static void rpcache_timeout_test(void)
+{
+    FSP_FILE_SYSTEM *FileSystem;
+    UINT32 Index;
+    BOOLEAN Found;
+    NTSTATUS Result;
+
+    FileSystem = rpcache_create(FALSE);
+
+    Result = FspFileSystemSetReparsePointCache(FileSystem, 100, 0);
+    ASSERT(NT_SUCCESS(Result));
+
+    Found = rpcache_find(FileSystem, L"\\a\\b\\file", &Index);
+    ASSERT(!Found);
+    ASSERT(2 == rpcache_Upcalls);
+
+    /* an unreported backend change becomes visible once the entries expire */
+    rpcache_Links[0].FileName = L"\\a";
+    rpcache_Links[0].Target = L"b";
+    Found = rpcache_find(FileSystem, L"\\a\\b\\file", &Index);
+    ASSERT(!Found);
+    ASSERT(2 == rpcache_Upcalls);
+
+    Sleep(300);
+
+    Index = 0;
+    Found = rpcache_find(FileSystem, L"\\a\\b\\file", &Index);
+    ASSERT(Found);
+    ASSERT(1 == Index);
+    ASSERT(3 == rpcache_Upcalls);
+
+    FspFileSystemDelete(FileSystem);
+}
+
+static void rpcache_bounded_test(void)
+{
+    FSP_FILE_SYSTEM *FileSystem;
+    WCHAR FileName[64];
+    UINT32 Index;
+    BOOLEAN Found;
+    NTSTATUS Result;
+
+    FileSystem = rpcache_create(TRUE);
+
+    Result = FspFileSystemSetReparsePointCache(FileSystem, 60000, 16);
+    ASSERT(NT_SUCCESS(Result));
+
+    /* case-insensitive file systems share entries between case variants */
+    Found = rpcache_find(FileSystem, L"\\dir\\sub\\file", &Index);
+    ASSERT(!Found);
+    ASSERT(2 == rpcache_Upcalls);
+    Found = rpcache_find(FileSystem, L"\\DIR\\Sub\\file", &Index);
+    ASSERT(!Found);
+    ASSERT(2 == rpcache_Upcalls);
+
+    /* filling the cache evicts the oldest entries */
+    for (ULONG I = 0; 32 > I; I++)
+    {
+        wsprintfW(FileName, L"\\dir%u\\file", I);
+        Found = rpcache_find(FileSystem, FileName, &Index);
+        ASSERT(!Found);
+    }
+    ASSERT(34 == rpcache_Upcalls);
+    Found = rpcache_find(FileSystem, L"\\dir\\sub\\file", &Index);
+    ASSERT(!Found);
+    ASSERT(36 == rpcache_Upcalls);
+    Found = rpcache_find(FileSystem, L"\\dir31\\file", &Index);
+    ASSERT(!Found);
+    ASSERT(36 == rpcache_Upcalls);
+
+    FspFileSystemDelete(FileSystem);
+}
+
+static void rpcache_resolve_dotest(FSP_FILE_SYSTEM *FileSystem,
+    IO_STATUS_BLOCK *IoStatus, PVOID Buffer, PSIZE_T PSize)
+{
+    WCHAR FileName[260];
+    NTSTATUS Result;
+
+    wcscpy_s(FileName, 260, L"\\a\\link1\\x\\file");
+    memset(IoStatus, 0, sizeof *IoStatus);
+    Result = FspFileSystemResolveReparsePoints(FileSystem, rpcache_GetReparsePointByName, 0,
+        FileName, 0, TRUE, IoStatus, Buffer, PSize);
+    ASSERT(STATUS_REPARSE == Result);
+}
+
+static void rpcache_resolve_test(void)
+{
+    FSP_FILE_SYSTEM *FileSystem;
+    union
+    {
+        REPARSE_DATA_BUFFER D;
+        UINT8 B[FSP_FSCTL_TRANSACT_PATH_SIZEMAX + 1024];
+    } Buffer0, Buffer1;
+    IO_STATUS_BLOCK IoStatus0, IoStatus1;
+    SIZE_T Size0, Size1;
+    LONG Upcalls;
+    NTSTATUS Result;
+
+    FileSystem = rpcache_create(FALSE);
+    rpcache_Links[0].FileName = L"\\a\\link1";
+    rpcache_Links[0].Target = L"link2";
+    rpcache_Links[1].FileName = L"\\a\\link2";
+    rpcache_Links[1].Target = L"b";
+
+    Size0 = sizeof Buffer0;
+    rpcache_resolve_dotest(FileSystem, &IoStatus0, &Buffer0, &Size0);
+    Upcalls = rpcache_Upcalls;
+
+    Result = FspFileSystemSetReparsePointCache(FileSystem, 60000, 0);
+    ASSERT(NT_SUCCESS(Result));
+
+    /* the first resolution fills the cache, the second one makes no upcalls */
+    for (int Pass = 0; 2 > Pass; Pass++)
+    {
+        rpcache_Upcalls = 0;
+        Size1 = sizeof Buffer1;
+        rpcache_resolve_dotest(FileSystem, &IoStatus1, &Buffer1, &Size1);
+        ASSERT(0 == Pass ? Upcalls >= rpcache_Upcalls : 0 == rpcache_Upcalls);
+        ASSERT(IoStatus0.Status == IoStatus1.Status);
+        ASSERT(IoStatus0.Information == IoStatus1.Information);
+        ASSERT(Size0 == Size1);
+        ASSERT(0 == memcmp(&Buffer0, &Buffer1, Size0));
+    }
+
+    FspFileSystemDelete(FileSystem);
+}
+
+static void rpcache_bench_test(void)
+{
+    enum { Depth = 16, Iterations = 100000 };
+    FSP_FILE_SYSTEM *FileSystem;
+    WCHAR FileName[260], *P;
+    LARGE_INTEGER Frequency, StartCounter, EndCounter;
+    double Seconds[2];
+    LONG Upcalls[2];
+    UINT32 Index;
+    NTSTATUS Result;
+
+    P = FileName;
+    for (ULONG I = 0; Depth > I; I++)
+        P += wsprintfW(P, L"\\directory%u", I);
+    wcscpy_s(P, 260 - (P - FileName), L"\\file.txt");
+
+    QueryPerformanceFrequency(&Frequency);
+
+    for (int Cached = 0; 2 > Cached; Cached++)
+    {
+        FileSystem = rpcache_create(FALSE);
+        rpcache_DelayCount = 1000;  /* stand-in for the cost of a FUSE getattr upcall */
+
+        if (Cached)
+        {
+            Result = FspFileSystemSetReparsePointCache(FileSystem, 60000, 0);
+            ASSERT(NT_SUCCESS(Result));
+        }
+
+        QueryPerformanceCounter(&StartCounter);
+        for (ULONG I = 0; Iterations > I; I++)
+            ASSERT(!rpcache_find(FileSystem, FileName, &Index));
+        QueryPerformanceCounter(&EndCounter);
+
+        Seconds[Cached] = (double)(EndCounter.QuadPart - StartCounter.QuadPart) / Frequency.QuadPart;
+        Upcalls[Cached] = rpcache_Upcalls;
+
+        FspFileSystemDelete(FileSystem);
+    }
+
+    ASSERT(Depth * Iterations == Upcalls[0]);
+    ASSERT(Depth == Upcalls[1]);
+
+    tlib_printf("depth=%u lookups=%u: uncached=%.3fs/%ld upcalls cached=%.3fs/%ld upcalls",
+        Depth, Iterations, Seconds[0], Upcalls[0], Seconds[1], Upcalls[1]);
+}
+
+void rpcache_tests(void)
+{
+    if (OptExternal)
+        return;
+
+    TEST(rpcache_find_test);
+    TEST(rpcache_timeout_test);
+    TEST(rpcache_bounded_test);
+    TEST(rpcache_resolve_test);
+    TEST_OPT(rpcache_bench_test);
+}
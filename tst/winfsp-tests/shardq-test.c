@@ -0,0 +1,431 @@
+/**
+ * @file shardq-test.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+
+#include <winfsp/winfsp.h>
+#include <tlib/testsuite.h>
+#include <process.h>
+
+#include "winfsp-tests.h"
+
+#include <shared/ku/shardq.c>
+
+/*
+ * These tests drive a shard queue the way the FSD drives its pending IRP queue (FSP_IOQ):
+ * a shard is locked around every insertion and removal, a consumer removes the head of the
+ * shard that FspShardQueueOldestShard finds only if that head is still the same, cancelation
+ * removes an entry from the middle of its shard, and consumers sleep on an auto-reset event
+ * that producers only signal when FspShardQueueInsertTail reports a waiter.
+ */
+typedef struct
+{
+    UINT_PTR Sequence;                  /* used by the queue */
+    LIST_ENTRY ListEntry;
+    FSP_SHARD_QUEUE_SHARD *volatile Shard;
+    BOOLEAN Queued;
+    volatile LONG Removed;
+    ULONG Producer, Index;
+} SHARDQ_ITEM;
+#define SHARDQ_SEQUENCE_OFFSET          \
+    ((LONG)FIELD_OFFSET(SHARDQ_ITEM, Sequence) - (LONG)FIELD_OFFSET(SHARDQ_ITEM, ListEntry))
+
+typedef struct
+{
+    FSP_SHARD_QUEUE *Queue;
+    HANDLE Event;
+    volatile LONG Stopped;
+} SHARDQ_MODEL;
+
+static void shardq_model_create(SHARDQ_MODEL *Model, ULONG ShardCount)
+{
+    NTSTATUS Result;
+
+    Result = FspShardQueueCreate(ShardCount, 0, SHARDQ_SEQUENCE_OFFSET, &Model->Queue);
+    ASSERT(STATUS_SUCCESS == Result);
+    Model->Event = CreateEventW(0, FALSE, FALSE, 0);
+    ASSERT(0 != Model->Event);
+    Model->Stopped = 0;
+}
+
+static void shardq_model_delete(SHARDQ_MODEL *Model)
+{
+    CloseHandle(Model->Event);
+    FspShardQueueDelete(Model->Queue);
+}
+
+static void shardq_post(SHARDQ_MODEL *Model, FSP_SHARD_QUEUE_SHARD *Shard, SHARDQ_ITEM *Item)
+{
+    FSP_SHARD_QUEUE_LOCK_STATE LockState;
+    BOOLEAN Wake;
+
+    FspShardQueueLock(Shard, &LockState);
+    Item->Shard = Shard;
+    Item->Queued = TRUE;
+    Wake = FspShardQueueInsertTail(Model->Queue, Shard, &Item->ListEntry);
+    FspShardQueueUnlock(Shard, LockState);
+
+    if (Wake)
+        SetEvent(Model->Event);
+}
+
+static SHARDQ_ITEM *shardq_remove_next(SHARDQ_MODEL *Model)
+{
+    FSP_SHARD_QUEUE_SHARD *Shard;
+    FSP_SHARD_QUEUE_LOCK_STATE LockState;
+    PLIST_ENTRY Entry;
+    SHARDQ_ITEM *Item;
+    LONG HeadSequence;
+    BOOLEAN Wake = FALSE;
+
+    for (;;)
+    {
+        Shard = FspShardQueueOldestShard(Model->Queue, &HeadSequence);
+        if (0 == Shard)
+            return 0;
+
+        Item = 0;
+        FspShardQueueLock(Shard, &LockState);
+        Entry = FspShardQueueNext(Shard, 0);
+        if (0 != Entry && HeadSequence == Shard->HeadSequence)
+        {
+            Item = CONTAINING_RECORD(Entry, SHARDQ_ITEM, ListEntry);
+            Item->Queued = FALSE;
+            Wake = FspShardQueueRemove(Model->Queue, Shard, Entry);
+        }
+        FspShardQueueUnlock(Shard, LockState);
+
+        if (0 != Item)
+        {
+            if (Wake)
+                SetEvent(Model->Event);
+            return Item;
+        }
+    }
+}
+
+static BOOLEAN shardq_cancel(SHARDQ_MODEL *Model, SHARDQ_ITEM *Item)
+{
+    FSP_SHARD_QUEUE_SHARD *Shard = Item->Shard;
+    FSP_SHARD_QUEUE_LOCK_STATE LockState;
+    BOOLEAN Cancelled = FALSE, Wake = FALSE;
+
+    if (0 == Shard)
+        return FALSE;
+
+    FspShardQueueLock(Shard, &LockState);
+    if (Item->Queued)
+    {
+        Item->Queued = FALSE;
+        Wake = FspShardQueueRemove(Model->Queue, Shard, &Item->ListEntry);
+        Cancelled = TRUE;
+    }
+    FspShardQueueUnlock(Shard, LockState);
+
+    if (Wake)
+        SetEvent(Model->Event);
+    return Cancelled;
+}
+
+static SHARDQ_ITEM *shardq_next(SHARDQ_MODEL *Model)
+{
+    SHARDQ_ITEM *Item;
+    DWORD WaitResult;
+
+    Item = shardq_remove_next(Model);
+    if (0 != Item)
+        return Item;
+
+    if (FspShardQueueBeginWait(Model->Queue) && !Model->Stopped)
+    {
+        /* a lost wakeup would leave us here while the producers keep posting */
+        WaitResult = WaitForSingleObject(Model->Event, 10000);
+        ASSERT(WAIT_OBJECT_0 == WaitResult);
+    }
+    FspShardQueueEndWait(Model->Queue);
+
+    Item = shardq_remove_next(Model);
+    if (0 == Item && (0 != FspShardQueueCount(Model->Queue) || Model->Stopped))
+        SetEvent(Model->Event);
+    return Item;
+}
+
+static void shardq_order_test(void)
+{
+    SHARDQ_MODEL Model;
+    SHARDQ_ITEM Items[1000], *Item;
+    ULONG ShardCount, Index;
+
+    shardq_model_create(&Model, 8);
+    ShardCount = FspShardQueueShardCount(Model.Queue);
+    ASSERT(8 == ShardCount);
+
+    /* entries inserted into different shards come out in insertion order */
+    memset(Items, 0, sizeof Items);
+    for (ULONG I = 0; 1000 > I; I++)
+    {
+        Items[I].Index = I;
+        shardq_post(&Model, FspShardQueueShard(Model.Queue, (I * 7 + I / 3) % ShardCount),
+            &Items[I]);
+    }
+    ASSERT(1000 == FspShardQueueCount(Model.Queue));
+
+    /* cancel some, including shard heads */
+    for (ULONG I = 0; 1000 > I; I += 3)
+        ASSERT(shardq_cancel(&Model, &Items[I]));
+    ASSERT(!shardq_cancel(&Model, &Items[0]));
+    ASSERT(1000 - 334 == FspShardQueueCount(Model.Queue));
+
+    Index = 0;
+    while (0 != (Item = shardq_remove_next(&Model)))
+    {
+        ASSERT(0 != Item->Index % 3);
+        ASSERT(Index < Item->Index);
+        ASSERT(0 == Item->Sequence);
+        Index = Item->Index;
+    }
+    ASSERT(998 == Index);
+    ASSERT(0 == FspShardQueueCount(Model.Queue));
+
+    /* sequence numbers wrap around */
+    Model.Queue->Counters->Sequence = 0x7ffffff0;
+    for (ULONG I = 0; 32 > I; I++)
+    {
+        Items[I].Index = I;
+        shardq_post(&Model, FspShardQueueShard(Model.Queue, ShardCount - 1 - I % ShardCount),
+            &Items[I]);
+    }
+    for (ULONG I = 0; 32 > I; I++)
+    {
+        Item = shardq_remove_next(&Model);
+        ASSERT(&Items[I] == Item);
+    }
+    ASSERT(0 == shardq_remove_next(&Model));
+
+    shardq_model_delete(&Model);
+}
+
+static void shardq_wait_test(void)
+{
+    SHARDQ_MODEL Model;
+    SHARDQ_ITEM Items[2];
+
+    shardq_model_create(&Model, 2);
+    memset(Items, 0, sizeof Items);
+
+    /* no waiters: producers do not signal */
+    ASSERT(!FspShardQueueInsertTail(Model.Queue, FspShardQueueShard(Model.Queue, 0),
+        &Items[0].ListEntry));
+    ASSERT(!FspShardQueueRemove(Model.Queue, FspShardQueueShard(Model.Queue, 0),
+        &Items[0].ListEntry));
+
+    /* a waiter on an empty queue sleeps and the next producer wakes it */
+    ASSERT(FspShardQueueBeginWait(Model.Queue));
+    ASSERT(FspShardQueueInsertTail(Model.Queue, FspShardQueueShard(Model.Queue, 0),
+        &Items[0].ListEntry));
+    ASSERT(FspShardQueueInsertTail(Model.Queue, FspShardQueueShard(Model.Queue, 1),
+        &Items[1].ListEntry));
+
+    /* a waiter on a non-empty queue does not sleep */
+    ASSERT(!FspShardQueueBeginWait(Model.Queue));
+    FspShardQueueEndWait(Model.Queue);
+
+    /* removal passes the wakeup along while entries remain */
+    ASSERT(FspShardQueueRemove(Model.Queue, FspShardQueueShard(Model.Queue, 0),
+        &Items[0].ListEntry));
+    ASSERT(!FspShardQueueRemove(Model.Queue, FspShardQueueShard(Model.Queue, 1),
+        &Items[1].ListEntry));
+    FspShardQueueEndWait(Model.Queue);
+
+    shardq_model_delete(&Model);
+}
+
+#define SHARDQ_STRESS_PRODUCERS         4
+#define SHARDQ_STRESS_CONSUMERS         4
+#define SHARDQ_STRESS_COUNT             50000
+
+static SHARDQ_MODEL shardq_stress_model;
+static SHARDQ_ITEM *shardq_stress_items;
+static volatile LONG shardq_stress_consumed, shardq_stress_cancelled;
+static volatile LONG shardq_stress_producing;
+
+static unsigned __stdcall shardq_stress_producer(void *Data)
+{
+    ULONG Producer = (ULONG)(UINT_PTR)Data;
+    SHARDQ_ITEM *Item;
+
+    for (ULONG I = 0; SHARDQ_STRESS_COUNT > I; I++)
+    {
+        Item = &shardq_stress_items[Producer * SHARDQ_STRESS_COUNT + I];
+        Item->Producer = Producer;
+        Item->Index = I;
+        shardq_post(&shardq_stress_model, FspShardQueueCurrentShard(shardq_stress_model.Queue),
+            Item);
+        if (0 == I % 64)
+            SwitchToThread();
+    }
+
+    InterlockedDecrement(&shardq_stress_producing);
+    return 0;
+}
+
+static unsigned __stdcall shardq_stress_consumer(void *Data)
+{
+    ULONG LastIndex[SHARDQ_STRESS_PRODUCERS];
+    SHARDQ_ITEM *Item;
+
+    memset(LastIndex, 0xff, sizeof LastIndex);
+
+    for (;;)
+    {
+        Item = shardq_next(&shardq_stress_model);
+        if (0 == Item)
+        {
+            if (shardq_stress_model.Stopped && 0 == FspShardQueueCount(shardq_stress_model.Queue))
+                break;
+            continue;
+        }
+
+        /* every item is delivered once; a consumer sees each producer's items in order */
+        ASSERT(0 == InterlockedExchange(&Item->Removed, 1));
+        ASSERT((ULONG)-1 == LastIndex[Item->Producer] || LastIndex[Item->Producer] < Item->Index);
+        LastIndex[Item->Producer] = Item->Index;
+        InterlockedIncrement(&shardq_stress_consumed);
+    }
+
+    return 0;
+}
+
+static unsigned __stdcall shardq_stress_canceller(void *Data)
+{
+    SHARDQ_ITEM *Item;
+
+    srand(0);
+    while (0 != shardq_stress_producing)
+    {
+        Item = &shardq_stress_items[
+            (ULONG)((ULONG)rand() * RAND_MAX + rand()) %
+                (SHARDQ_STRESS_PRODUCERS * SHARDQ_STRESS_COUNT)];
+        if (shardq_cancel(&shardq_stress_model, Item))
+        {
+            ASSERT(0 == InterlockedExchange(&Item->Removed, 1));
+            InterlockedIncrement(&shardq_stress_cancelled);
+        }
+    }
+
+    return 0;
+}
+
+static double shardq_stress_run(ULONG ShardCount, BOOLEAN Cancel)
+{
+    HANDLE Threads[SHARDQ_STRESS_PRODUCERS + SHARDQ_STRESS_CONSUMERS + 1];
+    ULONG ThreadCount = 0;
+    LARGE_INTEGER Frequency, StartCounter, EndCounter;
+
+    shardq_model_create(&shardq_stress_model, ShardCount);
+    shardq_stress_items = calloc(SHARDQ_STRESS_PRODUCERS * SHARDQ_STRESS_COUNT,
+        sizeof(SHARDQ_ITEM));
+    ASSERT(0 != shardq_stress_items);
+    shardq_stress_consumed = 0;
+    shardq_stress_cancelled = 0;
+    shardq_stress_producing = SHARDQ_STRESS_PRODUCERS;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&StartCounter);
+
+    for (ULONG I = 0; SHARDQ_STRESS_CONSUMERS > I; I++)
+    {
+        Threads[ThreadCount] = (HANDLE)_beginthreadex(0, 0,
+            shardq_stress_consumer, 0, 0, 0);
+        ASSERT(0 != Threads[ThreadCount]);
+        ThreadCount++;
+    }
+    for (ULONG I = 0; SHARDQ_STRESS_PRODUCERS > I; I++)
+    {
+        Threads[ThreadCount] = (HANDLE)_beginthreadex(0, 0,
+            shardq_stress_producer, (PVOID)(UINT_PTR)I, 0, 0);
+        ASSERT(0 != Threads[ThreadCount]);
+        ThreadCount++;
+    }
+    if (Cancel)
+    {
+        Threads[ThreadCount] = (HANDLE)_beginthreadex(0, 0,
+            shardq_stress_canceller, 0, 0, 0);
+        ASSERT(0 != Threads[ThreadCount]);
+        ThreadCount++;
+    }
+
+    WaitForMultipleObjects(SHARDQ_STRESS_PRODUCERS,
+        Threads + SHARDQ_STRESS_CONSUMERS, TRUE, INFINITE);
+    shardq_stress_model.Stopped = 1;
+    SetEvent(shardq_stress_model.Event);
+    WaitForMultipleObjects(ThreadCount, Threads, TRUE, INFINITE);
+
+    QueryPerformanceCounter(&EndCounter);
+
+    for (ULONG I = 0; ThreadCount > I; I++)
+        CloseHandle(Threads[I]);
+
+    ASSERT(SHARDQ_STRESS_PRODUCERS * SHARDQ_STRESS_COUNT ==
+        shardq_stress_consumed + shardq_stress_cancelled);
+    ASSERT(0 == FspShardQueueCount(shardq_stress_model.Queue));
+
+    free(shardq_stress_items);
+    shardq_stress_items = 0;
+    shardq_model_delete(&shardq_stress_model);
+
+    return (double)(EndCounter.QuadPart - StartCounter.QuadPart) / Frequency.QuadPart;
+}
+
+static void shardq_stress_test(void)
+{
+    SYSTEM_INFO SystemInfo;
+
+    GetSystemInfo(&SystemInfo);
+
+    shardq_stress_run(SystemInfo.dwNumberOfProcessors, TRUE);
+    shardq_stress_run(1, TRUE);
+}
+
+static void shardq_bench_test(void)
+{
+    SYSTEM_INFO SystemInfo;
+    double ShardedSeconds, SingleSeconds;
+
+    GetSystemInfo(&SystemInfo);
+
+    ShardedSeconds = shardq_stress_run(SystemInfo.dwNumberOfProcessors, FALSE);
+    SingleSeconds = shardq_stress_run(1, FALSE);
+
+    tlib_printf("%u items x %u producers x %u consumers: %u shards=%.3fs 1 shard=%.3fs",
+        SHARDQ_STRESS_COUNT, SHARDQ_STRESS_PRODUCERS, SHARDQ_STRESS_CONSUMERS,
+        SystemInfo.dwNumberOfProcessors, ShardedSeconds, SingleSeconds);
+}
+
+void shardq_tests(void)
+{
+    if (OptExternal)
+        return;
+
+    TEST(shardq_order_test);
+    TEST(shardq_wait_test);
+    TEST(shardq_stress_test);
+    TEST_OPT(shardq_bench_test);
+}
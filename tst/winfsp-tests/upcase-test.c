@@ -0,0 +1,233 @@
+/**
+ * @file upcase-test.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <winfsp/winfsp.h>
+#include <tlib/testsuite.h>
+#include <time.h>
+
+#include "winfsp-tests.h"
+
+/*
+ * The reference is the system's RtlUpcaseUnicodeChar (from ntdll), so these tests run as
+ * part of winfsp-tests on Windows only.
+ */
+typedef WCHAR NTAPI RTL_UPCASE_UNICODE_CHAR(WCHAR SourceCharacter);
+
+static RTL_UPCASE_UNICODE_CHAR *upcase_RtlUpcaseUnicodeChar;
+
+static BOOLEAN upcase_reference_init(void)
+{
+    HMODULE Module = GetModuleHandleW(L"ntdll.dll");
+    if (0 == Module)
+        return FALSE;
+
+    upcase_RtlUpcaseUnicodeChar =
+        (RTL_UPCASE_UNICODE_CHAR *)GetProcAddress(Module, "RtlUpcaseUnicodeChar");
+
+    return 0 != upcase_RtlUpcaseUnicodeChar;
+}
+
+/* scalar reference implementations: one character at a time */
+static BOOLEAN upcase_reference_equal(PWCH String1, PWCH String2, ULONG Count)
+{
+    for (ULONG I = 0; Count > I; I++)
+        if (upcase_RtlUpcaseUnicodeChar(String1[I]) != upcase_RtlUpcaseUnicodeChar(String2[I]))
+            return FALSE;
+    return TRUE;
+}
+
+static INT upcase_reference_compare(PWCH String1, ULONG Length1, PWCH String2, ULONG Length2)
+{
+    ULONG Count = Length1 < Length2 ? Length1 : Length2;
+    INT Result;
+    for (ULONG I = 0; Count > I; I++)
+    {
+        Result = (INT)upcase_RtlUpcaseUnicodeChar(String1[I]) -
+            (INT)upcase_RtlUpcaseUnicodeChar(String2[I]);
+        if (0 != Result)
+            return Result;
+    }
+    return (INT)Length1 - (INT)Length2;
+}
+
+static ULONG upcase_reference_hash(PWCH String, ULONG Count, ULONG Hash)
+{
+    for (ULONG I = 0; Count > I; I++)
+        Hash = (Hash ^ upcase_RtlUpcaseUnicodeChar(String[I])) * 16777619;
+    return Hash;
+}
+
+static void upcase_fill(PWCH Buffer, ULONG Count, BOOLEAN Ascii)
+{
+    /* include the characters around 'a'-'z' and 'A'-'Z' and some non-ASCII ones */
+    static WCHAR Alphabet[] = L"aAzZ`{@[_0."
+        L"\x00e9\x00c9\x00ff\x0131\x03b1\x0391\x0430\x0410\x007f\x0080\x8000\xffff";
+    ULONG AlphabetLength = Ascii ? 11 : sizeof Alphabet / sizeof(WCHAR) - 1;
+
+    for (ULONG I = 0; Count > I; I++)
+        Buffer[I] = Alphabet[rand() % AlphabetLength];
+}
+
+static void upcase_dotest(unsigned seed, ULONG Iterations)
+{
+    WCHAR String1[80], String2[80], Upcased[80];
+    ULONG Length1, Length2, Count;
+
+    srand(seed);
+
+    for (ULONG Iteration = 0; Iterations > Iteration; Iteration++)
+    {
+        BOOLEAN Ascii = 0 != rand() % 2;
+
+        Length1 = rand() % 72;
+        Length2 = 0 != rand() % 4 ? Length1 : rand() % 72;
+        upcase_fill(String1, Length1, Ascii);
+        upcase_fill(String2, Length2, Ascii);
+
+        /* make String2 mostly a case variant of String1, so that comparisons go deep */
+        for (ULONG I = 0; Length1 > I && Length2 > I; I++)
+            switch (rand() % 8)
+            {
+            case 0:
+                break;
+            case 1:
+                String2[I] = upcase_RtlUpcaseUnicodeChar(String1[I]);
+                break;
+            default:
+                String2[I] = String1[I];
+                break;
+            }
+
+        Count = Length1 < Length2 ? Length1 : Length2;
+
+        ASSERT(upcase_reference_equal(String1, String2, Count) ==
+            FspUpcaseEqual(String1, String2, Count));
+        ASSERT(upcase_reference_compare(String1, Length1, String2, Length2) ==
+            FspUpcaseCompare(String1, Length1, String2, Length2));
+        ASSERT(upcase_reference_hash(String1, Length1, 2166136261) ==
+            FspUpcaseHash(String1, Length1, 2166136261));
+
+        FspUpcaseChars(Upcased, String1, Length1);
+        for (ULONG I = 0; Length1 > I; I++)
+            ASSERT(upcase_RtlUpcaseUnicodeChar(String1[I]) == Upcased[I]);
+
+        /* in place */
+        memcpy(Upcased, String2, Length2 * sizeof(WCHAR));
+        FspUpcaseChars(Upcased, Upcased, Length2);
+        for (ULONG I = 0; Length2 > I; I++)
+            ASSERT(upcase_RtlUpcaseUnicodeChar(String2[I]) == Upcased[I]);
+    }
+}
+
+static void upcase_test(void)
+{
+    if (!upcase_reference_init())
+        return;
+
+    upcase_dotest((unsigned)time(0), 100000);
+}
+
+static void upcase_allchars_test(void)
+{
+    WCHAR Chars[256], Upcased[256];
+
+    if (!upcase_reference_init())
+        return;
+
+    for (ULONG Base = 0; 0x10000 > Base; Base += 256)
+    {
+        for (ULONG I = 0; 256 > I; I++)
+            Chars[I] = (WCHAR)(Base + I);
+
+        FspUpcaseChars(Upcased, Chars, 256);
+        for (ULONG I = 0; 256 > I; I++)
+            ASSERT(upcase_RtlUpcaseUnicodeChar(Chars[I]) == Upcased[I]);
+
+        ASSERT(upcase_reference_equal(Chars, Upcased, 256) ==
+            FspUpcaseEqual(Chars, Upcased, 256));
+        ASSERT(upcase_reference_compare(Chars, 256, Upcased, 256) ==
+            FspUpcaseCompare(Chars, 256, Upcased, 256));
+        ASSERT(upcase_reference_hash(Chars, 256, 2166136261) ==
+            FspUpcaseHash(Chars, 256, 2166136261));
+    }
+}
+
+static void upcase_bench_test(void)
+{
+    enum { NameCount = 100000, NameSize = 32, Rounds = 20 };
+    static ULONG Lengths[NameCount];
+    PWSTR Names1, Names2;
+    LARGE_INTEGER Frequency, StartCounter, EndCounter;
+    double Seconds[2];
+    ULONG Total[2];
+
+    if (!upcase_reference_init())
+        return;
+
+    Names1 = malloc(NameCount * NameSize * sizeof(WCHAR));
+    Names2 = malloc(NameCount * NameSize * sizeof(WCHAR));
+    ASSERT(0 != Names1 && 0 != Names2);
+    for (ULONG I = 0; NameCount > I; I++)
+    {
+        Lengths[I] = wsprintfW(Names1 + I * NameSize, L"Document-%u.txt", I);
+        wsprintfW(Names2 + I * NameSize, L"DOCUMENT-%u.TXT", I);
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+
+    for (int Impl = 0; 2 > Impl; Impl++)
+    {
+        Total[Impl] = 0;
+        QueryPerformanceCounter(&StartCounter);
+        for (ULONG R = 0; Rounds > R; R++)
+            for (ULONG I = 0; NameCount > I; I++)
+            {
+                PWCH P1 = Names1 + I * NameSize, P2 = Names2 + I * NameSize;
+                if (0 == Impl)
+                    Total[Impl] += FspUpcaseEqual(P1, P2, Lengths[I]) +
+                        (0 == FspUpcaseCompare(P1, Lengths[I], P2, Lengths[I])) +
+                        (FspUpcaseHash(P1, Lengths[I], 2166136261) & 1);
+                else
+                    Total[Impl] += upcase_reference_equal(P1, P2, Lengths[I]) +
+                        (0 == upcase_reference_compare(P1, Lengths[I], P2, Lengths[I])) +
+                        (upcase_reference_hash(P1, Lengths[I], 2166136261) & 1);
+            }
+        QueryPerformanceCounter(&EndCounter);
+        Seconds[Impl] = (double)(EndCounter.QuadPart - StartCounter.QuadPart) / Frequency.QuadPart;
+    }
+
+    ASSERT(Total[0] == Total[1]);
+
+    tlib_printf("equal+compare+hash: FspUpcase=%.3fs scalar=%.3fs", Seconds[0], Seconds[1]);
+
+    free(Names2);
+    free(Names1);
+}
+
+void upcase_tests(void)
+{
+    if (OptExternal)
+        return;
+
+    TEST(upcase_test);
+    TEST(upcase_allchars_test);
+    TEST_OPT(upcase_bench_test);
+}
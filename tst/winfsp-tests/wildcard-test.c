@@ -0,0 +1,276 @@
+/**
+ * @file wildcard-test.c
+ *
+ * @copyright 2015-2024 Bill Zissimopoulos
+ */
+/*
+ * This file is part of WinFsp.
+ *
+ * You can redistribute it and/or modify it under the terms of the GNU
+ * General Public License version 3 as published by the Free Software
+ * Foundation.
+ *
+ * Licensees holding a valid commercial license may use this software
+ * in accordance with the commercial license agreement provided in
+ * conjunction with the software.  The terms and conditions of any such
+ * commercial license agreement shall govern, supersede, and render
+ * ineffective any application of the GPLv3 license to this software,
+ * notwithstanding of any reference thereto in the software or
+ * associated repository.
+ */
+
+#include <winfsp/winfsp.h>
+#include <tlib/testsuite.h>
+#include <time.h>
+
+#include "winfsp-tests.h"
+
+typedef BOOLEAN NTAPI RTL_IS_NAME_IN_EXPRESSION(
+    PUNICODE_STRING Expression, PUNICODE_STRING Name, BOOLEAN IgnoreCase, PWCH UpcaseTable);
+typedef NTSTATUS NTAPI RTL_UPCASE_UNICODE_STRING(
+    PUNICODE_STRING DestinationString, PCUNICODE_STRING SourceString,
+    BOOLEAN AllocateDestinationString);
+
+static RTL_IS_NAME_IN_EXPRESSION *wildcard_RtlIsNameInExpression;
+static RTL_UPCASE_UNICODE_STRING *wildcard_RtlUpcaseUnicodeString;
+
+static BOOLEAN wildcard_reference_init(void)
+{
+    HMODULE Module = GetModuleHandleW(L"ntdll.dll");
+    if (0 == Module)
+        return FALSE;
+
+    wildcard_RtlIsNameInExpression =
+        (RTL_IS_NAME_IN_EXPRESSION *)GetProcAddress(Module, "RtlIsNameInExpression");
+    wildcard_RtlUpcaseUnicodeString =
+        (RTL_UPCASE_UNICODE_STRING *)GetProcAddress(Module, "RtlUpcaseUnicodeString");
+
+    return 0 != wildcard_RtlIsNameInExpression && 0 != wildcard_RtlUpcaseUnicodeString;
+}
+
+static BOOLEAN wildcard_reference(PWSTR Pattern, PWSTR FileName, BOOLEAN CaseInsensitive)
+{
+    /* RtlIsNameInExpression requires an upcased expression when ignoring case */
+    WCHAR PatternBuf[256];
+    UNICODE_STRING Expression, Name, Source;
+    NTSTATUS Result;
+
+    Source.Length = Source.MaximumLength = (USHORT)(wcslen(Pattern) * sizeof(WCHAR));
+    Source.Buffer = Pattern;
+    Expression.Length = 0;
+    Expression.MaximumLength = sizeof PatternBuf;
+    Expression.Buffer = PatternBuf;
+    if (CaseInsensitive)
+    {
+        Result = wildcard_RtlUpcaseUnicodeString(&Expression, &Source, FALSE);
+        ASSERT(0 <= Result);
+    }
+    else
+        Expression = Source;
+
+    Name.Length = Name.MaximumLength = (USHORT)(wcslen(FileName) * sizeof(WCHAR));
+    Name.Buffer = FileName;
+
+    return wildcard_RtlIsNameInExpression(&Expression, &Name, CaseInsensitive, 0);
+}
+
+static BOOLEAN wildcard_match(PWSTR Pattern, PWSTR FileName, BOOLEAN CaseInsensitive)
+{
+    FSP_FILE_NAME_PATTERN *CompiledPattern;
+    NTSTATUS Result;
+    BOOLEAN Match;
+
+    Result = FspFileNamePatternCompile(Pattern, (ULONG)-1, CaseInsensitive, &CompiledPattern);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    Match = FspFileNamePatternMatch(CompiledPattern, FileName, (ULONG)-1);
+
+    FspFileNamePatternDelete(CompiledPattern);
+
+    return Match;
+}
+
+static void wildcard_fixed_test(void)
+{
+    static struct
+    {
+        PWSTR Pattern, FileName;
+        BOOLEAN CaseInsensitive, Match;
+    } Tests[] =
+    {
+        /* plain names */
+        { L"file.txt", L"file.txt", FALSE, TRUE },
+        { L"file.txt", L"file.txt2", FALSE, FALSE },
+        { L"file.txt", L"FILE.TXT", FALSE, FALSE },
+        { L"file.txt", L"FILE.TXT", TRUE, TRUE },
+        /* star and question mark */
+        { L"*", L"a", FALSE, TRUE },
+        { L"*", L"a.b.c", FALSE, TRUE },
+        { L"**", L"abc", FALSE, TRUE },
+        { L"*.txt", L"file.txt", FALSE, TRUE },
+        { L"*.txt", L".txt", FALSE, TRUE },
+        { L"*.txt", L"file.txt.bak", FALSE, FALSE },
+        { L"*.txt", L"file.TXT", FALSE, FALSE },
+        { L"*.txt", L"file.TXT", TRUE, TRUE },
+        { L"abc*", L"abc", FALSE, TRUE },
+        { L"abc*", L"abcdef", FALSE, TRUE },
+        { L"abc*", L"abd", FALSE, FALSE },
+        { L"ab*yz", L"abyz", FALSE, TRUE },
+        { L"ab*yz", L"abxyz", FALSE, TRUE },
+        { L"ab*yz", L"abz", FALSE, FALSE },
+        { L"a?c", L"abc", FALSE, TRUE },
+        { L"a?c", L"ac", FALSE, FALSE },
+        { L"a?c", L"abbc", FALSE, FALSE },
+        { L"*.*", L"file", FALSE, FALSE },
+        { L"*.*", L"file.txt", FALSE, TRUE },
+        { L"*a*b*", L"xaxbx", FALSE, TRUE },
+        { L"*a*b*", L"xbxax", FALSE, FALSE },
+        /* DOS_STAR: does not consume the last dot */
+        { L"<.txt", L"file.txt", FALSE, TRUE },
+        { L"<.txt", L"a.b.txt", FALSE, TRUE },
+        { L"<\"*", L"file", FALSE, TRUE },
+        { L"<\"*", L"file.txt", FALSE, TRUE },
+        /* DOS_QM: matches zero characters at a dot or at the end */
+        { L"a>>>", L"a", FALSE, TRUE },
+        { L"a>>>", L"abcd", FALSE, TRUE },
+        { L"a>>>", L"abcde", FALSE, FALSE },
+        { L"a>>.c", L"a.c", FALSE, TRUE },
+        { L"a>>.c", L"ab.c", FALSE, TRUE },
+        { L"a>>.c", L"abcd.c", FALSE, FALSE },
+        /* DOS_DOT: matches a dot or zero characters at the end */
+        { L"a\"", L"a", FALSE, TRUE },
+        { L"a\"", L"a.", FALSE, TRUE },
+        { L"a\"", L"ab", FALSE, FALSE },
+    };
+
+    for (ULONG I = 0; sizeof Tests / sizeof Tests[0] > I; I++)
+    {
+        BOOLEAN Match = wildcard_match(Tests[I].Pattern, Tests[I].FileName, Tests[I].CaseInsensitive);
+        if (Tests[I].Match != Match)
+            tlib_printf("pattern=\"%S\" name=\"%S\" ci=%d expect=%d",
+                Tests[I].Pattern, Tests[I].FileName,
+                Tests[I].CaseInsensitive, Tests[I].Match);
+        ASSERT(Tests[I].Match == Match);
+    }
+}
+
+static void wildcard_reference_dotest(unsigned seed, ULONG Count, BOOLEAN CaseInsensitive)
+{
+    static WCHAR PatternAlphabet[] = L"aB.*?<>\"\x00e9";
+    static WCHAR NameAlphabet[] = L"abAB.\x00e9\x00c9";
+    WCHAR Pattern[16], FileName[16];
+    FSP_FILE_NAME_PATTERN *CompiledPattern;
+    NTSTATUS Result;
+    ULONG N;
+
+    srand(seed);
+
+    for (ULONG I = 0; Count > I; I++)
+    {
+        N = rand() % 10;
+        for (ULONG J = 0; N > J; J++)
+            Pattern[J] = PatternAlphabet[rand() % (sizeof PatternAlphabet / sizeof(WCHAR) - 1)];
+        Pattern[N] = L'\0';
+        if (0 == N)
+            continue;
+
+        Result = FspFileNamePatternCompile(Pattern, (ULONG)-1, CaseInsensitive, &CompiledPattern);
+        ASSERT(STATUS_SUCCESS == Result);
+
+        for (ULONG K = 0; 16 > K; K++)
+        {
+            N = 1 + rand() % 10;
+            for (ULONG J = 0; N > J; J++)
+                FileName[J] = NameAlphabet[rand() % (sizeof NameAlphabet / sizeof(WCHAR) - 1)];
+            FileName[N] = L'\0';
+
+            BOOLEAN Match = FspFileNamePatternMatch(CompiledPattern, FileName, N);
+            BOOLEAN Expect = wildcard_reference(Pattern, FileName, CaseInsensitive);
+            if (Expect != Match)
+                tlib_printf("pattern=\"%S\" name=\"%S\" ci=%d expect=%d",
+                    Pattern, FileName, CaseInsensitive, Expect);
+            ASSERT(Expect == Match);
+        }
+
+        FspFileNamePatternDelete(CompiledPattern);
+    }
+}
+
+static void wildcard_reference_test(void)
+{
+    if (!wildcard_reference_init())
+        return;
+
+    unsigned seed = (unsigned)time(0);
+
+    wildcard_reference_dotest(seed, 10000, FALSE);
+    wildcard_reference_dotest(seed, 10000, TRUE);
+}
+
+static void wildcard_bench_test(void)
+{
+    static PWSTR Patterns[] = { L"*.txt", L"file1*", L"*1?.*", L"<.dat", 0 };
+    enum { NameCount = 100000, Rounds = 10 };
+    PWSTR Names;
+    FSP_FILE_NAME_PATTERN *CompiledPattern;
+    UNICODE_STRING Expression, Name;
+    LARGE_INTEGER Frequency, StartCounter, EndCounter;
+    double CompiledSeconds, ReferenceSeconds;
+    ULONG CompiledCount, ReferenceCount;
+    NTSTATUS Result;
+
+    if (!wildcard_reference_init())
+        return;
+
+    Names = malloc(NameCount * 32 * sizeof(WCHAR));
+    ASSERT(0 != Names);
+    for (ULONG I = 0; NameCount > I; I++)
+        wsprintfW(Names + I * 32, L"file%u.%s", I, 0 == I % 3 ? L"txt" : L"dat");
+
+    QueryPerformanceFrequency(&Frequency);
+
+    for (PWSTR *Pattern = Patterns; 0 != *Pattern; Pattern++)
+    {
+        Result = FspFileNamePatternCompile(*Pattern, (ULONG)-1, FALSE, &CompiledPattern);
+        ASSERT(STATUS_SUCCESS == Result);
+
+        CompiledCount = 0;
+        QueryPerformanceCounter(&StartCounter);
+        for (ULONG R = 0; Rounds > R; R++)
+            for (ULONG I = 0; NameCount > I; I++)
+                CompiledCount += FspFileNamePatternMatch(CompiledPattern, Names + I * 32, (ULONG)-1);
+        QueryPerformanceCounter(&EndCounter);
+        CompiledSeconds = (double)(EndCounter.QuadPart - StartCounter.QuadPart) / Frequency.QuadPart;
+
+        FspFileNamePatternDelete(CompiledPattern);
+
+        Expression.Length = Expression.MaximumLength = (USHORT)(wcslen(*Pattern) * sizeof(WCHAR));
+        Expression.Buffer = *Pattern;
+        ReferenceCount = 0;
+        QueryPerformanceCounter(&StartCounter);
+        for (ULONG R = 0; Rounds > R; R++)
+            for (ULONG I = 0; NameCount > I; I++)
+            {
+                Name.Length = Name.MaximumLength = (USHORT)(wcslen(Names + I * 32) * sizeof(WCHAR));
+                Name.Buffer = Names + I * 32;
+                ReferenceCount += wildcard_RtlIsNameInExpression(&Expression, &Name, FALSE, 0);
+            }
+        QueryPerformanceCounter(&EndCounter);
+        ReferenceSeconds = (double)(EndCounter.QuadPart - StartCounter.QuadPart) / Frequency.QuadPart;
+
+        tlib_printf("pattern=\"%S\" matches=%u compiled=%.3fs RtlIsNameInExpression=%.3fs",
+            *Pattern, CompiledCount, CompiledSeconds, ReferenceSeconds);
+    }
+
+    free(Names);
+}
+
+void wildcard_tests(void)
+{
+    if (OptExternal)
+        return;
+
+    TEST(wildcard_fixed_test);
+    TEST(wildcard_reference_test);
+    TEST_OPT(wildcard_bench_test);
+}
@@ -19,12 +19,13 @@
  * associated repository.
  */
 
-#include <windows.h>
+#include <winfsp/winfsp.h>
 #include <dbghelp.h>
 #include <lm.h>
 #include <signal.h>
 #include <tlib/testsuite.h>
 #include <time.h>
+#include "memfs.h"
 
 #define WINFSP_TESTS_NO_HOOKS
 #include "winfsp-tests.h"
@@ -116,6 +117,96 @@ VOID GetTestDirectoryEx(PWSTR DirBuf, ULONG DirBufSize, PWSTR DriveBuf)
     }
 }
 
+HANDLE trace_tempfile(void)
+{
+    WCHAR TempPath[MAX_PATH], TempFileName[MAX_PATH];
+    HANDLE Handle;
+
+    ASSERT(0 != GetTempPathW(MAX_PATH, TempPath));
+    ASSERT(0 != GetTempFileNameW(TempPath, L"fsp", 0, TempFileName));
+
+    Handle = CreateFileW(TempFileName,
+        GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, 0,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, 0);
+    ASSERT(INVALID_HANDLE_VALUE != Handle);
+
+    return Handle;
+}
+
+void trace_record(UINT32 Kind, UINT64 Hint, UINT64 UserContext2,
+    NTSTATUS Status, UINT64 OpenedUserContext2)
+{
+    /*
+     * Log a request/response pair for \file.txt to the active trace. UserContext2 is the
+     * file context of the request (unused for Create); OpenedUserContext2 is the file
+     * context returned by a Create.
+     */
+
+    union
+    {
+        FSP_FSCTL_TRANSACT_REQ V;
+        UINT8 B[sizeof(FSP_FSCTL_TRANSACT_REQ) + 64];
+    } RequestBuf;
+    FSP_FSCTL_TRANSACT_REQ *Request = &RequestBuf.V;
+    FSP_FSCTL_TRANSACT_RSP Response;
+
+    memset(&RequestBuf, 0, sizeof RequestBuf);
+    Request->Version = sizeof(FSP_FSCTL_TRANSACT_REQ);
+    Request->Size = sizeof(FSP_FSCTL_TRANSACT_REQ) + sizeof L"\\file.txt";
+    Request->Kind = Kind;
+    Request->Hint = Hint;
+    Request->FileName.Offset = 0;
+    Request->FileName.Size = sizeof L"\\file.txt";
+    memcpy(Request->Buffer, L"\\file.txt", sizeof L"\\file.txt");
+    switch (Kind)
+    {
+    case FspFsctlTransactCreateKind:
+        Request->Req.Create.CreateOptions = FILE_OPEN_IF << 24;
+        Request->Req.Create.FileAttributes = FILE_ATTRIBUTE_NORMAL;
+        Request->Req.Create.DesiredAccess = FILE_GENERIC_READ | FILE_GENERIC_WRITE;
+        Request->Req.Create.ShareAccess = FILE_SHARE_READ;
+        Request->Req.Create.AccessToken = 0xdeadbeef; /* replaced during replay */
+        Request->Req.Create.UserMode = 1;
+        Request->Req.Create.HasTraversePrivilege = 1;
+        break;
+    case FspFsctlTransactReadKind:
+        Request->Req.Read.UserContext2 = UserContext2;
+        Request->Req.Read.Offset = 0;
+        Request->Req.Read.Length = 4096;
+        break;
+    case FspFsctlTransactWriteKind:
+        Request->Req.Write.UserContext2 = UserContext2;
+        Request->Req.Write.Offset = 0;
+        Request->Req.Write.Length = 4096;
+        break;
+    default:
+        /* Cleanup, Close: file context only */
+        Request->Req.Close.UserContext2 = UserContext2;
+        break;
+    }
+    FspDebugLogRequest(Request);
+
+    memset(&Response, 0, sizeof Response);
+    Response.Size = sizeof Response;
+    Response.Kind = Kind;
+    Response.Hint = Hint;
+    Response.IoStatus.Status = Status;
+    if (FspFsctlTransactCreateKind == Kind)
+        Response.Rsp.Create.Opened.UserContext2 = OpenedUserContext2;
+    FspDebugLogResponse(&Response);
+}
+
+void *memfs_create_detached(void)
+{
+    MEMFS *Memfs;
+    NTSTATUS Result;
+
+    Result = MemfsCreate(MemfsDisk | MemfsDetached, INFINITE, 1024, 1024 * 1024, 0, 0, &Memfs);
+    ASSERT(STATUS_SUCCESS == Result);
+
+    return Memfs;
+}
+
 static VOID DisableBackupRestorePrivileges(VOID)
 {
     union
@@ -226,12 +317,24 @@ int main(int argc, char *argv[])
     TESTSUITE(fuse_tests);
     TESTSUITE(posix_tests);
     TESTSUITE(uuid5_tests);
+    TESTSUITE(dataring_tests);
+    TESTSUITE(nametab_tests);
+    TESTSUITE(bufpool_tests);
+    TESTSUITE(shardq_tests);
+    TESTSUITE(wildcard_tests);
+    TESTSUITE(upcase_tests);
+    TESTSUITE(rpcache_tests);
+    TESTSUITE(hpp_tests);
+    TESTSUITE(opstat_tests);
     TESTSUITE(eventlog_tests);
+    TESTSUITE(debuglog_trace_tests);
     TESTSUITE(path_tests);
     TESTSUITE(dirbuf_tests);
     TESTSUITE(version_tests);
     TESTSUITE(launch_tests);
     TESTSUITE(launcher_ptrans_tests);
+    TESTSUITE(launcher_insttab_tests);
+    TESTSUITE(launcher_regrec_tests);
     TESTSUITE(mount_tests);
     TESTSUITE(timeout_tests);
     TESTSUITE(memfs_tests);
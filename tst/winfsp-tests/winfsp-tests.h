@@ -202,6 +202,13 @@ void *memfs_start_ex(ULONG Flags, ULONG FileInfoTimeout);
 void *memfs_start(ULONG Flags);
 void memfs_stop(void *data);
 PWSTR memfs_volumename(void *data);
+void *memfs_create_detached(void);
+
+#if defined(WINFSP_WINFSP_H_INCLUDED)
+HANDLE trace_tempfile(void);
+void trace_record(UINT32 Kind, UINT64 Hint, UINT64 UserContext2,
+    NTSTATUS Status, UINT64 OpenedUserContext2);
+#endif
 
 int mywcscmp(PWSTR a, int alen, PWSTR b, int blen);
 int myrand(void);